@@ -26,6 +26,7 @@
 #include <vmm_stdio.h>
 #include <vmm_host_irq.h>
 #include <vmm_scheduler.h>
+#include <vmm_vcpu_stats.h>
 #include <cpu_inline_asm.h>
 #include <cpu_vcpu_excep.h>
 #include <cpu_vcpu_emulate.h>
@@ -106,6 +107,33 @@ void do_data_abort(arch_regs_t *regs)
 	vmm_panic("%s: please reboot ...\n", __func__);
 }
 
+static u32 do_hyp_trap_exit_reason(u32 ec)
+{
+	switch (ec) {
+	case EC_TRAP_WFI_WFE:
+		return VMM_VCPU_EXIT_WFI;
+	case EC_TRAP_MCR_MRC_CP15:
+	case EC_TRAP_MCRR_MRRC_CP15:
+	case EC_TRAP_MCR_MRC_CP14:
+	case EC_TRAP_LDC_STC_CP14:
+	case EC_TRAP_CP0_TO_CP13:
+	case EC_TRAP_VMRS:
+	case EC_TRAP_MRRC_CP14:
+		return VMM_VCPU_EXIT_SYSREG;
+	case EC_TRAP_JAZELLE:
+	case EC_TRAP_BXJ:
+		return VMM_VCPU_EXIT_INSN;
+	case EC_TRAP_HVC:
+	case EC_TRAP_SMC:
+		return VMM_VCPU_EXIT_HYPERCALL;
+	case EC_TRAP_STAGE2_INST_ABORT:
+	case EC_TRAP_STAGE2_DATA_ABORT:
+		return VMM_VCPU_EXIT_STAGE2_FAULT;
+	default:
+		return VMM_VCPU_EXIT_UNKNOWN;
+	};
+}
+
 void do_hyp_trap(arch_regs_t *regs)
 {
 	int rc = VMM_OK;
@@ -139,6 +167,8 @@ void do_hyp_trap(arch_regs_t *regs)
 
 	vmm_scheduler_irq_enter(regs, TRUE);
 
+	vmm_vcpu_exit_begin(vcpu);
+
 	switch (ec) {
 	case EC_UNKNOWN:
 		/* We dont expect to get this trap so error */
@@ -235,15 +265,23 @@ void do_hyp_trap(arch_regs_t *regs)
 		}
 	}
 
+	vmm_vcpu_exit_end(vcpu, do_hyp_trap_exit_reason(ec));
+
 	vmm_scheduler_irq_exit(regs);
 }
 
 void do_irq(arch_regs_t *regs)
 {
+	struct vmm_vcpu *vcpu = vmm_scheduler_current_vcpu();
+
 	vmm_scheduler_irq_enter(regs, FALSE);
 
+	vmm_vcpu_exit_begin(vcpu);
+
 	vmm_host_active_irq_exec(CPU_EXTERNAL_IRQ);
 
+	vmm_vcpu_exit_end(vcpu, VMM_VCPU_EXIT_IRQ);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
@@ -1092,3 +1092,29 @@ void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu)
 {
 	/* For now no arch specific stats */
 }
+
+bool arch_vcpu_regs_sample(arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *fp)
+{
+	*pc = regs->pc;
+	*fp = regs->gpr[11];
+
+	return ((regs->cpsr & CPSR_MODE_MASK) != CPSR_MODE_HYPERVISOR) ?
+								TRUE : FALSE;
+}
+
+int arch_vcpu_unwind_frame(virtual_addr_t stack_lo, virtual_addr_t stack_hi,
+			   virtual_addr_t *fp, virtual_addr_t *pc)
+{
+	virtual_addr_t frame = *fp;
+
+	/* APCS frame: fp[-3] = caller fp, fp[-1] = return address */
+	if ((frame < (stack_lo + 12)) || (stack_hi <= frame) || (frame & 0x3)) {
+		return VMM_EINVALID;
+	}
+
+	*fp = *(u32 *)(frame - 12);
+	*pc = *(u32 *)(frame - 4);
+
+	return VMM_OK;
+}
@@ -81,4 +81,15 @@ static inline unsigned long emulate_psci_get_mpidr(struct vmm_vcpu *vcpu)
 	return arm_priv(vcpu)->cp15.c0_mpidr;
 }
 
+static inline physical_addr_t emulate_psci_pvtime_addr(struct vmm_vcpu *vcpu)
+{
+	/* PV time is only defined for AArch64 guests */
+	return 0;
+}
+
+static inline u64 *emulate_psci_pvtime_last(struct vmm_vcpu *vcpu)
+{
+	return NULL;
+}
+
 #endif	/* __CPU_EMULATE_PSCI_H__ */
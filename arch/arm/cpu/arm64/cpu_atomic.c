@@ -26,6 +26,19 @@
 #include <vmm_compiler.h>
 #include <arch_barrier.h>
 #include <arch_atomic.h>
+#include <cpu_inline_asm.h>
+#include <cpu_lse.h>
+
+#ifdef CONFIG_ARM64_LSE_ATOMICS
+bool cpu_lse_atomics_available __read_mostly = FALSE;
+#endif
+
+void __init cpu_lse_init(void)
+{
+#ifdef CONFIG_ARM64_LSE_ATOMICS
+	cpu_lse_atomics_available = cpu_supports_lse_atomics();
+#endif
+}
 
 long __lock arch_atomic_read(atomic_t *atom)
 {
@@ -45,6 +58,14 @@ void __lock arch_atomic_add(atomic_t *atom, long value)
 	unsigned int tmp;
 	long result;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	stadd	%w1, %0\n"
+		: "+Q" (atom->counter)
+		: "r" (value));
+		return;
+	}
+
 	asm volatile("// atomic_add\n"
 "1:	ldxr	%w0, [%3]\n"
 "	add	%w0, %w0, %w4\n"
@@ -60,6 +81,14 @@ void __lock arch_atomic_sub(atomic_t *atom, long value)
 	unsigned int tmp;
 	long result;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	neg	%w1, %w1\n"
+"	stadd	%w1, %0\n"
+		: "+Q" (atom->counter), "+&r" (value));
+		return;
+	}
+
 	asm volatile("// atomic_sub\n"
 "1:	ldxr	%w0, [%3]\n"
 "	sub	%w0, %w0, %w4\n"
@@ -75,6 +104,16 @@ long __lock arch_atomic_add_return(atomic_t *atom, long value)
 	unsigned int tmp;
 	long result;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	ldaddal	%w2, %w0, %1\n"
+"	add	%w0, %w0, %w2\n"
+		: "=&r" (result), "+Q" (atom->counter)
+		: "r" (value)
+		: "memory");
+		return result;
+	}
+
 	asm volatile("// atomic_add_return\n"
 "1:	ldaxr	%w0, [%3]\n"
 "	add	%w0, %w0, %w4\n"
@@ -92,6 +131,17 @@ long __lock arch_atomic_sub_return(atomic_t *atom, long value)
 	unsigned int tmp;
 	long result;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	neg	%w2, %w2\n"
+"	ldaddal	%w2, %w0, %1\n"
+"	add	%w0, %w0, %w2\n"
+		: "=&r" (result), "+Q" (atom->counter), "+&r" (value)
+		:
+		: "memory");
+		return result;
+	}
+
 	asm volatile("// atomic_sub_return\n"
 "1:	ldaxr	%w0, [%3]\n"
 "	sub	%w0, %w0, %w4\n"
@@ -109,6 +159,15 @@ long __lock arch_atomic_xchg(atomic_t *atom, long newval)
 	unsigned int tmp;
 	long previous;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	swpal	%w2, %w0, %1\n"
+		: "=&r" (previous), "+Q" (atom->counter)
+		: "r" (newval)
+		: "memory");
+		return previous;
+	}
+
 	asm volatile("// atomic_xchg\n"
 "1:	ldaxr	%w1, [%3]\n"
 "	stlxr	%w0, %w4, [%3]\n"
@@ -125,6 +184,16 @@ long __lock arch_atomic_cmpxchg(atomic_t *atom, long oldval, long newval)
 	unsigned int tmp;
 	long previous;
 
+	if (cpu_lse_atomics()) {
+		previous = oldval;
+		asm volatile(ARM64_LSE_PREAMBLE
+"	casal	%w0, %w2, %1\n"
+		: "+&r" (previous), "+Q" (atom->counter)
+		: "r" (newval)
+		: "memory");
+		return previous;
+	}
+
 	asm volatile("// atomic_cmpxchg\n"
 "1:	ldaxr	%w1, [%3]\n"
 "	cmp	%w1, %w4\n"
@@ -34,6 +34,7 @@
 #include <arch_cpu_irq.h>
 #include <arch_barrier.h>
 #include <arch_atomic64.h>
+#include <cpu_lse.h>
 
 u64 __lock arch_atomic64_read(atomic64_t *atom)
 {
@@ -49,6 +50,14 @@ void __lock arch_atomic64_add(atomic64_t *atom, u64 value)
 {
 	u64 result, tmp;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	stadd	%1, %0\n"
+		: "+Q" (atom->counter)
+		: "r" (value));
+		return;
+	}
+
 	asm volatile("// atomic64_add\n"
 "1:	ldxr	%0, %2\n"
 "	add	%0, %0, %3\n"
@@ -63,6 +72,14 @@ void __lock arch_atomic64_sub(atomic64_t *atom, u64 value)
 {
 	u64 result, tmp;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	neg	%1, %1\n"
+"	stadd	%1, %0\n"
+		: "+Q" (atom->counter), "+&r" (value));
+		return;
+	}
+
 	asm volatile("// atomic64_sub\n"
 "1:	ldxr	%0, %2\n"
 "	sub	%0, %0, %3\n"
@@ -77,6 +94,16 @@ u64 __lock arch_atomic64_add_return(atomic64_t *atom, u64 value)
 {
 	u64 result, tmp;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	ldaddal	%2, %0, %1\n"
+"	add	%0, %0, %2\n"
+		: "=&r" (result), "+Q" (atom->counter)
+		: "r" (value)
+		: "memory");
+		return result;
+	}
+
 	asm volatile("// atomic64_add_return\n"
 "1:	ldaxr	%0, %2\n"
 "	add	%0, %0, %3\n"
@@ -93,6 +120,17 @@ u64 __lock arch_atomic64_sub_return(atomic64_t *atom, u64 value)
 {
 	u64 result, tmp;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	neg	%2, %2\n"
+"	ldaddal	%2, %0, %1\n"
+"	add	%0, %0, %2\n"
+		: "=&r" (result), "+Q" (atom->counter), "+&r" (value)
+		:
+		: "memory");
+		return result;
+	}
+
 	asm volatile("// atomic64_sub_return\n"
 "1:	ldaxr	%0, %2\n"
 "	sub	%0, %0, %3\n"
@@ -110,6 +148,15 @@ u64 __lock arch_atomic64_xchg(atomic64_t *atom, u64 newval)
 	u64 previous;
 	unsigned long res;
 
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	swpal	%2, %0, %1\n"
+		: "=&r" (previous), "+Q" (atom->counter)
+		: "r" (newval)
+		: "memory");
+		return previous;
+	}
+
 	asm volatile("// atomic64_xchg\n"
 "1:	ldaxr	%1, %2\n"
 "	stlxr	%w0, %3, %2\n"
@@ -126,6 +173,16 @@ u64 __lock arch_atomic64_cmpxchg(atomic64_t *atom, u64 oldval, u64 newval)
 	u64 previous;
 	unsigned long res;
 
+	if (cpu_lse_atomics()) {
+		previous = oldval;
+		asm volatile(ARM64_LSE_PREAMBLE
+"	casal	%0, %2, %1\n"
+		: "+&r" (previous), "+Q" (atom->counter)
+		: "r" (newval)
+		: "memory");
+		return previous;
+	}
+
 	asm volatile("// atomic64_cmpxchg\n"
 "1:	ldaxr	%1, %2\n"
 "	cmp	%1, %3\n"
@@ -27,6 +27,7 @@
 #include <vmm_devtree.h>
 #include <arch_cpu.h>
 #include <arm_psci.h>
+#include <cpu_lse.h>
 
 extern u8 _code_start;
 extern u8 _code_end;
@@ -52,6 +53,9 @@ int __init arch_cpu_nascent_init(void)
 {
 	/* Host aspace, Heap, and Device tree available. */
 
+	/* Select LSE atomics if available */
+	cpu_lse_init();
+
 	/* Do PSCI init */
 	psci_init();
 
@@ -26,6 +26,7 @@
 #include <vmm_stdio.h>
 #include <vmm_host_irq.h>
 #include <vmm_scheduler.h>
+#include <vmm_vcpu_stats.h>
 #include <cpu_inline_asm.h>
 #include <cpu_vcpu_excep.h>
 #include <cpu_vcpu_emulate.h>
@@ -59,6 +60,35 @@ void do_bad_mode(arch_regs_t *regs, unsigned long mode)
 	vmm_panic("%s: please reboot ...\n", __func__);
 }
 
+static u32 do_sync_exit_reason(u32 ec)
+{
+	switch (ec) {
+	case EC_TRAP_WFI_WFE:
+		return VMM_VCPU_EXIT_WFI;
+	case EC_TRAP_MCR_MRC_CP15_A32:
+	case EC_TRAP_MCRR_MRRC_CP15_A32:
+	case EC_TRAP_MCR_MRC_CP14_A32:
+	case EC_TRAP_LDC_STC_CP14_A32:
+	case EC_SIMD_FPU:
+	case EC_FPEXC_A32:
+	case EC_FPEXC_A64:
+	case EC_TRAP_MRC_VMRS_CP10_A32:
+	case EC_TRAP_MCRR_MRRC_CP14_A32:
+	case EC_TRAP_MSR_MRS_SYSTEM:
+		return VMM_VCPU_EXIT_SYSREG;
+	case EC_TRAP_SMC_A32:
+	case EC_TRAP_SMC_A64:
+	case EC_TRAP_HVC_A32:
+	case EC_TRAP_HVC_A64:
+		return VMM_VCPU_EXIT_HYPERCALL;
+	case EC_TRAP_LWREL_INST_ABORT:
+	case EC_TRAP_LWREL_DATA_ABORT:
+		return VMM_VCPU_EXIT_STAGE2_FAULT;
+	default:
+		return VMM_VCPU_EXIT_UNKNOWN;
+	};
+}
+
 void do_sync(arch_regs_t *regs, unsigned long mode)
 {
 	int rc = VMM_OK;
@@ -99,6 +129,8 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 
 	vmm_scheduler_irq_enter(regs, TRUE);
 
+	vmm_vcpu_exit_begin(vcpu);
+
 	switch (ec) {
 	case EC_UNKNOWN:
 		/* We dont expect to get this trap so error */
@@ -213,15 +245,23 @@ void do_sync(arch_regs_t *regs, unsigned long mode)
 		}
 	}
 
+	vmm_vcpu_exit_end(vcpu, do_sync_exit_reason(ec));
+
 	vmm_scheduler_irq_exit(regs);
 }
 
 void do_irq(arch_regs_t *regs)
 {
+	struct vmm_vcpu *vcpu = vmm_scheduler_current_vcpu();
+
 	vmm_scheduler_irq_enter(regs, FALSE);
 
+	vmm_vcpu_exit_begin(vcpu);
+
 	vmm_host_active_irq_exec(EXC_HYP_IRQ_SPx);
 
+	vmm_vcpu_exit_end(vcpu, VMM_VCPU_EXIT_IRQ);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
@@ -19,176 +19,328 @@
  * @file cpu_locks.c
  * @author Sukanto Ghosh (sukantoghosh@gmail.com)
  * @brief ARM64 specific synchronization mechanisms.
+ *
+ * Spinlocks are ticket locks so that contending CPUs acquire the lock
+ * in FIFO order. Rwlocks are queued rwlocks which use a ticket lock
+ * to order contending readers and writers.
+ *
+ * Both are implemented using exclusive load/store loops or ARMv8.1
+ * LSE atomics depending on what was selected at boot time.
  */
 
 #include <vmm_error.h>
 #include <vmm_types.h>
 #include <vmm_smp.h>
 #include <vmm_compiler.h>
+#include <vmm_scheduler.h>
 #include <arch_barrier.h>
+#include <cpu_lse.h>
 
 bool __lock arch_spin_lock_check(arch_spinlock_t *lock)
 {
+	arch_spinlock_t lockval;
+
 	arch_smp_mb();
-	return (lock->lock == __ARCH_SPIN_UNLOCKED) ? FALSE : TRUE;
+	lockval.slock = lock->slock;
+	return (lockval.tickets.owner == lockval.tickets.next) ? FALSE : TRUE;
 }
 
 void __lock arch_spin_lock(arch_spinlock_t *lock)
 {
-	u32 cpu = vmm_smp_processor_id();
-	unsigned long tmp;
+	unsigned int lockval, newval, tmp;
+
+	/* Take a ticket */
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	mov	%w2, %w4\n"
+"	ldadda	%w2, %w0, %3\n"
+		: "=&r" (lockval), "=&r" (newval), "=&r" (tmp),
+		  "+Q" (lock->slock)
+		: "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
+		: "memory");
+	} else {
+		asm volatile(
+"	prfm	pstl1strm, %3\n"
+"1:	ldaxr	%w0, %3\n"
+"	add	%w1, %w0, %w4\n"
+"	stxr	%w2, %w1, %3\n"
+"	cbnz	%w2, 1b\n"
+		: "=&r" (lockval), "=&r" (newval), "=&r" (tmp),
+		  "+Q" (lock->slock)
+		: "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
+		: "memory");
+	}
 
-	__asm__ __volatile__(
+	/* Wait for our ticket to be served */
+	asm volatile(
+"	eor	%w1, %w0, %w0, ror #16\n"
+"	cbz	%w1, 2f\n"
 "	sevl\n"
 "1:	wfe\n"
-"2:	ldaxr	%w0, %1\n"
-"	cmp	%w0, %w3\n"
-"	b.ne	1b\n"
-"	stxr	%w0, %w2, %1\n"
-"	cbnz	%w0, 2b\n"
-	: "=&r" (tmp), "+Q" (lock->lock)
-	: "r" (cpu), "r" (__ARCH_SPIN_UNLOCKED)
-	: "cc", "memory");
+"	ldaxrh	%w2, %3\n"
+"	eor	%w1, %w2, %w0, lsr #16\n"
+"	cbnz	%w1, 1b\n"
+"2:\n"
+	: "+r" (lockval), "=&r" (newval), "=&r" (tmp)
+	: "Q" (lock->tickets.owner)
+	: "memory");
 }
 
 int arch_spin_trylock(arch_spinlock_t *lock)
 {
-	u32 cpu = vmm_smp_processor_id();
+	unsigned int lockval, tmp;
+
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	ldr	%w0, %2\n"
+"	eor	%w1, %w0, %w0, ror #16\n"
+"	cbnz	%w1, 1f\n"
+"	add	%w1, %w0, %3\n"
+"	casa	%w0, %w1, %2\n"
+"	sub	%w1, %w1, %3\n"
+"	eor	%w1, %w1, %w0\n"
+"1:\n"
+		: "=&r" (lockval), "=&r" (tmp), "+Q" (lock->slock)
+		: "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
+		: "memory");
+	} else {
+		asm volatile(
+"	prfm	pstl1strm, %2\n"
+"1:	ldaxr	%w0, %2\n"
+"	eor	%w1, %w0, %w0, ror #16\n"
+"	cbnz	%w1, 2f\n"
+"	add	%w0, %w0, %3\n"
+"	stxr	%w1, %w0, %2\n"
+"	cbnz	%w1, 1b\n"
+"2:\n"
+		: "=&r" (lockval), "=&r" (tmp), "+Q" (lock->slock)
+		: "I" (1 << __ARCH_SPIN_TICKET_SHIFT)
+		: "memory");
+	}
+
+	return (tmp == 0) ? 1 : 0;
+}
+
+void __lock arch_spin_unlock(arch_spinlock_t *lock)
+{
 	unsigned int tmp;
 
+	/* Serve the next ticket */
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	mov	%w1, #1\n"
+"	staddlh	%w1, %0\n"
+		: "+Q" (lock->tickets.owner), "=&r" (tmp)
+		:
+		: "memory");
+	} else {
+		asm volatile(
+"	ldrh	%w1, %0\n"
+"	add	%w1, %w1, #1\n"
+"	stlrh	%w1, %0\n"
+		: "+Q" (lock->tickets.owner), "=&r" (tmp)
+		:
+		: "memory");
+	}
+}
+
+static inline u32 rw_cmpxchg_acquire(volatile u32 *cnts, u32 old, u32 new)
+{
+	u32 prev, tmp;
+
+	if (cpu_lse_atomics()) {
+		prev = old;
+		asm volatile(ARM64_LSE_PREAMBLE
+"	casa	%w0, %w2, %1\n"
+		: "+&r" (prev), "+Q" (*cnts)
+		: "r" (new)
+		: "memory");
+		return prev;
+	}
+
 	asm volatile(
-"	ldaxr	%w0, %1\n"
+"1:	ldaxr	%w0, %2\n"
 "	cmp	%w0, %w3\n"
-"	b.ne	1f\n"
-"	stxr	%w0, %w2, %1\n"
-"	b	2f\n"
-"1:	mov	%w0, #1\n"
+"	b.ne	2f\n"
+"	stxr	%w1, %w4, %2\n"
+"	cbnz	%w1, 1b\n"
 "2:\n"
-	: "=&r" (tmp), "+Q" (lock->lock)
-	: "r" (cpu), "r" (__ARCH_SPIN_UNLOCKED)
+	: "=&r" (prev), "=&r" (tmp), "+Q" (*cnts)
+	: "r" (old), "r" (new)
 	: "cc", "memory");
 
-	if (tmp == 0) {
-		return 1;
-	} else {
-		return 0;
+	return prev;
+}
+
+static inline u32 rw_add_return_acquire(volatile u32 *cnts, u32 val)
+{
+	u32 ret, tmp;
+
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	ldadda	%w2, %w0, %1\n"
+"	add	%w0, %w0, %w2\n"
+		: "=&r" (ret), "+Q" (*cnts)
+		: "r" (val)
+		: "memory");
+		return ret;
 	}
+
+	asm volatile(
+"1:	ldaxr	%w0, %2\n"
+"	add	%w0, %w0, %w3\n"
+"	stxr	%w1, %w0, %2\n"
+"	cbnz	%w1, 1b\n"
+	: "=&r" (ret), "=&r" (tmp), "+Q" (*cnts)
+	: "r" (val)
+	: "memory");
+
+	return ret;
 }
 
-void __lock arch_spin_unlock(arch_spinlock_t *lock)
+static inline void rw_add_release(volatile u32 *cnts, u32 val)
 {
-	__asm__ __volatile__(
-"	stlr	%w1, %0\n"
-	: "=Q" (lock->lock) : "r" (__ARCH_SPIN_UNLOCKED)
+	u32 ret, tmp;
+
+	if (cpu_lse_atomics()) {
+		asm volatile(ARM64_LSE_PREAMBLE
+"	staddl	%w1, %0\n"
+		: "+Q" (*cnts)
+		: "r" (val)
+		: "memory");
+		return;
+	}
+
+	asm volatile(
+"1:	ldxr	%w0, %2\n"
+"	add	%w0, %w0, %w3\n"
+"	stlxr	%w1, %w0, %2\n"
+"	cbnz	%w1, 1b\n"
+	: "=&r" (ret), "=&r" (tmp), "+Q" (*cnts)
+	: "r" (val)
 	: "memory");
 }
 
+/*
+ * Wait in low-power state until (cnts & mask) == val and
+ * return the last value of cnts with acquire semantics.
+ */
+static inline u32 rw_wait_cnts(volatile u32 *cnts, u32 mask, u32 val)
+{
+	u32 ret, tmp;
+
+	asm volatile(
+"	sevl\n"
+"1:	wfe\n"
+"	ldaxr	%w0, %2\n"
+"	and	%w1, %w0, %w3\n"
+"	cmp	%w1, %w4\n"
+"	b.ne	1b\n"
+	: "=&r" (ret), "=&r" (tmp)
+	: "Q" (*cnts), "r" (mask), "r" (val)
+	: "cc", "memory");
+
+	return ret;
+}
+
 bool __lock arch_write_lock_check(arch_rwlock_t *lock)
 {
 	arch_smp_mb();
-	return (lock->lock & __ARCH_RW_LOCKED) ? TRUE : FALSE;
+	return (lock->cnts & __ARCH_RW_LOCKED) ? TRUE : FALSE;
 }
 
-/*
- * To take a write lock we set bit 31 to 1
- */
 void __lock arch_write_lock(arch_rwlock_t *lock)
 {
-	unsigned int tmp;
+	/* Fast path: lock is free */
+	if (rw_cmpxchg_acquire(&lock->cnts, 0, __ARCH_RW_LOCKED) == 0) {
+		return;
+	}
 
-	__asm__ __volatile__(
-	"	sevl\n"
-	"1:	wfe\n"
-	"2:	ldaxr	%w0, [%1]\n"
-	"	cbnz	%w0, 1b\n"
-	"	stxr	%w0, %w2, [%1]\n"
-	"	cbnz	%w0, 2b\n"
-	: "=&r" (tmp)
-	: "r" (&lock->lock), "r" (__ARCH_RW_LOCKED)
-	: "memory");
+	/* Queue up behind other contending readers and writers */
+	arch_spin_lock(&lock->wait);
+
+	if (!lock->cnts &&
+	    rw_cmpxchg_acquire(&lock->cnts, 0, __ARCH_RW_LOCKED) == 0) {
+		goto done;
+	}
+
+	/* Stop new readers and wait for current readers to drain */
+	rw_add_release(&lock->cnts, __ARCH_RW_WAITING);
+	do {
+		rw_wait_cnts(&lock->cnts, 0xffffffff, __ARCH_RW_WAITING);
+	} while (rw_cmpxchg_acquire(&lock->cnts, __ARCH_RW_WAITING,
+				    __ARCH_RW_LOCKED) != __ARCH_RW_WAITING);
+
+done:
+	arch_spin_unlock(&lock->wait);
 }
 
 int __lock arch_write_trylock(arch_rwlock_t *lock)
 {
-	unsigned int tmp;
-
-	asm volatile(
-	"	ldaxr	%w0, [%1]\n"
-	"	cbnz	%w0, 1f\n"
-	"	stxr	%w0, %w2, [%1]\n"
-	"1:\n"
-	: "=&r" (tmp)
-	: "r" (&lock->lock), "r" (__ARCH_RW_LOCKED)
-	: "memory");
-
-	if (tmp == 0) {
-		 return 1;
-	} else {
-		 return 0;
+	if (lock->cnts) {
+		return 0;
 	}
+
+	return (rw_cmpxchg_acquire(&lock->cnts, 0,
+				   __ARCH_RW_LOCKED) == 0) ? 1 : 0;
 }
 
 void __lock arch_write_unlock(arch_rwlock_t *lock)
 {
-	asm volatile(
-	"	stlr	%w1, [%0]\n"
-	: : "r" (&lock->lock), "r" (0) : "memory");
+	rw_add_release(&lock->cnts, -__ARCH_RW_LOCKED);
 }
 
 bool __lock arch_read_lock_check(arch_rwlock_t *lock)
 {
 	arch_smp_mb();
-	return (lock->lock == __ARCH_RW_UNLOCKED) ? FALSE : TRUE;
+	return (lock->cnts & ~__ARCH_RW_WAITING) ? TRUE : FALSE;
 }
 
 void __lock arch_read_lock(arch_rwlock_t *lock)
 {
-	unsigned int tmp, tmp2;
+	u32 cnts;
 
-	asm volatile(
-	"	sevl\n"
-	"1:	wfe\n"
-	"2:	ldaxr	%w0, [%2]\n"
-	"	add	%w0, %w0, #1\n"
-	"	tbnz	%w0, #31, 1b\n"
-	"	stxr	%w1, %w0, [%2]\n"
-	"	cbnz	%w1, 2b\n"
-	: "=&r" (tmp), "=&r" (tmp2)
-	: "r" (&lock->lock)
-	: "memory");
+	/* Fast path: no writer holding or waiting for the lock */
+	cnts = rw_add_return_acquire(&lock->cnts, __ARCH_RW_READER_BIAS);
+	if (likely(!(cnts & __ARCH_RW_WMASK))) {
+		return;
+	}
+
+	/*
+	 * Readers in IRQ context only wait for the writer to release
+	 * the lock so that an interrupted reader on the same CPU does
+	 * not deadlock against a waiting writer.
+	 */
+	if (vmm_scheduler_irq_context()) {
+		rw_wait_cnts(&lock->cnts, __ARCH_RW_LOCKED, 0);
+		return;
+	}
+
+	/* Back off and queue up behind other contending lockers */
+	rw_add_release(&lock->cnts, -__ARCH_RW_READER_BIAS);
+	arch_spin_lock(&lock->wait);
+	rw_add_return_acquire(&lock->cnts, __ARCH_RW_READER_BIAS);
+	rw_wait_cnts(&lock->cnts, __ARCH_RW_LOCKED, 0);
+	arch_spin_unlock(&lock->wait);
 }
 
 int __lock arch_read_trylock(arch_rwlock_t *lock)
 {
-	unsigned int tmp, tmp2 = 1;
-
-	asm volatile(
-	"	ldaxr	%w0, [%2]\n"
-	"	add	%w0, %w0, #1\n"
-	"	tbnz	%w0, #31, 1f\n"
-	"	stxr	%w1, %w0, [%2]\n"
-	"1:\n"
-	: "=&r" (tmp), "+r" (tmp2)
-	: "r" (&lock->lock)
-	: "memory");
+	u32 cnts = lock->cnts;
 
-	if (tmp2 == 0) {
-		return 1;
-	} else {
-		return 0;
+	if (!(cnts & __ARCH_RW_WMASK)) {
+		cnts = rw_add_return_acquire(&lock->cnts,
+					     __ARCH_RW_READER_BIAS);
+		if (likely(!(cnts & __ARCH_RW_WMASK))) {
+			return 1;
+		}
+		rw_add_release(&lock->cnts, -__ARCH_RW_READER_BIAS);
 	}
+
+	return 0;
 }
 
 void __lock arch_read_unlock(arch_rwlock_t *lock)
 {
-	unsigned int tmp, tmp2;
-
-	asm volatile(
-	"1:	ldxr	%w0, [%2]\n"
-	"	sub	%w0, %w0, #1\n"
-	"	stlxr	%w1, %w0, [%2]\n"
-	"	cbnz	%w1, 1b\n"
-	: "=&r" (tmp), "=&r" (tmp2)
-	: "r" (&lock->lock)
-	: "memory");
+	rw_add_release(&lock->cnts, -__ARCH_RW_READER_BIAS);
 }
@@ -36,6 +36,8 @@
 #include <cpu_vcpu_ptrauth.h>
 #include <cpu_vcpu_helper.h>
 #include <generic_timer.h>
+#include <emulate_psci.h>
+#include <psci.h>
 #include <arm_features.h>
 #include <arch_cache.h>
 
@@ -327,6 +329,14 @@ int arch_guest_init(struct vmm_guest *guest)
 			/* By default, assume PSCI v0.1 */
 			arm_guest_priv(guest)->psci_version = 1;
 		}
+
+		/* PV time requires SMCCC v1.1 discovery from PSCI v1.0 */
+		if ((arm_guest_priv(guest)->psci_version !=
+					PSCI_VERSION(1, 0)) ||
+		    vmm_devtree_read_physaddr(guest->node, "pvtime_base",
+				&arm_guest_priv(guest)->pvtime_base)) {
+			arm_guest_priv(guest)->pvtime_base = 0;
+		}
 	}
 
 	return VMM_OK;
@@ -596,6 +606,9 @@ int arch_vcpu_init(struct vmm_vcpu *vcpu)
 	/* Set last host CPU to invalid value */
 	arm_priv(vcpu)->last_hcpu = 0xFFFFFFFF;
 
+	/* Force PV time stolen time update on next schedule-in */
+	arm_priv(vcpu)->pvtime_steal = ~0ULL;
+
 	/* Initialize sysregs context */
 	rc = cpu_vcpu_sysregs_init(vcpu, cpuid);
 	if (rc) {
@@ -821,6 +834,9 @@ void arch_vcpu_post_switch(struct vmm_vcpu *vcpu,
 		generic_timer_vcpu_context_post_restore(vcpu,
 						arm_gentimer_context(vcpu));
 	}
+
+	/* Update PV time stolen time */
+	emulate_psci_pvtime_update(vcpu);
 }
 
 void arch_vcpu_preempt_orphan(void)
@@ -897,3 +913,33 @@ void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu)
 {
 	/* For now no arch specific stats */
 }
+
+bool arch_vcpu_regs_sample(arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *fp)
+{
+	*pc = regs->pc;
+	*fp = regs->gpr[29];
+
+	/* Anything other than EL2 is guest mode */
+	if (regs->pstate & PSR_MODE32) {
+		return TRUE;
+	}
+
+	return ((regs->pstate & PSR_EL_MASK) != PSR_EL_2) ? TRUE : FALSE;
+}
+
+int arch_vcpu_unwind_frame(virtual_addr_t stack_lo, virtual_addr_t stack_hi,
+			   virtual_addr_t *fp, virtual_addr_t *pc)
+{
+	virtual_addr_t frame = *fp;
+
+	/* AArch64 PCS frame record is {x29, x30} pointed by x29 */
+	if ((frame < stack_lo) || ((stack_hi - 16) < frame) || (frame & 0x7)) {
+		return VMM_EINVALID;
+	}
+
+	*fp = ((u64 *)frame)[0];
+	*pc = ((u64 *)frame)[1];
+
+	return VMM_OK;
+}
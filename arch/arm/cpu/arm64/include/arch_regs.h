@@ -160,6 +160,8 @@ struct arm_priv {
 	void (*vgic_restore)(void *vcpu_ptr);
 	bool (*vgic_irq_pending)(void *vcpu_ptr);
 	void *vgic_priv;
+	/* Stolen time last written to PV time structure */
+	u64 pvtime_steal;
 };
 
 struct arm_guest_priv {
@@ -170,6 +172,10 @@ struct arm_guest_priv {
 	 * Bits[15:0] = Minor number
 	 */
 	u32 psci_version;
+	/* Guest physical base of PV time stolen time structures
+	 * (one per VCPU) or zero when PV time is not available
+	 */
+	physical_addr_t pvtime_base;
 };
 
 #define arm_regs(vcpu)		(&((vcpu)->regs))
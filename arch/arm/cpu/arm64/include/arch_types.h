@@ -46,8 +46,21 @@ typedef struct {
 	volatile long long counter;
 } atomic64_t;
 
+/* Ticket spinlock: owner is the ticket being served and next is
+ * the ticket handed to next locker. Lock is free when both match. */
 typedef struct {
-	volatile long lock;
+	union {
+		volatile u32 slock;
+		struct {
+#ifdef CONFIG_CPU_BE
+			volatile u16 next;
+			volatile u16 owner;
+#else
+			volatile u16 owner;
+			volatile u16 next;
+#endif
+		} tickets;
+	};
 } arch_spinlock_t;
 
 #define ARCH_ATOMIC_INIT(_lptr, val)		\
@@ -62,27 +75,40 @@ typedef struct {
 #define ARCH_ATOMIC64_INITIALIZER(val)		\
 	{ .counter = (val), }
 
-#define __ARCH_SPIN_UNLOCKED		0xffffffffUL
+#define __ARCH_SPIN_UNLOCKED		0
+#define __ARCH_SPIN_TICKET_SHIFT	16
 
 /* FIXME: Need memory barrier for this. */
 #define ARCH_SPIN_LOCK_INIT(_lptr)		\
-	(_lptr)->lock = __ARCH_SPIN_UNLOCKED
+	(_lptr)->slock = __ARCH_SPIN_UNLOCKED
 
 #define ARCH_SPIN_LOCK_INITIALIZER		\
-	{ .lock = __ARCH_SPIN_UNLOCKED, }
+	{ { .slock = __ARCH_SPIN_UNLOCKED, } }
+
+/* Queued rwlock: cnts holds writer state in lower 9 bits and
+ * reader count in upper bits. Lockers which can't get the lock
+ * right away queue up in FIFO order on the wait ticket lock. */
 typedef struct {
-	volatile long lock;
+	volatile u32 cnts;
+	arch_spinlock_t wait;
 } arch_rwlock_t;
 
-#define __ARCH_RW_LOCKED		0x80000000UL
+#define __ARCH_RW_LOCKED		0x0ffU
+#define __ARCH_RW_WAITING		0x100U
+#define __ARCH_RW_WMASK			0x1ffU
+#define __ARCH_RW_READER_BIAS		0x200U
 #define __ARCH_RW_UNLOCKED		0
 
 /* FIXME: Need memory barrier for this. */
 #define ARCH_RW_LOCK_INIT(_lptr)		\
-	(_lptr)->lock = __ARCH_RW_UNLOCKED
+	do { \
+		(_lptr)->cnts = __ARCH_RW_UNLOCKED; \
+		ARCH_SPIN_LOCK_INIT(&(_lptr)->wait); \
+	} while (0)
 
 #define ARCH_RW_LOCK_INITIALIZER		\
-	{ .lock = __ARCH_RW_UNLOCKED, }
+	{ .cnts = __ARCH_RW_UNLOCKED, \
+	  .wait = ARCH_SPIN_LOCK_INITIALIZER, }
 
 #define ARCH_BITS_PER_LONG		64
 #define ARCH_BITS_PER_LONG_LONG		64
@@ -868,6 +868,8 @@ asm(
 #define ID_AA64ISAR0_SHA3_SHIFT				32
 #define ID_AA64ISAR0_RDM_SHIFT				28
 #define ID_AA64ISAR0_ATOMICS_SHIFT			20
+#define ID_AA64ISAR0_ATOMICS_MASK	(0xfUL << ID_AA64ISAR0_ATOMICS_SHIFT)
+#define ID_AA64ISAR0_ATOMICS_LSE			0x2
 #define ID_AA64ISAR0_CRC32_SHIFT			16
 #define ID_AA64ISAR0_SHA2_SHIFT				12
 #define ID_AA64ISAR0_SHA1_SHIFT				8
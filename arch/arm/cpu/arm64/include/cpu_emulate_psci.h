@@ -28,6 +28,7 @@
 #include <cpu_defines.h>
 #include <cpu_inline_asm.h>
 #include <cpu_vcpu_helper.h>
+#include <psci.h>
 
 static inline u32 emulate_psci_version(struct vmm_vcpu *vcpu)
 {
@@ -91,4 +92,16 @@ static inline unsigned long emulate_psci_get_mpidr(struct vmm_vcpu *vcpu)
 	return arm_priv(vcpu)->sysregs.mpidr_el1;
 }
 
+static inline physical_addr_t emulate_psci_pvtime_addr(struct vmm_vcpu *vcpu)
+{
+	physical_addr_t base = arm_guest_priv(vcpu->guest)->pvtime_base;
+
+	return (base) ? base + vcpu->subid * PV_TIME_ST_SIZE : 0;
+}
+
+static inline u64 *emulate_psci_pvtime_last(struct vmm_vcpu *vcpu)
+{
+	return &arm_priv(vcpu)->pvtime_steal;
+}
+
 #endif	/* __CPU_EMULATE_PSCI_H__ */
@@ -128,6 +128,14 @@
 
 /* CPU feature checking macros */
 
+#define cpu_supports_lse_atomics() ({ u64 isar0; \
+				   asm volatile("mrs %0, id_aa64isar0_el1" \
+						: "=r"(isar0)); \
+				   (((isar0 & ID_AA64ISAR0_ATOMICS_MASK) >> \
+				     ID_AA64ISAR0_ATOMICS_SHIFT) >= \
+				    ID_AA64ISAR0_ATOMICS_LSE); \
+				})
+
 #define cpu_supports_address_auth_arch() ({ u64 isar1; \
 				   asm volatile("mrs %0, id_aa64isar1_el1" \
 						: "=r"(isar1)); \
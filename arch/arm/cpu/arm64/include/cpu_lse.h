@@ -0,0 +1,51 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cpu_lse.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief ARMv8.1 Large System Extension (LSE) atomics selection
+ *
+ * Atomic operations and locks are implemented using both exclusive
+ * load/store loops and LSE atomic instructions. The LSE variants are
+ * selected at boot time when ID_AA64ISAR0_EL1.Atomic advertises them.
+ */
+#ifndef _CPU_LSE_H__
+#define _CPU_LSE_H__
+
+#include <vmm_types.h>
+
+/** Assembler directive required before LSE instructions */
+#define ARM64_LSE_PREAMBLE	".arch_extension lse\n"
+
+#ifdef CONFIG_ARM64_LSE_ATOMICS
+
+extern bool cpu_lse_atomics_available;
+
+/** Check whether LSE atomics were selected at boot time */
+#define cpu_lse_atomics()	(cpu_lse_atomics_available)
+
+#else
+
+#define cpu_lse_atomics()	FALSE
+
+#endif
+
+/** Select LSE atomics if supported by boot CPU */
+void cpu_lse_init(void);
+
+#endif
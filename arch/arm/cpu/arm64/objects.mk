@@ -30,6 +30,9 @@ arch-$(CONFIG_ARMV8) += -mgeneral-regs-only -mlittle-endian
 cpu-cppflags+=-DTEXT_START=0x10000000
 cpu-cflags += $(arch-y) $(tune-y)
 cpu-cflags += -fno-strict-aliasing -O2
+ifeq ($(CONFIG_PROFILE_SAMPLING), y)
+cpu-cflags += -fno-omit-frame-pointer -fno-optimize-sibling-calls
+endif
 cpu-asflags += $(arch-y) $(tune-y)
 cpu-ldflags +=
 
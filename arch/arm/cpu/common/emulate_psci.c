@@ -23,7 +23,10 @@
 
 #include <vmm_error.h>
 #include <vmm_stdio.h>
+#include <vmm_host_io.h>
 #include <vmm_vcpu_irq.h>
+#include <vmm_scheduler.h>
+#include <vmm_guest_aspace.h>
 #include <arch_barrier.h>
 
 #include <cpu_defines.h>
@@ -275,6 +278,189 @@ static int emulate_psci_0_2_call(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 	return VMM_OK;
 }
 
+static bool psci_pvtime_available(struct vmm_vcpu *vcpu, arch_regs_t *regs)
+{
+	u32 reg_flags = 0x0;
+	physical_addr_t hpa, addr;
+	physical_size_t avail;
+
+	/* PV time interface is only defined for AArch64 callers */
+	if (emulate_psci_is_32bit(vcpu, regs)) {
+		return FALSE;
+	}
+
+	addr = emulate_psci_pvtime_addr(vcpu);
+	if (!addr) {
+		return FALSE;
+	}
+
+	if (vmm_guest_physical_map(vcpu->guest, addr, PV_TIME_ST_SIZE,
+				   &hpa, &avail, &reg_flags)) {
+		return FALSE;
+	}
+
+	return ((reg_flags & VMM_REGION_ISRAM) &&
+		(avail >= PV_TIME_ST_SIZE)) ? TRUE : FALSE;
+}
+
+static unsigned long psci_features(struct vmm_vcpu *vcpu, arch_regs_t *regs)
+{
+	unsigned long fn = emulate_psci_get_reg(vcpu, regs, 1) & ~((u32)0);
+
+	switch (fn) {
+	case PSCI_0_2_FN_PSCI_VERSION:
+	case PSCI_0_2_FN_CPU_SUSPEND:
+	case PSCI_0_2_FN64_CPU_SUSPEND:
+	case PSCI_0_2_FN_CPU_OFF:
+	case PSCI_0_2_FN_CPU_ON:
+	case PSCI_0_2_FN64_CPU_ON:
+	case PSCI_0_2_FN_AFFINITY_INFO:
+	case PSCI_0_2_FN64_AFFINITY_INFO:
+	case PSCI_0_2_FN_MIGRATE_INFO_TYPE:
+	case PSCI_0_2_FN_SYSTEM_OFF:
+	case PSCI_0_2_FN_SYSTEM_RESET:
+	case PSCI_1_0_FN_PSCI_FEATURES:
+	case SMCCC_VERSION_FUNC_ID:
+		/* No optional feature flags (original StateID format) */
+		return PSCI_RET_SUCCESS;
+	default:
+		break;
+	};
+
+	return PSCI_RET_NOT_SUPPORTED;
+}
+
+static unsigned long smccc_arch_features(struct vmm_vcpu *vcpu,
+					 arch_regs_t *regs)
+{
+	unsigned long fn = emulate_psci_get_reg(vcpu, regs, 1) & ~((u32)0);
+
+	switch (fn) {
+	case SMCCC_ARCH_FEATURES_FUNC_ID:
+		return SMCCC_RET_SUCCESS;
+	case SMCCC_HV_PV_TIME_FEATURES:
+		if (psci_pvtime_available(vcpu, regs)) {
+			return SMCCC_RET_SUCCESS;
+		}
+		break;
+	default:
+		break;
+	};
+
+	return SMCCC_RET_NOT_SUPPORTED;
+}
+
+static unsigned long smccc_pvtime_features(struct vmm_vcpu *vcpu,
+					   arch_regs_t *regs)
+{
+	unsigned long fn = emulate_psci_get_reg(vcpu, regs, 1) & ~((u32)0);
+
+	if (!psci_pvtime_available(vcpu, regs)) {
+		return SMCCC_RET_NOT_SUPPORTED;
+	}
+
+	switch (fn) {
+	case SMCCC_HV_PV_TIME_FEATURES:
+	case SMCCC_HV_PV_TIME_ST:
+		return SMCCC_RET_SUCCESS;
+	default:
+		break;
+	};
+
+	return SMCCC_RET_NOT_SUPPORTED;
+}
+
+static unsigned long smccc_pvtime_st(struct vmm_vcpu *vcpu,
+				     arch_regs_t *regs)
+{
+	if (!psci_pvtime_available(vcpu, regs)) {
+		return SMCCC_RET_NOT_SUPPORTED;
+	}
+
+	return emulate_psci_pvtime_addr(vcpu);
+}
+
+static unsigned long xvisor_hyp_yield_to(struct vmm_vcpu *vcpu,
+					 arch_regs_t *regs)
+{
+	unsigned long mpidr = emulate_psci_get_reg(vcpu, regs, 1);
+	struct vmm_vcpu *tmp, *target = NULL;
+
+	if (emulate_psci_is_32bit(vcpu, regs)) {
+		mpidr &= ~((u32)0);
+		if (mpidr == ~((u32)0)) {
+			mpidr = ~0UL;
+		}
+	}
+
+	if (mpidr == ~0UL) {
+		vmm_scheduler_yield_to_preempted();
+		return SMCCC_RET_SUCCESS;
+	}
+
+	vmm_manager_for_each_guest_vcpu(tmp, vcpu->guest) {
+		if ((emulate_psci_get_mpidr(tmp) & MPIDR_HWID_BITMASK) ==
+					(mpidr & MPIDR_HWID_BITMASK)) {
+			target = tmp;
+			break;
+		}
+	}
+	if (!target || (target == vcpu)) {
+		return SMCCC_RET_INVALID_PARAMETER;
+	}
+
+	/* Target not waiting for host CPU is not an error */
+	vmm_scheduler_yield_to(target);
+
+	return SMCCC_RET_SUCCESS;
+}
+
+static int emulate_psci_1_0_call(struct vmm_vcpu *vcpu, arch_regs_t *regs)
+{
+	unsigned long psci_fn =
+			emulate_psci_get_reg(vcpu, regs, 0) & ~((u32)0);
+	unsigned long val;
+
+	switch (psci_fn) {
+	case PSCI_0_2_FN_PSCI_VERSION:
+		val = PSCI_VERSION(1, 0);
+		break;
+	case PSCI_1_0_FN_PSCI_FEATURES:
+		val = psci_features(vcpu, regs);
+		break;
+	case SMCCC_VERSION_FUNC_ID:
+		val = SMCCC_VERSION_1_1;
+		break;
+	case SMCCC_ARCH_FEATURES_FUNC_ID:
+		val = smccc_arch_features(vcpu, regs);
+		break;
+	case SMCCC_HV_PV_TIME_FEATURES:
+		val = smccc_pvtime_features(vcpu, regs);
+		break;
+	case SMCCC_HV_PV_TIME_ST:
+		val = smccc_pvtime_st(vcpu, regs);
+		break;
+	case SMCCC_XVISOR_HYP_YIELD_TO:
+		val = xvisor_hyp_yield_to(vcpu, regs);
+		break;
+	default:
+		/* Rest of PSCI v1.0 is same as PSCI v0.2 */
+		if (emulate_psci_0_2_call(vcpu, regs) == VMM_OK) {
+			return VMM_OK;
+		}
+		/*
+		 * SMCCC v1.1 callers probe optional services so unknown
+		 * function IDs must return NOT_SUPPORTED instead of UNDEF.
+		 */
+		val = SMCCC_RET_NOT_SUPPORTED;
+		break;
+	}
+
+	emulate_psci_set_reg(vcpu, regs, 0, val);
+
+	return VMM_OK;
+}
+
 /* PSCI v0.1 function numbers */
 #define PSCI_FN_BASE		0x95c1ba5e
 #define PSCI_FN(n)		(PSCI_FN_BASE + (n))
@@ -321,6 +507,8 @@ int emulate_psci_call(struct vmm_vcpu *vcpu, arch_regs_t *regs, bool is_smc)
 		return emulate_psci_0_1_call(vcpu, regs);
 	case 2: /* PSCI v0.2 */
 		return emulate_psci_0_2_call(vcpu, regs);
+	case PSCI_VERSION(1, 0): /* PSCI v1.0 */
+		return emulate_psci_1_0_call(vcpu, regs);
 	default:
 		break;
 	};
@@ -328,3 +516,41 @@ int emulate_psci_call(struct vmm_vcpu *vcpu, arch_regs_t *regs, bool is_smc)
 	return VMM_EINVALID;
 }
 
+void emulate_psci_pvtime_update(struct vmm_vcpu *vcpu)
+{
+	u32 hdr[2];
+	u64 steal, *last, val;
+	physical_addr_t addr = emulate_psci_pvtime_addr(vcpu);
+
+	if (!addr) {
+		return;
+	}
+
+	/*
+	 * Stolen time is the time VCPU was runnable but not running
+	 * (i.e. READY state time) since last VCPU reset. The value is
+	 * only updated in guest memory when it changed since the last
+	 * schedule-in of this VCPU.
+	 */
+	steal = vcpu->state_ready_nsecs;
+	last = emulate_psci_pvtime_last(vcpu);
+	if (*last == steal) {
+		return;
+	}
+
+	/* Revision and attributes are zero after VCPU reset */
+	if (*last == ~0ULL) {
+		hdr[0] = hdr[1] = 0;
+		vmm_guest_memory_write(vcpu->guest, addr,
+				       hdr, sizeof(hdr), TRUE);
+	}
+
+	/* Single-copy atomic update of stolen time */
+	val = vmm_cpu_to_le64(steal);
+	if (vmm_guest_memory_write(vcpu->guest,
+				   addr + PV_TIME_ST_STOLEN_TIME_OFFSET,
+				   &val, sizeof(val), TRUE) == sizeof(val)) {
+		*last = steal;
+	}
+}
+
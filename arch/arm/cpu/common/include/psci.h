@@ -72,6 +72,9 @@
 #define PSCI_0_2_FN64_MIGRATE			PSCI_0_2_FN64(5)
 #define PSCI_0_2_FN64_MIGRATE_INFO_UP_CPU	PSCI_0_2_FN64(7)
 
+/* PSCI v1.0 interface */
+#define PSCI_1_0_FN_PSCI_FEATURES		PSCI_0_2_FN(10)
+
 /* PSCI v0.2 power state encoding for CPU_SUSPEND function */
 #define PSCI_0_2_POWER_STATE_ID_MASK		0xffff
 #define PSCI_0_2_POWER_STATE_ID_SHIFT		0
@@ -101,6 +104,9 @@
 		(((ver) & PSCI_VERSION_MAJOR_MASK) >> PSCI_VERSION_MAJOR_SHIFT)
 #define PSCI_VERSION_MINOR(ver)			\
 		((ver) & PSCI_VERSION_MINOR_MASK)
+#define PSCI_VERSION(maj, min)			\
+		((((maj) << PSCI_VERSION_MAJOR_SHIFT) & PSCI_VERSION_MAJOR_MASK) | \
+		 ((min) & PSCI_VERSION_MINOR_MASK))
 
 /* PSCI return values (inclusive of all PSCI versions) */
 #define PSCI_RET_SUCCESS			0
@@ -113,4 +119,30 @@
 #define PSCI_RET_NOT_PRESENT			-7
 #define PSCI_RET_DISABLED			-8
 
+/*
+ * SMC Calling Convention (ARM DEN 0028) discovery functions and
+ * paravirtualized time functions (ARM DEN 0057A) which are routed
+ * through the same SMC/HVC conduit as PSCI v1.0 calls.
+ */
+#define SMCCC_VERSION_FUNC_ID			0x80000000
+#define SMCCC_ARCH_FEATURES_FUNC_ID		0x80000001
+#define SMCCC_VERSION_1_1			0x10001
+
+#define SMCCC_HV_PV_TIME_FEATURES		0xC5000020
+#define SMCCC_HV_PV_TIME_ST			0xC5000021
+
+#define SMCCC_RET_SUCCESS			0
+#define SMCCC_RET_NOT_SUPPORTED			-1
+#define SMCCC_RET_INVALID_PARAMETER		-3
+
+/*
+ * Xvisor vendor specific hypervisor service: directed yield to VCPU
+ * having MPIDR in x1 (or any preempted VCPU when x1 is all ones).
+ */
+#define SMCCC_XVISOR_HYP_YIELD_TO		0x86000001
+
+/* Size of per-VCPU stolen time structure */
+#define PV_TIME_ST_SIZE				64
+#define PV_TIME_ST_STOLEN_TIME_OFFSET		8
+
 #endif /* __PSCI_H */
@@ -70,6 +70,20 @@ void arch_vcpu_regs_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu);
 /** Print architecture specific stats for a VCPU */
 void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu);
 
+/** Get program counter and frame pointer of interrupted registers
+ *  Returns TRUE if registers belong to guest mode of Normal VCPU
+ *  otherwise FALSE (i.e. hypervisor mode).
+ */
+bool arch_vcpu_regs_sample(arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *fp);
+
+/** Unwind one hypervisor stack frame using frame pointer
+ *  NOTE: Only memory within [stack_lo, stack_hi) is accessed.
+ *  Returns VMM_OK and updates fp and pc to caller frame on success.
+ */
+int arch_vcpu_unwind_frame(virtual_addr_t stack_lo, virtual_addr_t stack_hi,
+			   virtual_addr_t *fp, virtual_addr_t *pc);
+
 /** Get count of VCPU interrupts */
 u32 arch_vcpu_irq_count(struct vmm_vcpu *vcpu);
 
@@ -26,6 +26,7 @@
 #include <vmm_smp.h>
 #include <vmm_host_irq.h>
 #include <vmm_scheduler.h>
+#include <vmm_vcpu_stats.h>
 #include <arch_vcpu.h>
 #include <cpu_hwcap.h>
 #include <cpu_vcpu_trap.h>
@@ -56,9 +57,12 @@ void do_error(struct vmm_vcpu *vcpu, arch_regs_t *regs,
 void do_handle_irq(arch_regs_t *regs, unsigned long cause)
 {
 	int rc = VMM_OK;
+	struct vmm_vcpu *vcpu = vmm_scheduler_current_vcpu();
 
 	vmm_scheduler_irq_enter(regs, FALSE);
 
+	vmm_vcpu_exit_begin(vcpu);
+
 	if (cause == IRQ_VS_SOFT ||
 	    cause == IRQ_VS_TIMER ||
 	    cause == IRQ_VS_EXT) {
@@ -81,9 +85,27 @@ done:
 			 "interrupt handling failed", rc, TRUE);
 	}
 
+	vmm_vcpu_exit_end(vcpu, VMM_VCPU_EXIT_IRQ);
+
 	vmm_scheduler_irq_exit(regs);
 }
 
+static u32 do_handle_trap_exit_reason(unsigned long cause)
+{
+	switch (cause) {
+	case CAUSE_FETCH_GUEST_PAGE_FAULT:
+	case CAUSE_LOAD_GUEST_PAGE_FAULT:
+	case CAUSE_STORE_GUEST_PAGE_FAULT:
+		return VMM_VCPU_EXIT_STAGE2_FAULT;
+	case CAUSE_VIRTUAL_INST_FAULT:
+		return VMM_VCPU_EXIT_SYSREG;
+	case CAUSE_VIRTUAL_SUPERVISOR_ECALL:
+		return VMM_VCPU_EXIT_HYPERCALL;
+	default:
+		return VMM_VCPU_EXIT_INSN;
+	};
+}
+
 void do_handle_trap(arch_regs_t *regs, unsigned long cause)
 {
 	int rc = VMM_OK;
@@ -109,6 +131,8 @@ void do_handle_trap(arch_regs_t *regs, unsigned long cause)
 		goto done;
 	}
 
+	vmm_vcpu_exit_begin(vcpu);
+
 	switch (cause) {
 	case CAUSE_MISALIGNED_FETCH:
 	case CAUSE_FETCH_ACCESS:
@@ -181,6 +205,8 @@ void do_handle_trap(arch_regs_t *regs, unsigned long cause)
 		riscv_stats_priv(vcpu)->trap[cause]++;
 	}
 
+	vmm_vcpu_exit_end(vcpu, do_handle_trap_exit_reason(cause));
+
 done:
 	if (rc) {
 		do_error(vcpu, regs, cause, msg, rc, panic);
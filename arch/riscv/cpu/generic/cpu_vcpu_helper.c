@@ -322,6 +322,7 @@ int arch_vcpu_init(struct vmm_vcpu *vcpu)
 	riscv_priv(vcpu)->vscause = 0;
 	riscv_priv(vcpu)->vstval = 0;
 	riscv_priv(vcpu)->vsatp = 0;
+	riscv_priv(vcpu)->vsiselect = 0;
 
 	/* By default, make CY, TM, and IR counters accessible in VU mode */
 	riscv_priv(vcpu)->scounteren = 7;
@@ -332,6 +333,9 @@ int arch_vcpu_init(struct vmm_vcpu *vcpu)
 	/* Reset FP state */
 	cpu_vcpu_fp_reset(vcpu);
 
+	/* Reset steal-time accounting state */
+	cpu_vcpu_sbi_sta_reset(vcpu);
+
 	/* Reset timer */
 	cpu_vcpu_timer_reset(vcpu);
 
@@ -413,6 +417,9 @@ void arch_vcpu_switch(struct vmm_vcpu *tvcpu,
 			priv->vstval = csr_read(CSR_VSTVAL);
 			priv->vsatp = csr_read(CSR_VSATP);
 			priv->scounteren = csr_read(CSR_SCOUNTEREN);
+			if (riscv_isa_extension_available(NULL, SxAIA)) {
+				priv->vsiselect = csr_read(CSR_VSISELECT);
+			}
 			cpu_vcpu_fp_save(tvcpu, regs);
 			cpu_vcpu_timer_save(tvcpu);
 		}
@@ -432,6 +439,9 @@ void arch_vcpu_switch(struct vmm_vcpu *tvcpu,
 		csr_write(CSR_VSTVAL, priv->vstval);
 		csr_write(CSR_VSATP, priv->vsatp);
 		csr_write(CSR_SCOUNTEREN, priv->scounteren);
+		if (riscv_isa_extension_available(NULL, SxAIA)) {
+			csr_write(CSR_VSISELECT, priv->vsiselect);
+		}
 		cpu_vcpu_envcfg_update(vcpu, riscv_nested_virt(vcpu));
 		cpu_vcpu_timer_restore(vcpu);
 		cpu_vcpu_fp_restore(vcpu, regs);
@@ -445,7 +455,10 @@ void arch_vcpu_switch(struct vmm_vcpu *tvcpu,
 void arch_vcpu_post_switch(struct vmm_vcpu *vcpu,
 			   arch_regs_t *regs)
 {
-	/* For now nothing to do here. */
+	/* Update steal time of normal VCPUs */
+	if (vcpu->is_normal) {
+		cpu_vcpu_sbi_sta_update(vcpu);
+	}
 }
 
 void cpu_vcpu_envcfg_update(struct vmm_vcpu *vcpu, bool nested_virt)
@@ -688,3 +701,31 @@ void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu)
 		    "Nested SBI Ecall",
 		    riscv_stats_priv(vcpu)->nested_sbi);
 }
+
+bool arch_vcpu_regs_sample(arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *fp)
+{
+	*pc = regs->sepc;
+	*fp = regs->s0;
+
+	return (regs->hstatus & HSTATUS_SPV) ? TRUE : FALSE;
+}
+
+int arch_vcpu_unwind_frame(virtual_addr_t stack_lo, virtual_addr_t stack_hi,
+			   virtual_addr_t *fp, virtual_addr_t *pc)
+{
+	virtual_addr_t frame = *fp;
+	unsigned long *ll;
+
+	/* Frame record {fp, ra} is just below frame pointer */
+	if ((frame < (stack_lo + 2 * sizeof(unsigned long))) ||
+	    (stack_hi < frame) || (frame & 0x7)) {
+		return VMM_EINVALID;
+	}
+
+	ll = (unsigned long *)frame - 2;
+	*fp = ll[0];
+	*pc = ll[1];
+
+	return VMM_OK;
+}
@@ -0,0 +1,500 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cpu_vcpu_imsic.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief source of software emulated IMSIC interrupt files
+ *
+ * Each VCPU of a Guest gets one software emulated supervisor-level IMSIC
+ * interrupt file. The Guest programs it through the siselect/sireg and
+ * stopei CSRs (which trap as virtual instruction because hstatus.VGEIN
+ * is zero) and MSIs are written to the per-VCPU 4KB page of the IMSIC
+ * MMIO region. Pending and enabled interrupt identities are signaled to
+ * the VCPU as VS-level external interrupt.
+ *
+ * Example guest DTS node:
+ *	imsics {
+ *		manifest_type = "virtual";
+ *		address_type = "memory";
+ *		guest_physical_addr = <0x28000000>;
+ *		physical_size = <0x4000>;
+ *		device_type = "pic";
+ *		compatible = "riscv,imsics";
+ *		num_ids = <255>;
+ *		parent_irq = <10>;
+ *	};
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_spinlocks.h>
+#include <vmm_manager.h>
+#include <vmm_devemu.h>
+#include <vmm_host_io.h>
+#include <vmm_vcpu_irq.h>
+#include <vmm_modules.h>
+#include <libs/bitops.h>
+#include <libs/stringlib.h>
+
+#include <cpu_vcpu_imsic.h>
+#include <cpu_vcpu_trap.h>
+#include <riscv_csr.h>
+#include <riscv_encoding.h>
+
+#define MODULE_DESC			"RISC-V IMSIC Emulator"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			imsic_emulator_init
+#define	MODULE_EXIT			imsic_emulator_exit
+
+#define IMSIC_PAGE_SHIFT		12
+#define IMSIC_PAGE_SIZE			(1UL << IMSIC_PAGE_SHIFT)
+#define IMSIC_SETEIPNUM_LE		0x00
+#define IMSIC_SETEIPNUM_BE		0x04
+
+#define IMSIC_MIN_ID			63
+#define IMSIC_MAX_ID			2047
+#define IMSIC_DEFAULT_ID		255
+#define IMSIC_WORDS			((IMSIC_MAX_ID + 1) / 32)
+
+#define IMSIC_EIDELIVERY		0x70
+#define IMSIC_EITHRESHOLD		0x72
+#define IMSIC_EIP0			0x80
+#define IMSIC_EIP63			0xbf
+#define IMSIC_EIE0			0xc0
+#define IMSIC_EIE63			0xff
+
+struct cpu_vcpu_imsic {
+	vmm_spinlock_t lock;
+	struct vmm_vcpu *vcpu;
+	u32 nr_ids;
+	u32 parent_irq;
+	u32 eidelivery;
+	u32 eithreshold;
+	u32 eip[IMSIC_WORDS];
+	u32 eie[IMSIC_WORDS];
+};
+
+struct imsic_state {
+	struct vmm_guest *guest;
+	physical_addr_t addr;
+	u32 nr_files;
+	struct cpu_vcpu_imsic *files;
+};
+
+/* Note: Must be called with f->lock held */
+static u32 __imsic_topei(struct cpu_vcpu_imsic *f)
+{
+	u32 i, id, word, max_id = f->nr_ids;
+
+	if (f->eithreshold && f->eithreshold <= max_id) {
+		max_id = f->eithreshold - 1;
+	}
+
+	/* Lowest interrupt identity has highest priority */
+	for (i = 0; (i * 32) <= max_id; i++) {
+		word = f->eip[i] & f->eie[i];
+		if (!word) {
+			continue;
+		}
+		id = i * 32 + __ffs(word);
+		return (id <= max_id) ? id : 0;
+	}
+
+	return 0;
+}
+
+/* Note: Must be called with f->lock held */
+static void __imsic_update(struct cpu_vcpu_imsic *f)
+{
+	if (f->eidelivery && __imsic_topei(f)) {
+		vmm_vcpu_irq_assert(f->vcpu, f->parent_irq, 0x0);
+	} else {
+		vmm_vcpu_irq_deassert(f->vcpu, f->parent_irq);
+	}
+}
+
+/* Mask of implemented interrupt identities in given word */
+static u32 imsic_word_mask(struct cpu_vcpu_imsic *f, u32 num)
+{
+	u32 mask = 0xffffffff;
+
+	if (f->nr_ids < (num * 32)) {
+		return 0;
+	}
+	if (f->nr_ids < (num * 32 + 31)) {
+		mask = (1UL << (f->nr_ids - num * 32 + 1)) - 1;
+	}
+	if (!num) {
+		mask &= ~0x1; /* Identity zero is never valid */
+	}
+
+	return mask;
+}
+
+static void imsic_seteipnum(struct cpu_vcpu_imsic *f, u32 id)
+{
+	irq_flags_t flags;
+
+	if (!id || f->nr_ids < id) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave(&f->lock, flags);
+	f->eip[id / 32] |= (1UL << (id % 32));
+	__imsic_update(f);
+	vmm_spin_unlock_irqrestore(&f->lock, flags);
+}
+
+static void imsic_eix_rmw(struct cpu_vcpu_imsic *f, u32 *eix, u32 num,
+			  unsigned long *val, unsigned long new_val,
+			  unsigned long wr_mask)
+{
+	unsigned long old, mask;
+
+	old = eix[num];
+	mask = imsic_word_mask(f, num);
+#ifdef CONFIG_64BIT
+	old |= (unsigned long)eix[num + 1] << 32;
+	mask |= (unsigned long)imsic_word_mask(f, num + 1) << 32;
+#endif
+	*val = old;
+
+	new_val = ((old & ~wr_mask) | (new_val & wr_mask)) & mask;
+	eix[num] = (u32)new_val;
+#ifdef CONFIG_64BIT
+	eix[num + 1] = (u32)(new_val >> 32);
+#endif
+}
+
+int cpu_vcpu_imsic_sireg_rmw(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			     unsigned int csr_num, unsigned long *val,
+			     unsigned long new_val, unsigned long wr_mask)
+{
+	u32 isel, num;
+	irq_flags_t flags;
+	int rc = VMM_OK;
+	struct cpu_vcpu_imsic *f = riscv_imsic_priv(vcpu);
+
+	/*
+	 * Trap from virtual-VS and virtual-VU modes should be forwarded to
+	 * virtual-HS mode as a virtual instruction trap.
+	 */
+	if (riscv_nested_virt(vcpu)) {
+		return TRAP_RETURN_VIRTUAL_INSN;
+	}
+
+	/* Guest without interrupt file can't access IMSIC registers */
+	if (!f) {
+		return TRAP_RETURN_ILLEGAL_INSN;
+	}
+
+	isel = csr_read(CSR_VSISELECT) & ISELECT_MASK;
+
+	vmm_spin_lock_irqsave(&f->lock, flags);
+
+	switch (isel) {
+	case IMSIC_EIDELIVERY:
+		*val = f->eidelivery;
+		f->eidelivery = ((f->eidelivery & ~wr_mask) |
+				 (new_val & wr_mask)) & 0x1;
+		break;
+	case IMSIC_EITHRESHOLD:
+		*val = f->eithreshold;
+		f->eithreshold = ((f->eithreshold & ~wr_mask) |
+				  (new_val & wr_mask)) & IMSIC_MAX_ID;
+		break;
+	case IMSIC_EIP0 ... IMSIC_EIP63:
+	case IMSIC_EIE0 ... IMSIC_EIE63:
+		num = isel & (IMSIC_EIP63 - IMSIC_EIP0);
+#ifdef CONFIG_64BIT
+		/* Odd numbered registers don't exist for RV64 */
+		if (num & 0x1) {
+			rc = TRAP_RETURN_ILLEGAL_INSN;
+			break;
+		}
+#endif
+		imsic_eix_rmw(f, (isel < IMSIC_EIE0) ? f->eip : f->eie,
+			      num, val, new_val, wr_mask);
+		break;
+	default:
+		rc = TRAP_RETURN_ILLEGAL_INSN;
+		break;
+	}
+
+	if (!rc) {
+		__imsic_update(f);
+	}
+
+	vmm_spin_unlock_irqrestore(&f->lock, flags);
+
+	return rc;
+}
+
+int cpu_vcpu_imsic_stopei_rmw(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			      unsigned int csr_num, unsigned long *val,
+			      unsigned long new_val, unsigned long wr_mask)
+{
+	u32 topei;
+	irq_flags_t flags;
+	struct cpu_vcpu_imsic *f = riscv_imsic_priv(vcpu);
+
+	/*
+	 * Trap from virtual-VS and virtual-VU modes should be forwarded to
+	 * virtual-HS mode as a virtual instruction trap.
+	 */
+	if (riscv_nested_virt(vcpu)) {
+		return TRAP_RETURN_VIRTUAL_INSN;
+	}
+
+	/* Guest without interrupt file can't access IMSIC registers */
+	if (!f) {
+		return TRAP_RETURN_ILLEGAL_INSN;
+	}
+
+	vmm_spin_lock_irqsave(&f->lock, flags);
+
+	topei = __imsic_topei(f);
+	*val = (topei) ? ((topei << TOPEI_ID_SHIFT) | topei) : 0;
+
+	/* Any write to stopei claims the top interrupt identity */
+	if (wr_mask && topei) {
+		f->eip[topei / 32] &= ~(1UL << (topei % 32));
+		__imsic_update(f);
+	}
+
+	vmm_spin_unlock_irqrestore(&f->lock, flags);
+
+	return VMM_OK;
+}
+
+static void imsic_msi_handle(physical_addr_t addr, u32 data,
+			     u32 devid, void *opaque)
+{
+	u32 idx;
+	physical_addr_t offset;
+	struct imsic_state *s = opaque;
+
+	offset = addr - s->addr;
+	idx = offset >> IMSIC_PAGE_SHIFT;
+	if (s->nr_files <= idx) {
+		return;
+	}
+
+	switch (offset & (IMSIC_PAGE_SIZE - 1)) {
+	case IMSIC_SETEIPNUM_LE:
+		imsic_seteipnum(&s->files[idx], data);
+		break;
+	case IMSIC_SETEIPNUM_BE:
+		imsic_seteipnum(&s->files[idx],
+				vmm_be32_to_cpu(vmm_cpu_to_le32(data)));
+		break;
+	default:
+		break;
+	}
+}
+
+static struct vmm_devemu_msichip imsic_msichip = {
+	.name = "IMSIC",
+	.handle = imsic_msi_handle,
+};
+
+static int imsic_emulator_read(struct vmm_emudev *edev,
+			       physical_addr_t offset,
+			       u32 *dst, u32 size)
+{
+	/* All IMSIC MMIO registers are write-only */
+	*dst = 0x0;
+
+	return VMM_OK;
+}
+
+static int imsic_emulator_write(struct vmm_emudev *edev,
+				physical_addr_t offset,
+				u32 src_mask, u32 src, u32 size)
+{
+	struct imsic_state *s = edev->priv;
+
+	/* Only 32-bit writes to setipnum registers are meaningful */
+	if (size == 4) {
+		imsic_msi_handle(s->addr + offset, src, 0, s);
+	}
+
+	return VMM_OK;
+}
+
+static int imsic_emulator_reset(struct vmm_emudev *edev)
+{
+	u32 i;
+	irq_flags_t flags;
+	struct cpu_vcpu_imsic *f;
+	struct imsic_state *s = edev->priv;
+
+	for (i = 0; i < s->nr_files; i++) {
+		f = &s->files[i];
+
+		vmm_spin_lock_irqsave(&f->lock, flags);
+
+		f->eidelivery = 0;
+		f->eithreshold = 0;
+		memset(f->eip, 0, sizeof(f->eip));
+		memset(f->eie, 0, sizeof(f->eie));
+		vmm_vcpu_irq_deassert(f->vcpu, f->parent_irq);
+
+		vmm_spin_unlock_irqrestore(&f->lock, flags);
+	}
+
+	return VMM_OK;
+}
+
+static int imsic_emulator_probe(struct vmm_guest *guest,
+				struct vmm_emudev *edev,
+				const struct vmm_devtree_nodeid *eid)
+{
+	u32 i, nr_ids, parent_irq;
+	int rc = VMM_OK;
+	struct vmm_vcpu *vcpu;
+	struct cpu_vcpu_imsic *f;
+	struct imsic_state *s;
+
+	if (vmm_devtree_read_u32(edev->node, "num_ids", &nr_ids)) {
+		nr_ids = IMSIC_DEFAULT_ID;
+	}
+	if ((nr_ids < IMSIC_MIN_ID) || (IMSIC_MAX_ID < nr_ids) ||
+	    ((nr_ids & IMSIC_MIN_ID) != IMSIC_MIN_ID)) {
+		rc = VMM_EINVALID;
+		goto imsic_emulator_probe_done;
+	}
+
+	if (vmm_devtree_read_u32(edev->node, "parent_irq", &parent_irq)) {
+		parent_irq = IRQ_VS_EXT;
+	}
+
+	/* One interrupt file page for each VCPU */
+	if (edev->reg->phys_size <
+	    ((physical_size_t)guest->vcpu_count << IMSIC_PAGE_SHIFT)) {
+		rc = VMM_EINVALID;
+		goto imsic_emulator_probe_done;
+	}
+
+	s = vmm_zalloc(sizeof(struct imsic_state));
+	if (!s) {
+		rc = VMM_ENOMEM;
+		goto imsic_emulator_probe_done;
+	}
+	s->guest = guest;
+	s->addr = edev->reg->gphys_addr;
+	s->nr_files = guest->vcpu_count;
+
+	s->files = vmm_zalloc(sizeof(*s->files) * s->nr_files);
+	if (!s->files) {
+		rc = VMM_ENOMEM;
+		goto imsic_emulator_probe_freestate_fail;
+	}
+
+	for (i = 0; i < s->nr_files; i++) {
+		vcpu = vmm_manager_guest_vcpu(guest, i);
+		if (!vcpu || riscv_imsic_priv(vcpu)) {
+			rc = VMM_EEXIST;
+			goto imsic_emulator_probe_freefiles_fail;
+		}
+	}
+
+	rc = vmm_devemu_register_msichip(guest, edev->reg->gphys_addr,
+					 edev->reg->phys_size,
+					 &imsic_msichip, s);
+	if (rc) {
+		goto imsic_emulator_probe_freefiles_fail;
+	}
+
+	for (i = 0; i < s->nr_files; i++) {
+		f = &s->files[i];
+		INIT_SPIN_LOCK(&f->lock);
+		f->vcpu = vmm_manager_guest_vcpu(guest, i);
+		f->nr_ids = nr_ids;
+		f->parent_irq = parent_irq;
+		riscv_imsic_priv(f->vcpu) = f;
+	}
+
+	edev->priv = s;
+
+	goto imsic_emulator_probe_done;
+
+imsic_emulator_probe_freefiles_fail:
+	vmm_free(s->files);
+imsic_emulator_probe_freestate_fail:
+	vmm_free(s);
+imsic_emulator_probe_done:
+	return rc;
+}
+
+static int imsic_emulator_remove(struct vmm_emudev *edev)
+{
+	u32 i;
+	struct imsic_state *s = edev->priv;
+
+	if (!s) {
+		return VMM_EFAIL;
+	}
+
+	vmm_devemu_unregister_msichip(s->guest, &imsic_msichip, s);
+	for (i = 0; i < s->nr_files; i++) {
+		riscv_imsic_priv(s->files[i].vcpu) = NULL;
+	}
+	vmm_free(s->files);
+	vmm_free(s);
+	edev->priv = NULL;
+
+	return VMM_OK;
+}
+
+static struct vmm_devtree_nodeid imsic_emulator_emuid_table[] = {
+	{ .type = "pic",
+	  .compatible = "riscv,imsics",
+	},
+	{ /* end of list */ },
+};
+
+VMM_DECLARE_EMULATOR_SIMPLE(imsic_emulator,
+			    "imsic",
+			    imsic_emulator_emuid_table,
+			    VMM_DEVEMU_LITTLE_ENDIAN,
+			    imsic_emulator_probe,
+			    imsic_emulator_remove,
+			    imsic_emulator_reset,
+			    NULL,
+			    imsic_emulator_read,
+			    imsic_emulator_write);
+
+static int __init imsic_emulator_init(void)
+{
+	return vmm_devemu_register_emulator(&imsic_emulator);
+}
+
+static void __exit imsic_emulator_exit(void)
+{
+	vmm_devemu_unregister_emulator(&imsic_emulator);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+		   MODULE_AUTHOR,
+		   MODULE_LICENSE,
+		   MODULE_IPRIORITY,
+		   MODULE_INIT,
+		   MODULE_EXIT);
@@ -0,0 +1,171 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cpu_vcpu_sbi_sta.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief source of SBI STA (steal-time accounting) extension
+ *
+ * The steal time of a VCPU is the time it was runnable but not
+ * running (i.e. time spent in READY state) since the Guest registered
+ * steal-time shared memory. The shared memory is updated using the
+ * sequence counter protocol every time the VCPU is scheduled-in.
+ */
+
+#include <vmm_error.h>
+#include <vmm_macros.h>
+#include <vmm_manager.h>
+#include <vmm_host_io.h>
+#include <vmm_guest_aspace.h>
+#include <arch_barrier.h>
+#include <libs/stringlib.h>
+#include <cpu_vcpu_sbi.h>
+#include <riscv_sbi.h>
+
+static bool vcpu_sbi_sta_write32(struct vmm_vcpu *vcpu,
+				 physical_addr_t addr, u32 val)
+{
+	val = vmm_cpu_to_le32(val);
+	return (vmm_guest_memory_write(vcpu->guest, addr, &val,
+				       sizeof(val), TRUE) == sizeof(val)) ?
+		TRUE : FALSE;
+}
+
+void cpu_vcpu_sbi_sta_update(struct vmm_vcpu *vcpu)
+{
+	u64 steal, val;
+	struct riscv_priv_sta *sta = riscv_sta_priv(vcpu);
+
+	if (!sta->enabled) {
+		return;
+	}
+
+	steal = vcpu->state_ready_nsecs - sta->steal_base;
+	if (steal == sta->last_steal) {
+		return;
+	}
+
+	/* Odd sequence value tells Guest that update is in-progress */
+	sta->sequence++;
+	if (!vcpu_sbi_sta_write32(vcpu, sta->shmem +
+				  SBI_STA_SHMEM_SEQUENCE_OFFSET,
+				  sta->sequence)) {
+		sta->sequence--;
+		return;
+	}
+	arch_wmb();
+
+	val = vmm_cpu_to_le64(steal);
+	vmm_guest_memory_write(vcpu->guest,
+			       sta->shmem + SBI_STA_SHMEM_STEAL_OFFSET,
+			       &val, sizeof(val), TRUE);
+	arch_wmb();
+
+	sta->sequence++;
+	vcpu_sbi_sta_write32(vcpu, sta->shmem + SBI_STA_SHMEM_SEQUENCE_OFFSET,
+			     sta->sequence);
+	sta->last_steal = steal;
+}
+
+void cpu_vcpu_sbi_sta_reset(struct vmm_vcpu *vcpu)
+{
+	struct riscv_priv_sta *sta = riscv_sta_priv(vcpu);
+
+	/* Steal-time shared memory is disabled after VCPU reset */
+	sta->enabled = FALSE;
+	sta->shmem = 0;
+	sta->sequence = 0;
+	sta->steal_base = 0;
+	sta->last_steal = 0;
+}
+
+static int vcpu_sbi_sta_set_shmem(struct vmm_vcpu *vcpu,
+				  unsigned long lo, unsigned long hi,
+				  unsigned long flags)
+{
+	u32 reg_flags = 0x0;
+	physical_addr_t gpa, hpa;
+	physical_size_t avail;
+	u8 zero[SBI_STA_SHMEM_SIZE];
+	struct riscv_priv_sta *sta = riscv_sta_priv(vcpu);
+
+	if (flags) {
+		return SBI_ERR_INVALID_PARAM;
+	}
+
+	if ((lo == (unsigned long)SBI_STA_SHMEM_DISABLE) &&
+	    (hi == (unsigned long)SBI_STA_SHMEM_DISABLE)) {
+		sta->enabled = FALSE;
+		return SBI_SUCCESS;
+	}
+
+	if (lo & (SBI_STA_SHMEM_SIZE - 1)) {
+		return SBI_ERR_INVALID_PARAM;
+	}
+
+#ifdef CONFIG_64BIT
+	if (hi) {
+		return SBI_ERR_INVALID_ADDRESS;
+	}
+	gpa = lo;
+#else
+	gpa = ((physical_addr_t)hi << 32) | lo;
+#endif
+
+	if (vmm_guest_physical_map(vcpu->guest, gpa, SBI_STA_SHMEM_SIZE,
+				   &hpa, &avail, &reg_flags) ||
+	    !(reg_flags & VMM_REGION_ISRAM) ||
+	    (reg_flags & VMM_REGION_READONLY) ||
+	    (avail < SBI_STA_SHMEM_SIZE)) {
+		return SBI_ERR_INVALID_ADDRESS;
+	}
+
+	memset(zero, 0, sizeof(zero));
+	if (vmm_guest_memory_write(vcpu->guest, gpa, zero,
+				   sizeof(zero), TRUE) != sizeof(zero)) {
+		return SBI_ERR_INVALID_ADDRESS;
+	}
+
+	sta->shmem = gpa;
+	sta->sequence = 0;
+	sta->steal_base = vcpu->state_ready_nsecs;
+	sta->last_steal = 0;
+	sta->enabled = TRUE;
+
+	return SBI_SUCCESS;
+}
+
+static int vcpu_sbi_sta_ecall(struct vmm_vcpu *vcpu, unsigned long ext_id,
+			      unsigned long func_id, unsigned long *args,
+			      struct cpu_vcpu_sbi_return *out)
+{
+	switch (func_id) {
+	case SBI_EXT_STA_STEAL_TIME_SET_SHMEM:
+		return vcpu_sbi_sta_set_shmem(vcpu, args[0], args[1], args[2]);
+	default:
+		break;
+	}
+
+	return SBI_ERR_NOT_SUPPORTED;
+}
+
+const struct cpu_vcpu_sbi_extension vcpu_sbi_sta = {
+	.name = "sta",
+	.extid_start = SBI_EXT_STA,
+	.extid_end = SBI_EXT_STA,
+	.handle = vcpu_sbi_sta_ecall,
+};
@@ -24,6 +24,7 @@
 #include <vmm_error.h>
 #include <vmm_macros.h>
 #include <vmm_manager.h>
+#include <vmm_scheduler.h>
 #include <vmm_guest_aspace.h>
 
 #include <cpu_hwcap.h>
@@ -34,11 +35,14 @@
 					 CPU_VCPU_SBI_IMPID)
 
 #define SBI_EXT_XVISOR_ISA_EXT		0x0
+#define SBI_EXT_XVISOR_YIELD_TO		0x1
 
 static int vcpu_sbi_xvisor_ecall(struct vmm_vcpu *vcpu, unsigned long ext_id,
 				 unsigned long func_id, unsigned long *args,
 				 struct cpu_vcpu_sbi_return *out)
 {
+	struct vmm_vcpu *target;
+
 	switch (func_id) {
 	case SBI_EXT_XVISOR_ISA_EXT:
 		if (args[0] < RISCV_ISA_EXT_MAX) {
@@ -49,6 +53,17 @@ static int vcpu_sbi_xvisor_ecall(struct vmm_vcpu *vcpu, unsigned long ext_id,
 			return SBI_ERR_INVALID_PARAM;
 		}
 		break;
+	case SBI_EXT_XVISOR_YIELD_TO:
+		/* Directed yield to given HART or any preempted HART */
+		if (args[0] == -1UL) {
+			vmm_scheduler_yield_to_preempted();
+			break;
+		}
+		target = vmm_manager_guest_vcpu(vcpu->guest, args[0]);
+		if (!target || (target == vcpu))
+			return SBI_ERR_INVALID_PARAM;
+		vmm_scheduler_yield_to(target);
+		break;
 	default:
 		return SBI_ERR_NOT_SUPPORTED;
 	}
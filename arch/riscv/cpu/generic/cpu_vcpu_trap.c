@@ -31,6 +31,7 @@
 
 #include <generic_mmu.h>
 #include <cpu_hwcap.h>
+#include <cpu_vcpu_imsic.h>
 #include <cpu_vcpu_nested.h>
 #include <cpu_vcpu_trap.h>
 #include <cpu_vcpu_unpriv.h>
@@ -565,6 +566,14 @@ static const struct csr_func csr_funcs[] = {
 		.csr_num  = CSR_SIPH,
 		.rmw_func = cpu_vcpu_nested_smode_csr_rmw,
 	},
+	{
+		.csr_num  = CSR_SIREG,
+		.rmw_func = cpu_vcpu_imsic_sireg_rmw,
+	},
+	{
+		.csr_num  = CSR_STOPEI,
+		.rmw_func = cpu_vcpu_imsic_stopei_rmw,
+	},
 	{
 		.csr_num  = CSR_STIMECMP,
 		.rmw_func = cpu_vcpu_nested_smode_csr_rmw,
@@ -188,6 +188,18 @@ struct riscv_priv_nested {
 	unsigned long hvictl;
 };
 
+struct riscv_priv_sta {
+	/* Steal-time shared memory registered by Guest */
+	bool enabled;
+	physical_addr_t shmem;
+	/* Sequence counter of steal-time shared memory */
+	u32 sequence;
+	/* VCPU ready time when shared memory was registered */
+	u64 steal_base;
+	/* Steal time last written to shared memory */
+	u64 last_steal;
+};
+
 #define RISCV_PRIV_MAX_TRAP_CAUSE			0x18
 struct riscv_priv_stats {
 	u64 trap[RISCV_PRIV_MAX_TRAP_CAUSE];
@@ -226,14 +238,19 @@ struct riscv_priv {
 	unsigned long vstval;
 	unsigned long vsatp;
 	unsigned long scounteren;
+	unsigned long vsiselect;
 	/* Nested state */
 	struct riscv_priv_nested nested;
+	/* Steal-time accounting state */
+	struct riscv_priv_sta sta;
 	/* FP state */
 	union riscv_priv_fp fp;
 	/* Opaque pointer to timer data */
 	void *timer_priv;
 	/* Opaque pointer to SBI data */
 	void *sbi_priv;
+	/* Opaque pointer to IMSIC interrupt file */
+	void *imsic_priv;
 };
 
 struct riscv_guest_priv {
@@ -251,8 +268,10 @@ struct riscv_guest_priv {
 #define riscv_nested_priv(vcpu)		(&riscv_priv(vcpu)->nested)
 #define riscv_nested_virt(vcpu)		(riscv_nested_priv(vcpu)->virt)
 #define riscv_fp_priv(vcpu)		(&riscv_priv(vcpu)->fp)
+#define riscv_sta_priv(vcpu)		(&riscv_priv(vcpu)->sta)
 #define riscv_timer_priv(vcpu)		(riscv_priv(vcpu)->timer_priv)
 #define riscv_sbi_priv(vcpu)		(riscv_priv(vcpu)->sbi_priv)
+#define riscv_imsic_priv(vcpu)		(riscv_priv(vcpu)->imsic_priv)
 #define riscv_guest_priv(guest)		((struct riscv_guest_priv *)((guest)->arch_priv))
 #define riscv_guest_serial(guest)	(riscv_guest_priv(guest)->guest_serial)
 
@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cpu_vcpu_imsic.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief header of software emulated IMSIC interrupt files
+ */
+
+#ifndef _CPU_VCPU_IMSIC_H__
+#define _CPU_VCPU_IMSIC_H__
+
+#include <vmm_types.h>
+#include <arch_regs.h>
+
+struct vmm_vcpu;
+
+int cpu_vcpu_imsic_sireg_rmw(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			     unsigned int csr_num, unsigned long *val,
+			     unsigned long new_val, unsigned long wr_mask);
+int cpu_vcpu_imsic_stopei_rmw(struct vmm_vcpu *vcpu, arch_regs_t *regs,
+			      unsigned int csr_num, unsigned long *val,
+			      unsigned long new_val, unsigned long wr_mask);
+
+#endif
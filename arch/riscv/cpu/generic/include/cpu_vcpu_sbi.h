@@ -61,4 +61,8 @@ void cpu_vcpu_sbi_deinit(struct vmm_vcpu *vcpu);
 
 int cpu_vcpu_sbi_xlate_error(int xvisor_error);
 
+void cpu_vcpu_sbi_sta_reset(struct vmm_vcpu *vcpu);
+
+void cpu_vcpu_sbi_sta_update(struct vmm_vcpu *vcpu);
+
 #endif
@@ -44,6 +44,7 @@
 #define SBI_EXT_SRST				0x53525354
 #define SBI_EXT_PMU				0x504D55
 #define SBI_EXT_DBCN				0x4442434E
+#define SBI_EXT_STA				0x535441
 
 /* SBI function IDs for BASE extension */
 #define SBI_EXT_BASE_GET_SPEC_VERSION		0x0
@@ -107,6 +108,18 @@
 #define SBI_SRST_RESET_REASON_NONE	0x0
 #define SBI_SRST_RESET_REASON_SYSFAIL	0x1
 
+/* SBI function IDs for STA extension */
+#define SBI_EXT_STA_STEAL_TIME_SET_SHMEM	0x0
+
+#define SBI_STA_SHMEM_DISABLE			-1
+
+/* SBI STA extension shared memory layout */
+#define SBI_STA_SHMEM_SIZE			64
+#define SBI_STA_SHMEM_SEQUENCE_OFFSET		0
+#define SBI_STA_SHMEM_FLAGS_OFFSET		4
+#define SBI_STA_SHMEM_STEAL_OFFSET		8
+#define SBI_STA_SHMEM_PREEMPTED_OFFSET		16
+
 /* SBI function IDs for PMU extension */
 #define SBI_EXT_PMU_NUM_COUNTERS	0x0
 #define SBI_EXT_PMU_COUNTER_GET_INFO	0x1
@@ -91,6 +91,7 @@ cpu-objs-$(CONFIG_SMP)+=cpu_smp_ops_default.o
 cpu-objs-$(CONFIG_SMP)+=cpu_smp_ops_sbi.o
 cpu-objs-$(CONFIG_SMP)+=cpu_sbi_ipi.o
 cpu-objs-y+= cpu_vcpu_helper.o
+cpu-objs-y+= cpu_vcpu_imsic.o
 cpu-objs-y+= cpu_vcpu_nested.o
 cpu-objs-y+= cpu_vcpu_fp.o
 cpu-objs-y+= cpu_vcpu_irq.o
@@ -99,6 +100,7 @@ cpu-objs-y+= cpu_vcpu_sbi_base.o
 cpu-objs-y+= cpu_vcpu_sbi_legacy.o
 cpu-objs-y+= cpu_vcpu_sbi_replace.o
 cpu-objs-y+= cpu_vcpu_sbi_hsm.o
+cpu-objs-y+= cpu_vcpu_sbi_sta.o
 cpu-objs-y+= cpu_vcpu_sbi_xvisor.o
 cpu-objs-y+= cpu_vcpu_switch.o
 cpu-objs-y+= cpu_vcpu_timer.o
@@ -65,6 +65,8 @@ extern int gpa_to_hpa(struct vcpu_hw_context *context, physical_addr_t vaddr,
 		      physical_addr_t *hpa);
 extern virtual_addr_t get_free_page_for_pagemap(struct vcpu_hw_context *context,
 						physical_addr_t *page_phys);
+extern void free_page_for_pagemap(struct vcpu_hw_context *context,
+				  virtual_addr_t page_virt);
 extern int purge_guest_shadow_pagetable(struct vcpu_hw_context *context);
 extern int create_guest_shadow_map(struct vcpu_hw_context *context,
 				   virtual_addr_t vaddr, physical_addr_t paddr,
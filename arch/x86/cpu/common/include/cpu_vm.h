@@ -108,6 +108,8 @@ struct vcpu_hw_context {
 
 	unsigned int asid;
 	u64 eptp;
+	bool ept_inv_pending; /**< EPT changed, INVEPT due before next VM entry */
+	vmm_spinlock_t ept_lock; /**< Serializes EPT updates of this context */
 	u64 vmcs_state;
 	unsigned long n_cr3;  /* [Note] When #VMEXIT occurs with
 			       * nested paging enabled, hCR3 is not
@@ -116,6 +118,7 @@ struct vcpu_hw_context {
 	union page32 *shadow32_pg_list; /**< Page list for 32-bit guest and paged real mode. */
 	union page32 *shadow32_pgt; /**<32-bit page table */
 	DECLARE_BITMAP(shadow32_pg_map, NR_32BIT_PGLIST_PAGES);
+	DECLARE_BITMAP(ept_stale_map, NR_32BIT_PGLIST_PAGES); /**< Unlinked EPT tables awaiting INVEPT */
 	u32 pgmap_free_cache;
 
 	struct vcpu_intercept_table icept_table;
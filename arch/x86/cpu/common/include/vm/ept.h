@@ -34,6 +34,12 @@
 #define EPT_PROT_MASK		(~(EPT_PROT_READ | EPT_PROT_WRITE	\
 				   | EPT_PROT_EXEC_S | EPT_PROT_EXEC_U))
 
+/* Intermediate tables grant everything, leaves decide the access */
+#define EPT_PROT_TABLE		(EPT_PROT_READ | EPT_PROT_WRITE	\
+				 | EPT_PROT_EXEC_S)
+
+#define EPT_ENTRIES_PER_TABLE	512
+
 #define EPT_PAGE_SIZE_1G	(0x1ULL << 30)
 #define EPT_PAGE_SIZE_2M	(0x1ULL << 21)
 #define EPT_PAGE_SIZE_4K	(0x1ULL << 12)
@@ -45,7 +51,7 @@ extern struct cpuinfo_x86 cpu_info;
 #define EPT_PAGE_MASK_4K	(PHYS_ADDR_BIT_MASK >> 12)
 #define EPT_PAGE_MASK_1G	(PHYS_ADDR_BIT_MASK >> 30)
 
-#define EPT_PHYS_FILTER(_p)	(_p & PHYS_ADDR_BIT_MASK)
+#define EPT_PHYS_FILTER(_p)	((_p) & PHYS_ADDR_BIT_MASK)
 #define EPT_PHYS_2MB_PFN(_p)	(EPT_PHYS_FILTER(_p) >> 21)
 #define EPT_PHYS_1GB_PFN(_p)	(EPT_PHYS_FILTER(_p) >> 30)
 #define EPT_PHYS_4KB_PFN(_p)	(EPT_PHYS_FILTER(_p) >> 12)
@@ -188,5 +194,15 @@ int setup_ept(struct vcpu_hw_context *context);
 int ept_create_pte_map(struct vcpu_hw_context *context,
 		       physical_addr_t gphys, physical_addr_t hphys,
 		       size_t pg_size, u32 pg_prot);
+int ept_destroy_pte_map(struct vcpu_hw_context *context,
+			physical_addr_t gphys, size_t pg_size);
+int ept_unmap_range(struct vcpu_hw_context *context,
+		    physical_addr_t gphys, physical_size_t size);
+/* Return tables unlinked by ept_unmap_range() once INVEPT is done */
+void ept_release_tables(struct vcpu_hw_context *context);
+/* Issue INVEPT for this context on current host CPU */
+void ept_invalidate(struct vcpu_hw_context *context);
+/* Issue one INVEPT for all EPT changes made since the last VM entry */
+void ept_flush_invalidations(struct vcpu_hw_context *context);
 
 #endif /* __EPT_H */
@@ -156,6 +156,8 @@ extern u64 vmx_ept_vpid_cap;
 	(vmx_ept_vpid_cap & VMX_EPT_MEMORY_TYPE_WB)
 #define cpu_has_vmx_ept_2MB				\
 	(vmx_ept_vpid_cap & VMX_EPT_SUPERPAGE_2MB)
+#define cpu_has_vmx_ept_1GB				\
+	(vmx_ept_vpid_cap & VMX_EPT_SUPERPAGE_1GB)
 #define cpu_has_vmx_invept \
 	(vmx_ept_vpid_cap & VMX_EPT_INVEPT_INSTRUCTION)
 #define cpu_has_vmx_ept_invept_single_context		\
@@ -25,6 +25,8 @@
 #include <vmm_heap.h>
 #include <vmm_stdio.h>
 #include <vmm_manager.h>
+#include <vmm_smp.h>
+#include <vmm_cpumask.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_host_aspace.h>
 #include <vmm_macros.h>
@@ -33,6 +35,7 @@
 #include <cpu_features.h>
 #include <cpu_vm.h>
 #include <vm/svm.h>
+#include <vm/ept.h>
 #include <libs/stringlib.h>
 #include <arch_guest_helper.h>
 
@@ -95,8 +98,34 @@ int arch_guest_add_region(struct vmm_guest *guest, struct vmm_region *region)
 	return VMM_OK;
 }
 
+#ifdef CONFIG_VEXT_INTEL_VTX
+#define EPT_INVALIDATE_TIMEOUT_MSECS	1000
+
+/* Runs on each host CPU which may cache EPT translations of guest */
+static void ept_invalidate_guest(void *arg0, void *arg1, void *arg2)
+{
+	irq_flags_t flags;
+	struct vmm_vcpu *vcpu;
+	struct vmm_guest *guest = arg0;
+	struct vcpu_hw_context *context;
+
+	vmm_read_lock_irqsave_lite(&guest->vcpu_lock, flags);
+
+	list_for_each_entry(vcpu, &guest->vcpu_list, head) {
+		if (!vcpu->arch_priv)
+			continue;
+		context = x86_vcpu_hw_context(vcpu);
+		if (context && context->eptp)
+			ept_invalidate(context);
+	}
+
+	vmm_read_unlock_irqrestore_lite(&guest->vcpu_lock, flags);
+}
+#endif
+
 int arch_guest_del_region(struct vmm_guest *guest, struct vmm_region *region)
 {
+	int rc = VMM_OK;
 	struct vmm_vcpu *vcpu;
 	u32 flags;
 
@@ -116,13 +145,65 @@ int arch_guest_del_region(struct vmm_guest *guest, struct vmm_region *region)
 		}
 	} else if (region->flags & (VMM_REGION_REAL | VMM_REGION_MEMORY)) {
 		struct x86_guest_priv *priv = x86_guest_priv(guest);
+#ifdef CONFIG_VEXT_INTEL_VTX
+		struct vcpu_hw_context *context;
+		struct vmm_cpumask cpus = VMM_CPU_MASK_NONE;
+
+		/*
+		 * Drop the EPT mappings of the region so that a region
+		 * added later at the same guest address faults afresh.
+		 * The ept_unmap_range() is serialized against the EPT
+		 * violation handler by per-context EPT lock.
+		 */
+		vmm_read_lock_irqsave_lite(&guest->vcpu_lock, flags);
+
+		list_for_each_entry(vcpu, &guest->vcpu_list, head) {
+			if (!vcpu->arch_priv)
+				continue;
+			context = x86_vcpu_hw_context(vcpu);
+			if (!context || !context->eptp)
+				continue;
+			ept_unmap_range(context,
+					VMM_REGION_GPHYS_START(region),
+					region->phys_size);
+			vmm_cpumask_set_cpu(vcpu->hcpu, &cpus);
+		}
+
+		vmm_read_unlock_irqrestore_lite(&guest->vcpu_lock, flags);
+
+		/*
+		 * Region memory is freed once we return so INVEPT on the
+		 * host CPUs of all VCPUs now. A running VCPU gets out of
+		 * guest mode for the IPI. The ept_inv_pending stays set
+		 * so that a VCPU migrating meanwhile flushes on its next
+		 * VM entry. Unlinked tables are reused only after this
+		 * (if INVEPT times out they wait for the next region del).
+		 */
+		rc = vmm_smp_ipi_sync_call(&cpus, EPT_INVALIDATE_TIMEOUT_MSECS,
+					   ept_invalidate_guest,
+					   guest, NULL, NULL);
+		if (!rc) {
+			vmm_read_lock_irqsave_lite(&guest->vcpu_lock, flags);
+
+			list_for_each_entry(vcpu, &guest->vcpu_list, head) {
+				if (!vcpu->arch_priv)
+					continue;
+				context = x86_vcpu_hw_context(vcpu);
+				if (context && context->eptp)
+					ept_release_tables(context);
+			}
+
+			vmm_read_unlock_irqrestore_lite(&guest->vcpu_lock,
+							flags);
+		}
+#endif
 
 		if (priv->tot_ram_sz && priv->tot_ram_sz >= region->phys_size)
 			/* += ? Multiple memory regions may be */
 			priv->tot_ram_sz += region->phys_size;
 	}
 
-	return VMM_OK;
+	return rc;
 }
 
 static void guest_cmos_init(struct vmm_guest *guest)
@@ -298,7 +379,11 @@ static inline int free_page_index_in_pglist(struct vcpu_hw_context *context)
 	if (context->pgmap_free_cache) {
 		boffs = context->pgmap_free_cache;
 		context->pgmap_free_cache = 0;
-		return boffs;
+		/* Cache is only a hint, the page may be in use by now */
+		if (boffs < NR_32BIT_PGLIST_PAGES &&
+		    !bitmap_allocate_region(context->shadow32_pg_map,
+					    boffs, 0))
+			return boffs;
 	}
 
 	if ((boffs = bitmap_find_free_region(context->shadow32_pg_map,
@@ -338,6 +423,19 @@ virtual_addr_t get_free_page_for_pagemap(struct vcpu_hw_context *context,
 	return tvaddr;
 }
 
+/* Return a page got from get_free_page_for_pagemap() to the list */
+void free_page_for_pagemap(struct vcpu_hw_context *context,
+			   virtual_addr_t page_virt)
+{
+	int index = (page_virt - (virtual_addr_t)context->shadow32_pg_list)
+		    / PAGE_SIZE;
+
+	if (index < 0 || index >= NR_32BIT_PGLIST_PAGES)
+		return;
+
+	bitmap_release_region(context->shadow32_pg_map, index, 0);
+}
+
 int create_guest_shadow_map(struct vcpu_hw_context *context,
 			    virtual_addr_t vaddr, physical_addr_t paddr,
 			    size_t size, u32 pdprot, u32 pgprot)
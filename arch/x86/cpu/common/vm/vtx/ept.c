@@ -23,6 +23,7 @@
 #include <vmm_error.h>
 #include <vmm_types.h>
 #include <vmm_stdio.h>
+#include <vmm_spinlocks.h>
 #include <vmm_host_aspace.h>
 #include <vmm_guest_aspace.h>
 #include <cpu_vm.h>
@@ -51,7 +52,7 @@ typedef struct ept_trace_entry {
 	u64 pdpt_index:10;
 	u64 pde_index:10;
 	u64 pt_index:10;
-	u64 pg_sz:24;
+	u64 pg_sz:24;		/* in units of 4K */
 	u32 pg_prot;
 } ept_trace_entry_t;
 
@@ -69,7 +70,7 @@ static void init_ept_trace(void)
 }
 
 static void add_ept_trace_point(u64 gphys, u64 hphys, u32 pml4, u32 pdpt,
-				u32 pde, u32 pt, u32 sz, u32 pg_prot)
+				u32 pde, u32 pt, u64 sz, u32 pg_prot)
 {
 	ept_trace_entry_t *te = &ept_trace.ept_trace_buf[ept_trace.trace_index];
 
@@ -79,7 +80,7 @@ static void add_ept_trace_point(u64 gphys, u64 hphys, u32 pml4, u32 pdpt,
 	te->pdpt_index = pdpt;
 	te->pde_index = pde;
 	te->pt_index = pt;
-	te->pg_sz = sz;
+	te->pg_sz = sz >> 12;
 	te->pg_prot = pg_prot;
 
 	ept_trace.trace_index++;
@@ -91,7 +92,7 @@ static void add_ept_trace_point(u64 gphys, u64 hphys, u32 pml4, u32 pdpt,
 #else
 static void init_ept_trace(void) {}
 static void add_ept_trace_point(u64 gphys, u64 hphys, u32 pml4, u32 pdpt,
-				u32 pde, u32 pg_prot) {}
+				u32 pde, u32 pt, u64 sz, u32 pg_prot) {}
 #endif /* EPT Trace */
 
 static inline u32 ept_pml4_index(physical_addr_t gphys)
@@ -136,8 +137,8 @@ invalidate_ept (int type, struct invept_desc *desc)
 			X86_DEBUG_LOG(ept, LVL_DEBUG, "EPT single context flush not supported\n");
 			return;
 		}
-		asm volatile("invept (%0), %1\n\t"
-			     ::"D"(type), "S"(desc)
+		asm volatile("invept (%1), %0\n\t"
+			     ::"D"((u64)type), "S"(desc)
 			     :"memory", "cc");
 	} else {
 		X86_DEBUG_LOG(ept, LVL_DEBUG, "INVEPT instruction is not supported by CPU\n");
@@ -186,9 +187,99 @@ static void decode_ept_entry(enum ept_level level, void *entry,
 	}
 }
 
-int ept_create_pte_map(struct vcpu_hw_context *context,
-		       physical_addr_t gphys, physical_addr_t hphys,
-		       size_t pg_size, u32 pg_prot)
+/*
+ * Break a 1G leaf into a page directory of 512 2M leaves with the
+ * same host frames and protection. Used when a sub-range of a huge
+ * page must be remapped (MMIO hole, dirty tracking, etc).
+ */
+static int ept_split_pdpte(struct vcpu_hw_context *context,
+			   ept_pdpte_t *pdpte)
+{
+	int i;
+	u32 prot;
+	ept_pde_t *pd;
+	virtual_addr_t virt;
+	physical_addr_t phys, hphys;
+
+	hphys = EPT_PHYS_1GB_PAGE((u64)pdpte->pe.phys);
+	prot = (pdpte->val & ~EPT_PROT_MASK);
+
+	virt = get_free_page_for_pagemap(context, &phys);
+	if (!virt) {
+		X86_DEBUG_LOG(ept, LVL_ERR, "System is out of guest page table memory\n");
+		return VMM_ENOMEM;
+	}
+	memset((void *)virt, 0, PAGE_SIZE);
+
+	pd = (ept_pde_t *)virt;
+	for (i = 0; i < EPT_ENTRIES_PER_TABLE; i++) {
+		pd[i].val = prot;
+		pd[i].pe.phys = EPT_PHYS_2MB_PFN(hphys + (i * EPT_PAGE_SIZE_2M));
+		pd[i].pe.mt = pdpte->pe.mt;
+		pd[i].pe.ign_pat = pdpte->pe.ign_pat;
+		pd[i].pe.is_page = 1;
+	}
+
+	pdpte->val = EPT_PROT_TABLE;
+	pdpte->te.pd_base = EPT_PHYS_4KB_PFN(phys);
+
+	X86_DEBUG_LOG(ept, LVL_DEBUG, "Split 1G page at 0x%"PRIx64" into 2M pages\n", hphys);
+
+	context->ept_inv_pending = TRUE;
+
+	return VMM_OK;
+}
+
+/*
+ * Break a 2M leaf into a page table of 512 4K leaves with the
+ * same host frames and protection.
+ */
+static int ept_split_pde(struct vcpu_hw_context *context, ept_pde_t *pde)
+{
+	int i;
+	u32 prot;
+	ept_pte_t *pt;
+	virtual_addr_t virt;
+	physical_addr_t phys, hphys;
+
+	hphys = EPT_PHYS_2MB_PAGE((u64)pde->pe.phys);
+	prot = (pde->val & ~EPT_PROT_MASK);
+
+	virt = get_free_page_for_pagemap(context, &phys);
+	if (!virt) {
+		X86_DEBUG_LOG(ept, LVL_ERR, "System is out of guest page table memory\n");
+		return VMM_ENOMEM;
+	}
+	memset((void *)virt, 0, PAGE_SIZE);
+
+	pt = (ept_pte_t *)virt;
+	for (i = 0; i < EPT_ENTRIES_PER_TABLE; i++) {
+		pt[i].val = prot;
+		pt[i].pe.phys = EPT_PHYS_4KB_PFN(hphys + (i * EPT_PAGE_SIZE_4K));
+		pt[i].pe.mt = pde->pe.mt;
+		pt[i].pe.ign_pat = pde->pe.ign_pat;
+	}
+
+	pde->val = EPT_PROT_TABLE;
+	pde->te.pt_base = EPT_PHYS_4KB_PFN(phys);
+
+	X86_DEBUG_LOG(ept, LVL_DEBUG, "Split 2M page at 0x%"PRIx64" into 4K pages\n", hphys);
+
+	context->ept_inv_pending = TRUE;
+
+	return VMM_OK;
+}
+
+/*
+ * Walk the EPT down to the table holding the leaf for a page of pg_size
+ * at gphys, allocating intermediate tables on the way. Larger leaves
+ * found on the way are split. If a smaller granularity table already
+ * exists where a large leaf is wanted VMM_EEXIST is returned so that
+ * the caller can fall back to a smaller page size.
+ */
+static int ept_walk_to_leaf(struct vcpu_hw_context *context,
+			    physical_addr_t gphys, size_t pg_size,
+			    bool alloc, u64 **leaf)
 {
 	u32 pml4_index = ept_pml4_index(gphys);
 	u32 pdpt_index = ept_pdpt_index(gphys);
@@ -197,263 +288,408 @@ int ept_create_pte_map(struct vcpu_hw_context *context,
 	ept_pml4e_t *pml4e;
 	ept_pdpte_t *pdpte;
 	ept_pde_t   *pde;
-	ept_pte_t   *pte;
 	u64 *pml4 = (u64 *)context->n_cr3;
 	physical_addr_t phys;
 	virtual_addr_t virt;
 	u32 e_pg_prot;
 	physical_addr_t e_phys;
-	int rc = 0;
-	struct invept_desc id;
+	int rc;
 
 	X86_DEBUG_LOG(ept, LVL_DEBUG, "pml4: 0x%"PRIx32" pdpt: 0x%"PRIx32" pd: 0x%"PRIx32" pt: 0x%"PRIx32"\n",
 	       pml4_index, pdpt_index, pd_index, pt_index);
 
-	add_ept_trace_point(gphys, hphys, pml4_index, pdpt_index, pd_index, pt_index, pg_size, pg_prot);
-
 	pml4e = (ept_pml4e_t *)(&pml4[pml4_index]);
 	decode_ept_entry(EPT_LEVEL_PML4E, (void *)pml4e, &e_phys, &e_pg_prot);
 	if (!e_pg_prot) {
-		pml4e->val = 0;
-		pml4e->val &= EPT_PROT_MASK;
-		pml4e->val |= pg_prot;
+		if (!alloc)
+			return VMM_ENOENT;
 		virt = get_free_page_for_pagemap(context, &phys);
 		if (!virt) {
 			X86_DEBUG_LOG(ept, LVL_ERR, "System is out of guest page table memory\n");
-			rc =  VMM_ENOMEM;
-			goto _done;
+			return VMM_ENOMEM;
 		}
 		X86_DEBUG_LOG(ept, LVL_DEBUG, "New PDPT Page at 0x%"PRIx64" (Phys: 0x%"PRIx64") for PML4 Index %d.\n",
 		       virt, phys, pml4_index);
 		memset((void *)virt, 0, PAGE_SIZE);
+		pml4e->val = EPT_PROT_TABLE;
 		pml4e->bits.pdpt_base = EPT_PHYS_4KB_PFN(phys);
-	} else {
-		if (vmm_host_pa2va(e_phys, &virt) != VMM_OK) {
-			X86_DEBUG_LOG(ept, LVL_ERR, "Couldn't map PDPTE physical 0x%"PRIx64" to virtual\n",
-			       e_phys);
-			rc = VMM_ENOENT;
-			goto _done;
-		}
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "Found PDPT Page at 0x%"PRIx64" (phys: 0x%"PRIx64") for PML4 Index: %d\n",
-		       virt, e_phys, pml4_index);
+	} else if (vmm_host_pa2va(e_phys, &virt) != VMM_OK) {
+		X86_DEBUG_LOG(ept, LVL_ERR, "Couldn't map PDPTE physical 0x%"PRIx64" to virtual\n",
+		       e_phys);
+		return VMM_ENOENT;
 	}
-	X86_DEBUG_LOG(ept, LVL_DEBUG, "%s: PML4E: 0x%"PRIx64"\n", __func__, pml4e->val);
 
-	phys = e_phys = e_pg_prot = 0;
 	pdpte = (ept_pdpte_t *)(&((u64 *)virt)[pdpt_index]);
-	X86_DEBUG_LOG(ept, LVL_DEBUG, "%s: PDPTE: 0x%"PRIx64" (PDPT Index: %d)\n", __func__, pdpte->val, pdpt_index);
-	decode_ept_entry(EPT_LEVEL_PDPTE, (void *)pdpte, &e_phys, &e_pg_prot);
+	if (pg_size == EPT_PAGE_SIZE_1G) {
+		decode_ept_entry(EPT_LEVEL_PDPTE, (void *)pdpte, &e_phys, &e_pg_prot);
+		if (e_pg_prot && !pdpte->pe.is_page)
+			return VMM_EEXIST;
+		*leaf = &pdpte->val;
+		return VMM_OK;
+	}
 
-	/*
-	 * if page protection bits are set and this is marked as a resident
-	 * page, its an error. Caller is trying to set a map without freeing
-	 * up the other one.
-	 */
 	if (pdpte->pe.is_page) {
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "PDPTE is page\n");
-		/* this is marked as 1GB page and new mapping wants otherwise
-		 * then its a problem. Caller didn't free this mapping prior
-		 * to calling this function */
-		if (pg_size != EPT_PAGE_SIZE_1G) {
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "New page size is not 1G (0x%"PRIx64"). Delete existing entry first.\n", pg_size);
-			rc = VMM_EBUSY;
-			goto _done;
-		}
-
-		/* caller is trying to create same mapping? */
-		if (e_phys == hphys) {
-			if (pg_prot != e_pg_prot) {
-				pdpte->val |= pg_prot;
-				/* need to invalidate ept as prot bits changed */
-				goto _invalidate_ept;
-			} else {
-				/* no change, same as existing mapping */
-				rc = VMM_OK;
-				goto _done;
-			}
-		} else {
-			/* existing physical is not same as new one. flag as error.
-			 * caller should have unmapped this mapping first */
-			rc = VMM_EBUSY;
-			goto _done;
-		}
+		if (!alloc && !(pdpte->val & ~EPT_PROT_MASK))
+			return VMM_ENOENT;
+		if ((rc = ept_split_pdpte(context, pdpte)) != VMM_OK)
+			return rc;
 	}
 
-	if (pg_size == EPT_PAGE_SIZE_1G) {
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "Creating map of 1G page at pdpt index: %d\n", pdpt_index);
-		pdpte->val = 0;
-		pdpte->val &= EPT_PROT_MASK;
-		pdpte->val |= pg_prot;
-		pdpte->pe.phys = EPT_PHYS_1GB_PFN(hphys);
-		pdpte->pe.mt = 6; /* write-back memory type */
-		pdpte->pe.ign_pat = 1; /* ignore PAT type */
-		pdpte->pe.is_page = 1;
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "New PDPT Entry: 0x%"PRIx64"\n", pdpte->val);
-		rc = VMM_OK;
-		/* new entry. Invalidate EPT */
-		goto _invalidate_ept;
-	} else { /* not a 1G page */
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "PDPTE doesn't point to 1G page. Looking for PDE\n");
-		if (!e_pg_prot) { /* if the page is not currently set */
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "PDE page protection not set. Creating new one\n");
-			virt = get_free_page_for_pagemap(context, &phys);
-			/* allocate a new PDPTE page */
-			if (!virt) {
-				X86_DEBUG_LOG(ept, LVL_ERR, "System is out of guest page table memory\n");
-				rc = VMM_ENOMEM;
-				goto _done;
-			}
-			memset((void *)virt, 0, PAGE_SIZE);
-			pdpte->val = 0;
-			pdpte->te.pd_base = EPT_PHYS_4KB_PFN(phys);
-			pdpte->val &= EPT_PROT_MASK;
-			pdpte->val |= pg_prot;
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "New PD Page at 0x%"PRIx64" (Phys: 0x%"PRIx64")\n", virt, phys);
-		} else { /* page is already allocated, a mapping in locality exists */
-			if (vmm_host_pa2va(e_phys, &virt) != VMM_OK) {
-				X86_DEBUG_LOG(ept, LVL_ERR, "Couldn't map PDE physical 0x%"PRIx64" to virtual\n",
-				       e_phys);
-				rc = VMM_ENOENT;
-				goto _done;
-			}
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "Found PDE at virtual address 0x%"PRIx64"\n", virt);
+	decode_ept_entry(EPT_LEVEL_PDPTE, (void *)pdpte, &e_phys, &e_pg_prot);
+	if (!e_pg_prot) {
+		if (!alloc)
+			return VMM_ENOENT;
+		virt = get_free_page_for_pagemap(context, &phys);
+		if (!virt) {
+			X86_DEBUG_LOG(ept, LVL_ERR, "System is out of guest page table memory\n");
+			return VMM_ENOMEM;
 		}
+		memset((void *)virt, 0, PAGE_SIZE);
+		pdpte->val = EPT_PROT_TABLE;
+		pdpte->te.pd_base = EPT_PHYS_4KB_PFN(phys);
+		X86_DEBUG_LOG(ept, LVL_DEBUG, "New PD Page at 0x%"PRIx64" (Phys: 0x%"PRIx64")\n", virt, phys);
+	} else if (vmm_host_pa2va(e_phys, &virt) != VMM_OK) {
+		X86_DEBUG_LOG(ept, LVL_ERR, "Couldn't map PDE physical 0x%"PRIx64" to virtual\n",
+		       e_phys);
+		return VMM_ENOENT;
 	}
-	X86_DEBUG_LOG(ept, LVL_DEBUG, "%s: PDPTE: 0x%"PRIx64"\n", __func__, pdpte->val);
 
-	phys = e_phys = e_pg_prot = 0;
 	pde = (ept_pde_t *)(&((u64 *)virt)[pd_index]);
-	X86_DEBUG_LOG(ept, LVL_DEBUG, "PDPTE Entry at index %d = 0x%"PRIx64"\n", pd_index, pde->val);
-	decode_ept_entry(EPT_LEVEL_PDE, (void *)pde, &e_phys, &e_pg_prot);
+	if (pg_size == EPT_PAGE_SIZE_2M) {
+		decode_ept_entry(EPT_LEVEL_PDE, (void *)pde, &e_phys, &e_pg_prot);
+		if (e_pg_prot && !pde->pe.is_page)
+			return VMM_EEXIST;
+		*leaf = &pde->val;
+		return VMM_OK;
+	}
 
 	if (pde->pe.is_page) {
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "PDE is a 2MB Page!\n");
-		/* this is marked as 1GB page and new mapping wants otherwise
-		 * then its a problem. Caller didn't free this mapping prior
-		 * to calling this function */
-		if (pg_size != EPT_PAGE_SIZE_2M) {
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "New page is not 2M. Delete previous entry first.\n");
-			rc = VMM_EBUSY;
-			goto _done;
+		if (!alloc && !(pde->val & ~EPT_PROT_MASK))
+			return VMM_ENOENT;
+		if ((rc = ept_split_pde(context, pde)) != VMM_OK)
+			return rc;
+	}
+
+	decode_ept_entry(EPT_LEVEL_PDE, (void *)pde, &e_phys, &e_pg_prot);
+	if (!e_pg_prot) {
+		if (!alloc)
+			return VMM_ENOENT;
+		virt = get_free_page_for_pagemap(context, &phys);
+		if (!virt) {
+			X86_DEBUG_LOG(ept, LVL_ERR, "System is out of guest page table memory\n");
+			return VMM_ENOMEM;
 		}
+		memset((void *)virt, 0, PAGE_SIZE);
+		pde->val = EPT_PROT_TABLE;
+		pde->te.pt_base = EPT_PHYS_4KB_PFN(phys);
+		X86_DEBUG_LOG(ept, LVL_DEBUG, "New PT page at 0x%"PRIx64" (Phys: 0x%"PRIx64")\n",
+		       virt, phys);
+	} else if (vmm_host_pa2va(e_phys, &virt) != VMM_OK) {
+		X86_DEBUG_LOG(ept, LVL_ERR, "Couldn't map PTE physical 0x%"PRIx64" to virtual\n",
+		       e_phys);
+		return VMM_ENOENT;
+	}
+
+	*leaf = &((u64 *)virt)[pt_index];
 
-		/* caller is trying to create same mapping? */
-		if (e_phys == hphys) {
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "Found same physical addres at pd index: %d\n", pd_index);
-			if (pg_prot != e_pg_prot) {
-				X86_DEBUG_LOG(ept, LVL_DEBUG, "PG prot are not same. Old: 0x%"PRIx32" New: 0x%"PRIx32"\n",
-				       e_pg_prot, pg_prot);
-				pde->val |= pg_prot;
-				rc = VMM_OK;
-				/* pgprot changed, invalidate ept */
-				goto _invalidate_ept;
-			} else {
-				X86_DEBUG_LOG(ept, LVL_DEBUG, "No change in page table entry.\n");
-				/* no change, same as existing mapping */
-				rc = VMM_OK;
-				goto _done;
-			}
-		} else {
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "pd index %d is busy. Val: 0x%"PRIx64"\n", pd_index, pde->val);
-			/* existing physical is not same as new one. flag as error.
-			 * caller should have unmapped this mapping first */
-			rc = VMM_EBUSY;
-			goto _done;
+	return VMM_OK;
+}
+
+static int __ept_create_pte_map(struct vcpu_hw_context *context,
+				physical_addr_t gphys, physical_addr_t hphys,
+				size_t pg_size, u32 pg_prot)
+{
+	int rc;
+	u64 *leaf = NULL;
+	u32 e_pg_prot;
+	physical_addr_t e_phys;
+	ept_pdpte_t *pdpte = NULL;
+	ept_pde_t *pde = NULL;
+	ept_pte_t *pte = NULL;
+
+	add_ept_trace_point(gphys, hphys, ept_pml4_index(gphys),
+			    ept_pdpt_index(gphys), ept_pd_index(gphys),
+			    ept_pt_index(gphys), pg_size, pg_prot);
+
+	rc = ept_walk_to_leaf(context, gphys, pg_size, TRUE, &leaf);
+	if (rc != VMM_OK)
+		return rc;
+
+	switch (pg_size) {
+	case EPT_PAGE_SIZE_1G:
+		pdpte = (ept_pdpte_t *)leaf;
+		decode_ept_entry(EPT_LEVEL_PDPTE, leaf, &e_phys, &e_pg_prot);
+		break;
+	case EPT_PAGE_SIZE_2M:
+		pde = (ept_pde_t *)leaf;
+		decode_ept_entry(EPT_LEVEL_PDE, leaf, &e_phys, &e_pg_prot);
+		break;
+	default:
+		pte = (ept_pte_t *)leaf;
+		decode_ept_entry(EPT_LEVEL_PTE, leaf, &e_phys, &e_pg_prot);
+		break;
+	}
+
+	if (e_pg_prot) { /* mapping exists */
+		if (e_phys != hphys) {
+			/* existing physical is not same as new one. flag as
+			 * error. caller should have unmapped this mapping first */
+			X86_DEBUG_LOG(ept, LVL_DEBUG, "Existing entry for 0x%"PRIx64" maps phys 0x%"PRIx64" (new: 0x%"PRIx64")\n",
+			       gphys, e_phys, hphys);
+			return VMM_EBUSY;
+		}
+		if (e_pg_prot == pg_prot) {
+			/* no change, same as existing mapping */
+			return VMM_OK;
 		}
+		/* present entry changed, cached translations are stale */
+		*leaf = (*leaf & EPT_PROT_MASK) | pg_prot;
+		context->ept_inv_pending = TRUE;
+		return VMM_OK;
 	}
 
-	/* not a 2MB page, is caller trying to create a 2MB page? */
-	if (pg_size == EPT_PAGE_SIZE_2M) {
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "Ask is to create 2MB page\n");
-		pdpte->val = 0;
-		pdpte->val &= EPT_PROT_MASK;
-		pdpte->val |= pg_prot;
-		pdpte->pe.phys = EPT_PHYS_2MB_PFN(hphys);
+	/*
+	 * New entry in place of a non-present one. The processor does
+	 * not cache non-present EPT entries so no INVEPT is required.
+	 */
+	switch (pg_size) {
+	case EPT_PAGE_SIZE_1G:
+		pdpte->val = pg_prot;
+		pdpte->pe.phys = EPT_PHYS_1GB_PFN(hphys);
 		pdpte->pe.mt = 6; /* write-back memory type */
 		pdpte->pe.ign_pat = 1; /* ignore PAT type */
 		pdpte->pe.is_page = 1;
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "New 2MB page. PDE Value: 0x%"PRIx64" at index: %d.\n", pdpte->val, pd_index);
-		rc = VMM_OK;
-		goto _invalidate_ept;
-	} else {
-		/* Ok. So this is PDE. Lets find PTE now. */
-		if (!e_pg_prot) { /* page for PTE is not currently set */
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "Page protection bits not set in PTE page. Creating new one.\n");
-			virt = get_free_page_for_pagemap(context, &phys);
-			/* allocate a new PTE page */
-			if (!virt) {
-				X86_DEBUG_LOG(ept, LVL_ERR, "System is out of guest page table memory\n");
-				rc = VMM_ENOMEM;
-				goto _done;
-			}
-			memset((void *)virt, 0, PAGE_SIZE);
-			pde->val = 0;
-			pde->te.pt_base = EPT_PHYS_4KB_PFN(phys);
-			pde->val &= EPT_PROT_MASK;
-			pde->val |= pg_prot;
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "New PT page at 0x%"PRIx64" (Phys: 0x%"PRIx64")\n",
-			       virt, phys);
-		} else { /* page is already allocated, a mapping in locality exists */
-			if (vmm_host_pa2va(e_phys, &virt) != VMM_OK) {
-				X86_DEBUG_LOG(ept, LVL_ERR, "Couldn't map PDE physical 0x%"PRIx64" to virtual\n",
-				       e_phys);
-				rc = VMM_ENOENT;
-				goto _done;
-			}
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "Found PT at virt 0x%"PRIx64"\n", virt);
-		}
+		X86_DEBUG_LOG(ept, LVL_DEBUG, "New 1G page. PDPTE: 0x%"PRIx64"\n", pdpte->val);
+		break;
+	case EPT_PAGE_SIZE_2M:
+		pde->val = pg_prot;
+		pde->pe.phys = EPT_PHYS_2MB_PFN(hphys);
+		pde->pe.mt = 6; /* write-back memory type */
+		pde->pe.ign_pat = 1; /* ignore PAT type */
+		pde->pe.is_page = 1;
+		X86_DEBUG_LOG(ept, LVL_DEBUG, "New 2M page. PDE: 0x%"PRIx64"\n", pde->val);
+		break;
+	default:
+		pte->val = pg_prot;
+		pte->pe.mt = 6;
+		pte->pe.phys = EPT_PHYS_4KB_PFN(hphys);
+		X86_DEBUG_LOG(ept, LVL_DEBUG, "New 4K page. PTE: 0x%"PRIx64"\n", pte->val);
+		break;
+	};
+
+	return VMM_OK;
+}
+
+int ept_create_pte_map(struct vcpu_hw_context *context,
+		       physical_addr_t gphys, physical_addr_t hphys,
+		       size_t pg_size, u32 pg_prot)
+{
+	int rc;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&context->ept_lock, flags);
+	rc = __ept_create_pte_map(context, gphys, hphys, pg_size, pg_prot);
+	vmm_spin_unlock_irqrestore(&context->ept_lock, flags);
+
+	return rc;
+}
+
+static int __ept_destroy_pte_map(struct vcpu_hw_context *context,
+				 physical_addr_t gphys, size_t pg_size)
+{
+	int rc;
+	u64 *leaf = NULL;
+
+	rc = ept_walk_to_leaf(context, gphys, pg_size, FALSE, &leaf);
+	if (rc == VMM_ENOENT)
+		return VMM_OK;
+	if (rc != VMM_OK)
+		return rc;
+
+	if (*leaf & ~EPT_PROT_MASK) {
+		*leaf = 0;
+		context->ept_inv_pending = TRUE;
 	}
-	X86_DEBUG_LOG(ept, LVL_DEBUG, "%s: PDE: 0x%"PRIx64"\n", __func__, pde->val);
 
-	e_phys = e_pg_prot = 0;
-	pte = (ept_pte_t *)(&((u64 *)virt)[pt_index]);
-	X86_DEBUG_LOG(ept, LVL_DEBUG, "PT Entry 0x%"PRIx64" at index: %d\n", pte->val, pt_index);
-	decode_ept_entry(EPT_LEVEL_PTE, (void *)pte, &e_phys, &e_pg_prot);
-	if (e_pg_prot) { /* mapping exists */
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "Page mapping exists: current pgprot: 0x%"PRIx32"\n", e_pg_prot);
-		if (e_phys == hphys) {
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "Existing physical and asked are same. (e_phys: 0x%"PRIx64" h_phys: 0x%"PRIx64")\n", e_phys, hphys);
-			if (e_pg_prot == pg_prot) { /* same mapping */
-				X86_DEBUG_LOG(ept, LVL_DEBUG, "Same PG prot: old: 0x%"PRIx32" new: 0x%"PRIx32"\n", e_pg_prot, pg_prot);
-				rc = VMM_OK;
-				goto _done; /* no change */
-			}
-			pte->val = 0;
-			rc = VMM_OK;
-			pte->val |= pg_prot;
-			goto _invalidate_ept;
-		} else {
-			X86_DEBUG_LOG(ept, LVL_DEBUG, "Existing PTE entry found at index: %d but with phys: 0x%"PRIx64" (new: 0x%"PRIx64")\n",
-			       pt_index, e_phys, hphys);
-			rc = VMM_EBUSY;
-			goto _done;
+	return VMM_OK;
+}
+
+int ept_destroy_pte_map(struct vcpu_hw_context *context,
+			physical_addr_t gphys, size_t pg_size)
+{
+	int rc;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&context->ept_lock, flags);
+	rc = __ept_destroy_pte_map(context, gphys, pg_size);
+	vmm_spin_unlock_irqrestore(&context->ept_lock, flags);
+
+	return rc;
+}
+
+static bool ept_table_empty(virtual_addr_t table)
+{
+	int i;
+
+	for (i = 0; i < EPT_ENTRIES_PER_TABLE; i++) {
+		if (((u64 *)table)[i])
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Unlink the table referenced by entry if none of its entries is in
+ * use. The table page is only parked in the stale map because the
+ * processor may still hold paging-structure cache entries pointing
+ * to it. It is returned by ept_release_tables() after INVEPT.
+ */
+static void ept_prune_table(struct vcpu_hw_context *context,
+			    enum ept_level level, u64 *entry)
+{
+	u32 e_pg_prot;
+	physical_addr_t e_phys;
+	virtual_addr_t table;
+
+	decode_ept_entry(level, (void *)entry, &e_phys, &e_pg_prot);
+	if (!e_pg_prot ||
+	    (level != EPT_LEVEL_PML4E && ((ept_pde_t *)entry)->pe.is_page))
+		return;
+	if (vmm_host_pa2va(e_phys, &table) != VMM_OK)
+		return;
+	if (!ept_table_empty(table))
+		return;
+
+	*entry = 0;
+	set_bit((table - (virtual_addr_t)context->shadow32_pg_list) / PAGE_SIZE,
+		context->ept_stale_map);
+	context->ept_inv_pending = TRUE;
+}
+
+/* Unlink the tables on the walk to gphys which have become empty */
+static void ept_prune_tables(struct vcpu_hw_context *context,
+			     physical_addr_t gphys)
+{
+	u64 *pml4 = (u64 *)context->n_cr3;
+	u64 *pml4e, *pdpte, *pde;
+	u32 e_pg_prot;
+	physical_addr_t e_phys;
+	virtual_addr_t virt;
+
+	pml4e = &pml4[ept_pml4_index(gphys)];
+	decode_ept_entry(EPT_LEVEL_PML4E, (void *)pml4e, &e_phys, &e_pg_prot);
+	if (!e_pg_prot || vmm_host_pa2va(e_phys, &virt) != VMM_OK)
+		return;
+
+	pdpte = &((u64 *)virt)[ept_pdpt_index(gphys)];
+	decode_ept_entry(EPT_LEVEL_PDPTE, (void *)pdpte, &e_phys, &e_pg_prot);
+	if (e_pg_prot && !((ept_pdpte_t *)pdpte)->pe.is_page &&
+	    vmm_host_pa2va(e_phys, &virt) == VMM_OK) {
+		pde = &((u64 *)virt)[ept_pd_index(gphys)];
+		ept_prune_table(context, EPT_LEVEL_PDE, pde);
+		ept_prune_table(context, EPT_LEVEL_PDPTE, pdpte);
+	}
+
+	ept_prune_table(context, EPT_LEVEL_PML4E, pml4e);
+}
+
+/*
+ * Remove all mappings of a guest physical range. Each chunk is torn
+ * down with the largest leaf its alignment allows, dropping to a
+ * smaller size where the EPT already holds a finer table. Large
+ * leaves straddling the range boundaries are split.
+ */
+int ept_unmap_range(struct vcpu_hw_context *context,
+		    physical_addr_t gphys, physical_size_t size)
+{
+	int rc = VMM_OK;
+	size_t pg_size;
+	irq_flags_t flags;
+	physical_addr_t end = gphys + size;
+
+	gphys &= ~((physical_addr_t)PAGE_SIZE - 1);
+
+	vmm_spin_lock_irqsave(&context->ept_lock, flags);
+
+	while (gphys < end) {
+		if (!(gphys & (EPT_PAGE_SIZE_1G - 1)) &&
+		    (end - gphys) >= EPT_PAGE_SIZE_1G)
+			pg_size = EPT_PAGE_SIZE_1G;
+		else if (!(gphys & (EPT_PAGE_SIZE_2M - 1)) &&
+			 (end - gphys) >= EPT_PAGE_SIZE_2M)
+			pg_size = EPT_PAGE_SIZE_2M;
+		else
+			pg_size = PAGE_SIZE;
+
+		while ((rc = __ept_destroy_pte_map(context, gphys, pg_size))
+		       == VMM_EEXIST) {
+			pg_size = (pg_size == EPT_PAGE_SIZE_1G) ?
+				  EPT_PAGE_SIZE_2M : PAGE_SIZE;
 		}
-	} else {
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "No page protection bits set in PTE. Creating new one\n");
-		pte->val = 0;
-		pte->val &= EPT_PROT_MASK;
-		pte->val |= pg_prot;
-		pte->pe.mt = 6;
-		pte->pe.phys = EPT_PHYS_4KB_PFN(hphys);
-		rc = VMM_OK;
-		X86_DEBUG_LOG(ept, LVL_DEBUG, "%s: PTE: 0x%"PRIx64" at index %d\n", __func__, pte->val, pt_index);
-		goto _invalidate_ept;
+		if (rc != VMM_OK)
+			break;
+
+		gphys += pg_size;
+
+		/* Drop tables emptied once we are done with them */
+		if (!(gphys & (EPT_PAGE_SIZE_2M - 1)) || gphys >= end)
+			ept_prune_tables(context, gphys - pg_size);
 	}
 
- _invalidate_ept:
+	vmm_spin_unlock_irqrestore(&context->ept_lock, flags);
+
+	return rc;
+}
+
+void ept_release_tables(struct vcpu_hw_context *context)
+{
+	int i;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&context->ept_lock, flags);
+
+	for_each_set_bit(i, context->ept_stale_map, NR_32BIT_PGLIST_PAGES) {
+		free_page_for_pagemap(context,
+			(virtual_addr_t)context->shadow32_pg_list +
+			(i * PAGE_SIZE));
+	}
+	bitmap_zero(context->ept_stale_map, NR_32BIT_PGLIST_PAGES);
+
+	vmm_spin_unlock_irqrestore(&context->ept_lock, flags);
+}
+
+void ept_invalidate(struct vcpu_hw_context *context)
+{
+	struct invept_desc id;
+
 	X86_DEBUG_LOG(ept, LVL_DEBUG, "Invalidating EPT\n");
 
 	id.eptp = context->eptp;
+	id.reserved = 0;
 	invalidate_ept(INVEPT_SINGLE_CONTEXT, &id);
- _done:
-	return rc;
+}
+
+void ept_flush_invalidations(struct vcpu_hw_context *context)
+{
+	if (likely(!context->ept_inv_pending))
+		return;
+
+	ept_invalidate(context);
+
+	context->ept_inv_pending = FALSE;
 }
 
 int setup_ept(struct vcpu_hw_context *context)
 {
 	physical_addr_t pml4_phys;
 	eptp_t *eptp = (eptp_t *)&context->eptp;
-	virtual_addr_t pml4 = get_free_page_for_pagemap(context, &pml4_phys);
+	virtual_addr_t pml4;
+
+	INIT_SPIN_LOCK(&context->ept_lock);
+	bitmap_zero(context->ept_stale_map, NR_32BIT_PGLIST_PAGES);
+
+	pml4 = get_free_page_for_pagemap(context, &pml4_phys);
 
 	X86_DEBUG_LOG(ept, LVL_DEBUG, "%s: PML4 vaddr: 0x%016lx paddr: 0x%016lx\n",
 	       __func__, pml4, pml4_phys);
@@ -33,7 +33,9 @@
 #include <arch_guest_helper.h>
 #include <vmm_devemu.h>
 #include <vmm_manager.h>
+#include <vmm_scheduler.h>
 #include <vmm_main.h>
+#include <vmm_vcpu_stats.h>
 #include <vm/vmcs.h>
 #include <vm/vmx.h>
 #include <vm/ept.h>
@@ -147,11 +149,53 @@ int vmx_handle_guest_realmode_page_fault(struct vcpu_hw_context *context)
 	return rc;
 }
 
+/*
+ * Find the largest EPT page which can back the faulting guest page. The
+ * naturally aligned guest range must lie within one real memory region
+ * and be backed by host memory that is contiguous and equally aligned.
+ */
+static size_t vmx_guest_fault_page_size(struct vmm_guest *guest,
+					physical_addr_t gphys,
+					physical_addr_t hphys)
+{
+	int i;
+	struct vmm_region *reg;
+	physical_addr_t gbase, hbase;
+	physical_size_t availsz;
+	const size_t sizes[] = { EPT_PAGE_SIZE_1G, EPT_PAGE_SIZE_2M };
+	const bool supported[] = { cpu_has_vmx_ept_1GB, cpu_has_vmx_ept_2MB };
+
+	reg = vmm_guest_find_region(guest, gphys, VMM_REGION_MEMORY, FALSE);
+	if (!reg || !(reg->flags & VMM_REGION_REAL) ||
+	    (reg->flags & VMM_REGION_ALIAS))
+		return PAGE_SIZE;
+
+	for (i = 0; i < array_size(sizes); i++) {
+		if (!supported[i])
+			continue;
+
+		gbase = gphys & ~((physical_addr_t)sizes[i] - 1);
+		if (gbase < VMM_REGION_GPHYS_START(reg) ||
+		    VMM_REGION_GPHYS_END(reg) < (gbase + sizes[i]))
+			continue;
+
+		vmm_guest_find_mapping(guest, reg, gbase, &hbase, &availsz);
+		if (availsz < sizes[i] || (hbase & (sizes[i] - 1)) ||
+		    (hbase + (gphys - gbase)) != hphys)
+			continue;
+
+		return sizes[i];
+	}
+
+	return PAGE_SIZE;
+}
+
 static inline
 int vmx_handle_guest_protected_mode_page_fault(struct vcpu_hw_context *context)
 {
 	physical_addr_t fault_gphys, hphys_addr;
 	physical_size_t availsz;
+	size_t pg_size;
 	int rc;
 	u32 flags;
 	struct vmm_guest *guest = x86_vcpu_hw_context_guest(context);
@@ -178,6 +222,23 @@ int vmx_handle_guest_protected_mode_page_fault(struct vcpu_hw_context *context)
 
 	X86_DEBUG_LOG(vtx_intercept, LVL_DEBUG, "GP: 0x%"PRIx64" HP: 0x%"PRIx64" Size: %lu\n", fault_gphys, hphys_addr, availsz);
 
+	/*
+	 * Try the largest leaf first. If part of the range is already
+	 * mapped at a finer granularity use the next smaller size.
+	 */
+	pg_size = vmx_guest_fault_page_size(guest, fault_gphys, hphys_addr);
+	while (pg_size > PAGE_SIZE) {
+		rc = ept_create_pte_map(context,
+					fault_gphys & ~((physical_addr_t)pg_size - 1),
+					hphys_addr & ~((physical_addr_t)pg_size - 1),
+					pg_size,
+					(EPT_PROT_READ | EPT_PROT_WRITE | EPT_PROT_EXEC_S));
+		if (rc != VMM_EEXIST)
+			return rc;
+		pg_size = (pg_size == EPT_PAGE_SIZE_1G) ?
+			  EPT_PAGE_SIZE_2M : PAGE_SIZE;
+	}
+
 	return ept_create_pte_map(context, fault_gphys, hphys_addr, PAGE_SIZE,
 				  (EPT_PROT_READ | EPT_PROT_WRITE | EPT_PROT_EXEC_S));
 }
@@ -434,6 +495,12 @@ int vmx_handle_vmexit(struct vcpu_hw_context *context, u32 exit_reason)
 		ext_intrs++;
 		return VMM_OK;
 
+	case EXIT_REASON_PAUSE_INSTRUCTION:
+		/* Pause loop exit means guest is spinning on a lock */
+		__vmwrite(GUEST_RIP, VMX_GUEST_NEXT_RIP(context));
+		vmm_scheduler_yield_to_preempted();
+		return VMM_OK;
+
 	default:
 		X86_DEBUG_LOG(vtx_intercept, LVL_DEBUG, "Unhandled VM Exit reason: %d\n", exit_reason);
 		goto guest_bad_fault;
@@ -443,6 +510,26 @@ guest_bad_fault:
 	return VMM_EFAIL;
 }
 
+static u32 vmx_exit_stats_reason(u32 exit_reason)
+{
+	switch (exit_reason) {
+	case EXIT_REASON_EPT_VIOLATION:
+		return VMM_VCPU_EXIT_STAGE2_FAULT;
+	case EXIT_REASON_IO_INSTRUCTION:
+		return VMM_VCPU_EXIT_IOPORT;
+	case EXIT_REASON_CR_ACCESS:
+		return VMM_VCPU_EXIT_SYSREG;
+	case EXIT_REASON_CPUID:
+	case EXIT_REASON_INVD:
+	case EXIT_REASON_PAUSE_INSTRUCTION:
+		return VMM_VCPU_EXIT_INSN;
+	case EXIT_REASON_EXTERNAL_INTERRUPT:
+		return VMM_VCPU_EXIT_IRQ;
+	default:
+		return VMM_VCPU_EXIT_UNKNOWN;
+	}
+}
+
 void vmx_vcpu_exit(struct vcpu_hw_context *context)
 {
 	exit_reason_t _exit_reason;
@@ -491,7 +578,11 @@ void vmx_vcpu_exit(struct vcpu_hw_context *context)
 		VMX_GUEST_SAVE_RIP(context);
 		X86_DEBUG_LOG(vtx_intercept, LVL_DEBUG, "Guest RIP: 0x%"PRIx64"\n", VMX_GUEST_RIP(context));
 
-		if (vmx_handle_vmexit(context, _exit_reason.bits.reason) != VMM_OK) {
+		vmm_vcpu_exit_begin(context->assoc_vcpu);
+		rc = vmx_handle_vmexit(context, _exit_reason.bits.reason);
+		vmm_vcpu_exit_end(context->assoc_vcpu,
+			vmx_exit_stats_reason(_exit_reason.bits.reason));
+		if (rc != VMM_OK) {
 			X86_DEBUG_LOG(vtx_intercept, LVL_DEBUG, "Error handling VMExit (Reason: %d)\n", _exit_reason.bits.reason);
 			goto unhandled_vm_exit;
 		}
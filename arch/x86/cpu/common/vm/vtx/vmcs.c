@@ -57,8 +57,8 @@ static int __unused __read_mostly opt_unrestricted_guest_enabled = 1;
  * Time is measured based on a counter that runs at the same rate as the TSC,
  * refer SDM volume 3b section 21.6.13 & 22.1.3.
  */
-static unsigned int __unused __read_mostly ple_gap = 41;
-static unsigned int __unused __read_mostly ple_window = 4096;
+static unsigned int __read_mostly ple_gap = 41;
+static unsigned int __read_mostly ple_window = 4096;
 
 static u32 vmx_basic_msr_low __read_mostly;
 static u32 vmx_basic_msr_high __read_mostly;
@@ -465,7 +465,6 @@ void set_proc_based_exec_controls(void)
 		case CPU_BASED_ACTIVATE_MSR_BITMAP:
 		case CPU_BASED_ACTIVATE_SECONDARY_CONTROLS:
 		case CPU_BASED_MONITOR_EXITING:
-		case CPU_BASED_PAUSE_EXITING:
 			/* we want to support this, set 1 for external
 			 * interrupts to cause VM exits */
 			vmx_proc_based_control |= proc_controls[i];
@@ -490,6 +489,15 @@ void set_proc_based_exec_controls(void)
 					vmm_printf("Enabling unrestricted guest.\n");
 					vmx_proc_secondary_control |= SECONDARY_EXEC_UNRESTRICTED_GUEST;
 				}
+				/* Exit only on PAUSE loops (i.e. spinning guest)
+				 * instead of every PAUSE instruction.
+				 */
+				if (SECONDARY_EXEC_PAUSE_LOOP_EXITING & vmx_secondary_exec_control) {
+					vmm_printf("Enabling pause loop exiting.\n");
+					vmx_proc_secondary_control |= SECONDARY_EXEC_PAUSE_LOOP_EXITING;
+					__vmwrite(PLE_GAP, ple_gap);
+					__vmwrite(PLE_WINDOW, ple_window);
+				}
 
 				__vmwrite(SECONDARY_VM_EXEC_CONTROL, vmx_proc_secondary_control);
 			}
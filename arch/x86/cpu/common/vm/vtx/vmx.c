@@ -33,6 +33,7 @@
 #include <vm/vmcs.h>
 #include <vm/vmx.h>
 #include <vm/vmx_intercept.h>
+#include <vm/ept.h>
 #include <vm/vmcs_auditor.h>
 #include <x86_debug_log.h>
 
@@ -421,6 +422,9 @@ static void vmx_vcpu_run(struct vcpu_hw_context *context)
 		context->vmcs_state  |=  (VMCS_STATE_ACTIVE | VMCS_STATE_CURRENT);
 	}
 
+	/* EPT updates done while handling exits share one INVEPT */
+	ept_flush_invalidations(context);
+
 	if (likely(context->vmcs_state & VMCS_STATE_LAUNCHED)) {
 		rc = __vmcs_run(context, true);
 	} else {
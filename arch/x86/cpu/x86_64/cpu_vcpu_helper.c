@@ -272,6 +272,35 @@ void arch_vcpu_stat_dump(struct vmm_chardev *cdev, struct vmm_vcpu *vcpu)
 	/* For now no arch specific stats */
 }
 
+bool arch_vcpu_regs_sample(arch_regs_t *regs,
+			   virtual_addr_t *pc, virtual_addr_t *fp)
+{
+	*pc = regs->rip;
+	*fp = regs->rbp;
+
+	/*
+	 * Guest runs in VMX non-root mode and host interrupts are
+	 * taken only after VM exit so registers are always of host.
+	 */
+	return FALSE;
+}
+
+int arch_vcpu_unwind_frame(virtual_addr_t stack_lo, virtual_addr_t stack_hi,
+			   virtual_addr_t *fp, virtual_addr_t *pc)
+{
+	virtual_addr_t frame = *fp;
+
+	/* Frame record is {saved rbp, return address} pointed by rbp */
+	if ((frame < stack_lo) || ((stack_hi - 16) < frame) || (frame & 0x7)) {
+		return VMM_EINVALID;
+	}
+
+	*fp = ((u64 *)frame)[0];
+	*pc = ((u64 *)frame)[1];
+
+	return VMM_OK;
+}
+
 static void dump_guest_vcpu_state(struct vcpu_hw_context *context)
 {
 	vmm_printf("\nGUEST %s dump state:\n\n", context->assoc_vcpu->name);
@@ -26,6 +26,10 @@ GCCMAJ=$(shell if [ `gcc --version | grep ^gcc | sed 's/^.* //g' | cut -f1 -d '.
 cpu-cflags +=-finline-functions -O0 -mcmodel=large
 cpu-cppflags +=-DCPU_TEXT_LMA=${CONFIG_VAPOOL_ALIGN_MB}
 
+ifeq ($(CONFIG_PROFILE_SAMPLING), y)
+cpu-cflags += -fno-omit-frame-pointer -fno-optimize-sibling-calls
+endif
+
 ifeq ($(GCCMAJ),true)
 cpu-ldflags += -no-pie
 cpu-cflags += -no-pie
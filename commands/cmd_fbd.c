@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cmd_fbd.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief Implementation of fbd command
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_modules.h>
+#include <vmm_cmdmgr.h>
+#include <libs/stringlib.h>
+#include <drv/fbd.h>
+
+#define MODULE_DESC			"Command fbd"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			cmd_fbd_init
+#define	MODULE_EXIT			cmd_fbd_exit
+
+static void cmd_fbd_usage(struct vmm_chardev *cdev)
+{
+	vmm_cprintf(cdev, "Usage:\n");
+	vmm_cprintf(cdev, "   fbd help\n");
+	vmm_cprintf(cdev, "   fbd list\n");
+	vmm_cprintf(cdev, "   fbd create <name> <path> [<size>] [ro]\n");
+	vmm_cprintf(cdev, "   fbd qcow2_create <path> <size> "
+			  "[<backing_path>]\n");
+	vmm_cprintf(cdev, "   fbd destroy <name>\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   <size> of raw image can be more than file "
+			  "size (i.e. sparse) and\n");
+	vmm_cprintf(cdev, "   zero <size> means use file size (or backing "
+			  "image size for qcow2).\n");
+	vmm_cprintf(cdev, "   Relative <backing_path> is relative to "
+			  "directory of qcow2 image.\n");
+}
+
+static int cmd_fbd_list(struct vmm_chardev *cdev)
+{
+	int num, count;
+	char size[32];
+	struct fbd *d;
+
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	vmm_cprintf(cdev, " %-16s %-6s %-3s %-18s %-32s\n",
+			  "Name", "Format", "RO", "Size", "Path");
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	count = fbd_count();
+	for (num = 0; num < count; num++) {
+		d = fbd_get(num);
+		vmm_snprintf(size, sizeof(size), "0x%"PRIx64, d->size);
+		vmm_cprintf(cdev, " %-16s %-6s %-3s %-18s %-32s\n",
+			    d->bdev->name, d->format,
+			    (d->bdev->flags & VMM_BLOCKDEV_RW) ? "no" : "yes",
+			    size, d->path);
+	}
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+
+	return VMM_OK;
+}
+
+static int cmd_fbd_create(struct vmm_chardev *cdev, const char *name,
+			  const char *path, u64 size, u32 flags)
+{
+	struct fbd *d;
+
+	d = fbd_create(name, path, size, flags);
+	if (!d) {
+		vmm_cprintf(cdev, "Failed to create %s FBD instance\n", name);
+		return VMM_EFAIL;
+	}
+
+	vmm_cprintf(cdev, "Created %s FBD instance (%s image)\n",
+		    name, d->format);
+
+	return VMM_OK;
+}
+
+static int cmd_fbd_qcow2_create(struct vmm_chardev *cdev, const char *path,
+				u64 size, const char *backing)
+{
+	int rc;
+
+	rc = fbd_qcow2_create(path, size, backing);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to create qcow2 image %s "
+			    "(error %d)\n", path, rc);
+		return rc;
+	}
+
+	vmm_cprintf(cdev, "Created qcow2 image %s\n", path);
+
+	return VMM_OK;
+}
+
+static int cmd_fbd_destroy(struct vmm_chardev *cdev, const char *name)
+{
+	struct fbd *d = fbd_find(name);
+
+	if (!d) {
+		vmm_cprintf(cdev, "Failed to find %s FBD instance\n", name);
+		return VMM_ENOTAVAIL;
+	}
+
+	fbd_destroy(d);
+
+	vmm_cprintf(cdev, "Destroyed %s FBD instance\n", name);
+
+	return VMM_OK;
+}
+
+static int cmd_fbd_exec(struct vmm_chardev *cdev, int argc, char **argv)
+{
+	u64 size = 0;
+	u32 flags = 0;
+
+	if (argc <= 1) {
+		goto fail;
+	}
+
+	if (strcmp(argv[1], "help") == 0) {
+		cmd_fbd_usage(cdev);
+		return VMM_OK;
+	} else if ((strcmp(argv[1], "list") == 0) && (argc == 2)) {
+		return cmd_fbd_list(cdev);
+	} else if ((strcmp(argv[1], "create") == 0) &&
+		   (3 < argc) && (argc < 7)) {
+		if ((argc > 4) && (strcmp(argv[argc - 1], "ro") == 0)) {
+			flags |= FBD_RDONLY;
+			argc--;
+		}
+		if (argc == 6) {
+			goto fail;
+		}
+		if (argc == 5) {
+			size = strtoull(argv[4], NULL, 0);
+		}
+		return cmd_fbd_create(cdev, argv[2], argv[3], size, flags);
+	} else if ((strcmp(argv[1], "qcow2_create") == 0) &&
+		   ((argc == 4) || (argc == 5))) {
+		size = strtoull(argv[3], NULL, 0);
+		return cmd_fbd_qcow2_create(cdev, argv[2], size,
+					    (argc == 5) ? argv[4] : NULL);
+	} else if ((strcmp(argv[1], "destroy") == 0) && (argc == 3)) {
+		return cmd_fbd_destroy(cdev, argv[2]);
+	}
+
+fail:
+	cmd_fbd_usage(cdev);
+	return VMM_EFAIL;
+}
+
+static struct vmm_cmd cmd_fbd = {
+	.name = "fbd",
+	.desc = "file backed block device commands",
+	.usage = cmd_fbd_usage,
+	.exec = cmd_fbd_exec,
+};
+
+static int __init cmd_fbd_init(void)
+{
+	return vmm_cmdmgr_register_cmd(&cmd_fbd);
+}
+
+static void __exit cmd_fbd_exit(void)
+{
+	vmm_cmdmgr_unregister_cmd(&cmd_fbd);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -27,7 +27,9 @@
 #include <vmm_cmdmgr.h>
 #include <vmm_heap.h>
 #include <vmm_timer.h>
+#include <vmm_manager.h>
 #include <vmm_profiler.h>
+#include <vmm_sampler.h>
 #include <arch_atomic.h>
 #include <arch_atomic64.h>
 #include <libs/stringlib.h>
@@ -42,17 +44,31 @@
 #define	MODULE_INIT			cmd_profile_init
 #define	MODULE_EXIT			cmd_profile_exit
 
-static bool cmd_profile_updated = FALSE;
+#define CMD_PROFILE_SAMPLE_PERIOD_USECS	1000
+#define CMD_PROFILE_SAMPLE_DUMP_COUNT	30
 
 static void cmd_profile_usage(struct vmm_chardev *cdev)
 {
 	vmm_cprintf(cdev, "Usage: \n");
 	vmm_cprintf(cdev, "   profile help\n");
+#if defined(CONFIG_PROFILE)
 	vmm_cprintf(cdev, "   profile start\n");
 	vmm_cprintf(cdev, "   profile stop\n");
 	vmm_cprintf(cdev, "   profile status\n");
 	vmm_cprintf(cdev,
 		    "   profile dump [name|count|total_time|single_time]\n");
+#endif
+#if defined(CONFIG_PROFILE_SAMPLING)
+	vmm_cprintf(cdev,
+		    "   profile sample start [<period_usecs>] [<depth>]\n");
+	vmm_cprintf(cdev, "   profile sample stop\n");
+	vmm_cprintf(cdev, "   profile sample status\n");
+	vmm_cprintf(cdev, "   profile sample dump [self|total] [<count>]\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   Default sampling period is %d usecs and "
+		    "<depth> > 1 walks frame pointers\n",
+		    CMD_PROFILE_SAMPLE_PERIOD_USECS);
+#endif
 }
 
 static int cmd_profile_help(struct vmm_chardev *cdev, char *dummy)
@@ -62,6 +78,10 @@ static int cmd_profile_help(struct vmm_chardev *cdev, char *dummy)
 	return VMM_OK;
 }
 
+#if defined(CONFIG_PROFILE)
+
+static bool cmd_profile_updated = FALSE;
+
 static int cmd_profile_status(struct vmm_chardev *cdev, char *dummy)
 {
 	if (vmm_profiler_isactive()) {
@@ -222,7 +242,7 @@ static int cmd_profile_stat_update(void *data, const char *name,
 static const struct {
 	char *name;
 	int (*function) (void *, size_t, size_t);
-} const filters[] = {
+} filters[] = {
 	{"count", cmd_profile_count_cmp},
 	{"total_time", cmd_profile_total_time_cmp},
 	{"single_time", cmd_profile_time_per_call_cmp},
@@ -334,15 +354,209 @@ static int cmd_profile_stop(struct vmm_chardev *cdev, char *dummy)
 	return vmm_profiler_stop();
 }
 
+#endif
+
+#if defined(CONFIG_PROFILE_SAMPLING)
+
+static int cmd_profile_sample_self_less(void *m, size_t a, size_t b)
+{
+	struct vmm_sampler_entry *e = m;
+
+	if (e[a].self != e[b].self) {
+		return (e[a].self > e[b].self) ? 1 : 0;
+	}
+
+	return (e[a].total > e[b].total) ? 1 : 0;
+}
+
+static int cmd_profile_sample_total_less(void *m, size_t a, size_t b)
+{
+	struct vmm_sampler_entry *e = m;
+
+	if (e[a].total != e[b].total) {
+		return (e[a].total > e[b].total) ? 1 : 0;
+	}
+
+	return (e[a].self > e[b].self) ? 1 : 0;
+}
+
+static void cmd_profile_sample_swap(void *m, size_t a, size_t b)
+{
+	struct vmm_sampler_entry tmp, *e = m;
+
+	tmp = e[a];
+	e[a] = e[b];
+	e[b] = tmp;
+}
+
+static void cmd_profile_sample_percent(struct vmm_chardev *cdev,
+				       u64 val, u64 total)
+{
+	u32 pct = (total) ? (u32)udiv64(val * 10000ULL, total) : 0;
+
+	vmm_cprintf(cdev, " %3d.%02d%%", pct / 100, pct % 100);
+}
+
+static int cmd_profile_sample_vcpu(struct vmm_vcpu *vcpu, void *data)
+{
+	u64 samples;
+	struct vmm_chardev *cdev = data;
+
+	if (!vcpu->is_normal) {
+		return VMM_OK;
+	}
+
+	samples = vmm_sampler_vcpu_samples(vcpu->id);
+	if (samples) {
+		vmm_cprintf(cdev, "  %-30s %12"PRIu64"\n", vcpu->name, samples);
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_profile_sample_status(struct vmm_chardev *cdev)
+{
+	u32 c;
+	struct vmm_sampler_stats st, tot;
+
+	memset(&tot, 0, sizeof(tot));
+	for_each_possible_cpu(c) {
+		if (vmm_sampler_get_stats(c, &st)) {
+			continue;
+		}
+		tot.samples += st.samples;
+		tot.guest += st.guest;
+		tot.hyp_vcpu += st.hyp_vcpu;
+		tot.hyp_orphan += st.hyp_orphan;
+		tot.no_regs += st.no_regs;
+		tot.dropped += st.dropped;
+	}
+
+	vmm_cprintf(cdev, "Sampling Profiler: %s\n",
+		    (vmm_sampler_isactive()) ? "running" : "stopped");
+	vmm_cprintf(cdev, "Period           : %"PRIu64" usecs\n",
+		    udiv64(vmm_sampler_period(), 1000));
+	vmm_cprintf(cdev, "Depth            : %d\n", vmm_sampler_depth());
+	vmm_cprintf(cdev, "Samples          : %"PRIu64"\n", tot.samples);
+	vmm_cprintf(cdev, "  Guest          : %12"PRIu64, tot.guest);
+	cmd_profile_sample_percent(cdev, tot.guest, tot.samples);
+	vmm_cprintf(cdev, "\n  Hyp (for VCPU) : %12"PRIu64, tot.hyp_vcpu);
+	cmd_profile_sample_percent(cdev, tot.hyp_vcpu, tot.samples);
+	vmm_cprintf(cdev, "\n  Hyp (orphan)   : %12"PRIu64, tot.hyp_orphan);
+	cmd_profile_sample_percent(cdev, tot.hyp_orphan, tot.samples);
+	vmm_cprintf(cdev, "\n  No registers   : %12"PRIu64"\n", tot.no_regs);
+	vmm_cprintf(cdev, "  Dropped        : %12"PRIu64"\n", tot.dropped);
+	vmm_cprintf(cdev, "Guest samples per VCPU:\n");
+	vmm_manager_vcpu_iterate(cmd_profile_sample_vcpu, cdev);
+
+	return VMM_OK;
+}
+
+static int cmd_profile_sample_dump(struct vmm_chardev *cdev,
+				   int argc, char **argv)
+{
+	int rc;
+	u32 i, count, max = CMD_PROFILE_SAMPLE_DUMP_COUNT;
+	u64 hyp_samples = 0, dropped = 0;
+	char name[KSYM_NAME_LEN];
+	struct vmm_sampler_stats st;
+	struct vmm_sampler_entry *e = NULL;
+	int (*less)(void *, size_t, size_t) = cmd_profile_sample_self_less;
+
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "self")) {
+			less = cmd_profile_sample_self_less;
+		} else if (!strcmp(argv[i], "total")) {
+			less = cmd_profile_sample_total_less;
+		} else {
+			max = atoi(argv[i]);
+		}
+	}
+
+	for_each_possible_cpu(i) {
+		if (!vmm_sampler_get_stats(i, &st)) {
+			hyp_samples += st.hyp_vcpu + st.hyp_orphan;
+			dropped += st.dropped;
+		}
+	}
+
+	rc = vmm_sampler_snapshot(&e, &count);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to get samples (error %d)\n", rc);
+		return rc;
+	}
+
+	libsort_smoothsort(e, 0, count, less, cmd_profile_sample_swap);
+
+	vmm_cprintf(cdev, "%-8s %-8s %10s %10s  %s\n",
+		    "  Self", "  Total", "Self", "Total", "Symbol");
+	for (i = 0; i < count && i < max; i++) {
+		cmd_profile_sample_percent(cdev, e[i].self, hyp_samples);
+		cmd_profile_sample_percent(cdev, e[i].total, hyp_samples);
+		vmm_cprintf(cdev, " %10d %10d  %s\n", e[i].self, e[i].total,
+			    vmm_sampler_entry_name(&e[i], name));
+	}
+
+	vmm_free(e);
+
+	if (dropped) {
+		vmm_cprintf(cdev, "%"PRIu64" samples dropped due to full "
+			    "hash table\n", dropped);
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_profile_sample(struct vmm_chardev *cdev,
+			      int argc, char **argv)
+{
+	u64 period = CMD_PROFILE_SAMPLE_PERIOD_USECS;
+	u32 depth = 1;
+	int rc;
+
+	if (argc < 1) {
+		goto fail;
+	}
+
+	if (!strcmp(argv[0], "start")) {
+		if (argc > 1) {
+			period = strtoull(argv[1], NULL, 10);
+		}
+		if (argc > 2) {
+			depth = atoi(argv[2]);
+		}
+		rc = vmm_sampler_start(period * 1000ULL, depth);
+		if (rc) {
+			vmm_cprintf(cdev, "Failed to start sampling "
+				    "(error %d)\n", rc);
+		}
+		return rc;
+	} else if (!strcmp(argv[0], "stop")) {
+		return vmm_sampler_stop();
+	} else if (!strcmp(argv[0], "status")) {
+		return cmd_profile_sample_status(cdev);
+	} else if (!strcmp(argv[0], "dump")) {
+		return cmd_profile_sample_dump(cdev, argc - 1, &argv[1]);
+	}
+
+fail:
+	cmd_profile_usage(cdev);
+	return VMM_EFAIL;
+}
+
+#endif
+
 static const struct {
 	char *name;
 	int (*function) (struct vmm_chardev *, char *);
-} const command[] = {
+} command[] = {
 	{"help", cmd_profile_help},
+#if defined(CONFIG_PROFILE)
 	{"start", cmd_profile_start},
 	{"stop", cmd_profile_stop},
 	{"status", cmd_profile_status},
 	{"dump", cmd_profile_dump},
+#endif
 	{NULL, NULL},
 };
 
@@ -351,6 +565,12 @@ static int cmd_profile_exec(struct vmm_chardev *cdev, int argc, char **argv)
 	char *param = NULL;
 	int index = 0;
 
+#if defined(CONFIG_PROFILE_SAMPLING)
+	if ((argc > 1) && !strcmp(argv[1], "sample")) {
+		return cmd_profile_sample(cdev, argc - 2, &argv[2]);
+	}
+#endif
+
 	if (argc > 3) {
 		goto fail;
 	}
@@ -0,0 +1,352 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file cmd_trace.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief Implementation of trace command
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_heap.h>
+#include <vmm_cpumask.h>
+#include <vmm_trace.h>
+#include <vmm_modules.h>
+#include <vmm_cmdmgr.h>
+#include <libs/stringlib.h>
+#if defined(CONFIG_VFS)
+#include <libs/vfs.h>
+#endif
+
+#define MODULE_DESC			"Command trace"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			cmd_trace_init
+#define	MODULE_EXIT			cmd_trace_exit
+
+static void cmd_trace_usage(struct vmm_chardev *cdev)
+{
+	vmm_cprintf(cdev, "Usage:\n");
+	vmm_cprintf(cdev, "   trace help\n");
+	vmm_cprintf(cdev, "   trace events\n");
+	vmm_cprintf(cdev, "   trace status\n");
+	vmm_cprintf(cdev, "   trace enable  all|<mask>|<event0> <event1> ...\n");
+	vmm_cprintf(cdev, "   trace disable [all|<mask>|<event0> <event1> ...]\n");
+	vmm_cprintf(cdev, "   trace clear\n");
+	vmm_cprintf(cdev, "   trace dump    [<vfs_path>]\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   <mask> is a hex number where bit N enables "
+			  "event with ID N\n");
+	vmm_cprintf(cdev, "   <vfs_path> receives binary records which can "
+			  "be decoded using\n");
+	vmm_cprintf(cdev, "   tools/scripts/trace_decode.py\n");
+}
+
+static int cmd_trace_help(struct vmm_chardev *cdev,
+			  int argc, char **argv)
+{
+	cmd_trace_usage(cdev);
+	return VMM_OK;
+}
+
+static int cmd_trace_events(struct vmm_chardev *cdev,
+			    int argc, char **argv)
+{
+	u32 ev, mask = vmm_trace_get_mask();
+
+	vmm_cprintf(cdev, "%-4s %-20s %s\n", "ID", "Event", "State");
+	for (ev = 0; ev < VMM_TRACE_MAX_EVENTS; ev++) {
+		vmm_cprintf(cdev, "%-4d %-20s %s\n", ev,
+			    vmm_trace_event_name(ev),
+			    (mask & VMM_TRACE_EVENT_MASK(ev)) ?
+			    "enabled" : "disabled");
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_trace_status(struct vmm_chardev *cdev,
+			    int argc, char **argv)
+{
+	u32 c;
+	u64 written, lost;
+
+	vmm_cprintf(cdev, "Event Mask       : 0x%08x\n", vmm_trace_get_mask());
+	vmm_cprintf(cdev, "Buffer Entries   : %d per CPU\n",
+		    vmm_trace_buffer_entries());
+	vmm_cprintf(cdev, "Record Size      : %d bytes\n",
+		    (u32)sizeof(struct vmm_trace_record));
+	for_each_possible_cpu(c) {
+		vmm_trace_cpu_stats(c, &written, &lost);
+		vmm_cprintf(cdev, "CPU%-3d           : %"PRIu64" written, "
+			    "%"PRIu64" lost\n", c, written, lost);
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_trace_parse_mask(struct vmm_chardev *cdev,
+				int argc, char **argv, u32 *mask)
+{
+	int i;
+	u32 ev;
+
+	*mask = 0;
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "all")) {
+			*mask |= VMM_TRACE_ALL_EVENTS;
+			continue;
+		}
+		if ('0' <= argv[i][0] && argv[i][0] <= '9') {
+			*mask |= (u32)strtoul(argv[i], NULL, 16);
+			continue;
+		}
+		ev = vmm_trace_event_find(argv[i]);
+		if (ev >= VMM_TRACE_MAX_EVENTS) {
+			vmm_cprintf(cdev, "Unknown event %s\n", argv[i]);
+			return VMM_EINVALID;
+		}
+		*mask |= VMM_TRACE_EVENT_MASK(ev);
+	}
+
+	return VMM_OK;
+}
+
+static int cmd_trace_enable(struct vmm_chardev *cdev,
+			    int argc, char **argv)
+{
+	int rc;
+	u32 mask;
+
+	rc = cmd_trace_parse_mask(cdev, argc, argv, &mask);
+	if (rc) {
+		return rc;
+	}
+
+	rc = vmm_trace_set_mask(vmm_trace_get_mask() | mask);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to enable events (error %d)\n", rc);
+	}
+
+	return rc;
+}
+
+static int cmd_trace_disable(struct vmm_chardev *cdev,
+			     int argc, char **argv)
+{
+	int rc;
+	u32 mask = VMM_TRACE_ALL_EVENTS;
+
+	if (argc) {
+		rc = cmd_trace_parse_mask(cdev, argc, argv, &mask);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	return vmm_trace_set_mask(vmm_trace_get_mask() & ~mask);
+}
+
+static int cmd_trace_clear(struct vmm_chardev *cdev,
+			   int argc, char **argv)
+{
+	vmm_trace_clear();
+	return VMM_OK;
+}
+
+#if defined(CONFIG_VFS)
+
+struct cmd_trace_save {
+	struct vmm_trace_record *recs;
+	u32 count;
+};
+
+static int cmd_trace_save_record(u32 cpu, struct vmm_trace_record *rec,
+				 void *priv)
+{
+	struct cmd_trace_save *s = priv;
+
+	if (s->count >= vmm_trace_buffer_entries()) {
+		return 1;
+	}
+	memcpy(&s->recs[s->count++], rec, sizeof(*rec));
+
+	return 0;
+}
+
+static int cmd_trace_write(int fd, void *buf, size_t len)
+{
+	return (vfs_write(fd, buf, len) == len) ? VMM_OK : VMM_EIO;
+}
+
+static int cmd_trace_dump_file(struct vmm_chardev *cdev, const char *path)
+{
+	int fd, rc = VMM_OK;
+	u32 c, cpu_count = 0;
+	u64 written;
+	struct cmd_trace_save s;
+	struct vmm_trace_file_header hdr;
+	struct vmm_trace_file_chunk chunk;
+
+	s.recs = vmm_malloc(vmm_trace_buffer_entries() * sizeof(*s.recs));
+	if (!s.recs) {
+		vmm_cprintf(cdev, "Failed to allocate buffer\n");
+		return VMM_ENOMEM;
+	}
+
+	fd = vfs_open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		vmm_cprintf(cdev, "Failed to open %s\n", path);
+		vmm_free(s.recs);
+		return fd;
+	}
+
+	for_each_possible_cpu(c) {
+		cpu_count++;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	strncpy(hdr.magic, VMM_TRACE_FILE_MAGIC, sizeof(hdr.magic));
+	hdr.version = VMM_TRACE_FILE_VERSION;
+	hdr.record_size = sizeof(struct vmm_trace_record);
+	hdr.cpu_count = cpu_count;
+	hdr.event_mask = vmm_trace_get_mask();
+	rc = cmd_trace_write(fd, &hdr, sizeof(hdr));
+	if (rc) {
+		goto done;
+	}
+
+	for_each_possible_cpu(c) {
+		s.count = 0;
+		vmm_trace_iterate(c, cmd_trace_save_record, &s);
+
+		memset(&chunk, 0, sizeof(chunk));
+		chunk.cpu = c;
+		chunk.nr_records = s.count;
+		/* Includes records overwritten while saving */
+		vmm_trace_cpu_stats(c, &written, NULL);
+		chunk.lost = (written > s.count) ? written - s.count : 0;
+		rc = cmd_trace_write(fd, &chunk, sizeof(chunk));
+		if (rc) {
+			goto done;
+		}
+		if (s.count) {
+			rc = cmd_trace_write(fd, s.recs,
+					     s.count * sizeof(*s.recs));
+			if (rc) {
+				goto done;
+			}
+		}
+		vmm_cprintf(cdev, "CPU%d: saved %d records\n", c, s.count);
+	}
+
+done:
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to write %s (error %d)\n", path, rc);
+	}
+	vfs_close(fd);
+	vmm_free(s.recs);
+
+	return rc;
+}
+
+#else
+
+static int cmd_trace_dump_file(struct vmm_chardev *cdev, const char *path)
+{
+	vmm_cprintf(cdev, "Dumping to file requires VFS support\n");
+	return VMM_ENOTAVAIL;
+}
+
+#endif
+
+static int cmd_trace_dump(struct vmm_chardev *cdev,
+			  int argc, char **argv)
+{
+	if (argc) {
+		return cmd_trace_dump_file(cdev, argv[0]);
+	}
+
+	vmm_trace_dump(cdev);
+
+	return VMM_OK;
+}
+
+static const struct {
+	char *name;
+	int (*function) (struct vmm_chardev *, int, char **);
+	int argc;
+} command[] = {
+	{"help", cmd_trace_help, 0},
+	{"events", cmd_trace_events, 0},
+	{"status", cmd_trace_status, 0},
+	{"enable", cmd_trace_enable, 1},
+	{"disable", cmd_trace_disable, 0},
+	{"clear", cmd_trace_clear, 0},
+	{"dump", cmd_trace_dump, 0},
+	{NULL, NULL, 0},
+};
+
+static int cmd_trace_exec(struct vmm_chardev *cdev,
+			  int argc, char **argv)
+{
+	int index = 0;
+
+	if (argc <= 1) {
+		cmd_trace_usage(cdev);
+		return VMM_EFAIL;
+	}
+
+	while (command[index].name) {
+		if ((strcmp(argv[1], command[index].name) == 0) &&
+		    ((argc - 2) >= command[index].argc)) {
+			return command[index].function(cdev,
+						argc - 2, &argv[2]);
+		}
+		index++;
+	}
+
+	cmd_trace_usage(cdev);
+
+	return VMM_EFAIL;
+}
+
+static struct vmm_cmd cmd_trace = {
+	.name = "trace",
+	.desc = "hypervisor event tracing commands",
+	.usage = cmd_trace_usage,
+	.exec = cmd_trace_exec,
+};
+
+static int __init cmd_trace_init(void)
+{
+	return vmm_cmdmgr_register_cmd(&cmd_trace);
+}
+
+static void __exit cmd_trace_exit(void)
+{
+	vmm_cmdmgr_unregister_cmd(&cmd_trace);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
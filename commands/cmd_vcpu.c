@@ -27,6 +27,8 @@
 #include <vmm_devtree.h>
 #include <vmm_manager.h>
 #include <vmm_scheduler.h>
+#include <vmm_vcpu_irq.h>
+#include <vmm_vcpu_stats.h>
 #include <vmm_host_ram.h>
 #include <vmm_host_vapool.h>
 #include <vmm_host_aspace.h>
@@ -61,6 +63,7 @@ static void cmd_vcpu_usage(struct vmm_chardev *cdev)
 			  "<hcpu0> <hcpu1> <hcpu2> ...\n");
 	vmm_cprintf(cdev, "   vcpu dumpreg <vcpu_id>\n");
 	vmm_cprintf(cdev, "   vcpu dumpstat <vcpu_id>\n");
+	vmm_cprintf(cdev, "   vcpu stats   <vcpu_id> [reset]\n");
 }
 
 static int cmd_vcpu_help(struct vmm_chardev *cdev,
@@ -537,6 +540,7 @@ static int cmd_vcpu_dumpstat(struct vmm_chardev *cdev,
 	u64 last_reset_nsecs, total_nsecs;
 	u64 ready_nsecs, running_nsecs, paused_nsecs;
 	u64 halted_nsecs, system_nsecs;
+	u64 poll_ns, poll_success, poll_wasted;
 	struct vmm_vcpu *vcpu;
 
 	if (!argc) {
@@ -624,12 +628,58 @@ static int cmd_vcpu_dumpstat(struct vmm_chardev *cdev,
 			  h, m, s, ms);
 	vmm_cprintf(cdev, "\n");
 
+	/* Halt polling statistics */
+	if (!vmm_vcpu_irq_poll_stats(vcpu, &poll_ns,
+				     &poll_success, &poll_wasted)) {
+		vmm_cprintf(cdev, "Halt Poll Limit  : %"PRIu64" ns\n",
+				  poll_ns);
+		vmm_cprintf(cdev, "Halt Poll Success: %"PRIu64"\n",
+				  poll_success);
+		vmm_cprintf(cdev, "Halt Poll Wasted : %"PRIu64"\n",
+				  poll_wasted);
+		vmm_cprintf(cdev, "\n");
+	}
+
 	/* Architecture specific dumpstat */
 	arch_vcpu_stat_dump(cdev, vcpu);
 
 	return ret;
 }
 
+static int cmd_vcpu_stats(struct vmm_chardev *cdev,
+			  int argc, char **argv)
+{
+	int ret, id;
+	struct vmm_vcpu *vcpu;
+
+	if (!argc) {
+		vmm_cprintf(cdev, "Must provide vcpu ID\n");
+		cmd_vcpu_usage(cdev);
+		return VMM_EINVALID;
+	}
+	id = atoi(argv[0]);
+
+	vcpu = vmm_manager_vcpu(id);
+	if (!vcpu) {
+		vmm_cprintf(cdev, "Failed to find vcpu\n");
+		return VMM_EFAIL;
+	}
+
+	if ((argc > 1) && !strcmp(argv[1], "reset")) {
+		ret = vmm_vcpu_exit_stats_reset(vcpu);
+		if (ret) {
+			vmm_cprintf(cdev, "%s: Failed to reset stats "
+				    "(error %d)\n", vcpu->name, ret);
+		} else {
+			vmm_cprintf(cdev, "%s: Stats reset done\n",
+				    vcpu->name);
+		}
+		return ret;
+	}
+
+	return vmm_vcpu_exit_stats_dump(cdev, vcpu);
+}
+
 static const struct {
 	char *name;
 	int (*function) (struct vmm_chardev *, int, char **);
@@ -649,6 +699,7 @@ static const struct {
 	{"set_affinity", cmd_vcpu_set_affinity, 2},
 	{"dumpreg", cmd_vcpu_dumpreg, 1},
 	{"dumpstat", cmd_vcpu_dumpstat, 1},
+	{"stats", cmd_vcpu_stats, 1},
 	{NULL, NULL, 0},
 };
 
@@ -23,11 +23,13 @@
 
 #include <vmm_error.h>
 #include <vmm_stdio.h>
+#include <vmm_timer.h>
 #include <vmm_devtree.h>
 #include <vmm_modules.h>
 #include <vmm_cmdmgr.h>
 #include <vio/vmm_vdisk.h>
 #include <libs/stringlib.h>
+#include <libs/mathlib.h>
 
 #define MODULE_DESC			"Command vdisk"
 #define MODULE_AUTHOR			"Anup Patel"
@@ -44,6 +46,16 @@ static void cmd_vdisk_usage(struct vmm_chardev *cdev)
 	vmm_cprintf(cdev, "   vdisk info <vdisk_name>\n");
 	vmm_cprintf(cdev, "   vdisk detach <vdisk_name>\n");
 	vmm_cprintf(cdev, "   vdisk attach <vdisk_name> <block_device_name>\n");
+	vmm_cprintf(cdev, "   vdisk qos <vdisk_name>\n");
+	vmm_cprintf(cdev, "   vdisk qos <vdisk_name> <param> <value>\n");
+	vmm_cprintf(cdev, "   vdisk stats <vdisk_name>\n");
+	vmm_cprintf(cdev, "   vdisk stats <vdisk_name> reset\n");
+	vmm_cprintf(cdev, "Note:\n");
+	vmm_cprintf(cdev, "   <param> = iops_rd|iops_wr|iops_rd_burst|"
+			  "iops_wr_burst|\n");
+	vmm_cprintf(cdev, "             bps_rd|bps_wr|bps_rd_burst|"
+			  "bps_wr_burst|weight\n");
+	vmm_cprintf(cdev, "   <value> = 0 removes the limit\n");
 }
 
 static int cmd_vdisk_list_iter(struct vmm_vdisk *vdisk, void *data)
@@ -126,6 +138,143 @@ static int cmd_vdisk_attach(struct vmm_chardev *cdev,
 	return VMM_OK;
 }
 
+static void cmd_vdisk_qos_show(struct vmm_chardev *cdev,
+			       const char *dname,
+			       const struct vmm_vdisk_qos_limit *l)
+{
+	vmm_cprintf(cdev, " %-6s %-16"PRIu64" %-16"PRIu64" "
+		    "%-16"PRIu64" %-16"PRIu64"\n",
+		    dname, l->iops, l->iops_burst, l->bps, l->bps_burst);
+}
+
+static int cmd_vdisk_qos(struct vmm_chardev *cdev,
+			 const char *vdisk_name,
+			 const char *param, const char *value)
+{
+	int rc;
+	u64 val;
+	struct vmm_vdisk_qos qos;
+	struct vmm_vdisk_qos_limit *rd = &qos.limit[VMM_VDISK_QOS_READ];
+	struct vmm_vdisk_qos_limit *wr = &qos.limit[VMM_VDISK_QOS_WRITE];
+	struct vmm_vdisk *vdisk = vmm_vdisk_find(vdisk_name);
+
+	if (!vdisk) {
+		vmm_cprintf(cdev, "Failed to find virtual disk\n");
+		return VMM_ENODEV;
+	}
+
+	rc = vmm_vdisk_get_qos(vdisk, &qos);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to get QoS of virtual disk\n");
+		return rc;
+	}
+
+	if (!param || !value) {
+		vmm_cprintf(cdev, "Weight: %"PRIu32"\n", qos.weight);
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "----------------------------------------\n");
+		vmm_cprintf(cdev, " %-6s %-16s %-16s %-16s %-16s\n",
+			    "Dir", "IOPS", "IOPS Burst", "Bytes/sec",
+			    "Bytes Burst");
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "----------------------------------------\n");
+		cmd_vdisk_qos_show(cdev, "read", rd);
+		cmd_vdisk_qos_show(cdev, "write", wr);
+		vmm_cprintf(cdev, "----------------------------------------"
+				  "----------------------------------------\n");
+		return VMM_OK;
+	}
+
+	val = strtoull(value, NULL, 0);
+	if (strcmp(param, "iops_rd") == 0) {
+		rd->iops = val;
+	} else if (strcmp(param, "iops_wr") == 0) {
+		wr->iops = val;
+	} else if (strcmp(param, "iops_rd_burst") == 0) {
+		rd->iops_burst = val;
+	} else if (strcmp(param, "iops_wr_burst") == 0) {
+		wr->iops_burst = val;
+	} else if (strcmp(param, "bps_rd") == 0) {
+		rd->bps = val;
+	} else if (strcmp(param, "bps_wr") == 0) {
+		wr->bps = val;
+	} else if (strcmp(param, "bps_rd_burst") == 0) {
+		rd->bps_burst = val;
+	} else if (strcmp(param, "bps_wr_burst") == 0) {
+		wr->bps_burst = val;
+	} else if (strcmp(param, "weight") == 0) {
+		qos.weight = (val <= VMM_VDISK_QOS_MAX_WEIGHT) ? val : 0;
+	} else {
+		vmm_cprintf(cdev, "Unknown QoS parameter %s\n", param);
+		return VMM_EINVALID;
+	}
+
+	rc = vmm_vdisk_set_qos(vdisk, &qos);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to set QoS parameter %s "
+			    "(error %d)\n", param, rc);
+	}
+
+	return rc;
+}
+
+static void cmd_vdisk_stats_show(struct vmm_chardev *cdev,
+				 const char *dname, u32 dir, u64 msecs,
+				 const struct vmm_vdisk_stats *st)
+{
+	u64 avg_lat = (st->ops[dir]) ?
+			udiv64(st->total_latency_ns[dir], st->ops[dir]) : 0;
+	u64 kbps = (msecs) ? udiv64(st->bytes[dir], msecs) : 0;
+
+	vmm_cprintf(cdev, " %-6s %-12"PRIu64" %-14"PRIu64" %-8"PRIu64" "
+		    "%-10"PRIu64" %-10"PRIu64" %-10"PRIu64" %-8"PRIu64"\n",
+		    dname, st->ops[dir], st->bytes[dir], st->errors[dir],
+		    st->throttled[dir], udiv64(avg_lat, 1000),
+		    udiv64(st->max_latency_ns[dir], 1000), kbps);
+}
+
+static int cmd_vdisk_stats(struct vmm_chardev *cdev,
+			   const char *vdisk_name, bool reset)
+{
+	int rc;
+	u64 msecs;
+	struct vmm_vdisk_stats st;
+	struct vmm_vdisk *vdisk = vmm_vdisk_find(vdisk_name);
+
+	if (!vdisk) {
+		vmm_cprintf(cdev, "Failed to find virtual disk\n");
+		return VMM_ENODEV;
+	}
+
+	if (reset) {
+		return vmm_vdisk_reset_stats(vdisk);
+	}
+
+	rc = vmm_vdisk_get_stats(vdisk, &st);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to get stats of virtual disk\n");
+		return rc;
+	}
+	msecs = udiv64(vmm_timer_timestamp() - st.reset_tstamp, 1000000ULL);
+
+	vmm_cprintf(cdev, "Queued  : %"PRIu32"\n", st.queued);
+	vmm_cprintf(cdev, "Inflight: %"PRIu32"\n", st.inflight);
+	vmm_cprintf(cdev, "Interval: %"PRIu64" ms\n", msecs);
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	vmm_cprintf(cdev, " %-6s %-12s %-14s %-8s %-10s %-10s %-10s %-8s\n",
+		    "Dir", "Ops", "Bytes", "Errors", "Throttled",
+		    "AvgLat(us)", "MaxLat(us)", "KB/s");
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+	cmd_vdisk_stats_show(cdev, "read", VMM_VDISK_QOS_READ, msecs, &st);
+	cmd_vdisk_stats_show(cdev, "write", VMM_VDISK_QOS_WRITE, msecs, &st);
+	vmm_cprintf(cdev, "----------------------------------------"
+			  "----------------------------------------\n");
+
+	return VMM_OK;
+}
+
 static int cmd_vdisk_exec(struct vmm_chardev *cdev, int argc, char **argv)
 {
 	if (argc == 2) {
@@ -141,10 +290,21 @@ static int cmd_vdisk_exec(struct vmm_chardev *cdev, int argc, char **argv)
 			return cmd_vdisk_detach(cdev, argv[2]);
 		} else if (strcmp(argv[1], "info") == 0) {
 			return cmd_vdisk_info(cdev, argv[2]);
+		} else if (strcmp(argv[1], "qos") == 0) {
+			return cmd_vdisk_qos(cdev, argv[2], NULL, NULL);
+		} else if (strcmp(argv[1], "stats") == 0) {
+			return cmd_vdisk_stats(cdev, argv[2], FALSE);
 		}
 	} else if (argc == 4) {
 		if (strcmp(argv[1], "attach") == 0) {
 			return cmd_vdisk_attach(cdev, argv[2], argv[3]);
+		} else if ((strcmp(argv[1], "stats") == 0) &&
+			   (strcmp(argv[3], "reset") == 0)) {
+			return cmd_vdisk_stats(cdev, argv[2], TRUE);
+		}
+	} else if (argc == 5) {
+		if (strcmp(argv[1], "qos") == 0) {
+			return cmd_vdisk_qos(cdev, argv[2], argv[3], argv[4]);
 		}
 	}
 	cmd_vdisk_usage(cdev);
@@ -29,13 +29,23 @@
 #include <vmm_wallclock.h>
 #include <vmm_manager.h>
 #include <vmm_host_aspace.h>
+#include <vmm_host_ram.h>
+#include <vmm_host_vapool.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_modules.h>
 #include <vmm_cmdmgr.h>
 #include <vmm_delay.h>
+#include <vmm_cache.h>
+#include <vmm_mutex.h>
+#include <vmm_completion.h>
+#include <vmm_threads.h>
+#include <vmm_workqueue.h>
 #include <libs/libfdt.h>
+#include <libs/mathlib.h>
 #include <libs/stringlib.h>
+#include <libs/xref.h>
 #include <libs/vfs.h>
+#include <arch_cpu_aspace.h>
 
 #if CONFIG_CRYPTO_HASH_MD5
 #include <libs/md5.h>
@@ -55,6 +65,11 @@
 #define VFS_MAX_MODULE_SZ		(256 * 1024)
 #define VFS_MAX_FDT_SZ			(32 * 1024)
 #define VFS_LOAD_BUF_SZ			(4 * 1024)
+#define VFS_LOAD_CHUNK_SZ		(1024 * 1024)
+#define VFS_LOAD_WORKERS		4
+#define VFS_LOAD_PROGRESS_MSECS		1000
+#define VFS_LOAD_IMAGES_NODE		"images"
+#define VFS_LOAD_SHA256_ATTR		"sha256"
 
 static void cmd_vfs_usage(struct vmm_chardev *cdev)
 {
@@ -94,11 +109,18 @@ static void cmd_vfs_usage(struct vmm_chardev *cdev)
 			  "<path_to_file> [<file_offset>] [<byte_count>]\n");
 	vmm_cprintf(cdev, "   vfs guest_load_list <guest_name> "
 			  "<path_to_list_file>\n");
+	vmm_cprintf(cdev, "   vfs host_load_start <path_to_list_file>\n");
+	vmm_cprintf(cdev, "   vfs guest_load_start <guest_name> "
+			  "<path_to_list_file>\n");
+	vmm_cprintf(cdev, "   vfs load_wait [<guest_name>|host]\n");
+	vmm_cprintf(cdev, "   vfs load_status\n");
 	vmm_cprintf(cdev, "Note:\n");
 	vmm_cprintf(cdev, "   <attr_type> = unknown|string|bytes|"
 					   "uint32|uint64|"
 			  		   "physaddr|physsize|"
 					   "virtaddr|virtsize\n");
+	vmm_cprintf(cdev, "   *_load_start commands load in background "
+			  "and load_wait waits for them\n");
 }
 
 static int cmd_vfs_fslist(struct vmm_chardev *cdev)
@@ -1162,81 +1184,660 @@ static int cmd_vfs_guest_fdt_load(struct vmm_chardev *cdev,
 	return VMM_OK;
 }
 
-static int cmd_vfs_load(struct vmm_chardev *cdev,
-			struct vmm_guest *guest,
-			physical_addr_t pa,
-			const char *curdir,
-			const char *path, u32 off, u32 len)
+struct cmd_vfs_load_extent {
+	physical_addr_t hpa;
+	physical_size_t size;
+};
+
+/* Image load running in background on one of the load workqueues */
+struct cmd_vfs_load_job {
+	struct dlist head;
+	struct xref ref;
+	struct vmm_work work;
+	struct vmm_completion done;
+	struct vmm_chardev *cdev;
+	struct vmm_guest *guest;
+	char name[VMM_FIELD_NAME_SIZE];
+	u32 batch;
+	u32 worker;
+	physical_addr_t pa;
+	int fd;
+	loff_t off;
+	u32 len;
+	u32 loaded;
+	bool cancel;
+	bool running;
+	bool finished;
+	int status;
+	bool verify;
+#if CONFIG_CRYPTO_HASH_SHA256
+	sha256_digest_t digest;
+#endif
+	u32 nr_extents;
+	struct cmd_vfs_load_extent *extents;
+	char path[VFS_MAX_PATH];
+};
+
+static DEFINE_MUTEX(load_lock);
+static LIST_HEAD(load_jobs);
+static u32 load_batch_next;
+static struct vmm_workqueue *load_wqs[VFS_LOAD_WORKERS];
+/* Fixed virtual window of each load worker used to map destination */
+static virtual_addr_t load_va[VFS_LOAD_WORKERS];
+
+static void cmd_vfs_load_job_free(struct xref *ref)
 {
-	int fd, rc;
+	struct cmd_vfs_load_job *job =
+			container_of(ref, struct cmd_vfs_load_job, ref);
+
+	if (job->extents) {
+		vmm_free(job->extents);
+	}
+	vmm_free(job);
+}
+
+static void cmd_vfs_load_job_put(struct cmd_vfs_load_job *job)
+{
+	xref_put(&job->ref, cmd_vfs_load_job_free);
+}
+
+static const char *cmd_vfs_load_name(struct cmd_vfs_load_job *job)
+{
+	return job->name;
+}
+
+/* Resolve host memory backing the load destination. Returns the
+ * number of physically contiguous extents and fills them when
+ * ext is not NULL.
+ */
+static int cmd_vfs_load_resolve(struct cmd_vfs_load_job *job,
+				struct cmd_vfs_load_extent *ext)
+{
+	int rc, count = 0;
+	u32 reg_flags;
+	physical_addr_t gpa, hpa, prev_end = 0;
+	physical_size_t size, left;
+
+	if (!job->guest) {
+		if (ext) {
+			ext[0].hpa = job->pa;
+			ext[0].size = job->len;
+		}
+		return 1;
+	}
+
+	gpa = job->pa;
+	left = job->len;
+	while (left) {
+		rc = vmm_guest_physical_map(job->guest, gpa, left,
+					    &hpa, &size, &reg_flags);
+		if (rc || !size || !(reg_flags & VMM_REGION_REAL)) {
+			return VMM_ENOTAVAIL;
+		}
+
+		if (count && (hpa == prev_end)) {
+			if (ext) {
+				ext[count - 1].size += size;
+			}
+		} else {
+			if (ext) {
+				ext[count].hpa = hpa;
+				ext[count].size = size;
+			}
+			count++;
+		}
+
+		prev_end = hpa + size;
+		gpa += size;
+		left -= size;
+	}
+
+	return count;
+}
+
+#if CONFIG_CRYPTO_HASH_SHA256
+/* Find optional digest of image loaded at given guest address */
+static void cmd_vfs_load_find_digest(struct cmd_vfs_load_job *job)
+{
+	physical_addr_t gpa;
+	struct vmm_devtree_node *images, *child;
+
+	if (!job->guest || !job->guest->node) {
+		return;
+	}
+
+	images = vmm_devtree_getchild(job->guest->node, VFS_LOAD_IMAGES_NODE);
+	if (!images) {
+		return;
+	}
+
+	vmm_devtree_for_each_child(child, images) {
+		if (vmm_devtree_read_physaddr(child,
+				VMM_DEVTREE_GUEST_PHYS_ATTR_NAME, &gpa) ||
+		    (gpa != job->pa)) {
+			continue;
+		}
+		if ((vmm_devtree_attrlen(child, VFS_LOAD_SHA256_ATTR) ==
+						SHA256_DIGEST_LEN) &&
+		    !vmm_devtree_read_u8_array(child, VFS_LOAD_SHA256_ATTR,
+					       job->digest,
+					       SHA256_DIGEST_LEN)) {
+			job->verify = TRUE;
+		}
+		vmm_devtree_dref_node(child);
+		break;
+	}
+
+	vmm_devtree_dref_node(images);
+}
+#endif
+
+/* Check whether given host physical range is entirely in host RAM */
+static bool cmd_vfs_load_is_ram(physical_addr_t hpa, physical_size_t size)
+{
+	u32 b;
+	physical_addr_t start;
+	physical_size_t bsize;
+
+	for (b = 0; b < vmm_host_ram_bank_count(); b++) {
+		start = vmm_host_ram_bank_start(b);
+		bsize = vmm_host_ram_bank_size(b);
+		if ((start <= hpa) && (size <= bsize) &&
+		    ((hpa - start) <= (bsize - size))) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void cmd_vfs_load_unmap(virtual_addr_t va, virtual_size_t sz)
+{
+	virtual_addr_t off;
+
+	for (off = 0; off < sz; off += VMM_PAGE_SIZE) {
+		arch_cpu_aspace_unmap(va + off);
+	}
+}
+
+/* Map host pages into fixed window of load worker */
+static int cmd_vfs_load_map(virtual_addr_t va, physical_addr_t pa,
+			    virtual_size_t sz)
+{
+	int rc;
+	virtual_addr_t off;
+
+	for (off = 0; off < sz; off += VMM_PAGE_SIZE) {
+		rc = arch_cpu_aspace_map(va + off, VMM_PAGE_SIZE, pa + off,
+					 VMM_MEMORY_FLAGS_NORMAL);
+		if (rc) {
+			cmd_vfs_load_unmap(va, off);
+			return rc;
+		}
+	}
+
+	return VMM_OK;
+}
+
+static void cmd_vfs_load_work(struct vmm_work *work)
+{
+	int rc = VMM_OK;
+	u32 i, pgoff, chunk;
+	size_t rd;
 	loff_t rd_off;
-	physical_addr_t wr_pa;
-	size_t buf_wr, buf_rd, buf_count, wr_count;
-	char *buf = NULL;
+	virtual_addr_t va;
+	virtual_size_t map_sz;
+	physical_addr_t hpa;
+	physical_size_t left;
+	void *buf;
+	struct cmd_vfs_load_job *job =
+			container_of(work, struct cmd_vfs_load_job, work);
+#if CONFIG_CRYPTO_HASH_SHA256
+	struct sha256_context sha256c;
+	sha256_digest_t digest;
 
-	rc = cmd_vfs_file_open_read(cdev, curdir, path, &fd, &len);
+	sha256_init(&sha256c);
+#endif
+
+	vmm_mutex_lock(&load_lock);
+	job->running = TRUE;
+	vmm_mutex_unlock(&load_lock);
+
+	va = load_va[job->worker];
+	rd_off = job->off;
+	for (i = 0; !rc && (i < job->nr_extents); i++) {
+		hpa = job->extents[i].hpa;
+		left = job->extents[i].size;
+		while (left) {
+			if (job->cancel) {
+				rc = VMM_ESHUTDOWN;
+				break;
+			}
+
+			/* File data is read straight into host frames
+			 * backing the destination one window at a time.
+			 * Each worker runs one job at a time so its
+			 * window is not shared.
+			 */
+			pgoff = hpa & VMM_PAGE_MASK;
+			chunk = VFS_LOAD_CHUNK_SZ - pgoff;
+			chunk = (left < chunk) ? left : chunk;
+			map_sz = VMM_ROUNDUP2_PAGE_SIZE(pgoff + chunk);
+			rc = cmd_vfs_load_map(va, hpa - pgoff, map_sz);
+			if (rc) {
+				vmm_cprintf(job->cdev, "Failed to map "
+					    "0x%"PRIPADDR" for %s\n",
+					    hpa, job->path);
+				break;
+			}
+			buf = (void *)(va + pgoff);
+
+			rd = vfs_pread(job->fd, buf, chunk, rd_off);
+#if CONFIG_CRYPTO_HASH_SHA256
+			if (job->verify && (rd == chunk)) {
+				sha256_update(&sha256c, buf, chunk);
+			}
+#endif
+			/* Image is consumed by guest with caches off */
+			vmm_flush_cache_range((virtual_addr_t)buf,
+					      (virtual_addr_t)buf + chunk);
+			cmd_vfs_load_unmap(va, map_sz);
+
+			if (rd != chunk) {
+				vmm_cprintf(job->cdev, "Failed to read "
+					    "%u bytes @ 0x%"PRIx64" from %s\n",
+					    chunk, (u64)rd_off, job->path);
+				rc = VMM_EIO;
+				break;
+			}
+
+			rd_off += chunk;
+			hpa += chunk;
+			left -= chunk;
+			job->loaded += chunk;
+		}
+	}
+
+#if CONFIG_CRYPTO_HASH_SHA256
+	if (!rc && job->verify) {
+		sha256_final(digest, &sha256c);
+		if (memcmp(digest, job->digest, SHA256_DIGEST_LEN)) {
+			vmm_cprintf(job->cdev, "%s: SHA-256 mismatch for %s\n",
+				    cmd_vfs_load_name(job), job->path);
+			rc = VMM_EFAIL;
+		}
+	}
+#endif
+
+	if (vfs_close(job->fd)) {
+		vmm_cprintf(job->cdev, "Failed to close %s\n", job->path);
+	}
+
+	vmm_cprintf(job->cdev, "%s: Loaded 0x%"PRIPADDR" with %u bytes%s\n",
+		    cmd_vfs_load_name(job), job->pa, job->loaded,
+		    (job->verify && !rc) ? " (SHA-256 verified)" : "");
+
+	vmm_mutex_lock(&load_lock);
+	job->status = rc;
+	job->running = FALSE;
+	job->finished = TRUE;
+	vmm_mutex_unlock(&load_lock);
+
+	vmm_completion_complete_all(&job->done);
+	cmd_vfs_load_job_put(job);
+}
+
+/* Allocate non-zero batch number used to tag loads queued by a
+ * blocking command so that it only waits for and reaps its own loads.
+ */
+static u32 cmd_vfs_load_batch_alloc(void)
+{
+	u32 batch;
+
+	vmm_mutex_lock(&load_lock);
+	load_batch_next++;
+	if (!load_batch_next) {
+		load_batch_next++;
+	}
+	batch = load_batch_next;
+	vmm_mutex_unlock(&load_lock);
+
+	return batch;
+}
+
+/* Open image and queue its load on the workqueue of destination.
+ * Background loads use zero batch number.
+ */
+static int cmd_vfs_load_start(struct vmm_chardev *cdev,
+			      struct vmm_guest *guest, u32 batch,
+			      physical_addr_t pa,
+			      const char *curdir,
+			      const char *path, u32 off, u32 len)
+{
+	int fd, rc;
+	u32 i, size;
+	struct cmd_vfs_load_job *job;
+
+	rc = cmd_vfs_file_open_read(cdev, curdir, path, &fd, &size);
 	if (VMM_OK != rc) {
 		return rc;
 	}
 
-	if (off >= len) {
+	if (off >= size) {
 		vfs_close(fd);
 		vmm_cprintf(cdev, "Offset greater than file size\n");
 		return VMM_EINVALID;
 	}
 
-	if (NULL == (buf = vmm_malloc(VFS_LOAD_BUF_SZ))) {
-		vmm_cprintf(cdev, "Failed to allocate buffer\n");
+	job = vmm_zalloc(sizeof(*job));
+	if (!job) {
 		vfs_close(fd);
+		vmm_cprintf(cdev, "Failed to allocate load job\n");
 		return VMM_ENOMEM;
 	}
+	INIT_LIST_HEAD(&job->head);
+	xref_init(&job->ref);
+	INIT_WORK(&job->work, cmd_vfs_load_work);
+	INIT_COMPLETION(&job->done);
+	job->cdev = cdev;
+	job->guest = guest;
+	/* Job can outlive the guest so keep a copy of its name */
+	strlcpy(job->name, (guest) ? guest->name : "host", sizeof(job->name));
+	job->batch = batch;
+	job->worker = (guest) ? (guest->id % VFS_LOAD_WORKERS) : 0;
+	job->pa = pa;
+	job->fd = fd;
+	job->off = off;
+	job->len = ((size - off) < len) ? (size - off) : len;
+	strlcpy(job->path, path, sizeof(job->path));
+
+	/* Destination is resolved and job is listed under load_lock
+	 * so that a region deleted meanwhile either fails the resolve
+	 * or finds the job to cancel in cmd_vfs_load_del_region().
+	 */
+	vmm_mutex_lock(&load_lock);
+
+	rc = cmd_vfs_load_resolve(job, NULL);
+	if (rc > 0) {
+		job->nr_extents = rc;
+		job->extents = vmm_malloc(rc * sizeof(*job->extents));
+		if (!job->extents) {
+			rc = VMM_ENOMEM;
+		} else {
+			rc = cmd_vfs_load_resolve(job, job->extents);
+		}
+	}
+	if (rc < 0) {
+		vmm_mutex_unlock(&load_lock);
+		vmm_cprintf(cdev, "%s: No memory to load %u bytes "
+			    "@ 0x%"PRIPADDR"\n", cmd_vfs_load_name(job),
+			    job->len, pa);
+		vfs_close(fd);
+		cmd_vfs_load_job_put(job);
+		return rc;
+	}
+
+	/* Only RAM can be mapped as normal memory by load workers */
+	for (i = 0; i < job->nr_extents; i++) {
+		if (!cmd_vfs_load_is_ram(job->extents[i].hpa,
+					 job->extents[i].size)) {
+			vmm_mutex_unlock(&load_lock);
+			vmm_cprintf(cdev, "%s: Host 0x%"PRIPADDR" is not "
+				    "RAM\n", cmd_vfs_load_name(job),
+				    job->extents[i].hpa);
+			vfs_close(fd);
+			cmd_vfs_load_job_put(job);
+			return VMM_EINVALID;
+		}
+	}
 
-	len = ((len - off) < len) ? (len - off) : len;
+#if CONFIG_CRYPTO_HASH_SHA256
+	cmd_vfs_load_find_digest(job);
+#endif
 
-	rd_off = 0;
-	wr_count = 0;
-	wr_pa = pa;
-	while (len) {
-		buf_rd = (len < VFS_LOAD_BUF_SZ) ? len : VFS_LOAD_BUF_SZ;
-		buf_count = vfs_read(fd, buf, buf_rd);
-		if (buf_count < 1) {
-			vmm_cprintf(cdev, "Failed to read "
-					  "%zu bytes @ 0x%llx from %s\n",
-					   buf_rd, rd_off, path);
+	/* One reference for load list and one for worker. Loads of
+	 * same guest go to same workqueue so they happen in order.
+	 */
+	xref_get(&job->ref);
+	list_add_tail(&job->head, &load_jobs);
+	vmm_mutex_unlock(&load_lock);
+
+	rc = vmm_workqueue_schedule_work(load_wqs[job->worker], &job->work);
+	if (rc) {
+		vmm_cprintf(cdev, "Failed to queue load of %s\n", path);
+		vmm_mutex_lock(&load_lock);
+		list_del(&job->head);
+		vmm_mutex_unlock(&load_lock);
+		vfs_close(fd);
+		cmd_vfs_load_job_put(job);
+		cmd_vfs_load_job_put(job);
+	}
+
+	return rc;
+}
+
+/* Wait for loads of a guest (NULL for host) or all loads when all
+ * is TRUE and reap them. Returns first error of the reaped loads.
+ * Loads of other batches are never reaped here. With zero batch the
+ * unfinished loads of other batches are waited for whereas with
+ * non-zero batch only loads of the given batch are considered.
+ */
+static int cmd_vfs_load_wait(struct vmm_chardev *cdev,
+			     struct vmm_guest *guest, u32 batch, bool all)
+{
+	int ret = VMM_OK;
+	u64 timeout;
+	struct cmd_vfs_load_job *job, *found;
+
+	while (1) {
+		found = NULL;
+		vmm_mutex_lock(&load_lock);
+		list_for_each_entry(job, &load_jobs, head) {
+			if (!all && (job->guest != guest)) {
+				continue;
+			}
+			if ((job->batch != batch) &&
+			    (batch || job->finished)) {
+				continue;
+			}
+			xref_get(&job->ref);
+			found = job;
 			break;
 		}
-		rd_off += buf_count;
-		if (guest) {
-			buf_wr = vmm_guest_memory_write(guest, wr_pa,
-							buf, buf_count, FALSE);
-		} else {
-			buf_wr = vmm_host_memory_write(wr_pa,
-						       buf, buf_count, FALSE);
-		}
-		if (buf_wr != buf_count) {
-			vmm_cprintf(cdev, "Failed to write "
-					  "%zu bytes @ 0x%"PRIPADDR" (%s)\n",
-					  buf_count, wr_pa,
-					  (guest) ? (guest->name) : "host");
+		vmm_mutex_unlock(&load_lock);
+		if (!found) {
 			break;
 		}
-		len -= buf_wr;
-		wr_count += buf_wr;
-		wr_pa += buf_wr;
+
+		timeout = VFS_LOAD_PROGRESS_MSECS * 1000000ULL;
+		while (vmm_completion_wait_timeout(&found->done, &timeout)) {
+			if (cdev && found->len) {
+				vmm_cprintf(cdev, "%s: Loading %s %u%%\n",
+					cmd_vfs_load_name(found), found->path,
+					(u32)udiv64((u64)found->loaded * 100,
+						    found->len));
+			}
+			timeout = VFS_LOAD_PROGRESS_MSECS * 1000000ULL;
+		}
+
+		vmm_mutex_lock(&load_lock);
+		if ((found->batch == batch) && !list_empty(&found->head)) {
+			list_del_init(&found->head);
+			if (!ret) {
+				ret = found->status;
+			}
+			cmd_vfs_load_job_put(found);
+		}
+		vmm_mutex_unlock(&load_lock);
+
+		cmd_vfs_load_job_put(found);
 	}
 
-	vmm_cprintf(cdev, "%s: Loaded 0x%"PRIPADDR" with %zu bytes\n",
-			  (guest) ? (guest->name) : "host",
-			  pa, wr_count);
+	return ret;
+}
 
-	vmm_free(buf);
-	rc = vfs_close(fd);
+static int cmd_vfs_load_status(struct vmm_chardev *cdev)
+{
+	u32 count = 0;
+	struct cmd_vfs_load_job *job;
+
+	vmm_cprintf(cdev, "%-16s %-18s %-11s %-10s %s\n",
+		    "Name", "Address", "Loaded", "State", "File");
+	vmm_mutex_lock(&load_lock);
+	list_for_each_entry(job, &load_jobs, head) {
+		vmm_cprintf(cdev, "%-16s 0x%016"PRIPADDR" %10u%% %-10s %s\n",
+			cmd_vfs_load_name(job), job->pa,
+			(job->len) ? (u32)udiv64((u64)job->loaded * 100,
+						 job->len) : 100,
+			(job->finished) ?
+				((job->status) ? "failed" : "done") :
+				((job->running) ? "running" : "queued"),
+			job->path);
+		count++;
+	}
+	vmm_mutex_unlock(&load_lock);
+	vmm_cprintf(cdev, "Total %u loads\n", count);
+
+	return VMM_OK;
+}
+
+struct cmd_vfs_load_overlap {
+	struct cmd_vfs_load_job *job;
+	bool found;
+};
+
+static void cmd_vfs_load_overlap_mapping(struct vmm_guest *guest,
+					 struct vmm_region *reg,
+					 physical_addr_t gphys_addr,
+					 physical_addr_t hphys_addr,
+					 physical_size_t phys_size,
+					 void *priv)
+{
+	u32 i;
+	struct cmd_vfs_load_overlap *ov = priv;
+	struct cmd_vfs_load_extent *ext;
+
+	for (i = 0; i < ov->job->nr_extents; i++) {
+		ext = &ov->job->extents[i];
+		if ((ext->hpa < (hphys_addr + phys_size)) &&
+		    (hphys_addr < (ext->hpa + ext->size))) {
+			ov->found = TRUE;
+		}
+	}
+}
+
+/* Check whether load writes to guest or host memory of region */
+static bool cmd_vfs_load_overlaps(struct cmd_vfs_load_job *job,
+				  struct vmm_guest *guest,
+				  struct vmm_region *reg)
+{
+	struct cmd_vfs_load_overlap ov = { .job = job, .found = FALSE };
+
+	if (job->guest != guest) {
+		return FALSE;
+	}
+
+	if ((job->pa < VMM_REGION_GPHYS_END(reg)) &&
+	    (VMM_REGION_GPHYS_START(reg) < (job->pa + job->len))) {
+		return TRUE;
+	}
+
+	if ((reg->flags & VMM_REGION_REAL) &&
+	    !(reg->flags & VMM_REGION_ALIAS)) {
+		vmm_guest_iterate_mapping(guest, reg,
+					  cmd_vfs_load_overlap_mapping, &ov);
+	}
+
+	return ov.found;
+}
+
+/* Cancel loads into a deleted region and wait for them to stop.
+ * The loads are left on the list for their waiters to reap.
+ */
+static void cmd_vfs_load_del_region(struct vmm_guest *guest,
+				    struct vmm_region *reg)
+{
+	struct cmd_vfs_load_job *job, *found;
+
+	vmm_mutex_lock(&load_lock);
+	list_for_each_entry(job, &load_jobs, head) {
+		if (!job->finished && cmd_vfs_load_overlaps(job, guest, reg)) {
+			job->cancel = TRUE;
+		}
+	}
+	vmm_mutex_unlock(&load_lock);
+
+	while (1) {
+		found = NULL;
+		vmm_mutex_lock(&load_lock);
+		list_for_each_entry(job, &load_jobs, head) {
+			if ((job->guest == guest) && job->cancel &&
+			    !job->finished) {
+				xref_get(&job->ref);
+				found = job;
+				break;
+			}
+		}
+		vmm_mutex_unlock(&load_lock);
+		if (!found) {
+			break;
+		}
+
+		vmm_completion_wait(&found->done);
+		cmd_vfs_load_job_put(found);
+	}
+}
+
+static int cmd_vfs_load_guest_aspace_notification(
+					struct vmm_notifier_block *nb,
+					unsigned long evt, void *data)
+{
+	struct cmd_vfs_load_job *job;
+	struct vmm_guest_aspace_event *edata = data;
+
+	if (evt == VMM_GUEST_ASPACE_EVENT_DEL_REGION) {
+		cmd_vfs_load_del_region(edata->guest, edata->data);
+		return NOTIFY_OK;
+	}
+	if (evt != VMM_GUEST_ASPACE_EVENT_DEINIT) {
+		return NOTIFY_DONE;
+	}
+
+	/* Regions are about to go so stop loads into them */
+	vmm_mutex_lock(&load_lock);
+	list_for_each_entry(job, &load_jobs, head) {
+		if (job->guest == edata->guest) {
+			job->cancel = TRUE;
+		}
+	}
+	vmm_mutex_unlock(&load_lock);
+
+	cmd_vfs_load_wait(NULL, edata->guest, 0, FALSE);
+
+	return NOTIFY_OK;
+}
+
+static struct vmm_notifier_block cmd_vfs_load_nb = {
+	.notifier_call = cmd_vfs_load_guest_aspace_notification,
+	.priority = 0,
+};
+
+static int cmd_vfs_load(struct vmm_chardev *cdev,
+			struct vmm_guest *guest,
+			physical_addr_t pa,
+			const char *curdir,
+			const char *path, u32 off, u32 len)
+{
+	int rc;
+	u32 batch = cmd_vfs_load_batch_alloc();
+
+	rc = cmd_vfs_load_start(cdev, guest, batch,
+				pa, curdir, path, off, len);
 	if (rc) {
-		vmm_cprintf(cdev, "Failed to close %s\n", path);
 		return rc;
 	}
 
-	return VMM_OK;
+	return cmd_vfs_load_wait(cdev, guest, batch, FALSE);
 }
 
 static const char cmd_vfs_esclist[] = {'\n', '\r', ' '};
@@ -1286,10 +1887,10 @@ static char *cmd_vfs_next_token(char **bufp, u32 *len)
 
 static int cmd_vfs_load_list(struct vmm_chardev *cdev,
 			     struct vmm_guest *guest,
-			     const char *path)
+			     const char *path, bool wait)
 {
-	u32 len;
-	int fd, rc;
+	u32 len, batch;
+	int fd, rc, wait_rc, load_rc = VMM_OK;
 	physical_addr_t pa;
 	char *buf = NULL;
 	char *buf_save = NULL;
@@ -1340,6 +1941,7 @@ static int cmd_vfs_load_list(struct vmm_chardev *cdev,
 		return len;
 	}
 
+	batch = (wait) ? cmd_vfs_load_batch_alloc() : 0;
 	while (buf) {
 		token = cmd_vfs_next_token(&buf, &len);
 		if (!token || !buf) {
@@ -1353,10 +1955,10 @@ static int cmd_vfs_load_list(struct vmm_chardev *cdev,
 			    (guest) ? (guest->name) : "host",
 			    pa, token);
 
-		rc = cmd_vfs_load(cdev, guest, pa,
-				  curdir, token, 0, 0xFFFFFFFF);
-		if (rc) {
-			vmm_cprintf(cdev, "error %d\n", rc);
+		load_rc = cmd_vfs_load_start(cdev, guest, batch, pa,
+					     curdir, token, 0, 0xFFFFFFFF);
+		if (load_rc) {
+			vmm_cprintf(cdev, "error %d\n", load_rc);
 			break;
 		}
 	}
@@ -1366,10 +1968,15 @@ static int cmd_vfs_load_list(struct vmm_chardev *cdev,
 	vmm_free(curdir);
 	if (rc) {
 		vmm_cprintf(cdev, "Failed to close %s\n", path);
-		return rc;
 	}
 
-	return VMM_OK;
+	/* Images already queued are loaded even if a later one failed */
+	if (wait) {
+		wait_rc = cmd_vfs_load_wait(cdev, guest, batch, FALSE);
+		load_rc = (load_rc) ? load_rc : wait_rc;
+	}
+
+	return (load_rc) ? load_rc : rc;
 }
 
 static int cmd_vfs_exec(struct vmm_chardev *cdev, int argc, char **argv)
@@ -1434,7 +2041,9 @@ static int cmd_vfs_exec(struct vmm_chardev *cdev, int argc, char **argv)
 		len = (argc > 5) ? strtoul(argv[5], NULL, 0) : 0xFFFFFFFF;
 		return cmd_vfs_load(cdev, NULL, pa, NULL, argv[3], off, len);
 	} else if ((strcmp(argv[1], "host_load_list") == 0) && (argc == 3)) {
-		return cmd_vfs_load_list(cdev, NULL, argv[2]);
+		return cmd_vfs_load_list(cdev, NULL, argv[2], TRUE);
+	} else if ((strcmp(argv[1], "host_load_start") == 0) && (argc == 3)) {
+		return cmd_vfs_load_list(cdev, NULL, argv[2], FALSE);
 	} else if ((strcmp(argv[1], "guest_load") == 0) && (argc > 4)) {
 		guest = vmm_manager_guest_find(argv[2]);
 		if (!guest) {
@@ -1453,7 +2062,31 @@ static int cmd_vfs_exec(struct vmm_chardev *cdev, int argc, char **argv)
 				    argv[2]);
 			return VMM_ENOTAVAIL;
 		}
-		return cmd_vfs_load_list(cdev, guest, argv[3]);
+		return cmd_vfs_load_list(cdev, guest, argv[3], TRUE);
+	} else if ((strcmp(argv[1], "guest_load_start") == 0) &&
+		   (argc == 4)) {
+		guest = vmm_manager_guest_find(argv[2]);
+		if (!guest) {
+			vmm_cprintf(cdev, "Failed to find guest %s\n",
+				    argv[2]);
+			return VMM_ENOTAVAIL;
+		}
+		return cmd_vfs_load_list(cdev, guest, argv[3], FALSE);
+	} else if ((strcmp(argv[1], "load_wait") == 0) && (argc <= 3)) {
+		if (argc == 2) {
+			return cmd_vfs_load_wait(cdev, NULL, 0, TRUE);
+		} else if (strcmp(argv[2], "host") == 0) {
+			return cmd_vfs_load_wait(cdev, NULL, 0, FALSE);
+		}
+		guest = vmm_manager_guest_find(argv[2]);
+		if (!guest) {
+			vmm_cprintf(cdev, "Failed to find guest %s\n",
+				    argv[2]);
+			return VMM_ENOTAVAIL;
+		}
+		return cmd_vfs_load_wait(cdev, guest, 0, FALSE);
+	} else if ((strcmp(argv[1], "load_status") == 0) && (argc == 2)) {
+		return cmd_vfs_load_status(cdev);
 	}
 	cmd_vfs_usage(cdev);
 	return VMM_EFAIL;
@@ -1466,14 +2099,73 @@ static struct vmm_cmd cmd_vfs = {
 	.exec = cmd_vfs_exec,
 };
 
+static void cmd_vfs_load_cleanup(void)
+{
+	u32 i;
+	struct cmd_vfs_load_job *job;
+
+	vmm_mutex_lock(&load_lock);
+	list_for_each_entry(job, &load_jobs, head) {
+		job->cancel = TRUE;
+	}
+	vmm_mutex_unlock(&load_lock);
+
+	cmd_vfs_load_wait(NULL, NULL, 0, TRUE);
+
+	for (i = 0; i < VFS_LOAD_WORKERS; i++) {
+		if (load_wqs[i]) {
+			vmm_workqueue_destroy(load_wqs[i]);
+			load_wqs[i] = NULL;
+		}
+		if (load_va[i]) {
+			vmm_host_vapool_free(load_va[i], VFS_LOAD_CHUNK_SZ);
+			load_va[i] = 0;
+		}
+	}
+}
+
 static int __init cmd_vfs_init(void)
 {
-	return vmm_cmdmgr_register_cmd(&cmd_vfs);
+	int rc;
+	u32 i;
+	char name[VMM_FIELD_NAME_SIZE];
+
+	for (i = 0; i < VFS_LOAD_WORKERS; i++) {
+		rc = vmm_host_vapool_alloc(&load_va[i], VFS_LOAD_CHUNK_SZ);
+		if (rc) {
+			load_va[i] = 0;
+			cmd_vfs_load_cleanup();
+			return rc;
+		}
+		vmm_snprintf(name, sizeof(name), "vfs_load%d", i);
+		load_wqs[i] = vmm_workqueue_create(name,
+						   VMM_THREAD_DEF_PRIORITY);
+		if (!load_wqs[i]) {
+			cmd_vfs_load_cleanup();
+			return VMM_ENOMEM;
+		}
+	}
+
+	rc = vmm_guest_aspace_register_client(&cmd_vfs_load_nb);
+	if (rc) {
+		cmd_vfs_load_cleanup();
+		return rc;
+	}
+
+	rc = vmm_cmdmgr_register_cmd(&cmd_vfs);
+	if (rc) {
+		vmm_guest_aspace_unregister_client(&cmd_vfs_load_nb);
+		cmd_vfs_load_cleanup();
+	}
+
+	return rc;
 }
 
 static void __exit cmd_vfs_exit(void)
 {
 	vmm_cmdmgr_unregister_cmd(&cmd_vfs);
+	vmm_guest_aspace_unregister_client(&cmd_vfs_load_nb);
+	cmd_vfs_load_cleanup();
 }
 
 VMM_DECLARE_MODULE(MODULE_DESC,
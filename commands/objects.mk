@@ -40,6 +40,7 @@ commands-objs-$(CONFIG_CMD_HEAP)+= cmd_heap.o
 commands-objs-$(CONFIG_CMD_WALLCLOCK)+= cmd_wallclock.o
 commands-objs-$(CONFIG_CMD_MODULE)+= cmd_module.o
 commands-objs-$(CONFIG_CMD_PROFILE)+= cmd_profile.o
+commands-objs-$(CONFIG_CMD_TRACE)+= cmd_trace.o
 
 commands-objs-$(CONFIG_CMD_VMSG)+= cmd_vmsg.o
 commands-objs-$(CONFIG_CMD_VSERIAL)+= cmd_vserial.o
@@ -56,6 +57,7 @@ commands-objs-$(CONFIG_CMD_FB)+= cmd_fb.o
 commands-objs-$(CONFIG_CMD_FB_BACKLIGHT)+= cmd_backlight.o
 commands-objs-$(CONFIG_CMD_BLOCKDEV)+= cmd_blockdev.o
 commands-objs-$(CONFIG_CMD_RBD)+= cmd_rbd.o
+commands-objs-$(CONFIG_CMD_FBD)+= cmd_fbd.o
 commands-objs-$(CONFIG_CMD_FLASH)+= cmd_flash.o
 commands-objs-$(CONFIG_CMD_I2C)+= cmd_i2c.o
 commands-objs-$(CONFIG_CMD_SPIDEV)+= cmd_spidev.o
@@ -179,11 +179,31 @@ int vmm_blockdev_submit_request(struct vmm_blockdev *bdev,
 	}
 	rq = bdev->rq;
 
-	if ((r->type == VMM_REQUEST_WRITE) &&
-	   !(bdev->flags & VMM_BLOCKDEV_RW)) {
+	switch (r->type) {
+	case VMM_REQUEST_READ:
+		break;
+	case VMM_REQUEST_DISCARD:
+		if (!(bdev->flags & VMM_BLOCKDEV_DISCARD)) {
+			rc = VMM_EOPNOTSUPP;
+			goto failed;
+		}
+		/* Fall-through */
+	case VMM_REQUEST_WRITE:
+	case VMM_REQUEST_WRITE_ZEROES:
+		if (!(bdev->flags & VMM_BLOCKDEV_RW)) {
+			rc = VMM_EINVALID;
+			goto failed;
+		}
+		break;
+	case VMM_REQUEST_FLUSH:
+		/* Flush has no block range so skip range checks */
+		r->lba = bdev->start_lba;
+		r->bcnt = 0;
+		goto skip_range_check;
+	default:
 		rc = VMM_EINVALID;
 		goto failed;
-	}
+	};
 
 	if (bdev->num_blocks < r->bcnt) {
 		rc = VMM_ERANGE;
@@ -198,7 +218,11 @@ int vmm_blockdev_submit_request(struct vmm_blockdev *bdev,
 		rc = VMM_ERANGE;
 		goto failed;
 	}
+	if (r->type != VMM_REQUEST_WRITE) {
+		r->flags &= ~VMM_REQUEST_FUA;
+	}
 
+skip_range_check:
 	if (rq->peek_cache) {
 		vmm_spin_lock_irqsave(&rq->lock, flags);
 		rc = __blockdev_peek_cache(bdev, r);
@@ -323,6 +347,7 @@ static int blockdev_rw_blocks(struct vmm_blockdev *bdev,
 
 	rw.failed = FALSE;
 	rw.req.type = type;
+	rw.req.flags = 0;
 	rw.req.lba = bdev->start_lba + lba;
 	rw.req.bcnt = bcnt;
 	rw.req.data = buf;
@@ -344,6 +369,18 @@ static int blockdev_rw_blocks(struct vmm_blockdev *bdev,
 	return VMM_OK;
 }
 
+int vmm_blockdev_flush(struct vmm_blockdev *bdev)
+{
+	BUG_ON(!vmm_scheduler_orphan_context());
+
+	if (!bdev || !bdev->rq) {
+		return VMM_EFAIL;
+	}
+
+	return blockdev_rw_blocks(bdev, VMM_REQUEST_FLUSH, NULL, 0, 0);
+}
+VMM_EXPORT_SYMBOL(vmm_blockdev_flush);
+
 u64 vmm_blockdev_rw(struct vmm_blockdev *bdev,
 			enum vmm_request_type type,
 			u8 *buf, u64 off, u64 len)
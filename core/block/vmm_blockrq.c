@@ -30,12 +30,18 @@
 #include <vmm_pagepool.h>
 #include <vmm_host_aspace.h>
 #include <block/vmm_blockrq.h>
+#include <libs/mathlib.h>
+#include <libs/stringlib.h>
+
+/* Size of zero buffer used for emulating write zeroes */
+#define BLOCKRQ_ZEROES_SIZE		(64 * 1024)
 
 struct blockrq_work {
 	struct vmm_blockrq *brq;
 	struct dlist head;
 	struct vmm_work work;
 	bool is_rw;
+	bool is_fua_sync;
 	union {
 		struct {
 			struct vmm_request *r;
@@ -49,6 +55,18 @@ struct blockrq_work {
 	bool is_free;
 };
 
+static bool blockrq_have_pending(struct vmm_blockrq *brq)
+{
+	bool ret;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&brq->wq_lock, flags);
+	ret = !list_empty(&brq->wq_pending_list);
+	vmm_spin_unlock_irqrestore(&brq->wq_lock, flags);
+
+	return ret;
+}
+
 static int blockrq_cache_rw(struct vmm_blockrq *brq,
 			    struct vmm_request *r)
 {
@@ -56,12 +74,19 @@ static int blockrq_cache_rw(struct vmm_blockrq *brq,
 
 	switch (r->type) {
 	case VMM_REQUEST_READ:
-		if (brq->ops->read_cache) {
+		if (brq->ops->read_cache &&
+		    !blockrq_have_pending(brq)) {
 			rc = brq->ops->read_cache(brq, r, brq->priv);
 		}
 		break;
 	case VMM_REQUEST_WRITE:
-		if (brq->ops->write_cache) {
+		/* FUA writes are queued so that they are followed by sync */
+		if ((r->flags & VMM_REQUEST_FUA) &&
+		    (brq->ops->sync || brq->ops->flush)) {
+			break;
+		}
+		if (brq->ops->write_cache &&
+		    !blockrq_have_pending(brq)) {
 			rc = brq->ops->write_cache(brq, r, brq->priv);
 		}
 		break;
@@ -90,6 +115,7 @@ static int blockrq_queue_rw(struct vmm_blockrq *brq,
 				 struct blockrq_work, head);
 	list_del(&bwork->head);
 	bwork->is_rw = TRUE;
+	bwork->is_fua_sync = FALSE;
 	bwork->d.rw.r = r;
 	if (r) {
 		bwork->d.rw.priv = r->priv;
@@ -204,6 +230,19 @@ void blockrq_rw_done(struct blockrq_work *bwork, int error)
 	}
 	r = bwork->d.rw.r;
 
+	/* For async request queue, follow FUA write with sync (or
+	 * flush) done by the request queue worker because we might
+	 * be in driver completion context here.
+	 */
+	if (!error && bwork->brq->async_rw &&
+	    (bwork->brq->ops->sync || bwork->brq->ops->flush) &&
+	    (r->type == VMM_REQUEST_WRITE) &&
+	    (r->flags & VMM_REQUEST_FUA) && !bwork->is_fua_sync) {
+		bwork->is_fua_sync = TRUE;
+		vmm_workqueue_schedule_work(bwork->brq->wq, &bwork->work);
+		return;
+	}
+
 	blockrq_dequeue_work(bwork);
 	if (error) {
 		vmm_blockdev_fail_request(r);
@@ -212,10 +251,76 @@ void blockrq_rw_done(struct blockrq_work *bwork, int error)
 	}
 }
 
+static int blockrq_sync(struct vmm_blockrq *brq,
+			struct vmm_request *r)
+{
+	if (brq->ops->sync) {
+		return brq->ops->sync(brq, r, brq->priv);
+	}
+
+	if (brq->ops->flush) {
+		brq->ops->flush(brq, brq->priv);
+	}
+
+	return VMM_OK;
+}
+
+static int blockrq_write_zeroes(struct vmm_blockrq *brq,
+				struct vmm_request *r)
+{
+	int rc = VMM_OK;
+	void *zeroes;
+	u32 bsize, chunk;
+	struct vmm_request zr;
+
+	if (brq->async_rw || !r->bdev || !r->bdev->block_size ||
+	    (!brq->ops->write && !brq->ops->write_cache)) {
+		return VMM_EOPNOTSUPP;
+	}
+
+	bsize = r->bdev->block_size;
+	chunk = udiv32(BLOCKRQ_ZEROES_SIZE, bsize);
+	chunk = (chunk) ? chunk : 1;
+	chunk = (chunk < r->bcnt) ? chunk : r->bcnt;
+	if (!chunk) {
+		return VMM_OK;
+	}
+
+	zeroes = vmm_zalloc(chunk * bsize);
+	if (!zeroes) {
+		return VMM_ENOMEM;
+	}
+
+	/* Write zero buffer one chunk at a time using a copy of request */
+	memcpy(&zr, r, sizeof(zr));
+	zr.type = VMM_REQUEST_WRITE;
+	zr.flags = 0;
+	zr.data = zeroes;
+	while (zr.lba < (r->lba + r->bcnt)) {
+		zr.bcnt = r->lba + r->bcnt - zr.lba;
+		zr.bcnt = (chunk < zr.bcnt) ? chunk : zr.bcnt;
+		if (brq->ops->write) {
+			rc = brq->ops->write(brq, &zr, brq->priv);
+		} else {
+			rc = brq->ops->write_cache(brq, &zr, brq->priv);
+		}
+		if (rc) {
+			break;
+		}
+		zr.lba += zr.bcnt;
+	}
+
+	vmm_free(zeroes);
+
+	return rc;
+}
+
 static void blockrq_work_func(struct vmm_work *work)
 {
 	int rc = VMM_OK;
+	bool async_done;
 	void *w_priv;
+	struct vmm_request *r;
 	void (*w_func)(struct vmm_blockrq *, void *);
 	struct blockrq_work *bwork =
 		container_of(work, struct blockrq_work, work);
@@ -231,26 +336,74 @@ static void blockrq_work_func(struct vmm_work *work)
 		return;
 	}
 
-	switch (bwork->d.rw.r->type) {
+	/* Sync following an async FUA write */
+	r = bwork->d.rw.r;
+	if (bwork->is_fua_sync) {
+		rc = blockrq_sync(brq, r);
+		if (!brq->ops->sync || rc) {
+			blockrq_rw_done(bwork, rc);
+		}
+		return;
+	}
+
+	/* Async completion only applies to driver operations
+	 * which are themselves async. Emulated operations are
+	 * always completed here.
+	 */
+	async_done = brq->async_rw;
+	switch (r->type) {
 	case VMM_REQUEST_READ:
 		if (brq->ops->read) {
-			rc = brq->ops->read(brq, bwork->d.rw.r, brq->priv);
+			rc = brq->ops->read(brq, r, brq->priv);
+		} else if (brq->ops->read_cache) {
+			rc = brq->ops->read_cache(brq, r, brq->priv);
+			async_done = FALSE;
 		} else {
 			rc = VMM_EIO;
 		}
 		break;
 	case VMM_REQUEST_WRITE:
 		if (brq->ops->write) {
-			rc = brq->ops->write(brq, bwork->d.rw.r, brq->priv);
+			rc = brq->ops->write(brq, r, brq->priv);
+		} else if (brq->ops->write_cache) {
+			rc = brq->ops->write_cache(brq, r, brq->priv);
+			async_done = FALSE;
 		} else {
 			rc = VMM_EIO;
 		}
+		if (!rc && !async_done && (r->flags & VMM_REQUEST_FUA)) {
+			rc = blockrq_sync(brq, r);
+		}
+		break;
+	case VMM_REQUEST_DISCARD:
+		if (brq->ops->discard) {
+			rc = brq->ops->discard(brq, r, brq->priv);
+		} else {
+			rc = VMM_EOPNOTSUPP;
+		}
+		break;
+	case VMM_REQUEST_WRITE_ZEROES:
+		if (brq->ops->write_zeroes) {
+			rc = brq->ops->write_zeroes(brq, r, brq->priv);
+		} else {
+			rc = blockrq_write_zeroes(brq, r);
+			async_done = FALSE;
+		}
+		break;
+	case VMM_REQUEST_FLUSH:
+		/* Requests are processed in FIFO order so all
+		 * writes completed before this point are flushed.
+		 */
+		if (!brq->ops->sync) {
+			async_done = FALSE;
+		}
+		rc = blockrq_sync(brq, r);
 		break;
 	default:
 		rc = VMM_EINVALID;
 		break;
 	};
-	if (!brq->async_rw) {
+	if (!async_done || rc) {
 		blockrq_rw_done(bwork, rc);
 	}
 }
@@ -378,6 +531,7 @@ struct vmm_blockrq *vmm_blockrq_create(
 		bwork->d.rw.r = NULL;
 		bwork->d.rw.priv = NULL;
 		bwork->is_rw = TRUE;
+		bwork->is_fua_sync = FALSE;
 		bwork->is_free = TRUE;
 		list_add_tail(&bwork->head, &brq->wq_rw_free_list);
 	}
@@ -391,6 +545,7 @@ struct vmm_blockrq *vmm_blockrq_create(
 		bwork->d.w.func = NULL;
 		bwork->d.w.priv = NULL;
 		bwork->is_rw = FALSE;
+		bwork->is_fua_sync = FALSE;
 		bwork->is_free = TRUE;
 		list_add_tail(&bwork->head, &brq->wq_w_free_list);
 	}
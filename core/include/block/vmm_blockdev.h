@@ -34,13 +34,24 @@
 #define VMM_BLOCKDEV_CLASS_NAME				"block"
 #define VMM_BLOCKDEV_CLASS_IPRIORITY			1
 
-/** Types of block IO request */
+/** Types of block IO request
+ *  NOTE: DISCARD and WRITE_ZEROES requests have lba and bcnt but no data
+ *  NOTE: DISCARD is only allowed if block device has VMM_BLOCKDEV_DISCARD
+ *  NOTE: FLUSH request has no lba, bcnt, and data. It completes only
+ *  after all requests completed before it was submitted are durable.
+ */
 enum vmm_request_type {
 	VMM_REQUEST_UNKNOWN=0,
 	VMM_REQUEST_READ=1,
-	VMM_REQUEST_WRITE=2
+	VMM_REQUEST_WRITE=2,
+	VMM_REQUEST_DISCARD=3,
+	VMM_REQUEST_WRITE_ZEROES=4,
+	VMM_REQUEST_FLUSH=5
 };
 
+/* Block IO request flags */
+#define VMM_REQUEST_FUA				0x00000001
+
 /** Representation of a block IO request */
 struct vmm_request {
 	struct dlist head;
@@ -50,6 +61,7 @@ struct vmm_request {
 				    */
 
 	enum vmm_request_type type;
+	u32 flags; /* VMM_REQUEST_FUA is only valid for WRITE requests */
 	u64 lba;
 	u32 bcnt;
 	void *data;
@@ -132,6 +144,7 @@ struct vmm_request_queue {
 /* Block device flags */
 #define VMM_BLOCKDEV_RDONLY				0x00000001
 #define VMM_BLOCKDEV_RW					0x00000002
+#define VMM_BLOCKDEV_DISCARD				0x00000004
 
 /** Block device */
 struct vmm_blockdev {
@@ -206,6 +219,15 @@ int vmm_blockdev_abort_request(struct vmm_request *r);
  */
 int vmm_blockdev_flush_cache(struct vmm_blockdev *bdev);
 
+/** Generic block IO flush
+ *  Note: This is a blocking API hence must be
+ *  called from Orphan (or Thread) Context
+ *  Note: Unlike vmm_blockdev_flush_cache(), this API submits a
+ *  FLUSH request and returns only after all writes completed
+ *  before it are durable on the block device.
+ */
+int vmm_blockdev_flush(struct vmm_blockdev *bdev);
+
 /** Generic block IO read/write
  *  Note: This is a blocking API hence must be
  *  called from Orphan (or Thread) Context
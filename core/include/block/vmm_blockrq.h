@@ -33,7 +33,18 @@
 
 struct vmm_blockrq;
 
-/** Representation of generic request queue operations */
+/** Representation of generic request queue operations
+ *  Note: read_cache() and write_cache() are tried before queuing
+ *  a request and also used for queued requests if read() or write()
+ *  is not available.
+ *  Note: discard(), write_zeroes() and sync() are optional. If
+ *  write_zeroes() is not available then it is emulated using write()
+ *  for non-async request queue. If sync() is not available then FLUSH
+ *  requests are completed after calling flush().
+ *  Note: For async request queue, read(), write(), discard(),
+ *  write_zeroes() and sync() complete using vmm_blockrq_async_done().
+ *  Note: FUA writes are followed by sync() or else by flush().
+ */
 struct vmm_blockrq_ops {
 	int (*read)(struct vmm_blockrq *brq,
 		    struct vmm_request *r, void *priv);
@@ -43,6 +54,12 @@ struct vmm_blockrq_ops {
 		     struct vmm_request *r, void *priv);
 	int (*write_cache)(struct vmm_blockrq *brq,
 			   struct vmm_request *r, void *priv);
+	int (*discard)(struct vmm_blockrq *brq,
+		       struct vmm_request *r, void *priv);
+	int (*write_zeroes)(struct vmm_blockrq *brq,
+			    struct vmm_request *r, void *priv);
+	int (*sync)(struct vmm_blockrq *brq,
+		    struct vmm_request *r, void *priv);
 	int (*abort)(struct vmm_blockrq *brq,
 		     struct vmm_request *r, void *priv);
 	void (*flush)(struct vmm_blockrq *brq, void *priv);
@@ -37,6 +37,14 @@
  * vmm_vdisk_submit_request() will automatically fill it. If
  * the emulators still need access to individual properties of
  * vmm_vdisk_request then they will have to use vmm_vdisk APIs.
+ *
+ * Each virtual disk can also have QoS limits in the form of token
+ * buckets for IOPS and bandwidth (separately for reads and writes).
+ * Requests exceeding these limits are held back by the virtual disk
+ * framework till enough tokens are available. All virtual disks
+ * sharing the request queue of a block device form a group and the
+ * requests of a group are dispatched in weighted fair order whenever
+ * the request queue has more requests than it can keep in-flight.
  */
 
 #ifndef _VMM_VDISK_H__
@@ -45,25 +53,95 @@
 #include <vmm_types.h>
 #include <vmm_spinlocks.h>
 #include <vmm_notifier.h>
+#include <vmm_devtree.h>
 #include <block/vmm_blockdev.h>
 #include <libs/list.h>
 
 #define VMM_VDISK_IPRIORITY		(VMM_BLOCKDEV_CLASS_IPRIORITY + 1)
 
 struct vmm_vdisk_request;
+struct vmm_vdisk_group;
 struct vmm_vdisk;
 
-/** Types of block IO request */
+/** Types of block IO request
+ *  NOTE: WRITE_FUA request completes only after data is durable
+ *  NOTE: DISCARD and WRITE_ZEROES requests have no data
+ *  NOTE: FLUSH request has no lba and no data
+ */
 enum vmm_vdisk_request_type {
 	VMM_VDISK_REQUEST_UNKNOWN=0,
 	VMM_VDISK_REQUEST_READ=1,
-	VMM_VDISK_REQUEST_WRITE=2
+	VMM_VDISK_REQUEST_WRITE=2,
+	VMM_VDISK_REQUEST_WRITE_FUA=3,
+	VMM_VDISK_REQUEST_DISCARD=4,
+	VMM_VDISK_REQUEST_WRITE_ZEROES=5,
+	VMM_VDISK_REQUEST_FLUSH=6
 };
 
 /** Representation of a virtual disk request  */
 struct vmm_vdisk_request {
 	struct vmm_vdisk *vdisk;
 	struct vmm_request r;
+
+	/* Private fields managed by virtual disk framework */
+	struct dlist head;
+	struct vmm_vdisk_group *group;
+	u64 tstamp;
+	u32 len;
+	u32 flags;
+};
+
+/** Direction of IO for virtual disk QoS limits and statistics */
+enum vmm_vdisk_qos_dir {
+	VMM_VDISK_QOS_READ=0,
+	VMM_VDISK_QOS_WRITE=1,
+	VMM_VDISK_QOS_MAX_DIR=2
+};
+
+/* Device tree attributes for virtual disk QoS limits */
+#define VMM_VDISK_QOS_IOPS_RD_ATTR_NAME		"iops_rd"
+#define VMM_VDISK_QOS_IOPS_WR_ATTR_NAME		"iops_wr"
+#define VMM_VDISK_QOS_IOPS_RD_BURST_ATTR_NAME	"iops_rd_burst"
+#define VMM_VDISK_QOS_IOPS_WR_BURST_ATTR_NAME	"iops_wr_burst"
+#define VMM_VDISK_QOS_BPS_RD_ATTR_NAME		"bps_rd"
+#define VMM_VDISK_QOS_BPS_WR_ATTR_NAME		"bps_wr"
+#define VMM_VDISK_QOS_BPS_RD_BURST_ATTR_NAME	"bps_rd_burst"
+#define VMM_VDISK_QOS_BPS_WR_BURST_ATTR_NAME	"bps_wr_burst"
+#define VMM_VDISK_QOS_WEIGHT_ATTR_NAME		"qos_weight"
+
+#define VMM_VDISK_QOS_MIN_WEIGHT	1
+#define VMM_VDISK_QOS_DEF_WEIGHT	100
+#define VMM_VDISK_QOS_MAX_WEIGHT	1000
+#define VMM_VDISK_QOS_MAX_RATE		1000000000000ULL
+
+/** Token bucket limits of virtual disk for one direction
+ *  NOTE: Zero rate means no limit
+ *  NOTE: Zero burst means bucket holds 100 milliseconds worth of IO
+ */
+struct vmm_vdisk_qos_limit {
+	u64 iops;
+	u64 iops_burst;
+	u64 bps;
+	u64 bps_burst;
+};
+
+/** QoS configuration of virtual disk */
+struct vmm_vdisk_qos {
+	struct vmm_vdisk_qos_limit limit[VMM_VDISK_QOS_MAX_DIR];
+	u32 weight;
+};
+
+/** Statistics of virtual disk */
+struct vmm_vdisk_stats {
+	u64 ops[VMM_VDISK_QOS_MAX_DIR];
+	u64 bytes[VMM_VDISK_QOS_MAX_DIR];
+	u64 errors[VMM_VDISK_QOS_MAX_DIR];
+	u64 throttled[VMM_VDISK_QOS_MAX_DIR];
+	u64 total_latency_ns[VMM_VDISK_QOS_MAX_DIR];
+	u64 max_latency_ns[VMM_VDISK_QOS_MAX_DIR];
+	u64 reset_tstamp;
+	u32 queued;
+	u32 inflight;
 };
 
 /** Representation of a virtual disk */
@@ -77,9 +155,21 @@ struct vmm_vdisk {
 	void (*completed)(struct vmm_vdisk *, struct vmm_vdisk_request *);
 	void (*failed)(struct vmm_vdisk *, struct vmm_vdisk_request *);
 
-	vmm_spinlock_t blk_lock; /* Protect blk pointer */
+	vmm_spinlock_t blk_lock; /* Protect blk and group pointer */
 	struct vmm_blockdev *blk;
 	u32 blk_factor;
+	struct vmm_vdisk_group *group;
+
+	/* QoS state protected by group lock (or blk_lock if no group) */
+	struct vmm_vdisk_qos qos;
+	struct dlist qos_head;
+	struct dlist qos_queue;
+	s64 qos_level[VMM_VDISK_QOS_MAX_DIR][2];
+	u64 qos_tstamp;
+	u64 qos_vtime;
+
+	vmm_spinlock_t stats_lock; /* Protect stats */
+	struct vmm_vdisk_stats stats;
 
 	void *priv;
 };
@@ -171,7 +261,11 @@ static inline void *vmm_vdisk_priv(struct vmm_vdisk *vdisk)
 	return (vdisk) ? vdisk->priv: NULL;
 }
 
-/** Submit IO request to virtual disk */
+/** Submit IO request to virtual disk
+ *  NOTE: For DISCARD and WRITE_ZEROES, data can be NULL and data_len
+ *  is the number of bytes to discard or zero.
+ *  NOTE: For FLUSH, lba, data and data_len are ignored.
+ */
 int vmm_vdisk_submit_request(struct vmm_vdisk *vdisk,
 			     struct vmm_vdisk_request *vreq,
 			     enum vmm_vdisk_request_type type,
@@ -184,6 +278,27 @@ int vmm_vdisk_abort_request(struct vmm_vdisk *vdisk,
 /** Flush cached IO from virtual disk */
 int vmm_vdisk_flush_cache(struct vmm_vdisk *vdisk);
 
+/** Check whether virtual disk can do DISCARD requests */
+bool vmm_vdisk_can_discard(struct vmm_vdisk *vdisk);
+
+/** Get QoS configuration of virtual disk */
+int vmm_vdisk_get_qos(struct vmm_vdisk *vdisk, struct vmm_vdisk_qos *qos);
+
+/** Set QoS configuration of virtual disk */
+int vmm_vdisk_set_qos(struct vmm_vdisk *vdisk,
+		      const struct vmm_vdisk_qos *qos);
+
+/** Update QoS configuration of virtual disk from device tree node */
+int vmm_vdisk_set_qos_from_devtree(struct vmm_vdisk *vdisk,
+				   struct vmm_devtree_node *node);
+
+/** Get statistics of virtual disk */
+int vmm_vdisk_get_stats(struct vmm_vdisk *vdisk,
+			struct vmm_vdisk_stats *stats);
+
+/** Reset statistics of virtual disk */
+int vmm_vdisk_reset_stats(struct vmm_vdisk *vdisk);
+
 /** Name of virtual disk */
 static inline const char *vmm_vdisk_name(struct vmm_vdisk *vdisk)
 {
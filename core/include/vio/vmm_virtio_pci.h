@@ -54,9 +54,19 @@
 
 #define VMM_VIRTIO_PCI_REGION_SIZE		(VMM_VIRTIO_PCI_ISR)
 
+/* MSI-X registers: only enabled if MSI-X is enabled. */
+/* A 16-bit vector for configuration changes. */
+#define VMM_VIRTIO_PCI_MSI_CONFIG_VECTOR	20
+/* A 16-bit vector for selected queue notifications. */
+#define VMM_VIRTIO_PCI_QUEUE_VECTOR		22
+
+/* Vector value used to disable MSI for queue */
+#define VMM_VIRTIO_PCI_MSI_NO_VECTOR		0xffff
+
 /* The remaining space is defined by each driver as the per-driver
  * configuration space */
 #define VMM_VIRTIO_PCI_CONFIG			(20)
+#define VMM_VIRTIO_PCI_CONFIG_OFF(msix_enabled)	((msix_enabled) ? 24 : 20)
 
 /* How many bits to shift physical queue address written to QUEUE_PFN.
  * 12 is historical, and due to x86 page size. */
@@ -88,4 +98,54 @@ struct vmm_virtio_pci_config {
 #define VMM_VIRTIO_PCI_O_CONFIG			0
 #define VMM_VIRTIO_PCI_O_MSIX			1
 
+/* Modern (VirtIO 1.0) PCI transport */
+
+/* PCI vendor ID of VirtIO devices */
+#define VMM_VIRTIO_PCI_VENDOR_ID		0x1af4
+
+/* Transitional device IDs are 0x1000 to 0x103f whereas
+ * modern device IDs are 0x1040 plus VirtIO device ID */
+#define VMM_VIRTIO_PCI_LEGACY_DEVICE_ID_MIN	0x1000
+#define VMM_VIRTIO_PCI_LEGACY_DEVICE_ID_MAX	0x103f
+#define VMM_VIRTIO_PCI_MODERN_DEVICE_ID_BASE	0x1040
+
+/* Types of vendor specific capabilities */
+#define VMM_VIRTIO_PCI_CAP_COMMON_CFG		1
+#define VMM_VIRTIO_PCI_CAP_NOTIFY_CFG		2
+#define VMM_VIRTIO_PCI_CAP_ISR_CFG		3
+#define VMM_VIRTIO_PCI_CAP_DEVICE_CFG		4
+#define VMM_VIRTIO_PCI_CAP_PCI_CFG		5
+
+/* Offsets of fields in vendor specific capability */
+#define VMM_VIRTIO_PCI_CAP_VNDR			0
+#define VMM_VIRTIO_PCI_CAP_NEXT			1
+#define VMM_VIRTIO_PCI_CAP_LEN			2
+#define VMM_VIRTIO_PCI_CAP_CFG_TYPE		3
+#define VMM_VIRTIO_PCI_CAP_BAR			4
+#define VMM_VIRTIO_PCI_CAP_OFFSET		8
+#define VMM_VIRTIO_PCI_CAP_LENGTH		12
+#define VMM_VIRTIO_PCI_NOTIFY_CAP_MULT		16
+
+/* Offsets of registers in common configuration structure */
+#define VMM_VIRTIO_PCI_COMMON_DFSELECT		0
+#define VMM_VIRTIO_PCI_COMMON_DF		4
+#define VMM_VIRTIO_PCI_COMMON_GFSELECT		8
+#define VMM_VIRTIO_PCI_COMMON_GF		12
+#define VMM_VIRTIO_PCI_COMMON_MSIX		16
+#define VMM_VIRTIO_PCI_COMMON_NUMQ		18
+#define VMM_VIRTIO_PCI_COMMON_STATUS		20
+#define VMM_VIRTIO_PCI_COMMON_CFGGENERATION	21
+#define VMM_VIRTIO_PCI_COMMON_Q_SELECT		22
+#define VMM_VIRTIO_PCI_COMMON_Q_SIZE		24
+#define VMM_VIRTIO_PCI_COMMON_Q_MSIX		26
+#define VMM_VIRTIO_PCI_COMMON_Q_ENABLE		28
+#define VMM_VIRTIO_PCI_COMMON_Q_NOFF		30
+#define VMM_VIRTIO_PCI_COMMON_Q_DESCLO		32
+#define VMM_VIRTIO_PCI_COMMON_Q_DESCHI		36
+#define VMM_VIRTIO_PCI_COMMON_Q_AVAILLO		40
+#define VMM_VIRTIO_PCI_COMMON_Q_AVAILHI		44
+#define VMM_VIRTIO_PCI_COMMON_Q_USEDLO		48
+#define VMM_VIRTIO_PCI_COMMON_Q_USEDHI		52
+#define VMM_VIRTIO_PCI_COMMON_SIZE		56
+
 #endif /* __VMM_VIRTIO_PCI_H__ */
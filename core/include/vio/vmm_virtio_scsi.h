@@ -0,0 +1,180 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_virtio_scsi.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief VirtIO SCSI Host Interface.
+ *
+ * This header has been derived from linux kernel source:
+ * <linux_source>/include/uapi/linux/virtio_scsi.h
+ *
+ * The original header is BSD licensed.
+ */
+
+/*
+ * This header is BSD licensed so anyone can use the definitions to implement
+ * compatible drivers/servers.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL AUTHOR OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __VMM_VIRTIO_SCSI_H__
+#define __VMM_VIRTIO_SCSI_H__
+
+#include <vmm_types.h>
+
+/* Default values of the CDB and sense data size configuration fields */
+#define VMM_VIRTIO_SCSI_CDB_DEFAULT_SIZE	32
+#define VMM_VIRTIO_SCSI_SENSE_DEFAULT_SIZE	96
+
+/* SCSI command request, followed by CDB and data-out */
+struct vmm_virtio_scsi_cmd_req {
+	u8 lun[8];		/* Logical Unit Number */
+	u64 tag;		/* Command identifier */
+	u8 task_attr;		/* Task attribute */
+	u8 prio;		/* SAM command priority field */
+	u8 crn;
+	u8 cdb[VMM_VIRTIO_SCSI_CDB_DEFAULT_SIZE];
+} __attribute__((packed));
+
+/* Response, followed by sense data and data-in */
+struct vmm_virtio_scsi_cmd_resp {
+	u32 sense_len;		/* Sense data length */
+	u32 resid;		/* Residual bytes in data buffer */
+	u16 status_qualifier;	/* Status qualifier */
+	u8 status;		/* Command completion status */
+	u8 response;		/* Response values */
+	u8 sense[VMM_VIRTIO_SCSI_SENSE_DEFAULT_SIZE];
+} __attribute__((packed));
+
+/* Task Management Request */
+struct vmm_virtio_scsi_ctrl_tmf_req {
+	u32 type;
+	u32 subtype;
+	u8 lun[8];
+	u64 tag;
+} __attribute__((packed));
+
+struct vmm_virtio_scsi_ctrl_tmf_resp {
+	u8 response;
+} __attribute__((packed));
+
+/* Asynchronous notification query/subscription */
+struct vmm_virtio_scsi_ctrl_an_req {
+	u32 type;
+	u8 lun[8];
+	u32 event_requested;
+} __attribute__((packed));
+
+struct vmm_virtio_scsi_ctrl_an_resp {
+	u32 event_actual;
+	u8 response;
+} __attribute__((packed));
+
+struct vmm_virtio_scsi_event {
+	u32 event;
+	u8 lun[8];
+	u32 reason;
+} __attribute__((packed));
+
+struct vmm_virtio_scsi_config {
+	u32 num_queues;
+	u32 seg_max;
+	u32 max_sectors;
+	u32 cmd_per_lun;
+	u32 event_info_size;
+	u32 sense_size;
+	u32 cdb_size;
+	u16 max_channel;
+	u16 max_target;
+	u32 max_lun;
+} __attribute__((packed));
+
+/* Feature Bits */
+#define VMM_VIRTIO_SCSI_F_INOUT			0
+#define VMM_VIRTIO_SCSI_F_HOTPLUG		1
+#define VMM_VIRTIO_SCSI_F_CHANGE		2
+#define VMM_VIRTIO_SCSI_F_T10_PI		3
+
+/* Response codes */
+#define VMM_VIRTIO_SCSI_S_OK			0
+#define VMM_VIRTIO_SCSI_S_OVERRUN		1
+#define VMM_VIRTIO_SCSI_S_ABORTED		2
+#define VMM_VIRTIO_SCSI_S_BAD_TARGET		3
+#define VMM_VIRTIO_SCSI_S_RESET			4
+#define VMM_VIRTIO_SCSI_S_BUSY			5
+#define VMM_VIRTIO_SCSI_S_TRANSPORT_FAILURE	6
+#define VMM_VIRTIO_SCSI_S_TARGET_FAILURE	7
+#define VMM_VIRTIO_SCSI_S_NEXUS_FAILURE		8
+#define VMM_VIRTIO_SCSI_S_FAILURE		9
+#define VMM_VIRTIO_SCSI_S_FUNCTION_SUCCEEDED	10
+#define VMM_VIRTIO_SCSI_S_FUNCTION_REJECTED	11
+#define VMM_VIRTIO_SCSI_S_INCORRECT_LUN		12
+
+/* Controlq type codes */
+#define VMM_VIRTIO_SCSI_T_TMF			0
+#define VMM_VIRTIO_SCSI_T_AN_QUERY		1
+#define VMM_VIRTIO_SCSI_T_AN_SUBSCRIBE		2
+
+/* Valid TMF subtypes */
+#define VMM_VIRTIO_SCSI_T_TMF_ABORT_TASK	0
+#define VMM_VIRTIO_SCSI_T_TMF_ABORT_TASK_SET	1
+#define VMM_VIRTIO_SCSI_T_TMF_CLEAR_ACA		2
+#define VMM_VIRTIO_SCSI_T_TMF_CLEAR_TASK_SET	3
+#define VMM_VIRTIO_SCSI_T_TMF_I_T_NEXUS_RESET	4
+#define VMM_VIRTIO_SCSI_T_TMF_LOGICAL_UNIT_RESET 5
+#define VMM_VIRTIO_SCSI_T_TMF_QUERY_TASK	6
+#define VMM_VIRTIO_SCSI_T_TMF_QUERY_TASK_SET	7
+
+/* Events */
+#define VMM_VIRTIO_SCSI_T_EVENTS_MISSED		0x80000000
+#define VMM_VIRTIO_SCSI_T_NO_EVENT		0
+#define VMM_VIRTIO_SCSI_T_TRANSPORT_RESET	1
+#define VMM_VIRTIO_SCSI_T_ASYNC_NOTIFY		2
+#define VMM_VIRTIO_SCSI_T_PARAM_CHANGE		3
+
+/* Reasons of transport reset event */
+#define VMM_VIRTIO_SCSI_EVT_RESET_HARD		0
+#define VMM_VIRTIO_SCSI_EVT_RESET_RESCAN	1
+#define VMM_VIRTIO_SCSI_EVT_RESET_REMOVED	2
+
+#define VMM_VIRTIO_SCSI_S_SIMPLE		0
+#define VMM_VIRTIO_SCSI_S_ORDERED		1
+#define VMM_VIRTIO_SCSI_S_HEAD			2
+#define VMM_VIRTIO_SCSI_S_ACA			3
+
+#endif /* __VMM_VIRTIO_SCSI_H__ */
@@ -153,6 +153,12 @@ struct vmm_devemu_irqchip {
 	void (*notify_disabled) (u32 irq, int cpu, void *opaque);
 };
 
+struct vmm_devemu_msichip {
+	const char *name;
+	void (*handle) (physical_addr_t addr, u32 data,
+			u32 devid, void *opaque);
+};
+
 /** Emulate memory read to virtual device for given VCPU */
 int vmm_devemu_emulate_read(struct vmm_vcpu *vcpu,
 			    physical_addr_t gphys_addr,
@@ -240,6 +246,26 @@ int vmm_devemu_unregister_irqchip(struct vmm_guest *guest, u32 irq,
 				  struct vmm_devemu_irqchip *chip,
 				  void *opaque);
 
+/** Emulate message signaled interrupt (MSI) write for guest
+ *  Note: The MSI write is delivered to MSI chip owning given address
+ *  and if there is none then it is emulated as a 32-bit little-endian
+ *  write to virtual device region containing given address.
+ *  Note: devid is the requester ID of device (e.g. PCI BDF)
+ */
+int vmm_devemu_emulate_msi(struct vmm_guest *guest,
+			   physical_addr_t addr, u32 data, u32 devid);
+
+/** Register guest MSI chip for given address range */
+int vmm_devemu_register_msichip(struct vmm_guest *guest,
+				physical_addr_t addr, physical_size_t size,
+				struct vmm_devemu_msichip *chip,
+				void *opaque);
+
+/** Unregister guest MSI chip */
+int vmm_devemu_unregister_msichip(struct vmm_guest *guest,
+				  struct vmm_devemu_msichip *chip,
+				  void *opaque);
+
 /** Count available irqs of a guest */
 u32 vmm_devemu_count_irqs(struct vmm_guest *guest);
 
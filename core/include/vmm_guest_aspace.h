@@ -32,6 +32,10 @@
 #define VMM_GUEST_ASPACE_EVENT_DEINIT		0x02
 /* Notifier event when guest aspace is reset */
 #define VMM_GUEST_ASPACE_EVENT_RESET		0x03
+/* Notifier event when a dynamic region is removed from guest aspace
+ * but not yet freed (event data points to the region)
+ */
+#define VMM_GUEST_ASPACE_EVENT_DEL_REGION	0x04
 
 /** Representation of block device notifier event */
 struct vmm_guest_aspace_event {
@@ -54,6 +58,10 @@ void vmm_guest_iterate_region(struct vmm_guest *guest, u32 reg_flags,
 
 /** Find region corresponding to a guest physical address and also
  *  resolve aliased regions to real or virtual regions if required.
+ *  Note: A dynamic region can be deleted at any time so the returned
+ *  region must only be used within RCU read-side critical section of
+ *  caller (VCPU trap handlers are implicitly one). Region deletion
+ *  waits for such sections before tearing down the region.
  */
 struct vmm_region *vmm_guest_find_region(struct vmm_guest *guest,
 					 physical_addr_t gphys_addr,
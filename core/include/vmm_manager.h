@@ -32,6 +32,7 @@
 #include <vmm_devtree.h>
 #include <vmm_cpumask.h>
 #include <vmm_shmem.h>
+#include <vmm_rcu.h>
 #include <libs/list.h>
 #include <libs/rbtree.h>
 
@@ -92,6 +93,7 @@ struct vmm_region {
 	struct vmm_region_mapping *maps;
 	void *devemu_priv;
 	void *priv;
+	struct vmm_rcu_head rcu;
 };
 
 #define VMM_REGION_NAME(reg)		((reg)->node->name)
@@ -110,9 +112,11 @@ struct vmm_guest_aspace {
 	struct vmm_guest *guest;
 	bool initialized;
 	vmm_rwlock_t reg_iotree_lock;
+	u32 reg_iotree_seq;
 	struct rb_root reg_iotree;
 	struct dlist reg_ioprobe_list;
 	vmm_rwlock_t reg_memtree_lock;
+	u32 reg_memtree_seq;
 	struct rb_root reg_memtree;
 	struct dlist reg_memprobe_list;
 	void *devemu_priv;
@@ -132,6 +136,7 @@ struct vmm_vcpu_irq {
 struct vmm_vcpu_irqs {
 	u32 irq_count;
 	struct vmm_vcpu_irq *irq;
+	unsigned long *assert_map;
 	atomic_t execute_pending;
 	atomic64_t assert_count;
 	atomic64_t execute_count;
@@ -142,6 +147,10 @@ struct vmm_vcpu_irqs {
 		u32 yield_count;
 		bool state;
 		void *priv;
+		u64 halt_tstamp;
+		u64 poll_ns;
+		u64 poll_success;
+		u64 poll_wasted;
 	} wfi;
 };
 
@@ -198,6 +207,8 @@ enum vmm_vcpu_states {
 #define VMM_VCPU_DEF_DEADLINE		(VMM_VCPU_DEF_TIME_SLICE * 10)
 #define VMM_VCPU_DEF_PERIODICITY	(VMM_VCPU_DEF_DEADLINE * 10)
 
+struct vmm_vcpu_exit_stats;
+
 struct vmm_vcpu_resource {
 	struct dlist head;
 	const char *name;
@@ -236,10 +247,12 @@ struct vmm_vcpu {
 	u64 reset_tstamp;
 	u32 preempt_count;
 	bool resumed;
+	bool preempted;
 	void *sched_priv;
 
 	/* Scheduler static context */
 	u8 priority;
+	u8 base_priority;
 	u64 time_slice;
 	u64 deadline;
 	u64 periodicity;
@@ -251,6 +264,9 @@ struct vmm_vcpu {
 	/* Virtual IRQ context */
 	struct vmm_vcpu_irqs irqs;
 
+	/* Exit accounting context */
+	struct vmm_vcpu_exit_stats *exit_stats;
+
 	/* Resources acquired */
 	vmm_spinlock_t res_lock;
 	struct dlist res_head;
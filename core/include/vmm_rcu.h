@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_rcu.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief Header file for read-copy-update (RCU) synchronization.
+ *
+ * RCU readers run with pre-emption disabled and never take locks so
+ * they can look-up read-mostly data structures concurrently with a
+ * writer. A host CPU passes through a quiescent state whenever the
+ * scheduler is allowed to switch VCPUs on it, hence a grace period
+ * ends once every online host CPU has been through the scheduler
+ * after the grace period started.
+ */
+
+#ifndef __VMM_RCU_H__
+#define __VMM_RCU_H__
+
+#include <vmm_types.h>
+#include <arch_barrier.h>
+#include <libs/list.h>
+
+struct vmm_rcu_head {
+	struct dlist head;
+	void (*func)(struct vmm_rcu_head *);
+};
+
+#define INIT_RCU_HEAD(r)	do { \
+				INIT_LIST_HEAD(&(r)->head); \
+				(r)->func = NULL; \
+				} while (0)
+
+/** Mark start of RCU read-side critical section
+ *  Note: RCU read-side critical sections must not sleep.
+ */
+void vmm_rcu_read_lock(void);
+
+/** Mark end of RCU read-side critical section */
+void vmm_rcu_read_unlock(void);
+
+/** Fetch RCU protected pointer for dereferencing */
+#define vmm_rcu_dereference(p)	(*(volatile typeof(p) *)&(p))
+
+/** Publish new value of RCU protected pointer */
+#define vmm_rcu_assign_pointer(p, v)	do { \
+					arch_smp_wmb(); \
+					*(volatile typeof(p) *)&(p) = (v); \
+					} while (0)
+
+/** Note quiescent state of current host CPU
+ *  (Do not call this function directly.)
+ *  (Only called by scheduler when switching VCPUs is allowed.)
+ */
+void vmm_rcu_note_qs(void);
+
+/** Wait for all pre-existing RCU read-side critical sections
+ *  Note: This function can only be called from Orphan (or Thread) context
+ */
+void vmm_rcu_synchronize(void);
+
+/** Invoke callback after all pre-existing RCU read-side
+ *  critical sections have completed.
+ *  Note: Callback is invoked from RCU workqueue (Orphan context)
+ */
+void vmm_rcu_call(struct vmm_rcu_head *rhead,
+		  void (*func)(struct vmm_rcu_head *));
+
+/** Wait for all pending RCU callbacks to finish
+ *  Note: This function can only be called from Orphan (or Thread) context
+ */
+void vmm_rcu_barrier(void);
+
+/** Initialize RCU subsystem */
+int vmm_rcu_init(void);
+
+#endif /* __VMM_RCU_H__ */
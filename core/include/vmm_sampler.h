@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_sampler.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief header file of hypervisor sampling profiler
+ *
+ * The sampling profiler periodically samples the interrupted context
+ * on each host CPU from a per-CPU timer event. Samples of hypervisor
+ * context are aggregated per symbol (optionally along with callers
+ * found by walking frame pointers) in per-CPU hash tables whereas
+ * samples of guest context are only counted per VCPU.
+ *
+ * Other sample sources (such as PMU overflow interrupt handlers) can
+ * feed samples using vmm_sampler_sample() while the profiler is active.
+ */
+
+#ifndef _VMM_SAMPLER_H__
+#define _VMM_SAMPLER_H__
+
+#include <vmm_types.h>
+#include <arch_regs.h>
+
+/** Maximum frames (including interrupted PC) sampled per sample */
+#define VMM_SAMPLER_MAX_DEPTH		16
+
+/** Minimum sampling period in nanoseconds */
+#define VMM_SAMPLER_MIN_PERIOD_NSECS	10000ULL
+
+/** Symbol key for samples outside hypervisor code */
+#define VMM_SAMPLER_SYM_UNKNOWN		0xffffffff
+
+struct vmm_sampler_entry {
+	/* Symbol position in kallsyms plus one (zero means free) */
+	u32 sym;
+	/* Samples where symbol was the interrupted function */
+	u32 self;
+	/* Samples where symbol was anywhere in sampled call chain */
+	u32 total;
+};
+
+struct vmm_sampler_stats {
+	/* All samples taken */
+	u64 samples;
+	/* Samples of Normal VCPUs running in guest mode */
+	u64 guest;
+	/* Samples of hypervisor working on behalf of Normal VCPUs */
+	u64 hyp_vcpu;
+	/* Samples of hypervisor threads, idle and other Orphan VCPUs */
+	u64 hyp_orphan;
+	/* Samples without interrupted registers */
+	u64 no_regs;
+	/* Samples not accounted due to full hash table */
+	u64 dropped;
+};
+
+/** Record one sample of given interrupted context on current host CPU
+ *  Note: must be called with interrupts disabled
+ */
+void vmm_sampler_sample(arch_regs_t *regs);
+
+/** Check whether sampling profiler is running */
+bool vmm_sampler_isactive(void);
+
+/** Sampling period in nanoseconds */
+u64 vmm_sampler_period(void);
+
+/** Maximum frames sampled per sample */
+u32 vmm_sampler_depth(void);
+
+/** Clear samples and start sampling profiler on all online host CPUs */
+int vmm_sampler_start(u64 period_nsecs, u32 depth);
+
+/** Stop sampling profiler on all online host CPUs */
+int vmm_sampler_stop(void);
+
+/** Retrieve sample statistics of a host CPU */
+int vmm_sampler_get_stats(u32 cpu, struct vmm_sampler_stats *st);
+
+/** Number of guest samples of a Normal VCPU across all host CPUs */
+u64 vmm_sampler_vcpu_samples(u32 vcpu_id);
+
+/** Merge per-CPU symbol tables into newly allocated array
+ *  Note: caller has to free the array using vmm_free()
+ */
+int vmm_sampler_snapshot(struct vmm_sampler_entry **entries, u32 *count);
+
+/** Name of symbol of an entry
+ *  Note: buf must have space for KSYM_NAME_LEN characters
+ */
+const char *vmm_sampler_entry_name(struct vmm_sampler_entry *e, char *buf);
+
+#endif
@@ -43,6 +43,9 @@ int vmm_schedalgo_rq_dequeue(void *rq,
 /** Detach VCPU from its ready queue */
 int vmm_schedalgo_rq_detach(void *rq, struct vmm_vcpu *vcpu);
 
+/** Move enqueued VCPU ahead of other READY VCPUs of same priority */
+int vmm_schedalgo_rq_boost(void *rq, struct vmm_vcpu *vcpu);
+
 /** Check if current VCPU is required to be prempted based on current 
  *  ready queue state
  */
@@ -61,6 +61,12 @@ bool vmm_scheduler_check_current_hcpu(struct vmm_vcpu *vcpu);
 /** Update host CPU assigned to given VCPU */
 int vmm_scheduler_set_hcpu(struct vmm_vcpu *vcpu, u32 hcpu);
 
+/** Change current priority of given VCPU
+ *  Note: A READY VCPU is re-queued as per new priority on its host CPU
+ *  Note: Used by priority inheritance hence base priority is unchanged
+ */
+int vmm_scheduler_set_priority(struct vmm_vcpu *vcpu, u8 priority);
+
 /** Enter IRQ Context (Must be called from somewhere) */
 void vmm_scheduler_irq_enter(arch_regs_t *regs, bool vcpu_context);
 
@@ -109,6 +115,17 @@ struct vmm_guest *vmm_scheduler_current_guest(void);
 /** Yield current vcpu (Should not be called in IRQ context) */
 void vmm_scheduler_yield(void);
 
+/** Boost given READY vcpu and yield current vcpu
+ *  (Should not be called in IRQ context)
+ */
+int vmm_scheduler_yield_to(struct vmm_vcpu *vcpu);
+
+/** Directed yield from current vcpu spinning on a lock to a preempted
+ *  sibling vcpu of same guest. Falls back to plain yield when no such
+ *  sibling vcpu is found. (Should not be called in IRQ context)
+ */
+int vmm_scheduler_yield_to_preempted(void);
+
 /** Initialize scheduler */
 int vmm_scheduler_init(void);
 
@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_trace.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief header file for hypervisor event tracing
+ *
+ * Tracepoints are placed at fixed locations in hypervisor code using
+ * vmm_trace(). Each host CPU records events into its own ring buffer
+ * of fixed-size binary records without taking any lock. A tracepoint
+ * whose event is not set in the runtime enable mask only costs a load
+ * and a test of the mask. Without CONFIG_TRACE tracepoints compile
+ * to nothing.
+ */
+#ifndef _VMM_TRACE_H__
+#define _VMM_TRACE_H__
+
+#include <vmm_types.h>
+#include <vmm_compiler.h>
+
+struct vmm_chardev;
+
+/** Trace events
+ *  Note: values are part of binary trace format so only append
+ */
+enum vmm_trace_events {
+	/* arg0 = next VCPU id, arg1 = previous VCPU id, arg2 = time slice */
+	VMM_TRACE_SCHED_SWITCH = 0,
+	/* arg0 = VCPU id, arg1 = irq number, arg2 = reason */
+	VMM_TRACE_VCPU_IRQ_ASSERT = 1,
+	/* arg0 = VCPU id, arg1 = irq number, arg2 = 0 */
+	VMM_TRACE_VCPU_IRQ_DEASSERT = 2,
+	/* arg0 = access length (bit8 set for IO port),
+	 * arg1 = guest physical address, arg2 = data
+	 */
+	VMM_TRACE_DEVEMU_READ = 3,
+	VMM_TRACE_DEVEMU_WRITE = 4,
+	/* arg0 = guest id, arg1 = queue number, arg2 = VirtIO device type */
+	VMM_TRACE_VIRTIO_KICK = 5,
+	VMM_TRACE_VIRTIO_NOTIFY = 6,
+	/* arg0 = 0, arg1 = handler address, arg2 = expiry lateness (ns) */
+	VMM_TRACE_TIMER_EXPIRY = 7,
+	/* arg0 = target CPU, arg1 = function address, arg2 = 1 for sync */
+	VMM_TRACE_IPI_SEND = 8,
+	/* arg0 = source CPU, arg1 = function address, arg2 = 1 for sync */
+	VMM_TRACE_IPI_RECV = 9,
+	/* arg0 = 0, arg1 = host irq number, arg2 = 0 */
+	VMM_TRACE_HIRQ_ENTRY = 10,
+	VMM_TRACE_HIRQ_EXIT = 11,
+	VMM_TRACE_MAX_EVENTS
+};
+
+#define VMM_TRACE_EVENT_MASK(ev)	(1U << (ev))
+#define VMM_TRACE_ALL_EVENTS		\
+			(VMM_TRACE_EVENT_MASK(VMM_TRACE_MAX_EVENTS) - 1)
+
+/** Binary trace record (32 bytes)
+ *  Note: seq is zero while the record is being written and otherwise
+ *  holds the lower 32 bits of (record index + 1).
+ */
+struct vmm_trace_record {
+	u64 tstamp;
+	u32 seq;
+	u16 event;
+	u16 arg0;
+	u64 arg1;
+	u64 arg2;
+} __packed;
+
+/** Binary trace file header, followed by per-CPU chunks */
+#define VMM_TRACE_FILE_MAGIC		"XVTRACE"
+#define VMM_TRACE_FILE_VERSION		1
+
+struct vmm_trace_file_header {
+	char magic[8];
+	u32 version;
+	u32 record_size;
+	u32 cpu_count;
+	u32 event_mask;
+} __packed;
+
+/** Header of per-CPU chunk, followed by nr_records records */
+struct vmm_trace_file_chunk {
+	u32 cpu;
+	u32 nr_records;
+	u64 lost;
+} __packed;
+
+#ifdef CONFIG_TRACE
+
+/** Runtime mask of enabled trace events (do not update directly) */
+extern u32 vmm_trace_mask;
+
+/** Record a trace event on current host CPU */
+void __vmm_trace(u32 event, u32 arg0, u64 arg1, u64 arg2);
+
+#define vmm_trace_enabled(ev)	\
+	unlikely(vmm_trace_mask & VMM_TRACE_EVENT_MASK(ev))
+
+#define vmm_trace(ev, a0, a1, a2)					\
+do {									\
+	if (vmm_trace_enabled(ev)) {					\
+		__vmm_trace((ev), (u32)(a0), (u64)(a1), (u64)(a2));	\
+	}								\
+} while (0)
+
+#else
+
+#define vmm_trace_enabled(ev)		0
+#define vmm_trace(ev, a0, a1, a2)	do { } while (0)
+
+#endif
+
+/** Name of a trace event */
+const char *vmm_trace_event_name(u32 event);
+
+/** Find trace event by name
+ *  Note: returns VMM_TRACE_MAX_EVENTS if not found
+ */
+u32 vmm_trace_event_find(const char *name);
+
+/** Current mask of enabled trace events */
+u32 vmm_trace_get_mask(void);
+
+/** Update mask of enabled trace events
+ *  Note: trace buffers are allocated when first event is enabled
+ */
+int vmm_trace_set_mask(u32 mask);
+
+/** Number of records in trace buffer of a host CPU */
+u32 vmm_trace_buffer_entries(void);
+
+/** Number of records written and lost since last clear */
+void vmm_trace_cpu_stats(u32 cpu, u64 *written, u64 *lost);
+
+/** Discard all records of all host CPUs */
+void vmm_trace_clear(void);
+
+/** Iterate over consistent records of a host CPU, oldest first
+ *  Note: records overwritten during iteration are skipped and the
+ *  iteration stops early when fn() returns non-zero.
+ */
+int vmm_trace_iterate(u32 cpu,
+		      int (*fn)(u32 cpu, struct vmm_trace_record *rec,
+				void *priv),
+		      void *priv);
+
+/** Print all records of all host CPUs in text form */
+void vmm_trace_dump(struct vmm_chardev *cdev);
+
+#endif
@@ -57,6 +57,16 @@ int vmm_vcpu_irq_wait_timeout(struct vmm_vcpu *vcpu, u64 nsecs);
 /** Current state of Wait for irq on given vcpu */
 bool vmm_vcpu_irq_wait_state(struct vmm_vcpu *vcpu);
 
+/** Busy wait on current host CPU while a vcpu halted on it is
+ *  expected to be woken-up soon.
+ *  Note: Called by idle vcpu with interrupts enabled.
+ */
+void vmm_vcpu_irq_halt_poll(void);
+
+/** Retrive halt polling statistics of given vcpu */
+int vmm_vcpu_irq_poll_stats(struct vmm_vcpu *vcpu, u64 *poll_ns,
+			    u64 *poll_success, u64 *poll_wasted);
+
 /** Initialize interrupts for given vcpu */
 int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu);
 
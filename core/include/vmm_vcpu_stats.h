@@ -0,0 +1,151 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_vcpu_stats.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief header file for per-VCPU exit accounting
+ *
+ * Architecture trap handlers bracket the handling of each guest exit
+ * with vmm_vcpu_exit_begin() and vmm_vcpu_exit_end(). Generic code
+ * deeper in the exit path (such as device emulation) may refine the
+ * reason of the current exit using vmm_vcpu_exit_set_reason() or
+ * vmm_vcpu_exit_note_emulator().
+ */
+#ifndef _VMM_VCPU_STATS_H__
+#define _VMM_VCPU_STATS_H__
+
+#include <vmm_types.h>
+#include <vmm_timer.h>
+#include <vmm_manager.h>
+
+struct vmm_chardev;
+struct vmm_emulator;
+
+enum vmm_vcpu_exit_reasons {
+	VMM_VCPU_EXIT_UNKNOWN = 0,
+	VMM_VCPU_EXIT_MMIO,
+	VMM_VCPU_EXIT_IOPORT,
+	VMM_VCPU_EXIT_STAGE2_FAULT,
+	VMM_VCPU_EXIT_WFI,
+	VMM_VCPU_EXIT_HYPERCALL,
+	VMM_VCPU_EXIT_SYSREG,
+	VMM_VCPU_EXIT_INSN,
+	VMM_VCPU_EXIT_IRQ,
+	VMM_VCPU_EXIT_MAX
+};
+
+/** Number of log2(nanoseconds) histogram buckets */
+#define VMM_VCPU_EXIT_HIST_BUCKETS	32
+
+/** Number of emulators tracked separately for MMIO/IO port exits */
+#define VMM_VCPU_EXIT_MAX_EMULATORS	16
+
+struct vmm_vcpu_exit_stat {
+	u64 count;
+	u64 total_nsecs;
+	u64 max_nsecs;
+	u32 hist[VMM_VCPU_EXIT_HIST_BUCKETS];
+};
+
+struct vmm_vcpu_exit_emu_stat {
+	struct vmm_emulator *emu;
+	u64 count;
+	u64 total_nsecs;
+};
+
+struct vmm_vcpu_exit_stats {
+	/* Context of exit being handled */
+	u64 tstamp;
+	u32 reason;
+	struct vmm_emulator *emu;
+
+	/* Accumulated statistics */
+	u64 reset_tstamp;
+	struct vmm_vcpu_exit_stat exits[VMM_VCPU_EXIT_MAX];
+	struct vmm_vcpu_exit_emu_stat emus[VMM_VCPU_EXIT_MAX_EMULATORS];
+	struct vmm_vcpu_exit_emu_stat other_emus;
+};
+
+#ifdef CONFIG_VCPU_EXIT_STATS
+
+/** Mark start of guest exit handling on current VCPU */
+static inline void vmm_vcpu_exit_begin(struct vmm_vcpu *vcpu)
+{
+	struct vmm_vcpu_exit_stats *s = (vcpu) ? vcpu->exit_stats : NULL;
+
+	if (s) {
+		s->tstamp = vmm_timer_timestamp();
+		s->reason = VMM_VCPU_EXIT_UNKNOWN;
+		s->emu = NULL;
+	}
+}
+
+/** Override reason of guest exit being handled */
+static inline void vmm_vcpu_exit_set_reason(struct vmm_vcpu *vcpu,
+					    u32 reason)
+{
+	if (vcpu && vcpu->exit_stats) {
+		vcpu->exit_stats->reason = reason;
+	}
+}
+
+/** Note emulator which handled the MMIO/IO port exit being handled */
+static inline void vmm_vcpu_exit_note_emulator(struct vmm_vcpu *vcpu,
+					       u32 reason,
+					       struct vmm_emulator *emu)
+{
+	if (vcpu && vcpu->exit_stats) {
+		vcpu->exit_stats->reason = reason;
+		vcpu->exit_stats->emu = emu;
+	}
+}
+
+/** Mark end of guest exit handling on current VCPU
+ *  Note: reason is used only if nobody refined it in-between
+ */
+void vmm_vcpu_exit_end(struct vmm_vcpu *vcpu, u32 reason);
+
+#else
+
+static inline void vmm_vcpu_exit_begin(struct vmm_vcpu *vcpu) {}
+static inline void vmm_vcpu_exit_set_reason(struct vmm_vcpu *vcpu,
+					    u32 reason) {}
+static inline void vmm_vcpu_exit_note_emulator(struct vmm_vcpu *vcpu,
+					       u32 reason,
+					       struct vmm_emulator *emu) {}
+static inline void vmm_vcpu_exit_end(struct vmm_vcpu *vcpu, u32 reason) {}
+
+#endif
+
+/** Name of a exit reason */
+const char *vmm_vcpu_exit_reason_name(u32 reason);
+
+/** Reset exit statistics of given VCPU */
+int vmm_vcpu_exit_stats_reset(struct vmm_vcpu *vcpu);
+
+/** Print exit statistics of given VCPU */
+int vmm_vcpu_exit_stats_dump(struct vmm_chardev *cdev,
+			     struct vmm_vcpu *vcpu);
+
+/** Initialize exit statistics for given VCPU */
+void vmm_vcpu_exit_stats_init(struct vmm_vcpu *vcpu);
+
+/** Deinitialize exit statistics for given VCPU */
+void vmm_vcpu_exit_stats_deinit(struct vmm_vcpu *vcpu);
+
+#endif
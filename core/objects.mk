@@ -52,6 +52,7 @@ core-objs-y+= vmm_timer.o
 core-objs-y+= vmm_delay.o
 core-objs-y+= vmm_shmem.o
 core-objs-y+= vmm_vcpu_irq.o
+core-objs-y+= vmm_vcpu_stats.o
 core-objs-y+= vmm_guest_aspace.o
 core-objs-y+= vmm_manager.o
 core-objs-y+= vmm_scheduler.o
@@ -62,6 +63,7 @@ core-objs-y+= vmm_semaphore.o
 core-objs-y+= vmm_mutex.o
 core-objs-y+= vmm_notifier.o
 core-objs-y+= vmm_workqueue.o
+core-objs-y+= vmm_rcu.o
 core-objs-y+= vmm_cmdmgr.o
 core-objs-y+= vmm_wallclock.o
 core-objs-y+= vmm_iommu.o
@@ -69,5 +71,7 @@ core-objs-y+= vmm_chardev.o
 core-objs-y+= vmm_modules.o
 core-objs-y+= vmm_params.o
 core-objs-$(CONFIG_PROFILE)+= vmm_profiler.o
+core-objs-$(CONFIG_PROFILE_SAMPLING)+= vmm_sampler.o
 core-objs-$(CONFIG_LOADBAL)+= vmm_loadbal.o
+core-objs-$(CONFIG_TRACE)+= vmm_trace.o
 core-objs-y+= vmm_extable.o
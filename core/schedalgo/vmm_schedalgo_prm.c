@@ -187,6 +187,12 @@ int vmm_schedalgo_rq_detach(void *rq, struct vmm_vcpu *vcpu)
 	return VMM_OK;
 }
 
+int vmm_schedalgo_rq_boost(void *rq, struct vmm_vcpu *vcpu)
+{
+	/* Ready queue order is fixed by VCPU periodicity */
+	return VMM_ENOTSUPP;
+}
+
 bool vmm_schedalgo_rq_prempt_needed(void *rq, struct vmm_vcpu *current)
 {
 	int p;
@@ -169,6 +169,31 @@ int vmm_schedalgo_rq_detach(void *rq, struct vmm_vcpu *vcpu)
 	return VMM_OK;
 }
 
+int vmm_schedalgo_rq_boost(void *rq, struct vmm_vcpu *vcpu)
+{
+	struct vmm_schedalgo_rq_entry *rq_entry;
+	struct vmm_schedalgo_rq *rqi;
+
+	if (!rq || !vcpu) {
+		return VMM_EFAIL;
+	}
+
+	rqi = rq;
+	rq_entry = vcpu->sched_priv;
+
+	if (!rq_entry) {
+		return VMM_EFAIL;
+	}
+
+	if (list_empty(&rq_entry->head)) {
+		return VMM_ENOTAVAIL;
+	}
+
+	list_move(&rq_entry->head, &rqi->list[vcpu->priority]);
+
+	return VMM_OK;
+}
+
 bool vmm_schedalgo_rq_prempt_needed(void *rq, struct vmm_vcpu *current)
 {
 	int p;
@@ -26,6 +26,8 @@
 #include <vmm_heap.h>
 #include <vmm_mutex.h>
 #include <vmm_stdio.h>
+#include <vmm_timer.h>
+#include <vmm_workqueue.h>
 #include <vmm_modules.h>
 #include <vio/vmm_vdisk.h>
 #include <libs/stringlib.h>
@@ -46,9 +48,46 @@
 #define	MODULE_INIT			vmm_vdisk_init
 #define	MODULE_EXIT			vmm_vdisk_exit
 
+/* Flags of virtual disk request */
+#define VDISK_REQ_QUEUED		0x1
+#define VDISK_REQ_INFLIGHT		0x2
+#define VDISK_REQ_THROTTLED		0x4
+
+/* Token buckets of each direction */
+#define VDISK_QOS_IOPS			0
+#define VDISK_QOS_BPS			1
+#define VDISK_QOS_MAX_BUCKET		2
+
+/* Token bucket level is in units of (operations or bytes) x usecs */
+#define VDISK_QOS_SCALE			1000000ULL
+
+/* Fair queuing cost of a request in addition to its length so that
+ * small requests from one virtual disk cannot starve the others.
+ */
+#define VDISK_QOS_REQ_COST		4096
+
+/** Virtual disks sharing request queue of a block device */
+struct vmm_vdisk_group {
+	struct dlist head;
+	struct vmm_request_queue *rq;
+
+	vmm_spinlock_t lock;
+	u32 member_count;
+	u32 depth;
+	u32 inflight;
+	u32 queued;
+	u64 vtime;
+	struct dlist active_list;
+
+	struct vmm_timer_event ev;
+	struct vmm_work work;
+};
+
 struct vmm_vdisk_ctrl {
 	struct vmm_mutex vdisk_list_lock;
         struct dlist vdisk_list;
+	struct vmm_mutex group_list_lock;
+	struct dlist group_list;
 	struct vmm_blocking_notifier_chain notifier_chain;
 	struct vmm_notifier_block blk_client;
 };
@@ -67,12 +106,445 @@ int vmm_vdisk_unregister_client(struct vmm_notifier_block *nb)
 }
 VMM_EXPORT_SYMBOL(vmm_vdisk_unregister_client);
 
+/* All requests other than reads are accounted as writes */
+static inline u32 vdisk_req_dir(struct vmm_vdisk_request *vreq)
+{
+	return (vreq->r.type == VMM_REQUEST_READ) ?
+			VMM_VDISK_QOS_READ : VMM_VDISK_QOS_WRITE;
+}
+
+static void vdisk_qos_bucket(struct vmm_vdisk *vdisk, u32 dir, u32 b,
+			     u64 *rate, u64 *cap)
+{
+	u64 burst;
+	struct vmm_vdisk_qos_limit *l = &vdisk->qos.limit[dir];
+
+	if (b == VDISK_QOS_IOPS) {
+		*rate = l->iops;
+		burst = l->iops_burst;
+	} else {
+		*rate = l->bps;
+		burst = l->bps_burst;
+	}
+
+	*cap = (burst) ? burst * VDISK_QOS_SCALE :
+			 (*rate) * udiv64(VDISK_QOS_SCALE, 10);
+}
+
+static void vdisk_qos_reset(struct vmm_vdisk *vdisk)
+{
+	u32 d, b;
+	u64 rate, cap;
+
+	for (d = 0; d < VMM_VDISK_QOS_MAX_DIR; d++) {
+		for (b = 0; b < VDISK_QOS_MAX_BUCKET; b++) {
+			vdisk_qos_bucket(vdisk, d, b, &rate, &cap);
+			vdisk->qos_level[d][b] = cap;
+		}
+	}
+	vdisk->qos_tstamp = vmm_timer_timestamp();
+}
+
+static void vdisk_qos_refill(struct vmm_vdisk *vdisk, u64 now)
+{
+	u32 d, b;
+	s64 *level;
+	u64 rate, cap, need, delta_us;
+
+	if (now <= vdisk->qos_tstamp) {
+		return;
+	}
+	delta_us = udiv64(now - vdisk->qos_tstamp, 1000);
+	if (!delta_us) {
+		return;
+	}
+	vdisk->qos_tstamp += delta_us * 1000;
+
+	for (d = 0; d < VMM_VDISK_QOS_MAX_DIR; d++) {
+		for (b = 0; b < VDISK_QOS_MAX_BUCKET; b++) {
+			vdisk_qos_bucket(vdisk, d, b, &rate, &cap);
+			if (!rate) {
+				continue;
+			}
+			level = &vdisk->qos_level[d][b];
+			if ((s64)cap <= *level) {
+				*level = cap;
+				continue;
+			}
+			need = (u64)((s64)cap - *level);
+			if (udiv64(need, rate) < delta_us) {
+				*level = cap;
+			} else {
+				*level += rate * delta_us;
+				if ((s64)cap < *level) {
+					*level = cap;
+				}
+			}
+		}
+	}
+}
+
+/* Nanoseconds to wait before next request in given direction */
+static u64 vdisk_qos_wait(struct vmm_vdisk *vdisk, u32 dir)
+{
+	u32 b;
+	u64 rate, cap, wait_us, ret = 0;
+
+	for (b = 0; b < VDISK_QOS_MAX_BUCKET; b++) {
+		vdisk_qos_bucket(vdisk, dir, b, &rate, &cap);
+		if (!rate || (0 <= vdisk->qos_level[dir][b])) {
+			continue;
+		}
+		wait_us = udiv64((u64)(-vdisk->qos_level[dir][b]) + rate - 1,
+				 rate);
+		if (ret < (wait_us * 1000)) {
+			ret = wait_us * 1000;
+		}
+	}
+
+	return ret;
+}
+
+static void vdisk_stats_queued(struct vmm_vdisk *vdisk, bool inc)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave_lite(&vdisk->stats_lock, flags);
+	if (inc) {
+		vdisk->stats.queued++;
+	} else if (vdisk->stats.queued) {
+		vdisk->stats.queued--;
+	}
+	vmm_spin_unlock_irqrestore_lite(&vdisk->stats_lock, flags);
+}
+
+static void vdisk_stats_failed(struct vmm_vdisk *vdisk, u32 dir)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave_lite(&vdisk->stats_lock, flags);
+	vdisk->stats.errors[dir]++;
+	vmm_spin_unlock_irqrestore_lite(&vdisk->stats_lock, flags);
+}
+
+/* Note: Must be called with group lock held */
+static void vdisk_qos_start(struct vmm_vdisk_group *grp,
+			    struct vmm_vdisk *vdisk,
+			    struct vmm_vdisk_request *vreq, bool queued)
+{
+	irq_flags_t flags;
+	u32 dir = vdisk_req_dir(vreq);
+
+	if (vdisk->qos.limit[dir].iops) {
+		vdisk->qos_level[dir][VDISK_QOS_IOPS] -= VDISK_QOS_SCALE;
+	}
+	if (vdisk->qos.limit[dir].bps) {
+		vdisk->qos_level[dir][VDISK_QOS_BPS] -=
+					(s64)vreq->len * VDISK_QOS_SCALE;
+	}
+
+	grp->vtime = vdisk->qos_vtime;
+	vdisk->qos_vtime += udiv64((u64)(vreq->len + VDISK_QOS_REQ_COST) *
+				   VMM_VDISK_QOS_DEF_WEIGHT,
+				   vdisk->qos.weight);
+	grp->inflight++;
+
+	vmm_spin_lock_irqsave_lite(&vdisk->stats_lock, flags);
+	if (queued && vdisk->stats.queued) {
+		vdisk->stats.queued--;
+	}
+	if (vreq->flags & VDISK_REQ_THROTTLED) {
+		vdisk->stats.throttled[dir]++;
+	}
+	vdisk->stats.inflight++;
+	vmm_spin_unlock_irqrestore_lite(&vdisk->stats_lock, flags);
+
+	vreq->group = grp;
+	vreq->flags = VDISK_REQ_INFLIGHT;
+}
+
+/* Note: Must be called with group lock held */
+static void vdisk_qos_dequeue(struct vmm_vdisk_group *grp,
+			      struct vmm_vdisk *vdisk,
+			      struct vmm_vdisk_request *vreq)
+{
+	list_del(&vreq->head);
+	vreq->flags &= ~VDISK_REQ_QUEUED;
+	grp->queued--;
+	if (list_empty(&vdisk->qos_queue)) {
+		list_del_init(&vdisk->qos_head);
+	}
+}
+
+/* Note: Must be called with group lock held */
+static void vdisk_qos_enqueue(struct vmm_vdisk_group *grp,
+			      struct vmm_vdisk *vdisk,
+			      struct vmm_vdisk_request *vreq)
+{
+	if (list_empty(&vdisk->qos_head)) {
+		/* Idle virtual disk does not get credit for idle time */
+		if ((s64)(vdisk->qos_vtime - grp->vtime) < 0) {
+			vdisk->qos_vtime = grp->vtime;
+		}
+		list_add_tail(&vdisk->qos_head, &grp->active_list);
+	}
+	list_add_tail(&vreq->head, &vdisk->qos_queue);
+	vreq->flags |= VDISK_REQ_QUEUED;
+	grp->queued++;
+}
+
+/* Note: Must be called with group lock held */
+static struct vmm_vdisk_request *vdisk_group_pick(struct vmm_vdisk_group *grp,
+						  u64 *wait_ns)
+{
+	u64 wait, now = vmm_timer_timestamp();
+	struct vmm_vdisk *vd, *best = NULL;
+	struct vmm_vdisk_request *vreq;
+
+	*wait_ns = 0;
+	if (grp->depth <= grp->inflight) {
+		return NULL;
+	}
+
+	list_for_each_entry(vd, &grp->active_list, qos_head) {
+		vreq = list_first_entry(&vd->qos_queue,
+					struct vmm_vdisk_request, head);
+		vdisk_qos_refill(vd, now);
+		wait = vdisk_qos_wait(vd, vdisk_req_dir(vreq));
+		if (wait) {
+			vreq->flags |= VDISK_REQ_THROTTLED;
+			if (!(*wait_ns) || (wait < *wait_ns)) {
+				*wait_ns = wait;
+			}
+			continue;
+		}
+		if (!best || ((s64)(vd->qos_vtime - best->qos_vtime) < 0)) {
+			best = vd;
+		}
+	}
+	if (!best) {
+		return NULL;
+	}
+
+	vreq = list_first_entry(&best->qos_queue,
+				struct vmm_vdisk_request, head);
+	vdisk_qos_dequeue(grp, best, vreq);
+	vdisk_qos_start(grp, best, vreq, TRUE);
+
+	return vreq;
+}
+
+/* Account completion of request and returns TRUE if request was
+ * in-flight before this call.
+ */
+static bool vdisk_qos_done(struct vmm_vdisk_request *vreq, bool failed)
+{
+	bool kick;
+	irq_flags_t flags;
+	u64 lat;
+	u32 dir = vdisk_req_dir(vreq);
+	struct vmm_vdisk *vdisk = vreq->vdisk;
+	struct vmm_vdisk_group *grp = vreq->group;
+
+	if (!grp) {
+		return FALSE;
+	}
+
+	vmm_spin_lock_irqsave_lite(&grp->lock, flags);
+	if (!(vreq->flags & VDISK_REQ_INFLIGHT)) {
+		vmm_spin_unlock_irqrestore_lite(&grp->lock, flags);
+		return FALSE;
+	}
+	vreq->flags = 0;
+	vreq->group = NULL;
+	grp->inflight--;
+	kick = (grp->queued) ? TRUE : FALSE;
+	vmm_spin_unlock_irqrestore_lite(&grp->lock, flags);
+
+	lat = vmm_timer_timestamp() - vreq->tstamp;
+
+	vmm_spin_lock_irqsave_lite(&vdisk->stats_lock, flags);
+	if (vdisk->stats.inflight) {
+		vdisk->stats.inflight--;
+	}
+	if (failed) {
+		vdisk->stats.errors[dir]++;
+	} else {
+		vdisk->stats.ops[dir]++;
+		vdisk->stats.bytes[dir] += vreq->len;
+		vdisk->stats.total_latency_ns[dir] += lat;
+		if (vdisk->stats.max_latency_ns[dir] < lat) {
+			vdisk->stats.max_latency_ns[dir] = lat;
+		}
+	}
+	vmm_spin_unlock_irqrestore_lite(&vdisk->stats_lock, flags);
+
+	if (kick) {
+		vmm_workqueue_schedule_work(NULL, &grp->work);
+	}
+
+	return TRUE;
+}
+
+static void vdisk_group_timeout(struct vmm_timer_event *ev)
+{
+	struct vmm_vdisk_group *grp = ev->priv;
+
+	vmm_workqueue_schedule_work(NULL, &grp->work);
+}
+
+static void vdisk_group_work(struct vmm_work *work)
+{
+	int rc;
+	u64 wait;
+	irq_flags_t flags;
+	struct vmm_vdisk *vdisk;
+	struct vmm_vdisk_request *vreq;
+	struct vmm_vdisk_group *grp =
+			container_of(work, struct vmm_vdisk_group, work);
+
+	while (1) {
+		vmm_spin_lock_irqsave_lite(&grp->lock, flags);
+		vreq = vdisk_group_pick(grp, &wait);
+		if (!vreq && wait &&
+		    (!vmm_timer_event_pending(&grp->ev) ||
+		     ((vmm_timer_timestamp() + wait) <
+				vmm_timer_event_expiry_time(&grp->ev)))) {
+			vmm_timer_event_start(&grp->ev, wait);
+		}
+		vmm_spin_unlock_irqrestore_lite(&grp->lock, flags);
+
+		if (!vreq) {
+			break;
+		}
+
+		/* Block device can be detached after the request was
+		 * picked so submit it with blk_lock held as done by
+		 * vmm_vdisk_submit_request().
+		 */
+		vdisk = vreq->vdisk;
+		vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
+		if (vdisk->blk && (vdisk->group == grp)) {
+			rc = vmm_blockdev_submit_request(vdisk->blk,
+							 &vreq->r);
+		} else {
+			rc = VMM_ENODEV;
+		}
+		vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
+
+		/* Requests failed by block device without calling
+		 * failed() callback are failed over here.
+		 */
+		if (rc && vdisk_qos_done(vreq, TRUE)) {
+			vdisk->failed(vdisk, vreq);
+		}
+	}
+}
+
+static void vdisk_fail_list(struct vmm_vdisk *vdisk, struct dlist *flist)
+{
+	struct vmm_vdisk_request *vreq;
+
+	while (!list_empty(flist)) {
+		vreq = list_first_entry(flist,
+					struct vmm_vdisk_request, head);
+		list_del(&vreq->head);
+		vdisk_stats_queued(vdisk, FALSE);
+		vdisk_stats_failed(vdisk, vdisk_req_dir(vreq));
+		vdisk->failed(vdisk, vreq);
+	}
+}
+
+static struct vmm_vdisk_group *vdisk_group_get(struct vmm_request_queue *rq)
+{
+	bool found = FALSE;
+	struct vmm_vdisk_group *grp;
+
+	vmm_mutex_lock(&vdctrl.group_list_lock);
+
+	list_for_each_entry(grp, &vdctrl.group_list, head) {
+		if (grp->rq == rq) {
+			found = TRUE;
+			break;
+		}
+	}
+
+	if (!found) {
+		grp = vmm_zalloc(sizeof(struct vmm_vdisk_group));
+		if (grp) {
+			INIT_LIST_HEAD(&grp->head);
+			grp->rq = rq;
+			INIT_SPIN_LOCK(&grp->lock);
+			grp->depth = (rq && rq->max_pending) ?
+						rq->max_pending : 1;
+			INIT_LIST_HEAD(&grp->active_list);
+			INIT_TIMER_EVENT(&grp->ev, vdisk_group_timeout, grp);
+			INIT_WORK(&grp->work, vdisk_group_work);
+			list_add_tail(&grp->head, &vdctrl.group_list);
+		}
+	}
+
+	vmm_mutex_unlock(&vdctrl.group_list_lock);
+
+	return grp;
+}
+
+/* Note: Must be called with group list lock held */
+static void vdisk_group_free(struct vmm_vdisk_group *grp)
+{
+	list_del(&grp->head);
+	vmm_timer_event_stop(&grp->ev);
+	vmm_workqueue_stop_work(&grp->work);
+	vmm_free(grp);
+}
+
+/* Note: Must be called with blk_lock held */
+static void vdisk_group_join(struct vmm_vdisk *vdisk,
+			     struct vmm_vdisk_group *grp)
+{
+	irq_flags_t flags;
+
+	vdisk->group = grp;
+
+	vmm_spin_lock_irqsave_lite(&grp->lock, flags);
+	grp->member_count++;
+	vdisk->qos_vtime = grp->vtime;
+	vdisk_qos_reset(vdisk);
+	vmm_spin_unlock_irqrestore_lite(&grp->lock, flags);
+}
+
+/* Note: Must be called with blk_lock held */
+static void vdisk_group_leave(struct vmm_vdisk *vdisk, struct dlist *flist)
+{
+	irq_flags_t flags;
+	struct vmm_vdisk_request *vreq;
+	struct vmm_vdisk_group *grp = vdisk->group;
+
+	if (!grp) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(&grp->lock, flags);
+	while (!list_empty(&vdisk->qos_queue)) {
+		vreq = list_first_entry(&vdisk->qos_queue,
+					struct vmm_vdisk_request, head);
+		vdisk_qos_dequeue(grp, vdisk, vreq);
+		list_add_tail(&vreq->head, flist);
+	}
+	grp->member_count--;
+	vmm_spin_unlock_irqrestore_lite(&grp->lock, flags);
+
+	vdisk->group = NULL;
+}
+
 static void vdisk_req_completed(struct vmm_request *r)
 {
 	struct vmm_vdisk_request *vreq =
 			container_of(r, struct vmm_vdisk_request, r);
 	struct vmm_vdisk *vdisk = vreq->vdisk;
 
+	vdisk_qos_done(vreq, FALSE);
+
 	if (vdisk->completed) {
 		vdisk->completed(vdisk, vreq);
 	}
@@ -87,6 +559,8 @@ static void vdisk_req_failed(struct vmm_request *r)
 			container_of(r, struct vmm_vdisk_request, r);
 	struct vmm_vdisk *vdisk = vreq->vdisk;
 
+	vdisk_qos_done(vreq, TRUE);
+
 	if (vdisk->failed) {
 		vdisk->failed(vdisk, vreq);
 	}
@@ -102,6 +576,7 @@ void vmm_vdisk_set_request_type(struct vmm_vdisk_request *vreq,
 		return;
 	}
 
+	vreq->r.flags = 0;
 	switch (type) {
 	case VMM_VDISK_REQUEST_READ:
 		vreq->r.type = VMM_REQUEST_READ;
@@ -109,6 +584,19 @@ void vmm_vdisk_set_request_type(struct vmm_vdisk_request *vreq,
 	case VMM_VDISK_REQUEST_WRITE:
 		vreq->r.type = VMM_REQUEST_WRITE;
 		break;
+	case VMM_VDISK_REQUEST_WRITE_FUA:
+		vreq->r.type = VMM_REQUEST_WRITE;
+		vreq->r.flags = VMM_REQUEST_FUA;
+		break;
+	case VMM_VDISK_REQUEST_DISCARD:
+		vreq->r.type = VMM_REQUEST_DISCARD;
+		break;
+	case VMM_VDISK_REQUEST_WRITE_ZEROES:
+		vreq->r.type = VMM_REQUEST_WRITE_ZEROES;
+		break;
+	case VMM_VDISK_REQUEST_FLUSH:
+		vreq->r.type = VMM_REQUEST_FLUSH;
+		break;
 	default:
 		vreq->r.type = VMM_REQUEST_UNKNOWN;
 		break;
@@ -129,7 +617,17 @@ enum vmm_vdisk_request_type vmm_vdisk_get_request_type(
 		type = VMM_VDISK_REQUEST_READ;
 		break;
 	case VMM_REQUEST_WRITE:
-		type = VMM_VDISK_REQUEST_WRITE;
+		type = (vreq->r.flags & VMM_REQUEST_FUA) ?
+			VMM_VDISK_REQUEST_WRITE_FUA : VMM_VDISK_REQUEST_WRITE;
+		break;
+	case VMM_REQUEST_DISCARD:
+		type = VMM_VDISK_REQUEST_DISCARD;
+		break;
+	case VMM_REQUEST_WRITE_ZEROES:
+		type = VMM_VDISK_REQUEST_WRITE_ZEROES;
+		break;
+	case VMM_REQUEST_FLUSH:
+		type = VMM_VDISK_REQUEST_FLUSH;
 		break;
 	default:
 		type = VMM_VDISK_REQUEST_UNKNOWN;
@@ -182,21 +680,39 @@ int vmm_vdisk_submit_request(struct vmm_vdisk *vdisk,
 			     u64 lba, void *data, u32 data_len)
 {
 	int rc;
-	irq_flags_t flags;
+	bool dispatch;
+	irq_flags_t flags, flags1;
+	struct vmm_vdisk_group *grp;
 
-	if (!vdisk || !vreq || !data) {
-		return VMM_EINVALID;
-	}
-	if (data_len < vdisk->block_size) {
+	if (!vdisk || !vreq) {
 		return VMM_EINVALID;
 	}
-	if ((type < VMM_VDISK_REQUEST_READ) ||
-	    (VMM_VDISK_REQUEST_WRITE < type)) {
+	switch (type) {
+	case VMM_VDISK_REQUEST_READ:
+	case VMM_VDISK_REQUEST_WRITE:
+	case VMM_VDISK_REQUEST_WRITE_FUA:
+		if (!data || (data_len < vdisk->block_size)) {
+			return VMM_EINVALID;
+		}
+		break;
+	case VMM_VDISK_REQUEST_DISCARD:
+	case VMM_VDISK_REQUEST_WRITE_ZEROES:
+		if (data_len < vdisk->block_size) {
+			return VMM_EINVALID;
+		}
+		data = NULL;
+		break;
+	case VMM_VDISK_REQUEST_FLUSH:
+		lba = 0;
+		data = NULL;
+		data_len = 0;
+		break;
+	default:
 		return VMM_EINVALID;
-	}
+	};
 
 	vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
-	if (vdisk->blk) {
+	if (vdisk->blk && vdisk->group) {
 		vreq->vdisk = vdisk;
 		vmm_vdisk_set_request_type(vreq, type);
 		vreq->r.lba = (lba + vdisk->blk->start_lba) * vdisk->blk_factor;
@@ -206,8 +722,45 @@ int vmm_vdisk_submit_request(struct vmm_vdisk *vdisk,
 		vreq->r.completed = vdisk_req_completed;
 		vreq->r.failed = vdisk_req_failed;
 		vreq->r.priv = NULL;
-		rc = vmm_blockdev_submit_request(vdisk->blk, &vreq->r);
+		vreq->group = NULL;
+		vreq->tstamp = vmm_timer_timestamp();
+		/* Only data transfer counts towards bandwidth */
+		vreq->len = (vreq->r.data) ?
+			udiv32(data_len, vdisk->block_size) *
+						vdisk->block_size : 0;
+		vreq->flags = 0;
+
+		/* Dispatch right away only if nothing else is queued
+		 * in the group and the virtual disk has enough tokens
+		 * otherwise let the group work dispatch it in order.
+		 */
+		grp = vdisk->group;
+		vmm_spin_lock_irqsave_lite(&grp->lock, flags1);
+		vdisk_qos_refill(vdisk, vreq->tstamp);
+		dispatch = (!grp->queued && (grp->inflight < grp->depth) &&
+			    !vdisk_qos_wait(vdisk, vdisk_req_dir(vreq)));
+		if (dispatch) {
+			vdisk_qos_start(grp, vdisk, vreq, FALSE);
+		} else {
+			vdisk_qos_enqueue(grp, vdisk, vreq);
+		}
+		vmm_spin_unlock_irqrestore_lite(&grp->lock, flags1);
+
+		if (dispatch) {
+			rc = vmm_blockdev_submit_request(vdisk->blk,
+							 &vreq->r);
+			if (rc) {
+				vdisk_qos_done(vreq, TRUE);
+			}
+		} else {
+			vdisk_stats_queued(vdisk, TRUE);
+			vmm_workqueue_schedule_work(NULL, &grp->work);
+			rc = VMM_OK;
+		}
 	} else {
+		vdisk_stats_failed(vdisk,
+			(type == VMM_VDISK_REQUEST_READ) ?
+			VMM_VDISK_QOS_READ : VMM_VDISK_QOS_WRITE);
 		vdisk->failed(vdisk, vreq);
 		rc = VMM_ENODEV;
 	}
@@ -224,7 +777,9 @@ int vmm_vdisk_abort_request(struct vmm_vdisk *vdisk,
 			    struct vmm_vdisk_request *vreq)
 {
 	int rc;
-	irq_flags_t flags;
+	bool queued = FALSE;
+	irq_flags_t flags, flags1;
+	struct vmm_vdisk_group *grp;
 
 	if (!vdisk || !vreq) {
 		return VMM_EINVALID;
@@ -234,7 +789,21 @@ int vmm_vdisk_abort_request(struct vmm_vdisk *vdisk,
 	}
 
 	vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
-	if (vdisk->blk) {
+	grp = vdisk->group;
+	if (grp) {
+		vmm_spin_lock_irqsave_lite(&grp->lock, flags1);
+		if (vreq->flags & VDISK_REQ_QUEUED) {
+			vdisk_qos_dequeue(grp, vdisk, vreq);
+			queued = TRUE;
+		}
+		vmm_spin_unlock_irqrestore_lite(&grp->lock, flags1);
+	}
+	if (queued) {
+		vdisk_stats_queued(vdisk, FALSE);
+		vdisk_stats_failed(vdisk, vdisk_req_dir(vreq));
+		vdisk->failed(vdisk, vreq);
+		rc = VMM_OK;
+	} else if (vdisk->blk) {
 		rc = vmm_blockdev_abort_request(&vreq->r);
 	} else {
 		rc = VMM_ENODEV;
@@ -272,6 +841,175 @@ int vmm_vdisk_flush_cache(struct vmm_vdisk *vdisk)
 }
 VMM_EXPORT_SYMBOL(vmm_vdisk_flush_cache);
 
+bool vmm_vdisk_can_discard(struct vmm_vdisk *vdisk)
+{
+	bool ret = FALSE;
+	irq_flags_t flags;
+
+	if (!vdisk) {
+		return FALSE;
+	}
+
+	vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
+	if (vdisk->blk && (vdisk->blk->flags & VMM_BLOCKDEV_DISCARD) &&
+	    (vdisk->blk->flags & VMM_BLOCKDEV_RW)) {
+		ret = TRUE;
+	}
+	vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
+
+	return ret;
+}
+VMM_EXPORT_SYMBOL(vmm_vdisk_can_discard);
+
+int vmm_vdisk_get_qos(struct vmm_vdisk *vdisk, struct vmm_vdisk_qos *qos)
+{
+	irq_flags_t flags, flags1;
+	struct vmm_vdisk_group *grp;
+
+	if (!vdisk || !qos) {
+		return VMM_EINVALID;
+	}
+
+	vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
+	grp = vdisk->group;
+	if (grp) {
+		vmm_spin_lock_irqsave_lite(&grp->lock, flags1);
+	}
+	memcpy(qos, &vdisk->qos, sizeof(*qos));
+	if (grp) {
+		vmm_spin_unlock_irqrestore_lite(&grp->lock, flags1);
+	}
+	vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_vdisk_get_qos);
+
+int vmm_vdisk_set_qos(struct vmm_vdisk *vdisk,
+		      const struct vmm_vdisk_qos *qos)
+{
+	u32 d;
+	irq_flags_t flags, flags1;
+	struct vmm_vdisk_group *grp;
+	const struct vmm_vdisk_qos_limit *l;
+
+	if (!vdisk || !qos) {
+		return VMM_EINVALID;
+	}
+	if ((qos->weight < VMM_VDISK_QOS_MIN_WEIGHT) ||
+	    (VMM_VDISK_QOS_MAX_WEIGHT < qos->weight)) {
+		return VMM_EINVALID;
+	}
+	for (d = 0; d < VMM_VDISK_QOS_MAX_DIR; d++) {
+		l = &qos->limit[d];
+		if ((VMM_VDISK_QOS_MAX_RATE < l->iops) ||
+		    (VMM_VDISK_QOS_MAX_RATE < l->iops_burst) ||
+		    (VMM_VDISK_QOS_MAX_RATE < l->bps) ||
+		    (VMM_VDISK_QOS_MAX_RATE < l->bps_burst)) {
+			return VMM_EINVALID;
+		}
+	}
+
+	vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
+	grp = vdisk->group;
+	if (grp) {
+		vmm_spin_lock_irqsave_lite(&grp->lock, flags1);
+	}
+	memcpy(&vdisk->qos, qos, sizeof(vdisk->qos));
+	vdisk_qos_reset(vdisk);
+	if (grp) {
+		vmm_spin_unlock_irqrestore_lite(&grp->lock, flags1);
+		/* Queued requests might be eligible with new limits */
+		vmm_workqueue_schedule_work(NULL, &grp->work);
+	}
+	vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_vdisk_set_qos);
+
+int vmm_vdisk_set_qos_from_devtree(struct vmm_vdisk *vdisk,
+				   struct vmm_devtree_node *node)
+{
+	int rc;
+	struct vmm_vdisk_qos qos;
+	struct vmm_vdisk_qos_limit *rd = &qos.limit[VMM_VDISK_QOS_READ];
+	struct vmm_vdisk_qos_limit *wr = &qos.limit[VMM_VDISK_QOS_WRITE];
+
+	if (!vdisk || !node) {
+		return VMM_EINVALID;
+	}
+
+	vmm_vdisk_get_qos(vdisk, &qos);
+
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_IOPS_RD_ATTR_NAME,
+			     &rd->iops);
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_IOPS_WR_ATTR_NAME,
+			     &wr->iops);
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_IOPS_RD_BURST_ATTR_NAME,
+			     &rd->iops_burst);
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_IOPS_WR_BURST_ATTR_NAME,
+			     &wr->iops_burst);
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_BPS_RD_ATTR_NAME,
+			     &rd->bps);
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_BPS_WR_ATTR_NAME,
+			     &wr->bps);
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_BPS_RD_BURST_ATTR_NAME,
+			     &rd->bps_burst);
+	vmm_devtree_read_u64(node, VMM_VDISK_QOS_BPS_WR_BURST_ATTR_NAME,
+			     &wr->bps_burst);
+	vmm_devtree_read_u32(node, VMM_VDISK_QOS_WEIGHT_ATTR_NAME,
+			     &qos.weight);
+
+	rc = vmm_vdisk_set_qos(vdisk, &qos);
+	if (rc) {
+		vmm_printf("%s: vdisk=%s invalid QoS attributes\n",
+			   __func__, vdisk->name);
+	}
+
+	return rc;
+}
+VMM_EXPORT_SYMBOL(vmm_vdisk_set_qos_from_devtree);
+
+int vmm_vdisk_get_stats(struct vmm_vdisk *vdisk,
+			struct vmm_vdisk_stats *stats)
+{
+	irq_flags_t flags;
+
+	if (!vdisk || !stats) {
+		return VMM_EINVALID;
+	}
+
+	vmm_spin_lock_irqsave_lite(&vdisk->stats_lock, flags);
+	memcpy(stats, &vdisk->stats, sizeof(*stats));
+	vmm_spin_unlock_irqrestore_lite(&vdisk->stats_lock, flags);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_vdisk_get_stats);
+
+int vmm_vdisk_reset_stats(struct vmm_vdisk *vdisk)
+{
+	u32 queued, inflight;
+	irq_flags_t flags;
+
+	if (!vdisk) {
+		return VMM_EINVALID;
+	}
+
+	vmm_spin_lock_irqsave_lite(&vdisk->stats_lock, flags);
+	queued = vdisk->stats.queued;
+	inflight = vdisk->stats.inflight;
+	memset(&vdisk->stats, 0, sizeof(vdisk->stats));
+	vdisk->stats.reset_tstamp = vmm_timer_timestamp();
+	vdisk->stats.queued = queued;
+	vdisk->stats.inflight = inflight;
+	vmm_spin_unlock_irqrestore_lite(&vdisk->stats_lock, flags);
+
+	return VMM_OK;
+}
+VMM_EXPORT_SYMBOL(vmm_vdisk_reset_stats);
+
 u64 vmm_vdisk_capacity(struct vmm_vdisk *vdisk)
 {
 	u64 ret = 0;
@@ -329,8 +1067,13 @@ static int vdisk_attach_iter(struct vmm_blockdev *dev, void *data)
 	struct vdisk_attach_priv *ap = data;
 	const char *bdev_name = ap->bdev_name;
 	struct vmm_vdisk *vdisk = ap->vdisk;
+	struct vmm_vdisk_group *grp;
 
 	if (strncmp(dev->name, bdev_name, sizeof(dev->name))==0) {
+		grp = vdisk_group_get(dev->rq);
+		if (!grp) {
+			return VMM_ENOMEM;
+		}
 		attached = FALSE;
 		vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
 		if (!vdisk->blk &&
@@ -339,6 +1082,7 @@ static int vdisk_attach_iter(struct vmm_blockdev *dev, void *data)
 			vdisk->blk = dev;
 			vdisk->blk_factor = udiv32(vdisk->block_size,
 					           vdisk->blk->block_size);
+			vdisk_group_join(vdisk, grp);
 			attached = TRUE;
 		}
 		vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
@@ -369,21 +1113,27 @@ void vmm_vdisk_detach_block_device(struct vmm_vdisk *vdisk)
 {
 	bool detached;
 	irq_flags_t flags;
+	struct dlist flist;
 
 	if (!vdisk) {
 		return;
 	}
 
+	INIT_LIST_HEAD(&flist);
 	detached = FALSE;
 	vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
 	if (vdisk->blk) {
 		vmm_blockdev_flush_cache(vdisk->blk);
 		detached = TRUE;
 	}
+	vdisk_group_leave(vdisk, &flist);
 	vdisk->blk = NULL;
 	vdisk->blk_factor = 1;
 	vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
 
+	/* Fail requests which were held back by QoS */
+	vdisk_fail_list(vdisk, &flist);
+
 	if (detached && vdisk->detached) {
 		vdisk->detached(vdisk);
 	}
@@ -443,6 +1193,13 @@ struct vmm_vdisk *vmm_vdisk_create(const char *name, u32 block_size,
 	INIT_SPIN_LOCK(&vdisk->blk_lock);
 	vdisk->blk = NULL;
 	vdisk->blk_factor = 1;
+	vdisk->group = NULL;
+	vdisk->qos.weight = VMM_VDISK_QOS_DEF_WEIGHT;
+	INIT_LIST_HEAD(&vdisk->qos_head);
+	INIT_LIST_HEAD(&vdisk->qos_queue);
+	vdisk_qos_reset(vdisk);
+	INIT_SPIN_LOCK(&vdisk->stats_lock);
+	vdisk->stats.reset_tstamp = vmm_timer_timestamp();
 	vdisk->priv = priv;
 
 	list_add_tail(&vdisk->head, &vdctrl.vdisk_list);
@@ -598,7 +1355,9 @@ static int vdisk_blk_notification(struct vmm_notifier_block *nb,
 				  unsigned long evt, void *data)
 {
 	irq_flags_t flags;
+	struct dlist flist;
 	struct vmm_vdisk *vdisk;
+	struct vmm_vdisk_group *grp, *grp_next;
 	struct vmm_blockdev_event *e = data;
 
 	if (evt != VMM_BLOCKDEV_EVENT_UNREGISTER) {
@@ -613,17 +1372,32 @@ static int vdisk_blk_notification(struct vmm_notifier_block *nb,
 
 	/* Find virtual disk using block device */
 	list_for_each_entry(vdisk, &vdctrl.vdisk_list, head) {
+		INIT_LIST_HEAD(&flist);
 		vmm_spin_lock_irqsave_lite(&vdisk->blk_lock, flags);
 		if (vdisk->blk == e->bdev) {
+			vdisk_group_leave(vdisk, &flist);
 			vdisk->blk = NULL;
 			vdisk->blk_factor = 1;
 		}
 		vmm_spin_unlock_irqrestore_lite(&vdisk->blk_lock, flags);
+		vdisk_fail_list(vdisk, &flist);
 	}
 
 	/* Unlock virtual disk list */
 	vmm_mutex_unlock(&vdctrl.vdisk_list_lock);
 
+	/* Free unused group of request queue owned by block device */
+	if (!e->bdev->parent) {
+		vmm_mutex_lock(&vdctrl.group_list_lock);
+		list_for_each_entry_safe(grp, grp_next,
+					 &vdctrl.group_list, head) {
+			if ((grp->rq == e->bdev->rq) && !grp->member_count) {
+				vdisk_group_free(grp);
+			}
+		}
+		vmm_mutex_unlock(&vdctrl.group_list_lock);
+	}
+
 	return NOTIFY_OK;
 }
 
@@ -633,6 +1407,8 @@ static int __init vmm_vdisk_init(void)
 
 	INIT_MUTEX(&vdctrl.vdisk_list_lock);
 	INIT_LIST_HEAD(&vdctrl.vdisk_list);
+	INIT_MUTEX(&vdctrl.group_list_lock);
+	INIT_LIST_HEAD(&vdctrl.group_list);
 	BLOCKING_INIT_NOTIFIER_CHAIN(&vdctrl.notifier_chain);
 
 	vdctrl.blk_client.notifier_call = &vdisk_blk_notification;
@@ -644,7 +1420,15 @@ static int __init vmm_vdisk_init(void)
 
 static void __exit vmm_vdisk_exit(void)
 {
+	struct vmm_vdisk_group *grp, *grp_next;
+
 	vmm_blockdev_unregister_client(&vdctrl.blk_client);
+
+	vmm_mutex_lock(&vdctrl.group_list_lock);
+	list_for_each_entry_safe(grp, grp_next, &vdctrl.group_list, head) {
+		vdisk_group_free(grp);
+	}
+	vmm_mutex_unlock(&vdctrl.group_list_lock);
 }
 
 VMM_DECLARE_MODULE(MODULE_DESC,
@@ -28,6 +28,8 @@
 #include <vmm_host_irq.h>
 #include <vmm_mutex.h>
 #include <vmm_guest_aspace.h>
+#include <vmm_vcpu_stats.h>
+#include <vmm_trace.h>
 #include <vmm_devemu.h>
 #include <vmm_devemu_debug.h>
 #include <libs/stringlib.h>
@@ -38,9 +40,19 @@ struct vmm_devemu_guest_irq {
 	void *opaque;
 };
 
+struct vmm_devemu_guest_msi {
+	struct dlist head;
+	physical_addr_t addr;
+	physical_size_t size;
+	struct vmm_devemu_msichip *chip;
+	void *opaque;
+};
+
 struct vmm_devemu_guest_context {
 	u32 g_irq_count;
 	struct dlist *g_irq;
+	vmm_rwlock_t g_msi_lock;
+	struct dlist g_msi;
 };
 
 struct vmm_devemu_ctrl {
@@ -412,6 +424,27 @@ static int devemu_dowrite(struct vmm_emudev *edev,
 	return rc;
 }
 
+static inline void devemu_note_exit(struct vmm_vcpu *vcpu, u32 reason,
+				    struct vmm_emudev *edev)
+{
+	if (edev) {
+		vmm_vcpu_exit_note_emulator(vcpu, reason, edev->emu);
+	}
+}
+
+static inline void devemu_trace_access(u32 event, bool io,
+				       physical_addr_t gphys_addr,
+				       void *buf, u32 len)
+{
+	u64 data = 0;
+
+	if (vmm_trace_enabled(event)) {
+		memcpy(&data, buf, min(len, (u32)sizeof(data)));
+		vmm_trace(event, (io) ? (0x100 | len) : len,
+			  gphys_addr, data);
+	}
+}
+
 int vmm_devemu_emulate_read(struct vmm_vcpu *vcpu,
 			    physical_addr_t gphys_addr,
 			    void *dst, u32 dst_len,
@@ -431,9 +464,15 @@ int vmm_devemu_emulate_read(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
+	devemu_note_exit(vcpu, VMM_VCPU_EXIT_MMIO, reg->devemu_priv);
+
 	rc = devemu_doread(reg->devemu_priv,
 			   gphys_addr - reg->gphys_addr,
 			   dst, dst_len, dst_endian);
+	if (!rc) {
+		devemu_trace_access(VMM_TRACE_DEVEMU_READ, FALSE,
+				    gphys_addr, dst, dst_len);
+	}
 skip:
 	if (rc) {
 		vmm_printf("%s: vcpu=%s gphys=0x%"PRIPADDR" dst_len=%d "
@@ -464,6 +503,11 @@ int vmm_devemu_emulate_write(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
+	devemu_note_exit(vcpu, VMM_VCPU_EXIT_MMIO, reg->devemu_priv);
+
+	devemu_trace_access(VMM_TRACE_DEVEMU_WRITE, FALSE,
+			    gphys_addr, src, src_len);
+
 	rc = devemu_dowrite(reg->devemu_priv,
 			    gphys_addr - reg->gphys_addr,
 			    src, src_len, src_endian);
@@ -497,9 +541,15 @@ int vmm_devemu_emulate_ioread(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
+	devemu_note_exit(vcpu, VMM_VCPU_EXIT_IOPORT, reg->devemu_priv);
+
 	rc = devemu_doread(reg->devemu_priv,
 			   gphys_addr - reg->gphys_addr,
 			   dst, dst_len, dst_endian);
+	if (!rc) {
+		devemu_trace_access(VMM_TRACE_DEVEMU_READ, TRUE,
+				    gphys_addr, dst, dst_len);
+	}
 skip:
 	if (rc) {
 		vmm_printf("%s: vcpu=%s gphys=0x%"PRIPADDR" dst_len=%d "
@@ -530,6 +580,11 @@ int vmm_devemu_emulate_iowrite(struct vmm_vcpu *vcpu,
 		goto skip;
 	}
 
+	devemu_note_exit(vcpu, VMM_VCPU_EXIT_IOPORT, reg->devemu_priv);
+
+	devemu_trace_access(VMM_TRACE_DEVEMU_WRITE, TRUE,
+			    gphys_addr, src, src_len);
+
 	rc = devemu_dowrite(reg->devemu_priv,
 			    gphys_addr - reg->gphys_addr,
 			    src, src_len, src_endian);
@@ -784,6 +839,132 @@ int vmm_devemu_unregister_irqchip(struct vmm_guest *guest, u32 irq,
 	return VMM_OK;
 }
 
+int vmm_devemu_emulate_msi(struct vmm_guest *guest,
+			   physical_addr_t addr, u32 data, u32 devid)
+{
+	irq_flags_t flags;
+	struct vmm_region *reg;
+	struct vmm_devemu_guest_msi *gm;
+	struct vmm_devemu_guest_context *eg;
+
+	if (!guest) {
+		return VMM_EFAIL;
+	}
+
+	eg = (struct vmm_devemu_guest_context *)guest->aspace.devemu_priv;
+
+	vmm_read_lock_irqsave_lite(&eg->g_msi_lock, flags);
+	list_for_each_entry(gm, &eg->g_msi, head) {
+		if ((gm->addr <= addr) && (addr < (gm->addr + gm->size))) {
+			gm->chip->handle(addr, data, devid, gm->opaque);
+			vmm_read_unlock_irqrestore_lite(&eg->g_msi_lock,
+							flags);
+			return VMM_OK;
+		}
+	}
+	vmm_read_unlock_irqrestore_lite(&eg->g_msi_lock, flags);
+
+	/* No MSI chip so treat it as write to doorbell register */
+	reg = vmm_guest_find_region(guest, addr,
+			VMM_REGION_VIRTUAL | VMM_REGION_MEMORY, FALSE);
+	if (!reg || !(reg->flags & VMM_REGION_ISDEVICE)) {
+		return VMM_ENOTAVAIL;
+	}
+
+	return devemu_dowrite(reg->devemu_priv, addr - reg->gphys_addr,
+			      &data, sizeof(data), VMM_DEVEMU_LITTLE_ENDIAN);
+}
+
+int vmm_devemu_register_msichip(struct vmm_guest *guest,
+				physical_addr_t addr, physical_size_t size,
+				struct vmm_devemu_msichip *chip,
+				void *opaque)
+{
+	irq_flags_t flags;
+	struct vmm_devemu_guest_msi *gm, *tgm;
+	struct vmm_devemu_guest_context *eg;
+
+	/* Sanity checks */
+	if (!guest || !chip || !chip->handle || !size) {
+		return VMM_EFAIL;
+	}
+
+	eg = (struct vmm_devemu_guest_context *)guest->aspace.devemu_priv;
+
+	/* Alloc guest MSI chip */
+	gm = vmm_zalloc(sizeof(struct vmm_devemu_guest_msi));
+	if (!gm) {
+		return VMM_ENOMEM;
+	}
+
+	/* Initialize guest MSI chip */
+	INIT_LIST_HEAD(&gm->head);
+	gm->addr = addr;
+	gm->size = size;
+	gm->chip = chip;
+	gm->opaque = opaque;
+
+	vmm_write_lock_irqsave_lite(&eg->g_msi_lock, flags);
+
+	/* Address ranges of MSI chips must not overlap */
+	list_for_each_entry(tgm, &eg->g_msi, head) {
+		if ((addr < (tgm->addr + tgm->size)) &&
+		    (tgm->addr < (addr + size))) {
+			vmm_write_unlock_irqrestore_lite(&eg->g_msi_lock,
+							 flags);
+			vmm_free(gm);
+			return VMM_EEXIST;
+		}
+	}
+
+	/* Add guest MSI chip to list */
+	list_add_tail(&gm->head, &eg->g_msi);
+
+	vmm_write_unlock_irqrestore_lite(&eg->g_msi_lock, flags);
+
+	return VMM_OK;
+}
+
+int vmm_devemu_unregister_msichip(struct vmm_guest *guest,
+				  struct vmm_devemu_msichip *chip,
+				  void *opaque)
+{
+	bool found;
+	irq_flags_t flags;
+	struct vmm_devemu_guest_msi *gm;
+	struct vmm_devemu_guest_context *eg;
+
+	/* Sanity checks */
+	if (!guest || !chip) {
+		return VMM_EFAIL;
+	}
+
+	eg = (struct vmm_devemu_guest_context *)guest->aspace.devemu_priv;
+
+	vmm_write_lock_irqsave_lite(&eg->g_msi_lock, flags);
+
+	gm = NULL;
+	found = FALSE;
+	list_for_each_entry(gm, &eg->g_msi, head) {
+		if (gm->chip == chip && gm->opaque == opaque) {
+			found = TRUE;
+			break;
+		}
+	}
+	if (found) {
+		list_del(&gm->head);
+	}
+
+	vmm_write_unlock_irqrestore_lite(&eg->g_msi_lock, flags);
+
+	if (!found) {
+		return VMM_ENOTAVAIL;
+	}
+	vmm_free(gm);
+
+	return VMM_OK;
+}
+
 u32 vmm_devemu_count_irqs(struct vmm_guest *guest)
 {
 	struct vmm_devemu_guest_context *eg;
@@ -1412,6 +1593,8 @@ int vmm_devemu_init_context(struct vmm_guest *guest)
 	for (ite = 0; ite < eg->g_irq_count; ite++) {
 		INIT_LIST_HEAD(&eg->g_irq[ite]);
 	}
+	INIT_RW_LOCK(&eg->g_msi_lock);
+	INIT_LIST_HEAD(&eg->g_msi);
 
 	guest->aspace.devemu_priv = eg;
 
@@ -1426,6 +1609,7 @@ devemu_init_context_done:
 int vmm_devemu_deinit_context(struct vmm_guest *guest)
 {
 	int rc = VMM_OK;
+	struct vmm_devemu_guest_msi *gm;
 	struct vmm_devemu_guest_context *eg;
 
 	if (!guest) {
@@ -1436,6 +1620,13 @@ int vmm_devemu_deinit_context(struct vmm_guest *guest)
 	guest->aspace.devemu_priv = NULL;
 
 	if (eg) {
+		while (!list_empty(&eg->g_msi)) {
+			gm = list_first_entry(&eg->g_msi,
+					      struct vmm_devemu_guest_msi, head);
+			list_del(&gm->head);
+			vmm_free(gm);
+		}
+
 		if (eg->g_irq) {
 			vmm_free(eg->g_irq);
 			eg->g_irq = NULL;
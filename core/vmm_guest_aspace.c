@@ -34,12 +34,102 @@
 #include <vmm_guest_aspace.h>
 #include <vmm_stdio.h>
 #include <vmm_notifier.h>
+#include <vmm_rcu.h>
+#include <arch_barrier.h>
 #include <arch_guest.h>
 #include <libs/stringlib.h>
 #include <libs/mathlib.h>
 
 static BLOCKING_NOTIFIER_CHAIN(guest_aspace_notifier_chain);
 
+/*
+ * Region trees are looked-up without any lock under RCU read-side
+ * critical section whereas updates are serialized using tree rwlock.
+ *
+ * A concurrent rbtree rotation can make a lockless walk miss a region
+ * so each tree has a sequence counter which is odd while a writer is
+ * updating the tree. A lockless walk which overlaps with an update is
+ * retried few times and then done again with tree read lock held.
+ *
+ * A region returned by lookup is only valid within the RCU read-side
+ * critical section of the caller. Deleting a region waits for a RCU
+ * grace period after removing it from tree and before tearing it down
+ * so that no lookup can still be using the region or its host memory.
+ */
+#define REGION_TREE_MAX_DEPTH		64
+#define REGION_TREE_MAX_RETRY		8
+
+static void region_tree_write_begin(u32 *seq)
+{
+	*(volatile u32 *)seq = *seq + 1;
+	arch_smp_wmb();
+}
+
+static void region_tree_write_end(u32 *seq)
+{
+	arch_smp_wmb();
+	*(volatile u32 *)seq = *seq + 1;
+}
+
+static struct vmm_region *region_tree_walk(struct rb_root *root,
+					   physical_addr_t start,
+					   physical_addr_t last)
+{
+	u32 depth = 0;
+	struct rb_node *pos;
+	struct vmm_region *reg;
+
+	pos = vmm_rcu_dereference(root->rb_node);
+	while (pos && (depth++ < REGION_TREE_MAX_DEPTH)) {
+		reg = rb_entry(pos, struct vmm_region, head);
+		if (last < VMM_REGION_GPHYS_START(reg)) {
+			pos = vmm_rcu_dereference(pos->rb_left);
+		} else if (VMM_REGION_GPHYS_END(reg) <= start) {
+			pos = vmm_rcu_dereference(pos->rb_right);
+		} else {
+			return reg;
+		}
+	}
+
+	return NULL;
+}
+
+/* Must be called with RCU read lock held */
+static struct vmm_region *region_tree_find(vmm_rwlock_t *root_lock,
+					   u32 *root_seq,
+					   struct rb_root *root,
+					   physical_addr_t start,
+					   physical_addr_t last)
+{
+	u32 seq, retry;
+	irq_flags_t flags;
+	struct vmm_region *reg;
+
+	for (retry = 0; retry < REGION_TREE_MAX_RETRY; retry++) {
+		seq = vmm_rcu_dereference(*root_seq);
+		if (seq & 0x1) {
+			continue;
+		}
+		arch_smp_rmb();
+		reg = region_tree_walk(root, start, last);
+		arch_smp_rmb();
+		if (vmm_rcu_dereference(*root_seq) == seq) {
+			return reg;
+		}
+	}
+
+	vmm_read_lock_irqsave_lite(root_lock, flags);
+	reg = region_tree_walk(root, start, last);
+	vmm_read_unlock_irqrestore_lite(root_lock, flags);
+
+	return reg;
+}
+
+static void region_free_rcu(struct vmm_rcu_head *rhead)
+{
+	vmm_free(container_of(rhead, struct vmm_region, rcu));
+}
+
 int vmm_guest_aspace_register_client(struct vmm_notifier_block *nb)
 {
 	int rc = vmm_blocking_notifier_register(&guest_aspace_notifier_chain,
@@ -96,12 +186,10 @@ struct vmm_region *vmm_guest_find_region(struct vmm_guest *guest,
 					 physical_addr_t gphys_addr,
 					 u32 reg_flags, bool resolve_alias)
 {
-	bool found = FALSE;
 	u32 cmp_flags;
-	irq_flags_t flags;
+	u32 *root_seq = NULL;
 	vmm_rwlock_t *root_lock = NULL;
 	struct rb_root *root = NULL;
-	struct rb_node *pos = NULL;
 	struct vmm_region *reg = NULL;
 	struct vmm_guest_aspace *aspace;
 
@@ -116,72 +204,49 @@ struct vmm_region *vmm_guest_find_region(struct vmm_guest *guest,
 	/* Find out region tree root */
 	if (reg_flags & VMM_REGION_IO) {
 		root = &aspace->reg_iotree;
+		root_seq = &aspace->reg_iotree_seq;
 		root_lock = &aspace->reg_iotree_lock;
 	} else {
 		root = &aspace->reg_memtree;
+		root_seq = &aspace->reg_memtree_seq;
 		root_lock = &aspace->reg_memtree_lock;
 	}
 
+	vmm_rcu_read_lock();
+
 	/* Try to find region ignoring required manifest flags */
-	reg = NULL;
-	found = FALSE;
-	vmm_read_lock_irqsave_lite(root_lock, flags);
-	pos = root->rb_node;
-	while (pos) {
-		reg = rb_entry(pos, struct vmm_region, head);
-		if (gphys_addr < VMM_REGION_GPHYS_START(reg)) {
-			pos = pos->rb_left;
-		} else if (VMM_REGION_GPHYS_END(reg) <= gphys_addr) {
-			pos = pos->rb_right;
-		} else {
-			if ((reg->flags & cmp_flags) == cmp_flags) {
-				found = TRUE;
-			}
-			break;
-		}
-	}
-	vmm_read_unlock_irqrestore_lite(root_lock, flags);
-	if (!found) {
-		return NULL;
+	reg = region_tree_find(root_lock, root_seq, root,
+			       gphys_addr, gphys_addr);
+	if (!reg || ((reg->flags & cmp_flags) != cmp_flags)) {
+		reg = NULL;
+		goto done;
 	}
 
 	/* Check if we can skip resolve alias */
 	if (!resolve_alias) {
-		goto done;
+		goto check_manifest;
 	}
 
 	/* Resolve aliased regions */
 	while (reg->flags & VMM_REGION_ALIAS) {
 		gphys_addr = VMM_REGION_GPHYS_TO_APHYS(reg, gphys_addr);
-		reg = NULL;
-		found = FALSE;
-		vmm_read_lock_irqsave_lite(root_lock, flags);
-		pos = root->rb_node;
-		while (pos) {
-			reg = rb_entry(pos, struct vmm_region, head);
-			if (gphys_addr < VMM_REGION_GPHYS_START(reg)) {
-				pos = pos->rb_left;
-			} else if (VMM_REGION_GPHYS_END(reg) <= gphys_addr) {
-				pos = pos->rb_right;
-			} else {
-				if ((reg->flags & cmp_flags) == cmp_flags) {
-					found = TRUE;
-				}
-				break;
-			}
-		}
-		vmm_read_unlock_irqrestore_lite(root_lock, flags);
-		if (!found) {
-			return NULL;
+		reg = region_tree_find(root_lock, root_seq, root,
+				       gphys_addr, gphys_addr);
+		if (!reg || ((reg->flags & cmp_flags) != cmp_flags)) {
+			reg = NULL;
+			goto done;
 		}
 	}
 
-done:
+check_manifest:
 	cmp_flags = reg_flags & VMM_REGION_MANIFEST_MASK;
 	if ((reg->flags & cmp_flags) != cmp_flags) {
-		return NULL;
+		reg = NULL;
 	}
 
+done:
+	vmm_rcu_read_unlock();
+
 	return reg;
 }
 
@@ -329,9 +394,12 @@ u32 vmm_guest_memory_read(struct vmm_guest *guest,
 	}
 
 	while (bytes_read < len) {
+		vmm_rcu_read_lock();
+
 		reg = vmm_guest_find_region(guest, gphys_addr,
 				VMM_REGION_REAL | VMM_REGION_MEMORY, TRUE);
 		if (!reg) {
+			vmm_rcu_read_unlock();
 			break;
 		}
 
@@ -343,6 +411,9 @@ u32 vmm_guest_memory_read(struct vmm_guest *guest,
 
 		to_read = vmm_host_memory_read(hphys_addr,
 					       dst, to_read, cacheable);
+
+		vmm_rcu_read_unlock();
+
 		if (!to_read) {
 			break;
 		}
@@ -369,9 +440,12 @@ u32 vmm_guest_memory_write(struct vmm_guest *guest,
 	}
 
 	while (bytes_written < len) {
+		vmm_rcu_read_lock();
+
 		reg = vmm_guest_find_region(guest, gphys_addr,
 				VMM_REGION_REAL | VMM_REGION_MEMORY, TRUE);
 		if (!reg) {
+			vmm_rcu_read_unlock();
 			break;
 		}
 
@@ -383,6 +457,9 @@ u32 vmm_guest_memory_write(struct vmm_guest *guest,
 
 		to_write = vmm_host_memory_write(hphys_addr,
 						 src, to_write, cacheable);
+
+		vmm_rcu_read_unlock();
+
 		if (!to_write) {
 			break;
 		}
@@ -402,6 +479,7 @@ int vmm_guest_physical_map(struct vmm_guest *guest,
 			   physical_size_t *phys_size,
 			   u32 *reg_flags)
 {
+	u32 flags;
 	physical_addr_t hphys;
 	physical_size_t size;
 	struct vmm_region *reg = NULL;
@@ -410,9 +488,12 @@ int vmm_guest_physical_map(struct vmm_guest *guest,
 		return VMM_EFAIL;
 	}
 
+	vmm_rcu_read_lock();
+
 	reg = vmm_guest_find_region(guest, gphys_addr,
 				    VMM_REGION_MEMORY, FALSE);
 	if (!reg) {
+		vmm_rcu_read_unlock();
 		return VMM_EFAIL;
 	}
 	while (reg->flags & VMM_REGION_ALIAS) {
@@ -420,11 +501,15 @@ int vmm_guest_physical_map(struct vmm_guest *guest,
 		reg = vmm_guest_find_region(guest, gphys_addr,
 					    VMM_REGION_MEMORY, FALSE);
 		if (!reg) {
+			vmm_rcu_read_unlock();
 			return VMM_EFAIL;
 		}
 	}
 
 	vmm_guest_find_mapping(guest, reg, gphys_addr, &hphys, &size);
+	flags = reg->flags;
+
+	vmm_rcu_read_unlock();
 
 	if (gphys_size < size) {
 		size = gphys_size;
@@ -439,7 +524,7 @@ int vmm_guest_physical_map(struct vmm_guest *guest,
 	}
 
 	if (reg_flags) {
-		*reg_flags = reg->flags;
+		*reg_flags = flags;
 	}
 
 	return VMM_OK;
@@ -618,44 +703,32 @@ static bool is_region_overlapping(struct vmm_guest *guest,
 				  struct vmm_region *reg,
 				  struct vmm_region **overlapping)
 {
-	bool ret = FALSE;
-	irq_flags_t flags;
+	u32 *root_seq = NULL;
 	vmm_rwlock_t *root_lock = NULL;
 	struct rb_root *root = NULL;
-	struct rb_node *pos = NULL;
 	struct vmm_region *treg = NULL;
 	struct vmm_guest_aspace *aspace = &guest->aspace;
 
 	if (reg->flags & VMM_REGION_IO) {
 		root = &aspace->reg_iotree;
+		root_seq = &aspace->reg_iotree_seq;
 		root_lock = &aspace->reg_iotree_lock;
 	} else {
 		root = &aspace->reg_memtree;
+		root_seq = &aspace->reg_memtree_seq;
 		root_lock = &aspace->reg_memtree_lock;
 	}
 
-	vmm_read_lock_irqsave_lite(root_lock, flags);
-
-	pos = root->rb_node;
-	while (pos) {
-		treg = rb_entry(pos, struct vmm_region, head);
-		if (VMM_REGION_GPHYS_END(reg) <=
-				VMM_REGION_GPHYS_START(treg)) {
-			pos = pos->rb_left;
-		} else if (VMM_REGION_GPHYS_END(treg) <=
-				VMM_REGION_GPHYS_START(reg)) {
-			pos = pos->rb_right;
-		} else {
-			if (overlapping)
-				*overlapping = treg;
-			ret = TRUE;
-			break;
-		}
+	vmm_rcu_read_lock();
+	treg = region_tree_find(root_lock, root_seq, root,
+				VMM_REGION_GPHYS_START(reg),
+				VMM_REGION_GPHYS_END(reg) - 1);
+	if (treg && overlapping) {
+		*overlapping = treg;
 	}
+	vmm_rcu_read_unlock();
 
-	vmm_read_unlock_irqrestore_lite(root_lock, flags);
-
-	return ret;
+	return (treg) ? TRUE : FALSE;
 }
 
 static void region_overlap_message(const char *func,
@@ -686,6 +759,7 @@ static int region_add(struct vmm_guest *guest,
 	int rc;
 	const char *aval;
 	irq_flags_t flags;
+	u32 *root_seq = NULL;
 	vmm_rwlock_t *root_lock = NULL;
 	struct dlist *root_plist = NULL;
 	struct rb_root *root = NULL;
@@ -1069,10 +1143,12 @@ static int region_add(struct vmm_guest *guest,
 	/* Add region to tree and probe list */
 	if (reg->flags & VMM_REGION_IO) {
 		root = &aspace->reg_iotree;
+		root_seq = &aspace->reg_iotree_seq;
 		root_plist = &aspace->reg_ioprobe_list;
 		root_lock = &aspace->reg_iotree_lock;
 	} else {
 		root = &aspace->reg_memtree;
+		root_seq = &aspace->reg_memtree_seq;
 		root_plist = &aspace->reg_memprobe_list;
 		root_lock = &aspace->reg_memtree_lock;
 	}
@@ -1093,8 +1169,10 @@ static int region_add(struct vmm_guest *guest,
 			goto region_arch_del_fail;
 		}
 	}
+	region_tree_write_begin(root_seq);
 	rb_link_node(&reg->head, pnode, new);
 	rb_insert_color(&reg->head, root);
+	region_tree_write_end(root_seq);
 	if (add_probe_list) {
 		list_add_tail(&reg->phead, root_plist);
 	}
@@ -1148,22 +1226,28 @@ static int region_del(struct vmm_guest *guest,
 	u32 i;
 	int rc = VMM_OK;
 	irq_flags_t flags;
+	u32 *root_seq;
 	vmm_rwlock_t *root_lock;
 	struct rb_root *root = NULL;
 	struct vmm_devtree_node *rnode = reg->node;
 	struct vmm_guest_aspace *aspace = &guest->aspace;
+	struct vmm_guest_aspace_event evt;
 
 	/* Remove it from region tree if not removed already */
 	if (del_reg_tree) {
 		if (reg->flags & VMM_REGION_IO) {
 			root = &aspace->reg_iotree;
+			root_seq = &aspace->reg_iotree_seq;
 			root_lock = &aspace->reg_iotree_lock;
 		} else {
 			root = &aspace->reg_memtree;
+			root_seq = &aspace->reg_memtree_seq;
 			root_lock = &aspace->reg_memtree_lock;
 		}
 		vmm_write_lock_irqsave_lite(root_lock, flags);
+		region_tree_write_begin(root_seq);
 		rb_erase(&reg->head, root);
+		region_tree_write_end(root_seq);
 		vmm_write_unlock_irqrestore_lite(root_lock, flags);
 	}
 
@@ -1179,6 +1263,18 @@ static int region_del(struct vmm_guest *guest,
 		vmm_write_unlock_irqrestore_lite(root_lock, flags);
 	}
 
+	/* Wait for lookups which might have found the region */
+	vmm_rcu_synchronize();
+
+	/* Let clients stop using region deleted from region tree */
+	if (del_reg_tree) {
+		evt.guest = guest;
+		evt.data = reg;
+		vmm_blocking_notifier_call(&guest_aspace_notifier_chain,
+					   VMM_GUEST_ASPACE_EVENT_DEL_REGION,
+					   &evt);
+	}
+
 	/* Call arch specific del region callback */
 	rc = arch_guest_del_region(guest, reg);
 	if (rc) {
@@ -1221,8 +1317,8 @@ static int region_del(struct vmm_guest *guest,
 		reg->shm = NULL;
 	}
 
-	/* Free the region */
-	vmm_free(reg);
+	/* Free the region after lockless readers are done with it */
+	vmm_rcu_call(&reg->rcu, region_free_rcu);
 
 	/* De-reference the region node */
 	vmm_devtree_dref_node(rnode);
@@ -1525,9 +1621,11 @@ int vmm_guest_aspace_init(struct vmm_guest *guest)
 	}
 	aspace->guest = guest;
 	INIT_RW_LOCK(&aspace->reg_iotree_lock);
+	aspace->reg_iotree_seq = 0;
 	aspace->reg_iotree = RB_ROOT;
 	INIT_LIST_HEAD(&aspace->reg_ioprobe_list);
 	INIT_RW_LOCK(&aspace->reg_memtree_lock);
+	aspace->reg_memtree_seq = 0;
 	aspace->reg_memtree = RB_ROOT;
 	INIT_LIST_HEAD(&aspace->reg_memprobe_list);
 	guest->aspace.devemu_priv = NULL;
@@ -1566,6 +1664,7 @@ int vmm_guest_aspace_deinit(struct vmm_guest *guest)
 {
 	int rc;
 	irq_flags_t flags;
+	u32 *root_seq;
 	vmm_rwlock_t *root_lock;
 	struct rb_root *root;
 	struct dlist *root_plist;
@@ -1595,6 +1694,7 @@ int vmm_guest_aspace_deinit(struct vmm_guest *guest)
 
 	/* One-by-one remove all io regions in reverse probing order */
 	root = &aspace->reg_iotree;
+	root_seq = &aspace->reg_iotree_seq;
 	root_plist = &aspace->reg_ioprobe_list;
 	root_lock = &aspace->reg_iotree_lock;
 	vmm_write_lock_irqsave_lite(root_lock, flags);
@@ -1604,18 +1704,23 @@ int vmm_guest_aspace_deinit(struct vmm_guest *guest)
 				 struct vmm_region, phead);
 
 		/* Remove region from tree */
+		region_tree_write_begin(root_seq);
 		rb_erase(&reg->head, root);
+		region_tree_write_end(root_seq);
 
 		/* Delete the region */
 		vmm_write_unlock_irqrestore_lite(root_lock, flags);
 		region_del(guest, reg, FALSE, FALSE);
 		vmm_write_lock_irqsave_lite(root_lock, flags);
 	}
+	region_tree_write_begin(root_seq);
 	*root = RB_ROOT;
+	region_tree_write_end(root_seq);
 	vmm_write_unlock_irqrestore_lite(root_lock, flags);
 
 	/* One-by-one remove all mem regions in reverse probing order */
 	root = &aspace->reg_memtree;
+	root_seq = &aspace->reg_memtree_seq;
 	root_plist = &aspace->reg_memprobe_list;
 	root_lock = &aspace->reg_memtree_lock;
 	vmm_write_lock_irqsave_lite(root_lock, flags);
@@ -1625,14 +1730,18 @@ int vmm_guest_aspace_deinit(struct vmm_guest *guest)
 				 struct vmm_region, phead);
 
 		/* Remove region from tree */
+		region_tree_write_begin(root_seq);
 		rb_erase(&reg->head, root);
+		region_tree_write_end(root_seq);
 
 		/* Delete the region */
 		vmm_write_unlock_irqrestore_lite(root_lock, flags);
 		region_del(guest, reg, FALSE, FALSE);
 		vmm_write_lock_irqsave_lite(root_lock, flags);
 	}
+	region_tree_write_begin(root_seq);
 	*root = RB_ROOT;
+	region_tree_write_end(root_seq);
 	vmm_write_unlock_irqrestore_lite(root_lock, flags);
 
 	/* DeInitialize device emulation context */
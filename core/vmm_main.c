@@ -47,6 +47,7 @@
 #include <vmm_devdrv.h>
 #include <vmm_devemu.h>
 #include <vmm_workqueue.h>
+#include <vmm_rcu.h>
 #include <vmm_cmdmgr.h>
 #include <vmm_wallclock.h>
 #include <vmm_chardev.h>
@@ -723,6 +724,13 @@ static void __init init_bootcpu(void)
 		goto init_bootcpu_fail;
 	}
 
+	/* Initialize read-copy-update framework */
+	vmm_init_printf("read-copy-update framework\n");
+	ret = vmm_rcu_init();
+	if (ret) {
+		goto init_bootcpu_fail;
+	}
+
 	/* Schedule system init work */
 	INIT_WORK(&sys_init, &system_init_work);
 	vmm_workqueue_schedule_work(NULL, &sys_init);
@@ -29,6 +29,7 @@
 #include <vmm_timer.h>
 #include <vmm_guest_aspace.h>
 #include <vmm_vcpu_irq.h>
+#include <vmm_vcpu_stats.h>
 #include <vmm_scheduler.h>
 #include <vmm_waitqueue.h>
 #include <vmm_workqueue.h>
@@ -494,6 +495,7 @@ struct vmm_vcpu *vmm_manager_vcpu_orphan_create(const char *name,
 
 		/* Update priority */
 		vcpu->priority = priority;
+		vcpu->base_priority = priority;
 
 		/* Update host CPU and affinity */
 		vcpu->hcpu = hcpu;
@@ -553,6 +555,7 @@ struct vmm_vcpu *vmm_manager_vcpu_orphan_create(const char *name,
 	vcpu->reset_tstamp = 0;
 	vcpu->preempt_count = 0;
 	vcpu->resumed = FALSE;
+	vcpu->preempted = FALSE;
 	vcpu->sched_priv = NULL;
 
 	/* Intialize static scheduling context */
@@ -1306,6 +1309,7 @@ struct vmm_guest *vmm_manager_guest_create(struct vmm_devtree_node *gnode)
 			if (vcpu->priority < VMM_VCPU_MIN_PRIORITY) {
 				vcpu->priority = VMM_VCPU_MIN_PRIORITY;
 			}
+			vcpu->base_priority = vcpu->priority;
 
 			/* Update host CPU and affinity */
 			memcpy(&mngr.vcpu_affinity_mask[vcpu->id],
@@ -1386,6 +1390,7 @@ struct vmm_guest *vmm_manager_guest_create(struct vmm_devtree_node *gnode)
 		vcpu->reset_tstamp = 0;
 		vcpu->preempt_count = 0;
 		vcpu->resumed = FALSE;
+		vcpu->preempted = FALSE;
 		vcpu->sched_priv = NULL;
 
 		/* Initialize static scheduling context */
@@ -1443,6 +1448,9 @@ struct vmm_guest *vmm_manager_guest_create(struct vmm_devtree_node *gnode)
 			goto fail_dref_vsnode;
 		}
 
+		/* Initialize exit accounting context */
+		vmm_vcpu_exit_stats_init(vcpu);
+
 		/* Initialize resource list */
 		INIT_SPIN_LOCK(&vcpu->res_lock);
 		INIT_LIST_HEAD(&vcpu->res_head);
@@ -1455,6 +1463,7 @@ struct vmm_guest *vmm_manager_guest_create(struct vmm_devtree_node *gnode)
 
 		/* Notify scheduler about new VCPU */
 		if (vmm_manager_vcpu_set_state(vcpu, VMM_VCPU_STATE_RESET)) {
+			vmm_vcpu_exit_stats_deinit(vcpu);
 			vmm_vcpu_irq_deinit(vcpu);
 			arch_vcpu_deinit(vcpu);
 			vmm_free((void *)vcpu->stack_va);
@@ -1572,6 +1581,9 @@ int vmm_manager_guest_destroy(struct vmm_guest *guest)
 		}
 		vcpu->sched_priv = NULL;
 
+		/* Deinit exit accounting context */
+		vmm_vcpu_exit_stats_deinit(vcpu);
+
 		/* Deinit Virtual IRQ context */
 		if ((rc = vmm_vcpu_irq_deinit(vcpu))) {
 			return rc;
@@ -1721,6 +1733,7 @@ int __init vmm_manager_init(void)
 		mngr.vcpu_array[vnum].name[0] = 0;
 		mngr.vcpu_array[vnum].node = NULL;
 		mngr.vcpu_array[vnum].is_normal = FALSE;
+		mngr.vcpu_array[vnum].exit_stats = NULL;
 		arch_atomic_write(&mngr.vcpu_array[vnum].state,
 				  VMM_VCPU_STATE_UNKNOWN);
 		mngr.vcpu_array[vnum].state_tstamp = 0;
@@ -23,10 +23,133 @@
 
 #include <vmm_error.h>
 #include <vmm_stdio.h>
+#include <vmm_smp.h>
+#include <vmm_timer.h>
 #include <vmm_scheduler.h>
 #include <vmm_mutex.h>
 #include <arch_cpu_irq.h>
 
+#ifdef CONFIG_MUTEX_PRIO_INHERIT
+
+/* Boost priority of mutex owner to priority of waiting VCPU */
+static void mutex_pi_boost(struct vmm_vcpu *owner, struct vmm_vcpu *waiter)
+{
+	if (owner && (owner->priority < waiter->priority)) {
+		vmm_scheduler_set_priority(owner, waiter->priority);
+	}
+}
+
+/*
+ * Restore priority of VCPU after releasing a mutex. The VCPU keeps
+ * the highest priority among VCPUs still waiting for other mutexes
+ * held by it.
+ * NOTE: Must be called after removing released mutex from VCPU
+ * resources.
+ */
+static void mutex_pi_restore(struct vmm_vcpu *vcpu)
+{
+	irq_flags_t flags;
+	struct vmm_vcpu *w;
+	struct vmm_mutex *mut;
+	struct vmm_vcpu_resource *res;
+	u8 priority = vcpu->base_priority;
+
+	if (vcpu->priority == priority) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave_lite(&vcpu->res_lock, flags);
+	list_for_each_entry(res, &vcpu->res_head, head) {
+		if (res->cleanup != __vmm_mutex_cleanup) {
+			continue;
+		}
+		mut = container_of(res, struct vmm_mutex, res);
+		vmm_spin_lock_lite(&mut->wq.lock);
+		list_for_each_entry(w, &mut->wq.vcpu_list, wq_head) {
+			if (priority < w->priority) {
+				priority = w->priority;
+			}
+		}
+		vmm_spin_unlock_lite(&mut->wq.lock);
+	}
+	vmm_spin_unlock_irqrestore_lite(&vcpu->res_lock, flags);
+
+	if (vcpu->priority != priority) {
+		vmm_scheduler_set_priority(vcpu, priority);
+	}
+}
+
+#else
+
+static inline void mutex_pi_boost(struct vmm_vcpu *owner,
+				  struct vmm_vcpu *waiter)
+{
+}
+
+static inline void mutex_pi_restore(struct vmm_vcpu *vcpu)
+{
+}
+
+#endif
+
+#if CONFIG_MUTEX_SPIN_NSECS > 0
+
+/* Check whether mutex owner is running on some other host CPU */
+static bool mutex_owner_running(struct vmm_vcpu *owner)
+{
+	if (!owner ||
+	    (arch_atomic_read(&owner->state) != VMM_VCPU_STATE_RUNNING)) {
+		return FALSE;
+	}
+
+	return (owner->hcpu != vmm_smp_processor_id()) ? TRUE : FALSE;
+}
+
+/*
+ * Optimistically spin (without holding waitqueue lock) as long as
+ * mutex owner does not change and keeps running on other host CPU.
+ * Returns TRUE if we should re-check the mutex instead of sleeping.
+ */
+static bool mutex_spin_on_owner(struct vmm_mutex *mut, irq_flags_t *flags,
+				u64 *spin_end)
+{
+	u64 now;
+	struct vmm_vcpu *owner = mut->owner;
+
+	if (!mutex_owner_running(owner)) {
+		return FALSE;
+	}
+
+	now = vmm_timer_timestamp();
+	if (!*spin_end) {
+		*spin_end = now + CONFIG_MUTEX_SPIN_NSECS;
+	} else if (*spin_end <= now) {
+		return FALSE;
+	}
+
+	vmm_spin_unlock_irqrestore(&mut->wq.lock, *flags);
+
+	while ((((volatile struct vmm_mutex *)mut)->owner == owner) &&
+	       mutex_owner_running(owner) &&
+	       (vmm_timer_timestamp() < *spin_end)) {
+		barrier();
+	}
+
+	vmm_spin_lock_irqsave(&mut->wq.lock, *flags);
+
+	return TRUE;
+}
+
+#else
+
+static inline bool mutex_spin_on_owner(struct vmm_mutex *mut,
+				       irq_flags_t *flags, u64 *spin_end)
+{
+	return FALSE;
+}
+
+#endif
+
 void __vmm_mutex_cleanup(struct vmm_vcpu *vcpu,
 			 struct vmm_vcpu_resource *vcpu_res)
 {
@@ -93,6 +216,7 @@ int vmm_mutex_unlock(struct vmm_mutex *mut)
 			mut->owner = NULL;
 			vmm_manager_vcpu_resource_remove(current_vcpu,
 							 &mut->res);
+			mutex_pi_restore(current_vcpu);
 			rc = __vmm_waitqueue_wakefirst(&mut->wq);
 			if (rc == VMM_ENOENT) {
 				rc = VMM_OK;
@@ -139,6 +263,7 @@ int vmm_mutex_trylock(struct vmm_mutex *mut)
 static int mutex_lock_common(struct vmm_mutex *mut, u64 *timeout)
 {
 	int rc = VMM_OK;
+	u64 spin_end = 0;
 	irq_flags_t flags;
 	struct vmm_vcpu *current_vcpu = vmm_scheduler_current_vcpu();
 
@@ -155,6 +280,16 @@ static int mutex_lock_common(struct vmm_mutex *mut, u64 *timeout)
 		if (mut->owner == current_vcpu) {
 			break;
 		}
+		/*
+		 * If owner is running on other host CPU then it will
+		 * release the lock soon so spin for a while instead of
+		 * going to sleep.
+		 */
+		if (mutex_spin_on_owner(mut, &flags, &spin_end)) {
+			continue;
+		}
+		/* Let owner inherit our priority before we sleep */
+		mutex_pi_boost(mut->owner, current_vcpu);
 		rc = __vmm_waitqueue_sleep(&mut->wq, timeout);
 		if (rc) {
 			/* Timeout or some other failure */
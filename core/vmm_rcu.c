@@ -0,0 +1,201 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_rcu.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief Implementation of read-copy-update (RCU) synchronization.
+ */
+
+#include <vmm_error.h>
+#include <vmm_smp.h>
+#include <vmm_percpu.h>
+#include <vmm_cpumask.h>
+#include <vmm_delay.h>
+#include <vmm_stdio.h>
+#include <vmm_spinlocks.h>
+#include <vmm_scheduler.h>
+#include <vmm_completion.h>
+#include <vmm_workqueue.h>
+#include <vmm_rcu.h>
+#include <arch_barrier.h>
+
+struct vmm_rcu_cpu {
+	u32 qs_count;
+};
+
+struct vmm_rcu_ctrl {
+	vmm_spinlock_t lock;
+	struct dlist pending_list;
+	struct vmm_work work;
+	struct vmm_workqueue *wq;
+};
+
+static DEFINE_PER_CPU(struct vmm_rcu_cpu, rcpu);
+static struct vmm_rcu_ctrl rctrl;
+
+void vmm_rcu_read_lock(void)
+{
+	vmm_scheduler_preempt_disable();
+	barrier();
+}
+
+void vmm_rcu_read_unlock(void)
+{
+	barrier();
+	vmm_scheduler_preempt_enable();
+}
+
+void vmm_rcu_note_qs(void)
+{
+	struct vmm_rcu_cpu *rcp = &this_cpu(rcpu);
+
+	/* Order prior read-side accesses before quiescent state */
+	arch_smp_mb();
+	rcp->qs_count++;
+}
+
+static u32 rcu_qs_count(u32 cpu)
+{
+	return *(volatile u32 *)&per_cpu(rcpu, cpu).qs_count;
+}
+
+void vmm_rcu_synchronize(void)
+{
+	bool done;
+	u32 cpu, curr_cpu;
+	u32 snap[CONFIG_CPU_COUNT];
+	struct vmm_cpumask wait_mask;
+
+	BUG_ON(!vmm_scheduler_orphan_context());
+
+	/* Order prior updates before sampling quiescent states */
+	arch_smp_mb();
+
+	curr_cpu = vmm_smp_processor_id();
+	vmm_cpumask_clear(&wait_mask);
+	for_each_online_cpu(cpu) {
+		if (cpu == curr_cpu) {
+			continue;
+		}
+		snap[cpu] = rcu_qs_count(cpu);
+		vmm_cpumask_set_cpu(cpu, &wait_mask);
+	}
+
+	while (1) {
+		done = TRUE;
+		for_each_cpu(cpu, &wait_mask) {
+			if (!vmm_cpu_online(cpu) ||
+			    (rcu_qs_count(cpu) != snap[cpu])) {
+				vmm_cpumask_clear_cpu(cpu, &wait_mask);
+				continue;
+			}
+
+			/* Kick lagging host CPU out of idle wait */
+			vmm_scheduler_force_resched(cpu);
+			done = FALSE;
+		}
+		if (done) {
+			break;
+		}
+
+		vmm_msleep(1);
+	}
+
+	/* Order quiescent states before subsequent updates */
+	arch_smp_mb();
+}
+
+static void rcu_work_func(struct vmm_work *work)
+{
+	irq_flags_t flags;
+	struct dlist *l;
+	struct vmm_rcu_head *rhead;
+	LIST_HEAD(done_list);
+
+	while (1) {
+		vmm_spin_lock_irqsave(&rctrl.lock, flags);
+		if (list_empty(&rctrl.pending_list)) {
+			vmm_spin_unlock_irqrestore(&rctrl.lock, flags);
+			break;
+		}
+		list_splice_init(&rctrl.pending_list, &done_list);
+		vmm_spin_unlock_irqrestore(&rctrl.lock, flags);
+
+		vmm_rcu_synchronize();
+
+		while (!list_empty(&done_list)) {
+			l = list_pop(&done_list);
+			rhead = list_entry(l, struct vmm_rcu_head, head);
+			rhead->func(rhead);
+		}
+	}
+}
+
+void vmm_rcu_call(struct vmm_rcu_head *rhead,
+		  void (*func)(struct vmm_rcu_head *))
+{
+	irq_flags_t flags;
+
+	BUG_ON(!rhead || !func);
+
+	rhead->func = func;
+
+	vmm_spin_lock_irqsave(&rctrl.lock, flags);
+	list_add_tail(&rhead->head, &rctrl.pending_list);
+	vmm_spin_unlock_irqrestore(&rctrl.lock, flags);
+
+	vmm_workqueue_schedule_work(rctrl.wq, &rctrl.work);
+}
+
+struct rcu_barrier_head {
+	struct vmm_rcu_head rhead;
+	struct vmm_completion done;
+};
+
+static void rcu_barrier_func(struct vmm_rcu_head *rhead)
+{
+	struct rcu_barrier_head *bh =
+		container_of(rhead, struct rcu_barrier_head, rhead);
+
+	vmm_completion_complete(&bh->done);
+}
+
+void vmm_rcu_barrier(void)
+{
+	struct rcu_barrier_head bh;
+
+	INIT_RCU_HEAD(&bh.rhead);
+	INIT_COMPLETION(&bh.done);
+
+	vmm_rcu_call(&bh.rhead, rcu_barrier_func);
+	vmm_completion_wait(&bh.done);
+}
+
+int __init vmm_rcu_init(void)
+{
+	INIT_SPIN_LOCK(&rctrl.lock);
+	INIT_LIST_HEAD(&rctrl.pending_list);
+	INIT_WORK(&rctrl.work, rcu_work_func);
+
+	rctrl.wq = vmm_workqueue_create("rcu", VMM_THREAD_DEF_PRIORITY);
+	if (!rctrl.wq) {
+		return VMM_ENOMEM;
+	}
+
+	return VMM_OK;
+}
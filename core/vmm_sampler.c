@@ -0,0 +1,419 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_sampler.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief source code of hypervisor sampling profiler
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_mutex.h>
+#include <vmm_percpu.h>
+#include <vmm_smp.h>
+#include <vmm_timer.h>
+#include <vmm_manager.h>
+#include <vmm_scheduler.h>
+#include <vmm_sampler.h>
+#include <arch_vcpu.h>
+#include <libs/kallsyms.h>
+#include <libs/log2.h>
+#include <libs/stringlib.h>
+
+#define SAMPLER_HASH_SIZE	CONFIG_PROFILE_SAMPLING_HASH_SIZE
+#define SAMPLER_HASH_MASK	(SAMPLER_HASH_SIZE - 1)
+#define SAMPLER_HASH_PROBES	16
+
+#if (SAMPLER_HASH_SIZE & SAMPLER_HASH_MASK)
+#error "CONFIG_PROFILE_SAMPLING_HASH_SIZE must be power of two"
+#endif
+
+extern u8 _code_end;
+
+struct sampler_cpu {
+	struct vmm_timer_event ev;
+	struct vmm_sampler_stats stats;
+	u32 *vcpu_samples;
+	struct vmm_sampler_entry *table;
+};
+
+struct sampler_ctrl {
+	struct vmm_mutex lock;
+	bool initialized;
+	bool active;
+	u64 period_nsecs;
+	u32 depth;
+};
+
+static DEFINE_PER_CPU(struct sampler_cpu, scpu);
+static struct sampler_ctrl sctrl = {
+	.lock = __MUTEX_INITIALIZER(sctrl.lock),
+};
+
+static inline u32 sampler_hash(u32 sym)
+{
+	return (sym * 2654435761U);
+}
+
+static struct vmm_sampler_entry *sampler_find(struct vmm_sampler_entry *tbl,
+					      u32 mask, u32 probes, u32 sym)
+{
+	u32 i, idx = sampler_hash(sym) & mask;
+
+	for (i = 0; i < probes; i++) {
+		if (tbl[idx].sym == sym) {
+			return &tbl[idx];
+		}
+		if (!tbl[idx].sym) {
+			tbl[idx].sym = sym;
+			return &tbl[idx];
+		}
+		idx = (idx + 1) & mask;
+	}
+
+	return NULL;
+}
+
+static u32 sampler_addr2sym(virtual_addr_t addr)
+{
+	if (!kallsyms_num_syms ||
+	    (addr < kallsyms_addresses[0]) ||
+	    ((virtual_addr_t)&_code_end <= addr)) {
+		return VMM_SAMPLER_SYM_UNKNOWN;
+	}
+
+	return kallsyms_get_symbol_pos(addr, NULL, NULL) + 1;
+}
+
+void vmm_sampler_sample(arch_regs_t *regs)
+{
+	bool seen;
+	u32 d, i, nsyms = 0, syms[VMM_SAMPLER_MAX_DEPTH];
+	virtual_addr_t pc, fp, prev_fp;
+	virtual_addr_t stack_lo = 0, stack_hi = 0;
+	struct vmm_sampler_entry *e;
+	struct sampler_cpu *sc = &this_cpu(scpu);
+	struct vmm_vcpu *vcpu = vmm_scheduler_current_vcpu();
+
+	if (!sctrl.active || !sc->table) {
+		return;
+	}
+
+	sc->stats.samples++;
+	if (!regs) {
+		sc->stats.no_regs++;
+		return;
+	}
+
+	if (arch_vcpu_regs_sample(regs, &pc, &fp)) {
+		sc->stats.guest++;
+		if (vcpu && vcpu->is_normal &&
+		    vcpu->id < CONFIG_MAX_VCPU_COUNT) {
+			sc->vcpu_samples[vcpu->id]++;
+		}
+		return;
+	}
+
+	if (vcpu && vcpu->is_normal) {
+		sc->stats.hyp_vcpu++;
+	} else {
+		sc->stats.hyp_orphan++;
+	}
+	if (vcpu) {
+		stack_lo = vcpu->stack_va;
+		stack_hi = vcpu->stack_va + vcpu->stack_sz;
+	}
+
+	for (d = 0; d < sctrl.depth; d++) {
+		if (d) {
+			prev_fp = fp;
+			if (!stack_hi ||
+			    arch_vcpu_unwind_frame(stack_lo, stack_hi,
+						   &fp, &pc) ||
+			    (fp <= prev_fp)) {
+				break;
+			}
+		}
+
+		syms[nsyms] = sampler_addr2sym(pc);
+
+		/* Count recursive callers only once per sample */
+		seen = FALSE;
+		for (i = 0; i < nsyms; i++) {
+			if (syms[i] == syms[nsyms]) {
+				seen = TRUE;
+				break;
+			}
+		}
+		if (seen) {
+			continue;
+		}
+
+		e = sampler_find(sc->table, SAMPLER_HASH_MASK,
+				 SAMPLER_HASH_PROBES, syms[nsyms]);
+		if (!e) {
+			sc->stats.dropped++;
+			break;
+		}
+		if (!d) {
+			e->self++;
+		}
+		e->total++;
+		nsyms++;
+	}
+}
+
+static void sampler_timer_handler(struct vmm_timer_event *ev)
+{
+	if (!sctrl.active) {
+		return;
+	}
+
+	vmm_sampler_sample(vmm_scheduler_irq_regs());
+
+	vmm_timer_event_start(ev, sctrl.period_nsecs);
+}
+
+static void sampler_start_cpu(void *arg0, void *arg1, void *arg2)
+{
+	struct sampler_cpu *sc = &this_cpu(scpu);
+
+	vmm_timer_event_start(&sc->ev, sctrl.period_nsecs);
+}
+
+static void sampler_stop_cpu(void *arg0, void *arg1, void *arg2)
+{
+	struct sampler_cpu *sc = &this_cpu(scpu);
+
+	vmm_timer_event_stop(&sc->ev);
+}
+
+static int sampler_alloc(void)
+{
+	u32 c;
+	struct sampler_cpu *sc;
+
+	for_each_possible_cpu(c) {
+		sc = &per_cpu(scpu, c);
+		if (!sctrl.initialized) {
+			INIT_TIMER_EVENT(&sc->ev, sampler_timer_handler, sc);
+		}
+		if (!sc->table) {
+			sc->table = vmm_zalloc(SAMPLER_HASH_SIZE *
+					       sizeof(*sc->table));
+			if (!sc->table) {
+				return VMM_ENOMEM;
+			}
+		}
+		if (!sc->vcpu_samples) {
+			sc->vcpu_samples = vmm_zalloc(CONFIG_MAX_VCPU_COUNT *
+						      sizeof(u32));
+			if (!sc->vcpu_samples) {
+				return VMM_ENOMEM;
+			}
+		}
+	}
+	sctrl.initialized = TRUE;
+
+	return VMM_OK;
+}
+
+bool vmm_sampler_isactive(void)
+{
+	return sctrl.active;
+}
+
+u64 vmm_sampler_period(void)
+{
+	return sctrl.period_nsecs;
+}
+
+u32 vmm_sampler_depth(void)
+{
+	return sctrl.depth;
+}
+
+int vmm_sampler_start(u64 period_nsecs, u32 depth)
+{
+	int rc;
+	u32 c;
+	struct sampler_cpu *sc;
+
+	if (period_nsecs < VMM_SAMPLER_MIN_PERIOD_NSECS ||
+	    !depth || VMM_SAMPLER_MAX_DEPTH < depth) {
+		return VMM_EINVALID;
+	}
+
+	vmm_mutex_lock(&sctrl.lock);
+
+	if (sctrl.active) {
+		vmm_mutex_unlock(&sctrl.lock);
+		return VMM_EBUSY;
+	}
+
+	rc = sampler_alloc();
+	if (rc) {
+		vmm_mutex_unlock(&sctrl.lock);
+		return rc;
+	}
+
+	for_each_possible_cpu(c) {
+		sc = &per_cpu(scpu, c);
+		memset(&sc->stats, 0, sizeof(sc->stats));
+		memset(sc->vcpu_samples, 0,
+		       CONFIG_MAX_VCPU_COUNT * sizeof(u32));
+		memset(sc->table, 0, SAMPLER_HASH_SIZE * sizeof(*sc->table));
+	}
+
+	sctrl.period_nsecs = period_nsecs;
+	sctrl.depth = depth;
+	sctrl.active = TRUE;
+
+	vmm_smp_ipi_sync_call(cpu_online_mask, 1000,
+			      sampler_start_cpu, NULL, NULL, NULL);
+
+	vmm_mutex_unlock(&sctrl.lock);
+
+	return VMM_OK;
+}
+
+int vmm_sampler_stop(void)
+{
+	vmm_mutex_lock(&sctrl.lock);
+
+	if (!sctrl.active) {
+		vmm_mutex_unlock(&sctrl.lock);
+		return VMM_EINVALID;
+	}
+
+	sctrl.active = FALSE;
+
+	vmm_smp_ipi_sync_call(cpu_online_mask, 1000,
+			      sampler_stop_cpu, NULL, NULL, NULL);
+
+	vmm_mutex_unlock(&sctrl.lock);
+
+	return VMM_OK;
+}
+
+int vmm_sampler_get_stats(u32 cpu, struct vmm_sampler_stats *st)
+{
+	if (CONFIG_CPU_COUNT <= cpu || !st) {
+		return VMM_EINVALID;
+	}
+
+	memcpy(st, &per_cpu(scpu, cpu).stats, sizeof(*st));
+
+	return VMM_OK;
+}
+
+u64 vmm_sampler_vcpu_samples(u32 vcpu_id)
+{
+	u32 c;
+	u64 ret = 0;
+	struct sampler_cpu *sc;
+
+	if (CONFIG_MAX_VCPU_COUNT <= vcpu_id) {
+		return 0;
+	}
+
+	for_each_possible_cpu(c) {
+		sc = &per_cpu(scpu, c);
+		if (sc->vcpu_samples) {
+			ret += sc->vcpu_samples[vcpu_id];
+		}
+	}
+
+	return ret;
+}
+
+int vmm_sampler_snapshot(struct vmm_sampler_entry **entries, u32 *count)
+{
+	u32 c, i, n, size;
+	struct sampler_cpu *sc;
+	struct vmm_sampler_entry *tbl, *e, *ret;
+
+	if (!entries || !count) {
+		return VMM_EINVALID;
+	}
+
+	/*
+	 * More slots than symbols and probed across the whole table so
+	 * every symbol finds a slot. Samples which did not fit in the
+	 * per-CPU tables are counted in vmm_sampler_stats.dropped.
+	 */
+	size = roundup_pow_of_two(2 * (kallsyms_num_syms + 1));
+	tbl = vmm_zalloc(size * sizeof(*tbl));
+	if (!tbl) {
+		return VMM_ENOMEM;
+	}
+
+	n = 0;
+	for_each_possible_cpu(c) {
+		sc = &per_cpu(scpu, c);
+		if (!sc->table) {
+			continue;
+		}
+		for (i = 0; i < SAMPLER_HASH_SIZE; i++) {
+			if (!sc->table[i].sym) {
+				continue;
+			}
+			e = sampler_find(tbl, size - 1, size,
+					 sc->table[i].sym);
+			if (!e) {
+				continue;
+			}
+			if (!e->self && !e->total) {
+				n++;
+			}
+			e->self += sc->table[i].self;
+			e->total += sc->table[i].total;
+		}
+	}
+
+	ret = vmm_malloc((n ? n : 1) * sizeof(*ret));
+	if (!ret) {
+		vmm_free(tbl);
+		return VMM_ENOMEM;
+	}
+
+	n = 0;
+	for (i = 0; i < size; i++) {
+		if (tbl[i].sym) {
+			memcpy(&ret[n++], &tbl[i], sizeof(*ret));
+		}
+	}
+	vmm_free(tbl);
+
+	*entries = ret;
+	*count = n;
+
+	return VMM_OK;
+}
+
+const char *vmm_sampler_entry_name(struct vmm_sampler_entry *e, char *buf)
+{
+	if (!e || !e->sym || e->sym == VMM_SAMPLER_SYM_UNKNOWN) {
+		return "[unknown]";
+	}
+
+	buf[0] = buf[KSYM_NAME_LEN - 1] = '\0';
+	kallsyms_expand_symbol(kallsyms_get_symbol_offset(e->sym - 1), buf);
+
+	return buf;
+}
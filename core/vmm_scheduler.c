@@ -31,6 +31,8 @@
 #include <vmm_timer.h>
 #include <vmm_schedalgo.h>
 #include <vmm_scheduler.h>
+#include <vmm_rcu.h>
+#include <vmm_trace.h>
 #include <vmm_stdio.h>
 #include <arch_regs.h>
 #include <arch_cpu_irq.h>
@@ -131,6 +133,20 @@ static bool rq_prempt_needed(struct vmm_scheduler_ctrl *schedp)
 	return ret;
 }
 
+/* NOTE: Must be called with vcpu->sched_lock held */
+static int rq_boost(struct vmm_scheduler_ctrl *schedp,
+		    struct vmm_vcpu *vcpu)
+{
+	int ret;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave_lite(&schedp->rq_lock, flags);
+	ret = vmm_schedalgo_rq_boost(schedp->rq, vcpu);
+	vmm_spin_unlock_irqrestore_lite(&schedp->rq_lock, flags);
+
+	return ret;
+}
+
 static u32 rq_length(struct vmm_scheduler_ctrl *schedp, u32 priority)
 {
 	u32 ret;
@@ -161,10 +177,12 @@ static struct vmm_vcpu *__vmm_scheduler_next1(struct vmm_scheduler_ctrl *schedp,
 
 	vmm_write_lock_irqsave_lite(&next->sched_lock, nf);
 
+	vmm_trace(VMM_TRACE_SCHED_SWITCH, next->id, ~0ULL, next_time_slice);
 	arch_vcpu_switch(NULL, next, regs);
 	next->state_ready_nsecs += tstamp - next->state_tstamp;
 	arch_atomic_write(&next->state, VMM_VCPU_STATE_RUNNING);
 	next->resumed = FALSE;
+	next->preempted = FALSE;
 	next->state_tstamp = tstamp;
 	schedp->current_vcpu = next;
 	schedp->current_vcpu_irq_ns = schedp->irq_process_ns;
@@ -210,6 +228,10 @@ static struct vmm_vcpu *__vmm_scheduler_next2(struct vmm_scheduler_ctrl *schedp,
 			__vmm_scheduler_sync_system_time(schedp, current);
 			current->state_running_nsecs +=
 				tstamp - current->state_tstamp;
+			/* Resumed flag is set when current VCPU yields so
+			 * only involuntary switch marks it as preempted.
+			 */
+			current->preempted = !current->resumed;
 			arch_atomic_write(&current->state, VMM_VCPU_STATE_READY);
 			current->state_tstamp = tstamp;
 			rq_enqueue(schedp, current);
@@ -239,12 +261,15 @@ dequeue_again:
 			vmm_write_unlock_irqrestore_lite(&next->sched_lock, nf);
 			goto dequeue_again;
 		}
+		vmm_trace(VMM_TRACE_SCHED_SWITCH,
+			  next->id, current->id, next_time_slice);
 		arch_vcpu_switch(tcurrent, next, regs);
 	}
 
 	next->state_ready_nsecs += tstamp - next->state_tstamp;
 	arch_atomic_write(&next->state, VMM_VCPU_STATE_RUNNING);
 	next->resumed = FALSE;
+	next->preempted = FALSE;
 	next->state_tstamp = tstamp;
 	schedp->current_vcpu = next;
 	schedp->current_vcpu_irq_ns = schedp->irq_process_ns;
@@ -275,6 +300,7 @@ static void vmm_scheduler_switch(struct vmm_scheduler_ctrl *schedp,
 		if (current->preempt_count == preempt_min) {
 			irq_flags_t cf;
 
+			vmm_rcu_note_qs();
 			vmm_write_lock_irqsave_lite(&current->sched_lock, cf);
 			next = __vmm_scheduler_next2(schedp, current, regs);
 			vmm_write_unlock_irqrestore_lite(&current->sched_lock,
@@ -294,6 +320,7 @@ static void vmm_scheduler_switch(struct vmm_scheduler_ctrl *schedp,
 			next = NULL;
 		}
 	} else {
+		vmm_rcu_note_qs();
 		next = __vmm_scheduler_next1(schedp, regs);
 	}
 
@@ -549,8 +576,9 @@ int vmm_scheduler_state_change(struct vmm_vcpu *vcpu, u32 new_state)
 			rc = vmm_schedalgo_vcpu_setup(vcpu);
 		} else if (current_state != VMM_VCPU_STATE_RESET) {
 			/* Existing VCPU */
-			/* Clear resumed flag */
+			/* Clear resumed and preempted flags */
 			vcpu->resumed = FALSE;
+			vcpu->preempted = FALSE;
 			/* Make sure VCPU is not in a ready queue */
 			if ((schedp->current_vcpu != vcpu) &&
 			    (current_state == VMM_VCPU_STATE_READY)) {
@@ -813,6 +841,80 @@ int vmm_scheduler_set_hcpu(struct vmm_vcpu *vcpu, u32 hcpu)
 	return VMM_OK;
 }
 
+static void scheduler_ipi_set_priority(void *arg0, void *arg1, void *arg2)
+{
+	irq_flags_t flags;
+	u32 hcpu = vmm_smp_processor_id();
+	u8 priority = (u8)(virtual_addr_t)arg1;
+	struct vmm_vcpu *vcpu = arg0;
+	struct vmm_scheduler_ctrl *schedp = &this_cpu(sched);
+
+	/* Lock VCPU scheduling */
+	vmm_write_lock_irqsave_lite(&vcpu->sched_lock, flags);
+
+	/* The VCPU migrated meanwhile so retry on its new hcpu */
+	if (vcpu->hcpu != hcpu) {
+		vmm_write_unlock_irqrestore_lite(&vcpu->sched_lock, flags);
+		vmm_scheduler_set_priority(vcpu, priority);
+		return;
+	}
+
+	/* Re-queue READY VCPU as per new priority */
+	if ((arch_atomic_read(&vcpu->state) == VMM_VCPU_STATE_READY) &&
+	    (schedp->current_vcpu != vcpu)) {
+		rq_detach(schedp, vcpu);
+		vcpu->priority = priority;
+		rq_enqueue(schedp, vcpu);
+	} else {
+		vcpu->priority = priority;
+	}
+
+	/* Unlock VCPU scheduling */
+	vmm_write_unlock_irqrestore_lite(&vcpu->sched_lock, flags);
+
+	if (schedp->irq_regs && rq_prempt_needed(schedp)) {
+		vmm_scheduler_switch(schedp, schedp->irq_regs);
+	}
+}
+
+int vmm_scheduler_set_priority(struct vmm_vcpu *vcpu, u8 priority)
+{
+	u32 hcpu, state;
+	irq_flags_t flags;
+
+	if (!vcpu ||
+	    (priority < VMM_VCPU_MIN_PRIORITY) ||
+	    (VMM_VCPU_MAX_PRIORITY < priority)) {
+		return VMM_EINVALID;
+	}
+
+	/* Lock VCPU scheduling */
+	vmm_write_lock_irqsave_lite(&vcpu->sched_lock, flags);
+
+	/*
+	 * Only a READY VCPU sits in ready queue of its host CPU so
+	 * for other states we simply update priority. The ready
+	 * queue is only updated on the host CPU which owns it.
+	 */
+	state = arch_atomic_read(&vcpu->state);
+	if ((vcpu->priority == priority) ||
+	    (state != VMM_VCPU_STATE_READY)) {
+		vcpu->priority = priority;
+		vmm_write_unlock_irqrestore_lite(&vcpu->sched_lock, flags);
+		return VMM_OK;
+	}
+	hcpu = vcpu->hcpu;
+
+	/* Unlock VCPU scheduling */
+	vmm_write_unlock_irqrestore_lite(&vcpu->sched_lock, flags);
+
+	vmm_smp_ipi_async_call(vmm_cpumask_of(hcpu),
+			       scheduler_ipi_set_priority, vcpu,
+			       (void *)(virtual_addr_t)priority, NULL);
+
+	return VMM_OK;
+}
+
 void vmm_scheduler_irq_enter(arch_regs_t *regs, bool vcpu_context)
 {
 	struct vmm_scheduler_ctrl *schedp = &this_cpu(sched);
@@ -1081,11 +1183,90 @@ void vmm_scheduler_yield(void)
 	}
 }
 
+int vmm_scheduler_yield_to(struct vmm_vcpu *vcpu)
+{
+	int rc;
+	irq_flags_t flags;
+	struct vmm_scheduler_ctrl *schedp = &this_cpu(sched);
+
+	if (!vcpu || (vcpu == schedp->current_vcpu)) {
+		return VMM_EINVALID;
+	}
+
+	if (schedp->irq_context) {
+		vmm_panic("%s: Cannot yield in IRQ context\n", __func__);
+	}
+
+	/* Boost target VCPU only if it is waiting in a ready queue */
+	vmm_read_lock_irqsave_lite(&vcpu->sched_lock, flags);
+	if (arch_atomic_read(&vcpu->state) == VMM_VCPU_STATE_READY) {
+		rc = rq_boost(&per_cpu(sched, vcpu->hcpu), vcpu);
+	} else {
+		rc = VMM_ENOTAVAIL;
+	}
+	vmm_read_unlock_irqrestore_lite(&vcpu->sched_lock, flags);
+	if (rc) {
+		return rc;
+	}
+
+	/*
+	 * Boosted VCPU on same host CPU runs right after current VCPU
+	 * yields whereas boosted VCPU on other host CPU runs on next
+	 * scheduling point of that host CPU.
+	 */
+	vmm_scheduler_yield();
+
+	return VMM_OK;
+}
+
+int vmm_scheduler_yield_to_preempted(void)
+{
+	int rc;
+	struct vmm_vcpu *tmp, *target = NULL;
+	struct vmm_vcpu *vcpu = this_cpu(sched).current_vcpu;
+
+	if (!vcpu || !vcpu->is_normal) {
+		return VMM_EINVALID;
+	}
+
+	/*
+	 * Pick a sibling VCPU which was preempted (not halted or yielding)
+	 * because it is likely to be holding the lock current VCPU is
+	 * spinning on. The search starts after current VCPU so that
+	 * spinning VCPUs of a guest boost different siblings.
+	 */
+	vmm_manager_for_each_guest_vcpu(tmp, vcpu->guest) {
+		if ((tmp == vcpu) || !tmp->preempted ||
+		    (arch_atomic_read(&tmp->state) != VMM_VCPU_STATE_READY)) {
+			continue;
+		}
+		if (tmp->subid > vcpu->subid) {
+			target = tmp;
+			break;
+		}
+		if (!target) {
+			target = tmp;
+		}
+	}
+
+	rc = (target) ? vmm_scheduler_yield_to(target) : VMM_ENOTAVAIL;
+	if (rc) {
+		/* Nobody to boost so simply give-up time slice */
+		vmm_scheduler_yield();
+	}
+
+	return rc;
+}
+
 static void idle_orphan(void)
 {
 	struct vmm_scheduler_ctrl *schedp = &this_cpu(sched);
 
 	while (1) {
+		if (rq_length(schedp, IDLE_VCPU_PRIORITY) == 0) {
+			vmm_vcpu_irq_halt_poll();
+		}
+
 		if (rq_length(schedp, IDLE_VCPU_PRIORITY) == 0) {
 			arch_cpu_wait_for_irq();
 		}
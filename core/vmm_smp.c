@@ -22,6 +22,7 @@
  */
 
 #include <vmm_error.h>
+#include <vmm_heap.h>
 #include <vmm_limits.h>
 #include <vmm_percpu.h>
 #include <vmm_smp.h>
@@ -31,7 +32,11 @@
 #include <vmm_timer.h>
 #include <vmm_completion.h>
 #include <vmm_manager.h>
-#include <libs/fifo.h>
+#include <vmm_trace.h>
+#include <arch_cpu_irq.h>
+#include <arch_barrier.h>
+#include <libs/log2.h>
+#include <libs/stringlib.h>
 
 /* SMP processor ID for Boot CPU */
 static u32 smp_bootcpu_id = UINT_MAX;
@@ -96,6 +101,12 @@ bool vmm_smp_is_bootcpu(void)
  */
 #define SMP_IPI_MAX_ASYNC_PER_CPU	(64)
 
+/* Maximum Sync IPI calls in-flight from a host CPU. This
+ * covers nested Sync IPI calls from interrupt context and
+ * calls abandoned after timeout which are yet to finish.
+ */
+#define SMP_IPI_MAX_WAIT_PER_CPU	(16)
+
 #define SMP_IPI_WAIT_TRY_COUNT		100
 #define SMP_IPI_WAIT_UDELAY		1000
 
@@ -105,6 +116,11 @@ bool vmm_smp_is_bootcpu(void)
 #define IPI_VCPU_DEADLINE 		VMM_VCPU_DEF_DEADLINE
 #define IPI_VCPU_PERIODICITY		VMM_VCPU_DEF_PERIODICITY
 
+struct smp_ipi_wait {
+	bool owned;
+	atomic_t pending;
+};
+
 struct smp_ipi_call {
 	u32 src_cpu;
 	u32 dst_cpu;
@@ -112,61 +128,203 @@ struct smp_ipi_call {
 	void *arg0;
 	void *arg1;
 	void *arg2;
+	struct smp_ipi_wait *wait;
+};
+
+/* Lock-free multi-producer single-consumer IPI queue
+ *
+ * Each slot has a sequence number telling whether it is free
+ * for the producer claiming given enqueue position or filled
+ * for the consumer at given dequeue position. Producers claim
+ * a position using cmpxchg whereas only the destination host
+ * CPU consumes hence dequeue position is a plain counter.
+ *
+ * Positions and sequence numbers are 32-bit free running
+ * counters (atomic_t is 32-bit wide on some architectures)
+ * which are compared using wrap-around safe differences.
+ */
+struct smp_ipi_slot {
+	atomic_t seq;
+	struct smp_ipi_call call;
+};
+
+struct smp_ipi_queue {
+	atomic_t enqueue_pos;
+	u32 dequeue_pos;
+	u32 slot_count;
+	struct smp_ipi_slot *slots;
 };
 
 struct smp_ipi_ctrl {
-	struct fifo *sync_fifo;
-	struct fifo *async_fifo;
+	struct smp_ipi_queue sync_q;
+	struct smp_ipi_queue async_q;
+	atomic_t ipi_pending;
+	struct smp_ipi_wait waits[SMP_IPI_MAX_WAIT_PER_CPU];
 	struct vmm_completion async_avail;
 	struct vmm_vcpu *async_vcpu;
 };
 
 static DEFINE_PER_CPU(struct smp_ipi_ctrl, ictl);
 
-static void smp_ipi_sync_submit(struct smp_ipi_ctrl *ictlp,
-				struct smp_ipi_call *ipic)
+static int smp_ipi_queue_init(struct smp_ipi_queue *q, u32 count)
 {
-	int try;
+	u32 i;
 
-	if (!ipic || !ipic->func) {
-		return;
+	q->slot_count = roundup_pow_of_two(count);
+	q->slots = vmm_zalloc(q->slot_count * sizeof(*q->slots));
+	if (!q->slots) {
+		return VMM_ENOMEM;
 	}
 
-	try = SMP_IPI_WAIT_TRY_COUNT;
-	while (!fifo_enqueue(ictlp->sync_fifo, ipic, FALSE) && try) {
-		arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
-		vmm_udelay(SMP_IPI_WAIT_UDELAY);
-		try--;
+	for (i = 0; i < q->slot_count; i++) {
+		ARCH_ATOMIC_INIT(&q->slots[i].seq, i);
 	}
+	ARCH_ATOMIC_INIT(&q->enqueue_pos, 0);
+	q->dequeue_pos = 0;
+
+	return VMM_OK;
+}
+
+static void smp_ipi_queue_free(struct smp_ipi_queue *q)
+{
+	vmm_free(q->slots);
+	q->slots = NULL;
+}
 
-	if (!try) {
-		vmm_panic("CPU%d: IPI sync fifo full\n", ipic->dst_cpu);
+/* Must be called with interrupts disabled so that a claimed
+ * slot is always filled without being interrupted.
+ */
+static bool smp_ipi_enqueue(struct smp_ipi_queue *q,
+			    struct smp_ipi_call *ipic)
+{
+	s32 diff;
+	u32 pos;
+	struct smp_ipi_slot *slot;
+
+	pos = (u32)arch_atomic_read(&q->enqueue_pos);
+	while (1) {
+		slot = &q->slots[pos & (q->slot_count - 1)];
+		diff = (s32)((u32)arch_atomic_read(&slot->seq) - pos);
+		if (!diff) {
+			if ((u32)arch_atomic_cmpxchg(&q->enqueue_pos,
+						     pos, (u32)(pos + 1)) == pos) {
+				break;
+			}
+		} else if (diff < 0) {
+			/* Queue is full */
+			return FALSE;
+		}
+		pos = (u32)arch_atomic_read(&q->enqueue_pos);
 	}
 
-	arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
+	slot->call = *ipic;
+	arch_smp_wmb();
+	arch_atomic_write(&slot->seq, (u32)(pos + 1));
+
+	return TRUE;
 }
 
-static void smp_ipi_async_submit(struct smp_ipi_ctrl *ictlp,
-				 struct smp_ipi_call *ipic)
+/* Must be called only from destination host CPU */
+static bool smp_ipi_dequeue(struct smp_ipi_queue *q,
+			    struct smp_ipi_call *ipic)
 {
-	int try;
+	u32 pos = q->dequeue_pos;
+	struct smp_ipi_slot *slot = &q->slots[pos & (q->slot_count - 1)];
 
-	if (!ipic || !ipic->func) {
-		return;
+	if ((u32)arch_atomic_read(&slot->seq) != (u32)(pos + 1)) {
+		return FALSE;
+	}
+	arch_smp_rmb();
+
+	*ipic = slot->call;
+	arch_smp_mb();
+	arch_atomic_write(&slot->seq, (u32)(pos + q->slot_count));
+	q->dequeue_pos = pos + 1;
+
+	return TRUE;
+}
+
+static bool smp_ipi_queue_isempty(struct smp_ipi_queue *q)
+{
+	u32 pos = q->dequeue_pos;
+	struct smp_ipi_slot *slot = &q->slots[pos & (q->slot_count - 1)];
+
+	return ((u32)arch_atomic_read(&slot->seq) != (u32)(pos + 1)) ?
+		TRUE : FALSE;
+}
+
+/* Returns TRUE if caller has to trigger hardware IPI to the
+ * destination host CPU and FALSE if an IPI is already pending
+ * which will process newly queued calls as well.
+ */
+static bool smp_ipi_mark_pending(struct smp_ipi_ctrl *ictlp)
+{
+	/* Order queued call before checking pending state */
+	arch_smp_mb();
+
+	if (arch_atomic_read(&ictlp->ipi_pending)) {
+		return FALSE;
 	}
 
+	return (arch_atomic_cmpxchg(&ictlp->ipi_pending, 0, 1) == 0) ?
+		TRUE : FALSE;
+}
+
+static struct smp_ipi_wait *smp_ipi_wait_alloc(struct smp_ipi_ctrl *ictlp)
+{
+	u32 i;
+	irq_flags_t flags;
+	struct smp_ipi_wait *w = NULL;
+
+	arch_cpu_irq_save(flags);
+	for (i = 0; i < SMP_IPI_MAX_WAIT_PER_CPU; i++) {
+		if (!ictlp->waits[i].owned &&
+		    !arch_atomic_read(&ictlp->waits[i].pending)) {
+			w = &ictlp->waits[i];
+			w->owned = TRUE;
+			break;
+		}
+	}
+	arch_cpu_irq_restore(flags);
+
+	return w;
+}
+
+static void smp_ipi_wait_free(struct smp_ipi_wait *w)
+{
+	/* Late completions of timed-out calls release the slot */
+	w->owned = FALSE;
+}
+
+static void smp_ipi_submit(struct smp_ipi_queue *q,
+			   struct smp_ipi_call *ipic, bool sync)
+{
+	int try;
+	bool ok;
+	irq_flags_t flags;
+
 	try = SMP_IPI_WAIT_TRY_COUNT;
-	while (!fifo_enqueue(ictlp->async_fifo, ipic, FALSE) && try) {
+	while (1) {
+		arch_cpu_irq_save(flags);
+		ok = smp_ipi_enqueue(q, ipic);
+		arch_cpu_irq_restore(flags);
+		if (ok || !try) {
+			break;
+		}
+
+		/* Queue is full so kick destination and retry */
 		arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
 		vmm_udelay(SMP_IPI_WAIT_UDELAY);
 		try--;
 	}
 
-	if (!try) {
-		vmm_panic("CPU%d: IPI async fifo full\n", ipic->dst_cpu);
+	if (!ok) {
+		vmm_panic("CPU%d: IPI %s queue full\n", ipic->dst_cpu,
+			  (sync) ? "sync" : "async");
 	}
 
-	arch_smp_ipi_trigger(vmm_cpumask_of(ipic->dst_cpu));
+	vmm_trace(VMM_TRACE_IPI_SEND, ipic->dst_cpu,
+		  (virtual_addr_t)ipic->func, (sync) ? 1 : 0);
 }
 
 static void smp_ipi_main(void)
@@ -179,8 +337,10 @@ static void smp_ipi_main(void)
 		vmm_completion_wait(&ictlp->async_avail);
 
 		/* Process async IPIs */
-		while (fifo_dequeue(ictlp->async_fifo, &ipic)) {
+		while (smp_ipi_dequeue(&ictlp->async_q, &ipic)) {
 			if (ipic.func) {
+				vmm_trace(VMM_TRACE_IPI_RECV, ipic.src_cpu,
+					  (virtual_addr_t)ipic.func, 0);
 				ipic.func(ipic.arg0, ipic.arg1, ipic.arg2);
 			}
 		}
@@ -192,15 +352,25 @@ void vmm_smp_ipi_exec(void)
 	struct smp_ipi_call ipic;
 	struct smp_ipi_ctrl *ictlp = &this_cpu(ictl);
 
+	/* Allow new IPIs before looking at the queues */
+	arch_atomic_write(&ictlp->ipi_pending, 0);
+	arch_smp_mb();
+
 	/* Process Sync IPIs */
-	while (fifo_dequeue(ictlp->sync_fifo, &ipic)) {
+	while (smp_ipi_dequeue(&ictlp->sync_q, &ipic)) {
 		if (ipic.func) {
+			vmm_trace(VMM_TRACE_IPI_RECV, ipic.src_cpu,
+				  (virtual_addr_t)ipic.func, 1);
 			ipic.func(ipic.arg0, ipic.arg1, ipic.arg2);
 		}
+		if (ipic.wait) {
+			arch_smp_mb();
+			arch_atomic_sub(&ipic.wait->pending, 1);
+		}
 	}
 
 	/* Signal IPI available event */
-	if (!fifo_isempty(ictlp->async_fifo)) {
+	if (!smp_ipi_queue_isempty(&ictlp->async_q)) {
 		vmm_completion_complete(&ictlp->async_avail);
 	}
 }
@@ -210,29 +380,44 @@ void vmm_smp_ipi_async_call(const struct vmm_cpumask *dest,
 			     void *arg0, void *arg1, void *arg2)
 {
 	u32 c, cpu = vmm_smp_processor_id();
+	struct vmm_cpumask trig_mask = VMM_CPU_MASK_NONE;
 	struct smp_ipi_call ipic;
+	struct smp_ipi_ctrl *ictlp;
+	bool trig = FALSE;
 
 	if (!dest || !func) {
 		return;
 	}
 
+	ipic.src_cpu = cpu;
+	ipic.func = func;
+	ipic.arg0 = arg0;
+	ipic.arg1 = arg1;
+	ipic.arg2 = arg2;
+	ipic.wait = NULL;
+
 	for_each_cpu(c, dest) {
-		if (c == cpu) {
-			func(arg0, arg1, arg2);
-		} else {
-			if (!vmm_cpu_online(c)) {
-				continue;
-			}
+		if (c == cpu || !vmm_cpu_online(c)) {
+			continue;
+		}
 
-			ipic.src_cpu = cpu;
-			ipic.dst_cpu = c;
-			ipic.func = func;
-			ipic.arg0 = arg0;
-			ipic.arg1 = arg1;
-			ipic.arg2 = arg2;
-			smp_ipi_async_submit(&per_cpu(ictl, c), &ipic);
+		ictlp = &per_cpu(ictl, c);
+		ipic.dst_cpu = c;
+		smp_ipi_submit(&ictlp->async_q, &ipic, FALSE);
+		if (smp_ipi_mark_pending(ictlp)) {
+			vmm_cpumask_set_cpu(c, &trig_mask);
+			trig = TRUE;
 		}
 	}
+
+	/* One multicast trigger for all destinations */
+	if (trig) {
+		arch_smp_ipi_trigger(&trig_mask);
+	}
+
+	if (vmm_cpumask_test_cpu(cpu, dest)) {
+		func(arg0, arg1, arg2);
+	}
 }
 
 int vmm_smp_ipi_sync_call(const struct vmm_cpumask *dest,
@@ -243,9 +428,12 @@ int vmm_smp_ipi_sync_call(const struct vmm_cpumask *dest,
 	int rc = VMM_OK;
 	u64 timeout_tstamp;
 	u32 c, trig_count, cpu = vmm_smp_processor_id();
+	struct vmm_cpumask call_mask = VMM_CPU_MASK_NONE;
 	struct vmm_cpumask trig_mask = VMM_CPU_MASK_NONE;
 	struct smp_ipi_call ipic;
 	struct smp_ipi_ctrl *ictlp;
+	struct smp_ipi_wait *w = NULL;
+	bool trig = FALSE;
 
 	if (!dest || !func) {
 		return VMM_EFAIL;
@@ -253,45 +441,59 @@ int vmm_smp_ipi_sync_call(const struct vmm_cpumask *dest,
 
 	trig_count = 0;
 	for_each_cpu(c, dest) {
-		if (c == cpu) {
-			func(arg0, arg1, arg2);
-		} else {
-			if (!vmm_cpu_online(c)) {
-				continue;
-			}
-
-			ipic.src_cpu = cpu;
-			ipic.dst_cpu = c;
-			ipic.func = func;
-			ipic.arg0 = arg0;
-			ipic.arg1 = arg1;
-			ipic.arg2 = arg2;
-			smp_ipi_sync_submit(&per_cpu(ictl, c), &ipic);
-			vmm_cpumask_set_cpu(c, &trig_mask);
+		if (c != cpu && vmm_cpu_online(c)) {
+			vmm_cpumask_set_cpu(c, &call_mask);
 			trig_count++;
 		}
 	}
 
 	if (trig_count && timeout_msecs) {
-		rc = VMM_ETIMEDOUT;
+		w = smp_ipi_wait_alloc(&per_cpu(ictl, cpu));
+		if (!w) {
+			/* All slots held by in-flight or timed-out calls */
+			return VMM_EBUSY;
+		}
+		arch_atomic_write(&w->pending, trig_count);
+	}
+
+	ipic.src_cpu = cpu;
+	ipic.func = func;
+	ipic.arg0 = arg0;
+	ipic.arg1 = arg1;
+	ipic.arg2 = arg2;
+	ipic.wait = w;
+
+	for_each_cpu(c, &call_mask) {
+		ictlp = &per_cpu(ictl, c);
+		ipic.dst_cpu = c;
+		smp_ipi_submit(&ictlp->sync_q, &ipic, TRUE);
+		if (smp_ipi_mark_pending(ictlp)) {
+			vmm_cpumask_set_cpu(c, &trig_mask);
+			trig = TRUE;
+		}
+	}
+
+	/* One multicast trigger for all destinations */
+	if (trig) {
+		arch_smp_ipi_trigger(&trig_mask);
+	}
+
+	if (vmm_cpumask_test_cpu(cpu, dest)) {
+		func(arg0, arg1, arg2);
+	}
+
+	/* Wait for destinations to complete the call */
+	if (w) {
 		timeout_tstamp = vmm_timer_timestamp();
 		timeout_tstamp += (u64)timeout_msecs * 1000000ULL;
-		while (vmm_timer_timestamp() < timeout_tstamp) {
-			for_each_cpu(c, &trig_mask) {
-				ictlp = &per_cpu(ictl, c);
-				if (!fifo_avail(ictlp->sync_fifo)) {
-					vmm_cpumask_clear_cpu(c, &trig_mask);
-					trig_count--;
-				}
-			}
-
-			if (!trig_count) {
-				rc = VMM_OK;
+		while (arch_atomic_read(&w->pending)) {
+			if (timeout_tstamp <= vmm_timer_timestamp()) {
+				rc = VMM_ETIMEDOUT;
 				break;
 			}
-
-			vmm_udelay(SMP_IPI_WAIT_UDELAY);
 		}
+		arch_smp_mb();
+		smp_ipi_wait_free(w);
 	}
 
 	return rc;
@@ -302,22 +504,22 @@ static int smp_sync_ipi_startup(struct vmm_cpuhp_notify *cpuhp, u32 cpu)
 	int rc = VMM_EFAIL;
 	struct smp_ipi_ctrl *ictlp = &per_cpu(ictl, cpu);
 
-	/* Initialize Sync IPI FIFO */
-	ictlp->sync_fifo = fifo_alloc(sizeof(struct smp_ipi_call),
-					   SMP_IPI_MAX_SYNC_PER_CPU);
-	if (!ictlp->sync_fifo) {
-		rc = VMM_ENOMEM;
+	/* Initialize Sync IPI queue */
+	rc = smp_ipi_queue_init(&ictlp->sync_q, SMP_IPI_MAX_SYNC_PER_CPU);
+	if (rc) {
 		goto fail;
 	}
 
-	/* Initialize Async IPI FIFO */
-	ictlp->async_fifo = fifo_alloc(sizeof(struct smp_ipi_call),
-					   SMP_IPI_MAX_ASYNC_PER_CPU);
-	if (!ictlp->async_fifo) {
-		rc = VMM_ENOMEM;
+	/* Initialize Async IPI queue */
+	rc = smp_ipi_queue_init(&ictlp->async_q, SMP_IPI_MAX_ASYNC_PER_CPU);
+	if (rc) {
 		goto fail_free_sync;
 	}
 
+	/* No IPI pending and no Sync IPI wait in-flight */
+	ARCH_ATOMIC_INIT(&ictlp->ipi_pending, 0);
+	memset(ictlp->waits, 0, sizeof(ictlp->waits));
+
 	/* Initialize IPI available completion event */
 	INIT_COMPLETION(&ictlp->async_avail);
 
@@ -332,9 +534,9 @@ static int smp_sync_ipi_startup(struct vmm_cpuhp_notify *cpuhp, u32 cpu)
 	return VMM_OK;
 
 fail_free_async:
-	fifo_free(ictlp->async_fifo);
+	smp_ipi_queue_free(&ictlp->async_q);
 fail_free_sync:
-	fifo_free(ictlp->sync_fifo);
+	smp_ipi_queue_free(&ictlp->sync_q);
 fail:
 	return rc;
 }
@@ -30,6 +30,7 @@
 #include <vmm_clocksource.h>
 #include <vmm_clockchip.h>
 #include <vmm_timer.h>
+#include <vmm_trace.h>
 #include <arch_cpu_irq.h>
 #include <libs/stringlib.h>
 
@@ -194,6 +195,9 @@ static void timer_clockchip_event_handler(struct vmm_clockchip *cc)
 			__timer_event_stop(e);
 			vmm_spin_unlock_irqrestore_lite(&e->active_lock, flags1);
 			/* Call event handler */
+			vmm_trace(VMM_TRACE_TIMER_EXPIRY, 0,
+				  (virtual_addr_t)e->handler,
+				  vmm_timer_timestamp() - e->expiry_tstamp);
 			e->handler(e);
 			/* Lock back event list */
 			vmm_read_lock_irqsave_lite(&tlcp->event_list_lock, flags);
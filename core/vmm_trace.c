@@ -0,0 +1,270 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_trace.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief source code for hypervisor event tracing
+ *
+ * Only the owner host CPU writes into its trace buffer and it does so
+ * with interrupts disabled, so writers never contend with each other.
+ * Readers on any host CPU copy a record and use its seq field to detect
+ * whether the record was overwritten while being copied.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_mutex.h>
+#include <vmm_percpu.h>
+#include <vmm_cpumask.h>
+#include <vmm_timer.h>
+#include <vmm_trace.h>
+#include <arch_barrier.h>
+#include <arch_cpu_irq.h>
+#include <libs/mathlib.h>
+#include <libs/stringlib.h>
+
+#define TRACE_ENTRIES		CONFIG_TRACE_BUFFER_ENTRIES
+#define TRACE_ENTRIES_MASK	(TRACE_ENTRIES - 1)
+
+#if (TRACE_ENTRIES & TRACE_ENTRIES_MASK)
+#error "CONFIG_TRACE_BUFFER_ENTRIES must be power of two"
+#endif
+
+struct trace_buffer {
+	/* Index of next record (updated by owner host CPU only) */
+	unsigned long head;
+	/* Index of first record after last clear */
+	unsigned long tail;
+	struct vmm_trace_record *recs;
+};
+
+static DEFINE_PER_CPU(struct trace_buffer, tbuf);
+static DEFINE_MUTEX(trace_lock);
+
+u32 __read_mostly vmm_trace_mask;
+
+static const char *const trace_event_names[VMM_TRACE_MAX_EVENTS] = {
+	[VMM_TRACE_SCHED_SWITCH] = "sched_switch",
+	[VMM_TRACE_VCPU_IRQ_ASSERT] = "vcpu_irq_assert",
+	[VMM_TRACE_VCPU_IRQ_DEASSERT] = "vcpu_irq_deassert",
+	[VMM_TRACE_DEVEMU_READ] = "devemu_read",
+	[VMM_TRACE_DEVEMU_WRITE] = "devemu_write",
+	[VMM_TRACE_VIRTIO_KICK] = "virtio_kick",
+	[VMM_TRACE_VIRTIO_NOTIFY] = "virtio_notify",
+	[VMM_TRACE_TIMER_EXPIRY] = "timer_expiry",
+	[VMM_TRACE_IPI_SEND] = "ipi_send",
+	[VMM_TRACE_IPI_RECV] = "ipi_recv",
+	[VMM_TRACE_HIRQ_ENTRY] = "hirq_entry",
+	[VMM_TRACE_HIRQ_EXIT] = "hirq_exit",
+};
+
+void __vmm_trace(u32 event, u32 arg0, u64 arg1, u64 arg2)
+{
+	unsigned long idx;
+	irq_flags_t flags;
+	struct trace_buffer *tb;
+	struct vmm_trace_record *r;
+
+	arch_cpu_irq_save(flags);
+
+	tb = &this_cpu(tbuf);
+	if (likely(tb->recs)) {
+		idx = tb->head;
+		r = &tb->recs[idx & TRACE_ENTRIES_MASK];
+
+		r->seq = 0;
+		arch_smp_wmb();
+		r->tstamp = vmm_timer_timestamp();
+		r->event = event;
+		r->arg0 = arg0;
+		r->arg1 = arg1;
+		r->arg2 = arg2;
+		arch_smp_wmb();
+		r->seq = (u32)(idx + 1);
+
+		tb->head = idx + 1;
+	}
+
+	arch_cpu_irq_restore(flags);
+}
+
+const char *vmm_trace_event_name(u32 event)
+{
+	if (event < VMM_TRACE_MAX_EVENTS) {
+		return trace_event_names[event];
+	}
+
+	return "unknown";
+}
+
+u32 vmm_trace_event_find(const char *name)
+{
+	u32 ev;
+
+	for (ev = 0; ev < VMM_TRACE_MAX_EVENTS; ev++) {
+		if (!strcmp(trace_event_names[ev], name)) {
+			break;
+		}
+	}
+
+	return ev;
+}
+
+u32 vmm_trace_get_mask(void)
+{
+	return vmm_trace_mask;
+}
+
+int vmm_trace_set_mask(u32 mask)
+{
+	u32 c;
+	struct trace_buffer *tb;
+
+	mask &= VMM_TRACE_ALL_EVENTS;
+
+	vmm_mutex_lock(&trace_lock);
+
+	/* Buffers are never freed because tracepoints run locklessly */
+	if (mask) {
+		for_each_possible_cpu(c) {
+			tb = &per_cpu(tbuf, c);
+			if (tb->recs) {
+				continue;
+			}
+			tb->recs = vmm_zalloc(TRACE_ENTRIES * sizeof(*tb->recs));
+			if (!tb->recs) {
+				vmm_mutex_unlock(&trace_lock);
+				return VMM_ENOMEM;
+			}
+		}
+		arch_smp_wmb();
+	}
+
+	vmm_trace_mask = mask;
+
+	vmm_mutex_unlock(&trace_lock);
+
+	return VMM_OK;
+}
+
+u32 vmm_trace_buffer_entries(void)
+{
+	return TRACE_ENTRIES;
+}
+
+void vmm_trace_cpu_stats(u32 cpu, u64 *written, u64 *lost)
+{
+	unsigned long count;
+	struct trace_buffer *tb = &per_cpu(tbuf, cpu);
+
+	count = tb->head - tb->tail;
+	if (written) {
+		*written = count;
+	}
+	if (lost) {
+		*lost = (count > TRACE_ENTRIES) ? count - TRACE_ENTRIES : 0;
+	}
+}
+
+void vmm_trace_clear(void)
+{
+	u32 c;
+	struct trace_buffer *tb;
+
+	for_each_possible_cpu(c) {
+		tb = &per_cpu(tbuf, c);
+		tb->tail = tb->head;
+	}
+}
+
+int vmm_trace_iterate(u32 cpu,
+		      int (*fn)(u32 cpu, struct vmm_trace_record *rec,
+				void *priv),
+		      void *priv)
+{
+	u32 seq;
+	unsigned long idx, head, tail;
+	struct trace_buffer *tb;
+	struct vmm_trace_record *r, rec;
+
+	if (!fn || CONFIG_CPU_COUNT <= cpu) {
+		return VMM_EINVALID;
+	}
+
+	tb = &per_cpu(tbuf, cpu);
+	if (!tb->recs) {
+		return VMM_OK;
+	}
+
+	head = tb->head;
+	arch_smp_rmb();
+	tail = tb->tail;
+	if ((head - tail) > TRACE_ENTRIES) {
+		tail = head - TRACE_ENTRIES;
+	}
+
+	for (idx = tail; idx != head; idx++) {
+		r = &tb->recs[idx & TRACE_ENTRIES_MASK];
+		seq = r->seq;
+		arch_smp_rmb();
+		memcpy(&rec, r, sizeof(rec));
+		arch_smp_rmb();
+		if (seq != (u32)(idx + 1) || r->seq != seq) {
+			/* Overwritten by a newer record */
+			continue;
+		}
+		rec.seq = seq;
+		if (fn(cpu, &rec, priv)) {
+			break;
+		}
+	}
+
+	return VMM_OK;
+}
+
+static int trace_dump_record(u32 cpu, struct vmm_trace_record *rec,
+			     void *priv)
+{
+	struct vmm_chardev *cdev = priv;
+
+	vmm_cprintf(cdev, "[%6"PRIu64".%09"PRIu64"] CPU%-3d %-18s "
+		    "0x%04x 0x%016"PRIx64" 0x%016"PRIx64"\n",
+		    udiv64(rec->tstamp, 1000000000ULL),
+		    umod64(rec->tstamp, 1000000000ULL),
+		    cpu, vmm_trace_event_name(rec->event),
+		    rec->arg0, rec->arg1, rec->arg2);
+
+	return 0;
+}
+
+void vmm_trace_dump(struct vmm_chardev *cdev)
+{
+	u32 c;
+	u64 written, lost;
+
+	for_each_possible_cpu(c) {
+		vmm_trace_cpu_stats(c, &written, &lost);
+		if (!written) {
+			continue;
+		}
+		vmm_cprintf(cdev, "CPU%d: %"PRIu64" records, %"PRIu64" lost\n",
+			    c, written, lost);
+		vmm_trace_iterate(c, trace_dump_record, cdev);
+	}
+}
@@ -25,10 +25,15 @@
 #include <vmm_error.h>
 #include <vmm_heap.h>
 #include <vmm_stdio.h>
+#include <vmm_smp.h>
+#include <vmm_percpu.h>
 #include <vmm_timer.h>
 #include <vmm_scheduler.h>
 #include <vmm_devtree.h>
 #include <vmm_vcpu_irq.h>
+#include <vmm_vcpu_stats.h>
+#include <vmm_trace.h>
+#include <libs/bitops.h>
 #include <libs/stringlib.h>
 
 #define DEASSERTED	0
@@ -37,6 +42,14 @@
 
 #define WFI_YIELD_THRESHOLD	100
 
+#define WFI_HALT_POLL_START_NSECS	10000
+
+/* Timestamp till which idle VCPU of a host CPU polls instead of
+ * waiting for host interrupt because a VCPU halted on this host CPU
+ * is expected to be woken-up soon.
+ */
+static DEFINE_PER_CPU(u64, halt_poll_deadline);
+
 static bool vcpu_irq_process_one(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 {
 	/* Proceed only if we have pending execute */
@@ -45,8 +58,8 @@ static bool vcpu_irq_process_one(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 		u32 i, tmp_prio, irq_count = vcpu->irqs.irq_count;
 		u32 irq_prio = 0;
 
-		/* Find the irq number to process */
-		for (i = 0; i < irq_count; i++) {
+		/* Find the irq number to process among asserted irqs */
+		for_each_set_bit(i, vcpu->irqs.assert_map, irq_count) {
 			if (arch_atomic_read(&vcpu->irqs.irq[i].assert) ==
 			    ASSERTED) {
 				tmp_prio = arch_vcpu_irq_priority(vcpu, i);
@@ -60,7 +73,12 @@ static bool vcpu_irq_process_one(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 			return FALSE;
 		}
 
-		/* If irq number found then execute it */
+		/* If irq number found then execute it
+		 * Note: assert bit is cleared before taking the irq so
+		 * that a concurrent deassert and re-assert which sets
+		 * it again is never lost.
+		 */
+		clear_bit(irq_no, vcpu->irqs.assert_map);
 		if (arch_atomic_cmpxchg(&vcpu->irqs.irq[irq_no].assert,
 					ASSERTED, PENDING) == ASSERTED) {
 			if (arch_vcpu_irq_execute(vcpu, regs, irq_no,
@@ -81,7 +99,11 @@ static bool vcpu_irq_process_one(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 				arch_atomic_write(&vcpu->irqs.
 						  irq[irq_no].assert,
 						  ASSERTED);
+				set_bit(irq_no, vcpu->irqs.assert_map);
 			}
+		} else {
+			/* Someone else changed the irq state in-between */
+			set_bit(irq_no, vcpu->irqs.assert_map);
 		}
 
 		return TRUE;
@@ -111,6 +133,85 @@ void vmm_vcpu_irq_process(struct vmm_vcpu *vcpu, arch_regs_t *regs)
 	}
 }
 
+/* Must be called with VCPU WFI lock held */
+static void vcpu_irq_halt_poll_update(struct vmm_vcpu *vcpu, u64 block_ns)
+{
+	u64 poll_ns = vcpu->irqs.wfi.poll_ns;
+
+	if (!CONFIG_WFI_HALT_POLL_NSECS) {
+		return;
+	}
+
+	if (block_ns <= poll_ns) {
+		vcpu->irqs.wfi.poll_success++;
+		return;
+	}
+	if (poll_ns) {
+		vcpu->irqs.wfi.poll_wasted++;
+	}
+
+	if (block_ns < CONFIG_WFI_HALT_POLL_NSECS) {
+		/* Wake-up was short so polling longer would have caught it */
+		poll_ns = (poll_ns) ? poll_ns * 2 : WFI_HALT_POLL_START_NSECS;
+		if (CONFIG_WFI_HALT_POLL_NSECS < poll_ns) {
+			poll_ns = CONFIG_WFI_HALT_POLL_NSECS;
+		}
+	} else {
+		/* Wake-up was too late so polling is a waste of time */
+		poll_ns = poll_ns / 2;
+		if (poll_ns < WFI_HALT_POLL_START_NSECS) {
+			poll_ns = 0;
+		}
+	}
+
+	vcpu->irqs.wfi.poll_ns = poll_ns;
+}
+
+static bool vcpu_irq_hcpu_idle(void)
+{
+	u8 prio;
+	u32 count = 0, hcpu = vmm_smp_processor_id();
+	struct vmm_vcpu *idle = vmm_scheduler_idle_vcpu(hcpu);
+
+	for (prio = VMM_VCPU_MIN_PRIORITY; prio <= VMM_VCPU_MAX_PRIORITY;
+	     prio++) {
+		count += vmm_scheduler_ready_count(hcpu, prio);
+	}
+
+	/* Idle VCPU is always ready when not running */
+	if (count && idle &&
+	    (vmm_manager_vcpu_get_state(idle) == VMM_VCPU_STATE_READY)) {
+		count--;
+	}
+
+	return (count) ? FALSE : TRUE;
+}
+
+/* Must be called with VCPU WFI lock held */
+static void vcpu_irq_halt_poll_start(struct vmm_vcpu *vcpu)
+{
+	u64 deadline, poll_ns = vcpu->irqs.wfi.poll_ns;
+
+	if (!poll_ns || !vcpu_irq_hcpu_idle()) {
+		return;
+	}
+
+	deadline = vcpu->irqs.wfi.halt_tstamp + poll_ns;
+	if (this_cpu(halt_poll_deadline) < deadline) {
+		this_cpu(halt_poll_deadline) = deadline;
+	}
+}
+
+void vmm_vcpu_irq_halt_poll(void)
+{
+	/* Interrupts are enabled over here so wake-up of halted
+	 * VCPU (or any other host interrupt) preempts this loop.
+	 */
+	while (vmm_timer_timestamp() < this_cpu(halt_poll_deadline)) ;
+
+	this_cpu(halt_poll_deadline) = 0;
+}
+
 static void vcpu_irq_wfi_resume(struct vmm_vcpu *vcpu, void *data)
 {
 	irq_flags_t flags;
@@ -132,11 +233,18 @@ static void vcpu_irq_wfi_resume(struct vmm_vcpu *vcpu, void *data)
 	if (vcpu->irqs.wfi.state) {
 		try_vcpu_resume = TRUE;
 
+		/* Adapt halt polling to wake-up latency */
+		vcpu_irq_halt_poll_update(vcpu, (data) ? ~0ULL :
+			vmm_timer_timestamp() - vcpu->irqs.wfi.halt_tstamp);
+
 		/* Clear wait for irq state */
 		vcpu->irqs.wfi.state = FALSE;
 
 		/* Stop wait for irq timeout event */
 		vmm_timer_event_stop(vcpu->irqs.wfi.priv);
+
+		/* Stop halt polling on this host CPU */
+		this_cpu(halt_poll_deadline) = 0;
 	}
 
 	/* Unlock VCPU WFI */
@@ -175,7 +283,7 @@ void vmm_vcpu_irq_assert(struct vmm_vcpu *vcpu, u32 irq_no, u64 reason)
 	}
 
 	/* Check irq number */
-	if (irq_no > vcpu->irqs.irq_count) {
+	if (irq_no >= vcpu->irqs.irq_count) {
 		return;
 	}
 
@@ -184,8 +292,11 @@ void vmm_vcpu_irq_assert(struct vmm_vcpu *vcpu, u32 irq_no, u64 reason)
 				DEASSERTED, ASSERTED) == DEASSERTED) {
 		if (arch_vcpu_irq_assert(vcpu, irq_no, reason) == VMM_OK) {
 			vcpu->irqs.irq[irq_no].reason = reason;
+			set_bit(irq_no, vcpu->irqs.assert_map);
 			arch_atomic_inc(&vcpu->irqs.execute_pending);
 			arch_atomic64_inc(&vcpu->irqs.assert_count);
+			vmm_trace(VMM_TRACE_VCPU_IRQ_ASSERT,
+				  vcpu->id, irq_no, reason);
 			asserted = TRUE;
 		} else {
 			arch_atomic_write(&vcpu->irqs.irq[irq_no].assert,
@@ -209,7 +320,7 @@ void vmm_vcpu_irq_clear(struct vmm_vcpu *vcpu, u32 irq_no)
 	}
 
 	/* Check irq number */
-	if (irq_no > vcpu->irqs.irq_count) {
+	if (irq_no >= vcpu->irqs.irq_count) {
 		return;
 	}
 
@@ -222,7 +333,11 @@ void vmm_vcpu_irq_clear(struct vmm_vcpu *vcpu, u32 irq_no)
 		arch_atomic64_inc(&vcpu->irqs.clear_count);
 	}
 
-	/* Reset VCPU irq assert state */
+	/* Reset VCPU irq assert state
+	 * Note: assert bit is cleared first so that a concurrent
+	 * assert after the state write is never lost.
+	 */
+	clear_bit(irq_no, vcpu->irqs.assert_map);
 	arch_atomic_write(&vcpu->irqs.irq[irq_no].assert, DEASSERTED);
 
 	/* Ensure irq reason is zeroed */
@@ -237,7 +352,7 @@ void vmm_vcpu_irq_deassert(struct vmm_vcpu *vcpu, u32 irq_no)
 	}
 
 	/* Check irq number */
-	if (irq_no > vcpu->irqs.irq_count) {
+	if (irq_no >= vcpu->irqs.irq_count) {
 		return;
 	}
 
@@ -245,9 +360,11 @@ void vmm_vcpu_irq_deassert(struct vmm_vcpu *vcpu, u32 irq_no)
 	if (arch_vcpu_irq_deassert(vcpu, irq_no,
 				   vcpu->irqs.irq[irq_no].reason) == VMM_OK) {
 		arch_atomic64_inc(&vcpu->irqs.deassert_count);
+		vmm_trace(VMM_TRACE_VCPU_IRQ_DEASSERT, vcpu->id, irq_no, 0);
 	}
 
 	/* Reset VCPU irq assert state */
+	clear_bit(irq_no, vcpu->irqs.assert_map);
 	arch_atomic_write(&vcpu->irqs.irq[irq_no].assert, DEASSERTED);
 
 	/* Ensure irq reason is zeroed */
@@ -280,6 +397,9 @@ int vmm_vcpu_irq_wait_timeout(struct vmm_vcpu *vcpu, u64 nsecs)
 	/* Ensure given VCPU is current VCPU */
 	BUG_ON(vmm_scheduler_current_vcpu() != vcpu);
 
+	/* Whatever trapped, this exit is accounted as WFI */
+	vmm_vcpu_exit_set_reason(vcpu, VMM_VCPU_EXIT_WFI);
+
 	/* Check for pending interrupts */
 	have_irq = arch_atomic_read(&vcpu->irqs.execute_pending) ||
 		   arch_vcpu_irq_pending(vcpu);
@@ -302,6 +422,12 @@ int vmm_vcpu_irq_wait_timeout(struct vmm_vcpu *vcpu, u64 nsecs)
 
 		/* Set wait for irq state */
 		vcpu->irqs.wfi.state = TRUE;
+		vcpu->irqs.wfi.halt_tstamp = vmm_timer_timestamp();
+
+		/* Host interrupts are disabled over here so let the
+		 * idle VCPU of this host CPU do the halt polling.
+		 */
+		vcpu_irq_halt_poll_start(vcpu);
 
 		/* Start wait for irq timeout event */
 		if (!nsecs) {
@@ -341,6 +467,9 @@ done:
 			/* Stop wait for irq timeout event */
 			vmm_timer_event_stop(vcpu->irqs.wfi.priv);
 
+			/* Stop halt polling on this host CPU */
+			this_cpu(halt_poll_deadline) = 0;
+
 			vmm_spin_unlock_irqrestore_lite(&vcpu->irqs.wfi.lock,
 							flags);
 		}
@@ -371,6 +500,36 @@ bool vmm_vcpu_irq_wait_state(struct vmm_vcpu *vcpu)
 	return ret;
 }
 
+int vmm_vcpu_irq_poll_stats(struct vmm_vcpu *vcpu, u64 *poll_ns,
+			    u64 *poll_success, u64 *poll_wasted)
+{
+	irq_flags_t flags;
+
+	/* Sanity Checks */
+	if (!vcpu || !vcpu->is_normal) {
+		return VMM_EINVALID;
+	}
+
+	/* Lock VCPU WFI */
+	vmm_spin_lock_irqsave_lite(&vcpu->irqs.wfi.lock, flags);
+
+	/* Read VCPU halt polling state */
+	if (poll_ns) {
+		*poll_ns = vcpu->irqs.wfi.poll_ns;
+	}
+	if (poll_success) {
+		*poll_success = vcpu->irqs.wfi.poll_success;
+	}
+	if (poll_wasted) {
+		*poll_wasted = vcpu->irqs.wfi.poll_wasted;
+	}
+
+	/* Unlock VCPU WFI */
+	vmm_spin_unlock_irqrestore_lite(&vcpu->irqs.wfi.lock, flags);
+
+	return VMM_OK;
+}
+
 int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu)
 {
 	int rc;
@@ -402,9 +561,21 @@ int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu)
 			return VMM_ENOMEM;
 		}
 
+		/* Allocate memory for asserted irq bitmap */
+		vcpu->irqs.assert_map =
+		    vmm_zalloc(BITS_TO_LONGS(irq_count) *
+			       sizeof(unsigned long));
+		if (!vcpu->irqs.assert_map) {
+			vmm_free(vcpu->irqs.irq);
+			vcpu->irqs.irq = NULL;
+			return VMM_ENOMEM;
+		}
+
 		/* Create wfi_timeout event */
 		ev = vmm_zalloc(sizeof(struct vmm_timer_event));
 		if (!ev) {
+			vmm_free(vcpu->irqs.assert_map);
+			vcpu->irqs.assert_map = NULL;
 			vmm_free(vcpu->irqs.irq);
 			vcpu->irqs.irq = NULL;
 			return VMM_ENOMEM;
@@ -435,12 +606,20 @@ int vmm_vcpu_irq_init(struct vmm_vcpu *vcpu)
 		vcpu->irqs.irq[ite].reason = 0;
 		arch_atomic_write(&vcpu->irqs.irq[ite].assert, DEASSERTED);
 	}
+	memset(vcpu->irqs.assert_map, 0,
+	       BITS_TO_LONGS(irq_count) * sizeof(unsigned long));
 
 	/* Setup wait for irq context */
 	vcpu->irqs.wfi.yield_count = 0;
 	vcpu->irqs.wfi.state = FALSE;
+	vcpu->irqs.wfi.halt_tstamp = 0;
+	vcpu->irqs.wfi.poll_ns = 0;
+	vcpu->irqs.wfi.poll_success = 0;
+	vcpu->irqs.wfi.poll_wasted = 0;
 	rc = vmm_timer_event_stop(vcpu->irqs.wfi.priv);
 	if (rc != VMM_OK) {
+		vmm_free(vcpu->irqs.assert_map);
+		vcpu->irqs.assert_map = NULL;
 		vmm_free(vcpu->irqs.irq);
 		vcpu->irqs.irq = NULL;
 		vmm_free(vcpu->irqs.wfi.priv);
@@ -470,6 +649,8 @@ int vmm_vcpu_irq_deinit(struct vmm_vcpu *vcpu)
 	vcpu->irqs.wfi.priv = NULL;
 
 	/* Free flags */
+	vmm_free(vcpu->irqs.assert_map);
+	vcpu->irqs.assert_map = NULL;
 	vmm_free(vcpu->irqs.irq);
 	vcpu->irqs.irq = NULL;
 
@@ -0,0 +1,248 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vmm_vcpu_stats.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief source code for per-VCPU exit accounting
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_timer.h>
+#include <vmm_devemu.h>
+#include <vmm_vcpu_stats.h>
+#include <libs/log2.h>
+#include <libs/mathlib.h>
+#include <libs/stringlib.h>
+
+static const char *const exit_reason_names[VMM_VCPU_EXIT_MAX] = {
+	[VMM_VCPU_EXIT_UNKNOWN] = "unknown",
+	[VMM_VCPU_EXIT_MMIO] = "mmio",
+	[VMM_VCPU_EXIT_IOPORT] = "ioport",
+	[VMM_VCPU_EXIT_STAGE2_FAULT] = "stage2_fault",
+	[VMM_VCPU_EXIT_WFI] = "wfi",
+	[VMM_VCPU_EXIT_HYPERCALL] = "hypercall",
+	[VMM_VCPU_EXIT_SYSREG] = "sysreg",
+	[VMM_VCPU_EXIT_INSN] = "insn",
+	[VMM_VCPU_EXIT_IRQ] = "irq",
+};
+
+const char *vmm_vcpu_exit_reason_name(u32 reason)
+{
+	if (reason < VMM_VCPU_EXIT_MAX) {
+		return exit_reason_names[reason];
+	}
+
+	return "invalid";
+}
+
+#ifdef CONFIG_VCPU_EXIT_STATS
+
+static void exit_emu_account(struct vmm_vcpu_exit_stats *s, u64 nsecs)
+{
+	u32 i;
+	struct vmm_vcpu_exit_emu_stat *es = &s->other_emus;
+
+	for (i = 0; i < VMM_VCPU_EXIT_MAX_EMULATORS; i++) {
+		if (s->emus[i].emu == s->emu) {
+			es = &s->emus[i];
+			break;
+		}
+		if (!s->emus[i].emu) {
+			es = &s->emus[i];
+			es->emu = s->emu;
+			break;
+		}
+	}
+
+	es->count++;
+	es->total_nsecs += nsecs;
+}
+
+void vmm_vcpu_exit_end(struct vmm_vcpu *vcpu, u32 reason)
+{
+	u64 nsecs;
+	struct vmm_vcpu_exit_stat *st;
+	struct vmm_vcpu_exit_stats *s = (vcpu) ? vcpu->exit_stats : NULL;
+
+	if (!s) {
+		return;
+	}
+
+	nsecs = vmm_timer_timestamp() - s->tstamp;
+	if (s->reason != VMM_VCPU_EXIT_UNKNOWN) {
+		reason = s->reason;
+	}
+	if (VMM_VCPU_EXIT_MAX <= reason) {
+		reason = VMM_VCPU_EXIT_UNKNOWN;
+	}
+
+	st = &s->exits[reason];
+	st->count++;
+	st->total_nsecs += nsecs;
+	if (st->max_nsecs < nsecs) {
+		st->max_nsecs = nsecs;
+	}
+	st->hist[(nsecs) ? min(ilog2(nsecs) + 1,
+			       VMM_VCPU_EXIT_HIST_BUCKETS - 1) : 0]++;
+
+	if (s->emu) {
+		exit_emu_account(s, nsecs);
+	}
+}
+
+int vmm_vcpu_exit_stats_reset(struct vmm_vcpu *vcpu)
+{
+	struct vmm_vcpu_exit_stats *s;
+
+	if (!vcpu) {
+		return VMM_EINVALID;
+	}
+	s = vcpu->exit_stats;
+	if (!s) {
+		return VMM_ENOTAVAIL;
+	}
+
+	/* Updates racing with the reset from the VCPU itself are lost */
+	memset(s->exits, 0, sizeof(s->exits));
+	memset(s->emus, 0, sizeof(s->emus));
+	memset(&s->other_emus, 0, sizeof(s->other_emus));
+	s->reset_tstamp = vmm_timer_timestamp();
+
+	return VMM_OK;
+}
+
+static void exit_stats_dump_hist(struct vmm_chardev *cdev,
+				 struct vmm_vcpu_exit_stat *st)
+{
+	u32 b, cnt = 0;
+
+	vmm_cprintf(cdev, "    histogram (nsecs):");
+	for (b = 0; b < VMM_VCPU_EXIT_HIST_BUCKETS; b++) {
+		if (!st->hist[b]) {
+			continue;
+		}
+		if (cnt && !(cnt % 4)) {
+			vmm_cprintf(cdev, "\n                      ");
+		}
+		vmm_cprintf(cdev, " <%"PRIu64":%"PRIu32,
+			    ((u64)1 << b), st->hist[b]);
+		cnt++;
+	}
+	vmm_cprintf(cdev, "\n");
+}
+
+int vmm_vcpu_exit_stats_dump(struct vmm_chardev *cdev,
+			     struct vmm_vcpu *vcpu)
+{
+	u32 r, i;
+	struct vmm_vcpu_exit_stat *st;
+	struct vmm_vcpu_exit_emu_stat *es;
+	struct vmm_vcpu_exit_stats *s;
+
+	if (!vcpu) {
+		return VMM_EINVALID;
+	}
+	s = vcpu->exit_stats;
+	if (!s) {
+		vmm_cprintf(cdev, "%s: No exit statistics\n", vcpu->name);
+		return VMM_ENOTAVAIL;
+	}
+
+	vmm_cprintf(cdev, "Name             : %s\n", vcpu->name);
+	vmm_cprintf(cdev, "Collected Since  : %"PRIu64" ms\n",
+		    udiv64(vmm_timer_timestamp() - s->reset_tstamp, 1000000ULL));
+	vmm_cprintf(cdev, "\n");
+	vmm_cprintf(cdev, "%-14s %12s %16s %10s %12s\n",
+		    "Reason", "Count", "Total(ns)", "Avg(ns)", "Max(ns)");
+	for (r = 0; r < VMM_VCPU_EXIT_MAX; r++) {
+		st = &s->exits[r];
+		if (!st->count) {
+			continue;
+		}
+		vmm_cprintf(cdev, "%-14s %12"PRIu64" %16"PRIu64" %10"PRIu64" %12"PRIu64"\n",
+			    vmm_vcpu_exit_reason_name(r), st->count,
+			    st->total_nsecs,
+			    udiv64(st->total_nsecs, st->count),
+			    st->max_nsecs);
+		exit_stats_dump_hist(cdev, st);
+	}
+
+	vmm_cprintf(cdev, "\n");
+	vmm_cprintf(cdev, "%-24s %12s %16s %10s\n",
+		    "Emulator", "Count", "Total(ns)", "Avg(ns)");
+	for (i = 0; i <= VMM_VCPU_EXIT_MAX_EMULATORS; i++) {
+		es = (i < VMM_VCPU_EXIT_MAX_EMULATORS) ?
+				&s->emus[i] : &s->other_emus;
+		if (!es->count) {
+			continue;
+		}
+		vmm_cprintf(cdev, "%-24s %12"PRIu64" %16"PRIu64" %10"PRIu64"\n",
+			    (es->emu) ? es->emu->name : "(other)",
+			    es->count, es->total_nsecs,
+			    udiv64(es->total_nsecs, es->count));
+	}
+
+	return VMM_OK;
+}
+
+void vmm_vcpu_exit_stats_init(struct vmm_vcpu *vcpu)
+{
+	if (!vcpu || !vcpu->is_normal) {
+		return;
+	}
+
+	/* Without statistics the VCPU works fine so ignore failure */
+	vcpu->exit_stats = vmm_zalloc(sizeof(*vcpu->exit_stats));
+	if (vcpu->exit_stats) {
+		vcpu->exit_stats->reset_tstamp = vmm_timer_timestamp();
+	}
+}
+
+void vmm_vcpu_exit_stats_deinit(struct vmm_vcpu *vcpu)
+{
+	if (vcpu && vcpu->exit_stats) {
+		vmm_free(vcpu->exit_stats);
+		vcpu->exit_stats = NULL;
+	}
+}
+
+#else
+
+int vmm_vcpu_exit_stats_reset(struct vmm_vcpu *vcpu)
+{
+	return VMM_ENOTAVAIL;
+}
+
+int vmm_vcpu_exit_stats_dump(struct vmm_chardev *cdev,
+			     struct vmm_vcpu *vcpu)
+{
+	vmm_cprintf(cdev, "VCPU exit statistics not available\n");
+	return VMM_ENOTAVAIL;
+}
+
+void vmm_vcpu_exit_stats_init(struct vmm_vcpu *vcpu)
+{
+}
+
+void vmm_vcpu_exit_stats_deinit(struct vmm_vcpu *vcpu)
+{
+}
+
+#endif
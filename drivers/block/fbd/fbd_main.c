@@ -0,0 +1,560 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file fbd_main.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief File backed block device driver.
+ *
+ * A file backed device (FBD) exposes an image file on any VFS mount
+ * point as a block device. Raw images (optionally sparse, with bytes
+ * beyond end of file reading as zeros) and qcow2 images are supported.
+ * The qcow2 images can have a read-only backing image so that many
+ * guests can share one base image using their private qcow2 overlays.
+ *
+ * All image file accesses are done from the request queue thread of
+ * the block device because VFS APIs can only be used in Orphan context.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_spinlocks.h>
+#include <vmm_modules.h>
+#include <block/vmm_blockrq.h>
+#include <libs/stringlib.h>
+#include <drv/fbd.h>
+
+#include "fbd_priv.h"
+
+#define MODULE_DESC			"File Backed Block Driver"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(FBD_IPRIORITY)
+#define	MODULE_INIT			fbd_driver_init
+#define	MODULE_EXIT			fbd_driver_exit
+
+/* Size of zero buffer used for zeroing parts of image file
+ * (same as default qcow2 cluster size so that a newly allocated
+ * cluster is zeroed using one write)
+ */
+#define FBD_ZERO_BUF_SIZE		(64 * 1024)
+
+static LIST_HEAD(fbd_list);
+static DEFINE_SPINLOCK(fbd_list_lock);
+static u8 *fbd_zero_buf;
+
+/* Formats in probing order (raw must be last) */
+static const struct fbd_format *fbd_formats[] = {
+	&fbd_qcow2_format,
+	&fbd_raw_format,
+};
+
+int fbd_file_read(struct fbd_image *img, u64 off, void *buf, u32 len)
+{
+	u32 rlen = 0;
+
+	if (off < img->file_size) {
+		rlen = len;
+		if ((img->file_size - off) < rlen) {
+			rlen = img->file_size - off;
+		}
+		if (vfs_pread(img->fd, buf, rlen, off) != rlen) {
+			return VMM_EIO;
+		}
+	}
+
+	if (rlen < len) {
+		memset((u8 *)buf + rlen, 0, len - rlen);
+	}
+
+	return VMM_OK;
+}
+
+static int __fbd_file_write(struct fbd_image *img, u64 off,
+			    const void *buf, u32 len)
+{
+	if (vfs_pwrite(img->fd, (void *)buf, len, off) != len) {
+		return VMM_EIO;
+	}
+
+	if (img->file_size < (off + len)) {
+		img->file_size = off + len;
+	}
+
+	return VMM_OK;
+}
+
+static int __fbd_file_zero(struct fbd_image *img, u64 off, u64 len)
+{
+	int rc;
+	u32 wlen;
+
+	while (len) {
+		wlen = (len < FBD_ZERO_BUF_SIZE) ? len : FBD_ZERO_BUF_SIZE;
+		rc = __fbd_file_write(img, off, fbd_zero_buf, wlen);
+		if (rc) {
+			return rc;
+		}
+		off += wlen;
+		len -= wlen;
+	}
+
+	return VMM_OK;
+}
+
+int fbd_file_write(struct fbd_image *img, u64 off,
+		   const void *buf, u32 len)
+{
+	int rc;
+
+	if (img->rdonly) {
+		return VMM_EROFS;
+	}
+
+	/* Not all filesystems support holes so explicitly
+	 * zero-fill the gap between end of file and offset.
+	 */
+	if (img->file_size < off) {
+		rc = __fbd_file_zero(img, img->file_size,
+				     off - img->file_size);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	return __fbd_file_write(img, off, buf, len);
+}
+
+int fbd_file_zero(struct fbd_image *img, u64 off, u32 len)
+{
+	u64 zlen = len;
+
+	if (img->rdonly) {
+		return VMM_EROFS;
+	}
+
+	if (img->file_size < off) {
+		zlen += off - img->file_size;
+		off = img->file_size;
+	}
+
+	return __fbd_file_zero(img, off, zlen);
+}
+
+int fbd_image_read(struct fbd_image *img, u64 off, void *buf, u32 len)
+{
+	u32 rlen = 0;
+	int rc;
+
+	if (off < img->size) {
+		rlen = len;
+		if ((img->size - off) < rlen) {
+			rlen = img->size - off;
+		}
+		rc = img->fmt->read(img, off, buf, rlen);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	if (rlen < len) {
+		memset((u8 *)buf + rlen, 0, len - rlen);
+	}
+
+	return VMM_OK;
+}
+
+int fbd_image_write(struct fbd_image *img, u64 off,
+		    const void *buf, u32 len)
+{
+	if (img->rdonly) {
+		return VMM_EROFS;
+	}
+
+	if ((img->size < off) || ((img->size - off) < len)) {
+		return VMM_EINVALID;
+	}
+
+	return img->fmt->write(img, off, buf, len);
+}
+
+int fbd_image_flush(struct fbd_image *img)
+{
+	if (img->rdonly) {
+		return VMM_OK;
+	}
+
+	if (img->fmt->flush) {
+		return img->fmt->flush(img);
+	}
+
+	return vfs_fsync(img->fd);
+}
+
+int fbd_image_open(const char *path, bool rdonly, u64 size, u32 depth,
+		   struct fbd_image **imgp)
+{
+	int i, rc;
+	struct stat st;
+	struct fbd_image *img;
+
+	if (!path || !imgp) {
+		return VMM_EINVALID;
+	}
+	if (depth > FBD_MAX_BACKING_DEPTH) {
+		return VMM_EOVERFLOW;
+	}
+
+	img = vmm_zalloc(sizeof(struct fbd_image));
+	if (!img) {
+		return VMM_ENOMEM;
+	}
+	if (strlcpy(img->path, path, sizeof(img->path)) >=
+	    sizeof(img->path)) {
+		rc = VMM_EOVERFLOW;
+		goto fail_free;
+	}
+	img->rdonly = rdonly;
+
+	img->fd = vfs_open(path, (rdonly) ? O_RDONLY : O_RDWR, 0);
+	if (img->fd < 0) {
+		rc = img->fd;
+		goto fail_free;
+	}
+
+	rc = vfs_fstat(img->fd, &st);
+	if (rc) {
+		goto fail_close;
+	}
+	img->file_size = st.st_size;
+
+	for (i = 0; i < array_size(fbd_formats); i++) {
+		if (!fbd_formats[i]->probe ||
+		    fbd_formats[i]->probe(img)) {
+			img->fmt = fbd_formats[i];
+			break;
+		}
+	}
+	if (!img->fmt) {
+		rc = VMM_ENOTSUPP;
+		goto fail_close;
+	}
+
+	rc = img->fmt->open(img, size, depth);
+	if (rc) {
+		goto fail_close;
+	}
+
+	*imgp = img;
+
+	return VMM_OK;
+
+fail_close:
+	vfs_close(img->fd);
+fail_free:
+	vmm_free(img);
+	return rc;
+}
+
+void fbd_image_close(struct fbd_image *img)
+{
+	if (!img) {
+		return;
+	}
+
+	if (img->fmt->close) {
+		img->fmt->close(img);
+	}
+
+	if (img->backing) {
+		fbd_image_close(img->backing);
+	}
+
+	vfs_close(img->fd);
+	vmm_free(img);
+}
+
+static int fbd_read(struct vmm_blockrq *brq,
+		    struct vmm_request *r, void *priv)
+{
+	struct fbd *d = priv;
+
+	return fbd_image_read(d->img, r->lba * FBD_BLOCK_SIZE,
+			      r->data, r->bcnt * FBD_BLOCK_SIZE);
+}
+
+static int fbd_write(struct vmm_blockrq *brq,
+		     struct vmm_request *r, void *priv)
+{
+	struct fbd *d = priv;
+
+	return fbd_image_write(d->img, r->lba * FBD_BLOCK_SIZE,
+			       r->data, r->bcnt * FBD_BLOCK_SIZE);
+}
+
+static int fbd_sync(struct vmm_blockrq *brq,
+		    struct vmm_request *r, void *priv)
+{
+	struct fbd *d = priv;
+
+	return fbd_image_flush(d->img);
+}
+
+static void fbd_flush(struct vmm_blockrq *brq, void *priv)
+{
+	struct fbd *d = priv;
+
+	fbd_image_flush(d->img);
+}
+
+static struct vmm_blockrq_ops fbd_rq_ops = {
+	.read = fbd_read,
+	.write = fbd_write,
+	.sync = fbd_sync,
+	.flush = fbd_flush,
+};
+
+struct fbd *fbd_create(const char *name, const char *path,
+		       u64 size, u32 flags)
+{
+	int rc;
+	struct fbd *d;
+	irq_flags_t f;
+	struct vmm_blockrq *brq;
+
+	if (!name || !path) {
+		return NULL;
+	}
+
+	d = vmm_zalloc(sizeof(struct fbd));
+	if (!d) {
+		goto free_nothing;
+	}
+	INIT_LIST_HEAD(&d->head);
+	strlcpy(d->path, path, sizeof(d->path));
+
+	rc = fbd_image_open(path, (flags & FBD_RDONLY) ? TRUE : FALSE,
+			    size, 0, &d->img);
+	if (rc) {
+		vmm_printf("%s: failed to open %s (error %d)\n",
+			   __func__, path, rc);
+		goto free_fbd;
+	}
+	d->format = d->img->fmt->name;
+	d->size = d->img->size;
+	if (d->size < FBD_BLOCK_SIZE) {
+		goto free_img;
+	}
+
+	d->bdev = vmm_blockdev_alloc();
+	if (!d->bdev) {
+		goto free_img;
+	}
+
+	/* Setup block device instance */
+	strncpy(d->bdev->name, name, VMM_FIELD_NAME_SIZE);
+	strncpy(d->bdev->desc, "File backed block device",
+		VMM_FIELD_DESC_SIZE);
+	d->bdev->flags = (flags & FBD_RDONLY) ?
+			 VMM_BLOCKDEV_RDONLY : VMM_BLOCKDEV_RW;
+	d->bdev->start_lba = 0;
+	d->bdev->num_blocks = d->size / FBD_BLOCK_SIZE;
+	d->bdev->block_size = FBD_BLOCK_SIZE;
+
+	/* Setup request queue for block device instance */
+	brq = vmm_blockrq_create(name, 8, FALSE, &fbd_rq_ops, d);
+	if (!brq) {
+		goto free_bdev;
+	}
+	d->bdev->rq = vmm_blockrq_to_rq(brq);
+
+	/* Register block device instance */
+	if (vmm_blockdev_register(d->bdev)) {
+		goto free_bdev_rq;
+	}
+
+	/* Add to list of FBD instances */
+	vmm_spin_lock_irqsave(&fbd_list_lock, f);
+	list_add_tail(&d->head, &fbd_list);
+	vmm_spin_unlock_irqrestore(&fbd_list_lock, f);
+
+	return d;
+
+free_bdev_rq:
+	vmm_blockrq_destroy(vmm_rq_to_blockrq(d->bdev->rq));
+free_bdev:
+	vmm_blockdev_free(d->bdev);
+free_img:
+	fbd_image_close(d->img);
+free_fbd:
+	vmm_free(d);
+free_nothing:
+	return NULL;
+}
+VMM_EXPORT_SYMBOL(fbd_create);
+
+void fbd_destroy(struct fbd *d)
+{
+	irq_flags_t f;
+
+	/* Sanity check */
+	if (!d) {
+		return;
+	}
+
+	/* Remove from list of FBD instances */
+	vmm_spin_lock_irqsave(&fbd_list_lock, f);
+	list_del(&d->head);
+	vmm_spin_unlock_irqrestore(&fbd_list_lock, f);
+
+	/* Unregister block device */
+	vmm_blockdev_unregister(d->bdev);
+
+	/* Free block device request queue */
+	vmm_blockrq_destroy(vmm_rq_to_blockrq(d->bdev->rq));
+
+	/* Free block device */
+	vmm_blockdev_free(d->bdev);
+
+	/* Write back and close image files */
+	fbd_image_flush(d->img);
+	fbd_image_close(d->img);
+
+	/* Free FBD instance */
+	vmm_free(d);
+}
+VMM_EXPORT_SYMBOL(fbd_destroy);
+
+int fbd_qcow2_create(const char *path, u64 size, const char *backing)
+{
+	if (!path) {
+		return VMM_EINVALID;
+	}
+
+	return fbd_qcow2_image_create(path, size, backing);
+}
+VMM_EXPORT_SYMBOL(fbd_qcow2_create);
+
+struct fbd *fbd_find(const char *name)
+{
+	bool found;
+	struct dlist *l;
+	struct fbd *d;
+	irq_flags_t flags;
+
+	if (!name) {
+		return NULL;
+	}
+
+	found = FALSE;
+	d = NULL;
+
+	vmm_spin_lock_irqsave(&fbd_list_lock, flags);
+
+	list_for_each(l, &fbd_list) {
+		d = list_entry(l, struct fbd, head);
+		if (strcmp(d->bdev->name, name) == 0) {
+			found = TRUE;
+			break;
+		}
+	}
+
+	vmm_spin_unlock_irqrestore(&fbd_list_lock, flags);
+
+	if (!found) {
+		return NULL;
+	}
+
+	return d;
+}
+VMM_EXPORT_SYMBOL(fbd_find);
+
+struct fbd *fbd_get(int index)
+{
+	bool found;
+	struct dlist *l;
+	struct fbd *retval;
+	irq_flags_t flags;
+
+	if (index < 0) {
+		return NULL;
+	}
+
+	retval = NULL;
+	found = FALSE;
+
+	vmm_spin_lock_irqsave(&fbd_list_lock, flags);
+
+	list_for_each(l, &fbd_list) {
+		retval = list_entry(l, struct fbd, head);
+		if (!index) {
+			found = TRUE;
+			break;
+		}
+		index--;
+	}
+
+	vmm_spin_unlock_irqrestore(&fbd_list_lock, flags);
+
+	if (!found) {
+		return NULL;
+	}
+
+	return retval;
+}
+VMM_EXPORT_SYMBOL(fbd_get);
+
+u32 fbd_count(void)
+{
+	u32 retval = 0;
+	struct dlist *l;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&fbd_list_lock, flags);
+
+	list_for_each(l, &fbd_list) {
+		retval++;
+	}
+
+	vmm_spin_unlock_irqrestore(&fbd_list_lock, flags);
+
+	return retval;
+}
+VMM_EXPORT_SYMBOL(fbd_count);
+
+static int __init fbd_driver_init(void)
+{
+	fbd_zero_buf = vmm_zalloc(FBD_ZERO_BUF_SIZE);
+	if (!fbd_zero_buf) {
+		return VMM_ENOMEM;
+	}
+
+	return VMM_OK;
+}
+
+static void __exit fbd_driver_exit(void)
+{
+	vmm_free(fbd_zero_buf);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
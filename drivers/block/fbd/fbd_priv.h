@@ -0,0 +1,97 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file fbd_priv.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief Private interface of file backed block device driver.
+ */
+
+#ifndef __FBD_PRIV_H_
+#define __FBD_PRIV_H_
+
+#include <vmm_types.h>
+#include <libs/vfs.h>
+
+/* Max depth of backing image chain */
+#define FBD_MAX_BACKING_DEPTH		8
+
+struct fbd_image;
+
+/** Image file format operations */
+struct fbd_format {
+	const char *name;
+	/* Check whether image file is of this format */
+	bool (*probe)(struct fbd_image *img);
+	/* Setup image (must set virtual size of image) */
+	int (*open)(struct fbd_image *img, u64 size, u32 depth);
+	void (*close)(struct fbd_image *img);
+	int (*read)(struct fbd_image *img, u64 off, void *buf, u32 len);
+	int (*write)(struct fbd_image *img, u64 off, const void *buf, u32 len);
+	int (*flush)(struct fbd_image *img);
+};
+
+/** Opened image file */
+struct fbd_image {
+	char path[VFS_MAX_PATH];
+	int fd;
+	bool rdonly;
+	u64 file_size;
+	u64 size;
+	const struct fbd_format *fmt;
+	struct fbd_image *backing;
+	void *priv;
+};
+
+extern const struct fbd_format fbd_raw_format;
+extern const struct fbd_format fbd_qcow2_format;
+
+/** Open image file and detect its format */
+int fbd_image_open(const char *path, bool rdonly, u64 size, u32 depth,
+		   struct fbd_image **imgp);
+
+/** Close image file and its backing image files */
+void fbd_image_close(struct fbd_image *img);
+
+/** Read from virtual disk of image where bytes beyond
+ *  virtual size of image are read as zeros
+ */
+int fbd_image_read(struct fbd_image *img, u64 off, void *buf, u32 len);
+
+/** Write to virtual disk of image */
+int fbd_image_write(struct fbd_image *img, u64 off,
+		    const void *buf, u32 len);
+
+/** Flush image file */
+int fbd_image_flush(struct fbd_image *img);
+
+/** Read from image file where bytes beyond end of file
+ *  are read as zeros
+ */
+int fbd_file_read(struct fbd_image *img, u64 off, void *buf, u32 len);
+
+/** Write to image file (extending it if required) */
+int fbd_file_write(struct fbd_image *img, u64 off,
+		   const void *buf, u32 len);
+
+/** Write zeros to image file (extending it if required) */
+int fbd_file_zero(struct fbd_image *img, u64 off, u32 len);
+
+/** Create empty qcow2 image file */
+int fbd_qcow2_image_create(const char *path, u64 size, const char *backing);
+
+#endif /* __FBD_PRIV_H_ */
@@ -0,0 +1,777 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file fbd_qcow2.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief QCOW2 image format for file backed block device driver.
+ *
+ * The virtual disk of QCOW2 image is divided into clusters which are
+ * mapped to image file using a two level (L1/L2) table. Clusters not
+ * allocated in image file are read from backing image (if any) or as
+ * zeros. On first write to such a cluster, a new cluster is allocated
+ * at the end of image file and filled with contents of backing image
+ * (i.e. copy-on-write).
+ *
+ * Both version 2 and version 3 images are supported for reading. For
+ * writing, the image must use 16-bit refcounts and must not have any
+ * snapshots or incompatible features. Compressed clusters and encrypted
+ * images are not supported.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_compiler.h>
+#include <vmm_host_io.h>
+#include <libs/stringlib.h>
+#include <drv/fbd.h>
+
+#include "fbd_priv.h"
+
+#define QCOW2_MAGIC			0x514649fb /* 'Q' 'F' 'I' 0xfb */
+
+#define QCOW2_MIN_CLUSTER_BITS		9
+#define QCOW2_MAX_CLUSTER_BITS		21
+#define QCOW2_DEF_CLUSTER_BITS		16
+
+/* Limit on size of in-memory L1 and refcount tables */
+#define QCOW2_MAX_TABLE_SIZE		(32 * 1024 * 1024)
+
+#define QCOW2_MAX_BACKING_NAME		1023
+
+#define QCOW2_V2_HEADER_LENGTH		72
+#define QCOW2_V3_HEADER_LENGTH		104
+
+#define QCOW2_INCOMPAT_DIRTY		(1ULL << 0)
+
+#define QCOW2_OFLAG_COPIED		(1ULL << 63)
+#define QCOW2_OFLAG_COMPRESSED		(1ULL << 62)
+#define QCOW2_OFLAG_ZERO		(1ULL << 0)
+#define QCOW2_L1E_OFFSET_MASK		0x00fffffffffffe00ULL
+#define QCOW2_L2E_OFFSET_MASK		0x00fffffffffffe00ULL
+#define QCOW2_REFT_OFFSET_MASK		0xfffffffffffffe00ULL
+
+/* Number of L2 tables cached per image */
+#define QCOW2_L2_CACHE_SIZE		4
+
+struct qcow2_header {
+	u32 magic;
+	u32 version;
+	u64 backing_file_offset;
+	u32 backing_file_size;
+	u32 cluster_bits;
+	u64 size;
+	u32 crypt_method;
+	u32 l1_size;
+	u64 l1_table_offset;
+	u64 refcount_table_offset;
+	u32 refcount_table_clusters;
+	u32 nb_snapshots;
+	u64 snapshots_offset;
+	/* Version 3 fields */
+	u64 incompatible_features;
+	u64 compatible_features;
+	u64 autoclear_features;
+	u32 refcount_order;
+	u32 header_length;
+} __packed;
+
+struct qcow2_l2_cache {
+	u64 offset;
+	u64 stamp;
+	u64 *table;
+};
+
+struct qcow2 {
+	u32 version;
+	u32 cluster_bits;
+	u64 cluster_size;
+	u32 l2_bits;
+	u32 l1_size;
+	u64 l1_table_offset;
+	u64 *l1_table;
+	u64 refcount_table_offset;
+	u32 refcount_table_size;
+	u64 *refcount_table;
+	bool writable;
+	u64 alloc_off;
+	u64 l2_stamp;
+	struct qcow2_l2_cache l2_cache[QCOW2_L2_CACHE_SIZE];
+	u8 *cow_buf;
+};
+
+static bool qcow2_probe(struct fbd_image *img)
+{
+	u32 magic;
+
+	if (img->file_size < QCOW2_V2_HEADER_LENGTH) {
+		return FALSE;
+	}
+
+	if (fbd_file_read(img, 0, &magic, sizeof(magic))) {
+		return FALSE;
+	}
+
+	return (vmm_be32_to_cpu(magic) == QCOW2_MAGIC) ? TRUE : FALSE;
+}
+
+static u64 *qcow2_l2_table(struct fbd_image *img, u64 l2_off, bool fresh)
+{
+	int i, rc;
+	struct qcow2 *q = img->priv;
+	struct qcow2_l2_cache *c, *victim = NULL;
+
+	for (i = 0; i < QCOW2_L2_CACHE_SIZE; i++) {
+		c = &q->l2_cache[i];
+		if (c->table && c->offset == l2_off) {
+			c->stamp = ++q->l2_stamp;
+			return c->table;
+		}
+		if (!victim || c->stamp < victim->stamp) {
+			victim = c;
+		}
+	}
+
+	if (!victim->table) {
+		victim->table = vmm_malloc(q->cluster_size);
+		if (!victim->table) {
+			return NULL;
+		}
+	}
+
+	if (fresh) {
+		memset(victim->table, 0, q->cluster_size);
+	} else {
+		rc = fbd_file_read(img, l2_off, victim->table, q->cluster_size);
+		if (rc) {
+			victim->offset = 0;
+			victim->stamp = 0;
+			return NULL;
+		}
+	}
+	victim->offset = l2_off;
+	victim->stamp = ++q->l2_stamp;
+
+	return victim->table;
+}
+
+static int qcow2_refcount_inc(struct fbd_image *img, u64 host_off)
+{
+	int rc;
+	u16 refcount;
+	u64 rb_off, rt_idx, rb_idx;
+	struct qcow2 *q = img->priv;
+	u32 rb_bits = q->cluster_bits - 1; /* 16-bit refcounts */
+
+	rt_idx = host_off >> (q->cluster_bits + rb_bits);
+	rb_idx = (host_off >> q->cluster_bits) & ((1ULL << rb_bits) - 1);
+	if (rt_idx >= q->refcount_table_size) {
+		return VMM_ENOSPC;
+	}
+
+	rb_off = vmm_be64_to_cpu(q->refcount_table[rt_idx]) &
+		 QCOW2_REFT_OFFSET_MASK;
+	if (!rb_off) {
+		/* Allocate new refcount block */
+		rb_off = q->alloc_off;
+		q->alloc_off += q->cluster_size;
+		rc = fbd_file_zero(img, rb_off, q->cluster_size);
+		if (rc) {
+			return rc;
+		}
+		q->refcount_table[rt_idx] = vmm_cpu_to_be64(rb_off);
+		rc = fbd_file_write(img, q->refcount_table_offset + rt_idx * 8,
+				    &q->refcount_table[rt_idx], 8);
+		if (rc) {
+			return rc;
+		}
+		/* New refcount block is referenced by refcount table */
+		rc = qcow2_refcount_inc(img, rb_off);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	rc = fbd_file_read(img, rb_off + rb_idx * 2, &refcount, 2);
+	if (rc) {
+		return rc;
+	}
+	refcount = vmm_cpu_to_be16(vmm_be16_to_cpu(refcount) + 1);
+
+	return fbd_file_write(img, rb_off + rb_idx * 2, &refcount, 2);
+}
+
+static int qcow2_alloc_cluster(struct fbd_image *img, u64 *host_off)
+{
+	int rc;
+	struct qcow2 *q = img->priv;
+	u64 off = q->alloc_off;
+
+	q->alloc_off += q->cluster_size;
+
+	rc = qcow2_refcount_inc(img, off);
+	if (rc) {
+		return rc;
+	}
+
+	*host_off = off;
+
+	return VMM_OK;
+}
+
+static int qcow2_read(struct fbd_image *img, u64 off, void *buf, u32 len)
+{
+	int rc;
+	u32 clen;
+	u64 coff, l1_idx, l2_off, entry, host_off, *l2;
+	struct qcow2 *q = img->priv;
+
+	while (len) {
+		coff = off & (q->cluster_size - 1);
+		clen = ((q->cluster_size - coff) < len) ?
+			(q->cluster_size - coff) : len;
+
+		/* Find L2 entry of cluster */
+		entry = 0;
+		l1_idx = off >> (q->cluster_bits + q->l2_bits);
+		l2_off = (l1_idx < q->l1_size) ?
+			 vmm_be64_to_cpu(q->l1_table[l1_idx]) &
+			 QCOW2_L1E_OFFSET_MASK : 0;
+		if (l2_off) {
+			l2 = qcow2_l2_table(img, l2_off, FALSE);
+			if (!l2) {
+				return VMM_EIO;
+			}
+			entry = vmm_be64_to_cpu(l2[(off >> q->cluster_bits) &
+					((1ULL << q->l2_bits) - 1)]);
+		}
+		host_off = entry & QCOW2_L2E_OFFSET_MASK;
+
+		if (entry & QCOW2_OFLAG_COMPRESSED) {
+			return VMM_EIO;
+		} else if ((q->version >= 3) && (entry & QCOW2_OFLAG_ZERO)) {
+			memset(buf, 0, clen);
+		} else if (host_off) {
+			rc = fbd_file_read(img, host_off + coff, buf, clen);
+			if (rc) {
+				return rc;
+			}
+		} else if (img->backing) {
+			rc = fbd_image_read(img->backing, off, buf, clen);
+			if (rc) {
+				return rc;
+			}
+		} else {
+			memset(buf, 0, clen);
+		}
+
+		off += clen;
+		buf = (u8 *)buf + clen;
+		len -= clen;
+	}
+
+	return VMM_OK;
+}
+
+static int qcow2_write_cluster(struct fbd_image *img, u64 off,
+			       const void *buf, u32 len)
+{
+	int rc;
+	bool zero;
+	u64 coff, l1_idx, l2_idx, l2_off, entry, host_off, *l2;
+	struct qcow2 *q = img->priv;
+
+	coff = off & (q->cluster_size - 1);
+	l1_idx = off >> (q->cluster_bits + q->l2_bits);
+	l2_idx = (off >> q->cluster_bits) & ((1ULL << q->l2_bits) - 1);
+	if (l1_idx >= q->l1_size) {
+		return VMM_EIO;
+	}
+
+	/* Find or allocate L2 table */
+	l2_off = vmm_be64_to_cpu(q->l1_table[l1_idx]) & QCOW2_L1E_OFFSET_MASK;
+	if (!l2_off) {
+		rc = qcow2_alloc_cluster(img, &l2_off);
+		if (rc) {
+			return rc;
+		}
+		memset(q->cow_buf, 0, q->cluster_size);
+		rc = fbd_file_write(img, l2_off, q->cow_buf, q->cluster_size);
+		if (rc) {
+			return rc;
+		}
+		q->l1_table[l1_idx] = vmm_cpu_to_be64(l2_off |
+						      QCOW2_OFLAG_COPIED);
+		rc = fbd_file_write(img, q->l1_table_offset + l1_idx * 8,
+				    &q->l1_table[l1_idx], 8);
+		if (rc) {
+			return rc;
+		}
+		l2 = qcow2_l2_table(img, l2_off, TRUE);
+	} else {
+		l2 = qcow2_l2_table(img, l2_off, FALSE);
+	}
+	if (!l2) {
+		return VMM_EIO;
+	}
+
+	entry = vmm_be64_to_cpu(l2[l2_idx]);
+	host_off = entry & QCOW2_L2E_OFFSET_MASK;
+	zero = ((q->version >= 3) && (entry & QCOW2_OFLAG_ZERO)) ?
+		TRUE : FALSE;
+	if (entry & QCOW2_OFLAG_COMPRESSED) {
+		return VMM_EIO;
+	}
+
+	/* Allocated cluster is updated in-place */
+	if (host_off && !zero) {
+		return fbd_file_write(img, host_off + coff, buf, len);
+	}
+
+	/* Preallocated zero cluster is reused otherwise allocate new one */
+	if (!host_off) {
+		rc = qcow2_alloc_cluster(img, &host_off);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	/* Fill complete cluster and write it */
+	if (len < q->cluster_size) {
+		if (!zero && img->backing) {
+			rc = fbd_image_read(img->backing, off - coff,
+					    q->cow_buf, q->cluster_size);
+			if (rc) {
+				return rc;
+			}
+		} else {
+			memset(q->cow_buf, 0, q->cluster_size);
+		}
+		memcpy(q->cow_buf + coff, buf, len);
+		buf = q->cow_buf;
+	}
+	rc = fbd_file_write(img, host_off, buf, q->cluster_size);
+	if (rc) {
+		return rc;
+	}
+
+	/* Point L2 entry to new cluster */
+	l2[l2_idx] = vmm_cpu_to_be64(host_off | QCOW2_OFLAG_COPIED);
+
+	return fbd_file_write(img, l2_off + l2_idx * 8, &l2[l2_idx], 8);
+}
+
+static int qcow2_write(struct fbd_image *img, u64 off,
+		       const void *buf, u32 len)
+{
+	int rc;
+	u32 clen;
+	struct qcow2 *q = img->priv;
+
+	if (!q->writable) {
+		return VMM_ENOTSUPP;
+	}
+
+	while (len) {
+		clen = q->cluster_size - (off & (q->cluster_size - 1));
+		clen = (clen < len) ? clen : len;
+
+		rc = qcow2_write_cluster(img, off, buf, clen);
+		if (rc) {
+			return rc;
+		}
+
+		off += clen;
+		buf = (const u8 *)buf + clen;
+		len -= clen;
+	}
+
+	return VMM_OK;
+}
+
+/* Backing name relative to directory of image is converted to path */
+static int qcow2_backing_path(const char *image, const char *name,
+			      char *path)
+{
+	char *sep;
+
+	path[0] = '\0';
+	if (name[0] != '/') {
+		strlcpy(path, image, VFS_MAX_PATH);
+		sep = strrchr(path, '/');
+		if (sep) {
+			sep[1] = '\0';
+		} else {
+			path[0] = '\0';
+		}
+	}
+
+	if (strlcat(path, name, VFS_MAX_PATH) >= VFS_MAX_PATH) {
+		return VMM_EOVERFLOW;
+	}
+
+	return VMM_OK;
+}
+
+static int qcow2_open_backing(struct fbd_image *img, u64 name_off,
+			      u32 name_len, u32 depth)
+{
+	int rc;
+	char *name, *path;
+
+	if (name_len > QCOW2_MAX_BACKING_NAME) {
+		return VMM_EINVALID;
+	}
+
+	name = vmm_zalloc(name_len + 1);
+	path = vmm_zalloc(VFS_MAX_PATH);
+	if (!name || !path) {
+		rc = VMM_ENOMEM;
+		goto done;
+	}
+
+	rc = fbd_file_read(img, name_off, name, name_len);
+	if (rc) {
+		goto done;
+	}
+
+	rc = qcow2_backing_path(img->path, name, path);
+	if (rc) {
+		goto done;
+	}
+
+	/* Backing image is never written */
+	rc = fbd_image_open(path, TRUE, 0, depth + 1, &img->backing);
+	if (rc) {
+		vmm_printf("%s: failed to open backing image %s (error %d)\n",
+			   __func__, path, rc);
+	}
+
+done:
+	if (path) {
+		vmm_free(path);
+	}
+	if (name) {
+		vmm_free(name);
+	}
+	return rc;
+}
+
+static void qcow2_close(struct fbd_image *img)
+{
+	int i;
+	struct qcow2 *q = img->priv;
+
+	if (!q) {
+		return;
+	}
+
+	for (i = 0; i < QCOW2_L2_CACHE_SIZE; i++) {
+		if (q->l2_cache[i].table) {
+			vmm_free(q->l2_cache[i].table);
+		}
+	}
+	if (q->cow_buf) {
+		vmm_free(q->cow_buf);
+	}
+	if (q->refcount_table) {
+		vmm_free(q->refcount_table);
+	}
+	if (q->l1_table) {
+		vmm_free(q->l1_table);
+	}
+	vmm_free(q);
+	img->priv = NULL;
+}
+
+static int qcow2_open(struct fbd_image *img, u64 size, u32 depth)
+{
+	int rc;
+	u64 l1_need, incompat;
+	u32 refcount_order, rt_bytes;
+	struct qcow2_header h;
+	struct qcow2 *q;
+
+	memset(&h, 0, sizeof(h));
+	rc = fbd_file_read(img, 0, &h,
+		(img->file_size < sizeof(h)) ? img->file_size : sizeof(h));
+	if (rc) {
+		return rc;
+	}
+
+	q = vmm_zalloc(sizeof(struct qcow2));
+	if (!q) {
+		return VMM_ENOMEM;
+	}
+	img->priv = q;
+
+	q->version = vmm_be32_to_cpu(h.version);
+	q->cluster_bits = vmm_be32_to_cpu(h.cluster_bits);
+	img->size = vmm_be64_to_cpu(h.size);
+	q->l1_size = vmm_be32_to_cpu(h.l1_size);
+	q->l1_table_offset = vmm_be64_to_cpu(h.l1_table_offset);
+	q->refcount_table_offset = vmm_be64_to_cpu(h.refcount_table_offset);
+	if (q->version >= 3) {
+		incompat = vmm_be64_to_cpu(h.incompatible_features);
+		refcount_order = vmm_be32_to_cpu(h.refcount_order);
+	} else {
+		incompat = 0;
+		refcount_order = 4;
+	}
+
+	if ((q->version != 2) && (q->version != 3)) {
+		rc = VMM_ENOTSUPP;
+		goto fail;
+	}
+	if ((q->cluster_bits < QCOW2_MIN_CLUSTER_BITS) ||
+	    (q->cluster_bits > QCOW2_MAX_CLUSTER_BITS)) {
+		rc = VMM_EINVALID;
+		goto fail;
+	}
+	if (vmm_be32_to_cpu(h.crypt_method) ||
+	    (incompat & ~QCOW2_INCOMPAT_DIRTY)) {
+		rc = VMM_ENOTSUPP;
+		goto fail;
+	}
+
+	q->cluster_size = 1ULL << q->cluster_bits;
+	q->l2_bits = q->cluster_bits - 3;
+	l1_need = (img->size + (1ULL << (q->cluster_bits + q->l2_bits)) - 1)
+			>> (q->cluster_bits + q->l2_bits);
+	if (!img->size || (q->l1_size < l1_need) ||
+	    ((u64)q->l1_size * 8 > QCOW2_MAX_TABLE_SIZE) ||
+	    (q->l1_table_offset & (q->cluster_size - 1))) {
+		rc = VMM_EINVALID;
+		goto fail;
+	}
+
+	/* Load L1 table */
+	q->l1_table = vmm_zalloc(q->l1_size * 8);
+	if (!q->l1_table) {
+		rc = VMM_ENOMEM;
+		goto fail;
+	}
+	rc = fbd_file_read(img, q->l1_table_offset,
+			   q->l1_table, q->l1_size * 8);
+	if (rc) {
+		goto fail;
+	}
+
+	/* Open backing image */
+	if (h.backing_file_offset && h.backing_file_size) {
+		rc = qcow2_open_backing(img,
+				vmm_be64_to_cpu(h.backing_file_offset),
+				vmm_be32_to_cpu(h.backing_file_size), depth);
+		if (rc) {
+			goto fail;
+		}
+	}
+
+	/* Writes are only supported for simple images */
+	q->writable = (!img->rdonly && (refcount_order == 4) &&
+		       !h.nb_snapshots && !incompat) ? TRUE : FALSE;
+	if (!img->rdonly && !q->writable) {
+		vmm_printf("%s: %s can only be opened read-only\n",
+			   __func__, img->path);
+		rc = VMM_ENOTSUPP;
+		goto fail;
+	}
+	if (!q->writable) {
+		return VMM_OK;
+	}
+
+	/* Load refcount table */
+	rt_bytes = vmm_be32_to_cpu(h.refcount_table_clusters);
+	if (!rt_bytes || (rt_bytes > (QCOW2_MAX_TABLE_SIZE >> q->cluster_bits)) ||
+	    (q->refcount_table_offset & (q->cluster_size - 1))) {
+		rc = VMM_EINVALID;
+		goto fail;
+	}
+	rt_bytes <<= q->cluster_bits;
+	q->refcount_table_size = rt_bytes / 8;
+	q->refcount_table = vmm_zalloc(rt_bytes);
+	if (!q->refcount_table) {
+		rc = VMM_ENOMEM;
+		goto fail;
+	}
+	rc = fbd_file_read(img, q->refcount_table_offset,
+			   q->refcount_table, rt_bytes);
+	if (rc) {
+		goto fail;
+	}
+
+	q->cow_buf = vmm_malloc(q->cluster_size);
+	if (!q->cow_buf) {
+		rc = VMM_ENOMEM;
+		goto fail;
+	}
+
+	/* New clusters are allocated at end of image file */
+	q->alloc_off = (img->file_size + q->cluster_size - 1) &
+			~(q->cluster_size - 1);
+
+	return VMM_OK;
+
+fail:
+	if (img->backing) {
+		fbd_image_close(img->backing);
+		img->backing = NULL;
+	}
+	qcow2_close(img);
+	return rc;
+}
+
+const struct fbd_format fbd_qcow2_format = {
+	.name = "qcow2",
+	.probe = qcow2_probe,
+	.open = qcow2_open,
+	.close = qcow2_close,
+	.read = qcow2_read,
+	.write = qcow2_write,
+};
+
+int fbd_qcow2_image_create(const char *path, u64 size, const char *backing)
+{
+	int rc;
+	u32 i, l1_size, l1_clusters, name_len = 0;
+	u64 cs = 1ULL << QCOW2_DEF_CLUSTER_BITS;
+	u32 l2_bits = QCOW2_DEF_CLUSTER_BITS - 3;
+	struct qcow2_header *h;
+	struct fbd_image *img, *bimg;
+	u64 *rt;
+	u16 *rb;
+	u8 *buf;
+
+	if (backing) {
+		name_len = strlen(backing);
+		if (!name_len || (name_len > QCOW2_MAX_BACKING_NAME)) {
+			return VMM_EINVALID;
+		}
+		/* Backing image must be usable */
+		buf = vmm_zalloc(VFS_MAX_PATH);
+		if (!buf) {
+			return VMM_ENOMEM;
+		}
+		rc = qcow2_backing_path(path, backing, (char *)buf);
+		if (!rc) {
+			rc = fbd_image_open((char *)buf, TRUE, 0, 1, &bimg);
+		}
+		vmm_free(buf);
+		if (rc) {
+			return rc;
+		}
+		if (!size) {
+			size = bimg->size;
+		}
+		fbd_image_close(bimg);
+	}
+
+	size = (size + FBD_BLOCK_SIZE - 1) & ~((u64)FBD_BLOCK_SIZE - 1);
+	if (!size) {
+		return VMM_EINVALID;
+	}
+	l1_size = (size + (1ULL << (QCOW2_DEF_CLUSTER_BITS + l2_bits)) - 1)
+			>> (QCOW2_DEF_CLUSTER_BITS + l2_bits);
+	l1_clusters = ((u64)l1_size * 8 + cs - 1) >> QCOW2_DEF_CLUSTER_BITS;
+	if ((3 + l1_clusters) > (cs / 2)) {
+		/* Initial refcount block must cover all metadata */
+		return VMM_EINVALID;
+	}
+
+	img = vmm_zalloc(sizeof(struct fbd_image));
+	buf = vmm_malloc(cs);
+	if (!img || !buf) {
+		rc = VMM_ENOMEM;
+		goto done;
+	}
+
+	img->fd = vfs_open(path, O_RDWR | O_CREAT | O_TRUNC, 0);
+	if (img->fd < 0) {
+		rc = img->fd;
+		goto done;
+	}
+
+	/*
+	 * Image layout:
+	 * cluster 0 = header (followed by backing file name)
+	 * cluster 1 = refcount table
+	 * cluster 2 = refcount block
+	 * cluster 3 onwards = L1 table
+	 */
+	memset(buf, 0, cs);
+	h = (struct qcow2_header *)buf;
+	h->magic = vmm_cpu_to_be32(QCOW2_MAGIC);
+	h->version = vmm_cpu_to_be32(3);
+	h->cluster_bits = vmm_cpu_to_be32(QCOW2_DEF_CLUSTER_BITS);
+	h->size = vmm_cpu_to_be64(size);
+	h->l1_size = vmm_cpu_to_be32(l1_size);
+	h->l1_table_offset = vmm_cpu_to_be64(3 * cs);
+	h->refcount_table_offset = vmm_cpu_to_be64(cs);
+	h->refcount_table_clusters = vmm_cpu_to_be32(1);
+	h->refcount_order = vmm_cpu_to_be32(4);
+	h->header_length = vmm_cpu_to_be32(QCOW2_V3_HEADER_LENGTH);
+	/* Header extension end marker is at header_length (already zero) */
+	if (backing) {
+		h->backing_file_offset =
+			vmm_cpu_to_be64(QCOW2_V3_HEADER_LENGTH + 8);
+		h->backing_file_size = vmm_cpu_to_be32(name_len);
+		memcpy(buf + QCOW2_V3_HEADER_LENGTH + 8, backing, name_len);
+	}
+	rc = fbd_file_write(img, 0, buf, cs);
+	if (rc) {
+		goto done_close;
+	}
+
+	memset(buf, 0, cs);
+	rt = (u64 *)buf;
+	rt[0] = vmm_cpu_to_be64(2 * cs);
+	rc = fbd_file_write(img, cs, buf, cs);
+	if (rc) {
+		goto done_close;
+	}
+
+	memset(buf, 0, cs);
+	rb = (u16 *)buf;
+	for (i = 0; i < (3 + l1_clusters); i++) {
+		rb[i] = vmm_cpu_to_be16(1);
+	}
+	rc = fbd_file_write(img, 2 * cs, buf, cs);
+	if (rc) {
+		goto done_close;
+	}
+
+	for (i = 0; i < l1_clusters; i++) {
+		rc = fbd_file_zero(img, (3 + i) * cs, cs);
+		if (rc) {
+			goto done_close;
+		}
+	}
+
+	rc = vfs_fsync(img->fd);
+
+done_close:
+	vfs_close(img->fd);
+done:
+	if (buf) {
+		vmm_free(buf);
+	}
+	if (img) {
+		vmm_free(img);
+	}
+	return rc;
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file fbd_raw.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief Raw image format for file backed block device driver.
+ *
+ * The virtual disk of raw image maps one-to-one to the image file.
+ * The virtual disk can be larger than the image file in which case
+ * bytes beyond end of file are read as zeros and the image file is
+ * extended on write (i.e. sparse image).
+ */
+
+#include <vmm_error.h>
+#include <drv/fbd.h>
+
+#include "fbd_priv.h"
+
+static bool fbd_raw_probe(struct fbd_image *img)
+{
+	/* Any file can be used as raw image */
+	return TRUE;
+}
+
+static int fbd_raw_open(struct fbd_image *img, u64 size, u32 depth)
+{
+	img->size = (size) ? size : img->file_size;
+	if (!img->size) {
+		return VMM_EINVALID;
+	}
+
+	return VMM_OK;
+}
+
+static int fbd_raw_read(struct fbd_image *img, u64 off, void *buf, u32 len)
+{
+	return fbd_file_read(img, off, buf, len);
+}
+
+static int fbd_raw_write(struct fbd_image *img, u64 off,
+			 const void *buf, u32 len)
+{
+	return fbd_file_write(img, off, buf, len);
+}
+
+const struct fbd_format fbd_raw_format = {
+	.name = "raw",
+	.probe = fbd_raw_probe,
+	.open = fbd_raw_open,
+	.read = fbd_raw_read,
+	.write = fbd_raw_write,
+};
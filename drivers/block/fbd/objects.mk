@@ -0,0 +1,31 @@
+#/**
+# Copyright (c) 2026 Anup Patel.
+# All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# @file objects.mk
+# @author Anup Patel (anup@brainfault.org)
+# @brief list of file backed block device driver objects
+# */
+
+drivers-objs-$(CONFIG_BLOCK_FBD)+= block/fbd/fbd.o
+
+fbd-y += fbd_main.o
+fbd-y += fbd_raw.o
+fbd-y += fbd_qcow2.o
+
+%/fbd.o: $(foreach obj,$(fbd-y),%/$(obj))
+	$(call merge_objs,$@,$^)
@@ -40,6 +40,9 @@
 #define	MODULE_INIT			rbd_driver_init
 #define	MODULE_EXIT			rbd_driver_exit
 
+/* Max bytes zeroed in one go for discard and write zeroes */
+#define RBD_ZEROES_CHUNK		(1024 * 1024)
+
 static LIST_HEAD(rbd_list);
 static DEFINE_SPINLOCK(rbd_list_lock);
 
@@ -73,9 +76,41 @@ static int rbd_write_cache(struct vmm_blockrq *brq,
 	return VMM_OK;
 }
 
+static int rbd_write_zeroes(struct vmm_blockrq *brq,
+			    struct vmm_request *r, void *priv)
+{
+	u32 len;
+	struct rbd *d = priv;
+	physical_addr_t pa;
+	physical_size_t sz;
+
+	pa = d->addr + r->lba * RBD_BLOCK_SIZE;
+	sz = r->bcnt * RBD_BLOCK_SIZE;
+
+	while (sz) {
+		len = (sz < RBD_ZEROES_CHUNK) ? sz : RBD_ZEROES_CHUNK;
+		vmm_host_memory_set(pa, 0, len, TRUE);
+		pa += len;
+		sz -= len;
+	}
+
+	return VMM_OK;
+}
+
+static int rbd_discard(struct vmm_blockrq *brq,
+		       struct vmm_request *r, void *priv)
+{
+	/* RAM backing the device is reserved so it cannot be given
+	 * back hence discarded blocks are simply zeroed.
+	 */
+	return rbd_write_zeroes(brq, r, priv);
+}
+
 static struct vmm_blockrq_ops rbd_rq_ops = {
 	.read_cache = rbd_read_cache,
-	.write_cache = rbd_write_cache
+	.write_cache = rbd_write_cache,
+	.discard = rbd_discard,
+	.write_zeroes = rbd_write_zeroes
 };
 
 static struct rbd *__rbd_create(struct vmm_device *dev,
@@ -110,7 +145,7 @@ static struct rbd *__rbd_create(struct vmm_device *dev,
 	strncpy(d->bdev->desc, "RAM backed block device",
 		VMM_FIELD_DESC_SIZE);
 	d->bdev->dev.parent = dev;
-	d->bdev->flags = VMM_BLOCKDEV_RW;
+	d->bdev->flags = VMM_BLOCKDEV_RW | VMM_BLOCKDEV_DISCARD;
 	d->bdev->start_lba = 0;
 	d->bdev->num_blocks = udiv64(d->size, RBD_BLOCK_SIZE);
 	d->bdev->block_size = RBD_BLOCK_SIZE;
@@ -56,6 +56,10 @@ struct virtio_host_blk_req {
 	struct vmm_completion *cmpl;
 	struct virtio_host_blk *vblk;
 	struct vmm_virtio_blk_outhdr hdr;
+	struct virtio_blk_discard_write_zeroes range;
+	u64 range_sector;
+	u64 range_left;
+	u32 range_max;
 	u8 status;
 	struct virtio_host_iovec iovec[3];
 	struct virtio_host_iovec *ivs[3];
@@ -66,9 +70,14 @@ struct virtio_host_blk {
 	struct virtio_host_device *vdev;
 
 	bool read_only;
+	bool has_flush;
+	bool has_discard;
+	bool has_write_zeroes;
 	u64 num_blocks;
 	u32 block_size;
 	u32 seg_size;
+	u32 max_discard_sectors;
+	u32 max_write_zeroes_sectors;
 
 	u16 num_vqs;
 	struct virtio_host_queue **vqs;
@@ -201,6 +210,151 @@ static void virtio_host_blk_flush(struct vmm_blockrq *brq, void *priv)
 	return;
 }
 
+/* Add next chunk of discard or write zeroes range to VirtIO host queue */
+static int virtio_host_blk_add_range(struct virtio_host_blk *vblk,
+				     struct virtio_host_blk_req *req)
+{
+	int rc;
+	u32 nr_sectors;
+
+	nr_sectors = (req->range_left < req->range_max) ?
+				(u32)req->range_left : req->range_max;
+
+	req->range.sector = cpu_to_virtio64(vblk->vdev, req->range_sector);
+	req->range.num_sectors = cpu_to_virtio32(vblk->vdev, nr_sectors);
+	req->range.flags = 0;
+	req->iovec[1].buf = &req->range;
+	req->iovec[1].buf_len = sizeof(req->range);
+
+	DPRINTF(vblk, "%s: req=0x%p sector=%"PRIu64" nr_sectors=%d\n",
+		__func__, req, req->range_sector, nr_sectors);
+
+	rc = virtio_host_queue_add_iovecs(vblk->vqs[0], req->ivs, 2, 1, req);
+	if (rc) {
+		vmm_lerror(vblk->vdev->dev.name,
+			   "Failed to add iovecs to VirtIO host queue\n");
+		return rc;
+	}
+
+	req->range_sector += nr_sectors;
+	req->range_left -= nr_sectors;
+
+	virtio_host_queue_kick(vblk->vqs[0]);
+
+	return VMM_OK;
+}
+
+/* Ranges larger than max_sectors are split into chunks which are
+ * queued one after another from virtio_host_blk_done_work() and the
+ * block request completes with the last chunk.
+ */
+static int virtio_host_blk_queue_range(struct virtio_host_blk *vblk,
+				       struct vmm_request *r,
+				       u32 type, u32 max_sectors)
+{
+	int rc;
+	struct virtio_host_blk_req *req;
+
+	if (!fifo_dequeue(vblk->reqs_fifo, &req)) {
+		vmm_lerror(vblk->vdev->dev.name,
+			   "Failed to dequeue free request\n");
+		return VMM_EIO;
+	}
+
+	req->r = r;
+	req->cmpl = NULL;
+	req->hdr.type = cpu_to_virtio32(vblk->vdev, type);
+	req->hdr.ioprio = 0;
+	req->hdr.sector = 0;
+	req->range_sector = r->lba * udiv32(vblk->block_size, 512);
+	req->range_left = (u64)r->bcnt * udiv32(vblk->block_size, 512);
+	req->range_max = max_sectors;
+
+	DPRINTF(vblk, "%s: req=0x%p type=%d lba=%"PRIu64" bcnt=%d\n",
+		__func__, req, type, req->r->lba, req->r->bcnt);
+
+	rc = virtio_host_blk_add_range(vblk, req);
+	if (rc) {
+		req->r = NULL;
+		req->cmpl = NULL;
+		req->range_left = 0;
+		fifo_enqueue(vblk->reqs_fifo, &req, TRUE);
+		return rc;
+	}
+
+	return VMM_OK;
+}
+
+static int virtio_host_blk_discard(struct vmm_blockrq *brq,
+				   struct vmm_request *r, void *priv)
+{
+	struct virtio_host_blk *vblk = priv;
+
+	if (!vblk->has_discard) {
+		return VMM_EOPNOTSUPP;
+	}
+
+	return virtio_host_blk_queue_range(vblk, r,
+					   VMM_VIRTIO_BLK_T_DISCARD,
+					   vblk->max_discard_sectors);
+}
+
+static int virtio_host_blk_write_zeroes(struct vmm_blockrq *brq,
+					struct vmm_request *r, void *priv)
+{
+	struct virtio_host_blk *vblk = priv;
+
+	if (!vblk->has_write_zeroes) {
+		return VMM_EOPNOTSUPP;
+	}
+
+	return virtio_host_blk_queue_range(vblk, r,
+					   VMM_VIRTIO_BLK_T_WRITE_ZEROES,
+					   vblk->max_write_zeroes_sectors);
+}
+
+static int virtio_host_blk_sync(struct vmm_blockrq *brq,
+				struct vmm_request *r, void *priv)
+{
+	int rc;
+	struct virtio_host_blk *vblk = priv;
+	struct virtio_host_blk_req *req;
+
+	/* Without flush feature the host has no volatile write cache */
+	if (!vblk->has_flush) {
+		vmm_blockrq_async_done(brq, r, VMM_OK);
+		return VMM_OK;
+	}
+
+	if (!fifo_dequeue(vblk->reqs_fifo, &req)) {
+		vmm_lerror(vblk->vdev->dev.name,
+			   "Failed to dequeue free request\n");
+		return VMM_EIO;
+	}
+
+	req->r = r;
+	req->cmpl = NULL;
+	req->hdr.type = cpu_to_virtio32(vblk->vdev, VMM_VIRTIO_BLK_T_FLUSH);
+	req->hdr.ioprio = 0;
+	req->hdr.sector = 0;
+
+	DPRINTF(vblk, "%s: req=0x%p\n", __func__, req);
+
+	rc = virtio_host_queue_add_iovecs(vblk->vqs[0], req->ivs, 1, 1, req);
+	if (rc) {
+		vmm_lerror(vblk->vdev->dev.name,
+			   "Failed to add iovecs to VirtIO host queue\n");
+		req->r = NULL;
+		req->cmpl = NULL;
+		fifo_enqueue(vblk->reqs_fifo, &req, TRUE);
+		return rc;
+	}
+
+	virtio_host_queue_kick(vblk->vqs[0]);
+
+	return VMM_OK;
+}
+
 #define VIRTIO_HOST_BLK_DONE_BUDGET	8
 
 static void virtio_host_blk_done_work(struct vmm_blockrq *brq, void *priv)
@@ -253,6 +407,12 @@ static void virtio_host_blk_done_work(struct vmm_blockrq *brq, void *priv)
 			} else {
 				err = VMM_EINVALID;
 			}
+			if (!err && req->range_left) {
+				err = virtio_host_blk_add_range(vblk, req);
+				if (!err) {
+					continue;
+				}
+			}
 			vmm_blockrq_async_done(vblk->brq, req->r, err);
 		} else if (req->cmpl) {
 			DPRINTF(vblk, "%s: req=0x%p cmpl=0x%p len=%d\n",
@@ -266,6 +426,7 @@ static void virtio_host_blk_done_work(struct vmm_blockrq *brq, void *priv)
 
 		req->r = NULL;
 		req->cmpl = NULL;
+		req->range_left = 0;
 		fifo_enqueue(vblk->reqs_fifo, &req, TRUE);
 	} while (i < VIRTIO_HOST_BLK_DONE_BUDGET);
 
@@ -485,6 +646,9 @@ static int virtio_host_blk_name_format(char *prefix, int index,
 static struct vmm_blockrq_ops virtio_host_blk_rq_ops = {
 	.read = virtio_host_blk_read,
 	.write = virtio_host_blk_write,
+	.discard = virtio_host_blk_discard,
+	.write_zeroes = virtio_host_blk_write_zeroes,
+	.sync = virtio_host_blk_sync,
 	.flush = virtio_host_blk_flush
 };
 
@@ -549,6 +713,30 @@ static int virtio_host_blk_probe(struct virtio_host_device *vdev)
 					  vblk->block_size);
 	}
 
+	/* Host can optionally support flush, discard and write zeroes */
+	vblk->has_flush = virtio_host_has_feature(vdev,
+						 VMM_VIRTIO_BLK_F_FLUSH);
+	vblk->has_discard = (!vblk->read_only &&
+		virtio_host_has_feature(vdev, VMM_VIRTIO_BLK_F_DISCARD));
+	vblk->has_write_zeroes = (!vblk->read_only &&
+		virtio_host_has_feature(vdev, VMM_VIRTIO_BLK_F_WRITE_ZEROES));
+	if (vblk->has_discard) {
+		virtio_cread(vdev, struct vmm_virtio_blk_config,
+			     max_discard_sectors,
+			     &vblk->max_discard_sectors);
+		if (!vblk->max_discard_sectors) {
+			vblk->has_discard = false;
+		}
+	}
+	if (vblk->has_write_zeroes) {
+		virtio_cread(vdev, struct vmm_virtio_blk_config,
+			     max_write_zeroes_sectors,
+			     &vblk->max_write_zeroes_sectors);
+		if (!vblk->max_write_zeroes_sectors) {
+			vblk->has_write_zeroes = false;
+		}
+	}
+
 	/* Setup VirtIO host queues */
 	rc = virtio_host_blk_init_vqs(vblk);
 	if (rc) {
@@ -588,6 +776,9 @@ static int virtio_host_blk_probe(struct virtio_host_device *vdev)
 	vblk->bdev->dev.parent = &vblk->vdev->dev;
 	vblk->bdev->flags = (vblk->read_only) ?
 			 VMM_BLOCKDEV_RDONLY : VMM_BLOCKDEV_RW;
+	if (vblk->has_discard) {
+		vblk->bdev->flags |= VMM_BLOCKDEV_DISCARD;
+	}
 	vblk->bdev->start_lba = 0;
 	vblk->bdev->num_blocks = vblk->num_blocks;
 	vblk->bdev->block_size = vblk->block_size;
@@ -681,6 +872,8 @@ static unsigned int features[] = {
 	VMM_VIRTIO_BLK_F_RO,
 	VMM_VIRTIO_BLK_F_BLK_SIZE,
 	VMM_VIRTIO_BLK_F_FLUSH,
+	VMM_VIRTIO_BLK_F_DISCARD,
+	VMM_VIRTIO_BLK_F_WRITE_ZEROES,
 };
 
 static struct virtio_host_driver virtio_host_blk_driver = {
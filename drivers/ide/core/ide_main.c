@@ -42,6 +42,9 @@
 #define	MODULE_INIT			ide_core_init
 #define	MODULE_EXIT			ide_core_exit
 
+/* Size of zero buffer used for write zeroes requests */
+#define IDE_ZEROES_SIZE			(64 * 1024)
+
 /*
  * Protected list of ide hosts.
  */
@@ -141,6 +144,32 @@ static u32 __ide_bread(struct ide_drive *drive, u64 start,
 	return drive->io_ops.block_read(drive, start, blkcnt, dst);
 }
 
+static u32 __ide_bwrite_zeroes(struct ide_drive *drive, u64 start,
+			       u32 blkcnt)
+{
+	void *zeroes;
+	u32 cur, chunk, cnt = 0;
+
+	chunk = udiv32(IDE_ZEROES_SIZE, drive->blk_size);
+	chunk = (chunk) ? chunk : 1;
+	zeroes = vmm_zalloc(chunk * drive->blk_size);
+	if (!zeroes) {
+		return 0;
+	}
+
+	while (cnt < blkcnt) {
+		cur = ((blkcnt - cnt) < chunk) ? (blkcnt - cnt) : chunk;
+		if (__ide_bwrite(drive, start + cnt, cur, zeroes) != cur) {
+			break;
+		}
+		cnt += cur;
+	}
+
+	vmm_free(zeroes);
+
+	return cnt;
+}
+
 static int __ide_blockdev_request(struct ide_drive *drive,
 				  struct vmm_request_queue *rq,
 				  struct vmm_request *r)
@@ -178,6 +207,21 @@ static int __ide_blockdev_request(struct ide_drive *drive,
 			rc = VMM_EIO;
 		}
 		break;
+	case VMM_REQUEST_WRITE_ZEROES:
+		cnt = __ide_bwrite_zeroes(drive, r->lba, r->bcnt);
+		if (cnt == r->bcnt) {
+			vmm_blockdev_complete_request(r);
+			rc = VMM_OK;
+		} else {
+			vmm_blockdev_fail_request(r);
+			rc = VMM_EIO;
+		}
+		break;
+	case VMM_REQUEST_FLUSH:
+		/* Every PIO write is followed by cache flush command */
+		vmm_blockdev_complete_request(r);
+		rc = VMM_OK;
+		break;
 	default:
 		vmm_blockdev_fail_request(r);
 		rc = VMM_EFAIL;
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file fbd.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief Interface for file backed block device driver.
+ */
+
+#ifndef __FBD_H_
+#define __FBD_H_
+
+#include <vmm_types.h>
+#include <libs/list.h>
+#include <libs/vfs.h>
+#include <block/vmm_blockdev.h>
+
+#define FBD_IPRIORITY			(VFS_IPRIORITY+1)
+#define FBD_BLOCK_SIZE			512
+
+/** FBD instance flags */
+#define FBD_RDONLY			0x00000001
+
+struct fbd_image;
+
+/* File backed device (FBD) context */
+struct fbd {
+	struct dlist head;
+	struct vmm_blockdev *bdev;
+	char path[VFS_MAX_PATH];
+	const char *format;
+	u64 size;
+	struct fbd_image *img;
+};
+
+/** Create FBD instance for a raw or qcow2 image file
+ *  Note: For raw images, size zero means use file size whereas
+ *  non-zero size greater than file size creates a sparse device.
+ *  Note: Must be called from Orphan (or Thread) context.
+ */
+struct fbd *fbd_create(const char *name, const char *path,
+		       u64 size, u32 flags);
+
+/** Destroy FBD instance
+ *  Note: Must be called from Orphan (or Thread) context.
+ */
+void fbd_destroy(struct fbd *d);
+
+/** Create empty qcow2 image file of given virtual size which
+ *  optionally uses another image file as backing (base) image.
+ *  Note: If size is zero then size of backing image is used.
+ *  Note: Must be called from Orphan (or Thread) context.
+ */
+int fbd_qcow2_create(const char *path, u64 size, const char *backing);
+
+/** Find a FBD instance with given name */
+struct fbd *fbd_find(const char *name);
+
+/** Get FBD instance with given index */
+struct fbd *fbd_get(int index);
+
+/** Count number of FBD instances */
+u32 fbd_count(void);
+
+#endif /* __FBD_H_ */
@@ -459,6 +459,19 @@ static int mmc_blockrq_write(struct vmm_blockrq *brq,
 	return rc;
 }
 
+static int mmc_blockrq_discard(struct vmm_blockrq *brq,
+			       struct vmm_request *r, void *priv)
+{
+	int rc;
+	struct mmc_host *host = priv;
+
+	vmm_mutex_lock(&host->lock);
+	rc = __mmc_sd_berase(host, host->card, r->lba, r->bcnt);
+	vmm_mutex_unlock(&host->lock);
+
+	return rc;
+}
+
 static int mmc_blockrq_abort(struct vmm_blockrq *brq,
 			     struct vmm_request *r, void *priv)
 {
@@ -509,6 +522,7 @@ VMM_EXPORT_SYMBOL(mmc_alloc_host);
 static struct vmm_blockrq_ops mmc_rq_ops = {
 	.read = mmc_blockrq_read,
 	.write = mmc_blockrq_write,
+	.discard = mmc_blockrq_discard,
 	.abort = mmc_blockrq_abort,
 	.flush = mmc_blockrq_flush
 };
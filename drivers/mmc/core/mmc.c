@@ -52,6 +52,9 @@
 #define DPRINTF(msg...)
 #endif
 
+/* Max blocks erased by single erase command */
+#define MMC_ERASE_MAX_BLOCKS		65536
+
 struct mode_width_tuning {
 	enum mmc_bus_mode mode;
 	u32 widths;
@@ -261,6 +264,91 @@ u32 __mmc_sd_bwrite(struct mmc_host *host, struct mmc_card *card,
 	return blkcnt;
 }
 
+static int __mmc_erase_blocks(struct mmc_host *host, struct mmc_card *card,
+			      u64 start, u32 blkcnt)
+{
+	u64 end;
+	struct mmc_cmd cmd;
+	int timeout = 3000;
+
+	DPRINTF("%s: start=0x%llx blkcnt=%d\n", __func__,
+		(unsigned long long)start, blkcnt);
+
+	end = start + blkcnt - 1;
+	if (!card->high_capacity) {
+		start *= card->write_bl_len;
+		end *= card->write_bl_len;
+	}
+
+	if (IS_SD(card)) {
+		cmd.cmdidx = SD_CMD_ERASE_WR_BLK_START;
+	} else {
+		cmd.cmdidx = MMC_CMD_ERASE_GROUP_START;
+	}
+	cmd.cmdarg = start;
+	cmd.resp_type = MMC_RSP_R1;
+	if (mmc_send_cmd(host, &cmd, NULL)) {
+		return VMM_EIO;
+	}
+
+	if (IS_SD(card)) {
+		cmd.cmdidx = SD_CMD_ERASE_WR_BLK_END;
+	} else {
+		cmd.cmdidx = MMC_CMD_ERASE_GROUP_END;
+	}
+	cmd.cmdarg = end;
+	cmd.resp_type = MMC_RSP_R1;
+	if (mmc_send_cmd(host, &cmd, NULL)) {
+		return VMM_EIO;
+	}
+
+	cmd.cmdidx = MMC_CMD_ERASE;
+	cmd.cmdarg = 0;
+	cmd.resp_type = MMC_RSP_R1b;
+	if (mmc_send_cmd(host, &cmd, NULL)) {
+		return VMM_EIO;
+	}
+
+	/* Waiting for the ready status */
+	if (mmc_send_status(host, card, timeout)) {
+		return VMM_ETIMEDOUT;
+	}
+
+	return VMM_OK;
+}
+
+int __mmc_sd_berase(struct mmc_host *host, struct mmc_card *card,
+		    u64 start, u32 blkcnt)
+{
+	int rc;
+	u64 end;
+	u32 cur, grp = card->erase_grp_size;
+
+	if (!grp) {
+		return VMM_EOPNOTSUPP;
+	}
+
+	/* Only erase groups which are entirely within the range
+	 * because erase always works on whole erase groups.
+	 */
+	end = start + blkcnt;
+	start = udiv64(start + grp - 1, grp) * grp;
+	end = udiv64(end, grp) * grp;
+
+	while (start < end) {
+		cur = ((end - start) > MMC_ERASE_MAX_BLOCKS) ?
+				MMC_ERASE_MAX_BLOCKS : (end - start);
+		cur = (cur > grp) ? (cur - umod32(cur, grp)) : grp;
+		rc = __mmc_erase_blocks(host, card, start, cur);
+		if (rc) {
+			return rc;
+		}
+		start += cur;
+	}
+
+	return VMM_OK;
+}
+
 static u32 __mmc_read_blocks(struct mmc_host *host, struct mmc_card *card,
 			     void *dst, u64 start, u32 blkcnt)
 {
@@ -1799,6 +1887,9 @@ int __mmc_sd_attach(struct mmc_host *host)
 		     ((card->cid[2] >> 16) & 0xf));
 	bdev->dev.parent = host->dev;
 	bdev->flags = VMM_BLOCKDEV_RW;
+	if (card->erase_grp_size) {
+		bdev->flags |= VMM_BLOCKDEV_DISCARD;
+	}
 	if (card->read_bl_len < card->write_bl_len) {
 		bdev->block_size = card->write_bl_len;
 	} else {
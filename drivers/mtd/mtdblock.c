@@ -98,6 +98,27 @@ int mtd_blockdev_write(struct vmm_blockrq *brq,
 	return mtd_blockdev_erase_write(r, off, len, mtd);
 }
 
+int mtd_blockdev_discard(struct vmm_blockrq *brq,
+			 struct vmm_request *r, void *priv)
+{
+	struct erase_info info;
+	struct mtd_info *mtd = priv;
+
+	/* Block size is erase size so discard is plain erase */
+	info.mtd = mtd;
+	info.addr = r->lba << mtd->erasesize_shift;
+	info.len = r->bcnt << mtd->erasesize_shift;
+	info.callback = mtd_blockdev_erase_callback;
+
+	if (mtd_erase(mtd, &info)) {
+		dev_err(&r->bdev->dev, "Erasing at 0x%08X failed\n",
+			(u32)info.addr);
+		return VMM_EIO;
+	}
+
+	return VMM_OK;
+}
+
 void mtd_blockdev_flush(struct vmm_blockrq *brq, void *priv)
 {
 	/* Nothing to do here. */
@@ -106,6 +127,7 @@ void mtd_blockdev_flush(struct vmm_blockrq *brq, void *priv)
 static struct vmm_blockrq_ops mtd_blockdev_rq_ops = {
 	.read = mtd_blockdev_read,
 	.write = mtd_blockdev_write,
+	.discard = mtd_blockdev_discard,
 	.flush = mtd_blockdev_flush
 };
 
@@ -125,7 +147,7 @@ void mtdblock_add(struct mtd_info *mtd)
 	strncpy(bdev->desc, "MTD m25p80 NOR flash block device",
 		VMM_FIELD_DESC_SIZE);
 	bdev->dev.priv = mtd;
-	bdev->flags = VMM_BLOCKDEV_RW;
+	bdev->flags = VMM_BLOCKDEV_RW | VMM_BLOCKDEV_DISCARD;
 	bdev->start_lba = 0;
 	bdev->num_blocks = mtd->size >> mtd->erasesize_shift;
 	bdev->block_size = mtd->erasesize;
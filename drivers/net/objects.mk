@@ -28,3 +28,4 @@ drivers-objs-$(CONFIG_NET_DEVICES)+= net/ethtool.o
 drivers-objs-$(CONFIG_NET_DEVICES)+= net/of_net.o
 drivers-objs-$(CONFIG_NET_DEVICES)+= net/eth.o
 drivers-objs-$(CONFIG_NET_NAPI)+= net/dev.o
+drivers-objs-$(CONFIG_NET_VIRTIO_HOST)+= net/virtio_host_net.o
@@ -0,0 +1,716 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file virtio_host_net.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief VirtIO host network device driver.
+ *
+ * Each VirtIO host network device is exposed as a netport which is
+ * attached to the netswitch named by "switch" attribute of transport
+ * device node (or the default netswitch).
+ *
+ * Received frames are DMAed directly into mbufs which are handed over
+ * to the netswitch without copying. When multiple queue pairs are
+ * available, one queue pair is used per online host CPU and frames are
+ * transmitted on the queue pair of current host CPU. Partially
+ * checksummed frames received from device (VIRTIO_NET_F_GUEST_CSUM)
+ * are completed in software because mbufs don't carry checksum state.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_smp.h>
+#include <vmm_cpumask.h>
+#include <vmm_spinlocks.h>
+#include <vmm_stdio.h>
+#include <vmm_devtree.h>
+#include <vmm_modules.h>
+#include <net/vmm_mbuf.h>
+#include <net/vmm_netport.h>
+#include <net/vmm_netswitch.h>
+#include <vio/vmm_virtio_config.h>
+#include <vio/vmm_virtio_net.h>
+#include <drv/virtio_host.h>
+#include <libs/stringlib.h>
+
+#undef DEBUG
+
+#ifdef DEBUG
+#define DPRINTF(vnet, ...)		vmm_linfo((vnet)->vdev->dev.name, \
+						  __VA_ARGS__)
+#else
+#define DPRINTF(vnet, ...)
+#endif
+
+#define MODULE_DESC			"VirtIO Host Network Driver"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(VIRTIO_HOST_IPRIORITY + 1)
+#define	MODULE_INIT			virtio_host_net_init
+#define	MODULE_EXIT			virtio_host_net_exit
+
+#define VIRTIO_HOST_NET_MTU		1500
+#define VIRTIO_HOST_NET_MAX_FRAME	(VIRTIO_HOST_NET_MTU + 14 + 4)
+#define VIRTIO_HOST_NET_MAX_PAIRS	CONFIG_CPU_COUNT
+
+struct virtio_host_net;
+
+struct virtio_host_net_queue {
+	struct virtio_host_net *vnet;
+	struct virtio_host_queue *vq;
+	vmm_spinlock_t lock;
+};
+
+struct virtio_host_net {
+	struct virtio_host_device *vdev;
+	struct vmm_netport *port;
+
+	u32 hdr_len;
+	bool link_up;
+
+	u16 max_pairs;
+	u16 curr_pairs;
+	struct virtio_host_net_queue *rq;
+	struct virtio_host_net_queue *sq;
+	struct virtio_host_queue *cvq;
+
+	/* Transmitted frames don't use any offload hence
+	 * all of them share one zeroed (read-only) header */
+	struct vmm_virtio_net_hdr_mrg_rxbuf tx_hdr;
+};
+
+static u16 virtio_host_net_csum_fold(u8 *data, u32 len)
+{
+	u32 i, sum = 0;
+
+	for (i = 0; (i + 1) < len; i += 2) {
+		sum += ((u32)data[i] << 8) | data[i + 1];
+	}
+	if (len & 1) {
+		sum += (u32)data[len - 1] << 8;
+	}
+	while (sum >> 16) {
+		sum = (sum & 0xffff) + (sum >> 16);
+	}
+
+	return ~sum & 0xffff;
+}
+
+/* Complete checksum of a partially checksummed frame. The pseudo-header
+ * checksum is already stored at checksum location by the sender. */
+static int virtio_host_net_csum_complete(struct virtio_host_net *vnet,
+					 struct vmm_mbuf *mb,
+					 struct vmm_virtio_net_hdr *hdr)
+{
+	u16 csum;
+	u8 *data = mtod(mb, u8 *);
+	u32 start = virtio16_to_cpu(vnet->vdev, hdr->csum_start);
+	u32 offset = virtio16_to_cpu(vnet->vdev, hdr->csum_offset);
+
+	if (mb->m_len < (start + offset + 2)) {
+		return VMM_EINVALID;
+	}
+
+	csum = virtio_host_net_csum_fold(&data[start], mb->m_len - start);
+	if (!csum) {
+		csum = 0xffff;
+	}
+	data[start + offset] = csum >> 8;
+	data[start + offset + 1] = csum & 0xff;
+
+	return VMM_OK;
+}
+
+static int virtio_host_net_add_rxbuf(struct virtio_host_net_queue *q)
+{
+	int rc;
+	struct vmm_mbuf *mb;
+	struct virtio_host_iovec iov;
+	struct virtio_host_net *vnet = q->vnet;
+
+	MGETHDR(mb, 0, 0);
+	if (!mb) {
+		return VMM_ENOMEM;
+	}
+	if (!MEXTMALLOC(mb, vnet->hdr_len + VIRTIO_HOST_NET_MAX_FRAME,
+			VMM_MBUF_ALLOC_DMA)) {
+		m_freem(mb);
+		return VMM_ENOMEM;
+	}
+
+	/* Header and frame share one descriptor (VIRTIO_F_ANY_LAYOUT) */
+	iov.buf = M_BUFADDR(mb);
+	iov.buf_len = vnet->hdr_len + VIRTIO_HOST_NET_MAX_FRAME;
+
+	rc = virtio_host_queue_add_inbuf(q->vq, &iov, 1, mb);
+	if (rc) {
+		m_freem(mb);
+	}
+
+	return rc;
+}
+
+/* Note: must be called with queue lock held */
+static void virtio_host_net_fill_rxq(struct virtio_host_net_queue *q)
+{
+	bool added = FALSE;
+
+	while (q->vq->num_free) {
+		if (virtio_host_net_add_rxbuf(q)) {
+			break;
+		}
+		added = TRUE;
+	}
+
+	if (added) {
+		virtio_host_queue_kick(q->vq);
+	}
+}
+
+static void virtio_host_net_rx_done(struct virtio_host_queue *vq)
+{
+	unsigned int len;
+	irq_flags_t flags;
+	struct vmm_mbuf *mb;
+	struct vmm_virtio_net_hdr *hdr;
+	struct virtio_host_net *vnet = vq->vdev->priv;
+	struct virtio_host_net_queue *q = &vnet->rq[vq->index / 2];
+
+	vmm_spin_lock_irqsave(&q->lock, flags);
+
+	while ((mb = virtio_host_queue_get_buf(vq, &len))) {
+		if (len <= vnet->hdr_len) {
+			m_freem(mb);
+			continue;
+		}
+
+		hdr = (struct vmm_virtio_net_hdr *)M_BUFADDR(mb);
+		mb->m_data += vnet->hdr_len;
+		mb->m_len = mb->m_pktlen = len - vnet->hdr_len;
+
+		if ((hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) &&
+		    virtio_host_net_csum_complete(vnet, mb, hdr)) {
+			DPRINTF(vnet, "%s: bad csum_start/csum_offset\n",
+				__func__);
+			m_freem(mb);
+			continue;
+		}
+
+		if (!vnet->link_up || !vnet->port->nsw) {
+			m_freem(mb);
+			continue;
+		}
+
+		vmm_port2switch_xfer_mbuf(vnet->port, mb);
+	}
+
+	virtio_host_net_fill_rxq(q);
+
+	vmm_spin_unlock_irqrestore(&q->lock, flags);
+}
+
+/* Note: must be called with queue lock held */
+static void virtio_host_net_free_old_xmit(struct virtio_host_net_queue *q)
+{
+	unsigned int len;
+	struct vmm_mbuf *mb;
+
+	while ((mb = virtio_host_queue_get_buf(q->vq, &len))) {
+		m_freem(mb);
+	}
+}
+
+static void virtio_host_net_tx_done(struct virtio_host_queue *vq)
+{
+	irq_flags_t flags;
+	struct virtio_host_net *vnet = vq->vdev->priv;
+	struct virtio_host_net_queue *q = &vnet->sq[vq->index / 2];
+
+	vmm_spin_lock_irqsave(&q->lock, flags);
+	virtio_host_net_free_old_xmit(q);
+	vmm_spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static void virtio_host_net_link_changed(struct vmm_netport *port)
+{
+	/* Nothing to do here. */
+}
+
+static int virtio_host_net_can_receive(struct vmm_netport *port)
+{
+	struct virtio_host_net *vnet = port->priv;
+
+	return vnet->link_up;
+}
+
+static int virtio_host_net_switch2port_xfer(struct vmm_netport *port,
+					    struct vmm_mbuf *mb)
+{
+	int rc;
+	irq_flags_t flags;
+	struct vmm_mbuf *m;
+	struct virtio_host_iovec iov[2];
+	struct virtio_host_net *vnet = port->priv;
+	struct virtio_host_net_queue *q =
+		&vnet->sq[vmm_smp_processor_id() % vnet->curr_pairs];
+
+	if (!vnet->link_up ||
+	    (VIRTIO_HOST_NET_MAX_FRAME < mb->m_pktlen)) {
+		m_freem(mb);
+		return VMM_OK;
+	}
+
+	/* Device needs frame in one buffer so linearize mbuf chains */
+	if (mb->m_next) {
+		MGETHDR(m, 0, 0);
+		if (!m) {
+			m_freem(mb);
+			return VMM_ENOMEM;
+		}
+		if (!MEXTMALLOC(m, mb->m_pktlen, VMM_MBUF_ALLOC_DMA)) {
+			m_freem(m);
+			m_freem(mb);
+			return VMM_ENOMEM;
+		}
+		m_copydata(mb, 0, mb->m_pktlen, M_BUFADDR(m));
+		m->m_len = m->m_pktlen = mb->m_pktlen;
+		m_freem(mb);
+		mb = m;
+	}
+
+	iov[0].buf = &vnet->tx_hdr;
+	iov[0].buf_len = vnet->hdr_len;
+	iov[1].buf = M_BUFADDR(mb);
+	iov[1].buf_len = mb->m_len;
+
+	vmm_spin_lock_irqsave(&q->lock, flags);
+
+	virtio_host_net_free_old_xmit(q);
+
+	rc = virtio_host_queue_add_outbuf(q->vq, iov, 2, mb);
+	if (!rc) {
+		virtio_host_queue_kick(q->vq);
+	}
+
+	vmm_spin_unlock_irqrestore(&q->lock, flags);
+
+	/* Frame is dropped when queue is full */
+	if (rc) {
+		DPRINTF(vnet, "%s: dropped frame (error %d)\n", __func__, rc);
+		m_freem(mb);
+	}
+
+	return VMM_OK;
+}
+
+static int virtio_host_net_set_queues(struct virtio_host_net *vnet,
+				      u16 pairs)
+{
+	int rc;
+	u16 vq_pairs;
+	unsigned int len;
+	struct vmm_virtio_net_ctrl_hdr ctrl;
+	vmm_virtio_net_ctrl_ack_t status = VMM_VIRTIO_NET_ERR;
+	struct virtio_host_iovec iovec[3];
+	struct virtio_host_iovec *ivs[3];
+
+	ctrl.class = VMM_VIRTIO_NET_CTRL_MQ;
+	ctrl.cmd = VMM_VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+	vq_pairs = cpu_to_virtio16(vnet->vdev, pairs);
+
+	iovec[0].buf = &ctrl;
+	iovec[0].buf_len = sizeof(ctrl);
+	iovec[1].buf = &vq_pairs;
+	iovec[1].buf_len = sizeof(vq_pairs);
+	iovec[2].buf = &status;
+	iovec[2].buf_len = sizeof(status);
+	ivs[0] = &iovec[0];
+	ivs[1] = &iovec[1];
+	ivs[2] = &iovec[2];
+
+	rc = virtio_host_queue_add_iovecs(vnet->cvq, ivs, 2, 1, vnet);
+	if (rc) {
+		return rc;
+	}
+
+	if (!virtio_host_queue_kick(vnet->cvq)) {
+		return VMM_EIO;
+	}
+
+	/* Control commands are rare so simply spin for the response */
+	while (!virtio_host_queue_get_buf(vnet->cvq, &len)) {
+		if (vnet->cvq->broken) {
+			return VMM_EIO;
+		}
+	}
+
+	return (status == VMM_VIRTIO_NET_OK) ? VMM_OK : VMM_EFAIL;
+}
+
+static int virtio_host_net_init_vqs(struct virtio_host_net *vnet)
+{
+	int rc = VMM_OK;
+	u32 i, nvqs;
+	struct virtio_host_queue **vqs;
+	virtio_host_queue_callback_t *callbacks;
+	char **names;
+
+	/* Queue layout is rx0, tx0, ..., rxN, txN, ctrl where
+	 * N is maximum queue pairs advertised by device */
+	nvqs = vnet->max_pairs * 2;
+	if (virtio_host_has_feature(vnet->vdev, VMM_VIRTIO_NET_F_CTRL_VQ)) {
+		nvqs++;
+	}
+
+	vnet->rq = vmm_zalloc(vnet->curr_pairs * sizeof(*vnet->rq));
+	vnet->sq = vmm_zalloc(vnet->curr_pairs * sizeof(*vnet->sq));
+	vqs = vmm_zalloc(nvqs * sizeof(*vqs));
+	callbacks = vmm_zalloc(nvqs * sizeof(*callbacks));
+	names = vmm_zalloc(nvqs * sizeof(*names));
+	if (!vnet->rq || !vnet->sq || !vqs || !callbacks || !names) {
+		rc = VMM_ENOMEM;
+		goto done;
+	}
+
+	/* Unused queue pairs are not created (NULL name) */
+	for (i = 0; i < vnet->curr_pairs; i++) {
+		callbacks[2*i] = virtio_host_net_rx_done;
+		callbacks[2*i + 1] = virtio_host_net_tx_done;
+		names[2*i] = vmm_zalloc(VMM_FIELD_NAME_SIZE);
+		names[2*i + 1] = vmm_zalloc(VMM_FIELD_NAME_SIZE);
+		if (!names[2*i] || !names[2*i + 1]) {
+			rc = VMM_ENOMEM;
+			goto done;
+		}
+		vmm_snprintf(names[2*i], VMM_FIELD_NAME_SIZE,
+			     "vnet.rx%d", i);
+		vmm_snprintf(names[2*i + 1], VMM_FIELD_NAME_SIZE,
+			     "vnet.tx%d", i);
+	}
+	if (nvqs & 1) {
+		callbacks[nvqs - 1] = NULL;
+		names[nvqs - 1] = vmm_zalloc(VMM_FIELD_NAME_SIZE);
+		if (!names[nvqs - 1]) {
+			rc = VMM_ENOMEM;
+			goto done;
+		}
+		vmm_snprintf(names[nvqs - 1], VMM_FIELD_NAME_SIZE,
+			     "vnet.ctrl");
+	}
+
+	rc = virtio_host_find_vqs(vnet->vdev, nvqs, vqs, callbacks, names);
+	if (rc) {
+		goto done;
+	}
+
+	for (i = 0; i < vnet->curr_pairs; i++) {
+		vnet->rq[i].vnet = vnet;
+		vnet->rq[i].vq = vqs[2*i];
+		INIT_SPIN_LOCK(&vnet->rq[i].lock);
+		vnet->sq[i].vnet = vnet;
+		vnet->sq[i].vq = vqs[2*i + 1];
+		INIT_SPIN_LOCK(&vnet->sq[i].lock);
+	}
+	if (nvqs & 1) {
+		vnet->cvq = vqs[nvqs - 1];
+	}
+
+done:
+	if (names) {
+		for (i = 0; i < nvqs; i++) {
+			if (names[i]) {
+				vmm_free(names[i]);
+			}
+		}
+		vmm_free(names);
+	}
+	if (callbacks) {
+		vmm_free(callbacks);
+	}
+	if (vqs) {
+		vmm_free(vqs);
+	}
+	if (rc) {
+		if (vnet->sq) {
+			vmm_free(vnet->sq);
+			vnet->sq = NULL;
+		}
+		if (vnet->rq) {
+			vmm_free(vnet->rq);
+			vnet->rq = NULL;
+		}
+	}
+	return rc;
+}
+
+static void virtio_host_net_cleanup_vqs(struct virtio_host_net *vnet)
+{
+	u32 i;
+	unsigned int len;
+	struct vmm_mbuf *mb;
+
+	/* Device is already reset so reclaim all posted buffers */
+	for (i = 0; i < vnet->curr_pairs; i++) {
+		while ((mb = virtio_host_queue_get_buf(vnet->rq[i].vq, &len)))
+			m_freem(mb);
+		while ((mb = virtio_host_queue_get_buf(vnet->sq[i].vq, &len)))
+			m_freem(mb);
+	}
+
+	virtio_host_del_vqs(vnet->vdev);
+	vmm_free(vnet->sq);
+	vmm_free(vnet->rq);
+}
+
+static void virtio_host_net_update_status(struct virtio_host_net *vnet)
+{
+	u16 status;
+
+	if (!virtio_host_has_feature(vnet->vdev, VMM_VIRTIO_NET_F_STATUS)) {
+		vnet->link_up = TRUE;
+		return;
+	}
+
+	virtio_cread(vnet->vdev, struct vmm_virtio_net_config,
+		     status, &status);
+	vnet->link_up = (status & VMM_VIRTIO_NET_S_LINK_UP) ? TRUE : FALSE;
+}
+
+static void virtio_host_net_config_changed(struct virtio_host_device *vdev)
+{
+	struct virtio_host_net *vnet = vdev->priv;
+	bool link_up;
+
+	if (!vnet) {
+		return;
+	}
+
+	link_up = vnet->link_up;
+	virtio_host_net_update_status(vnet);
+	if (link_up != vnet->link_up) {
+		vmm_linfo(vdev->dev.name, "%s link %s\n", vnet->port->name,
+			  (vnet->link_up) ? "up" : "down");
+	}
+}
+
+static void virtio_host_net_attach_switch(struct virtio_host_net *vnet)
+{
+	const char *attr;
+	struct vmm_netswitch *nsw = NULL;
+	struct vmm_device *pdev = vnet->vdev->dev.parent;
+
+	if (pdev && pdev->of_node &&
+	    vmm_devtree_read_string(pdev->of_node,
+				    "switch", &attr) == VMM_OK) {
+		nsw = vmm_netswitch_find(attr);
+		if (!nsw) {
+			vmm_lerror(vnet->vdev->dev.name,
+				   "Cannot find netswitch \"%s\"\n", attr);
+			return;
+		}
+	} else {
+		nsw = vmm_netswitch_default();
+		if (!nsw) {
+			vmm_lwarning(vnet->vdev->dev.name,
+				     "No default netswitch for %s\n",
+				     vnet->port->name);
+			return;
+		}
+	}
+
+	vmm_netswitch_port_add(nsw, vnet->port);
+}
+
+static int virtio_host_net_probe(struct virtio_host_device *vdev)
+{
+	int rc = VMM_OK;
+	u32 i;
+	irq_flags_t flags;
+	struct virtio_host_net *vnet;
+
+	vnet = vmm_zalloc(sizeof(*vnet));
+	if (!vnet) {
+		vmm_lerror(vdev->dev.name,
+			   "failed to alloc virtio_host_net\n");
+		return VMM_ENOMEM;
+	}
+	vnet->vdev = vdev;
+
+	if (virtio_host_has_feature(vdev, VMM_VIRTIO_F_VERSION_1) ||
+	    virtio_host_has_feature(vdev, VMM_VIRTIO_NET_F_MRG_RXBUF)) {
+		vnet->hdr_len = sizeof(struct vmm_virtio_net_hdr_mrg_rxbuf);
+	} else {
+		vnet->hdr_len = sizeof(struct vmm_virtio_net_hdr);
+	}
+
+	/* Use one queue pair per online host CPU if possible */
+	vnet->max_pairs = 1;
+	if (virtio_host_has_feature(vdev, VMM_VIRTIO_NET_F_MQ) &&
+	    virtio_host_has_feature(vdev, VMM_VIRTIO_NET_F_CTRL_VQ)) {
+		virtio_cread(vdev, struct vmm_virtio_net_config,
+			     max_virtqueue_pairs, &vnet->max_pairs);
+		if (!vnet->max_pairs) {
+			vnet->max_pairs = 1;
+		}
+	}
+	vnet->curr_pairs = min(vnet->max_pairs,
+			       (u16)min((u32)VIRTIO_HOST_NET_MAX_PAIRS,
+					(u32)vmm_num_online_cpus()));
+
+	vnet->port = vmm_netport_alloc(vdev->dev.name,
+				       VMM_NETPORT_DEF_QUEUE_SIZE);
+	if (!vnet->port) {
+		vmm_lerror(vdev->dev.name, "failed to alloc netport\n");
+		rc = VMM_ENOMEM;
+		goto fail_free_vnet;
+	}
+	vnet->port->dev.parent = &vdev->dev;
+	vnet->port->mtu = VIRTIO_HOST_NET_MTU;
+	vnet->port->link_changed = virtio_host_net_link_changed;
+	vnet->port->can_receive = virtio_host_net_can_receive;
+	vnet->port->switch2port_xfer = virtio_host_net_switch2port_xfer;
+	vnet->port->priv = vnet;
+	if (virtio_host_has_feature(vdev, VMM_VIRTIO_NET_F_MAC)) {
+		virtio_cread_bytes(vdev,
+			offsetof(struct vmm_virtio_net_config, mac),
+			vnet->port->macaddr, sizeof(vnet->port->macaddr));
+	}
+
+	rc = virtio_host_net_init_vqs(vnet);
+	if (rc) {
+		vmm_lerror(vdev->dev.name,
+			   "failed to setup virtio_host queues\n");
+		goto fail_free_port;
+	}
+
+	/* Save VirtIO host network pointer in VirtIO device */
+	vdev->priv = vnet;
+
+	/* Make VirtIO device ready */
+	virtio_host_device_ready(vdev);
+
+	if (1 < vnet->curr_pairs) {
+		rc = virtio_host_net_set_queues(vnet, vnet->curr_pairs);
+		if (rc) {
+			vmm_lwarning(vdev->dev.name,
+				     "failed to set %d queue pairs\n",
+				     vnet->curr_pairs);
+			vnet->curr_pairs = 1;
+		}
+	}
+
+	/* Post receive buffers */
+	for (i = 0; i < vnet->curr_pairs; i++) {
+		vmm_spin_lock_irqsave(&vnet->rq[i].lock, flags);
+		virtio_host_net_fill_rxq(&vnet->rq[i]);
+		vmm_spin_unlock_irqrestore(&vnet->rq[i].lock, flags);
+	}
+
+	virtio_host_net_update_status(vnet);
+
+	rc = vmm_netport_register(vnet->port);
+	if (rc) {
+		vmm_lerror(vdev->dev.name, "failed to register netport\n");
+		goto fail_reset;
+	}
+
+	virtio_host_net_attach_switch(vnet);
+
+	/* Announce presence of VirtIO host network device */
+	vmm_linfo(vdev->dev.name, "netport=%s queue_pairs=%d/%d "
+		  "guest_csum=%s link=%s\n", vnet->port->name,
+		  vnet->curr_pairs, vnet->max_pairs,
+		  virtio_host_has_feature(vdev,
+			VMM_VIRTIO_NET_F_GUEST_CSUM) ? "yes" : "no",
+		  (vnet->link_up) ? "up" : "down");
+
+	return VMM_OK;
+
+fail_reset:
+	virtio_host_device_reset(vdev);
+	vdev->priv = NULL;
+	virtio_host_net_cleanup_vqs(vnet);
+fail_free_port:
+	vmm_netport_free(vnet->port);
+fail_free_vnet:
+	vmm_free(vnet);
+	return rc;
+}
+
+static void virtio_host_net_remove(struct virtio_host_device *vdev)
+{
+	struct virtio_host_net *vnet = vdev->priv;
+
+	vnet->link_up = FALSE;
+	vmm_netport_unregister(vnet->port);
+	virtio_host_device_reset(vdev);
+	virtio_host_net_cleanup_vqs(vnet);
+	vmm_netport_free(vnet->port);
+	vmm_free(vnet);
+	vdev->priv = NULL;
+}
+
+static struct virtio_host_device_id virtio_host_net_devid_table[] = {
+	{ VMM_VIRTIO_ID_NET, VMM_VIRTIO_ID_ANY },
+	{ 0 },
+};
+
+static unsigned int features_legacy[] = {
+	VMM_VIRTIO_NET_F_GUEST_CSUM,
+	VMM_VIRTIO_NET_F_MAC,
+	VMM_VIRTIO_NET_F_STATUS,
+	VMM_VIRTIO_NET_F_CTRL_VQ,
+	VMM_VIRTIO_NET_F_MQ,
+};
+
+static unsigned int features[] = {
+	VMM_VIRTIO_NET_F_GUEST_CSUM,
+	VMM_VIRTIO_NET_F_MAC,
+	VMM_VIRTIO_NET_F_STATUS,
+	VMM_VIRTIO_NET_F_CTRL_VQ,
+	VMM_VIRTIO_NET_F_MQ,
+};
+
+static struct virtio_host_driver virtio_host_net_driver = {
+	.name = "virtio_host_net",
+	.id_table = virtio_host_net_devid_table,
+	.feature_table = features,
+	.feature_table_size = array_size(features),
+	.feature_table_legacy = features_legacy,
+	.feature_table_size_legacy = array_size(features_legacy),
+	.probe = virtio_host_net_probe,
+	.remove = virtio_host_net_remove,
+	.config_changed = virtio_host_net_config_changed,
+};
+
+static int __init virtio_host_net_init(void)
+{
+	return virtio_host_register_driver(&virtio_host_net_driver);
+}
+
+static void __exit virtio_host_net_exit(void)
+{
+	virtio_host_unregister_driver(&virtio_host_net_driver);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+		   MODULE_AUTHOR,
+		   MODULE_LICENSE,
+		   MODULE_IPRIORITY,
+		   MODULE_INIT,
+		   MODULE_EXIT);
@@ -23,3 +23,4 @@
 
 drivers-objs-$(CONFIG_VIRTIO_HOST)+= virtio/virtio_host.o
 drivers-objs-$(CONFIG_VIRTIO_HOST_MMIO)+= virtio/virtio_host_mmio.o
+drivers-objs-$(CONFIG_VIRTIO_HOST_PCI)+= virtio/virtio_host_pci.o
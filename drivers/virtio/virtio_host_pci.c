@@ -0,0 +1,741 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file virtio_host_pci.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief VirtIO host PCI transport driver.
+ *
+ * The source has been largely adapted from Linux
+ * drivers/virtio/virtio_pci_modern.c
+ *
+ * Only the modern (VirtIO 1.0) register layout described by vendor
+ * specific PCI capabilities is supported. Transitional devices are
+ * driven through their modern interface whereas legacy-only devices
+ * are left alone. Interrupts are received using INTx because host
+ * MSI-X is not available through PCI framework.
+ *
+ * The original code is licensed under the GPL.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_host_io.h>
+#include <vmm_host_irq.h>
+#include <vmm_delay.h>
+#include <vmm_spinlocks.h>
+#include <vmm_stdio.h>
+#include <vmm_modules.h>
+#include <vmm_devdrv.h>
+#include <linux/pci.h>
+#include <vio/vmm_virtio_config.h>
+#include <vio/vmm_virtio_pci.h>
+#include <drv/virtio_host.h>
+
+#undef DEBUG
+
+#ifdef DEBUG
+#define DPRINTF(dev, msg...)		vmm_linfo(dev->name, msg)
+#else
+#define DPRINTF(dev, msg...)
+#endif
+
+#define MODULE_DESC			"VirtIO Host PCI Transport Driver"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(PCI_CORE_IPRIORITY + 1)
+#define	MODULE_INIT			virtio_host_pci_init
+#define	MODULE_EXIT			virtio_host_pci_exit
+
+/* The alignment to use between consumer and producer parts of vring. */
+#define VIRTIO_HOST_PCI_VRING_ALIGN	VMM_PAGE_SIZE
+
+#define VIRTIO_HOST_PCI_NUM_BARS	(PCI_STD_RESOURCE_END + 1)
+
+#define to_virtio_host_pci_device(_vdev) \
+	container_of(_vdev, struct virtio_host_pci_device, vdev)
+
+struct virtio_host_pci_device {
+	struct virtio_host_device vdev;
+	struct pci_dev *pdev;
+
+	/* mapped memory BARs */
+	void *bars[VIRTIO_HOST_PCI_NUM_BARS];
+
+	/* mapped capability structures */
+	void *common;
+	void *isr;
+	void *device;
+	u32 device_len;
+	void *notify_base;
+	u32 notify_len;
+	u32 notify_off_multiplier;
+
+	/* a list of queues so we can dispatch IRQs */
+	vmm_spinlock_t lock;
+	struct dlist vqs;
+};
+
+struct virtio_host_pci_vq_info {
+	/* the actual VirtIO host queue */
+	struct virtio_host_queue *vq;
+
+	/* the notification address of VirtIO host queue */
+	void *notify;
+
+	/* the list node for the VirtIO host queue list */
+	struct dlist node;
+};
+
+/* Capability parsing */
+
+static int vp_find_cap(struct pci_dev *pdev, u8 cfg_type,
+		       u8 *bar, u32 *offset, u32 *length)
+{
+	int pos;
+	u8 type, cap_bar;
+
+	for (pos = pci_find_capability(pdev, PCI_CAP_ID_VNDR); pos > 0;
+	     pos = pci_find_next_capability(pdev, pos, PCI_CAP_ID_VNDR)) {
+		pci_read_config_byte(pdev,
+				pos + VMM_VIRTIO_PCI_CAP_CFG_TYPE, &type);
+		pci_read_config_byte(pdev,
+				pos + VMM_VIRTIO_PCI_CAP_BAR, &cap_bar);
+
+		/* Ignore structures with reserved BAR values */
+		if (type != cfg_type ||
+		    VIRTIO_HOST_PCI_NUM_BARS <= cap_bar) {
+			continue;
+		}
+
+		/* Only memory BARs are supported */
+		if (!pci_resource_len(pdev, cap_bar) ||
+		    !(pci_resource_flags(pdev, cap_bar) & IORESOURCE_MEM)) {
+			continue;
+		}
+
+		pci_read_config_dword(pdev,
+				pos + VMM_VIRTIO_PCI_CAP_OFFSET, offset);
+		pci_read_config_dword(pdev,
+				pos + VMM_VIRTIO_PCI_CAP_LENGTH, length);
+		*bar = cap_bar;
+
+		return pos;
+	}
+
+	return 0;
+}
+
+static void *vp_map_cap(struct virtio_host_pci_device *vp_dev, int pos,
+			u8 bar, u32 offset, u32 length, u32 minlen)
+{
+	struct pci_dev *pdev = vp_dev->pdev;
+
+	if (length < minlen ||
+	    pci_resource_len(pdev, bar) < ((u64)offset + length)) {
+		vmm_lerror(pdev->dev.name,
+			   "capability at 0x%x outside BAR%d\n", pos, bar);
+		return NULL;
+	}
+
+	if (!vp_dev->bars[bar]) {
+		vp_dev->bars[bar] = pci_iomap(pdev, bar, 0);
+		if (!vp_dev->bars[bar]) {
+			vmm_lerror(pdev->dev.name,
+				   "failed to map BAR%d\n", bar);
+			return NULL;
+		}
+	}
+
+	return vp_dev->bars[bar] + offset;
+}
+
+static void vp_unmap_bars(struct virtio_host_pci_device *vp_dev)
+{
+	int i;
+
+	for (i = 0; i < VIRTIO_HOST_PCI_NUM_BARS; i++) {
+		if (vp_dev->bars[i]) {
+			pci_iounmap(vp_dev->pdev, vp_dev->bars[i]);
+			vp_dev->bars[i] = NULL;
+		}
+	}
+}
+
+static int vp_map_caps(struct virtio_host_pci_device *vp_dev)
+{
+	int pos;
+	u8 bar;
+	u32 offset, length;
+	struct pci_dev *pdev = vp_dev->pdev;
+
+	pos = vp_find_cap(pdev, VMM_VIRTIO_PCI_CAP_COMMON_CFG,
+			  &bar, &offset, &length);
+	if (!pos) {
+		vmm_linfo(pdev->dev.name, "no modern common config\n");
+		return VMM_ENODEV;
+	}
+	vp_dev->common = vp_map_cap(vp_dev, pos, bar, offset, length,
+				    VMM_VIRTIO_PCI_COMMON_SIZE);
+	if (!vp_dev->common) {
+		return VMM_ENODEV;
+	}
+
+	pos = vp_find_cap(pdev, VMM_VIRTIO_PCI_CAP_ISR_CFG,
+			  &bar, &offset, &length);
+	if (!pos) {
+		vmm_lerror(pdev->dev.name, "missing ISR capability\n");
+		return VMM_ENODEV;
+	}
+	vp_dev->isr = vp_map_cap(vp_dev, pos, bar, offset, length, 1);
+	if (!vp_dev->isr) {
+		return VMM_ENODEV;
+	}
+
+	pos = vp_find_cap(pdev, VMM_VIRTIO_PCI_CAP_NOTIFY_CFG,
+			  &bar, &offset, &length);
+	if (!pos) {
+		vmm_lerror(pdev->dev.name, "missing notify capability\n");
+		return VMM_ENODEV;
+	}
+	pci_read_config_dword(pdev, pos + VMM_VIRTIO_PCI_NOTIFY_CAP_MULT,
+			      &vp_dev->notify_off_multiplier);
+	vp_dev->notify_base = vp_map_cap(vp_dev, pos, bar,
+					 offset, length, 2);
+	if (!vp_dev->notify_base) {
+		return VMM_ENODEV;
+	}
+	vp_dev->notify_len = length;
+
+	/* Device config is optional */
+	pos = vp_find_cap(pdev, VMM_VIRTIO_PCI_CAP_DEVICE_CFG,
+			  &bar, &offset, &length);
+	if (pos) {
+		vp_dev->device = vp_map_cap(vp_dev, pos, bar,
+					    offset, length, 0);
+		if (!vp_dev->device) {
+			return VMM_ENODEV;
+		}
+		vp_dev->device_len = length;
+	}
+
+	return VMM_OK;
+}
+
+/* Configuration interface */
+
+static u64 vp_get_features(struct virtio_host_device *vdev)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+	u64 features;
+
+	vmm_writel(1, vp_dev->common + VMM_VIRTIO_PCI_COMMON_DFSELECT);
+	features = vmm_readl(vp_dev->common + VMM_VIRTIO_PCI_COMMON_DF);
+	features <<= 32;
+
+	vmm_writel(0, vp_dev->common + VMM_VIRTIO_PCI_COMMON_DFSELECT);
+	features |= vmm_readl(vp_dev->common + VMM_VIRTIO_PCI_COMMON_DF);
+
+	return features;
+}
+
+static int vp_finalize_features(struct virtio_host_device *vdev)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+
+	/* Give virtio_ring a chance to accept features. */
+	virtio_host_transport_features(vdev);
+
+	if (!__virtio_host_test_bit(vdev, VMM_VIRTIO_F_VERSION_1)) {
+		vmm_lerror(vdev->dev.name, "VirtIO PCI devices "
+		"must provide VIRTIO_F_VERSION_1 feature!\n");
+		return VMM_EINVALID;
+	}
+
+	vmm_writel(1, vp_dev->common + VMM_VIRTIO_PCI_COMMON_GFSELECT);
+	vmm_writel((u32)(vdev->features >> 32),
+		   vp_dev->common + VMM_VIRTIO_PCI_COMMON_GF);
+
+	vmm_writel(0, vp_dev->common + VMM_VIRTIO_PCI_COMMON_GFSELECT);
+	vmm_writel((u32)vdev->features,
+		   vp_dev->common + VMM_VIRTIO_PCI_COMMON_GF);
+
+	return 0;
+}
+
+static void vp_get(struct virtio_host_device *vdev, unsigned offset,
+		   void *buf, unsigned len)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+	void *base = vp_dev->device;
+	u8 b;
+	u16 w;
+	u32 l;
+
+	BUG_ON(vp_dev->device_len < (offset + len));
+
+	switch (len) {
+	case 1:
+		b = vmm_readb(base + offset);
+		memcpy(buf, &b, sizeof(b));
+		break;
+	case 2:
+		w = vmm_cpu_to_le16(vmm_readw(base + offset));
+		memcpy(buf, &w, sizeof(w));
+		break;
+	case 4:
+		l = vmm_cpu_to_le32(vmm_readl(base + offset));
+		memcpy(buf, &l, sizeof(l));
+		break;
+	case 8:
+		l = vmm_cpu_to_le32(vmm_readl(base + offset));
+		memcpy(buf, &l, sizeof(l));
+		l = vmm_cpu_to_le32(vmm_readl(base + offset + sizeof(l)));
+		memcpy(buf + sizeof(l), &l, sizeof(l));
+		break;
+	default:
+		BUG();
+	}
+}
+
+static void vp_set(struct virtio_host_device *vdev, unsigned offset,
+		   const void *buf, unsigned len)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+	void *base = vp_dev->device;
+	u8 b;
+	u16 w;
+	u32 l;
+
+	BUG_ON(vp_dev->device_len < (offset + len));
+
+	switch (len) {
+	case 1:
+		memcpy(&b, buf, sizeof(b));
+		vmm_writeb(b, base + offset);
+		break;
+	case 2:
+		memcpy(&w, buf, sizeof(w));
+		vmm_writew(vmm_le16_to_cpu(w), base + offset);
+		break;
+	case 4:
+		memcpy(&l, buf, sizeof(l));
+		vmm_writel(vmm_le32_to_cpu(l), base + offset);
+		break;
+	case 8:
+		memcpy(&l, buf, sizeof(l));
+		vmm_writel(vmm_le32_to_cpu(l), base + offset);
+		memcpy(&l, buf + sizeof(l), sizeof(l));
+		vmm_writel(vmm_le32_to_cpu(l), base + offset + sizeof(l));
+		break;
+	default:
+		BUG();
+	}
+}
+
+static u32 vp_generation(struct virtio_host_device *vdev)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+
+	return vmm_readb(vp_dev->common +
+			 VMM_VIRTIO_PCI_COMMON_CFGGENERATION);
+}
+
+static u8 vp_get_status(struct virtio_host_device *vdev)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+
+	return vmm_readb(vp_dev->common + VMM_VIRTIO_PCI_COMMON_STATUS);
+}
+
+static void vp_set_status(struct virtio_host_device *vdev, u8 status)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+
+	/* We should never be setting status to 0. */
+	BUG_ON(status == 0);
+
+	vmm_writeb(status, vp_dev->common + VMM_VIRTIO_PCI_COMMON_STATUS);
+}
+
+static void vp_reset(struct virtio_host_device *vdev)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+
+	/* 0 status means a reset. */
+	vmm_writeb(0, vp_dev->common + VMM_VIRTIO_PCI_COMMON_STATUS);
+
+	/* After writing 0 to device_status, the driver MUST wait for a
+	 * read of device_status to return 0 before reinitializing the
+	 * device. */
+	while (vmm_readb(vp_dev->common + VMM_VIRTIO_PCI_COMMON_STATUS))
+		vmm_udelay(1000);
+}
+
+/* Transport interface */
+
+/* The notify function used when creating a virt queue */
+static bool vp_notify(struct virtio_host_queue *vq)
+{
+	struct virtio_host_pci_vq_info *info = vq->priv;
+
+	/* We write the queue's selector into the notification register to
+	 * signal the other end */
+	vmm_writew(vq->index, info->notify);
+	return TRUE;
+}
+
+/* Notify all virtqueues on an interrupt. */
+static vmm_irq_return_t vp_interrupt(int irq, void *opaque)
+{
+	struct virtio_host_pci_device *vp_dev = opaque;
+	struct virtio_host_pci_vq_info *info;
+	irq_flags_t flags;
+	u8 isr;
+	vmm_irq_return_t ret = VMM_IRQ_NONE;
+
+	/* Reading the ISR status also acknowledges interrupts */
+	isr = vmm_readb(vp_dev->isr);
+
+	/* It's definitely not us if the ISR was not high (INTx
+	 * can be shared with other PCI devices) */
+	if (!isr)
+		return VMM_IRQ_NONE;
+
+	if (unlikely(isr & VMM_VIRTIO_PCI_INT_CONFIG)) {
+		virtio_host_config_changed(&vp_dev->vdev);
+		ret = VMM_IRQ_HANDLED;
+	}
+
+	if (likely(isr & VMM_VIRTIO_PCI_INT_VRING)) {
+		vmm_spin_lock_irqsave(&vp_dev->lock, flags);
+		list_for_each_entry(info, &vp_dev->vqs, node)
+			ret |= virtio_host_queue_interrupt(irq, info->vq);
+		vmm_spin_unlock_irqrestore(&vp_dev->lock, flags);
+	}
+
+	return ret;
+}
+
+static void vp_del_vq(struct virtio_host_queue *vq)
+{
+	struct virtio_host_pci_device *vp_dev =
+			to_virtio_host_pci_device(vq->vdev);
+	struct virtio_host_pci_vq_info *info = vq->priv;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&vp_dev->lock, flags);
+	list_del(&info->node);
+	vmm_spin_unlock_irqrestore(&vp_dev->lock, flags);
+
+	/* Queues are disabled by device reset because queue_enable
+	 * can't be cleared by driver */
+	virtio_host_destroy_queue(vq);
+
+	vmm_free(info);
+}
+
+static void vp_del_vqs(struct virtio_host_device *vdev)
+{
+	struct virtio_host_queue *vq, *n;
+
+	list_for_each_entry_safe(vq, n, &vdev->vqs, head)
+		vp_del_vq(vq);
+}
+
+static struct virtio_host_queue *vp_setup_vq(struct virtio_host_device *vdev,
+					unsigned index,
+					virtio_host_queue_callback_t callback,
+					const char *name)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+	void *common = vp_dev->common;
+	struct virtio_host_pci_vq_info *info;
+	struct virtio_host_queue *vq;
+	irq_flags_t flags;
+	unsigned int num;
+	u64 addr, off;
+	int err;
+
+	if (!name)
+		return NULL;
+
+	if (vmm_readw(common + VMM_VIRTIO_PCI_COMMON_NUMQ) <= index) {
+		err = VMM_ENOENT;
+		goto error_available;
+	}
+
+	/* Select the queue we're interested in */
+	vmm_writew(index, common + VMM_VIRTIO_PCI_COMMON_Q_SELECT);
+
+	/* Queue shouldn't already be set up. */
+	num = vmm_readw(common + VMM_VIRTIO_PCI_COMMON_Q_SIZE);
+	if (!num || vmm_readw(common + VMM_VIRTIO_PCI_COMMON_Q_ENABLE)) {
+		err = VMM_ENOENT;
+		goto error_available;
+	}
+
+	/* Queue size must be power of two for split virtqueues */
+	if (num & (num - 1)) {
+		vmm_lerror(vdev->dev.name,
+			   "bad queue size %u for queue %u\n", num, index);
+		err = VMM_EINVALID;
+		goto error_available;
+	}
+
+	/* Locate notification address of the queue */
+	off = vmm_readw(common + VMM_VIRTIO_PCI_COMMON_Q_NOFF);
+	off *= vp_dev->notify_off_multiplier;
+	if (vp_dev->notify_len < (off + 2)) {
+		vmm_lerror(vdev->dev.name,
+			   "bad notification offset 0x%"PRIx64" for queue %u\n",
+			   off, index);
+		err = VMM_EINVALID;
+		goto error_available;
+	}
+
+	/* Allocate and fill out our active queue description */
+	info = vmm_zalloc(sizeof(*info));
+	if (!info) {
+		err = VMM_ENOMEM;
+		goto error_available;
+	}
+	info->notify = vp_dev->notify_base + off;
+
+	/* Create the vring */
+	vq = virtio_host_create_queue(index, num,
+				      VIRTIO_HOST_PCI_VRING_ALIGN, vdev,
+				      TRUE, vp_notify, callback, name);
+	if (!vq) {
+		err = VMM_ENOMEM;
+		goto error_new_vq;
+	}
+
+	/* Activate the queue */
+	vmm_writew(virtio_host_queue_get_vring_size(vq),
+		   common + VMM_VIRTIO_PCI_COMMON_Q_SIZE);
+
+	addr = virtio_host_queue_get_desc_addr(vq);
+	vmm_writel((u32)addr, common + VMM_VIRTIO_PCI_COMMON_Q_DESCLO);
+	vmm_writel((u32)(addr >> 32), common + VMM_VIRTIO_PCI_COMMON_Q_DESCHI);
+
+	addr = virtio_host_queue_get_avail_addr(vq);
+	vmm_writel((u32)addr, common + VMM_VIRTIO_PCI_COMMON_Q_AVAILLO);
+	vmm_writel((u32)(addr >> 32), common + VMM_VIRTIO_PCI_COMMON_Q_AVAILHI);
+
+	addr = virtio_host_queue_get_used_addr(vq);
+	vmm_writel((u32)addr, common + VMM_VIRTIO_PCI_COMMON_Q_USEDLO);
+	vmm_writel((u32)(addr >> 32), common + VMM_VIRTIO_PCI_COMMON_Q_USEDHI);
+
+	/* We only use INTx hence no MSI-X vector for queue */
+	vmm_writew(VMM_VIRTIO_PCI_MSI_NO_VECTOR,
+		   common + VMM_VIRTIO_PCI_COMMON_Q_MSIX);
+
+	vmm_writew(1, common + VMM_VIRTIO_PCI_COMMON_Q_ENABLE);
+
+	vq->priv = info;
+	info->vq = vq;
+
+	vmm_spin_lock_irqsave(&vp_dev->lock, flags);
+	list_add(&info->node, &vp_dev->vqs);
+	vmm_spin_unlock_irqrestore(&vp_dev->lock, flags);
+
+	return vq;
+
+error_new_vq:
+	vmm_free(info);
+error_available:
+	return VMM_ERR_PTR(err);
+}
+
+static int vp_find_vqs(struct virtio_host_device *vdev, unsigned nvqs,
+		       struct virtio_host_queue **vqs,
+		       virtio_host_queue_callback_t *callbacks,
+		       char **names)
+{
+	int i;
+
+	for (i = 0; i < nvqs; ++i) {
+		vqs[i] = vp_setup_vq(vdev, i, callbacks[i], names[i]);
+		if (VMM_IS_ERR(vqs[i])) {
+			vp_del_vqs(vdev);
+			return VMM_PTR_ERR(vqs[i]);
+		}
+	}
+
+	return 0;
+}
+
+static const char *vp_bus_name(struct virtio_host_device *vdev)
+{
+	struct virtio_host_pci_device *vp_dev =
+				to_virtio_host_pci_device(vdev);
+
+	return pci_name(vp_dev->pdev);
+}
+
+static const struct virtio_host_config_ops virtio_host_pci_config_ops = {
+	.get		= vp_get,
+	.set		= vp_set,
+	.generation	= vp_generation,
+	.get_status	= vp_get_status,
+	.set_status	= vp_set_status,
+	.reset		= vp_reset,
+	.find_vqs	= vp_find_vqs,
+	.del_vqs	= vp_del_vqs,
+	.get_features	= vp_get_features,
+	.finalize_features = vp_finalize_features,
+	.bus_name	= vp_bus_name,
+};
+
+static int virtio_host_pci_probe(struct pci_dev *pdev,
+				 const struct pci_device_id *id)
+{
+	int ret = 0;
+	struct virtio_host_pci_device *vp_dev;
+
+	/* We only own devices >= 0x1000 and <= 0x107f */
+	if (pdev->devid < VMM_VIRTIO_PCI_LEGACY_DEVICE_ID_MIN ||
+	    (VMM_VIRTIO_PCI_MODERN_DEVICE_ID_BASE + 0x3f) < pdev->devid)
+		return VMM_ENODEV;
+
+	vp_dev = vmm_zalloc(sizeof(*vp_dev));
+	if (vp_dev == NULL)
+		return VMM_ENOMEM;
+
+	vp_dev->pdev = pdev;
+	INIT_SPIN_LOCK(&vp_dev->lock);
+	INIT_LIST_HEAD(&vp_dev->vqs);
+
+	if (pdev->devid < VMM_VIRTIO_PCI_MODERN_DEVICE_ID_BASE) {
+		/* Transitional devices use the PCI subsystem device id as
+		 * virtio device id, same as legacy driver always did. */
+		vp_dev->vdev.id.device = pdev->subsystem_device;
+	} else {
+		/* Modern devices: simply use PCI device id, but start
+		 * from 0x1040. */
+		vp_dev->vdev.id.device = pdev->devid -
+					 VMM_VIRTIO_PCI_MODERN_DEVICE_ID_BASE;
+	}
+	vp_dev->vdev.id.vendor = pdev->subsystem_vendor;
+
+	ret = pci_enable_device(pdev);
+	if (ret) {
+		vmm_lerror(pdev->dev.name,
+			   "Failed to enable device: %d\n", ret);
+		goto fail_free;
+	}
+
+	ret = pci_request_regions(pdev, "virtio_host_pci");
+	if (ret) {
+		vmm_lerror(pdev->dev.name,
+			   "Failed to request regions: %d\n", ret);
+		goto fail_disable;
+	}
+
+	ret = vp_map_caps(vp_dev);
+	if (ret) {
+		goto fail_unmap;
+	}
+
+	pci_set_master(pdev);
+
+	if ((ret = vmm_host_irq_register(pdev->irq, pdev->dev.name,
+					 vp_interrupt, vp_dev))) {
+		vmm_lerror(pdev->dev.name,
+			   "Failed to register IRQ handler: %d\n", ret);
+		goto fail_unmap;
+	}
+
+	pci_set_drvdata(pdev, vp_dev);
+
+	vmm_linfo(pdev->dev.name, "VirtIO host PCI device id=%d irq=%d\n",
+		  vp_dev->vdev.id.device, pdev->irq);
+
+	ret = virtio_host_add_device(&vp_dev->vdev,
+				     &virtio_host_pci_config_ops, &pdev->dev);
+	if (ret) {
+		vmm_lerror(pdev->dev.name,
+			   "Failed to register VirtIO host device!\n");
+		goto fail_unreg_irq;
+	}
+
+	return VMM_OK;
+
+fail_unreg_irq:
+	pci_set_drvdata(pdev, NULL);
+	vmm_host_irq_unregister(pdev->irq, vp_dev);
+fail_unmap:
+	vp_unmap_bars(vp_dev);
+	pci_release_regions(pdev);
+fail_disable:
+	pci_disable_device(pdev);
+fail_free:
+	vmm_free(vp_dev);
+	return ret;
+}
+
+static void virtio_host_pci_remove(struct pci_dev *pdev)
+{
+	struct virtio_host_pci_device *vp_dev = pci_get_drvdata(pdev);
+
+	virtio_host_remove_device(&vp_dev->vdev);
+	vmm_host_irq_unregister(pdev->irq, vp_dev);
+	vp_unmap_bars(vp_dev);
+	pci_release_regions(pdev);
+	pci_disable_device(pdev);
+	pci_set_drvdata(pdev, NULL);
+	vmm_free(vp_dev);
+}
+
+static struct pci_device_id virtio_host_pci_id_table[] = {
+	{ PCI_DEVICE(VMM_VIRTIO_PCI_VENDOR_ID, PCI_ANY_ID) },
+	{ 0 },
+};
+
+static struct pci_driver virtio_host_pci_driver = {
+	.name = "virtio_host_pci",
+	.id_table = virtio_host_pci_id_table,
+	.probe = virtio_host_pci_probe,
+	.remove = virtio_host_pci_remove,
+};
+
+static int __init virtio_host_pci_init(void)
+{
+	return pci_register_driver(&virtio_host_pci_driver);
+}
+
+static void __exit virtio_host_pci_exit(void)
+{
+	pci_unregister_driver(&virtio_host_pci_driver);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
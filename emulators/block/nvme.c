@@ -0,0 +1,2455 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file nvme.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief NVMe PCI controller emulator backed by virtual disk.
+ *
+ * The emulated controller implements NVMe 1.4 with one namespace,
+ * an admin queue pair and up to NVME_MAX_IO_QUEUES I/O queue pairs.
+ * The PCI device emulator ("nvme,pci") provides the configuration
+ * header whereas the BAR emulator ("nvme,pci,bar") provides the
+ * controller registers, doorbells and MSI-X table.
+ *
+ * Each completion queue has its own interrupt vector. Submission
+ * and completion queues are protected by their own locks so that
+ * doorbell writes on different queues do not contend with each
+ * other. Commands are fetched in the context of the VCPU writing
+ * the doorbell and block I/O is completed by virtual disk callbacks.
+ *
+ * Guest data described by PRPs or SGLs is gathered into (or scattered
+ * from) a bounce buffer because virtual disk requests need a single
+ * contiguous host buffer.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_spinlocks.h>
+#include <vmm_timer.h>
+#include <vmm_modules.h>
+#include <vmm_devtree.h>
+#include <vmm_devemu.h>
+#include <vmm_guest_aspace.h>
+#include <vio/vmm_vdisk.h>
+#include <emu/pci/pci_emu_core.h>
+#include <arch_barrier.h>
+#include <libs/list.h>
+#include <libs/stringlib.h>
+
+#undef DEBUG
+
+#ifdef DEBUG
+#define DPRINTF(msg...)			vmm_printf(msg)
+#else
+#define DPRINTF(msg...)
+#endif
+
+#define MODULE_DESC			"NVMe Controller Emulator"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(PCI_EMU_CORE_IPRIORITY + \
+					 VMM_VDISK_IPRIORITY + 1)
+#define MODULE_INIT			nvme_emulator_init
+#define MODULE_EXIT			nvme_emulator_exit
+
+/* PCI identity (same as QEMU NVMe controller) */
+#define NVME_PCI_VENDOR_ID		0x1b36
+#define NVME_PCI_DEVICE_ID		0x0010
+#define NVME_PCI_CLASS			0x01
+#define NVME_PCI_SUBCLASS		0x08
+#define NVME_PCI_PROG_IF		0x02
+
+/* Controller limits */
+#define NVME_MAX_IO_QUEUES		16
+#define NVME_MAX_QUEUES			(NVME_MAX_IO_QUEUES + 1)
+#define NVME_MAX_QUEUE_ENTRIES		1024
+#define NVME_MAX_ADMIN_ENTRIES		4096
+#define NVME_MAX_SQ_REQS		64
+#define NVME_MAX_SEGS			64
+#define NVME_MAX_SGL_DESCS		256
+#define NVME_MDTS			5
+#define NVME_PAGE_SHIFT			12
+#define NVME_PAGE_SIZE			(1UL << NVME_PAGE_SHIFT)
+#define NVME_MAX_XFER			(NVME_PAGE_SIZE << NVME_MDTS)
+#define NVME_LBA_SHIFT			9
+#define NVME_LBA_SIZE			(1UL << NVME_LBA_SHIFT)
+#define NVME_AERL			3
+#define NVME_NSID			1
+#define NVME_SERIAL_LEN			20
+#define NVME_MODEL_LEN			40
+
+/* BAR layout */
+#define NVME_BAR_SIZE			0x4000
+#define NVME_DB_OFFSET			0x1000
+#define NVME_MSI_VECTORS		32
+#define NVME_MSIX_TABLE_OFFSET		0x2000
+#define NVME_MSIX_PBA_OFFSET		0x3000
+
+/* Controller registers */
+#define NVME_REG_CAP			0x00
+#define NVME_REG_VS			0x08
+#define NVME_REG_INTMS			0x0c
+#define NVME_REG_INTMC			0x10
+#define NVME_REG_CC			0x14
+#define NVME_REG_CSTS			0x1c
+#define NVME_REG_AQA			0x24
+#define NVME_REG_ASQ			0x28
+#define NVME_REG_ACQ			0x30
+
+#define NVME_VS				0x00010400
+
+#define NVME_CAP_MQES			(NVME_MAX_QUEUE_ENTRIES - 1)
+#define NVME_CAP_CQR			(1ULL << 16)
+#define NVME_CAP_TO(x)			((u64)(x) << 24)
+#define NVME_CAP_CSS_NVM		(1ULL << 37)
+#define NVME_CAP			(NVME_CAP_MQES | NVME_CAP_CQR | \
+					 NVME_CAP_TO(0xf) | NVME_CAP_CSS_NVM)
+
+#define NVME_CC_EN			(1 << 0)
+#define NVME_CC_CSS(cc)			(((cc) >> 4) & 0x7)
+#define NVME_CC_MPS(cc)			(((cc) >> 7) & 0xf)
+#define NVME_CC_AMS(cc)			(((cc) >> 11) & 0x7)
+#define NVME_CC_SHN(cc)			(((cc) >> 14) & 0x3)
+#define NVME_CC_IOSQES(cc)		(((cc) >> 16) & 0xf)
+#define NVME_CC_IOCQES(cc)		(((cc) >> 20) & 0xf)
+
+#define NVME_CSTS_RDY			(1 << 0)
+#define NVME_CSTS_CFS			(1 << 1)
+#define NVME_CSTS_SHST_MASK		(3 << 2)
+#define NVME_CSTS_SHST_CMPLT		(2 << 2)
+
+#define NVME_AQA_ASQS(aqa)		((aqa) & 0xfff)
+#define NVME_AQA_ACQS(aqa)		(((aqa) >> 16) & 0xfff)
+
+/* Admin commands */
+#define NVME_ADM_DELETE_SQ		0x00
+#define NVME_ADM_CREATE_SQ		0x01
+#define NVME_ADM_GET_LOG_PAGE		0x02
+#define NVME_ADM_DELETE_CQ		0x04
+#define NVME_ADM_CREATE_CQ		0x05
+#define NVME_ADM_IDENTIFY		0x06
+#define NVME_ADM_ABORT			0x08
+#define NVME_ADM_SET_FEATURES		0x09
+#define NVME_ADM_GET_FEATURES		0x0a
+#define NVME_ADM_ASYNC_EVENT		0x0c
+
+/* I/O commands */
+#define NVME_CMD_FLUSH			0x00
+#define NVME_CMD_WRITE			0x01
+#define NVME_CMD_READ			0x02
+#define NVME_CMD_WRITE_ZEROES		0x08
+#define NVME_CMD_DSM			0x09
+
+/* I/O command dword bits */
+#define NVME_RW_FUA			(1 << 30)
+#define NVME_DSM_AD			(1 << 2)
+
+/* Limits of dataset management */
+#define NVME_DSM_MAX_NLB		(0xffffffffUL >> NVME_LBA_SHIFT)
+
+/* Identify CNS values */
+#define NVME_ID_CNS_NS			0x00
+#define NVME_ID_CNS_CTRL		0x01
+#define NVME_ID_CNS_NS_ACTIVE_LIST	0x02
+#define NVME_ID_CNS_NS_DESC_LIST	0x03
+#define NVME_ID_SIZE			4096
+
+/* Log pages */
+#define NVME_LOG_ERROR			0x01
+#define NVME_LOG_SMART			0x02
+#define NVME_LOG_FW_SLOT		0x03
+#define NVME_LOG_SIZE			512
+
+/* Features */
+#define NVME_FEAT_ARBITRATION		0x01
+#define NVME_FEAT_POWER_MGMT		0x02
+#define NVME_FEAT_TEMP_THRESH		0x04
+#define NVME_FEAT_ERR_RECOVERY		0x05
+#define NVME_FEAT_VOLATILE_WC		0x06
+#define NVME_FEAT_NUM_QUEUES		0x07
+#define NVME_FEAT_IRQ_COALESCE		0x08
+#define NVME_FEAT_IRQ_CONFIG		0x09
+#define NVME_FEAT_WRITE_ATOMIC		0x0a
+#define NVME_FEAT_ASYNC_EVENT		0x0b
+#define NVME_FEAT_SEL_SUPPORTED		0x3
+#define NVME_FEAT_CAP_CHANGEABLE	(1 << 2)
+
+#define NVME_COAL_THR(v)		((v) & 0xff)
+#define NVME_COAL_TIME(v)		(((v) >> 8) & 0xff)
+#define NVME_COAL_TIME_NSECS		100000ULL
+
+/* Composite temperature in Kelvin */
+#define NVME_TEMP			0x012f
+#define NVME_WCTEMP			0x0157
+#define NVME_CCTEMP			0x0175
+
+/* Status codes (shifted left by one when posted with phase bit) */
+#define NVME_SC_SUCCESS			0x000
+#define NVME_SC_INVALID_OPCODE		0x001
+#define NVME_SC_INVALID_FIELD		0x002
+#define NVME_SC_DATA_XFER_ERROR		0x004
+#define NVME_SC_INTERNAL		0x006
+#define NVME_SC_INVALID_NS		0x00b
+#define NVME_SC_SGL_INVALID_LAST	0x00d
+#define NVME_SC_SGL_INVALID_COUNT	0x00e
+#define NVME_SC_SGL_INVALID_DATA	0x00f
+#define NVME_SC_SGL_INVALID_TYPE	0x011
+#define NVME_SC_PRP_INVALID_OFFSET	0x013
+#define NVME_SC_SGL_INVALID_SUBTYPE	0x017
+#define NVME_SC_LBA_RANGE		0x080
+#define NVME_SC_CQ_INVALID		0x100
+#define NVME_SC_QID_INVALID		0x101
+#define NVME_SC_QUEUE_SIZE		0x102
+#define NVME_SC_ASYNC_LIMIT		0x105
+#define NVME_SC_INVALID_VECTOR		0x108
+#define NVME_SC_INVALID_LOG_PAGE	0x109
+#define NVME_SC_INVALID_QUEUE		0x10c
+#define NVME_SC_FEATURE_NOT_SAVEABLE	0x10d
+#define NVME_SC_WRITE_FAULT		0x280
+#define NVME_SC_READ_ERROR		0x281
+#define NVME_SC_DNR			0x4000
+/* Not a real status code, command completes later */
+#define NVME_SC_PENDING			0xffff
+
+/* Command flags */
+#define NVME_CMD_PSDT(flags)		(((flags) >> 6) & 0x3)
+#define NVME_PSDT_PRP			0x0
+
+/* SGL descriptor types */
+#define NVME_SGL_TYPE(type)		((type) >> 4)
+#define NVME_SGL_SUBTYPE(type)		((type) & 0xf)
+#define NVME_SGL_DATA_BLOCK		0x0
+#define NVME_SGL_BIT_BUCKET		0x1
+#define NVME_SGL_SEGMENT		0x2
+#define NVME_SGL_LAST_SEGMENT		0x3
+#define NVME_SGL_SUBTYPE_ADDRESS	0x0
+
+/* Submission queue entry */
+struct nvme_sqe {
+	u8 opcode;
+	u8 flags;
+	u16 cid;
+	u32 nsid;
+	u64 rsvd2;
+	u64 mptr;
+	u64 dptr[2];
+	u32 cdw10;
+	u32 cdw11;
+	u32 cdw12;
+	u32 cdw13;
+	u32 cdw14;
+	u32 cdw15;
+} __packed;
+
+/* Completion queue entry */
+struct nvme_cqe {
+	u32 result;
+	u32 rsvd;
+	u16 sq_head;
+	u16 sq_id;
+	u16 cid;
+	u16 status;
+} __packed;
+
+/* SGL descriptor */
+struct nvme_sgl_desc {
+	u64 addr;
+	u32 len;
+	u8 rsvd[3];
+	u8 type;
+} __packed;
+
+/* Dataset management range */
+struct nvme_dsm_range {
+	u32 cattr;
+	u32 nlb;
+	u64 slba;
+} __packed;
+
+/* Guest memory segment of a request (bucket segments are discarded) */
+struct nvme_seg {
+	physical_addr_t addr;
+	u32 len;
+	bool bucket;
+};
+
+enum nvme_req_state {
+	NVME_REQ_FREE = 0,
+	NVME_REQ_ACTIVE,
+	NVME_REQ_VDISK,
+	NVME_REQ_CQ_WAIT,
+	NVME_REQ_AER,
+};
+
+struct nvme_ctrl;
+struct nvme_sq;
+
+static void nvme_sq_process(struct nvme_ctrl *ctrl, struct nvme_sq *sq);
+
+struct nvme_req {
+	struct dlist head;
+	struct nvme_ctrl *ctrl;
+	struct nvme_sq *sq;
+	u32 gen;
+	u32 seq;
+	enum nvme_req_state state;
+	struct nvme_sqe cmd;
+	struct nvme_cqe cqe;
+	bool to_guest;
+	void *buf;
+	u32 len;
+	u32 nsegs;
+	struct nvme_seg segs[NVME_MAX_SEGS];
+	u32 dsm_nr;
+	u32 dsm_idx;
+	u64 dsm_slba;
+	u32 dsm_nlb;
+	struct vmm_vdisk_request r;
+};
+
+struct nvme_sq {
+	vmm_spinlock_t lock;
+	bool valid;
+	bool busy;
+	bool starved;
+	u16 qid;
+	u16 cqid;
+	u32 size;
+	u32 head;
+	u32 tail;
+	physical_addr_t dma;
+	/* Bumped when queue is deleted so that stale requests are dropped */
+	u32 gen;
+	/* Request pool (allocated on first use and kept till remove) */
+	struct nvme_req *reqs;
+	struct dlist free_reqs;
+	struct dlist aer_reqs;
+};
+
+struct nvme_cq {
+	vmm_spinlock_t lock;
+	bool valid;
+	bool ien;
+	u16 qid;
+	u16 iv;
+	u32 size;
+	u32 head;
+	u32 tail;
+	u16 phase;
+	physical_addr_t dma;
+	u32 nr_sqs;
+	u32 coal_count;
+	/* Requests waiting for free completion queue entries */
+	struct dlist pending;
+};
+
+struct nvme_ctrl {
+	struct vmm_guest *guest;
+	struct pci_device *pdev;
+	char name[VMM_FIELD_NAME_SIZE];
+	char serial[NVME_SERIAL_LEN + 1];
+	u32 irq;
+	u32 barnum;
+	struct vmm_vdisk *vdisk;
+
+	/* Registers, features and queue creation/deletion */
+	vmm_spinlock_t lock;
+	u32 intms;
+	u32 cc;
+	u32 csts;
+	u32 aqa;
+	u64 asq;
+	u64 acq;
+	u32 nr_aer;
+	u32 feat_arb;
+	u32 feat_pm;
+	u32 feat_temp;
+	u32 feat_err;
+	u32 feat_vwc;
+	u32 feat_coal;
+	u32 feat_atomic;
+	u32 feat_async;
+	u32 coal_disable;
+
+	/* Pin based interrupt and coalescing timer */
+	vmm_spinlock_t irq_lock;
+	bool intx_level;
+	bool coal_armed;
+	struct vmm_timer_event coal_ev;
+
+	struct nvme_sq sqs[NVME_MAX_QUEUES];
+	struct nvme_cq cqs[NVME_MAX_QUEUES];
+};
+
+static inline void nvme_put16(u8 *buf, u32 off, u16 val)
+{
+	buf[off] = val & 0xff;
+	buf[off + 1] = (val >> 8) & 0xff;
+}
+
+static inline void nvme_put32(u8 *buf, u32 off, u32 val)
+{
+	nvme_put16(buf, off, val & 0xffff);
+	nvme_put16(buf, off + 2, val >> 16);
+}
+
+static inline void nvme_put64(u8 *buf, u32 off, u64 val)
+{
+	nvme_put32(buf, off, val & 0xffffffff);
+	nvme_put32(buf, off + 4, val >> 32);
+}
+
+/* Copy string padded with spaces as required by identify data */
+static void nvme_put_str(u8 *buf, u32 off, const char *str, u32 len)
+{
+	u32 i, slen = strlen(str);
+
+	for (i = 0; i < len; i++) {
+		buf[off + i] = (i < slen) ? str[i] : ' ';
+	}
+}
+
+static void nvme_intx_update(struct nvme_ctrl *ctrl)
+{
+	u32 q;
+	bool level = FALSE;
+	irq_flags_t flags;
+	struct nvme_cq *cq;
+
+	vmm_spin_lock_irqsave(&ctrl->irq_lock, flags);
+
+	if (!(ctrl->intms & 0x1) && !pci_emu_msi_enabled(ctrl->pdev)) {
+		for (q = 0; q < NVME_MAX_QUEUES; q++) {
+			cq = &ctrl->cqs[q];
+			if (cq->valid && cq->ien && (cq->head != cq->tail)) {
+				level = TRUE;
+				break;
+			}
+		}
+	}
+
+	if (ctrl->intx_level != level) {
+		ctrl->intx_level = level;
+		vmm_devemu_emulate_irq(ctrl->guest, ctrl->irq, (level) ? 1 : 0);
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->irq_lock, flags);
+}
+
+static void nvme_coal_timer(struct vmm_timer_event *ev)
+{
+	u32 q, count;
+	u16 iv;
+	irq_flags_t flags;
+	struct nvme_cq *cq;
+	struct nvme_ctrl *ctrl = ev->priv;
+
+	vmm_spin_lock_irqsave(&ctrl->irq_lock, flags);
+	ctrl->coal_armed = FALSE;
+	vmm_spin_unlock_irqrestore(&ctrl->irq_lock, flags);
+
+	for (q = 1; q < NVME_MAX_QUEUES; q++) {
+		cq = &ctrl->cqs[q];
+
+		vmm_spin_lock_irqsave(&cq->lock, flags);
+		count = (cq->valid) ? cq->coal_count : 0;
+		cq->coal_count = 0;
+		iv = cq->iv;
+		vmm_spin_unlock_irqrestore(&cq->lock, flags);
+
+		if (count) {
+			pci_emu_msi_notify(ctrl->pdev, iv);
+		}
+	}
+}
+
+/*
+ * Signal new completion queue entries to guest. The admin
+ * completion queue and completion queues with coalescing disabled
+ * interrupt right away whereas other completion queues interrupt
+ * after aggregation threshold entries or aggregation time.
+ */
+static void nvme_cq_notify(struct nvme_ctrl *ctrl, struct nvme_cq *cq)
+{
+	bool fire = TRUE;
+	u32 coal = ctrl->feat_coal;
+	irq_flags_t flags;
+
+	if (!cq->ien) {
+		return;
+	}
+
+	if (cq->qid && NVME_COAL_TIME(coal) &&
+	    !(ctrl->coal_disable & (1 << cq->iv)) &&
+	    pci_emu_msi_enabled(ctrl->pdev)) {
+		vmm_spin_lock_irqsave(&cq->lock, flags);
+		cq->coal_count++;
+		if (cq->coal_count > NVME_COAL_THR(coal)) {
+			cq->coal_count = 0;
+		} else {
+			fire = FALSE;
+		}
+		vmm_spin_unlock_irqrestore(&cq->lock, flags);
+
+		if (!fire) {
+			vmm_spin_lock_irqsave(&ctrl->irq_lock, flags);
+			if (!ctrl->coal_armed) {
+				ctrl->coal_armed = TRUE;
+				vmm_timer_event_start(&ctrl->coal_ev,
+					NVME_COAL_TIME(coal) * NVME_COAL_TIME_NSECS);
+			}
+			vmm_spin_unlock_irqrestore(&ctrl->irq_lock, flags);
+			return;
+		}
+	}
+
+	if (pci_emu_msi_notify(ctrl->pdev, cq->iv) != VMM_ENOTAVAIL) {
+		return;
+	}
+
+	nvme_intx_update(ctrl);
+}
+
+/* Must be called with completion queue lock held */
+static inline bool nvme_cq_full(struct nvme_cq *cq)
+{
+	return ((cq->tail + 1) % cq->size) == cq->head;
+}
+
+/* Must be called with completion queue lock held */
+static void nvme_cq_post(struct nvme_ctrl *ctrl, struct nvme_cq *cq,
+			 struct nvme_cqe *cqe)
+{
+	physical_addr_t addr = cq->dma + cq->tail * sizeof(*cqe);
+	u32 last = ((u32)(cqe->status | cq->phase) << 16) | cqe->cid;
+
+	/* Guest polls phase bit so last dword has to be written last */
+	vmm_guest_memory_write(ctrl->guest, addr, cqe,
+			       offsetof(struct nvme_cqe, cid), TRUE);
+	arch_wmb();
+	vmm_guest_memory_write(ctrl->guest,
+			       addr + offsetof(struct nvme_cqe, cid),
+			       &last, sizeof(last), TRUE);
+
+	cq->tail++;
+	if (cq->tail == cq->size) {
+		cq->tail = 0;
+		cq->phase ^= 0x1;
+	}
+}
+
+/*
+ * Return request to pool of submission queue and tell whether the
+ * submission queue has to be processed again.
+ * Must be called with submission queue lock held.
+ */
+static bool nvme_sq_put_req(struct nvme_sq *sq, struct nvme_req *req)
+{
+	if (req->buf) {
+		vmm_free(req->buf);
+		req->buf = NULL;
+	}
+	req->state = NVME_REQ_FREE;
+	list_add_tail(&req->head, &sq->free_reqs);
+
+	if (sq->starved) {
+		sq->starved = FALSE;
+		return sq->valid;
+	}
+
+	return FALSE;
+}
+
+static u32 nvme_req_copy(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 i, done, off = 0;
+	struct nvme_seg *seg;
+
+	for (i = 0; i < req->nsegs; i++) {
+		seg = &req->segs[i];
+		if (!seg->bucket) {
+			if (req->to_guest) {
+				done = vmm_guest_memory_write(ctrl->guest,
+						seg->addr, (u8 *)req->buf + off,
+						seg->len, TRUE);
+			} else {
+				done = vmm_guest_memory_read(ctrl->guest,
+						seg->addr, (u8 *)req->buf + off,
+						seg->len, TRUE);
+			}
+			if (done != seg->len) {
+				return NVME_SC_DATA_XFER_ERROR;
+			}
+		}
+		off += seg->len;
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+/*
+ * Complete request on its completion queue. Requests of deleted
+ * submission queues are dropped and requests which do not fit
+ * in completion queue wait for completion queue head doorbell.
+ * Returns TRUE if submission queue has to be processed again.
+ */
+static bool nvme_req_done(struct nvme_req *req, u32 status)
+{
+	bool posted = FALSE, kick = FALSE;
+	irq_flags_t flags, cq_flags;
+	struct nvme_sq *sq = req->sq;
+	struct nvme_ctrl *ctrl = req->ctrl;
+	struct nvme_cq *cq = NULL;
+
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+
+	if (!sq->valid || (req->gen != sq->gen)) {
+		kick = nvme_sq_put_req(sq, req);
+		vmm_spin_unlock_irqrestore(&sq->lock, flags);
+		return kick;
+	}
+
+	if ((status == NVME_SC_SUCCESS) && req->to_guest && req->buf) {
+		status = nvme_req_copy(ctrl, req);
+	}
+	if (req->buf) {
+		vmm_free(req->buf);
+		req->buf = NULL;
+	}
+
+	req->cqe.sq_head = sq->head;
+	req->cqe.sq_id = sq->qid;
+	req->cqe.cid = req->cmd.cid;
+	req->cqe.status = status << 1;
+
+	cq = &ctrl->cqs[sq->cqid];
+	vmm_spin_lock_irqsave(&cq->lock, cq_flags);
+	if (nvme_cq_full(cq) || !list_empty(&cq->pending)) {
+		req->state = NVME_REQ_CQ_WAIT;
+		list_add_tail(&req->head, &cq->pending);
+	} else {
+		nvme_cq_post(ctrl, cq, &req->cqe);
+		posted = TRUE;
+	}
+	vmm_spin_unlock_irqrestore(&cq->lock, cq_flags);
+
+	if (posted) {
+		kick = nvme_sq_put_req(sq, req);
+	}
+
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+
+	if (posted) {
+		nvme_cq_notify(ctrl, cq);
+	}
+
+	return kick;
+}
+
+static bool nvme_add_seg(struct nvme_req *req, physical_addr_t addr,
+			 u32 len, bool bucket)
+{
+	if (req->nsegs == NVME_MAX_SEGS) {
+		return FALSE;
+	}
+
+	req->segs[req->nsegs].addr = addr;
+	req->segs[req->nsegs].len = len;
+	req->segs[req->nsegs].bucket = bucket;
+	req->nsegs++;
+
+	return TRUE;
+}
+
+static u32 nvme_map_prp(struct nvme_ctrl *ctrl, struct nvme_req *req,
+			u32 len)
+{
+	u64 prp1 = req->cmd.dptr[0];
+	u64 prp2 = req->cmd.dptr[1];
+	u64 list = prp2, ents[32];
+	u32 i, n, nents, count, chunk, trans, loops = 0;
+
+	trans = NVME_PAGE_SIZE - (prp1 & (NVME_PAGE_SIZE - 1));
+	trans = (len < trans) ? len : trans;
+	nvme_add_seg(req, prp1, trans, FALSE);
+	len -= trans;
+	if (!len) {
+		return NVME_SC_SUCCESS;
+	}
+
+	if (len <= NVME_PAGE_SIZE) {
+		if (prp2 & (NVME_PAGE_SIZE - 1)) {
+			return NVME_SC_PRP_INVALID_OFFSET | NVME_SC_DNR;
+		}
+		nvme_add_seg(req, prp2, len, FALSE);
+		return NVME_SC_SUCCESS;
+	}
+
+	while (len) {
+		if ((list & 0x7) || (++loops > NVME_MAX_SEGS)) {
+			return NVME_SC_PRP_INVALID_OFFSET | NVME_SC_DNR;
+		}
+
+		/* Entries left in current list page, last one may chain */
+		nents = (NVME_PAGE_SIZE - (list & (NVME_PAGE_SIZE - 1))) / 8;
+		count = (len + NVME_PAGE_SIZE - 1) >> NVME_PAGE_SHIFT;
+		if (count > nents) {
+			count = nents - 1;
+		}
+
+		for (i = 0; i < count; i += chunk) {
+			chunk = count - i;
+			chunk = (chunk < array_size(ents)) ?
+						chunk : array_size(ents);
+			if (vmm_guest_memory_read(ctrl->guest,
+					list + i * 8, ents, chunk * 8, TRUE) !=
+							(chunk * 8)) {
+				return NVME_SC_DATA_XFER_ERROR;
+			}
+			for (n = 0; n < chunk; n++) {
+				if (ents[n] & (NVME_PAGE_SIZE - 1)) {
+					return NVME_SC_PRP_INVALID_OFFSET |
+					       NVME_SC_DNR;
+				}
+				trans = (len < NVME_PAGE_SIZE) ?
+							len : NVME_PAGE_SIZE;
+				if (!nvme_add_seg(req, ents[n], trans, FALSE)) {
+					return NVME_SC_INVALID_FIELD |
+					       NVME_SC_DNR;
+				}
+				len -= trans;
+			}
+		}
+
+		if (len) {
+			if (vmm_guest_memory_read(ctrl->guest,
+					list + (nents - 1) * 8, &list, 8, TRUE) != 8) {
+				return NVME_SC_DATA_XFER_ERROR;
+			}
+		}
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+static u32 nvme_map_sgl_data(struct nvme_req *req,
+			     struct nvme_sgl_desc *desc, u32 *len)
+{
+	u32 trans;
+	bool bucket;
+
+	switch (NVME_SGL_TYPE(desc->type)) {
+	case NVME_SGL_DATA_BLOCK:
+		if (NVME_SGL_SUBTYPE(desc->type) != NVME_SGL_SUBTYPE_ADDRESS) {
+			return NVME_SC_SGL_INVALID_SUBTYPE | NVME_SC_DNR;
+		}
+		bucket = FALSE;
+		break;
+	case NVME_SGL_BIT_BUCKET:
+		/* Bit bucket only makes sense for data read by host */
+		if (!req->to_guest) {
+			return NVME_SC_SGL_INVALID_TYPE | NVME_SC_DNR;
+		}
+		bucket = TRUE;
+		break;
+	default:
+		return NVME_SC_SGL_INVALID_TYPE | NVME_SC_DNR;
+	}
+
+	trans = (desc->len < *len) ? desc->len : *len;
+	if (trans) {
+		if (!nvme_add_seg(req, desc->addr, trans, bucket)) {
+			return NVME_SC_SGL_INVALID_COUNT | NVME_SC_DNR;
+		}
+		*len -= trans;
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+static u32 nvme_map_sgl(struct nvme_ctrl *ctrl, struct nvme_req *req,
+			u32 len)
+{
+	bool last, chained;
+	u32 i, n, chunk, count, status, total = 0;
+	struct nvme_sgl_desc desc, descs[16];
+
+	memcpy(&desc, req->cmd.dptr, sizeof(desc));
+
+	while (1) {
+		if ((NVME_SGL_TYPE(desc.type) != NVME_SGL_SEGMENT) &&
+		    (NVME_SGL_TYPE(desc.type) != NVME_SGL_LAST_SEGMENT)) {
+			status = nvme_map_sgl_data(req, &desc, &len);
+			if (status) {
+				return status;
+			}
+			break;
+		}
+
+		if (NVME_SGL_SUBTYPE(desc.type) != NVME_SGL_SUBTYPE_ADDRESS) {
+			return NVME_SC_SGL_INVALID_SUBTYPE | NVME_SC_DNR;
+		}
+		count = desc.len / sizeof(desc);
+		if (!count || (desc.len % sizeof(desc))) {
+			return NVME_SC_SGL_INVALID_DATA | NVME_SC_DNR;
+		}
+		total += count;
+		if (total > NVME_MAX_SGL_DESCS) {
+			return NVME_SC_SGL_INVALID_COUNT | NVME_SC_DNR;
+		}
+		last = (NVME_SGL_TYPE(desc.type) == NVME_SGL_LAST_SEGMENT);
+		chained = FALSE;
+
+		for (i = 0; i < count; i += chunk) {
+			chunk = count - i;
+			chunk = (chunk < array_size(descs)) ?
+						chunk : array_size(descs);
+			if (vmm_guest_memory_read(ctrl->guest,
+					desc.addr + i * sizeof(desc), descs,
+					chunk * sizeof(desc), TRUE) !=
+						(chunk * sizeof(desc))) {
+				return NVME_SC_DATA_XFER_ERROR;
+			}
+
+			for (n = 0; n < chunk; n++) {
+				if ((NVME_SGL_TYPE(descs[n].type) ==
+						NVME_SGL_SEGMENT) ||
+				    (NVME_SGL_TYPE(descs[n].type) ==
+						NVME_SGL_LAST_SEGMENT)) {
+					/* Only last descriptor may chain */
+					if (last || ((i + n + 1) != count)) {
+						return NVME_SC_SGL_INVALID_LAST |
+						       NVME_SC_DNR;
+					}
+					desc = descs[n];
+					chained = TRUE;
+					break;
+				}
+				status = nvme_map_sgl_data(req,
+							   &descs[n], &len);
+				if (status) {
+					return status;
+				}
+			}
+		}
+
+		if (!chained) {
+			break;
+		}
+	}
+
+	if (len) {
+		return NVME_SC_SGL_INVALID_DATA | NVME_SC_DNR;
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+/* Map data pointer of command and allocate bounce buffer */
+static u32 nvme_map_data(struct nvme_ctrl *ctrl, struct nvme_req *req,
+			 u32 len, bool to_guest)
+{
+	u32 status;
+	u8 psdt = NVME_CMD_PSDT(req->cmd.flags);
+
+	req->to_guest = to_guest;
+	req->len = len;
+	req->nsegs = 0;
+
+	if (psdt == NVME_PSDT_PRP) {
+		status = nvme_map_prp(ctrl, req, len);
+	} else if (req->sq->qid) {
+		status = nvme_map_sgl(ctrl, req, len);
+	} else {
+		/* Admin commands always use PRPs */
+		status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	}
+	if (status) {
+		return status;
+	}
+
+	/* Admin data is built in place so it needs zeroed buffer */
+	req->buf = (req->sq->qid) ? vmm_malloc(len) : vmm_zalloc(len);
+	if (!req->buf) {
+		return NVME_SC_INTERNAL;
+	}
+
+	if (!to_guest) {
+		return nvme_req_copy(ctrl, req);
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+static void nvme_vdisk_done(struct nvme_req *req, u32 status)
+{
+	irq_flags_t flags;
+	struct nvme_sq *sq = req->sq;
+
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+	if (req->state != NVME_REQ_VDISK) {
+		vmm_spin_unlock_irqrestore(&sq->lock, flags);
+		return;
+	}
+	req->state = NVME_REQ_ACTIVE;
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+
+	if (nvme_req_done(req, status)) {
+		nvme_sq_process(req->ctrl, sq);
+	}
+}
+
+/* Submit vdisk request on behalf of I/O command */
+static u32 nvme_io_submit(struct nvme_ctrl *ctrl, struct nvme_req *req,
+			  enum vmm_vdisk_request_type type,
+			  u64 slba, void *data, u32 len)
+{
+	int rc;
+	bool own;
+	u32 seq;
+	irq_flags_t flags;
+	struct nvme_sq *sq = req->sq;
+
+	seq = req->seq;
+	req->state = NVME_REQ_VDISK;
+	rc = vmm_vdisk_submit_request(ctrl->vdisk, &req->r,
+				      type, slba, data, len);
+	if (!rc) {
+		return NVME_SC_PENDING;
+	}
+
+	/* Failure callback might already have completed the request */
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+	own = (req->state == NVME_REQ_VDISK) && (req->seq == seq);
+	if (own) {
+		req->state = NVME_REQ_ACTIVE;
+	}
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+
+	return (own) ? NVME_SC_INTERNAL : NVME_SC_PENDING;
+}
+
+/* Discard next chunk of dataset management ranges */
+static u32 nvme_dsm_next(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u64 slba;
+	u32 nlb;
+	struct nvme_dsm_range *range;
+
+	while (!req->dsm_nlb) {
+		if (req->dsm_idx == req->dsm_nr) {
+			return NVME_SC_SUCCESS;
+		}
+		range = (struct nvme_dsm_range *)req->buf + req->dsm_idx++;
+		req->dsm_slba = range->slba;
+		req->dsm_nlb = range->nlb;
+	}
+
+	slba = req->dsm_slba;
+	nlb = min(req->dsm_nlb, (u32)NVME_DSM_MAX_NLB);
+	req->dsm_slba += nlb;
+	req->dsm_nlb -= nlb;
+
+	return nvme_io_submit(ctrl, req, VMM_VDISK_REQUEST_DISCARD,
+			      slba, NULL, nlb << NVME_LBA_SHIFT);
+}
+
+static void nvme_vdisk_completed(struct vmm_vdisk *vdisk,
+				 struct vmm_vdisk_request *vreq)
+{
+	u32 status;
+	struct nvme_req *req = container_of(vreq, struct nvme_req, r);
+
+	DPRINTF("%s: vdisk=%s cid=%d\n",
+		__func__, vmm_vdisk_name(vdisk), req->cmd.cid);
+
+	/* Dataset management ranges are discarded one after another */
+	if (req->dsm_nr) {
+		status = nvme_dsm_next(req->ctrl, req);
+		if (status == NVME_SC_PENDING) {
+			return;
+		} else if (status != NVME_SC_SUCCESS) {
+			if (nvme_req_done(req, status)) {
+				nvme_sq_process(req->ctrl, req->sq);
+			}
+			return;
+		}
+	}
+
+	nvme_vdisk_done(req, NVME_SC_SUCCESS);
+}
+
+static void nvme_vdisk_failed(struct vmm_vdisk *vdisk,
+			      struct vmm_vdisk_request *vreq)
+{
+	struct nvme_req *req = container_of(vreq, struct nvme_req, r);
+
+	DPRINTF("%s: vdisk=%s cid=%d\n",
+		__func__, vmm_vdisk_name(vdisk), req->cmd.cid);
+
+	nvme_vdisk_done(req, (req->to_guest) ?
+			NVME_SC_READ_ERROR : NVME_SC_WRITE_FAULT);
+}
+
+static void nvme_vdisk_attached(struct vmm_vdisk *vdisk)
+{
+	DPRINTF("%s: vdisk=%s\n", __func__, vmm_vdisk_name(vdisk));
+}
+
+static void nvme_vdisk_detached(struct vmm_vdisk *vdisk)
+{
+	DPRINTF("%s: vdisk=%s\n", __func__, vmm_vdisk_name(vdisk));
+}
+
+static u32 nvme_io_rw(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 status, len;
+	enum vmm_vdisk_request_type type;
+	bool read = (req->cmd.opcode == NVME_CMD_READ);
+	u64 slba = ((u64)req->cmd.cdw11 << 32) | req->cmd.cdw10;
+	u32 nlb = (req->cmd.cdw12 & 0xffff) + 1;
+
+	if (((slba + nlb) < slba) ||
+	    ((slba + nlb) > vmm_vdisk_capacity(ctrl->vdisk))) {
+		return NVME_SC_LBA_RANGE | NVME_SC_DNR;
+	}
+
+	len = nlb << NVME_LBA_SHIFT;
+	if (len > NVME_MAX_XFER) {
+		return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	}
+
+	status = nvme_map_data(ctrl, req, len, read);
+	if (status) {
+		return status;
+	}
+
+	if (read) {
+		type = VMM_VDISK_REQUEST_READ;
+	} else if (req->cmd.cdw12 & NVME_RW_FUA) {
+		type = VMM_VDISK_REQUEST_WRITE_FUA;
+	} else {
+		type = VMM_VDISK_REQUEST_WRITE;
+	}
+
+	return nvme_io_submit(ctrl, req, type, slba, req->buf, len);
+}
+
+static u32 nvme_io_write_zeroes(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u64 slba = ((u64)req->cmd.cdw11 << 32) | req->cmd.cdw10;
+	u32 nlb = (req->cmd.cdw12 & 0xffff) + 1;
+
+	if (((slba + nlb) < slba) ||
+	    ((slba + nlb) > vmm_vdisk_capacity(ctrl->vdisk))) {
+		return NVME_SC_LBA_RANGE | NVME_SC_DNR;
+	}
+
+	return nvme_io_submit(ctrl, req, VMM_VDISK_REQUEST_WRITE_ZEROES,
+			      slba, NULL, nlb << NVME_LBA_SHIFT);
+}
+
+static u32 nvme_io_dsm(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 i, nr, status;
+	u64 capacity = vmm_vdisk_capacity(ctrl->vdisk);
+	struct nvme_dsm_range *range;
+
+	/* Only deallocate attribute is acted upon rest are hints */
+	if (!(req->cmd.cdw11 & NVME_DSM_AD) ||
+	    !vmm_vdisk_can_discard(ctrl->vdisk)) {
+		return NVME_SC_SUCCESS;
+	}
+
+	nr = (req->cmd.cdw10 & 0xff) + 1;
+	status = nvme_map_data(ctrl, req,
+			       nr * sizeof(struct nvme_dsm_range), FALSE);
+	if (status) {
+		return status;
+	}
+
+	range = req->buf;
+	for (i = 0; i < nr; i++) {
+		if (((range[i].slba + range[i].nlb) < range[i].slba) ||
+		    ((range[i].slba + range[i].nlb) > capacity)) {
+			return NVME_SC_LBA_RANGE | NVME_SC_DNR;
+		}
+	}
+
+	req->dsm_nr = nr;
+	req->dsm_idx = 0;
+	req->dsm_nlb = 0;
+
+	return nvme_dsm_next(ctrl, req);
+}
+
+static u32 nvme_io_cmd(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 nsid = req->cmd.nsid;
+
+	switch (req->cmd.opcode) {
+	case NVME_CMD_FLUSH:
+		if ((nsid != NVME_NSID) && (nsid != 0xffffffff)) {
+			return NVME_SC_INVALID_NS | NVME_SC_DNR;
+		}
+		return nvme_io_submit(ctrl, req, VMM_VDISK_REQUEST_FLUSH,
+				      0, NULL, 0);
+	case NVME_CMD_WRITE:
+	case NVME_CMD_READ:
+		if (nsid != NVME_NSID) {
+			return NVME_SC_INVALID_NS | NVME_SC_DNR;
+		}
+		return nvme_io_rw(ctrl, req);
+	case NVME_CMD_WRITE_ZEROES:
+		if (nsid != NVME_NSID) {
+			return NVME_SC_INVALID_NS | NVME_SC_DNR;
+		}
+		return nvme_io_write_zeroes(ctrl, req);
+	case NVME_CMD_DSM:
+		if (nsid != NVME_NSID) {
+			return NVME_SC_INVALID_NS | NVME_SC_DNR;
+		}
+		return nvme_io_dsm(ctrl, req);
+	default:
+		break;
+	}
+
+	return NVME_SC_INVALID_OPCODE | NVME_SC_DNR;
+}
+
+/* Must be called with controller lock held */
+static void nvme_sq_teardown(struct nvme_ctrl *ctrl, struct nvme_sq *sq)
+{
+	irq_flags_t flags, cq_flags;
+	struct nvme_req *req, *next;
+	struct nvme_cq *cq;
+
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+
+	sq->valid = FALSE;
+	sq->starved = FALSE;
+	sq->gen++;
+
+	/* Drop completions still waiting for completion queue space */
+	cq = &ctrl->cqs[sq->cqid];
+	vmm_spin_lock_irqsave(&cq->lock, cq_flags);
+	list_for_each_entry_safe(req, next, &cq->pending, head) {
+		if (req->sq == sq) {
+			list_del(&req->head);
+			nvme_sq_put_req(sq, req);
+		}
+	}
+	cq->nr_sqs--;
+	vmm_spin_unlock_irqrestore(&cq->lock, cq_flags);
+
+	while (!list_empty(&sq->aer_reqs)) {
+		req = list_first_entry(&sq->aer_reqs, struct nvme_req, head);
+		list_del(&req->head);
+		nvme_sq_put_req(sq, req);
+	}
+
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+}
+
+/* Must be called with controller lock held */
+static void nvme_cq_teardown(struct nvme_cq *cq)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&cq->lock, flags);
+	cq->valid = FALSE;
+	cq->coal_count = 0;
+	vmm_spin_unlock_irqrestore(&cq->lock, flags);
+}
+
+static int nvme_sq_alloc_reqs(struct nvme_ctrl *ctrl, struct nvme_sq *sq)
+{
+	u32 i;
+	irq_flags_t flags;
+	struct nvme_req *reqs;
+
+	if (sq->reqs) {
+		return VMM_OK;
+	}
+
+	reqs = vmm_zalloc(NVME_MAX_SQ_REQS * sizeof(*reqs));
+	if (!reqs) {
+		return VMM_ENOMEM;
+	}
+
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+	if (sq->reqs) {
+		vmm_spin_unlock_irqrestore(&sq->lock, flags);
+		vmm_free(reqs);
+		return VMM_OK;
+	}
+	for (i = 0; i < NVME_MAX_SQ_REQS; i++) {
+		INIT_LIST_HEAD(&reqs[i].head);
+		reqs[i].ctrl = ctrl;
+		reqs[i].sq = sq;
+		reqs[i].state = NVME_REQ_FREE;
+		list_add_tail(&reqs[i].head, &sq->free_reqs);
+	}
+	sq->reqs = reqs;
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+
+	return VMM_OK;
+}
+
+/* Must be called with controller lock held */
+static void nvme_sq_init(struct nvme_ctrl *ctrl, struct nvme_sq *sq,
+			 u16 qid, u16 cqid, u32 size, physical_addr_t dma)
+{
+	irq_flags_t flags, cq_flags;
+	struct nvme_cq *cq = &ctrl->cqs[cqid];
+
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+	sq->qid = qid;
+	sq->cqid = cqid;
+	sq->size = size;
+	sq->head = sq->tail = 0;
+	sq->dma = dma;
+	sq->starved = FALSE;
+	sq->valid = TRUE;
+	vmm_spin_lock_irqsave(&cq->lock, cq_flags);
+	cq->nr_sqs++;
+	vmm_spin_unlock_irqrestore(&cq->lock, cq_flags);
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+}
+
+/* Must be called with controller lock held */
+static void nvme_cq_init(struct nvme_cq *cq, u16 qid, u32 size,
+			 physical_addr_t dma, bool ien, u16 iv)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&cq->lock, flags);
+	cq->qid = qid;
+	cq->size = size;
+	cq->head = cq->tail = 0;
+	cq->phase = 1;
+	cq->dma = dma;
+	cq->ien = ien;
+	cq->iv = iv;
+	cq->nr_sqs = 0;
+	cq->coal_count = 0;
+	cq->valid = TRUE;
+	vmm_spin_unlock_irqrestore(&cq->lock, flags);
+}
+
+static void nvme_features_reset(struct nvme_ctrl *ctrl)
+{
+	ctrl->feat_arb = 0;
+	ctrl->feat_pm = 0;
+	ctrl->feat_temp = NVME_WCTEMP;
+	ctrl->feat_err = 0;
+	ctrl->feat_vwc = 1;
+	ctrl->feat_coal = 0;
+	ctrl->feat_atomic = 0;
+	ctrl->feat_async = 0;
+	ctrl->coal_disable = 0;
+}
+
+/* Must be called with controller lock held */
+static void nvme_ctrl_reset(struct nvme_ctrl *ctrl)
+{
+	u32 q;
+
+	for (q = 0; q < NVME_MAX_QUEUES; q++) {
+		if (ctrl->sqs[q].valid) {
+			nvme_sq_teardown(ctrl, &ctrl->sqs[q]);
+		}
+	}
+	for (q = 0; q < NVME_MAX_QUEUES; q++) {
+		if (ctrl->cqs[q].valid) {
+			nvme_cq_teardown(&ctrl->cqs[q]);
+		}
+	}
+
+	vmm_timer_event_stop(&ctrl->coal_ev);
+	ctrl->coal_armed = FALSE;
+
+	ctrl->nr_aer = 0;
+	ctrl->intms = 0;
+	ctrl->csts = 0;
+	nvme_features_reset(ctrl);
+}
+
+/* Must be called with controller lock held */
+static int nvme_ctrl_enable(struct nvme_ctrl *ctrl)
+{
+	u32 asqs = NVME_AQA_ASQS(ctrl->aqa) + 1;
+	u32 acqs = NVME_AQA_ACQS(ctrl->aqa) + 1;
+
+	if (NVME_CC_MPS(ctrl->cc) || NVME_CC_CSS(ctrl->cc) ||
+	    NVME_CC_AMS(ctrl->cc)) {
+		return VMM_EINVALID;
+	}
+	if ((asqs < 2) || (acqs < 2) || !ctrl->asq || !ctrl->acq) {
+		return VMM_EINVALID;
+	}
+
+	nvme_cq_init(&ctrl->cqs[0], 0, acqs, ctrl->acq, TRUE, 0);
+	nvme_sq_init(ctrl, &ctrl->sqs[0], 0, 0, asqs, ctrl->asq);
+
+	return VMM_OK;
+}
+
+static u32 nvme_adm_create_cq(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 status = NVME_SC_SUCCESS;
+	irq_flags_t flags;
+	u16 qid = req->cmd.cdw10 & 0xffff;
+	u32 size = (req->cmd.cdw10 >> 16) + 1;
+	u16 iv = req->cmd.cdw11 >> 16;
+	bool ien = (req->cmd.cdw11 & 0x2) ? TRUE : FALSE;
+	u64 dma = req->cmd.dptr[0];
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	if (!qid || (NVME_MAX_QUEUES <= qid) || ctrl->cqs[qid].valid) {
+		status = NVME_SC_QID_INVALID | NVME_SC_DNR;
+	} else if ((size < 2) || (NVME_MAX_QUEUE_ENTRIES < size)) {
+		status = NVME_SC_QUEUE_SIZE | NVME_SC_DNR;
+	} else if (NVME_MAX_QUEUES <= iv) {
+		status = NVME_SC_INVALID_VECTOR | NVME_SC_DNR;
+	} else if (!(req->cmd.cdw11 & 0x1) || !dma ||
+		   (dma & (NVME_PAGE_SIZE - 1)) ||
+		   ((1 << NVME_CC_IOCQES(ctrl->cc)) !=
+					sizeof(struct nvme_cqe))) {
+		status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	} else {
+		nvme_cq_init(&ctrl->cqs[qid], qid, size, dma, ien, iv);
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	return status;
+}
+
+static u32 nvme_adm_create_sq(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 status = NVME_SC_SUCCESS;
+	irq_flags_t flags;
+	u16 qid = req->cmd.cdw10 & 0xffff;
+	u32 size = (req->cmd.cdw10 >> 16) + 1;
+	u16 cqid = req->cmd.cdw11 >> 16;
+	u64 dma = req->cmd.dptr[0];
+
+	if (!qid || (NVME_MAX_QUEUES <= qid)) {
+		return NVME_SC_QID_INVALID | NVME_SC_DNR;
+	}
+	if (nvme_sq_alloc_reqs(ctrl, &ctrl->sqs[qid])) {
+		return NVME_SC_INTERNAL;
+	}
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	if (ctrl->sqs[qid].valid) {
+		status = NVME_SC_QID_INVALID | NVME_SC_DNR;
+	} else if (!cqid || (NVME_MAX_QUEUES <= cqid) ||
+		   !ctrl->cqs[cqid].valid) {
+		status = NVME_SC_CQ_INVALID | NVME_SC_DNR;
+	} else if ((size < 2) || (NVME_MAX_QUEUE_ENTRIES < size)) {
+		status = NVME_SC_QUEUE_SIZE | NVME_SC_DNR;
+	} else if (!(req->cmd.cdw11 & 0x1) || !dma ||
+		   (dma & (NVME_PAGE_SIZE - 1)) ||
+		   ((1 << NVME_CC_IOSQES(ctrl->cc)) !=
+					sizeof(struct nvme_sqe))) {
+		status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	} else {
+		nvme_sq_init(ctrl, &ctrl->sqs[qid], qid, cqid, size, dma);
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	return status;
+}
+
+static u32 nvme_adm_delete_sq(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 status = NVME_SC_SUCCESS;
+	irq_flags_t flags;
+	u16 qid = req->cmd.cdw10 & 0xffff;
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	if (!qid || (NVME_MAX_QUEUES <= qid) || !ctrl->sqs[qid].valid) {
+		status = NVME_SC_QID_INVALID | NVME_SC_DNR;
+	} else {
+		nvme_sq_teardown(ctrl, &ctrl->sqs[qid]);
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	return status;
+}
+
+static u32 nvme_adm_delete_cq(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 status = NVME_SC_SUCCESS;
+	irq_flags_t flags;
+	u16 qid = req->cmd.cdw10 & 0xffff;
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	if (!qid || (NVME_MAX_QUEUES <= qid) || !ctrl->cqs[qid].valid) {
+		status = NVME_SC_QID_INVALID | NVME_SC_DNR;
+	} else if (ctrl->cqs[qid].nr_sqs) {
+		status = NVME_SC_INVALID_QUEUE | NVME_SC_DNR;
+	} else {
+		nvme_cq_teardown(&ctrl->cqs[qid]);
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	if (!status) {
+		nvme_intx_update(ctrl);
+	}
+
+	return status;
+}
+
+static void nvme_identify_ctrl(struct nvme_ctrl *ctrl, u8 *id)
+{
+	u16 oncs;
+	char nqn[256];
+
+	nvme_put16(id, 0, NVME_PCI_VENDOR_ID);		/* VID */
+	nvme_put16(id, 2, NVME_PCI_VENDOR_ID);		/* SSVID */
+	nvme_put_str(id, 4, ctrl->serial, NVME_SERIAL_LEN);
+	nvme_put_str(id, 24, "Xvisor NVMe Ctrl", NVME_MODEL_LEN);
+	nvme_put_str(id, 64, "1.0", 8);			/* FR */
+	id[72] = 6;					/* RAB */
+	id[77] = NVME_MDTS;				/* MDTS */
+	nvme_put32(id, 80, NVME_VS);			/* VER */
+	id[111] = 1;					/* CNTRLTYPE (I/O) */
+	id[258] = 3;					/* ACL */
+	id[259] = NVME_AERL;				/* AERL */
+	id[260] = (1 << 1) | 0x1;			/* FRMW */
+	id[261] = (1 << 2);				/* LPA */
+	nvme_put16(id, 266, NVME_WCTEMP);		/* WCTEMP */
+	nvme_put16(id, 268, NVME_CCTEMP);		/* CCTEMP */
+	id[512] = 0x66;					/* SQES */
+	id[513] = 0x44;					/* CQES */
+	nvme_put32(id, 516, 1);				/* NN */
+	oncs = (1 << 3);				/* Write Zeroes */
+	if (vmm_vdisk_can_discard(ctrl->vdisk)) {
+		oncs |= (1 << 2);			/* DSM */
+	}
+	nvme_put16(id, 520, oncs);			/* ONCS */
+	id[525] = 0x1;					/* VWC */
+	nvme_put32(id, 536, (1 << 16) | 0x1);		/* SGLS */
+	vmm_snprintf(nqn, sizeof(nqn),
+		     "nqn.2026-01.org.xvisor:nvme:%s", ctrl->serial);
+	memcpy(&id[768], nqn, strlen(nqn));		/* SUBNQN */
+	nvme_put16(id, 2048, 2500);			/* PSD0.MP */
+}
+
+static void nvme_identify_ns(struct nvme_ctrl *ctrl, u8 *id)
+{
+	u64 nsze = vmm_vdisk_capacity(ctrl->vdisk);
+
+	nvme_put64(id, 0, nsze);			/* NSZE */
+	nvme_put64(id, 8, nsze);			/* NCAP */
+	nvme_put64(id, 16, nsze);			/* NUSE */
+	id[25] = 0;					/* NLBAF */
+	id[26] = 0;					/* FLBAS */
+	nvme_put32(id, 128, NVME_LBA_SHIFT << 16);	/* LBAF0 */
+}
+
+static u32 nvme_adm_identify(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	u32 status;
+	u32 nsid = req->cmd.nsid;
+	u8 cns = req->cmd.cdw10 & 0xff;
+
+	switch (cns) {
+	case NVME_ID_CNS_NS:
+		if ((nsid != NVME_NSID) && (nsid != 0xffffffff)) {
+			return NVME_SC_INVALID_NS | NVME_SC_DNR;
+		}
+		break;
+	case NVME_ID_CNS_NS_DESC_LIST:
+		if (nsid != NVME_NSID) {
+			return NVME_SC_INVALID_NS | NVME_SC_DNR;
+		}
+		break;
+	case NVME_ID_CNS_NS_ACTIVE_LIST:
+		if (nsid >= 0xfffffffe) {
+			return NVME_SC_INVALID_NS | NVME_SC_DNR;
+		}
+		break;
+	case NVME_ID_CNS_CTRL:
+		break;
+	default:
+		return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	}
+
+	status = nvme_map_data(ctrl, req, NVME_ID_SIZE, TRUE);
+	if (status) {
+		return status;
+	}
+
+	switch (cns) {
+	case NVME_ID_CNS_NS:
+		nvme_identify_ns(ctrl, req->buf);
+		break;
+	case NVME_ID_CNS_CTRL:
+		nvme_identify_ctrl(ctrl, req->buf);
+		break;
+	case NVME_ID_CNS_NS_ACTIVE_LIST:
+		if (nsid < NVME_NSID) {
+			nvme_put32(req->buf, 0, NVME_NSID);
+		}
+		break;
+	default:
+		/* No namespace identification descriptors */
+		break;
+	}
+
+	return NVME_SC_SUCCESS;
+}
+
+static u32 nvme_adm_get_log_page(struct nvme_ctrl *ctrl,
+				 struct nvme_req *req)
+{
+	u32 status, len;
+	u8 lid = req->cmd.cdw10 & 0xff;
+	u32 numd = ((req->cmd.cdw11 & 0xffff) << 16) |
+		   (req->cmd.cdw10 >> 16);
+	u64 off = ((u64)req->cmd.cdw13 << 32) | req->cmd.cdw12;
+	u8 log[NVME_LOG_SIZE];
+
+	memset(log, 0, sizeof(log));
+	switch (lid) {
+	case NVME_LOG_ERROR:
+		/* No error information entries */
+		break;
+	case NVME_LOG_SMART:
+		nvme_put16(log, 1, NVME_TEMP);		/* Composite temp */
+		log[3] = 100;				/* Available spare */
+		log[4] = 10;				/* Spare threshold */
+		break;
+	case NVME_LOG_FW_SLOT:
+		log[0] = 1;				/* AFI */
+		nvme_put_str(log, 8, "1.0", 8);		/* FRS1 */
+		break;
+	default:
+		return NVME_SC_INVALID_LOG_PAGE | NVME_SC_DNR;
+	}
+
+	if (NVME_MAX_XFER < ((u64)numd + 1) * 4) {
+		return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	}
+	len = (numd + 1) * 4;
+	if ((off & 0x3) || (sizeof(log) < off)) {
+		return NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+	}
+
+	status = nvme_map_data(ctrl, req, len, TRUE);
+	if (status) {
+		return status;
+	}
+	memcpy(req->buf, &log[off],
+	       ((sizeof(log) - off) < len) ? (sizeof(log) - off) : len);
+
+	return NVME_SC_SUCCESS;
+}
+
+static u32 nvme_adm_set_features(struct nvme_ctrl *ctrl,
+				 struct nvme_req *req)
+{
+	u16 iv;
+	u32 status = NVME_SC_SUCCESS;
+	irq_flags_t flags;
+	bool flush = FALSE;
+	u32 val = req->cmd.cdw11;
+
+	if (req->cmd.cdw10 & (1U << 31)) {
+		return NVME_SC_FEATURE_NOT_SAVEABLE | NVME_SC_DNR;
+	}
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	switch (req->cmd.cdw10 & 0xff) {
+	case NVME_FEAT_ARBITRATION:
+		ctrl->feat_arb = val;
+		break;
+	case NVME_FEAT_POWER_MGMT:
+		if (val & 0x1f) {
+			status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+			break;
+		}
+		ctrl->feat_pm = val;
+		break;
+	case NVME_FEAT_TEMP_THRESH:
+		/* Only over temperature threshold of composite sensor */
+		if (!((val >> 16) & 0x3f)) {
+			ctrl->feat_temp = val & 0xffff;
+		}
+		break;
+	case NVME_FEAT_ERR_RECOVERY:
+		ctrl->feat_err = val;
+		break;
+	case NVME_FEAT_VOLATILE_WC:
+		flush = (ctrl->feat_vwc & 0x1) && !(val & 0x1);
+		ctrl->feat_vwc = val & 0x1;
+		break;
+	case NVME_FEAT_NUM_QUEUES:
+		if (((val & 0xffff) == 0xffff) || ((val >> 16) == 0xffff)) {
+			status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+			break;
+		}
+		req->cqe.result = (NVME_MAX_IO_QUEUES - 1) |
+				  ((NVME_MAX_IO_QUEUES - 1) << 16);
+		break;
+	case NVME_FEAT_IRQ_COALESCE:
+		ctrl->feat_coal = val & 0xffff;
+		break;
+	case NVME_FEAT_IRQ_CONFIG:
+		iv = val & 0xffff;
+		if (NVME_MAX_QUEUES <= iv) {
+			status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+			break;
+		}
+		if (val & (1 << 16)) {
+			ctrl->coal_disable |= (1 << iv);
+		} else {
+			ctrl->coal_disable &= ~(1 << iv);
+		}
+		break;
+	case NVME_FEAT_WRITE_ATOMIC:
+		ctrl->feat_atomic = val & 0x1;
+		break;
+	case NVME_FEAT_ASYNC_EVENT:
+		ctrl->feat_async = val;
+		break;
+	default:
+		status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+		break;
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	if (flush) {
+		vmm_vdisk_flush_cache(ctrl->vdisk);
+	}
+
+	return status;
+}
+
+static u32 nvme_adm_get_features(struct nvme_ctrl *ctrl,
+				 struct nvme_req *req)
+{
+	u16 iv;
+	u32 status = NVME_SC_SUCCESS;
+	irq_flags_t flags;
+	u8 fid = req->cmd.cdw10 & 0xff;
+	u8 sel = (req->cmd.cdw10 >> 8) & 0x7;
+	u32 res = 0;
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	switch (fid) {
+	case NVME_FEAT_ARBITRATION:
+		res = ctrl->feat_arb;
+		break;
+	case NVME_FEAT_POWER_MGMT:
+		res = ctrl->feat_pm;
+		break;
+	case NVME_FEAT_TEMP_THRESH:
+		res = (((req->cmd.cdw11 >> 16) & 0x3f)) ?
+						0 : ctrl->feat_temp;
+		break;
+	case NVME_FEAT_ERR_RECOVERY:
+		res = ctrl->feat_err;
+		break;
+	case NVME_FEAT_VOLATILE_WC:
+		res = ctrl->feat_vwc;
+		break;
+	case NVME_FEAT_NUM_QUEUES:
+		res = (NVME_MAX_IO_QUEUES - 1) |
+		       ((NVME_MAX_IO_QUEUES - 1) << 16);
+		break;
+	case NVME_FEAT_IRQ_COALESCE:
+		res = ctrl->feat_coal;
+		break;
+	case NVME_FEAT_IRQ_CONFIG:
+		iv = req->cmd.cdw11 & 0xffff;
+		if (NVME_MAX_QUEUES <= iv) {
+			status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+			break;
+		}
+		res = iv;
+		if (ctrl->coal_disable & (1 << iv)) {
+			res |= (1 << 16);
+		}
+		break;
+	case NVME_FEAT_WRITE_ATOMIC:
+		res = ctrl->feat_atomic;
+		break;
+	case NVME_FEAT_ASYNC_EVENT:
+		res = ctrl->feat_async;
+		break;
+	default:
+		status = NVME_SC_INVALID_FIELD | NVME_SC_DNR;
+		break;
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	if (!status && (sel == NVME_FEAT_SEL_SUPPORTED)) {
+		res = NVME_FEAT_CAP_CHANGEABLE;
+	}
+	req->cqe.result = res;
+
+	return status;
+}
+
+static u32 nvme_adm_async_event(struct nvme_ctrl *ctrl,
+				struct nvme_req *req)
+{
+	bool full;
+	irq_flags_t flags;
+	struct nvme_sq *sq = req->sq;
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+	full = (NVME_AERL < ctrl->nr_aer);
+	if (!full) {
+		ctrl->nr_aer++;
+	}
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	if (full) {
+		return NVME_SC_ASYNC_LIMIT | NVME_SC_DNR;
+	}
+
+	/* No events are generated so request is held till reset */
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+	if (sq->valid && (req->gen == sq->gen)) {
+		req->state = NVME_REQ_AER;
+		list_add_tail(&req->head, &sq->aer_reqs);
+	} else {
+		nvme_sq_put_req(sq, req);
+	}
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+
+	return NVME_SC_PENDING;
+}
+
+static u32 nvme_admin_cmd(struct nvme_ctrl *ctrl, struct nvme_req *req)
+{
+	switch (req->cmd.opcode) {
+	case NVME_ADM_DELETE_SQ:
+		return nvme_adm_delete_sq(ctrl, req);
+	case NVME_ADM_CREATE_SQ:
+		return nvme_adm_create_sq(ctrl, req);
+	case NVME_ADM_GET_LOG_PAGE:
+		return nvme_adm_get_log_page(ctrl, req);
+	case NVME_ADM_DELETE_CQ:
+		return nvme_adm_delete_cq(ctrl, req);
+	case NVME_ADM_CREATE_CQ:
+		return nvme_adm_create_cq(ctrl, req);
+	case NVME_ADM_IDENTIFY:
+		return nvme_adm_identify(ctrl, req);
+	case NVME_ADM_ABORT:
+		/* Commands are never aborted */
+		req->cqe.result = 1;
+		return NVME_SC_SUCCESS;
+	case NVME_ADM_SET_FEATURES:
+		return nvme_adm_set_features(ctrl, req);
+	case NVME_ADM_GET_FEATURES:
+		return nvme_adm_get_features(ctrl, req);
+	case NVME_ADM_ASYNC_EVENT:
+		return nvme_adm_async_event(ctrl, req);
+	default:
+		break;
+	}
+
+	return NVME_SC_INVALID_OPCODE | NVME_SC_DNR;
+}
+
+/*
+ * Fetch and execute commands till submission queue is empty or
+ * request pool of submission queue is exhausted. Only one caller
+ * processes a submission queue at a time, others just return.
+ */
+static void nvme_sq_process(struct nvme_ctrl *ctrl, struct nvme_sq *sq)
+{
+	u32 status;
+	irq_flags_t flags;
+	struct nvme_req *req;
+
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+
+	if (sq->busy) {
+		vmm_spin_unlock_irqrestore(&sq->lock, flags);
+		return;
+	}
+	sq->busy = TRUE;
+
+	while (sq->valid && (sq->head != sq->tail)) {
+		if (list_empty(&sq->free_reqs)) {
+			sq->starved = TRUE;
+			break;
+		}
+
+		req = list_first_entry(&sq->free_reqs, struct nvme_req, head);
+		list_del(&req->head);
+		req->state = NVME_REQ_ACTIVE;
+		req->gen = sq->gen;
+		req->seq++;
+		req->to_guest = FALSE;
+		req->buf = NULL;
+		req->len = 0;
+		req->nsegs = 0;
+		req->dsm_nr = 0;
+		memset(&req->cqe, 0, sizeof(req->cqe));
+		if (vmm_guest_memory_read(ctrl->guest,
+				sq->dma + sq->head * sizeof(req->cmd), &req->cmd,
+				sizeof(req->cmd), TRUE) != sizeof(req->cmd)) {
+			memset(&req->cmd, 0, sizeof(req->cmd));
+			req->cmd.opcode = 0xff;
+		}
+		sq->head = (sq->head + 1) % sq->size;
+
+		vmm_spin_unlock_irqrestore(&sq->lock, flags);
+
+		DPRINTF("%s: sq=%d cid=%d opcode=0x%x\n", __func__,
+			sq->qid, req->cmd.cid, req->cmd.opcode);
+
+		if (sq->qid) {
+			status = nvme_io_cmd(ctrl, req);
+		} else {
+			status = nvme_admin_cmd(ctrl, req);
+		}
+		if (status != NVME_SC_PENDING) {
+			nvme_req_done(req, status);
+		}
+
+		vmm_spin_lock_irqsave(&sq->lock, flags);
+	}
+
+	sq->busy = FALSE;
+
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+}
+
+static void nvme_sq_doorbell(struct nvme_ctrl *ctrl, u16 qid, u32 tail)
+{
+	bool kick = FALSE;
+	irq_flags_t flags;
+	struct nvme_sq *sq = &ctrl->sqs[qid];
+
+	vmm_spin_lock_irqsave(&sq->lock, flags);
+	if (sq->valid && (tail < sq->size)) {
+		sq->tail = tail;
+		kick = TRUE;
+	}
+	vmm_spin_unlock_irqrestore(&sq->lock, flags);
+
+	if (kick) {
+		nvme_sq_process(ctrl, sq);
+	}
+}
+
+static void nvme_cq_doorbell(struct nvme_ctrl *ctrl, u16 qid, u32 head)
+{
+	bool kick;
+	u32 posted = 0;
+	irq_flags_t flags;
+	struct nvme_req *req, *next;
+	struct nvme_cq *cq = &ctrl->cqs[qid];
+	struct nvme_sq *sq;
+	struct dlist done;
+
+	INIT_LIST_HEAD(&done);
+
+	vmm_spin_lock_irqsave(&cq->lock, flags);
+	if (!cq->valid || (cq->size <= head)) {
+		vmm_spin_unlock_irqrestore(&cq->lock, flags);
+		return;
+	}
+	cq->head = head;
+	while (!list_empty(&cq->pending) && !nvme_cq_full(cq)) {
+		req = list_first_entry(&cq->pending, struct nvme_req, head);
+		list_del(&req->head);
+		nvme_cq_post(ctrl, cq, &req->cqe);
+		list_add_tail(&req->head, &done);
+		posted++;
+	}
+	vmm_spin_unlock_irqrestore(&cq->lock, flags);
+
+	list_for_each_entry_safe(req, next, &done, head) {
+		list_del(&req->head);
+		sq = req->sq;
+		vmm_spin_lock_irqsave(&sq->lock, flags);
+		kick = nvme_sq_put_req(sq, req);
+		vmm_spin_unlock_irqrestore(&sq->lock, flags);
+		if (kick) {
+			nvme_sq_process(ctrl, sq);
+		}
+	}
+
+	if (posted) {
+		nvme_cq_notify(ctrl, cq);
+	}
+
+	nvme_intx_update(ctrl);
+}
+
+static u32 nvme_reg_read(struct nvme_ctrl *ctrl, u32 offset)
+{
+	u32 ret = 0;
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	switch (offset) {
+	case NVME_REG_CAP:
+		ret = NVME_CAP & 0xffffffff;
+		break;
+	case NVME_REG_CAP + 4:
+		ret = NVME_CAP >> 32;
+		break;
+	case NVME_REG_VS:
+		ret = NVME_VS;
+		break;
+	case NVME_REG_INTMS:
+	case NVME_REG_INTMC:
+		ret = ctrl->intms;
+		break;
+	case NVME_REG_CC:
+		ret = ctrl->cc;
+		break;
+	case NVME_REG_CSTS:
+		ret = ctrl->csts;
+		break;
+	case NVME_REG_AQA:
+		ret = ctrl->aqa;
+		break;
+	case NVME_REG_ASQ:
+		ret = ctrl->asq & 0xffffffff;
+		break;
+	case NVME_REG_ASQ + 4:
+		ret = ctrl->asq >> 32;
+		break;
+	case NVME_REG_ACQ:
+		ret = ctrl->acq & 0xffffffff;
+		break;
+	case NVME_REG_ACQ + 4:
+		ret = ctrl->acq >> 32;
+		break;
+	default:
+		break;
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	return ret;
+}
+
+/* Must be called with controller lock held */
+static void nvme_cc_write(struct nvme_ctrl *ctrl, u32 val)
+{
+	u32 old = ctrl->cc;
+
+	ctrl->cc = val;
+
+	if (!(old & NVME_CC_EN) && (val & NVME_CC_EN)) {
+		if (nvme_ctrl_enable(ctrl)) {
+			ctrl->csts |= NVME_CSTS_CFS;
+		} else {
+			ctrl->csts |= NVME_CSTS_RDY;
+		}
+	} else if ((old & NVME_CC_EN) && !(val & NVME_CC_EN)) {
+		nvme_ctrl_reset(ctrl);
+	}
+
+	if (NVME_CC_SHN(val) && !NVME_CC_SHN(old)) {
+		vmm_vdisk_flush_cache(ctrl->vdisk);
+		ctrl->csts &= ~NVME_CSTS_SHST_MASK;
+		ctrl->csts |= NVME_CSTS_SHST_CMPLT;
+	} else if (!NVME_CC_SHN(val)) {
+		ctrl->csts &= ~NVME_CSTS_SHST_MASK;
+	}
+}
+
+static void nvme_reg_write(struct nvme_ctrl *ctrl, u32 offset, u32 val)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+
+	switch (offset) {
+	case NVME_REG_INTMS:
+		ctrl->intms |= val;
+		break;
+	case NVME_REG_INTMC:
+		ctrl->intms &= ~val;
+		break;
+	case NVME_REG_CC:
+		nvme_cc_write(ctrl, val);
+		break;
+	case NVME_REG_AQA:
+		ctrl->aqa = val & 0x0fff0fff;
+		break;
+	case NVME_REG_ASQ:
+		ctrl->asq = (ctrl->asq & ~0xffffffffULL) |
+			    (val & ~(NVME_PAGE_SIZE - 1));
+		break;
+	case NVME_REG_ASQ + 4:
+		ctrl->asq = (ctrl->asq & 0xffffffffULL) | ((u64)val << 32);
+		break;
+	case NVME_REG_ACQ:
+		ctrl->acq = (ctrl->acq & ~0xffffffffULL) |
+			    (val & ~(NVME_PAGE_SIZE - 1));
+		break;
+	case NVME_REG_ACQ + 4:
+		ctrl->acq = (ctrl->acq & 0xffffffffULL) | ((u64)val << 32);
+		break;
+	default:
+		break;
+	}
+
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	if ((offset == NVME_REG_INTMS) || (offset == NVME_REG_INTMC) ||
+	    (offset == NVME_REG_CC)) {
+		nvme_intx_update(ctrl);
+	}
+}
+
+static int nvme_read(struct nvme_ctrl *ctrl,
+		     u32 offset, u32 *dst, u32 size)
+{
+	int rc;
+	u32 shift = (offset & 0x3) * 8;
+
+	if (NVME_MSIX_TABLE_OFFSET <= offset) {
+		rc = pci_emu_msix_bar_read(ctrl->pdev, ctrl->barnum,
+					   offset, dst, size);
+		if (rc != VMM_ENOTAVAIL) {
+			return rc;
+		}
+		*dst = 0;
+		return VMM_OK;
+	}
+
+	if (NVME_DB_OFFSET <= offset) {
+		/* Doorbells are write only */
+		*dst = 0;
+		return VMM_OK;
+	}
+
+	*dst = nvme_reg_read(ctrl, offset & ~0x3) >> shift;
+
+	return VMM_OK;
+}
+
+static int nvme_write(struct nvme_ctrl *ctrl, u32 offset,
+		      u32 regmask, u32 regval, u32 size)
+{
+	int rc;
+	u32 db, val, shift = (offset & 0x3) * 8;
+
+	/* Doorbells are decoded first and only take queue locks */
+	if ((NVME_DB_OFFSET <= offset) && (offset < NVME_MSIX_TABLE_OFFSET)) {
+		db = (offset - NVME_DB_OFFSET) >> 2;
+		if (!(offset & 0x3) && ((db >> 1) < NVME_MAX_QUEUES)) {
+			if (db & 0x1) {
+				nvme_cq_doorbell(ctrl, db >> 1, regval);
+			} else {
+				nvme_sq_doorbell(ctrl, db >> 1, regval);
+			}
+		}
+		return VMM_OK;
+	}
+
+	if (NVME_MSIX_TABLE_OFFSET <= offset) {
+		rc = pci_emu_msix_bar_write(ctrl->pdev, ctrl->barnum,
+					    offset, regval, size);
+		return (rc == VMM_ENOTAVAIL) ? VMM_OK : rc;
+	}
+
+	val = nvme_reg_read(ctrl, offset & ~0x3);
+	val &= ~(~regmask << shift);
+	val |= (regval & ~regmask) << shift;
+	nvme_reg_write(ctrl, offset & ~0x3, val);
+
+	return VMM_OK;
+}
+
+static int nvme_bar_read8(struct vmm_emudev *edev,
+			  physical_addr_t offset,
+			  u8 *dst)
+{
+	int rc;
+	u32 regval = 0x0;
+
+	rc = nvme_read(edev->priv, offset, &regval, 1);
+	if (!rc) {
+		*dst = regval & 0xFF;
+	}
+
+	return rc;
+}
+
+static int nvme_bar_read16(struct vmm_emudev *edev,
+			   physical_addr_t offset,
+			   u16 *dst)
+{
+	int rc;
+	u32 regval = 0x0;
+
+	rc = nvme_read(edev->priv, offset, &regval, 2);
+	if (!rc) {
+		*dst = regval & 0xFFFF;
+	}
+
+	return rc;
+}
+
+static int nvme_bar_read32(struct vmm_emudev *edev,
+			   physical_addr_t offset,
+			   u32 *dst)
+{
+	return nvme_read(edev->priv, offset, dst, 4);
+}
+
+static int nvme_bar_read64(struct vmm_emudev *edev,
+			   physical_addr_t offset,
+			   u64 *dst)
+{
+	int rc;
+	u32 lo = 0x0, hi = 0x0;
+
+	rc = nvme_read(edev->priv, offset, &lo, 4);
+	if (!rc) {
+		rc = nvme_read(edev->priv, offset + 4, &hi, 4);
+	}
+	if (!rc) {
+		*dst = ((u64)hi << 32) | lo;
+	}
+
+	return rc;
+}
+
+static int nvme_bar_write8(struct vmm_emudev *edev,
+			   physical_addr_t offset,
+			   u8 src)
+{
+	return nvme_write(edev->priv, offset, 0xFFFFFF00, src, 1);
+}
+
+static int nvme_bar_write16(struct vmm_emudev *edev,
+			    physical_addr_t offset,
+			    u16 src)
+{
+	return nvme_write(edev->priv, offset, 0xFFFF0000, src, 2);
+}
+
+static int nvme_bar_write32(struct vmm_emudev *edev,
+			    physical_addr_t offset,
+			    u32 src)
+{
+	return nvme_write(edev->priv, offset, 0x00000000, src, 4);
+}
+
+static int nvme_bar_write64(struct vmm_emudev *edev,
+			    physical_addr_t offset,
+			    u64 src)
+{
+	int rc;
+
+	rc = nvme_write(edev->priv, offset, 0x00000000,
+			src & 0xFFFFFFFF, 4);
+	if (!rc) {
+		rc = nvme_write(edev->priv, offset + 4, 0x00000000,
+				src >> 32, 4);
+	}
+
+	return rc;
+}
+
+static int nvme_bar_reset(struct vmm_emudev *edev)
+{
+	irq_flags_t flags;
+	struct nvme_ctrl *ctrl = edev->priv;
+
+	vmm_spin_lock_irqsave(&ctrl->lock, flags);
+	nvme_ctrl_reset(ctrl);
+	ctrl->cc = 0;
+	ctrl->aqa = 0;
+	ctrl->asq = 0;
+	ctrl->acq = 0;
+	vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+
+	pci_emu_msi_reset(ctrl->pdev);
+	nvme_intx_update(ctrl);
+
+	return VMM_OK;
+}
+
+static void nvme_ctrl_free(struct nvme_ctrl *ctrl)
+{
+	u32 q, i;
+	struct nvme_req *req;
+
+	for (q = 0; q < NVME_MAX_QUEUES; q++) {
+		if (!ctrl->sqs[q].reqs) {
+			continue;
+		}
+		for (i = 0; i < NVME_MAX_SQ_REQS; i++) {
+			req = &ctrl->sqs[q].reqs[i];
+			if (req->state == NVME_REQ_VDISK) {
+				vmm_vdisk_abort_request(ctrl->vdisk, &req->r);
+			}
+			if (req->buf) {
+				vmm_free(req->buf);
+			}
+		}
+		vmm_free(ctrl->sqs[q].reqs);
+	}
+
+	if (ctrl->vdisk) {
+		vmm_vdisk_destroy(ctrl->vdisk);
+	}
+
+	vmm_free(ctrl);
+}
+
+static int nvme_bar_remove(struct vmm_emudev *edev)
+{
+	irq_flags_t flags;
+	struct nvme_ctrl *ctrl = edev->priv;
+
+	if (ctrl) {
+		vmm_spin_lock_irqsave(&ctrl->lock, flags);
+		nvme_ctrl_reset(ctrl);
+		vmm_spin_unlock_irqrestore(&ctrl->lock, flags);
+		pci_emu_msi_cleanup(ctrl->pdev);
+		nvme_ctrl_free(ctrl);
+		edev->priv = NULL;
+	}
+
+	return VMM_OK;
+}
+
+static int nvme_bar_probe(struct vmm_guest *guest,
+			  struct vmm_emudev *edev,
+			  const struct vmm_devtree_nodeid *eid)
+{
+	u32 q;
+	int rc = VMM_OK;
+	const char *attr;
+	struct nvme_ctrl *ctrl;
+
+	/* Registers, doorbells and MSI-X need a memory BAR */
+	if (!vmm_guest_get_region_priv(edev->reg) ||
+	    (edev->reg->flags & VMM_REGION_IO) ||
+	    (edev->reg->phys_size < NVME_BAR_SIZE)) {
+		vmm_printf("%s: %s needs %d bytes memory BAR\n",
+			   __func__, edev->node->name, NVME_BAR_SIZE);
+		return VMM_EINVALID;
+	}
+
+	ctrl = vmm_zalloc(sizeof(struct nvme_ctrl));
+	if (!ctrl) {
+		rc = VMM_ENOMEM;
+		goto nvme_probe_done;
+	}
+
+	ctrl->guest = guest;
+	ctrl->pdev = vmm_guest_get_region_priv(edev->reg);
+	vmm_snprintf(ctrl->name, sizeof(ctrl->name),
+		     "%s/%s", guest->name, edev->node->name);
+	INIT_SPIN_LOCK(&ctrl->lock);
+	INIT_SPIN_LOCK(&ctrl->irq_lock);
+	INIT_TIMER_EVENT(&ctrl->coal_ev, nvme_coal_timer, ctrl);
+	for (q = 0; q < NVME_MAX_QUEUES; q++) {
+		INIT_SPIN_LOCK(&ctrl->sqs[q].lock);
+		INIT_LIST_HEAD(&ctrl->sqs[q].free_reqs);
+		INIT_LIST_HEAD(&ctrl->sqs[q].aer_reqs);
+		INIT_SPIN_LOCK(&ctrl->cqs[q].lock);
+		INIT_LIST_HEAD(&ctrl->cqs[q].pending);
+	}
+	nvme_features_reset(ctrl);
+
+	if (vmm_devtree_read_string(edev->node, "serial", &attr) == VMM_OK) {
+		strncpy(ctrl->serial, attr, NVME_SERIAL_LEN);
+	} else {
+		strncpy(ctrl->serial, edev->node->name, NVME_SERIAL_LEN);
+	}
+
+	rc = vmm_devtree_read_u32_atindex(edev->node,
+					  VMM_DEVTREE_INTERRUPTS_ATTR_NAME,
+					  &ctrl->irq, 0);
+	if (rc) {
+		goto nvme_probe_freestate_fail;
+	}
+
+	rc = vmm_devtree_read_u32(edev->node, "barnum", &ctrl->barnum);
+	if (rc) {
+		goto nvme_probe_freestate_fail;
+	}
+
+	/* Admin queue requests are needed as soon as controller is enabled */
+	rc = nvme_sq_alloc_reqs(ctrl, &ctrl->sqs[0]);
+	if (rc) {
+		goto nvme_probe_freestate_fail;
+	}
+
+	rc = pci_emu_msi_init(ctrl->pdev, NVME_MSI_VECTORS,
+			      NVME_MAX_QUEUES, ctrl->barnum,
+			      NVME_MSIX_TABLE_OFFSET, NVME_MSIX_PBA_OFFSET);
+	if (rc) {
+		goto nvme_probe_freestate_fail;
+	}
+
+	ctrl->vdisk = vmm_vdisk_create(ctrl->name, NVME_LBA_SIZE,
+				       nvme_vdisk_attached,
+				       nvme_vdisk_detached,
+				       nvme_vdisk_completed,
+				       nvme_vdisk_failed,
+				       ctrl);
+	if (!ctrl->vdisk) {
+		rc = VMM_EFAIL;
+		goto nvme_probe_msicleanup_fail;
+	}
+
+	vmm_vdisk_set_qos_from_devtree(ctrl->vdisk, edev->node);
+	if (vmm_devtree_read_string(edev->node, "blkdev", &attr) == VMM_OK) {
+		vmm_vdisk_attach_block_device(ctrl->vdisk, attr);
+	}
+
+	edev->priv = ctrl;
+
+	goto nvme_probe_done;
+
+nvme_probe_msicleanup_fail:
+	pci_emu_msi_cleanup(ctrl->pdev);
+nvme_probe_freestate_fail:
+	nvme_ctrl_free(ctrl);
+nvme_probe_done:
+	return rc;
+}
+
+static int nvme_emulator_reset(struct pci_device *pdev)
+{
+	return VMM_OK;
+}
+
+static int nvme_emulator_probe(struct pci_device *pdev,
+			       struct vmm_guest *guest,
+			       const struct vmm_devtree_nodeid *eid)
+{
+	struct pci_class *class = PCI_DEVICE_TO_CLASS(pdev);
+
+	class->conf_header.vendor_id = NVME_PCI_VENDOR_ID;
+	class->conf_header.device_id = NVME_PCI_DEVICE_ID;
+	class->conf_header.subsystem_vendor_id = NVME_PCI_VENDOR_ID;
+	class->conf_header.subsystem_device_id = NVME_PCI_DEVICE_ID;
+	class->conf_header.class = NVME_PCI_CLASS;
+	class->conf_header.sub_class = NVME_PCI_SUBCLASS;
+	class->conf_header.prog_if = NVME_PCI_PROG_IF;
+	class->conf_header.revision = 0x2;
+	class->conf_header.int_pin = 1;
+
+	pdev->priv = NULL;
+
+	return VMM_OK;
+}
+
+static int nvme_emulator_remove(struct pci_device *pdev)
+{
+	return VMM_OK;
+}
+
+static struct vmm_devtree_nodeid nvme_emuid_table[] = {
+	{
+		.type = "block",
+		.compatible = "nvme,pci",
+	},
+	{ /* end of list */ },
+};
+
+static struct pci_dev_emulator nvme_emulator = {
+	.name = "nvme-pci",
+	.match_table = nvme_emuid_table,
+	.probe = nvme_emulator_probe,
+	.reset = nvme_emulator_reset,
+	.remove = nvme_emulator_remove,
+};
+
+static struct vmm_devtree_nodeid nvme_bar_emuid_table[] = {
+	{
+		.type = "block",
+		.compatible = "nvme,pci,bar",
+	},
+	{ /* end of list */ },
+};
+
+static struct vmm_emulator nvme_bar_emulator = {
+	.name = "nvme-pci-bar",
+	.match_table = nvme_bar_emuid_table,
+	.endian = VMM_DEVEMU_LITTLE_ENDIAN,
+	.probe = nvme_bar_probe,
+	.read8 = nvme_bar_read8,
+	.write8 = nvme_bar_write8,
+	.read16 = nvme_bar_read16,
+	.write16 = nvme_bar_write16,
+	.read32 = nvme_bar_read32,
+	.write32 = nvme_bar_write32,
+	.read64 = nvme_bar_read64,
+	.write64 = nvme_bar_write64,
+	.reset = nvme_bar_reset,
+	.remove = nvme_bar_remove,
+};
+
+static int __init nvme_emulator_init(void)
+{
+	int rc;
+
+	rc = pci_emu_register_device(&nvme_emulator);
+	if (rc) {
+		return rc;
+	}
+
+	rc = vmm_devemu_register_emulator(&nvme_bar_emulator);
+	if (rc) {
+		pci_emu_unregister_device(&nvme_emulator);
+	}
+
+	return rc;
+}
+
+static void __exit nvme_emulator_exit(void)
+{
+	vmm_devemu_unregister_emulator(&nvme_bar_emulator);
+	pci_emu_unregister_device(&nvme_emulator);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+		   MODULE_AUTHOR,
+		   MODULE_LICENSE,
+		   MODULE_IPRIORITY,
+		   MODULE_INIT,
+		   MODULE_EXIT);
@@ -22,4 +22,6 @@
 # */
 
 emulators-objs-$(CONFIG_EMU_BLOCK_VIRTIO)+= block/virtio_blk.o
+emulators-objs-$(CONFIG_EMU_BLOCK_VIRTIO_SCSI)+= block/virtio_scsi.o
+emulators-objs-$(CONFIG_EMU_BLOCK_NVME)+= block/nvme.o
 
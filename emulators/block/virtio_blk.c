@@ -53,6 +53,7 @@
 #define VIRTIO_BLK_NUM_QUEUES		1
 #define VIRTIO_BLK_SECTOR_SIZE		512
 #define VIRTIO_BLK_DISK_SEG_MAX		(VIRTIO_BLK_QUEUE_SIZE - 2)
+#define VIRTIO_BLK_MAX_RANGE_SECTORS	(0xffffffff / VIRTIO_BLK_SECTOR_SIZE)
 
 struct virtio_blk_dev_req {
 	struct vmm_virtio_queue		*vq;
@@ -79,13 +80,22 @@ struct virtio_blk_dev {
 
 static u64 virtio_blk_get_host_features(struct vmm_virtio_device *dev)
 {
-	return	1UL << VMM_VIRTIO_BLK_F_SEG_MAX
+	struct virtio_blk_dev *vbdev = dev->emu_data;
+	u64 features = 1UL << VMM_VIRTIO_BLK_F_SEG_MAX
 		| 1UL << VMM_VIRTIO_BLK_F_BLK_SIZE
 		| 1UL << VMM_VIRTIO_BLK_F_FLUSH
+		| 1UL << VMM_VIRTIO_BLK_F_WRITE_ZEROES
 		| 1UL << VMM_VIRTIO_RING_F_EVENT_IDX;
 #if 0
-		| 1UL << VMM_VIRTIO_RING_F_INDIRECT_DESC;
+	features |= 1UL << VMM_VIRTIO_RING_F_INDIRECT_DESC;
 #endif
+
+	/* Discard only if attached block device can discard */
+	if (vmm_vdisk_can_discard(vbdev->vdisk)) {
+		features |= 1UL << VMM_VIRTIO_BLK_F_DISCARD;
+	}
+
+	return features;
 }
 
 static void virtio_blk_set_guest_features(struct vmm_virtio_device *dev,
@@ -197,6 +207,47 @@ static void virtio_blk_req_done(struct virtio_blk_dev *vbdev,
 	}
 }
 
+static void virtio_blk_config_ranges(struct virtio_blk_dev *vbdev)
+{
+	/* Only one segment per discard or write zeroes request */
+	vbdev->config.max_discard_sectors = VIRTIO_BLK_MAX_RANGE_SECTORS;
+	vbdev->config.max_discard_seg = 1;
+	vbdev->config.discard_sector_alignment = 1;
+	vbdev->config.max_write_zeroes_sectors = VIRTIO_BLK_MAX_RANGE_SECTORS;
+	vbdev->config.max_write_zeroes_seg = 1;
+	vbdev->config.write_zeroes_may_unmap = 0;
+}
+
+static u8 virtio_blk_read_range(struct vmm_virtio_device *dev,
+				struct virtio_blk_dev *vbdev,
+				struct virtio_blk_dev_req *req,
+				u32 iov_cnt, u32 valid_flags,
+				u64 *sector, u32 *len)
+{
+	struct virtio_blk_discard_write_zeroes range;
+
+	if (req->len != sizeof(range)) {
+		return VMM_VIRTIO_BLK_S_UNSUPP;
+	}
+	if (vmm_virtio_iovec_to_buf_read(dev, &vbdev->iov[1], iov_cnt - 2,
+					 &range, sizeof(range)) !=
+							sizeof(range)) {
+		return VMM_VIRTIO_BLK_S_IOERR;
+	}
+	if (range.flags & ~valid_flags) {
+		return VMM_VIRTIO_BLK_S_UNSUPP;
+	}
+	if (!range.num_sectors ||
+	    (VIRTIO_BLK_MAX_RANGE_SECTORS < range.num_sectors)) {
+		return VMM_VIRTIO_BLK_S_IOERR;
+	}
+
+	*sector = range.sector;
+	*len = range.num_sectors * VIRTIO_BLK_SECTOR_SIZE;
+
+	return VMM_VIRTIO_BLK_S_OK;
+}
+
 static void virtio_blk_attached(struct vmm_vdisk *vdisk)
 {
 	struct virtio_blk_dev *vbdev = vmm_vdisk_priv(vdisk);
@@ -207,6 +258,7 @@ static void virtio_blk_attached(struct vmm_vdisk *vdisk)
 	vbdev->config.capacity = vmm_vdisk_capacity(vbdev->vdisk);
 	vbdev->config.seg_max = VIRTIO_BLK_DISK_SEG_MAX,
 	vbdev->config.blk_size = vmm_vdisk_block_size(vbdev->vdisk);
+	virtio_blk_config_ranges(vbdev);
 }
 
 static void virtio_blk_detached(struct vmm_vdisk *vdisk)
@@ -247,8 +299,11 @@ static void virtio_blk_do_io(struct vmm_virtio_device *dev,
 			     struct virtio_blk_dev *vbdev)
 {
 	int rc;
+	u8 status;
+	u64 sector;
 	u16 head, thead;
 	u32 i, iov_cnt, len;
+	enum vmm_vdisk_request_type type;
 	struct virtio_blk_dev_req *req;
 	struct vmm_virtio_queue *vq = &vbdev->vqs[VIRTIO_BLK_IO_QUEUE];
 	struct vmm_virtio_blk_outhdr hdr;
@@ -344,16 +399,44 @@ static void virtio_blk_do_io(struct vmm_virtio_device *dev,
 			break;
 		case VMM_VIRTIO_BLK_T_FLUSH:
 			vmm_vdisk_set_request_type(&req->r,
-						   VMM_VDISK_REQUEST_WRITE);
+						   VMM_VDISK_REQUEST_FLUSH);
+			req->len = 0;
 			DPRINTF("%s: VIRTIO_BLK_T_FLUSH dev=%s\n",
 				__func__, dev->name);
-			if (vmm_vdisk_flush_cache(vbdev->vdisk)) {
-				virtio_blk_req_done(vbdev, req,
-						    VMM_VIRTIO_BLK_S_IOERR);
+			/* Note: Flush is ordered after all writes which
+			 * completed before it hence it is submitted as
+			 * request instead of flushing cache right away.
+			 */
+			vmm_vdisk_submit_request(vbdev->vdisk, &req->r,
+						 VMM_VDISK_REQUEST_FLUSH,
+						 0, NULL, 0);
+			break;
+		case VMM_VIRTIO_BLK_T_DISCARD:
+		case VMM_VIRTIO_BLK_T_WRITE_ZEROES:
+			if (hdr.type == VMM_VIRTIO_BLK_T_DISCARD) {
+				type = VMM_VDISK_REQUEST_DISCARD;
+				status = virtio_blk_read_range(dev, vbdev, req,
+						iov_cnt, 0, &sector, &len);
 			} else {
-				virtio_blk_req_done(vbdev, req,
-						    VMM_VIRTIO_BLK_S_OK);
+				type = VMM_VDISK_REQUEST_WRITE_ZEROES;
+				status = virtio_blk_read_range(dev, vbdev, req,
+					iov_cnt,
+					VMM_VIRTIO_BLK_WRITE_ZEROES_FLAG_UNMAP,
+					&sector, &len);
 			}
+			vmm_vdisk_set_request_type(&req->r, type);
+			req->len = 0;
+			if (status != VMM_VIRTIO_BLK_S_OK) {
+				virtio_blk_req_done(vbdev, req, status);
+				continue;
+			}
+			DPRINTF("%s: VIRTIO_BLK_T_%s dev=%s "
+				"sector=%"PRIu64" len=%d\n", __func__,
+				(type == VMM_VDISK_REQUEST_DISCARD) ?
+				"DISCARD" : "WRITE_ZEROES",
+				dev->name, sector, len);
+			vmm_vdisk_submit_request(vbdev->vdisk, &req->r,
+						 type, sector, NULL, len);
 			break;
 		case VMM_VIRTIO_BLK_T_GET_ID:
 			vmm_vdisk_set_request_type(&req->r,
@@ -498,6 +581,7 @@ static int virtio_blk_connect(struct vmm_virtio_device *dev,
 	vbdev->config.capacity = 0;
 	vbdev->config.seg_max = VIRTIO_BLK_DISK_SEG_MAX,
 	vbdev->config.blk_size = VIRTIO_BLK_SECTOR_SIZE;
+	virtio_blk_config_ranges(vbdev);
 
 	vbdev->vdisk = vmm_vdisk_create(dev->name, VIRTIO_BLK_SECTOR_SIZE,
 					virtio_blk_attached,
@@ -510,7 +594,8 @@ static int virtio_blk_connect(struct vmm_virtio_device *dev,
 		return VMM_EFAIL;
 	}
 
-	/* Attach block device */
+	/* Apply QoS limits and attach block device */
+	vmm_vdisk_set_qos_from_devtree(vbdev->vdisk, dev->edev->node);
 	if (vmm_devtree_read_string(dev->edev->node,
 				    "blkdev", &attr) == VMM_OK) {
                 vmm_vdisk_attach_block_device(vbdev->vdisk, attr);
@@ -0,0 +1,1547 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file virtio_scsi.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief VirtIO based SCSI host Emulator.
+ *
+ * The emulated SCSI host has a grid of targets and LUNs where each LUN
+ * is backed by its own virtual disk named "<device_name>:<target>:<lun>".
+ * The grid and request queues are described by following attributes of
+ * the emulated device node:
+ *   num_queues  - number of request queues (default: 1)
+ *   num_targets - number of targets (default: 1)
+ *   num_luns    - number of LUNs per target (default: 1)
+ *   blkdev      - block devices for LUNs in target-major order where
+ *                 an empty string leaves the LUN without block device
+ *
+ * Commands are executed asynchronously so multiple commands can be in
+ * flight on each LUN and complete out of order. All task attributes are
+ * treated as SIMPLE. Task management functions never cancel submitted
+ * I/O instead they complete after I/O of the affected LUNs has drained.
+ * Attaching or detaching block device of a LUN is reported to the guest
+ * as a hotplug event.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_delay.h>
+#include <vmm_spinlocks.h>
+#include <vmm_modules.h>
+#include <vmm_devtree.h>
+#include <vmm_devemu.h>
+#include <vmm_guest_aspace.h>
+#include <vio/vmm_vdisk.h>
+#include <vio/vmm_virtio.h>
+#include <vio/vmm_virtio_scsi.h>
+#include <libs/list.h>
+#include <libs/scsi.h>
+#include <libs/stringlib.h>
+#include <libs/unaligned.h>
+
+#undef DEBUG
+
+#ifdef DEBUG
+#define DPRINTF(msg...)			vmm_printf(msg)
+#else
+#define DPRINTF(msg...)
+#endif
+
+#define MODULE_DESC			"VirtIO SCSI Emulator"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(VMM_VIRTIO_IPRIORITY + 1)
+#define MODULE_INIT			virtio_scsi_init
+#define MODULE_EXIT			virtio_scsi_exit
+
+#define VIRTIO_SCSI_QUEUE_SIZE		128
+#define VIRTIO_SCSI_CONTROL_QUEUE	0
+#define VIRTIO_SCSI_EVENT_QUEUE		1
+#define VIRTIO_SCSI_REQUEST_QUEUE	2
+#define VIRTIO_SCSI_MAX_REQUEST_QUEUES	16
+#define VIRTIO_SCSI_MAX_TARGETS		256
+#define VIRTIO_SCSI_MAX_LUN_SLOTS	256
+#define VIRTIO_SCSI_ALL_LUNS		0xFFFFFFFF
+#define VIRTIO_SCSI_SECTOR_SIZE		512
+#define VIRTIO_SCSI_SEG_MAX		(VIRTIO_SCSI_QUEUE_SIZE - 2)
+#define VIRTIO_SCSI_MAX_SECTORS		2048
+#define VIRTIO_SCSI_MAX_UNMAP_DESC	64
+#define VIRTIO_SCSI_MAX_UNMAP_SECTORS	(0xFFFFFFFF / VIRTIO_SCSI_SECTOR_SIZE)
+#define VIRTIO_SCSI_MAX_EVENTS		16
+#define VIRTIO_SCSI_MAX_CDB_SIZE	256
+#define VIRTIO_SCSI_MAX_SENSE_SIZE	256
+#define VIRTIO_SCSI_SENSE_LEN		18
+#define VIRTIO_SCSI_EMU_BUF_SIZE	4096
+
+#define VIRTIO_SCSI_VENDOR		"Xvisor  "
+#define VIRTIO_SCSI_PRODUCT		"VirtIO SCSI Disk"
+#define VIRTIO_SCSI_REVISION		"1.0 "
+
+/* Force unit access bit of WRITE(10) and WRITE(16) */
+#define VIRTIO_SCSI_CDB_FUA		0x08
+
+/* Additional sense codes */
+#define VIRTIO_SCSI_ASC_WRITE_ERROR	0x0C
+#define VIRTIO_SCSI_ASC_READ_ERROR	0x11
+#define VIRTIO_SCSI_ASC_INVALID_OPCODE	0x20
+#define VIRTIO_SCSI_ASC_LBA_OUT_OF_RANGE 0x21
+#define VIRTIO_SCSI_ASC_INVALID_FIELD	0x24
+#define VIRTIO_SCSI_ASC_LUN_NOT_SUPPORTED 0x25
+#define VIRTIO_SCSI_ASC_INVALID_PARAM	0x26
+
+struct virtio_scsi_dev;
+
+struct virtio_scsi_lun {
+	struct virtio_scsi_dev		*vsdev;
+	u32				target;
+	u32				lun;
+	struct vmm_vdisk		*vdisk;
+	bool				present;
+	u32				inflight;
+};
+
+struct virtio_scsi_req {
+	struct dlist			head;
+	struct virtio_scsi_lun		*lun;
+	u32				queue;
+	u32				gen;
+	u16				vhead;
+	struct vmm_virtio_iovec		*iov;
+	u32				rd_cnt;
+	u32				rd_len;
+	u32				wr_cnt;
+	u32				wr_len;
+
+	/* SCSI command state */
+	u32				req_len;
+	u32				resp_len;
+	u8				cdb[VMM_VIRTIO_SCSI_CDB_DEFAULT_SIZE];
+	u8				response;
+	u8				status;
+	u8				sense[VIRTIO_SCSI_SENSE_LEN];
+	u32				sense_len;
+	bool				data_in;
+	u32				xfer;
+	void				*data;
+	struct vmm_vdisk_request	r;
+
+	/* UNMAP descriptors still to be discarded */
+	u32				unmap_idx;
+	u32				unmap_cnt;
+	u64				unmap_lba;
+	u32				unmap_nb;
+
+	/* Task management state */
+	u32				tmf_target;
+	u32				tmf_lun;
+};
+
+struct virtio_scsi_queue {
+	vmm_spinlock_t			lock;
+	u32				gen;
+	struct vmm_virtio_queue		vq;
+	struct vmm_virtio_iovec		iov[VIRTIO_SCSI_QUEUE_SIZE];
+};
+
+struct virtio_scsi_dev {
+	struct vmm_virtio_device 	*vdev;
+
+	u32				num_queues;
+	struct virtio_scsi_queue	*queues;
+	u64 				features;
+
+	struct vmm_virtio_scsi_config 	config;
+
+	u32				num_targets;
+	u32				num_luns;
+	struct virtio_scsi_lun		*luns;
+
+	/* Protects inflight counts, pending TMFs and pending events */
+	vmm_spinlock_t			lock;
+	struct dlist			tmf_list;
+	struct vmm_virtio_scsi_event	events[VIRTIO_SCSI_MAX_EVENTS];
+	u32				events_head;
+	u32				events_count;
+	bool				events_missed;
+};
+
+static u64 virtio_scsi_get_host_features(struct vmm_virtio_device *dev)
+{
+	return	1UL << VMM_VIRTIO_SCSI_F_HOTPLUG
+		| 1UL << VMM_VIRTIO_RING_F_EVENT_IDX;
+}
+
+static void virtio_scsi_set_guest_features(struct vmm_virtio_device *dev,
+					   u32 select, u32 features)
+{
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+
+	if (1 < select)
+		return;
+
+	vsdev->features &= ~((u64)UINT_MAX << (select * 32));
+	vsdev->features |= ((u64)features << (select * 32));
+}
+
+static int virtio_scsi_init_vq(struct vmm_virtio_device *dev,
+			       u32 vq, u32 page_size, u32 align,
+			       u32 pfn)
+{
+	int rc;
+	irq_flags_t flags;
+	struct virtio_scsi_queue *q;
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+
+	if (vsdev->num_queues <= vq) {
+		return VMM_EINVALID;
+	}
+	q = &vsdev->queues[vq];
+
+	vmm_spin_lock_irqsave(&q->lock, flags);
+	rc = vmm_virtio_queue_setup(&q->vq, dev->guest,
+			pfn, page_size, VIRTIO_SCSI_QUEUE_SIZE, align);
+	vmm_spin_unlock_irqrestore(&q->lock, flags);
+
+	return rc;
+}
+
+static int virtio_scsi_get_pfn_vq(struct vmm_virtio_device *dev, u32 vq)
+{
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+
+	if (vsdev->num_queues <= vq) {
+		return VMM_EINVALID;
+	}
+
+	return vmm_virtio_queue_guest_pfn(&vsdev->queues[vq].vq);
+}
+
+static int virtio_scsi_get_size_vq(struct vmm_virtio_device *dev, u32 vq)
+{
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+
+	return (vq < vsdev->num_queues) ? VIRTIO_SCSI_QUEUE_SIZE : 0;
+}
+
+static int virtio_scsi_set_size_vq(struct vmm_virtio_device *dev,
+				   u32 vq, int size)
+{
+	/* FIXME: dynamic */
+	return size;
+}
+
+static u32 virtio_scsi_iov_rw(struct virtio_scsi_dev *vsdev,
+			      struct vmm_virtio_iovec *iov, u32 iov_cnt,
+			      u32 off, void *buf, u32 len, bool write)
+{
+	u32 i, pos = 0, chunk, ret;
+	struct vmm_guest *guest = vsdev->vdev->guest;
+
+	for (i = 0; (i < iov_cnt) && (pos < len); i++) {
+		if (iov[i].len <= off) {
+			off -= iov[i].len;
+			continue;
+		}
+
+		chunk = min(iov[i].len - off, len - pos);
+		if (write) {
+			ret = vmm_guest_memory_write(guest, iov[i].addr + off,
+						     buf + pos, chunk, TRUE);
+		} else {
+			ret = vmm_guest_memory_read(guest, iov[i].addr + off,
+						    buf + pos, chunk, TRUE);
+		}
+		pos += ret;
+		if (ret != chunk) {
+			break;
+		}
+		off = 0;
+	}
+
+	return pos;
+}
+
+static inline void virtio_scsi_encode_lun(u8 *addr, u32 target, u32 lun)
+{
+	memset(addr, 0, 8);
+	addr[0] = 1;
+	addr[1] = target;
+	addr[2] = 0x40 | ((lun >> 8) & 0x3F);
+	addr[3] = lun & 0xFF;
+}
+
+static bool virtio_scsi_decode_lun(struct virtio_scsi_dev *vsdev,
+				   const u8 *addr, u32 *target, u32 *lun)
+{
+	if ((addr[0] != 1) || (vsdev->num_targets <= addr[1])) {
+		return FALSE;
+	}
+
+	*target = addr[1];
+	*lun = ((addr[2] << 8) | addr[3]) & 0x3FFF;
+
+	return TRUE;
+}
+
+static struct virtio_scsi_lun *virtio_scsi_get_lun(
+					struct virtio_scsi_dev *vsdev,
+					u32 target, u32 lun)
+{
+	if (vsdev->num_luns <= lun) {
+		return NULL;
+	}
+
+	return &vsdev->luns[target * vsdev->num_luns + lun];
+}
+
+static void virtio_scsi_req_free(struct virtio_scsi_req *req)
+{
+	if (req->data) {
+		vmm_free(req->data);
+	}
+	vmm_free(req);
+}
+
+/* Write response and data-in to the guest then release the request */
+static void virtio_scsi_req_done(struct virtio_scsi_dev *vsdev,
+				 struct virtio_scsi_req *req,
+				 void *resp, u32 resp_len, u32 data_len)
+{
+	bool signal = FALSE;
+	irq_flags_t flags;
+	struct vmm_virtio_device *dev = vsdev->vdev;
+	struct virtio_scsi_queue *q = &vsdev->queues[req->queue];
+	struct vmm_virtio_iovec *wr_iov = &req->iov[req->rd_cnt];
+
+	/* Stale requests from before device reset are just dropped */
+	if (req->gen == q->gen) {
+		if (data_len) {
+			virtio_scsi_iov_rw(vsdev, wr_iov, req->wr_cnt,
+					   req->resp_len, req->data,
+					   data_len, TRUE);
+		}
+		if (resp_len) {
+			virtio_scsi_iov_rw(vsdev, wr_iov, req->wr_cnt,
+					   0, resp, resp_len, TRUE);
+		}
+	}
+
+	vmm_spin_lock_irqsave(&q->lock, flags);
+	if (req->gen == q->gen) {
+		vmm_virtio_queue_set_used_elem(&q->vq, req->vhead,
+				(resp_len) ? req->resp_len + data_len : 0);
+		signal = vmm_virtio_queue_should_signal(&q->vq);
+	}
+	vmm_spin_unlock_irqrestore(&q->lock, flags);
+
+	if (signal) {
+		dev->tra->notify(dev, req->queue);
+	}
+
+	virtio_scsi_req_free(req);
+}
+
+static void virtio_scsi_cmd_done(struct virtio_scsi_dev *vsdev,
+				 struct virtio_scsi_req *req)
+{
+	u32 buf_len, data_len = 0;
+	struct vmm_virtio_scsi_cmd_resp resp;
+
+	buf_len = (req->data_in) ? req->wr_len - req->resp_len :
+				   req->rd_len - req->req_len;
+
+	memset(&resp, 0, sizeof(resp));
+	resp.response = req->response;
+	resp.resid = buf_len;
+	if (req->response == VMM_VIRTIO_SCSI_S_OK) {
+		resp.status = req->status;
+		if (req->status == S_GOOD) {
+			resp.resid = buf_len - req->xfer;
+			data_len = (req->data_in) ? req->xfer : 0;
+		}
+		resp.sense_len = min(req->sense_len,
+				req->resp_len - (u32)offsetof(
+				struct vmm_virtio_scsi_cmd_resp, sense));
+		memcpy(resp.sense, req->sense, resp.sense_len);
+	}
+
+	virtio_scsi_req_done(vsdev, req, &resp,
+			     min(req->resp_len, (u32)sizeof(resp)), data_len);
+}
+
+static void virtio_scsi_set_sense(struct virtio_scsi_req *req,
+				  u8 key, u8 asc, u8 ascq)
+{
+	memset(req->sense, 0, sizeof(req->sense));
+	req->sense[0] = 0x70;
+	req->sense[2] = key;
+	req->sense[7] = VIRTIO_SCSI_SENSE_LEN - 8;
+	req->sense[12] = asc;
+	req->sense[13] = ascq;
+	req->sense_len = VIRTIO_SCSI_SENSE_LEN;
+	req->status = S_CHECK_COND;
+}
+
+static bool virtio_scsi_tmf_busy(struct virtio_scsi_dev *vsdev,
+				 struct virtio_scsi_req *req)
+{
+	u32 l;
+
+	if (req->tmf_lun != VIRTIO_SCSI_ALL_LUNS) {
+		return (virtio_scsi_get_lun(vsdev, req->tmf_target,
+					    req->tmf_lun)->inflight) ?
+			TRUE : FALSE;
+	}
+
+	for (l = 0; l < vsdev->num_luns; l++) {
+		if (virtio_scsi_get_lun(vsdev, req->tmf_target, l)->inflight) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void virtio_scsi_tmf_done(struct virtio_scsi_dev *vsdev,
+				 struct virtio_scsi_req *req, u8 response)
+{
+	struct vmm_virtio_scsi_ctrl_tmf_resp resp;
+
+	resp.response = response;
+	req->resp_len = sizeof(resp);
+	virtio_scsi_req_done(vsdev, req, &resp, sizeof(resp), 0);
+}
+
+static void virtio_scsi_lun_get(struct virtio_scsi_dev *vsdev,
+				struct virtio_scsi_lun *lun)
+{
+	irq_flags_t flags;
+
+	vmm_spin_lock_irqsave(&vsdev->lock, flags);
+	lun->inflight++;
+	vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+}
+
+static void virtio_scsi_lun_put(struct virtio_scsi_dev *vsdev,
+				struct virtio_scsi_lun *lun)
+{
+	irq_flags_t flags;
+	struct dlist done;
+	struct virtio_scsi_req *req, *nreq;
+
+	INIT_LIST_HEAD(&done);
+
+	vmm_spin_lock_irqsave(&vsdev->lock, flags);
+	lun->inflight--;
+	if (!lun->inflight) {
+		list_for_each_entry_safe(req, nreq, &vsdev->tmf_list, head) {
+			if (!virtio_scsi_tmf_busy(vsdev, req)) {
+				list_del(&req->head);
+				list_add_tail(&req->head, &done);
+			}
+		}
+	}
+	vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+
+	list_for_each_entry_safe(req, nreq, &done, head) {
+		list_del(&req->head);
+		virtio_scsi_tmf_done(vsdev, req, VMM_VIRTIO_SCSI_S_OK);
+	}
+}
+
+static void virtio_scsi_push_events(struct virtio_scsi_dev *vsdev)
+{
+	int rc;
+	bool signal = FALSE;
+	u16 head, thead;
+	u32 iov_cnt, len;
+	irq_flags_t flags;
+	struct vmm_virtio_scsi_event ev;
+	struct vmm_virtio_device *dev = vsdev->vdev;
+	struct virtio_scsi_queue *q = &vsdev->queues[VIRTIO_SCSI_EVENT_QUEUE];
+
+	vmm_spin_lock_irqsave(&vsdev->lock, flags);
+	vmm_spin_lock(&q->lock);
+
+	while ((vsdev->events_count || vsdev->events_missed) &&
+	       vmm_virtio_queue_available(&q->vq)) {
+		thead = vmm_virtio_queue_pop(&q->vq);
+		rc = vmm_virtio_queue_get_head_iovec(&q->vq, thead, q->iov,
+						     &iov_cnt, &len, &head);
+		if (rc) {
+			vmm_printf("%s: failed to get iovec (error %d)\n",
+				   __func__, rc);
+			continue;
+		}
+
+		if (vsdev->events_count) {
+			memcpy(&ev, &vsdev->events[vsdev->events_head],
+			       sizeof(ev));
+			vsdev->events_head = (vsdev->events_head + 1) %
+						VIRTIO_SCSI_MAX_EVENTS;
+			vsdev->events_count--;
+		} else {
+			memset(&ev, 0, sizeof(ev));
+			ev.event = VMM_VIRTIO_SCSI_T_NO_EVENT;
+		}
+		if (vsdev->events_missed) {
+			ev.event |= VMM_VIRTIO_SCSI_T_EVENTS_MISSED;
+			vsdev->events_missed = FALSE;
+		}
+
+		len = vmm_virtio_buf_to_iovec_write(dev, q->iov, iov_cnt,
+						    &ev, sizeof(ev));
+		vmm_virtio_queue_set_used_elem(&q->vq, head, len);
+		if (vmm_virtio_queue_should_signal(&q->vq)) {
+			signal = TRUE;
+		}
+	}
+
+	vmm_spin_unlock(&q->lock);
+	vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+
+	if (signal) {
+		dev->tra->notify(dev, VIRTIO_SCSI_EVENT_QUEUE);
+	}
+}
+
+static void virtio_scsi_post_event(struct virtio_scsi_dev *vsdev,
+				   struct virtio_scsi_lun *lun,
+				   u32 event, u32 reason)
+{
+	irq_flags_t flags;
+	struct vmm_virtio_scsi_event *ev;
+
+	if (!(vsdev->features & (1UL << VMM_VIRTIO_SCSI_F_HOTPLUG))) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave(&vsdev->lock, flags);
+	if (vsdev->events_count < VIRTIO_SCSI_MAX_EVENTS) {
+		ev = &vsdev->events[(vsdev->events_head +
+				     vsdev->events_count) %
+				    VIRTIO_SCSI_MAX_EVENTS];
+		ev->event = event;
+		virtio_scsi_encode_lun(ev->lun, lun->target, lun->lun);
+		ev->reason = reason;
+		vsdev->events_count++;
+	} else {
+		vsdev->events_missed = TRUE;
+	}
+	vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+
+	virtio_scsi_push_events(vsdev);
+}
+
+static void virtio_scsi_attached(struct vmm_vdisk *vdisk)
+{
+	struct virtio_scsi_lun *lun = vmm_vdisk_priv(vdisk);
+
+	DPRINTF("%s: vdisk=%s\n",
+		__func__, vmm_vdisk_name(vdisk));
+
+	lun->present = TRUE;
+	virtio_scsi_post_event(lun->vsdev, lun,
+			       VMM_VIRTIO_SCSI_T_TRANSPORT_RESET,
+			       VMM_VIRTIO_SCSI_EVT_RESET_RESCAN);
+}
+
+static void virtio_scsi_detached(struct vmm_vdisk *vdisk)
+{
+	struct virtio_scsi_lun *lun = vmm_vdisk_priv(vdisk);
+
+	DPRINTF("%s: vdisk=%s\n",
+		__func__, vmm_vdisk_name(vdisk));
+
+	lun->present = FALSE;
+	virtio_scsi_post_event(lun->vsdev, lun,
+			       VMM_VIRTIO_SCSI_T_TRANSPORT_RESET,
+			       VMM_VIRTIO_SCSI_EVT_RESET_REMOVED);
+}
+
+/* Returns TRUE when next chunk of UNMAP was submitted to virtual disk */
+static bool virtio_scsi_unmap_next(struct virtio_scsi_req *req)
+{
+	u8 *desc;
+	u64 lba;
+	u32 nb;
+	struct virtio_scsi_lun *lun = req->lun;
+
+	while (!req->unmap_nb) {
+		if (req->unmap_idx == req->unmap_cnt) {
+			return FALSE;
+		}
+		desc = (u8 *)req->data + 8 + req->unmap_idx++ * 16;
+		req->unmap_lba = get_unaligned_be64(&desc[0]);
+		req->unmap_nb = get_unaligned_be32(&desc[8]);
+	}
+
+	lba = req->unmap_lba;
+	nb = min(req->unmap_nb, (u32)VIRTIO_SCSI_MAX_UNMAP_SECTORS);
+	req->unmap_lba += nb;
+	req->unmap_nb -= nb;
+
+	virtio_scsi_lun_get(lun->vsdev, lun);
+	vmm_vdisk_submit_request(lun->vdisk, &req->r,
+				 VMM_VDISK_REQUEST_DISCARD,
+				 lba, NULL, nb * VIRTIO_SCSI_SECTOR_SIZE);
+
+	return TRUE;
+}
+
+static void virtio_scsi_req_completed(struct vmm_vdisk *vdisk,
+				      struct vmm_vdisk_request *vreq)
+{
+	struct virtio_scsi_lun *lun = vmm_vdisk_priv(vdisk);
+	struct virtio_scsi_req *req =
+			container_of(vreq, struct virtio_scsi_req, r);
+
+	DPRINTF("%s: vdisk=%s\n",
+		__func__, vmm_vdisk_name(vdisk));
+
+	if (!req->unmap_cnt || !virtio_scsi_unmap_next(req)) {
+		virtio_scsi_cmd_done(lun->vsdev, req);
+	}
+	virtio_scsi_lun_put(lun->vsdev, lun);
+}
+
+static void virtio_scsi_req_failed(struct vmm_vdisk *vdisk,
+				   struct vmm_vdisk_request *vreq)
+{
+	struct virtio_scsi_lun *lun = vmm_vdisk_priv(vdisk);
+	struct virtio_scsi_req *req =
+			container_of(vreq, struct virtio_scsi_req, r);
+
+	DPRINTF("%s: vdisk=%s\n",
+		__func__, vmm_vdisk_name(vdisk));
+
+	virtio_scsi_set_sense(req, SENSE_MEDIUM_ERROR,
+			      (req->data_in) ? VIRTIO_SCSI_ASC_READ_ERROR :
+					       VIRTIO_SCSI_ASC_WRITE_ERROR, 0);
+	virtio_scsi_cmd_done(lun->vsdev, req);
+	virtio_scsi_lun_put(lun->vsdev, lun);
+}
+
+static int virtio_scsi_inquiry(struct virtio_scsi_req *req, u8 *buf)
+{
+	u32 len;
+	const char *name;
+	struct virtio_scsi_lun *lun = req->lun;
+	static const u8 pages[] = { 0x00, 0x80, 0x83, 0xB0, 0xB2 };
+
+	if (!(req->cdb[1] & 0x01)) {
+		if (req->cdb[2]) {
+			return VMM_EINVALID;
+		}
+
+		/* Standard inquiry data of a SPC-3 disk with CMDQUE */
+		buf[0] = (lun && lun->present) ? 0x00 : 0x7F;
+		buf[2] = 0x05;
+		buf[3] = 0x02;
+		buf[4] = 36 - 5;
+		buf[7] = 0x02;
+		memcpy(&buf[8], VIRTIO_SCSI_VENDOR, 8);
+		memcpy(&buf[16], VIRTIO_SCSI_PRODUCT, 16);
+		memcpy(&buf[32], VIRTIO_SCSI_REVISION, 4);
+		return 36;
+	}
+
+	if (!lun || !lun->present) {
+		return VMM_EINVALID;
+	}
+
+	buf[1] = req->cdb[2];
+	name = vmm_vdisk_name(lun->vdisk);
+	switch (req->cdb[2]) {
+	case 0x00: /* Supported VPD pages */
+		buf[3] = sizeof(pages);
+		memcpy(&buf[4], pages, sizeof(pages));
+		len = 4 + sizeof(pages);
+		break;
+	case 0x80: /* Unit serial number */
+		len = strlen(name);
+		buf[3] = len;
+		memcpy(&buf[4], name, len);
+		len += 4;
+		break;
+	case 0x83: /* Device identification (T10 vendor ID based) */
+		len = 8 + strlen(name);
+		buf[4] = 0x02;
+		buf[5] = 0x01;
+		buf[7] = len;
+		memcpy(&buf[8], VIRTIO_SCSI_VENDOR, 8);
+		memcpy(&buf[16], name, len - 8);
+		put_unaligned_be16(4 + len, &buf[2]);
+		len += 8;
+		break;
+	case 0xB0: /* Block limits */
+		put_unaligned_be16(0x3C, &buf[2]);
+		put_unaligned_be32(VIRTIO_SCSI_MAX_SECTORS, &buf[8]);
+		put_unaligned_be32(0xFFFFFFFF, &buf[20]);
+		put_unaligned_be32(VIRTIO_SCSI_MAX_UNMAP_DESC, &buf[24]);
+		len = 0x40;
+		break;
+	case 0xB2: /* Logical block provisioning (UNMAP supported) */
+		put_unaligned_be16(0x04, &buf[2]);
+		buf[5] = 0x80;
+		len = 8;
+		break;
+	default:
+		return VMM_EINVALID;
+	};
+
+	return len;
+}
+
+static int virtio_scsi_report_luns(struct virtio_scsi_dev *vsdev,
+				   u32 target, u8 *buf)
+{
+	u32 l, n = 0;
+	u8 *p;
+
+	for (l = 0; l < vsdev->num_luns; l++) {
+		if (!virtio_scsi_get_lun(vsdev, target, l)->present) {
+			continue;
+		}
+		p = &buf[8 + n * 8];
+		if (l < 256) {
+			p[1] = l;
+		} else {
+			p[0] = 0x40 | (l >> 8);
+			p[1] = l & 0xFF;
+		}
+		n++;
+	}
+	put_unaligned_be32(n * 8, &buf[0]);
+
+	return 8 + n * 8;
+}
+
+static int virtio_scsi_mode_sense(struct virtio_scsi_req *req, u8 *buf)
+{
+	bool ten = (req->cdb[0] == SCSI_MODE_SEN10) ? TRUE : FALSE;
+	u8 pc = req->cdb[2] >> 6, page = req->cdb[2] & 0x3F;
+	u32 len, hlen = (ten) ? 8 : 4;
+
+	if ((pc == 3) || ((page != 0x08) && (page != 0x3F))) {
+		return VMM_EINVALID;
+	}
+
+	/* DPOFUA set because FUA writes are honoured */
+	buf[(ten) ? 3 : 2] = 0x10;
+
+	/* Caching mode page with write cache enabled */
+	buf[hlen + 0] = 0x08;
+	buf[hlen + 1] = 0x12;
+	buf[hlen + 2] = (pc == 1) ? 0x00 : 0x04;
+	len = hlen + 0x14;
+
+	if (ten) {
+		put_unaligned_be16(len - 2, &buf[0]);
+	} else {
+		buf[0] = len - 1;
+	}
+
+	return len;
+}
+
+static int virtio_scsi_unmap(struct virtio_scsi_dev *vsdev,
+			     struct virtio_scsi_req *req, u8 *buf)
+{
+	u64 lba, cap;
+	u32 i, nb, len, count;
+
+	len = get_unaligned_be16(&req->cdb[7]);
+	len = min(len, req->rd_len - req->req_len);
+	len = min(len, (u32)VIRTIO_SCSI_EMU_BUF_SIZE);
+	if (len < 8) {
+		return VMM_OK;
+	}
+	if (virtio_scsi_iov_rw(vsdev, req->iov, req->rd_cnt, req->req_len,
+			       buf, len, FALSE) != len) {
+		return VMM_EIO;
+	}
+
+	count = min((u32)get_unaligned_be16(&buf[2]), len - 8) / 16;
+	if (VIRTIO_SCSI_MAX_UNMAP_DESC < count) {
+		virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+				      VIRTIO_SCSI_ASC_INVALID_PARAM, 0);
+		return VMM_OK;
+	}
+
+	cap = vmm_vdisk_capacity(req->lun->vdisk);
+	for (i = 0; i < count; i++) {
+		lba = get_unaligned_be64(&buf[8 + i * 16]);
+		nb = get_unaligned_be32(&buf[8 + i * 16 + 8]);
+		if ((cap <= lba) || ((cap - lba) < nb)) {
+			virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+					VIRTIO_SCSI_ASC_LBA_OUT_OF_RANGE, 0);
+			return VMM_OK;
+		}
+	}
+
+	/* Note: When block device can't discard the valid ranges are
+	 * simply retained. This is allowed because we don't report LBPRZ
+	 * hence guest makes no assumption about contents of unmapped blocks.
+	 */
+	if (count && vmm_vdisk_can_discard(req->lun->vdisk)) {
+		req->data_in = FALSE;
+		req->unmap_idx = 0;
+		req->unmap_cnt = count;
+		req->unmap_nb = 0;
+	}
+
+	return VMM_OK;
+}
+
+/* Returns TRUE when command was submitted to virtual disk */
+static bool virtio_scsi_cmd_rw(struct virtio_scsi_dev *vsdev,
+			       struct virtio_scsi_req *req,
+			       bool write, u64 lba, u32 nb)
+{
+	u64 cap;
+	u32 buf_len;
+	enum vmm_vdisk_request_type type;
+	struct virtio_scsi_lun *lun = req->lun;
+
+	req->data_in = (write) ? FALSE : TRUE;
+	if (!nb) {
+		return FALSE;
+	}
+
+	cap = vmm_vdisk_capacity(lun->vdisk);
+	if ((cap <= lba) || ((cap - lba) < nb)) {
+		virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+				      VIRTIO_SCSI_ASC_LBA_OUT_OF_RANGE, 0);
+		return FALSE;
+	}
+	if (VIRTIO_SCSI_MAX_SECTORS < nb) {
+		virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+				      VIRTIO_SCSI_ASC_INVALID_FIELD, 0);
+		return FALSE;
+	}
+
+	buf_len = (write) ? req->rd_len - req->req_len :
+			    req->wr_len - req->resp_len;
+	if (buf_len < (nb * VIRTIO_SCSI_SECTOR_SIZE)) {
+		req->response = VMM_VIRTIO_SCSI_S_OVERRUN;
+		return FALSE;
+	}
+
+	req->xfer = nb * VIRTIO_SCSI_SECTOR_SIZE;
+	req->data = vmm_malloc(req->xfer);
+	if (!req->data) {
+		req->status = S_BUSY;
+		return FALSE;
+	}
+
+	if (write &&
+	    (virtio_scsi_iov_rw(vsdev, req->iov, req->rd_cnt, req->req_len,
+				req->data, req->xfer, FALSE) != req->xfer)) {
+		req->response = VMM_VIRTIO_SCSI_S_FAILURE;
+		return FALSE;
+	}
+
+	DPRINTF("%s: %s dev=%s lba=%"PRIu64" nb=%d\n", __func__,
+		(write) ? "write" : "read", vsdev->vdev->name, lba, nb);
+
+	if (!write) {
+		type = VMM_VDISK_REQUEST_READ;
+	} else if ((req->cdb[0] != SCSI_WRITE6) &&
+		   (req->cdb[1] & VIRTIO_SCSI_CDB_FUA)) {
+		type = VMM_VDISK_REQUEST_WRITE_FUA;
+	} else {
+		type = VMM_VDISK_REQUEST_WRITE;
+	}
+
+	virtio_scsi_lun_get(vsdev, lun);
+
+	/* Note: We will get failed() or complete() callback
+	 * even when no block device attached to virtual disk
+	 */
+	vmm_vdisk_submit_request(lun->vdisk, &req->r, type,
+				 lba, req->data, req->xfer);
+
+	return TRUE;
+}
+
+static void virtio_scsi_handle_cmd(struct virtio_scsi_dev *vsdev,
+				   struct virtio_scsi_req *req)
+{
+	int rc;
+	u64 last_lba;
+	u8 *buf, *cdb = req->cdb;
+	u32 len, target, lunid, alloc_len = 0;
+	struct vmm_virtio_scsi_cmd_req hdr;
+	struct virtio_scsi_lun *lun;
+
+	req->req_len = offsetof(struct vmm_virtio_scsi_cmd_req, cdb) +
+			vsdev->config.cdb_size;
+	req->resp_len = offsetof(struct vmm_virtio_scsi_cmd_resp, sense) +
+			vsdev->config.sense_size;
+	if ((req->rd_len < req->req_len) || (req->wr_len < req->resp_len)) {
+		virtio_scsi_req_done(vsdev, req, NULL, 0, 0);
+		return;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	len = min(req->req_len, (u32)sizeof(hdr));
+	if (virtio_scsi_iov_rw(vsdev, req->iov, req->rd_cnt, 0,
+			       &hdr, len, FALSE) != len) {
+		virtio_scsi_req_done(vsdev, req, NULL, 0, 0);
+		return;
+	}
+	memcpy(cdb, hdr.cdb, sizeof(req->cdb));
+
+	req->response = VMM_VIRTIO_SCSI_S_OK;
+	req->status = S_GOOD;
+	req->data_in = (req->resp_len < req->wr_len) ? TRUE : FALSE;
+
+	if (!virtio_scsi_decode_lun(vsdev, hdr.lun, &target, &lunid)) {
+		req->response = VMM_VIRTIO_SCSI_S_BAD_TARGET;
+		virtio_scsi_cmd_done(vsdev, req);
+		return;
+	}
+	lun = req->lun = virtio_scsi_get_lun(vsdev, target, lunid);
+
+	DPRINTF("%s: dev=%s target=%d lun=%d opcode=0x%02x\n",
+		__func__, vsdev->vdev->name, target, lunid, cdb[0]);
+
+	if ((!lun || !lun->present) &&
+	    (cdb[0] != SCSI_INQUIRY) &&
+	    (cdb[0] != SCSI_REPORT_LUNS) &&
+	    (cdb[0] != SCSI_REQ_SENSE)) {
+		virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+				      VIRTIO_SCSI_ASC_LUN_NOT_SUPPORTED, 0);
+		virtio_scsi_cmd_done(vsdev, req);
+		return;
+	}
+
+	/* Commands emulated in place produce at most one buffer of data */
+	switch (cdb[0]) {
+	case SCSI_INQUIRY:
+	case SCSI_REPORT_LUNS:
+	case SCSI_REQ_SENSE:
+	case SCSI_RD_CAPAC:
+	case SCSI_RD_CAPAC16:
+	case SCSI_MODE_SEN6:
+	case SCSI_MODE_SEN10:
+	case SCSI_UNMAP:
+		req->data = vmm_zalloc(VIRTIO_SCSI_EMU_BUF_SIZE);
+		if (!req->data) {
+			req->status = S_BUSY;
+			virtio_scsi_cmd_done(vsdev, req);
+			return;
+		}
+		break;
+	default:
+		break;
+	};
+	buf = req->data;
+
+	rc = VMM_OK;
+	switch (cdb[0]) {
+	case SCSI_TST_U_RDY:
+	case SCSI_START_STP:
+	case SCSI_MED_REMOVL:
+	case SCSI_VERIFY:
+	case SCSI_VERIFY16:
+		break;
+	case SCSI_INQUIRY:
+		alloc_len = get_unaligned_be16(&cdb[3]);
+		rc = virtio_scsi_inquiry(req, buf);
+		break;
+	case SCSI_REPORT_LUNS:
+		alloc_len = get_unaligned_be32(&cdb[6]);
+		rc = virtio_scsi_report_luns(vsdev, target, buf);
+		break;
+	case SCSI_REQ_SENSE:
+		alloc_len = cdb[4];
+		buf[0] = 0x70;
+		buf[7] = VIRTIO_SCSI_SENSE_LEN - 8;
+		if (!lun || !lun->present) {
+			buf[2] = SENSE_ILLEGAL_REQUEST;
+			buf[12] = VIRTIO_SCSI_ASC_LUN_NOT_SUPPORTED;
+		}
+		rc = VIRTIO_SCSI_SENSE_LEN;
+		break;
+	case SCSI_RD_CAPAC:
+		alloc_len = 8;
+		last_lba = vmm_vdisk_capacity(lun->vdisk) - 1;
+		put_unaligned_be32((last_lba < 0xFFFFFFFFULL) ?
+				   (u32)last_lba : 0xFFFFFFFF, &buf[0]);
+		put_unaligned_be32(VIRTIO_SCSI_SECTOR_SIZE, &buf[4]);
+		rc = 8;
+		break;
+	case SCSI_RD_CAPAC16:
+		if ((cdb[1] & 0x1F) != SCSI_SAI_RD_CAPAC16) {
+			virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+					VIRTIO_SCSI_ASC_INVALID_OPCODE, 0);
+			break;
+		}
+		alloc_len = get_unaligned_be32(&cdb[10]);
+		put_unaligned_be64(vmm_vdisk_capacity(lun->vdisk) - 1,
+				   &buf[0]);
+		put_unaligned_be32(VIRTIO_SCSI_SECTOR_SIZE, &buf[8]);
+		buf[14] = 0x80; /* LBPME */
+		rc = 32;
+		break;
+	case SCSI_MODE_SEN6:
+		alloc_len = cdb[4];
+		rc = virtio_scsi_mode_sense(req, buf);
+		break;
+	case SCSI_MODE_SEN10:
+		alloc_len = get_unaligned_be16(&cdb[7]);
+		rc = virtio_scsi_mode_sense(req, buf);
+		break;
+	case SCSI_SYNC_CACHE:
+	case SCSI_SYNC_CACHE16:
+		req->data_in = FALSE;
+		virtio_scsi_lun_get(vsdev, lun);
+		vmm_vdisk_submit_request(lun->vdisk, &req->r,
+					 VMM_VDISK_REQUEST_FLUSH, 0, NULL, 0);
+		return;
+	case SCSI_UNMAP:
+		rc = virtio_scsi_unmap(vsdev, req, buf);
+		if (req->unmap_cnt && virtio_scsi_unmap_next(req)) {
+			return;
+		}
+		vmm_free(req->data);
+		req->data = NULL;
+		break;
+	case SCSI_READ6:
+	case SCSI_WRITE6:
+		if (virtio_scsi_cmd_rw(vsdev, req, cdb[0] == SCSI_WRITE6,
+				((cdb[1] & 0x1F) << 16) | (cdb[2] << 8) | cdb[3],
+				(cdb[4]) ? cdb[4] : 256)) {
+			return;
+		}
+		break;
+	case SCSI_READ10:
+	case SCSI_WRITE10:
+		if (virtio_scsi_cmd_rw(vsdev, req, cdb[0] == SCSI_WRITE10,
+				       get_unaligned_be32(&cdb[2]),
+				       get_unaligned_be16(&cdb[7]))) {
+			return;
+		}
+		break;
+	case SCSI_READ16:
+	case SCSI_WRITE16:
+		if (virtio_scsi_cmd_rw(vsdev, req, cdb[0] == SCSI_WRITE16,
+				       get_unaligned_be64(&cdb[2]),
+				       get_unaligned_be32(&cdb[10]))) {
+			return;
+		}
+		break;
+	default:
+		DPRINTF("%s: unhandled opcode=0x%02x\n", __func__, cdb[0]);
+		virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+				      VIRTIO_SCSI_ASC_INVALID_OPCODE, 0);
+		break;
+	};
+
+	if (rc == VMM_EINVALID) {
+		virtio_scsi_set_sense(req, SENSE_ILLEGAL_REQUEST,
+				      VIRTIO_SCSI_ASC_INVALID_FIELD, 0);
+	} else if (rc < 0) {
+		req->response = VMM_VIRTIO_SCSI_S_FAILURE;
+	} else if (req->data && (req->status == S_GOOD)) {
+		req->data_in = TRUE;
+		req->xfer = min(min((u32)rc, alloc_len),
+				req->wr_len - req->resp_len);
+	}
+
+	virtio_scsi_cmd_done(vsdev, req);
+}
+
+static void virtio_scsi_handle_tmf(struct virtio_scsi_dev *vsdev,
+				   struct virtio_scsi_req *req)
+{
+	u32 target, lunid;
+	irq_flags_t flags;
+	struct vmm_virtio_scsi_ctrl_tmf_req tmf;
+
+	if ((req->rd_len < sizeof(tmf)) ||
+	    (req->wr_len < sizeof(struct vmm_virtio_scsi_ctrl_tmf_resp)) ||
+	    (virtio_scsi_iov_rw(vsdev, req->iov, req->rd_cnt, 0,
+				&tmf, sizeof(tmf), FALSE) != sizeof(tmf))) {
+		virtio_scsi_req_done(vsdev, req, NULL, 0, 0);
+		return;
+	}
+
+	DPRINTF("%s: dev=%s subtype=%d\n",
+		__func__, vsdev->vdev->name, tmf.subtype);
+
+	if (!virtio_scsi_decode_lun(vsdev, tmf.lun, &target, &lunid)) {
+		virtio_scsi_tmf_done(vsdev, req,
+				     VMM_VIRTIO_SCSI_S_BAD_TARGET);
+		return;
+	}
+	req->tmf_target = target;
+
+	switch (tmf.subtype) {
+	case VMM_VIRTIO_SCSI_T_TMF_ABORT_TASK:
+	case VMM_VIRTIO_SCSI_T_TMF_ABORT_TASK_SET:
+	case VMM_VIRTIO_SCSI_T_TMF_CLEAR_TASK_SET:
+	case VMM_VIRTIO_SCSI_T_TMF_LOGICAL_UNIT_RESET:
+		if (!virtio_scsi_get_lun(vsdev, target, lunid)) {
+			virtio_scsi_tmf_done(vsdev, req,
+					VMM_VIRTIO_SCSI_S_INCORRECT_LUN);
+			return;
+		}
+		req->tmf_lun = lunid;
+		break;
+	case VMM_VIRTIO_SCSI_T_TMF_I_T_NEXUS_RESET:
+		req->tmf_lun = VIRTIO_SCSI_ALL_LUNS;
+		break;
+	default:
+		virtio_scsi_tmf_done(vsdev, req,
+				     VMM_VIRTIO_SCSI_S_FUNCTION_REJECTED);
+		return;
+	};
+
+	/* Complete once I/O of affected LUNs has drained */
+	vmm_spin_lock_irqsave(&vsdev->lock, flags);
+	if (virtio_scsi_tmf_busy(vsdev, req)) {
+		list_add_tail(&req->head, &vsdev->tmf_list);
+		vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+		return;
+	}
+	vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+
+	virtio_scsi_tmf_done(vsdev, req, VMM_VIRTIO_SCSI_S_OK);
+}
+
+static void virtio_scsi_handle_ctrl(struct virtio_scsi_dev *vsdev,
+				    struct virtio_scsi_req *req)
+{
+	u32 type;
+	struct vmm_virtio_scsi_ctrl_an_resp resp;
+
+	if (virtio_scsi_iov_rw(vsdev, req->iov, req->rd_cnt, 0,
+			       &type, sizeof(type), FALSE) != sizeof(type)) {
+		virtio_scsi_req_done(vsdev, req, NULL, 0, 0);
+		return;
+	}
+
+	switch (type) {
+	case VMM_VIRTIO_SCSI_T_TMF:
+		virtio_scsi_handle_tmf(vsdev, req);
+		break;
+	case VMM_VIRTIO_SCSI_T_AN_QUERY:
+	case VMM_VIRTIO_SCSI_T_AN_SUBSCRIBE:
+		if ((req->rd_len <
+			sizeof(struct vmm_virtio_scsi_ctrl_an_req)) ||
+		    (req->wr_len < sizeof(resp))) {
+			virtio_scsi_req_done(vsdev, req, NULL, 0, 0);
+			break;
+		}
+		/* No asynchronous notification is supported */
+		resp.event_actual = 0;
+		resp.response = VMM_VIRTIO_SCSI_S_OK;
+		req->resp_len = sizeof(resp);
+		virtio_scsi_req_done(vsdev, req, &resp, sizeof(resp), 0);
+		break;
+	default:
+		vmm_printf("%s: unhandled type=%d\n", __func__, type);
+		virtio_scsi_req_done(vsdev, req, NULL, 0, 0);
+		break;
+	};
+}
+
+static struct virtio_scsi_req *virtio_scsi_alloc_req(
+					struct virtio_scsi_queue *q,
+					u32 queue, u16 head, u32 iov_cnt)
+{
+	u32 i;
+	struct virtio_scsi_req *req;
+
+	req = vmm_zalloc(sizeof(*req) + iov_cnt * sizeof(*req->iov));
+	if (!req) {
+		return NULL;
+	}
+
+	INIT_LIST_HEAD(&req->head);
+	req->queue = queue;
+	req->gen = q->gen;
+	req->vhead = head;
+	req->iov = (struct vmm_virtio_iovec *)(req + 1);
+	memcpy(req->iov, q->iov, iov_cnt * sizeof(*req->iov));
+
+	/* Device readable buffers must preceed device writable buffers */
+	for (i = 0; i < iov_cnt; i++) {
+		if (req->iov[i].flags) {
+			req->wr_cnt++;
+			req->wr_len += req->iov[i].len;
+		} else if (req->wr_cnt) {
+			vmm_free(req);
+			return NULL;
+		} else {
+			req->rd_cnt++;
+			req->rd_len += req->iov[i].len;
+		}
+	}
+	vmm_vdisk_set_request_type(&req->r, VMM_VDISK_REQUEST_UNKNOWN);
+
+	return req;
+}
+
+static void virtio_scsi_do_queue(struct virtio_scsi_dev *vsdev, u32 queue)
+{
+	int rc;
+	u16 head, thead;
+	u32 iov_cnt, len;
+	irq_flags_t flags;
+	struct virtio_scsi_req *req;
+	struct virtio_scsi_queue *q = &vsdev->queues[queue];
+
+	while (1) {
+		vmm_spin_lock_irqsave(&q->lock, flags);
+
+		if (!vmm_virtio_queue_available(&q->vq)) {
+			vmm_spin_unlock_irqrestore(&q->lock, flags);
+			break;
+		}
+
+		thead = vmm_virtio_queue_pop(&q->vq);
+		rc = vmm_virtio_queue_get_head_iovec(&q->vq, thead, q->iov,
+						     &iov_cnt, &len, &head);
+		if (rc) {
+			vmm_spin_unlock_irqrestore(&q->lock, flags);
+			vmm_printf("%s: failed to get iovec (error %d)\n",
+				   __func__, rc);
+			continue;
+		}
+
+		req = virtio_scsi_alloc_req(q, queue, head, iov_cnt);
+		if (!req) {
+			vmm_virtio_queue_set_used_elem(&q->vq, head, 0);
+		}
+
+		vmm_spin_unlock_irqrestore(&q->lock, flags);
+
+		if (!req) {
+			continue;
+		}
+
+		if (queue == VIRTIO_SCSI_CONTROL_QUEUE) {
+			virtio_scsi_handle_ctrl(vsdev, req);
+		} else {
+			virtio_scsi_handle_cmd(vsdev, req);
+		}
+	}
+}
+
+static int virtio_scsi_notify_vq(struct vmm_virtio_device *dev, u32 vq)
+{
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+
+	DPRINTF("%s: dev=%s vq=%d\n", __func__, dev->name, vq);
+
+	if (vsdev->num_queues <= vq) {
+		return VMM_EINVALID;
+	}
+
+	if (vq == VIRTIO_SCSI_EVENT_QUEUE) {
+		virtio_scsi_push_events(vsdev);
+	} else {
+		virtio_scsi_do_queue(vsdev, vq);
+	}
+
+	return VMM_OK;
+}
+
+static void virtio_scsi_status_changed(struct vmm_virtio_device *dev,
+				       u32 new_status)
+{
+	/* Nothing to do here. */
+}
+
+static int virtio_scsi_read_config(struct vmm_virtio_device *dev,
+				   u32 offset, void *dst, u32 dst_len)
+{
+	u32 i;
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+	u8 *src = (u8 *)&vsdev->config;
+
+	DPRINTF("%s: dev=%s offset=%d dst=%p dst_len=%d\n",
+		__func__, dev->name, offset, dst, dst_len);
+
+	for (i=0; (i<dst_len) && ((offset+i) < sizeof(vsdev->config)); i++) {
+		((u8 *)dst)[i] = src[offset + i];
+	}
+
+	return VMM_OK;
+}
+
+static int virtio_scsi_write_config(struct vmm_virtio_device *dev,
+				    u32 offset, void *src, u32 src_len)
+{
+	u32 i, start, end;
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+	u8 *dst = (u8 *)&vsdev->config;
+
+	DPRINTF("%s: dev=%s offset=%d src=%p src_len=%d\n",
+		__func__, dev->name, offset, src, src_len);
+
+	/* Only sense_size and cdb_size are writeable */
+	start = offsetof(struct vmm_virtio_scsi_config, sense_size);
+	end = offsetof(struct vmm_virtio_scsi_config, max_channel);
+	for (i=0; i<src_len; i++) {
+		if ((start <= (offset+i)) && ((offset+i) < end)) {
+			dst[offset + i] = ((u8 *)src)[i];
+		}
+	}
+
+	if (VIRTIO_SCSI_MAX_SENSE_SIZE < vsdev->config.sense_size) {
+		vsdev->config.sense_size = VIRTIO_SCSI_MAX_SENSE_SIZE;
+	}
+	if (VIRTIO_SCSI_MAX_CDB_SIZE < vsdev->config.cdb_size) {
+		vsdev->config.cdb_size = VIRTIO_SCSI_MAX_CDB_SIZE;
+	}
+
+	return VMM_OK;
+}
+
+static int virtio_scsi_reset(struct vmm_virtio_device *dev)
+{
+	u32 i;
+	int rc = VMM_OK;
+	irq_flags_t flags;
+	struct dlist stale;
+	struct virtio_scsi_req *req, *nreq;
+	struct virtio_scsi_queue *q;
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+
+	DPRINTF("%s: dev=%s\n", __func__, dev->name);
+
+	/* Requests still in flight are dropped upon completion */
+	for (i = 0; i < vsdev->num_queues; i++) {
+		q = &vsdev->queues[i];
+		vmm_spin_lock_irqsave(&q->lock, flags);
+		q->gen++;
+		if (vmm_virtio_queue_cleanup(&q->vq)) {
+			rc = VMM_EFAIL;
+		}
+		vmm_spin_unlock_irqrestore(&q->lock, flags);
+	}
+
+	INIT_LIST_HEAD(&stale);
+	vmm_spin_lock_irqsave(&vsdev->lock, flags);
+	list_for_each_entry_safe(req, nreq, &vsdev->tmf_list, head) {
+		list_del(&req->head);
+		list_add_tail(&req->head, &stale);
+	}
+	vsdev->events_head = 0;
+	vsdev->events_count = 0;
+	vsdev->events_missed = FALSE;
+	vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+
+	list_for_each_entry_safe(req, nreq, &stale, head) {
+		list_del(&req->head);
+		virtio_scsi_req_free(req);
+	}
+
+	vsdev->config.sense_size = VMM_VIRTIO_SCSI_SENSE_DEFAULT_SIZE;
+	vsdev->config.cdb_size = VMM_VIRTIO_SCSI_CDB_DEFAULT_SIZE;
+
+	return rc;
+}
+
+static void virtio_scsi_free(struct virtio_scsi_dev *vsdev)
+{
+	u32 i, inflight;
+	irq_flags_t flags;
+
+	if (!vsdev->luns) {
+		goto free_queues;
+	}
+
+	/* Wait for I/O submitted to virtual disks */
+	do {
+		inflight = 0;
+		vmm_spin_lock_irqsave(&vsdev->lock, flags);
+		for (i = 0; i < (vsdev->num_targets * vsdev->num_luns); i++) {
+			inflight += vsdev->luns[i].inflight;
+		}
+		vmm_spin_unlock_irqrestore(&vsdev->lock, flags);
+		if (inflight) {
+			vmm_msleep(1);
+		}
+	} while (inflight);
+
+	for (i = 0; i < (vsdev->num_targets * vsdev->num_luns); i++) {
+		if (vsdev->luns[i].vdisk) {
+			vmm_vdisk_destroy(vsdev->luns[i].vdisk);
+		}
+	}
+
+	vmm_free(vsdev->luns);
+free_queues:
+	if (vsdev->queues) {
+		vmm_free(vsdev->queues);
+	}
+	vmm_free(vsdev);
+}
+
+static int virtio_scsi_connect(struct vmm_virtio_device *dev,
+			       struct vmm_virtio_emulator *emu)
+{
+	u32 i, val;
+	const char *attr;
+	struct virtio_scsi_lun *lun;
+	struct virtio_scsi_dev *vsdev;
+	struct vmm_devtree_node *node = dev->edev->node;
+	char name[VMM_FIELD_NAME_SIZE];
+
+	DPRINTF("%s: dev=%s emu=%s\n", __func__, dev->name, emu->name);
+
+	vsdev = vmm_zalloc(sizeof(struct virtio_scsi_dev));
+	if (!vsdev) {
+		vmm_printf("Failed to allocate virtio scsi device....\n");
+		return VMM_ENOMEM;
+	}
+	vsdev->vdev = dev;
+	INIT_SPIN_LOCK(&vsdev->lock);
+	INIT_LIST_HEAD(&vsdev->tmf_list);
+
+	if (vmm_devtree_read_u32(node, "num_queues", &val) ||
+	    !val || (VIRTIO_SCSI_MAX_REQUEST_QUEUES < val)) {
+		val = 1;
+	}
+	vsdev->num_queues = VIRTIO_SCSI_REQUEST_QUEUE + val;
+	if (vmm_devtree_read_u32(node, "num_targets", &vsdev->num_targets) ||
+	    !vsdev->num_targets ||
+	    (VIRTIO_SCSI_MAX_TARGETS < vsdev->num_targets)) {
+		vsdev->num_targets = 1;
+	}
+	if (vmm_devtree_read_u32(node, "num_luns", &vsdev->num_luns) ||
+	    !vsdev->num_luns ||
+	    (VIRTIO_SCSI_MAX_LUN_SLOTS <
+			(vsdev->num_targets * vsdev->num_luns))) {
+		vsdev->num_luns = 1;
+	}
+
+	vsdev->config.num_queues = val;
+	vsdev->config.seg_max = VIRTIO_SCSI_SEG_MAX;
+	vsdev->config.max_sectors = VIRTIO_SCSI_MAX_SECTORS;
+	vsdev->config.cmd_per_lun = VIRTIO_SCSI_QUEUE_SIZE;
+	vsdev->config.event_info_size = sizeof(struct vmm_virtio_scsi_event);
+	vsdev->config.sense_size = VMM_VIRTIO_SCSI_SENSE_DEFAULT_SIZE;
+	vsdev->config.cdb_size = VMM_VIRTIO_SCSI_CDB_DEFAULT_SIZE;
+	vsdev->config.max_channel = 0;
+	vsdev->config.max_target = vsdev->num_targets - 1;
+	vsdev->config.max_lun = vsdev->num_luns - 1;
+
+	vsdev->queues = vmm_zalloc(vsdev->num_queues *
+				   sizeof(struct virtio_scsi_queue));
+	vsdev->luns = vmm_zalloc(vsdev->num_targets * vsdev->num_luns *
+				 sizeof(struct virtio_scsi_lun));
+	if (!vsdev->queues || !vsdev->luns) {
+		virtio_scsi_free(vsdev);
+		return VMM_ENOMEM;
+	}
+	for (i = 0; i < vsdev->num_queues; i++) {
+		INIT_SPIN_LOCK(&vsdev->queues[i].lock);
+	}
+
+	dev->emu_data = vsdev;
+
+	for (i = 0; i < (vsdev->num_targets * vsdev->num_luns); i++) {
+		lun = &vsdev->luns[i];
+		lun->vsdev = vsdev;
+		lun->target = i / vsdev->num_luns;
+		lun->lun = i % vsdev->num_luns;
+
+		vmm_snprintf(name, sizeof(name), "%s:%d:%d",
+			     dev->name, lun->target, lun->lun);
+		lun->vdisk = vmm_vdisk_create(name, VIRTIO_SCSI_SECTOR_SIZE,
+					      virtio_scsi_attached,
+					      virtio_scsi_detached,
+					      virtio_scsi_req_completed,
+					      virtio_scsi_req_failed,
+					      lun);
+		if (!lun->vdisk) {
+			virtio_scsi_free(vsdev);
+			dev->emu_data = NULL;
+			return VMM_EFAIL;
+		}
+
+		/* Apply QoS limits and attach block device */
+		vmm_vdisk_set_qos_from_devtree(lun->vdisk, node);
+		if (vmm_devtree_string_index(node, "blkdev", i, &attr) > 0) {
+			vmm_vdisk_attach_block_device(lun->vdisk, attr);
+		}
+	}
+
+	return VMM_OK;
+}
+
+static void virtio_scsi_disconnect(struct vmm_virtio_device *dev)
+{
+	struct virtio_scsi_dev *vsdev = dev->emu_data;
+
+	DPRINTF("%s: dev=%s\n", __func__, dev->name);
+
+	virtio_scsi_free(vsdev);
+}
+
+struct vmm_virtio_device_id virtio_scsi_emu_id[] = {
+	{ .type = VMM_VIRTIO_ID_SCSI },
+	{ },
+};
+
+struct vmm_virtio_emulator virtio_scsi = {
+	.name = "virtio_scsi",
+	.id_table = virtio_scsi_emu_id,
+
+	/* VirtIO operations */
+	.get_host_features      = virtio_scsi_get_host_features,
+	.set_guest_features     = virtio_scsi_set_guest_features,
+	.init_vq                = virtio_scsi_init_vq,
+	.get_pfn_vq             = virtio_scsi_get_pfn_vq,
+	.get_size_vq            = virtio_scsi_get_size_vq,
+	.set_size_vq            = virtio_scsi_set_size_vq,
+	.notify_vq              = virtio_scsi_notify_vq,
+	.status_changed         = virtio_scsi_status_changed,
+
+	/* Emulator operations */
+	.read_config = virtio_scsi_read_config,
+	.write_config = virtio_scsi_write_config,
+	.reset = virtio_scsi_reset,
+	.connect = virtio_scsi_connect,
+	.disconnect = virtio_scsi_disconnect,
+};
+
+static int __init virtio_scsi_init(void)
+{
+	return vmm_virtio_register_emulator(&virtio_scsi);
+}
+
+static void __exit virtio_scsi_exit(void)
+{
+	vmm_virtio_unregister_emulator(&virtio_scsi);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
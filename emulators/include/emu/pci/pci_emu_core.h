@@ -70,6 +70,42 @@
 #define PCI_CONFIG_MIN_GNT_OFFS		62
 #define PCI_CONFIG_MAX_LAT_OFFS		63
 
+/* PCI command and status register bits */
+#define PCI_COMMAND_INTX_DISABLE	0x400
+#define PCI_STATUS_CAP_LIST		0x10
+
+/* PCI capabilities emulated by PCI emulation core */
+#define PCI_CAP_ID_MSI			0x05
+#define PCI_CAP_ID_MSIX			0x11
+#define PCI_EMU_CAP_START		PCI_CONFIG_HEADER_SIZE
+
+/* 64-bit MSI capability with per-vector masking */
+#define PCI_MSI_FLAGS_OFFS		2
+#define PCI_MSI_ADDR_LO_OFFS		4
+#define PCI_MSI_ADDR_HI_OFFS		8
+#define PCI_MSI_DATA_OFFS		12
+#define PCI_MSI_MASK_OFFS		16
+#define PCI_MSI_PENDING_OFFS		20
+#define PCI_MSI_CAP_SIZE		24
+#define PCI_MSI_FLAGS_ENABLE		0x0001
+#define PCI_MSI_FLAGS_QMASK		0x000e
+#define PCI_MSI_FLAGS_QSIZE		0x0070
+#define PCI_MSI_FLAGS_64BIT		0x0080
+#define PCI_MSI_FLAGS_MASKBIT		0x0100
+#define PCI_MSI_MAX_VECTORS		32
+
+/* MSI-X capability */
+#define PCI_MSIX_FLAGS_OFFS		2
+#define PCI_MSIX_TABLE_OFFS		4
+#define PCI_MSIX_PBA_OFFS		8
+#define PCI_MSIX_CAP_SIZE		12
+#define PCI_MSIX_FLAGS_QSIZE		0x07ff
+#define PCI_MSIX_FLAGS_MASKALL		0x4000
+#define PCI_MSIX_FLAGS_ENABLE		0x8000
+#define PCI_MSIX_ENTRY_SIZE		16
+#define PCI_MSIX_ENTRY_CTRL_MASKBIT	0x1
+#define PCI_MSIX_MAX_VECTORS		2048
+
 #define PCI_CONTROLLER_TO_CLASS(controller)	(&(controller)->class)
 
 #define PCI_DEVICE_TO_CLASS(pdev)			(&(pdev)->class)
@@ -111,11 +147,43 @@ struct pci_conf_header {
 	u8 max_lat;
 } __packed;
 
+struct pci_emu_msix_entry {
+	u32 addr_lo;
+	u32 addr_hi;
+	u32 data;
+	u32 ctrl;
+} __packed;
+
+struct pci_emu_msi {
+	struct vmm_guest *guest;
+	u32 devid;
+
+	/* MSI capability (msi_cap is zero when absent) */
+	u8 msi_cap;
+	u8 msi_nvec;
+	u16 msi_flags;
+	u64 msi_addr;
+	u16 msi_data;
+	u32 msi_mask;
+	u32 msi_pending;
+
+	/* MSI-X capability (msix_cap is zero when absent) */
+	u8 msix_cap;
+	u8 msix_bar;
+	u16 msix_flags;
+	u16 msix_nvec;
+	u32 msix_table_offset;
+	u32 msix_pba_offset;
+	struct pci_emu_msix_entry *msix_table;
+	u32 *msix_pba;
+};
+
 struct pci_class {
 	struct pci_conf_header conf_header;
 	vmm_spinlock_t lock;
 	pci_config_read_t config_read;
 	pci_config_write_t config_write;
+	struct pci_emu_msi *msi;
 };
 
 struct pci_host_controller {
@@ -180,4 +248,53 @@ int pci_emu_config_space_write(struct pci_class *class, u32 reg_offs, u32 val);
 u32 pci_emu_config_space_read(struct pci_class *class, u32 reg_offs, u32 size);
 int __init pci_devemu_init(void);
 
+/** Add MSI and/or MSI-X capability to emulated PCI device
+ *  Note: msi_nvec must be power of two (zero means no MSI capability)
+ *  Note: msix_nvec of zero means no MSI-X capability otherwise MSI-X
+ *  table and PBA live in msix_bar at given offsets
+ */
+int pci_emu_msi_init(struct pci_device *pdev, u32 msi_nvec,
+		     u32 msix_nvec, u32 msix_bar,
+		     u32 msix_table_offset, u32 msix_pba_offset);
+
+/** Remove MSI and MSI-X capabilities of emulated PCI device */
+void pci_emu_msi_cleanup(struct pci_device *pdev);
+
+/** Reset MSI and MSI-X state of emulated PCI device */
+void pci_emu_msi_reset(struct pci_device *pdev);
+
+/** Check whether guest enabled MSI or MSI-X for emulated PCI device */
+bool pci_emu_msi_enabled(struct pci_device *pdev);
+
+/** Number of usable vectors enabled by guest (zero if MSI/MSI-X off) */
+u32 pci_emu_msi_nvec(struct pci_device *pdev);
+
+/** Signal given MSI/MSI-X vector of emulated PCI device
+ *  Note: returns VMM_ENOTAVAIL if guest has not enabled MSI or MSI-X
+ *  hence caller can fallback to legacy INTx.
+ */
+int pci_emu_msi_notify(struct pci_device *pdev, u32 vector);
+
+/** Internal functions to emulate capability config space accesses
+ *  (should not be called directly)
+ */
+bool __pci_emu_msi_config_read(struct pci_class *class, u32 reg_offs,
+			       u32 size, u32 *val);
+bool __pci_emu_msi_config_write(struct pci_class *class, u32 reg_offs,
+				u32 val);
+void __pci_emu_msi_flush(struct pci_class *class);
+
+/** Emulate read of MSI-X table or PBA in BAR of emulated PCI device
+ *  Note: returns VMM_ENOTAVAIL if offset is not part of MSI-X table/PBA
+ */
+int pci_emu_msix_bar_read(struct pci_device *pdev, u32 barnum,
+			  u32 offset, u32 *dst, u32 size);
+
+/** Emulate write of MSI-X table or PBA in BAR of emulated PCI device
+ *  Note: size can be 1, 2, 4 or 8 bytes
+ *  Note: returns VMM_ENOTAVAIL if offset is not part of MSI-X table/PBA
+ */
+int pci_emu_msix_bar_write(struct pci_device *pdev, u32 barnum,
+			   u32 offset, u64 src, u32 size);
+
 #endif /* __PCI_EMU_CORE_H */
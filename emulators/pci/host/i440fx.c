@@ -146,51 +146,77 @@ static int i440fx_config_write(struct pci_class *pci_class, u16 reg_offset, u32
 	return VMM_OK;
 }
 
+static struct pci_class *i440fx_conf_class(struct i440fx_state *s)
+{
+	u16 bus, dev, func;
+	struct pci_device *pdev;
+
+	bus = (s->conf_add >> 16) & 0xff;
+	dev = (s->conf_add >> 11) & 0x1f;
+	func = (s->conf_add >> 8) & 0x7;
+
+	/* if bus and dev are 0, its bound to PMC */
+	if (bus == 0 && dev == 0) {
+		/* PMC is not a multi-function device */
+		return (func) ? NULL : (struct pci_class *)s->controller;
+	}
+
+	if (pci_emu_find_pci_device(s->controller, bus, dev, &pdev) != VMM_OK) {
+		return NULL;
+	}
+
+	return (struct pci_class *)pdev;
+}
+
 static int i440fx_reg_write(struct i440fx_state *s, u32 addr,
 			    u32 src_mask, u32 val)
 {
-	s->conf_add = val;
+	struct pci_class *class;
+
+	/* Writes to address port select the config register */
+	if (addr < 4) {
+		s->conf_add = val;
+		return VMM_OK;
+	}
+
+	if (!(s->conf_add & 0x80000000)) {
+		return VMM_OK;
+	}
+
+	/* Writes to data port go to the selected config register */
+	class = i440fx_conf_class(s);
+	if (!class) {
+		return VMM_OK;
+	}
+
+	pci_emu_config_space_write(class, (s->conf_add & 0xfc) + (addr - 4),
+				   val & ~src_mask);
 
 	return VMM_OK;
 }
 
 static int i440fx_reg_read(struct i440fx_state *s, u32 addr, u32 *dst, u32 size)
 {
-	u16 bus, dev, func, reg_offs;
-	struct pci_device *pdev;
+	struct pci_class *class;
 
 	/*
 	 * If guest is reading from command register,
 	 * then its probing if PCI is supported or not.
 	 */
-	if (!addr) {
+	if (addr < 4) {
 		*dst = s->conf_add;
 		return VMM_OK;
 	}
 
 	if (s->conf_add & 0x80000000) {
-		bus = (s->conf_add >> 16) & 0xff;
-		dev = (s->conf_add >> 11) & 0x1f;
-		func = (s->conf_add >> 8) & 0x7;
-		reg_offs = (s->conf_add) & 0xfc;
-
-		/* if bus and dev are 0, its bound to PMC */
-		if (bus == 0 && dev == 0) {
-			/* PMC is not a multi-function device */
-			if (func) {
-				*dst = 0xFFFFFFFFUL;
-			} else {
-				*dst = pci_emu_config_space_read((struct pci_class *)s->controller,
-								 reg_offs, size);
-			}
-		} else {
-			if (pci_emu_find_pci_device(s->controller, bus, dev, &pdev) != VMM_OK) {
-				*dst = 0xffff;
-				return VMM_OK;
-			}
-
-			*dst = pci_emu_config_space_read((struct pci_class *)pdev, reg_offs, size);
+		class = i440fx_conf_class(s);
+		if (!class) {
+			*dst = 0xFFFFFFFFUL;
+			return VMM_OK;
 		}
+
+		*dst = pci_emu_config_space_read(class,
+				(s->conf_add & 0xfc) + (addr - 4), size);
 	}
 
 	return VMM_OK;
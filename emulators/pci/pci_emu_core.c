@@ -228,7 +228,7 @@ int pci_emu_unregister_device(struct pci_dev_emulator *emu)
 
 static int pci_emu_register_bar(struct vmm_guest *guest,
 				const char *name,
-				struct pci_class *class,
+				struct pci_device *pdev,
 				u32 barnum,
 				struct vmm_devtree_node *bar_node)
 {
@@ -240,10 +240,12 @@ static int pci_emu_register_bar(struct vmm_guest *guest,
 		return VMM_EFAIL;
 	}
 
-	if ((rc = vmm_guest_add_region_from_node(guest, bar_node, NULL)) != VMM_OK)
+	/* BAR emulators find their PCI device using region private */
+	if ((rc = vmm_guest_add_region_from_node(guest, bar_node,
+						 pdev)) != VMM_OK)
 		return rc;
 
-	class->conf_header.bars[barnum] = addr;
+	PCI_DEVICE_TO_CLASS(pdev)->conf_header.bars[barnum] = addr;
 
 	return VMM_OK;
 }
@@ -256,7 +258,6 @@ static int pci_emu_enumerate_bars(struct vmm_guest *guest,
 	char reg_name[64];
 	int rc = VMM_OK;
 	u32 barnum;
-	struct pci_class *class = (struct pci_class *)pdev;
 
 	bar_node = vmm_devtree_getchild(bus_node, "bars");
 	if (!bar_node) {
@@ -284,7 +285,7 @@ static int pci_emu_enumerate_bars(struct vmm_guest *guest,
 		vmm_sprintf(reg_name, "%s@%s", bars->name, bus_node->name);
 		/* FIXME: Unmap previously register bars, or let it go??? */
 		if ((rc = pci_emu_register_bar(guest, reg_name,
-					class, barnum, bars)) != VMM_OK) {
+					pdev, barnum, bars)) != VMM_OK) {
 			vmm_printf("%s: Failed to register bar region %s\n",
 				   __func__, reg_name);
 			vmm_devtree_dref_node(bars);
@@ -350,6 +351,7 @@ int pci_emu_probe_devices(struct vmm_guest *guest,
 				}
 				INIT_SPIN_LOCK(&pdev->lock);
 				pdev->node = dev_node;
+				pdev->guest = guest;
 				pdev->priv = NULL;
 				rc = vmm_devtree_read_u32(dev_node,
 							  "device_id", &pdev->device_id);
@@ -477,6 +479,12 @@ int pci_emu_config_space_write(struct pci_class *class, u32 reg_offs, u32 val)
 	vmm_spin_lock_irqsave(&class->lock, flags);
 
 	if (reg_offs > PCI_CONFIG_HEADER_END) {
+		if (__pci_emu_msi_config_write(class, reg_offs, val)) {
+			vmm_spin_unlock_irqrestore(&class->lock, flags);
+			/* Deliver messages unmasked by this write */
+			__pci_emu_msi_flush(class);
+			return VMM_OK;
+		}
 		if (class->config_write) {
 			retv = class->config_write(class, reg_offs, val);
 			vmm_spin_unlock_irqrestore(&class->lock, flags);
@@ -504,7 +512,9 @@ int pci_emu_config_space_write(struct pci_class *class, u32 reg_offs, u32 val)
 		break;
 
 	case PCI_CONFIG_STATUS_REG_OFFS:
-		class->conf_header.status = val;
+		/* Capabilities list bit is read-only */
+		class->conf_header.status = (val & ~PCI_STATUS_CAP_LIST) |
+			(class->conf_header.status & PCI_STATUS_CAP_LIST);
 		break;
 
 	case PCI_CONFIG_REVISION_ID_OFFS:
@@ -613,6 +623,10 @@ u32 pci_emu_config_space_read(struct pci_class *class, u32 reg_offs, u32 size)
 	vmm_spin_lock_irqsave(&class->lock, flags);
 
 	if (reg_offs > PCI_CONFIG_HEADER_END) {
+		if (__pci_emu_msi_config_read(class, reg_offs, size, &ret)) {
+			vmm_spin_unlock_irqrestore(&class->lock, flags);
+			return ret;
+		}
 		if (class->config_read) {
 			ret = class->config_read(class, reg_offs);
 			vmm_spin_unlock_irqrestore(&class->lock, flags);
@@ -0,0 +1,651 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file pci_emu_msi.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief MSI and MSI-X capability emulation for emulated PCI devices.
+ *
+ * The MSI capability (64-bit address with per-vector masking) and the
+ * MSI-X capability are placed right after the standard config header.
+ * MSI-X table and PBA are emulated on behalf of device BAR emulators
+ * which forward BAR accesses using pci_emu_msix_bar_read/write().
+ *
+ * Messages are delivered using vmm_devemu_emulate_msi() so the guest
+ * interrupt controller emulator (or its doorbell register) decides
+ * how to inject the message. Delivery always happens after dropping
+ * class->lock.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_devemu.h>
+#include <libs/bitops.h>
+#include <libs/stringlib.h>
+#include <emu/pci/pci_emu_core.h>
+
+/* Max messages collected under class->lock per flush round */
+#define MSI_FLUSH_BATCH		16
+
+struct msi_msg {
+	u64 addr;
+	u32 data;
+};
+
+static inline bool msi_is_enabled(struct pci_emu_msi *msi)
+{
+	return (msi->msi_cap &&
+		(msi->msi_flags & PCI_MSI_FLAGS_ENABLE)) ? TRUE : FALSE;
+}
+
+static inline bool msix_is_enabled(struct pci_emu_msi *msi)
+{
+	return (msi->msix_cap &&
+		(msi->msix_flags & PCI_MSIX_FLAGS_ENABLE)) ? TRUE : FALSE;
+}
+
+static inline u32 msi_enabled_nvec(struct pci_emu_msi *msi)
+{
+	return 1 << ((msi->msi_flags & PCI_MSI_FLAGS_QSIZE) >> 4);
+}
+
+static inline u32 msi_vec_mask(struct pci_emu_msi *msi)
+{
+	return (msi->msi_nvec < 32) ? ((1U << msi->msi_nvec) - 1) : ~0U;
+}
+
+static inline u32 msix_pba_size(struct pci_emu_msi *msi)
+{
+	/* PBA is made of 64-bit entries */
+	return ((msi->msix_nvec + 63) / 64) * 8;
+}
+
+static inline u32 msix_table_size(struct pci_emu_msi *msi)
+{
+	return msi->msix_nvec * PCI_MSIX_ENTRY_SIZE;
+}
+
+static inline u32 msi_data(struct pci_emu_msi *msi, u32 vector)
+{
+	return (msi->msi_data & ~(msi_enabled_nvec(msi) - 1)) | vector;
+}
+
+static inline u64 msix_addr(struct pci_emu_msix_entry *e)
+{
+	return ((u64)e->addr_hi << 32) | e->addr_lo;
+}
+
+/* Collect pending messages which are no longer masked and clear
+ * their pending state. Returns number of messages collected.
+ * Note: must be called with class->lock held
+ */
+static u32 msi_collect_pending(struct pci_emu_msi *msi,
+			       struct msi_msg *msgs, u32 max)
+{
+	u32 v, pend, count = 0;
+	struct pci_emu_msix_entry *e;
+
+	if (msix_is_enabled(msi)) {
+		if (msi->msix_flags & PCI_MSIX_FLAGS_MASKALL) {
+			return 0;
+		}
+		for (v = 0; (v < msi->msix_nvec) && (count < max); v++) {
+			if (!(msi->msix_pba[v / 32] & (1U << (v % 32)))) {
+				continue;
+			}
+			e = &msi->msix_table[v];
+			if (e->ctrl & PCI_MSIX_ENTRY_CTRL_MASKBIT) {
+				continue;
+			}
+			msi->msix_pba[v / 32] &= ~(1U << (v % 32));
+			msgs[count].addr = msix_addr(e);
+			msgs[count].data = e->data;
+			count++;
+		}
+	} else if (msi_is_enabled(msi)) {
+		pend = msi->msi_pending & ~msi->msi_mask;
+		while (pend && (count < max)) {
+			v = __ffs(pend);
+			pend &= ~(1U << v);
+			msi->msi_pending &= ~(1U << v);
+			msgs[count].addr = msi->msi_addr;
+			msgs[count].data = msi_data(msi, v);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+void __pci_emu_msi_flush(struct pci_class *class)
+{
+	u32 i, count, devid = 0;
+	irq_flags_t flags;
+	struct vmm_guest *guest = NULL;
+	struct msi_msg msgs[MSI_FLUSH_BATCH];
+
+	do {
+		count = 0;
+		vmm_spin_lock_irqsave(&class->lock, flags);
+		if (class->msi) {
+			count = msi_collect_pending(class->msi,
+						    msgs, MSI_FLUSH_BATCH);
+			guest = class->msi->guest;
+			devid = class->msi->devid;
+		}
+		vmm_spin_unlock_irqrestore(&class->lock, flags);
+
+		for (i = 0; i < count; i++) {
+			vmm_devemu_emulate_msi(guest, msgs[i].addr,
+					       msgs[i].data, devid);
+		}
+	} while (count == MSI_FLUSH_BATCH);
+}
+
+static void msi_flags_write(struct pci_emu_msi *msi, u32 flags)
+{
+	u16 qmask = (msi->msi_flags & PCI_MSI_FLAGS_QMASK) >> 1;
+	u16 qsize = (flags & PCI_MSI_FLAGS_QSIZE) >> 4;
+
+	if (qsize > qmask) {
+		qsize = qmask;
+	}
+
+	msi->msi_flags &= ~(PCI_MSI_FLAGS_ENABLE | PCI_MSI_FLAGS_QSIZE);
+	msi->msi_flags |= (flags & PCI_MSI_FLAGS_ENABLE) | (qsize << 4);
+}
+
+static void msix_flags_write(struct pci_emu_msi *msi, u32 flags)
+{
+	msi->msix_flags &= ~(PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL);
+	msi->msix_flags |= flags &
+			(PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL);
+}
+
+static bool msi_cap_hit(struct pci_emu_msi *msi, u32 reg_offs)
+{
+	return (msi->msi_cap && (msi->msi_cap <= reg_offs) &&
+		(reg_offs < (msi->msi_cap + PCI_MSI_CAP_SIZE))) ? TRUE : FALSE;
+}
+
+static bool msix_cap_hit(struct pci_emu_msi *msi, u32 reg_offs)
+{
+	return (msi->msix_cap && (msi->msix_cap <= reg_offs) &&
+		(reg_offs < (msi->msix_cap + PCI_MSIX_CAP_SIZE))) ? TRUE : FALSE;
+}
+
+static u32 msi_cap_read32(struct pci_emu_msi *msi, u32 reg_offs)
+{
+	if (msi_cap_hit(msi, reg_offs)) {
+		switch (reg_offs - msi->msi_cap) {
+		case 0:
+			return PCI_CAP_ID_MSI | ((u32)msi->msix_cap << 8) |
+				((u32)msi->msi_flags << 16);
+		case PCI_MSI_ADDR_LO_OFFS:
+			return (u32)msi->msi_addr;
+		case PCI_MSI_ADDR_HI_OFFS:
+			return (u32)(msi->msi_addr >> 32);
+		case PCI_MSI_DATA_OFFS:
+			return msi->msi_data;
+		case PCI_MSI_MASK_OFFS:
+			return msi->msi_mask;
+		case PCI_MSI_PENDING_OFFS:
+			return msi->msi_pending;
+		default:
+			break;
+		}
+	} else if (msix_cap_hit(msi, reg_offs)) {
+		switch (reg_offs - msi->msix_cap) {
+		case 0:
+			return PCI_CAP_ID_MSIX | ((u32)msi->msix_flags << 16);
+		case PCI_MSIX_TABLE_OFFS:
+			return msi->msix_table_offset | msi->msix_bar;
+		case PCI_MSIX_PBA_OFFS:
+			return msi->msix_pba_offset | msi->msix_bar;
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+bool __pci_emu_msi_config_read(struct pci_class *class, u32 reg_offs,
+			       u32 size, u32 *val)
+{
+	u32 ret;
+	struct pci_emu_msi *msi = class->msi;
+
+	if (!msi ||
+	    (!msi_cap_hit(msi, reg_offs) && !msix_cap_hit(msi, reg_offs))) {
+		return FALSE;
+	}
+
+	ret = msi_cap_read32(msi, reg_offs & ~0x3);
+	ret >>= (reg_offs & 0x3) * 8;
+	if (size < 4) {
+		ret &= (1U << (size * 8)) - 1;
+	}
+	*val = ret;
+
+	return TRUE;
+}
+
+bool __pci_emu_msi_config_write(struct pci_class *class, u32 reg_offs,
+				u32 val)
+{
+	struct pci_emu_msi *msi = class->msi;
+
+	if (!msi) {
+		return FALSE;
+	}
+
+	if (msi_cap_hit(msi, reg_offs)) {
+		switch (reg_offs - msi->msi_cap) {
+		case 0:
+			/* Dword write covering capability ID and flags */
+			msi_flags_write(msi, val >> 16);
+			break;
+		case PCI_MSI_FLAGS_OFFS:
+			msi_flags_write(msi, val);
+			break;
+		case PCI_MSI_ADDR_LO_OFFS:
+			msi->msi_addr &= ~0xffffffffULL;
+			msi->msi_addr |= val & ~0x3;
+			break;
+		case PCI_MSI_ADDR_HI_OFFS:
+			msi->msi_addr &= 0xffffffffULL;
+			msi->msi_addr |= (u64)val << 32;
+			break;
+		case PCI_MSI_DATA_OFFS:
+			msi->msi_data = val;
+			break;
+		case PCI_MSI_MASK_OFFS:
+			msi->msi_mask = val & msi_vec_mask(msi);
+			break;
+		default:
+			/* Read-only registers */
+			break;
+		}
+		return TRUE;
+	}
+
+	if (msix_cap_hit(msi, reg_offs)) {
+		switch (reg_offs - msi->msix_cap) {
+		case 0:
+			msix_flags_write(msi, val >> 16);
+			break;
+		case PCI_MSIX_FLAGS_OFFS:
+			msix_flags_write(msi, val);
+			break;
+		default:
+			/* Read-only registers */
+			break;
+		}
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void msi_reset(struct pci_emu_msi *msi)
+{
+	u32 v;
+
+	msi->msi_flags &= ~(PCI_MSI_FLAGS_ENABLE | PCI_MSI_FLAGS_QSIZE);
+	msi->msi_addr = 0;
+	msi->msi_data = 0;
+	msi->msi_mask = 0;
+	msi->msi_pending = 0;
+
+	msi->msix_flags &= ~(PCI_MSIX_FLAGS_ENABLE | PCI_MSIX_FLAGS_MASKALL);
+	if (msi->msix_cap) {
+		memset(msi->msix_table, 0, msix_table_size(msi));
+		for (v = 0; v < msi->msix_nvec; v++) {
+			msi->msix_table[v].ctrl = PCI_MSIX_ENTRY_CTRL_MASKBIT;
+		}
+		memset(msi->msix_pba, 0, msix_pba_size(msi));
+	}
+}
+
+int pci_emu_msi_init(struct pci_device *pdev, u32 msi_nvec,
+		     u32 msix_nvec, u32 msix_bar,
+		     u32 msix_table_offset, u32 msix_pba_offset)
+{
+	u8 cap = PCI_EMU_CAP_START;
+	irq_flags_t flags;
+	struct pci_emu_msi *msi;
+	struct pci_class *class;
+
+	if (!pdev || !pdev->guest) {
+		return VMM_EFAIL;
+	}
+	if (!msi_nvec && !msix_nvec) {
+		return VMM_EINVALID;
+	}
+	if ((PCI_MSI_MAX_VECTORS < msi_nvec) ||
+	    (msi_nvec & (msi_nvec - 1))) {
+		return VMM_EINVALID;
+	}
+	if (msix_nvec &&
+	    ((PCI_MSIX_MAX_VECTORS < msix_nvec) || (6 <= msix_bar) ||
+	     (msix_table_offset & 0x7) || (msix_pba_offset & 0x7))) {
+		return VMM_EINVALID;
+	}
+
+	msi = vmm_zalloc(sizeof(*msi));
+	if (!msi) {
+		return VMM_ENOMEM;
+	}
+
+	msi->guest = pdev->guest;
+	msi->devid = pdev->device_id & 0xffff;
+
+	if (msi_nvec) {
+		msi->msi_cap = cap;
+		msi->msi_nvec = msi_nvec;
+		msi->msi_flags = (__ffs(msi_nvec) << 1) |
+				 PCI_MSI_FLAGS_64BIT | PCI_MSI_FLAGS_MASKBIT;
+		cap += PCI_MSI_CAP_SIZE;
+	}
+
+	if (msix_nvec) {
+		msi->msix_cap = cap;
+		msi->msix_bar = msix_bar;
+		msi->msix_nvec = msix_nvec;
+		msi->msix_flags = msix_nvec - 1;
+		msi->msix_table_offset = msix_table_offset;
+		msi->msix_pba_offset = msix_pba_offset;
+		msi->msix_table = vmm_zalloc(msix_table_size(msi));
+		msi->msix_pba = vmm_zalloc(msix_pba_size(msi));
+		if (!msi->msix_table || !msi->msix_pba) {
+			if (msi->msix_table) {
+				vmm_free(msi->msix_table);
+			}
+			if (msi->msix_pba) {
+				vmm_free(msi->msix_pba);
+			}
+			vmm_free(msi);
+			return VMM_ENOMEM;
+		}
+	}
+
+	msi_reset(msi);
+
+	class = PCI_DEVICE_TO_CLASS(pdev);
+	vmm_spin_lock_irqsave(&class->lock, flags);
+	if (class->msi) {
+		vmm_spin_unlock_irqrestore(&class->lock, flags);
+		if (msi->msix_cap) {
+			vmm_free(msi->msix_table);
+			vmm_free(msi->msix_pba);
+		}
+		vmm_free(msi);
+		return VMM_EEXIST;
+	}
+	class->msi = msi;
+	class->conf_header.cap_pointer = PCI_EMU_CAP_START;
+	class->conf_header.status |= PCI_STATUS_CAP_LIST;
+	vmm_spin_unlock_irqrestore(&class->lock, flags);
+
+	return VMM_OK;
+}
+
+void pci_emu_msi_cleanup(struct pci_device *pdev)
+{
+	irq_flags_t flags;
+	struct pci_emu_msi *msi;
+	struct pci_class *class;
+
+	if (!pdev) {
+		return;
+	}
+
+	class = PCI_DEVICE_TO_CLASS(pdev);
+	vmm_spin_lock_irqsave(&class->lock, flags);
+	msi = class->msi;
+	class->msi = NULL;
+	class->conf_header.cap_pointer = 0;
+	class->conf_header.status &= ~PCI_STATUS_CAP_LIST;
+	vmm_spin_unlock_irqrestore(&class->lock, flags);
+
+	if (msi) {
+		if (msi->msix_cap) {
+			vmm_free(msi->msix_table);
+			vmm_free(msi->msix_pba);
+		}
+		vmm_free(msi);
+	}
+}
+
+void pci_emu_msi_reset(struct pci_device *pdev)
+{
+	irq_flags_t flags;
+	struct pci_class *class;
+
+	if (!pdev) {
+		return;
+	}
+
+	class = PCI_DEVICE_TO_CLASS(pdev);
+	vmm_spin_lock_irqsave(&class->lock, flags);
+	if (class->msi) {
+		msi_reset(class->msi);
+	}
+	vmm_spin_unlock_irqrestore(&class->lock, flags);
+}
+
+bool pci_emu_msi_enabled(struct pci_device *pdev)
+{
+	return (pci_emu_msi_nvec(pdev)) ? TRUE : FALSE;
+}
+
+u32 pci_emu_msi_nvec(struct pci_device *pdev)
+{
+	u32 ret = 0;
+	irq_flags_t flags;
+	struct pci_emu_msi *msi;
+	struct pci_class *class;
+
+	if (!pdev) {
+		return 0;
+	}
+
+	class = PCI_DEVICE_TO_CLASS(pdev);
+	vmm_spin_lock_irqsave(&class->lock, flags);
+	msi = class->msi;
+	if (msi && msix_is_enabled(msi)) {
+		ret = msi->msix_nvec;
+	} else if (msi && msi_is_enabled(msi)) {
+		ret = msi_enabled_nvec(msi);
+	}
+	vmm_spin_unlock_irqrestore(&class->lock, flags);
+
+	return ret;
+}
+
+int pci_emu_msi_notify(struct pci_device *pdev, u32 vector)
+{
+	u64 addr;
+	u32 data, nvec, devid;
+	irq_flags_t flags;
+	struct vmm_guest *guest;
+	struct pci_emu_msi *msi;
+	struct pci_class *class;
+	struct pci_emu_msix_entry *e;
+
+	if (!pdev) {
+		return VMM_EFAIL;
+	}
+
+	class = PCI_DEVICE_TO_CLASS(pdev);
+	vmm_spin_lock_irqsave(&class->lock, flags);
+
+	msi = class->msi;
+	if (msi && msix_is_enabled(msi)) {
+		if (msi->msix_nvec <= vector) {
+			vmm_spin_unlock_irqrestore(&class->lock, flags);
+			return VMM_EINVALID;
+		}
+		e = &msi->msix_table[vector];
+		if ((msi->msix_flags & PCI_MSIX_FLAGS_MASKALL) ||
+		    (e->ctrl & PCI_MSIX_ENTRY_CTRL_MASKBIT)) {
+			msi->msix_pba[vector / 32] |= (1U << (vector % 32));
+			vmm_spin_unlock_irqrestore(&class->lock, flags);
+			return VMM_OK;
+		}
+		addr = msix_addr(e);
+		data = e->data;
+	} else if (msi && msi_is_enabled(msi)) {
+		/* Vectors beyond the ones enabled by guest are folded */
+		nvec = msi_enabled_nvec(msi);
+		vector &= nvec - 1;
+		if (msi->msi_mask & (1U << vector)) {
+			msi->msi_pending |= (1U << vector);
+			vmm_spin_unlock_irqrestore(&class->lock, flags);
+			return VMM_OK;
+		}
+		addr = msi->msi_addr;
+		data = msi_data(msi, vector);
+	} else {
+		vmm_spin_unlock_irqrestore(&class->lock, flags);
+		return VMM_ENOTAVAIL;
+	}
+
+	guest = msi->guest;
+	devid = msi->devid;
+
+	vmm_spin_unlock_irqrestore(&class->lock, flags);
+
+	return vmm_devemu_emulate_msi(guest, addr, data, devid);
+}
+
+int pci_emu_msix_bar_read(struct pci_device *pdev, u32 barnum,
+			  u32 offset, u32 *dst, u32 size)
+{
+	int rc = VMM_OK;
+	u32 val, shift;
+	irq_flags_t flags;
+	struct pci_emu_msi *msi;
+	struct pci_class *class;
+
+	if (!pdev || !dst) {
+		return VMM_EFAIL;
+	}
+
+	class = PCI_DEVICE_TO_CLASS(pdev);
+	vmm_spin_lock_irqsave(&class->lock, flags);
+
+	msi = class->msi;
+	if (!msi || !msi->msix_cap || (msi->msix_bar != barnum)) {
+		rc = VMM_ENOTAVAIL;
+	} else if ((msi->msix_table_offset <= offset) &&
+		   (offset < (msi->msix_table_offset + msix_table_size(msi)))) {
+		val = ((u32 *)msi->msix_table)
+				[(offset - msi->msix_table_offset) / 4];
+	} else if ((msi->msix_pba_offset <= offset) &&
+		   (offset < (msi->msix_pba_offset + msix_pba_size(msi)))) {
+		val = msi->msix_pba[(offset - msi->msix_pba_offset) / 4];
+	} else {
+		rc = VMM_ENOTAVAIL;
+	}
+
+	vmm_spin_unlock_irqrestore(&class->lock, flags);
+
+	if (rc == VMM_OK) {
+		shift = (offset & 0x3) * 8;
+		val >>= shift;
+		if (size < 4) {
+			val &= (1U << (size * 8)) - 1;
+		}
+		*dst = val;
+	}
+
+	return rc;
+}
+
+/* Update part of a dword in MSI-X table
+ * Note: must be called with class->lock held. Returns TRUE if vector
+ * control was written so pending messages need to be flushed.
+ */
+static bool msix_table_write(struct pci_emu_msi *msi, u32 offset,
+			     u32 src, u32 size)
+{
+	u32 word, mask, shift, *ent;
+
+	word = (offset - msi->msix_table_offset) / 4;
+	ent = &((u32 *)msi->msix_table)[word];
+	shift = (offset & 0x3) * 8;
+	mask = (size < 4) ? ((1U << (size * 8)) - 1) : ~0U;
+	mask <<= shift;
+	*ent = (*ent & ~mask) | ((src << shift) & mask);
+	if ((word % 4) == 3) {
+		/* Only mask bit of vector control is writable */
+		*ent &= PCI_MSIX_ENTRY_CTRL_MASKBIT;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+int pci_emu_msix_bar_write(struct pci_device *pdev, u32 barnum,
+			   u32 offset, u64 src, u32 size)
+{
+	int rc = VMM_OK;
+	bool flush = FALSE;
+	irq_flags_t flags;
+	struct pci_emu_msi *msi;
+	struct pci_class *class;
+
+	if (!pdev) {
+		return VMM_EFAIL;
+	}
+
+	class = PCI_DEVICE_TO_CLASS(pdev);
+	vmm_spin_lock_irqsave(&class->lock, flags);
+
+	msi = class->msi;
+	if (!msi || !msi->msix_cap || (msi->msix_bar != barnum)) {
+		rc = VMM_ENOTAVAIL;
+	} else if ((msi->msix_table_offset <= offset) &&
+		   (offset < (msi->msix_table_offset + msix_table_size(msi)))) {
+		if (size == 8) {
+			/* Quadword store updates two consecutive dwords */
+			flush = msix_table_write(msi, offset, (u32)src, 4);
+			if ((offset + 4) < (msi->msix_table_offset +
+					    msix_table_size(msi))) {
+				flush |= msix_table_write(msi, offset + 4,
+							  (u32)(src >> 32), 4);
+			}
+		} else {
+			flush = msix_table_write(msi, offset, (u32)src, size);
+		}
+	} else if ((msi->msix_pba_offset <= offset) &&
+		   (offset < (msi->msix_pba_offset + msix_pba_size(msi)))) {
+		/* PBA is read-only */
+	} else {
+		rc = VMM_ENOTAVAIL;
+	}
+
+	vmm_spin_unlock_irqrestore(&class->lock, flags);
+
+	if (flush) {
+		__pci_emu_msi_flush(class);
+	}
+
+	return rc;
+}
@@ -0,0 +1,901 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file aplic.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief RISC-V Advanced Platform Level Interrupt Controller (APLIC) Emulator.
+ *
+ * The emulated APLIC is a supervisor-level root interrupt domain which
+ * supports both direct delivery mode (using one interrupt delivery
+ * control per VCPU) and MSI delivery mode (forwarding interrupts as
+ * MSIs to IMSIC interrupt files of VCPUs). The MSI delivery mode is
+ * available only when "msi_base_addr" DT attribute is provided and the
+ * MSI address configuration is preset (read-only) for the Guest.
+ *
+ * Example guest DTS node:
+ *	aplic {
+ *		manifest_type = "virtual";
+ *		address_type = "memory";
+ *		guest_physical_addr = <0x0d000000>;
+ *		physical_size = <0x8000>;
+ *		device_type = "pic";
+ *		compatible = "riscv,aplic";
+ *		base_irq = <0>;
+ *		num_irq = <96>;
+ *		parent_irq = <10>;
+ *		msi_base_addr = <0x0 0x28000000>;
+ *	};
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_modules.h>
+#include <vmm_spinlocks.h>
+#include <vmm_manager.h>
+#include <vmm_host_io.h>
+#include <vmm_vcpu_irq.h>
+#include <vmm_devemu.h>
+#include <libs/bitops.h>
+#include <libs/log2.h>
+#include <libs/stringlib.h>
+
+#define MODULE_DESC			"RISC-V APLIC Emulator"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			aplic_emulator_init
+#define	MODULE_EXIT			aplic_emulator_exit
+
+#define APLIC_MAX_SOURCES		1024
+#define APLIC_MAX_IDC			(1UL << 14)
+
+#define APLIC_DOMAINCFG			0x0000
+#define APLIC_DOMAINCFG_RDONLY		0x80000000
+#define APLIC_DOMAINCFG_IE		(1 << 8)
+#define APLIC_DOMAINCFG_DM		(1 << 2)
+
+#define APLIC_SOURCECFG_BASE		0x0004
+#define APLIC_SOURCECFG_D		(1 << 10)
+#define APLIC_SOURCECFG_SM_MASK		0x7
+#define APLIC_SOURCECFG_SM_INACTIVE	0x0
+#define APLIC_SOURCECFG_SM_DETACHED	0x1
+#define APLIC_SOURCECFG_SM_EDGE_RISE	0x4
+#define APLIC_SOURCECFG_SM_EDGE_FALL	0x5
+#define APLIC_SOURCECFG_SM_LEVEL_HIGH	0x6
+#define APLIC_SOURCECFG_SM_LEVEL_LOW	0x7
+
+#define APLIC_MMSICFGADDR		0x1bc0
+#define APLIC_MMSICFGADDRH		0x1bc4
+#define APLIC_SMSICFGADDR		0x1bc8
+#define APLIC_SMSICFGADDRH		0x1bcc
+#define APLIC_xMSICFGADDRH_L		(1UL << 31)
+#define APLIC_xMSICFGADDRH_LHXS_SHIFT	20
+#define APLIC_xMSICFGADDRH_LHXW_SHIFT	12
+#define APLIC_xMSICFGADDRH_PPN_MASK	0xfff
+
+#define APLIC_SETIP_BASE		0x1c00
+#define APLIC_SETIPNUM			0x1cdc
+#define APLIC_CLRIP_BASE		0x1d00
+#define APLIC_CLRIPNUM			0x1ddc
+#define APLIC_SETIE_BASE		0x1e00
+#define APLIC_SETIENUM			0x1edc
+#define APLIC_CLRIE_BASE		0x1f00
+#define APLIC_CLRIENUM			0x1fdc
+#define APLIC_SETIPNUM_LE		0x2000
+#define APLIC_SETIPNUM_BE		0x2004
+#define APLIC_GENMSI			0x3000
+#define APLIC_TARGET_BASE		0x3004
+
+#define APLIC_TARGET_HART_IDX_SHIFT	18
+#define APLIC_TARGET_HART_IDX_MASK	0x3fff
+#define APLIC_TARGET_GUEST_IDX_SHIFT	12
+#define APLIC_TARGET_GUEST_IDX_MASK	0x3f
+#define APLIC_TARGET_IPRIO_MASK		0xff
+#define APLIC_TARGET_EIID_MASK		0x7ff
+#define APLIC_GENMSI_BUSY		(1 << 12)
+
+#define APLIC_IDC_BASE			0x4000
+#define APLIC_IDC_SIZE			32
+#define APLIC_IDC_IDELIVERY		0x00
+#define APLIC_IDC_IFORCE		0x04
+#define APLIC_IDC_ITHRESHOLD		0x08
+#define APLIC_IDC_TOPI			0x18
+#define APLIC_IDC_CLAIMI		0x1c
+#define APLIC_IDC_TOPI_ID_SHIFT		16
+
+struct aplic_idc {
+	u32 idelivery;
+	u32 iforce;
+	u32 ithreshold;
+	/* Cached top pending interrupt of this IDC */
+	u32 topi;
+};
+
+struct aplic_state {
+	/* Guest to which this belongs */
+	struct vmm_guest *guest;
+
+	/* Static Configuration */
+	u32 base_irq;
+	u32 num_irq;
+	u32 num_irq_word;
+	u32 parent_irq;
+	bool msi_avail;
+	physical_addr_t msi_base;
+	u32 msi_lhxw;
+
+	/* Interrupt delivery controls (one per VCPU) */
+	u32 nr_idcs;
+	struct aplic_idc *idcs;
+
+	/* Global IRQ state */
+	vmm_spinlock_t lock;
+	u32 domaincfg;
+	u32 genmsi;
+	u32 sourcecfg[APLIC_MAX_SOURCES];
+	u32 target[APLIC_MAX_SOURCES];
+	u32 level[APLIC_MAX_SOURCES / 32];
+	u32 pending[APLIC_MAX_SOURCES / 32];
+	u32 enabled[APLIC_MAX_SOURCES / 32];
+};
+
+static inline bool aplic_msimode(struct aplic_state *s)
+{
+	return (s->domaincfg & APLIC_DOMAINCFG_DM) ? TRUE : FALSE;
+}
+
+static inline u32 aplic_sm(struct aplic_state *s, u32 irq)
+{
+	return s->sourcecfg[irq] & APLIC_SOURCECFG_SM_MASK;
+}
+
+/* Note: Must be called with s->lock held */
+static bool __aplic_rectified(struct aplic_state *s, u32 irq)
+{
+	bool raw = (s->level[irq / 32] & (1UL << (irq % 32))) ? TRUE : FALSE;
+
+	switch (aplic_sm(s, irq)) {
+	case APLIC_SOURCECFG_SM_EDGE_RISE:
+	case APLIC_SOURCECFG_SM_LEVEL_HIGH:
+		return raw;
+	case APLIC_SOURCECFG_SM_EDGE_FALL:
+	case APLIC_SOURCECFG_SM_LEVEL_LOW:
+		return !raw;
+	default:
+		break;
+	}
+
+	return FALSE;
+}
+
+/* Note: Must be called with s->lock held */
+static void __aplic_set_pending(struct aplic_state *s, u32 irq, bool pend)
+{
+	if (pend && (aplic_sm(s, irq) != APLIC_SOURCECFG_SM_INACTIVE)) {
+		s->pending[irq / 32] |= (1UL << (irq % 32));
+	} else {
+		s->pending[irq / 32] &= ~(1UL << (irq % 32));
+	}
+}
+
+/* Pending bit change requested through setip or in_clrip registers
+ * Note: Must be called with s->lock held
+ */
+static void __aplic_sw_pending(struct aplic_state *s, u32 irq, bool pend)
+{
+	if (!irq || s->num_irq <= irq) {
+		return;
+	}
+
+	switch (aplic_sm(s, irq)) {
+	case APLIC_SOURCECFG_SM_DETACHED:
+	case APLIC_SOURCECFG_SM_EDGE_RISE:
+	case APLIC_SOURCECFG_SM_EDGE_FALL:
+		__aplic_set_pending(s, irq, pend);
+		break;
+	case APLIC_SOURCECFG_SM_LEVEL_HIGH:
+	case APLIC_SOURCECFG_SM_LEVEL_LOW:
+		/* In direct mode, pending bit follows rectified input */
+		if (!aplic_msimode(s)) {
+			break;
+		}
+		if (!pend || __aplic_rectified(s, irq)) {
+			__aplic_set_pending(s, irq, pend);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/* Note: Must be called with s->lock held */
+static void __aplic_set_enabled(struct aplic_state *s, u32 irq, bool en)
+{
+	if (!irq || s->num_irq <= irq) {
+		return;
+	}
+
+	if (en && (aplic_sm(s, irq) != APLIC_SOURCECFG_SM_INACTIVE)) {
+		s->enabled[irq / 32] |= (1UL << (irq % 32));
+	} else {
+		s->enabled[irq / 32] &= ~(1UL << (irq % 32));
+	}
+}
+
+/* Recompute top interrupt of each IDC and update VCPU interrupt lines
+ * Note: Must be called with s->lock held
+ */
+static void __aplic_direct_update(struct aplic_state *s)
+{
+	bool ie = (s->domaincfg & APLIC_DOMAINCFG_IE) ? TRUE : FALSE;
+	u32 i, irq, word, hart, iprio, topi;
+	struct aplic_idc *idc;
+	struct vmm_vcpu *vcpu;
+
+	for (i = 0; i < s->nr_idcs; i++) {
+		s->idcs[i].topi = 0;
+	}
+
+	/*
+	 * Single pass over pending and enabled sources so that cost
+	 * does not grow with number of IDCs times number of sources.
+	 */
+	for (i = 0; !aplic_msimode(s) && (i < s->num_irq_word); i++) {
+		word = s->pending[i] & s->enabled[i];
+		while (word) {
+			irq = i * 32 + __ffs(word);
+			word &= ~(1UL << (irq % 32));
+
+			hart = s->target[irq] >> APLIC_TARGET_HART_IDX_SHIFT;
+			if (s->nr_idcs <= hart) {
+				continue;
+			}
+			idc = &s->idcs[hart];
+
+			iprio = s->target[irq] & APLIC_TARGET_IPRIO_MASK;
+			if (idc->ithreshold && (idc->ithreshold <= iprio)) {
+				continue;
+			}
+
+			/* Lower priority number and then lower ID wins */
+			topi = (irq << APLIC_IDC_TOPI_ID_SHIFT) | iprio;
+			if (!idc->topi ||
+			    (iprio < (idc->topi & APLIC_TARGET_IPRIO_MASK))) {
+				idc->topi = topi;
+			}
+		}
+	}
+
+	for (i = 0; i < s->nr_idcs; i++) {
+		idc = &s->idcs[i];
+		vcpu = vmm_manager_guest_vcpu(s->guest, i);
+		if (!vcpu) {
+			continue;
+		}
+		if (!aplic_msimode(s) && ie && idc->idelivery &&
+		    (idc->topi || idc->iforce)) {
+			vmm_vcpu_irq_assert(vcpu, s->parent_irq, 0x0);
+		} else {
+			vmm_vcpu_irq_deassert(vcpu, s->parent_irq);
+		}
+	}
+}
+
+static physical_addr_t aplic_msi_addr(struct aplic_state *s,
+				      u32 hart, u32 guest)
+{
+	hart &= (1UL << s->msi_lhxw) - 1;
+
+	return s->msi_base + ((physical_addr_t)hart << 12) +
+	       ((physical_addr_t)guest << 12);
+}
+
+/* Forward pending and enabled interrupts as MSIs
+ * Note: Must be called without s->lock held because MSI targets
+ * can be emulated devices which in-turn trigger wired interrupts.
+ */
+static void aplic_msi_forward(struct aplic_state *s)
+{
+	bool found;
+	irq_flags_t flags;
+	u32 i, irq, word, target;
+	physical_addr_t addr;
+
+	while (1) {
+		found = FALSE;
+		irq = 0;
+		addr = 0;
+		target = 0;
+
+		vmm_spin_lock_irqsave(&s->lock, flags);
+
+		if (aplic_msimode(s) &&
+		    (s->domaincfg & APLIC_DOMAINCFG_IE)) {
+			for (i = 0; i < s->num_irq_word; i++) {
+				word = s->pending[i] & s->enabled[i];
+				if (word) {
+					irq = i * 32 + __ffs(word);
+					found = TRUE;
+					break;
+				}
+			}
+		}
+
+		if (found) {
+			target = s->target[irq];
+			addr = aplic_msi_addr(s,
+				target >> APLIC_TARGET_HART_IDX_SHIFT,
+				(target >> APLIC_TARGET_GUEST_IDX_SHIFT) &
+				APLIC_TARGET_GUEST_IDX_MASK);
+			__aplic_set_pending(s, irq, FALSE);
+		}
+
+		vmm_spin_unlock_irqrestore(&s->lock, flags);
+
+		if (!found) {
+			break;
+		}
+
+		vmm_devemu_emulate_msi(s->guest, addr,
+				       target & APLIC_TARGET_EIID_MASK, irq);
+	}
+}
+
+static void aplic_irq_handle(u32 irq, int cpu, int level, void *opaque)
+{
+	bool old, new;
+	irq_flags_t flags;
+	struct aplic_state *s = opaque;
+
+	if (irq < s->base_irq || (s->base_irq + s->num_irq) <= irq) {
+		return;
+	}
+	irq -= s->base_irq;
+	if (irq == 0) {
+		return;
+	}
+
+	vmm_spin_lock_irqsave(&s->lock, flags);
+
+	old = __aplic_rectified(s, irq);
+	if (level) {
+		s->level[irq / 32] |= (1UL << (irq % 32));
+	} else {
+		s->level[irq / 32] &= ~(1UL << (irq % 32));
+	}
+	new = __aplic_rectified(s, irq);
+
+	switch (aplic_sm(s, irq)) {
+	case APLIC_SOURCECFG_SM_EDGE_RISE:
+	case APLIC_SOURCECFG_SM_EDGE_FALL:
+		if (!old && new) {
+			__aplic_set_pending(s, irq, TRUE);
+		}
+		break;
+	case APLIC_SOURCECFG_SM_LEVEL_HIGH:
+	case APLIC_SOURCECFG_SM_LEVEL_LOW:
+		if (!aplic_msimode(s)) {
+			__aplic_set_pending(s, irq, new);
+		} else if (!old && new) {
+			__aplic_set_pending(s, irq, TRUE);
+		} else if (!new) {
+			__aplic_set_pending(s, irq, FALSE);
+		}
+		break;
+	default:
+		break;
+	}
+
+	__aplic_direct_update(s);
+
+	vmm_spin_unlock_irqrestore(&s->lock, flags);
+
+	aplic_msi_forward(s);
+}
+
+/* Note: Must be called with s->lock held */
+static u32 __aplic_idc_claim(struct aplic_state *s, struct aplic_idc *idc)
+{
+	u32 irq, topi = idc->topi;
+
+	if (!topi) {
+		/* Spurious external interrupt clears iforce */
+		idc->iforce = 0;
+		return 0;
+	}
+
+	/* Level sensitive pending bit follows input in direct mode */
+	irq = topi >> APLIC_IDC_TOPI_ID_SHIFT;
+	switch (aplic_sm(s, irq)) {
+	case APLIC_SOURCECFG_SM_LEVEL_HIGH:
+	case APLIC_SOURCECFG_SM_LEVEL_LOW:
+		__aplic_set_pending(s, irq, __aplic_rectified(s, irq));
+		break;
+	default:
+		__aplic_set_pending(s, irq, FALSE);
+		break;
+	}
+
+	return topi;
+}
+
+/* Note: Must be called with s->lock held */
+static u32 __aplic_read_word(struct aplic_state *s, u32 *bitmap,
+			     physical_addr_t offset)
+{
+	u32 i = offset / 4;
+
+	return (i < s->num_irq_word) ? bitmap[i] : 0;
+}
+
+/* Note: Must be called with s->lock held */
+static u32 __aplic_read_rectified(struct aplic_state *s,
+				  physical_addr_t offset)
+{
+	u32 i, irq, ret = 0, word = offset / 4;
+
+	for (i = 0; i < 32; i++) {
+		irq = word * 32 + i;
+		if (irq && (irq < s->num_irq) && __aplic_rectified(s, irq)) {
+			ret |= (1UL << i);
+		}
+	}
+
+	return ret;
+}
+
+static int aplic_reg_read(struct aplic_state *s,
+			  physical_addr_t offset, u32 *dst)
+{
+	u32 irq, idx;
+	irq_flags_t flags;
+	struct aplic_idc *idc;
+
+	offset &= ~0x3;
+
+	vmm_spin_lock_irqsave(&s->lock, flags);
+
+	*dst = 0;
+	if (offset == APLIC_DOMAINCFG) {
+		*dst = APLIC_DOMAINCFG_RDONLY | s->domaincfg;
+	} else if (APLIC_SOURCECFG_BASE <= offset &&
+		   offset < (APLIC_SOURCECFG_BASE + (APLIC_MAX_SOURCES - 1) * 4)) {
+		irq = (offset - APLIC_SOURCECFG_BASE) / 4 + 1;
+		if (irq < s->num_irq) {
+			*dst = s->sourcecfg[irq];
+		}
+	} else if ((offset == APLIC_MMSICFGADDR ||
+		    offset == APLIC_SMSICFGADDR) && s->msi_avail) {
+		*dst = (u32)(s->msi_base >> 12);
+	} else if ((offset == APLIC_MMSICFGADDRH ||
+		    offset == APLIC_SMSICFGADDRH) && s->msi_avail) {
+		*dst = (u32)((u64)s->msi_base >> 44) &
+			APLIC_xMSICFGADDRH_PPN_MASK;
+		if (offset == APLIC_MMSICFGADDRH) {
+			*dst |= APLIC_xMSICFGADDRH_L;
+			*dst |= s->msi_lhxw << APLIC_xMSICFGADDRH_LHXW_SHIFT;
+		}
+	} else if (APLIC_SETIP_BASE <= offset && offset < APLIC_SETIPNUM) {
+		*dst = __aplic_read_word(s, s->pending,
+					 offset - APLIC_SETIP_BASE);
+	} else if (APLIC_CLRIP_BASE <= offset && offset < APLIC_CLRIPNUM) {
+		*dst = __aplic_read_rectified(s, offset - APLIC_CLRIP_BASE);
+	} else if (APLIC_SETIE_BASE <= offset && offset < APLIC_SETIENUM) {
+		*dst = __aplic_read_word(s, s->enabled,
+					 offset - APLIC_SETIE_BASE);
+	} else if (offset == APLIC_GENMSI) {
+		*dst = s->genmsi;
+	} else if (APLIC_TARGET_BASE <= offset &&
+		   offset < (APLIC_TARGET_BASE + (APLIC_MAX_SOURCES - 1) * 4)) {
+		irq = (offset - APLIC_TARGET_BASE) / 4 + 1;
+		if (irq < s->num_irq) {
+			*dst = s->target[irq];
+		}
+	} else if (APLIC_IDC_BASE <= offset &&
+		   offset < (APLIC_IDC_BASE + s->nr_idcs * APLIC_IDC_SIZE)) {
+		idx = (offset - APLIC_IDC_BASE) / APLIC_IDC_SIZE;
+		idc = &s->idcs[idx];
+		switch ((offset - APLIC_IDC_BASE) % APLIC_IDC_SIZE) {
+		case APLIC_IDC_IDELIVERY:
+			*dst = idc->idelivery;
+			break;
+		case APLIC_IDC_IFORCE:
+			*dst = idc->iforce;
+			break;
+		case APLIC_IDC_ITHRESHOLD:
+			*dst = idc->ithreshold;
+			break;
+		case APLIC_IDC_TOPI:
+			*dst = idc->topi;
+			break;
+		case APLIC_IDC_CLAIMI:
+			*dst = __aplic_idc_claim(s, idc);
+			__aplic_direct_update(s);
+			break;
+		default:
+			break;
+		}
+	}
+
+	vmm_spin_unlock_irqrestore(&s->lock, flags);
+
+	return VMM_OK;
+}
+
+/* Note: Must be called with s->lock held */
+static void __aplic_write_sourcecfg(struct aplic_state *s, u32 irq, u32 val)
+{
+	u32 sm = val & APLIC_SOURCECFG_SM_MASK;
+
+	/* Delegation to child domains is not supported */
+	if (val & APLIC_SOURCECFG_D) {
+		sm = APLIC_SOURCECFG_SM_INACTIVE;
+	}
+
+	switch (sm) {
+	case APLIC_SOURCECFG_SM_DETACHED:
+	case APLIC_SOURCECFG_SM_EDGE_RISE:
+	case APLIC_SOURCECFG_SM_EDGE_FALL:
+		break;
+	case APLIC_SOURCECFG_SM_LEVEL_HIGH:
+	case APLIC_SOURCECFG_SM_LEVEL_LOW:
+		s->sourcecfg[irq] = sm;
+		if (!aplic_msimode(s)) {
+			__aplic_set_pending(s, irq, __aplic_rectified(s, irq));
+		}
+		return;
+	default:
+		sm = APLIC_SOURCECFG_SM_INACTIVE;
+		break;
+	}
+
+	s->sourcecfg[irq] = sm;
+	if (sm == APLIC_SOURCECFG_SM_INACTIVE) {
+		__aplic_set_pending(s, irq, FALSE);
+		__aplic_set_enabled(s, irq, FALSE);
+		s->target[irq] = 0;
+	}
+}
+
+/* Note: Must be called with s->lock held */
+static void __aplic_write_target(struct aplic_state *s, u32 irq, u32 val)
+{
+	u32 hart = (val >> APLIC_TARGET_HART_IDX_SHIFT) &
+		   APLIC_TARGET_HART_IDX_MASK;
+
+	if (aplic_sm(s, irq) == APLIC_SOURCECFG_SM_INACTIVE) {
+		return;
+	}
+
+	if (aplic_msimode(s)) {
+		val &= (APLIC_TARGET_HART_IDX_MASK <<
+			APLIC_TARGET_HART_IDX_SHIFT) |
+		       (APLIC_TARGET_GUEST_IDX_MASK <<
+			APLIC_TARGET_GUEST_IDX_SHIFT) |
+		       APLIC_TARGET_EIID_MASK;
+	} else {
+		val &= APLIC_TARGET_IPRIO_MASK;
+		if (!val) {
+			val = 1;
+		}
+		if (s->nr_idcs <= hart) {
+			hart = 0;
+		}
+		val |= hart << APLIC_TARGET_HART_IDX_SHIFT;
+	}
+
+	s->target[irq] = val;
+}
+
+/* Note: Must be called with s->lock held */
+static void __aplic_write_word(struct aplic_state *s, physical_addr_t offset,
+			       u32 val, bool pend, bool set)
+{
+	u32 i, word = offset / 4;
+
+	if (s->num_irq_word <= word) {
+		return;
+	}
+
+	for (i = 0; i < 32; i++) {
+		if (!(val & (1UL << i))) {
+			continue;
+		}
+		if (pend) {
+			__aplic_sw_pending(s, word * 32 + i, set);
+		} else {
+			__aplic_set_enabled(s, word * 32 + i, set);
+		}
+	}
+}
+
+/* Note: Must be called with s->lock held */
+static void __aplic_write_genmsi(struct aplic_state *s, u32 val)
+{
+	val &= (APLIC_TARGET_HART_IDX_MASK << APLIC_TARGET_HART_IDX_SHIFT) |
+	       APLIC_TARGET_EIID_MASK;
+	s->genmsi = val;
+}
+
+static int aplic_reg_write(struct aplic_state *s, physical_addr_t offset,
+			   u32 src_mask, u32 src)
+{
+	u32 irq, idx, val;
+	bool genmsi = FALSE;
+	irq_flags_t flags;
+	struct aplic_idc *idc;
+
+	offset &= ~0x3;
+
+	vmm_spin_lock_irqsave(&s->lock, flags);
+
+	/* Partial writes are merged with current register value below */
+	val = src & ~src_mask;
+
+	if (offset == APLIC_DOMAINCFG) {
+		val |= (s->domaincfg & src_mask);
+		s->domaincfg = val & APLIC_DOMAINCFG_IE;
+		if (s->msi_avail) {
+			s->domaincfg |= val & APLIC_DOMAINCFG_DM;
+		}
+	} else if (APLIC_SOURCECFG_BASE <= offset &&
+		   offset < (APLIC_SOURCECFG_BASE + (APLIC_MAX_SOURCES - 1) * 4)) {
+		irq = (offset - APLIC_SOURCECFG_BASE) / 4 + 1;
+		if (irq < s->num_irq) {
+			val |= (s->sourcecfg[irq] & src_mask);
+			__aplic_write_sourcecfg(s, irq, val);
+		}
+	} else if (APLIC_SETIP_BASE <= offset && offset < APLIC_SETIPNUM) {
+		__aplic_write_word(s, offset - APLIC_SETIP_BASE,
+				   val, TRUE, TRUE);
+	} else if (offset == APLIC_SETIPNUM || offset == APLIC_SETIPNUM_LE) {
+		__aplic_sw_pending(s, val, TRUE);
+	} else if (offset == APLIC_SETIPNUM_BE) {
+		__aplic_sw_pending(s, vmm_be32_to_cpu(vmm_cpu_to_le32(val)),
+				   TRUE);
+	} else if (APLIC_CLRIP_BASE <= offset && offset < APLIC_CLRIPNUM) {
+		__aplic_write_word(s, offset - APLIC_CLRIP_BASE,
+				   val, TRUE, FALSE);
+	} else if (offset == APLIC_CLRIPNUM) {
+		__aplic_sw_pending(s, val, FALSE);
+	} else if (APLIC_SETIE_BASE <= offset && offset < APLIC_SETIENUM) {
+		__aplic_write_word(s, offset - APLIC_SETIE_BASE,
+				   val, FALSE, TRUE);
+	} else if (offset == APLIC_SETIENUM) {
+		__aplic_set_enabled(s, val, TRUE);
+	} else if (APLIC_CLRIE_BASE <= offset && offset < APLIC_CLRIENUM) {
+		__aplic_write_word(s, offset - APLIC_CLRIE_BASE,
+				   val, FALSE, FALSE);
+	} else if (offset == APLIC_CLRIENUM) {
+		__aplic_set_enabled(s, val, FALSE);
+	} else if (offset == APLIC_GENMSI) {
+		if (aplic_msimode(s)) {
+			__aplic_write_genmsi(s, val | (s->genmsi & src_mask));
+			genmsi = TRUE;
+		}
+	} else if (APLIC_TARGET_BASE <= offset &&
+		   offset < (APLIC_TARGET_BASE + (APLIC_MAX_SOURCES - 1) * 4)) {
+		irq = (offset - APLIC_TARGET_BASE) / 4 + 1;
+		if (irq < s->num_irq) {
+			val |= (s->target[irq] & src_mask);
+			__aplic_write_target(s, irq, val);
+		}
+	} else if (APLIC_IDC_BASE <= offset &&
+		   offset < (APLIC_IDC_BASE + s->nr_idcs * APLIC_IDC_SIZE)) {
+		idx = (offset - APLIC_IDC_BASE) / APLIC_IDC_SIZE;
+		idc = &s->idcs[idx];
+		switch ((offset - APLIC_IDC_BASE) % APLIC_IDC_SIZE) {
+		case APLIC_IDC_IDELIVERY:
+			idc->idelivery = (val | (idc->idelivery & src_mask)) & 0x1;
+			break;
+		case APLIC_IDC_IFORCE:
+			idc->iforce = (val | (idc->iforce & src_mask)) & 0x1;
+			break;
+		case APLIC_IDC_ITHRESHOLD:
+			idc->ithreshold = (val | (idc->ithreshold & src_mask)) &
+					  APLIC_TARGET_IPRIO_MASK;
+			break;
+		default:
+			break;
+		}
+	}
+
+	__aplic_direct_update(s);
+
+	val = s->genmsi;
+
+	vmm_spin_unlock_irqrestore(&s->lock, flags);
+
+	/* Extempore MSI requested through genmsi register */
+	if (genmsi) {
+		vmm_devemu_emulate_msi(s->guest,
+			aplic_msi_addr(s, val >> APLIC_TARGET_HART_IDX_SHIFT, 0),
+			val & APLIC_TARGET_EIID_MASK, 0);
+	}
+
+	aplic_msi_forward(s);
+
+	return VMM_OK;
+}
+
+static int aplic_emulator_read(struct vmm_emudev *edev,
+			       physical_addr_t offset,
+			       u32 *dst, u32 size)
+{
+	return aplic_reg_read(edev->priv, offset, dst);
+}
+
+static int aplic_emulator_write(struct vmm_emudev *edev,
+				physical_addr_t offset,
+				u32 src_mask, u32 src, u32 size)
+{
+	return aplic_reg_write(edev->priv, offset, src_mask, src);
+}
+
+static int aplic_emulator_reset(struct vmm_emudev *edev)
+{
+	irq_flags_t flags;
+	struct aplic_state *s = edev->priv;
+
+	vmm_spin_lock_irqsave(&s->lock, flags);
+
+	s->domaincfg = 0;
+	s->genmsi = 0;
+	memset(s->sourcecfg, 0, sizeof(s->sourcecfg));
+	memset(s->target, 0, sizeof(s->target));
+	memset(s->pending, 0, sizeof(s->pending));
+	memset(s->enabled, 0, sizeof(s->enabled));
+	memset(s->idcs, 0, sizeof(*s->idcs) * s->nr_idcs);
+	__aplic_direct_update(s);
+
+	vmm_spin_unlock_irqrestore(&s->lock, flags);
+
+	return VMM_OK;
+}
+
+static struct vmm_devemu_irqchip aplic_irqchip = {
+	.name = "APLIC",
+	.handle = aplic_irq_handle,
+};
+
+static int aplic_emulator_probe(struct vmm_guest *guest,
+				struct vmm_emudev *edev,
+				const struct vmm_devtree_nodeid *eid)
+{
+	u32 i;
+	int rc = VMM_OK;
+	struct aplic_state *s;
+
+	s = vmm_zalloc(sizeof(struct aplic_state));
+	if (!s) {
+		rc = VMM_ENOMEM;
+		goto aplic_emulator_probe_done;
+	}
+	s->guest = guest;
+
+	if (vmm_devtree_read_u32(edev->node, "base_irq", &s->base_irq)) {
+		s->base_irq = 0;
+	}
+
+	if (vmm_devtree_read_u32(edev->node, "num_irq", &s->num_irq)) {
+		s->num_irq = APLIC_MAX_SOURCES - 1;
+	}
+	s->num_irq += 1; /* IRQ0 is dummy */
+	if (s->num_irq > APLIC_MAX_SOURCES) {
+		rc = VMM_EINVALID;
+		goto aplic_emulator_probe_freestate_fail;
+	}
+	s->num_irq_word = s->num_irq / 32;
+	if ((s->num_irq_word * 32) < s->num_irq)
+		s->num_irq_word++;
+
+	rc = vmm_devtree_read_u32(edev->node, "parent_irq", &s->parent_irq);
+	if (rc) {
+		goto aplic_emulator_probe_freestate_fail;
+	}
+
+	/* MSI delivery mode needs IMSIC interrupt files of VCPUs */
+	if (!vmm_devtree_read_physaddr(edev->node, "msi_base_addr",
+				       &s->msi_base)) {
+		s->msi_avail = TRUE;
+		s->msi_lhxw = (guest->vcpu_count > 1) ?
+			      ilog2(roundup_pow_of_two(guest->vcpu_count)) : 0;
+	}
+
+	s->nr_idcs = guest->vcpu_count;
+	if ((s->nr_idcs > APLIC_MAX_IDC) ||
+	    (edev->reg->phys_size <
+	     (APLIC_IDC_BASE + s->nr_idcs * APLIC_IDC_SIZE))) {
+		rc = VMM_ENODEV;
+		goto aplic_emulator_probe_freestate_fail;
+	}
+
+	s->idcs = vmm_zalloc(sizeof(*s->idcs) * s->nr_idcs);
+	if (!s->idcs) {
+		rc = VMM_ENOMEM;
+		goto aplic_emulator_probe_freestate_fail;
+	}
+
+	INIT_SPIN_LOCK(&s->lock);
+	edev->priv = s;
+
+	for (i = s->base_irq; i < (s->base_irq + s->num_irq); i++) {
+		vmm_devemu_register_irqchip(guest, i, &aplic_irqchip, s);
+	}
+
+	goto aplic_emulator_probe_done;
+
+aplic_emulator_probe_freestate_fail:
+	vmm_free(s);
+aplic_emulator_probe_done:
+	return rc;
+}
+
+static int aplic_emulator_remove(struct vmm_emudev *edev)
+{
+	u32 i;
+	struct aplic_state *s = edev->priv;
+
+	if (!s) {
+		return VMM_EFAIL;
+	}
+
+	for (i = s->base_irq; i < (s->base_irq + s->num_irq); i++) {
+		vmm_devemu_unregister_irqchip(s->guest, i, &aplic_irqchip, s);
+	}
+	vmm_free(s->idcs);
+	vmm_free(s);
+	edev->priv = NULL;
+
+	return VMM_OK;
+}
+
+static struct vmm_devtree_nodeid aplic_emulator_emuid_table[] = {
+	{ .type = "pic",
+	  .compatible = "riscv,aplic",
+	},
+	{ /* end of list */ },
+};
+
+VMM_DECLARE_EMULATOR_SIMPLE(aplic_emulator,
+			    "aplic",
+			    aplic_emulator_emuid_table,
+			    VMM_DEVEMU_LITTLE_ENDIAN,
+			    aplic_emulator_probe,
+			    aplic_emulator_remove,
+			    aplic_emulator_reset,
+			    NULL,
+			    aplic_emulator_read,
+			    aplic_emulator_write);
+
+static int __init aplic_emulator_init(void)
+{
+	return vmm_devemu_register_emulator(&aplic_emulator);
+}
+
+static void __exit aplic_emulator_exit(void)
+{
+	vmm_devemu_unregister_emulator(&aplic_emulator);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+		   MODULE_AUTHOR,
+		   MODULE_LICENSE,
+		   MODULE_IPRIORITY,
+		   MODULE_INIT,
+		   MODULE_EXIT);
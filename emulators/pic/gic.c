@@ -37,6 +37,7 @@
 #include <vmm_scheduler.h>
 #include <vmm_vcpu_irq.h>
 #include <vmm_devemu.h>
+#include <libs/bitops.h>
 #include <libs/stringlib.h>
 #include <emu/gic_emulator.h>
 
@@ -49,6 +50,8 @@
 
 #define GIC_MAX_NCPU			8
 #define GIC_MAX_NIRQ			256
+#define GIC_NIRQ_WORDS			(GIC_MAX_NIRQ / 32)
+#define GIC_NUM_PRIO			16
 
 struct memory_region {
 	u32 offset;
@@ -78,6 +81,12 @@ struct gic_cpu_state {
 	u8 priority[32];
 };
 
+/* Pending and enabled IRQs of a CPU interface bucketed by priority */
+struct gic_pend_state {
+	u32 prio_map;
+	u32 irq_map[GIC_NUM_PRIO][GIC_NIRQ_WORDS];
+};
+
 struct gic_state {
 	struct vmm_guest *guest;
 
@@ -100,17 +109,30 @@ struct gic_state {
 	struct memory_region dist;
 	vmm_rwlock_t dist_lock;
 	struct gic_irq_state irq_state[GIC_MAX_NIRQ];
+	struct gic_pend_state pend_state[GIC_MAX_NCPU];
 };
 
 #define GIC_ALL_CPU_MASK(s) ((1 << (s)->num_cpu) - 1)
 #define GIC_NUM_CPU(s) ((s)->num_cpu)
 #define GIC_NUM_IRQ(s) ((s)->num_irq)
 #define GIC_BASE_IRQ(s) ((s)->base_irq)
-#define GIC_SET_ENABLED(s, irq, cm) (s)->irq_state[irq].enabled |= (cm)
-#define GIC_CLEAR_ENABLED(s, irq, cm) (s)->irq_state[irq].enabled &= ~(cm)
+#define GIC_SET_ENABLED(s, irq, cm) do { \
+	(s)->irq_state[irq].enabled |= (cm); \
+	__gic_pend_update(s, irq, FALSE); \
+} while (0)
+#define GIC_CLEAR_ENABLED(s, irq, cm) do { \
+	(s)->irq_state[irq].enabled &= ~(cm); \
+	__gic_pend_update(s, irq, FALSE); \
+} while (0)
 #define GIC_TEST_ENABLED(s, irq, cm) ((s)->irq_state[irq].enabled & (cm))
-#define GIC_SET_PENDING(s, irq, cm) (s)->irq_state[irq].pending |= (cm)
-#define GIC_CLEAR_PENDING(s, irq, cm) (s)->irq_state[irq].pending &= ~(cm)
+#define GIC_SET_PENDING(s, irq, cm) do { \
+	(s)->irq_state[irq].pending |= (cm); \
+	__gic_pend_update(s, irq, FALSE); \
+} while (0)
+#define GIC_CLEAR_PENDING(s, irq, cm) do { \
+	(s)->irq_state[irq].pending &= ~(cm); \
+	__gic_pend_update(s, irq, FALSE); \
+} while (0)
 #define GIC_TEST_PENDING(s, irq, cm) ((s)->irq_state[irq].pending & (cm))
 #define GIC_SET_ACTIVE(s, irq, cm) (s)->irq_state[irq].active |= (cm)
 #define GIC_CLEAR_ACTIVE(s, irq, cm) (s)->irq_state[irq].active &= ~(cm)
@@ -128,18 +150,76 @@ struct gic_state {
   (((irq) < 32) ? (s)->cpu_state[cpu].priority[irq] : (s)->irq_state[irq].priority)
 #define GIC_TARGET(s, irq) (s)->irq_state[irq].target
 
+static void __gic_pend_set(struct gic_pend_state *ps,
+			   int prio, int irq, bool pend)
+{
+	int i;
+	u32 *map = ps->irq_map[prio];
+
+	if (pend) {
+		map[irq / 32] |= (1 << (irq % 32));
+		ps->prio_map |= (1 << prio);
+		return;
+	}
+
+	map[irq / 32] &= ~(1 << (irq % 32));
+	for (i = 0; i < GIC_NIRQ_WORDS; i++) {
+		if (map[i]) {
+			return;
+		}
+	}
+	ps->prio_map &= ~(1 << prio);
+}
+
+/* Sync pending bitmaps of all CPU interfaces with state of given IRQ.
+ * Passing del == TRUE removes the IRQ so that its priority can change.
+ * Note: Must be called with dist_lock held for writing
+ */
+static void __gic_pend_update(struct gic_state *s, int irq, bool del)
+{
+	int cpu, cm;
+
+	for (cpu = 0; cpu < GIC_NUM_CPU(s); cpu++) {
+		cm = 1 << cpu;
+		__gic_pend_set(&s->pend_state[cpu],
+			       GIC_GET_PRIORITY(s, irq, cpu), irq,
+			       !del && GIC_TEST_ENABLED(s, irq, cm) &&
+			       GIC_TEST_PENDING(s, irq, cm));
+	}
+}
+
+/* Note: Must be called with dist_lock held */
+static int __gic_pend_best(struct gic_state *s, int cpu, int *best_prio)
+{
+	int i, prio;
+	struct gic_pend_state *ps = &s->pend_state[cpu];
+
+	if (!ps->prio_map) {
+		return 1023;
+	}
+
+	prio = __ffs(ps->prio_map);
+	for (i = 0; i < GIC_NIRQ_WORDS; i++) {
+		if (ps->irq_map[prio][i]) {
+			*best_prio = prio;
+			return i * 32 + __ffs(ps->irq_map[prio][i]);
+		}
+	}
+
+	return 1023;
+}
+
 /* Update interrupt status after enabled or pending bits have been changed. */
 static void gic_update(struct gic_state *s)
 {
 	irq_flags_t dist_flags, cpu_flags;
 	int best_irq, best_prio;
-	int irq, level, cpu, cm;
+	int level, cpu;
 	struct vmm_vcpu *vcpu;
 	struct gic_cpu_state *cpu_state;
 
 	for (cpu = 0; cpu < GIC_NUM_CPU(s); cpu++) {
 		cpu_state = &s->cpu_state[cpu];
-		cm = 1 << cpu;
 
 		vmm_write_lock_irqsave(&cpu_state->cpu_lock, cpu_flags);
 
@@ -154,20 +234,10 @@ static void gic_update(struct gic_state *s)
 			break;
 		}
 		best_prio = 0x100;
-		best_irq = 1023;
 
 		vmm_read_lock_irqsave(&s->dist_lock, dist_flags);
 
-		for (irq = 0; irq < GIC_NUM_IRQ(s); irq++) {
-			if (GIC_TEST_ENABLED(s, irq, cm) &&
-			    GIC_TEST_PENDING(s, irq, cm)) {
-				if (GIC_GET_PRIORITY(s, irq, cpu) < best_prio) {
-					best_prio =
-						GIC_GET_PRIORITY(s, irq, cpu);
-					best_irq = irq;
-				}
-			}
-		}
+		best_irq = __gic_pend_best(s, cpu, &best_prio);
 
 		vmm_read_unlock_irqrestore(&s->dist_lock, dist_flags);
 
@@ -579,11 +649,13 @@ static int __gic_dist_writeb(struct gic_state *s, int cpu, u32 offset, u8 src)
 			done = 0;
 			break;
 		}
+		__gic_pend_update(s, irq, TRUE);
 		if (irq < 32) {
 			s->cpu_state[cpu].priority[irq] = src >> 4;
 		} else {
 			s->irq_state[irq].priority = src >> 4;
 		}
+		__gic_pend_update(s, irq, FALSE);
 		break;
 	case 0x8: /* CPU targets */
 		irq = offset - 0x800;
@@ -667,7 +739,7 @@ static int gic_dist_write(struct gic_state *s, int cpu, u32 offset,
 
 	if (offset == 0xF00) {
 		/* Software Interrupt */
-		irq = src & 0x3ff;
+		irq = src & 0xf;
 		switch ((src >> 24) & 3) {
 		case 0:
 			mask = (src >> 16) & GIC_ALL_CPU_MASK(s);
@@ -0,0 +1,291 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file gicv2m.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief ARM GICv2m MSI frame Emulator.
+ *
+ * The GICv2m MSI frame translates writes to its MSI_SETSPI_NS register
+ * into edge triggered SPIs of the guest GIC distributor (emulated by
+ * GIC emulator or VGIC). It is registered as MSI chip for its frame so
+ * that MSIs of emulated PCI devices are delivered as SPIs directly.
+ *
+ * Example guest DTS node:
+ *	gic_v2m {
+ *		manifest_type = "virtual";
+ *		address_type = "memory";
+ *		guest_physical_addr = <0x08020000>;
+ *		physical_size = <0x1000>;
+ *		device_type = "pic";
+ *		compatible = "arm,gic-v2m-frame";
+ *		base_irq = <64>;
+ *		num_irq = <32>;
+ *	};
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_modules.h>
+#include <vmm_devemu.h>
+
+#define MODULE_DESC			"GICv2m MSI Frame Emulator"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		0
+#define	MODULE_INIT			gicv2m_emulator_init
+#define	MODULE_EXIT			gicv2m_emulator_exit
+
+#define V2M_MSI_TYPER			0x008
+#define V2M_MSI_SETSPI_NS		0x040
+#define V2M_MSI_IIDR			0xFCC
+
+#define V2M_MSI_TYPER_BASE_SHIFT	16
+#define V2M_MSI_TYPER_BASE_MASK		0x3FF
+#define V2M_MSI_TYPER_NUM_MASK		0x3FF
+
+#define V2M_MIN_SPI			32
+#define V2M_MAX_SPI			1019
+
+struct gicv2m_state {
+	struct vmm_guest *guest;
+	physical_addr_t addr;
+	u32 base_irq;
+	u32 num_irq;
+};
+
+static void gicv2m_setspi(struct gicv2m_state *s, u32 irq)
+{
+	/* Ignore writes of SPIs which are not owned by MSI frame */
+	if ((irq < s->base_irq) || ((s->base_irq + s->num_irq) <= irq)) {
+		return;
+	}
+
+	/* MSIs are edge triggered */
+	vmm_devemu_emulate_irq(s->guest, irq, 1);
+	vmm_devemu_emulate_irq(s->guest, irq, 0);
+}
+
+static void gicv2m_msi_handle(physical_addr_t addr, u32 data,
+			      u32 devid, void *opaque)
+{
+	struct gicv2m_state *s = opaque;
+
+	if ((addr - s->addr) == V2M_MSI_SETSPI_NS) {
+		gicv2m_setspi(s, data);
+	}
+}
+
+static struct vmm_devemu_msichip gicv2m_msichip = {
+	.name = "GICv2m",
+	.handle = gicv2m_msi_handle,
+};
+
+static int gicv2m_reg_read(struct gicv2m_state *s,
+			   u32 offset, u32 *dst)
+{
+	switch (offset & ~0x3) {
+	case V2M_MSI_TYPER:
+		*dst = ((s->base_irq & V2M_MSI_TYPER_BASE_MASK) <<
+			V2M_MSI_TYPER_BASE_SHIFT) |
+		       (s->num_irq & V2M_MSI_TYPER_NUM_MASK);
+		break;
+	case V2M_MSI_IIDR:
+	default:
+		*dst = 0x0;
+		break;
+	}
+
+	*dst = *dst >> ((offset & 0x3) * 8);
+
+	return VMM_OK;
+}
+
+static int gicv2m_reg_write(struct gicv2m_state *s,
+			    u32 offset, u32 src_mask, u32 src)
+{
+	if (offset == V2M_MSI_SETSPI_NS) {
+		gicv2m_setspi(s, src & ~src_mask);
+	}
+
+	return VMM_OK;
+}
+
+static int gicv2m_emulator_read8(struct vmm_emudev *edev,
+				 physical_addr_t offset,
+				 u8 *dst)
+{
+	int rc;
+	u32 regval = 0x0;
+
+	rc = gicv2m_reg_read(edev->priv, offset, &regval);
+	if (!rc) {
+		*dst = regval & 0xFF;
+	}
+
+	return rc;
+}
+
+static int gicv2m_emulator_read16(struct vmm_emudev *edev,
+				  physical_addr_t offset,
+				  u16 *dst)
+{
+	int rc;
+	u32 regval = 0x0;
+
+	rc = gicv2m_reg_read(edev->priv, offset, &regval);
+	if (!rc) {
+		*dst = regval & 0xFFFF;
+	}
+
+	return rc;
+}
+
+static int gicv2m_emulator_read32(struct vmm_emudev *edev,
+				  physical_addr_t offset,
+				  u32 *dst)
+{
+	return gicv2m_reg_read(edev->priv, offset, dst);
+}
+
+static int gicv2m_emulator_write8(struct vmm_emudev *edev,
+				  physical_addr_t offset,
+				  u8 src)
+{
+	return gicv2m_reg_write(edev->priv, offset, 0xFFFFFF00, src);
+}
+
+static int gicv2m_emulator_write16(struct vmm_emudev *edev,
+				   physical_addr_t offset,
+				   u16 src)
+{
+	return gicv2m_reg_write(edev->priv, offset, 0xFFFF0000, src);
+}
+
+static int gicv2m_emulator_write32(struct vmm_emudev *edev,
+				   physical_addr_t offset,
+				   u32 src)
+{
+	return gicv2m_reg_write(edev->priv, offset, 0x00000000, src);
+}
+
+static int gicv2m_emulator_reset(struct vmm_emudev *edev)
+{
+	return VMM_OK;
+}
+
+static int gicv2m_emulator_probe(struct vmm_guest *guest,
+				 struct vmm_emudev *edev,
+				 const struct vmm_devtree_nodeid *eid)
+{
+	int rc = VMM_OK;
+	struct gicv2m_state *s;
+
+	s = vmm_zalloc(sizeof(struct gicv2m_state));
+	if (!s) {
+		rc = VMM_ENOMEM;
+		goto gicv2m_emulator_probe_done;
+	}
+
+	s->guest = guest;
+	s->addr = edev->reg->gphys_addr;
+
+	if (vmm_devtree_read_u32(edev->node, "base_irq", &s->base_irq)) {
+		rc = VMM_EINVALID;
+		goto gicv2m_emulator_probe_freestate_fail;
+	}
+
+	if (vmm_devtree_read_u32(edev->node, "num_irq", &s->num_irq)) {
+		rc = VMM_EINVALID;
+		goto gicv2m_emulator_probe_freestate_fail;
+	}
+
+	if ((s->base_irq < V2M_MIN_SPI) || !s->num_irq ||
+	    (V2M_MAX_SPI < (s->base_irq + s->num_irq - 1)) ||
+	    (vmm_devemu_count_irqs(guest) < (s->base_irq + s->num_irq))) {
+		rc = VMM_EINVALID;
+		goto gicv2m_emulator_probe_freestate_fail;
+	}
+
+	rc = vmm_devemu_register_msichip(guest, edev->reg->gphys_addr,
+					 edev->reg->phys_size,
+					 &gicv2m_msichip, s);
+	if (rc) {
+		goto gicv2m_emulator_probe_freestate_fail;
+	}
+
+	edev->priv = s;
+
+	goto gicv2m_emulator_probe_done;
+
+gicv2m_emulator_probe_freestate_fail:
+	vmm_free(s);
+gicv2m_emulator_probe_done:
+	return rc;
+}
+
+static int gicv2m_emulator_remove(struct vmm_emudev *edev)
+{
+	struct gicv2m_state *s = edev->priv;
+
+	if (s) {
+		vmm_devemu_unregister_msichip(s->guest, &gicv2m_msichip, s);
+		vmm_free(s);
+		edev->priv = NULL;
+	}
+
+	return VMM_OK;
+}
+
+static struct vmm_devtree_nodeid gicv2m_emuid_table[] = {
+	{ .type = "pic",
+	  .compatible = "arm,gic-v2m-frame",
+	},
+	{ /* end of list */ },
+};
+
+static struct vmm_emulator gicv2m_emulator = {
+	.name = "gicv2m",
+	.match_table = gicv2m_emuid_table,
+	.endian = VMM_DEVEMU_LITTLE_ENDIAN,
+	.probe = gicv2m_emulator_probe,
+	.read8 = gicv2m_emulator_read8,
+	.write8 = gicv2m_emulator_write8,
+	.read16 = gicv2m_emulator_read16,
+	.write16 = gicv2m_emulator_write16,
+	.read32 = gicv2m_emulator_read32,
+	.write32 = gicv2m_emulator_write32,
+	.reset = gicv2m_emulator_reset,
+	.remove = gicv2m_emulator_remove,
+};
+
+static int __init gicv2m_emulator_init(void)
+{
+	return vmm_devemu_register_emulator(&gicv2m_emulator);
+}
+
+static void __exit gicv2m_emulator_exit(void)
+{
+	vmm_devemu_unregister_emulator(&gicv2m_emulator);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
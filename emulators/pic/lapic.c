@@ -298,6 +298,27 @@ void apic_irq_handle(u32 irq, int cpu, int level, void *opaque)
 	vmm_spin_unlock_irqrestore(&s->state_lock, flags);
 }
 
+/* Process MSI written to APIC interrupt address range (0xFEExxxxx) */
+static void apic_msi_handle(physical_addr_t addr, u32 data,
+			    u32 devid, void *opaque)
+{
+	irq_flags_t flags;
+	apic_state_t *s = opaque;
+	u8 dest, dest_mode, del_mode, tmode, vnum;
+
+	dest = (addr >> 12) & 0xff;
+	dest_mode = (addr >> 2) & 0x1;
+	vnum = data & 0xff;
+	del_mode = (data >> 8) & 0x7;
+	tmode = (data >> 15) & 0x1;
+
+	vmm_spin_lock_irqsave(&s->state_lock, flags);
+
+	apic_deliver_irq(s, dest, dest_mode, del_mode, vnum, tmode);
+
+	vmm_spin_unlock_irqrestore(&s->state_lock, flags);
+}
+
 #if 0
 static void apic_set_base(apic_state_t *s, u64 val)
 {
@@ -947,6 +968,11 @@ static void apic_reset_common(apic_state_t *s)
 	}
 }
 
+static struct vmm_devemu_msichip apic_msichip = {
+	.name = "APIC",
+	.handle = apic_msi_handle,
+};
+
 static int apic_emulator_remove(struct vmm_emudev *edev)
 {
 	apic_state_t *s = edev->priv;
@@ -955,6 +981,8 @@ static int apic_emulator_remove(struct vmm_emudev *edev)
 		return VMM_EFAIL;
 	}
 
+	vmm_devemu_unregister_msichip(s->guest, &apic_msichip, s);
+
 	vmm_free(s);
 	edev->priv = NULL;
 
@@ -1018,6 +1046,15 @@ static int apic_emulator_probe(struct vmm_guest *guest,
 		vmm_devemu_register_irqchip(guest, i, &apic_irqchip, s);
 	}
 
+	/* Messages written to APIC address range are interrupts */
+	rc = vmm_devemu_register_msichip(guest, edev->reg->gphys_addr,
+					 edev->reg->phys_size,
+					 &apic_msichip, s);
+	if (rc) {
+		APIC_LOG(ERR, "Failed to register MSI chip!\n");
+		goto apic_emulator_probe_freestate_fail;
+	}
+
 	edev->priv = s;
 
 	return VMM_OK;
@@ -23,7 +23,9 @@
 # */
 
 emulators-objs-$(CONFIG_EMU_PIC_GIC)+= pic/gic.o
+emulators-objs-$(CONFIG_EMU_PIC_GICV2M)+= pic/gicv2m.o
 emulators-objs-$(CONFIG_EMU_PIC_PL190)+= pic/pl190.o
 emulators-objs-$(CONFIG_EMU_PIC_I8259)+= pic/i8259.o
 emulators-objs-$(CONFIG_EMU_PIC_LAPIC)+= pic/lapic.o
 emulators-objs-$(CONFIG_EMU_PIC_PLIC)+= pic/plic.o
+emulators-objs-$(CONFIG_EMU_PIC_APLIC)+= pic/aplic.o
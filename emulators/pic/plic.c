@@ -26,6 +26,8 @@
 #include <vmm_modules.h>
 #include <vmm_vcpu_irq.h>
 #include <vmm_devemu.h>
+#include <libs/bitops.h>
+#include <libs/stringlib.h>
 
 #define MODULE_DESC			"RISC-V PLIC Emulator"
 #define MODULE_AUTHOR			"Anup Patel"
@@ -96,6 +98,7 @@
 /* Each interrupt source has a priority register associated with it. */
 #define PRIORITY_BASE		0
 #define PRIORITY_PER_ID		4
+#define PRIORITY_LEVELS		(1 << PRIORITY_PER_ID)
 
 /*
  * Each hart context has a vector of interupt enable bits associated with it.
@@ -132,6 +135,10 @@ struct plic_context {
 	u32 irq_pending[MAX_DEVICES/32];
 	u8 irq_pending_priority[MAX_DEVICES];
 	u32 irq_claimed[MAX_DEVICES/32];
+
+	/* Pending and unclaimed IRQs bucketed by pending priority */
+	u32 irq_ready_prio_map;
+	u32 irq_ready[PRIORITY_LEVELS][MAX_DEVICES/32];
 };
 
 struct plic_state {
@@ -155,34 +162,61 @@ struct plic_state {
 	u32 irq_level[MAX_DEVICES/32];
 };
 
+/* Remove IRQ from ready bitmaps before changing its pending state
+ * Note: Must be called with c->irq_lock held
+ */
+static void __plic_context_ready_del(struct plic_state *s,
+				     struct plic_context *c, u32 irq)
+{
+	u32 i, prio = c->irq_pending_priority[irq];
+	u32 *ready = c->irq_ready[prio];
+
+	ready[irq / 32] &= ~(1 << (irq % 32));
+	for (i = 0; i < s->num_irq_word; i++) {
+		if (ready[i]) {
+			return;
+		}
+	}
+	c->irq_ready_prio_map &= ~(1 << prio);
+}
+
+/* Add IRQ to ready bitmaps after changing its pending state
+ * Note: Must be called with c->irq_lock held
+ */
+static void __plic_context_ready_add(struct plic_state *s,
+				     struct plic_context *c, u32 irq)
+{
+	u32 irq_word = irq / 32, irq_mask = 1 << (irq % 32);
+	u32 prio = c->irq_pending_priority[irq];
+
+	if (!(c->irq_pending[irq_word] & irq_mask) ||
+	    (c->irq_claimed[irq_word] & irq_mask)) {
+		return;
+	}
+
+	c->irq_ready[prio][irq_word] |= irq_mask;
+	c->irq_ready_prio_map |= (1 << prio);
+}
+
 /* Note: Must be called with c->irq_lock held */
 static u32 __plic_context_best_pending_irq(struct plic_state *s,
 					   struct plic_context *c)
 {
-	u8 best_irq_prio = 0;
-	u32 i, j, irq, best_irq = 0;
+	u32 i, *ready;
 
-	for (i = 0; i < s->num_irq_word; i++) {
-		if (!c->irq_pending[i]) {
-			continue;
-		}
+	if (!c->irq_ready_prio_map) {
+		return 0;
+	}
 
-		for (j = 0; j < 32; j++) {
-			irq = i * 32 + j;
-			if ((s->num_irq <= irq) ||
-			    !(c->irq_pending[i] & (1 << j)) ||
-			    (c->irq_claimed[i] & (1 << j))) {
-				continue;
-			}
-			if (!best_irq ||
-			    (best_irq_prio < c->irq_pending_priority[irq])) {
-				best_irq = irq;
-				best_irq_prio = c->irq_pending_priority[irq];
-			}
+	/* Highest priority wins and lowest IRQ number breaks ties */
+	ready = c->irq_ready[__fls(c->irq_ready_prio_map)];
+	for (i = 0; i < s->num_irq_word; i++) {
+		if (ready[i]) {
+			return i * 32 + __ffs(ready[i]);
 		}
 	}
 
-	return best_irq;
+	return 0;
 }
 
 /* Note: Must be called with c->irq_lock held */
@@ -209,6 +243,7 @@ static u32 __plic_context_irq_claim(struct plic_state *s,
 	vmm_vcpu_irq_clear(vcpu, s->parent_irq);
 
 	if (best_irq) {
+		__plic_context_ready_del(s, c, best_irq);
 		c->irq_claimed[best_irq / 32] |= (1 << (best_irq % 32));
 	}
 
@@ -254,6 +289,7 @@ static void plic_irq_handle(u32 irq, int cpu, int level, void *opaque)
 		c = &s->contexts[i];
 		vmm_spin_lock_irqsave(&c->irq_lock, flags1);
 		if (c->irq_enable[irq_word] & irq_mask) {
+			__plic_context_ready_del(s, c, irq);
 			if (level) {
 				c->irq_pending[irq_word] |= irq_mask;
 				c->irq_pending_priority[irq] = irq_prio;
@@ -262,6 +298,7 @@ static void plic_irq_handle(u32 irq, int cpu, int level, void *opaque)
 				c->irq_pending_priority[irq] = 0;
 				c->irq_claimed[irq_word] &= ~irq_mask;
 			}
+			__plic_context_ready_add(s, c, irq);
 			__plic_context_irq_update(s, c);
 			irq_marked = TRUE;
 		}
@@ -320,7 +357,7 @@ static int plic_context_enable_read(struct plic_state *s,
 	irq_flags_t flags;
 	u32 irq_word = offset >> 2;
 
-	if (s->num_irq_word < irq_word) {
+	if (s->num_irq_word <= irq_word) {
 		return VMM_EINVALID;
 	}
 
@@ -342,7 +379,7 @@ static int plic_context_enable_write(struct plic_state *s,
 	u32 irq_word = offset >> 2;
 	u32 old_val, new_val, xor_val;
 
-	if (s->num_irq_word < irq_word)
+	if (s->num_irq_word <= irq_word)
 		return VMM_EINVALID;
 
 	vmm_spin_lock_irqsave(&s->irq_lock, flags);
@@ -363,6 +400,7 @@ static int plic_context_enable_write(struct plic_state *s,
 		irq_prio = s->irq_priority[irq];
 		if (!(xor_val & irq_mask))
 			continue;
+		__plic_context_ready_del(s, c, irq);
 		if ((new_val & irq_mask) &&
 		    (s->irq_level[irq_word] & irq_mask)) {
 			c->irq_pending[irq_word] |= irq_mask;
@@ -372,6 +410,7 @@ static int plic_context_enable_write(struct plic_state *s,
 			c->irq_pending_priority[irq] = 0;
 			c->irq_claimed[irq_word] &= ~irq_mask;
 		}
+		__plic_context_ready_add(s, c, irq);
 	}
 
 	__plic_context_irq_update(s, c);
@@ -533,13 +572,15 @@ static int plic_emulator_reset(struct vmm_emudev *edev)
 
 		c->irq_priority_threshold = 0;
 		for (j = 0; j < MAX_DEVICES/32; j++) {
-			c->irq_enable[i] = 0;
-			c->irq_pending[i] = 0;
-			c->irq_claimed[i] = 0;
+			c->irq_enable[j] = 0;
+			c->irq_pending[j] = 0;
+			c->irq_claimed[j] = 0;
 		}
 		for (j = 0; j < MAX_DEVICES; j++) {
-			c->irq_pending_priority[i] = 0;
+			c->irq_pending_priority[j] = 0;
 		}
+		c->irq_ready_prio_map = 0;
+		memset(c->irq_ready, 0, sizeof(c->irq_ready));
 
 		vmm_spin_unlock_irqrestore(&c->irq_lock, flags);
 	}
@@ -26,6 +26,7 @@
 #include <vmm_stdio.h>
 #include <vmm_modules.h>
 #include <vmm_devemu.h>
+#include <vmm_trace.h>
 #include <vio/vmm_virtio.h>
 #include <vio/vmm_virtio_mmio.h>
 
@@ -47,6 +48,8 @@ static int virtio_mmio_notify(struct vmm_virtio_device *dev, u32 vq)
 {
 	struct virtio_mmio_dev *m = dev->tra_data;
 
+	vmm_trace(VMM_TRACE_VIRTIO_NOTIFY, m->guest->id, vq, dev->id.type);
+
 	m->config.interrupt_state |= VMM_VIRTIO_MMIO_INT_VRING;
 
 	vmm_devemu_emulate_irq(m->guest, m->irq, 1);
@@ -168,6 +171,8 @@ static int virtio_mmio_config_write(struct virtio_mmio_dev *m,
 				    val);
 		break;
 	case VMM_VIRTIO_MMIO_QUEUE_NOTIFY:
+		vmm_trace(VMM_TRACE_VIRTIO_KICK,
+			  m->guest->id, val, m->dev.id.type);
 		m->dev.emu->notify_vq(&m->dev, val);
 		break;
 	case VMM_VIRTIO_MMIO_INTERRUPT_ACK:
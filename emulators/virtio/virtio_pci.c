@@ -26,6 +26,8 @@
 #include <vmm_heap.h>
 #include <vmm_modules.h>
 #include <vmm_devemu.h>
+#include <vmm_guest_aspace.h>
+#include <vmm_trace.h>
 #include <vio/vmm_virtio.h>
 #include <vio/vmm_virtio_pci.h>
 #include <emu/pci/pci_emu_core.h>
@@ -38,6 +40,15 @@
 
 #define GET_VIRTIO_PCI_DEVICE_ID(did)	(VIRTIO_PCI_DEVICE_ID_BASE + did)
 
+/*
+ * MSI-X table and PBA are placed at end of memory BARs which are
+ * large enough. One vector for config changes and one per queue.
+ */
+#define VIRTIO_PCI_MSIX_VECTORS		16
+#define VIRTIO_PCI_MSIX_TABLE_OFFSET	0x800
+#define VIRTIO_PCI_MSIX_PBA_OFFSET	0xc00
+#define VIRTIO_PCI_MSIX_BAR_SIZE	0x1000
+
 #define VIRTIO_PCI_EMU_IPRIORITY	(PCI_EMU_CORE_IPRIORITY +	\
 					 VMM_VIRTIO_IPRIORITY + 1)
 
@@ -53,12 +64,58 @@ struct virtio_pci_dev {
 	struct vmm_virtio_device dev;
 	struct vmm_virtio_pci_config config;
 	u32 irq;
+	/* PCI device and BAR number (only if MSI-X is emulated) */
+	struct pci_device *pdev;
+	u32 barnum;
+	u16 config_vector;
+	u16 queue_vector[VMM_VIRTIO_PCI_QUEUE_MAX];
 };
 
+static bool virtio_pci_msix_enabled(struct virtio_pci_dev *m)
+{
+	return (m->pdev) ? pci_emu_msi_enabled(m->pdev) : FALSE;
+}
+
+static u16 virtio_pci_msix_vector(struct virtio_pci_dev *m, u32 val)
+{
+	/* Unsupported vectors read back as no vector */
+	if (!m->pdev || (pci_emu_msi_nvec(m->pdev) <= (u16)val)) {
+		return VMM_VIRTIO_PCI_MSI_NO_VECTOR;
+	}
+
+	return (u16)val;
+}
+
+static void virtio_pci_msix_reset(struct virtio_pci_dev *m)
+{
+	u32 i;
+
+	m->config_vector = VMM_VIRTIO_PCI_MSI_NO_VECTOR;
+	for (i = 0; i < VMM_VIRTIO_PCI_QUEUE_MAX; i++) {
+		m->queue_vector[i] = VMM_VIRTIO_PCI_MSI_NO_VECTOR;
+	}
+	if (m->pdev) {
+		pci_emu_msi_reset(m->pdev);
+	}
+}
+
 static int virtio_pci_notify(struct vmm_virtio_device *dev, u32 vq)
 {
+	u16 vec;
 	struct virtio_pci_dev *m = dev->tra_data;
 
+	vmm_trace(VMM_TRACE_VIRTIO_NOTIFY, m->guest->id, vq, dev->id.type);
+
+	/* With MSI-X enabled, no interrupt is raised for unmapped queues */
+	if (virtio_pci_msix_enabled(m)) {
+		vec = (vq < VMM_VIRTIO_PCI_QUEUE_MAX) ?
+			m->queue_vector[vq] : VMM_VIRTIO_PCI_MSI_NO_VECTOR;
+		if ((vec == VMM_VIRTIO_PCI_MSI_NO_VECTOR) ||
+		    (pci_emu_msi_notify(m->pdev, vec) != VMM_ENOTAVAIL)) {
+			return VMM_OK;
+		}
+	}
+
 	m->config.interrupt_state |= VMM_VIRTIO_PCI_INT_VRING;
 
 	vmm_devemu_emulate_irq(m->guest, m->irq, 1);
@@ -92,6 +149,12 @@ int virtio_pci_config_read(struct virtio_pci_dev *m,
 		m->config.interrupt_state = 0;
 		vmm_devemu_emulate_irq(m->guest, m->irq, 0);
 		break;
+	case VMM_VIRTIO_PCI_MSI_CONFIG_VECTOR:
+		*(u32 *)dst = m->config_vector;
+		break;
+	case VMM_VIRTIO_PCI_QUEUE_VECTOR:
+		*(u32 *)dst = m->queue_vector[m->config.queue_sel];
+		break;
 	default:
 		vmm_printf("%s: guest=%s invalid offset=0x%x\n",
 			   __func__, m->guest->name, offset);
@@ -105,9 +168,22 @@ int virtio_pci_config_read(struct virtio_pci_dev *m,
 static int virtio_pci_read(struct virtio_pci_dev *m,
 			   u32 offset, u32 *dst, u32 dst_len)
 {
-	/* Device specific config write */
-	if (offset >= VMM_VIRTIO_PCI_CONFIG) {
-		offset -= VMM_VIRTIO_PCI_CONFIG;
+	int rc;
+	u32 config_off;
+
+	/* MSI-X table and PBA */
+	if (m->pdev) {
+		rc = pci_emu_msix_bar_read(m->pdev, m->barnum,
+					   offset, dst, dst_len);
+		if (rc != VMM_ENOTAVAIL) {
+			return rc;
+		}
+	}
+
+	/* Device specific config read */
+	config_off = VMM_VIRTIO_PCI_CONFIG_OFF(virtio_pci_msix_enabled(m));
+	if (offset >= config_off) {
+		offset -= config_off;
 		return vmm_virtio_config_read(&m->dev, offset, dst, dst_len);
 	}
 
@@ -138,6 +214,8 @@ static int virtio_pci_config_write(struct virtio_pci_dev *m,
 		break;
 	case VMM_VIRTIO_PCI_QUEUE_NOTIFY:
 		if (val < VMM_VIRTIO_PCI_QUEUE_MAX) {
+			vmm_trace(VMM_TRACE_VIRTIO_KICK,
+				  m->guest->id, val, m->dev.id.type);
 			m->dev.emu->notify_vq(&m->dev, val);
 		}
 		break;
@@ -147,6 +225,13 @@ static int virtio_pci_config_write(struct virtio_pci_dev *m,
 		}
 		m->config.status = (u8)val;
 		break;
+	case VMM_VIRTIO_PCI_MSI_CONFIG_VECTOR:
+		m->config_vector = virtio_pci_msix_vector(m, val);
+		break;
+	case VMM_VIRTIO_PCI_QUEUE_VECTOR:
+		m->queue_vector[m->config.queue_sel] =
+					virtio_pci_msix_vector(m, val);
+		break;
 
 	default:
 		vmm_printf("%s: guest=%s invalid offset=0x%x\n",
@@ -161,11 +246,24 @@ static int virtio_pci_config_write(struct virtio_pci_dev *m,
 static int virtio_pci_write(struct virtio_pci_dev *m,
 			    u32 offset, u32 src_mask, u32 src, u32 src_len)
 {
+	int rc;
+	u32 config_off;
+
 	src = src & ~src_mask;
 
+	/* MSI-X table and PBA */
+	if (m->pdev) {
+		rc = pci_emu_msix_bar_write(m->pdev, m->barnum,
+					    offset, src, src_len);
+		if (rc != VMM_ENOTAVAIL) {
+			return rc;
+		}
+	}
+
 	/* Device specific config write */
-	if (offset >= VMM_VIRTIO_PCI_CONFIG) {
-		offset -= VMM_VIRTIO_PCI_CONFIG;
+	config_off = VMM_VIRTIO_PCI_CONFIG_OFF(virtio_pci_msix_enabled(m));
+	if (offset >= config_off) {
+		offset -= config_off;
 		return vmm_virtio_config_write(&m->dev, offset, &src, src_len);
 	}
 
@@ -246,6 +344,24 @@ static int virtio_pci_bar_read32(struct vmm_emudev *edev,
 	return virtio_pci_read(edev->priv, offset, dst, 4);
 }
 
+static int virtio_pci_bar_read64(struct vmm_emudev *edev,
+				 physical_addr_t offset,
+				 u64 *dst)
+{
+	int rc;
+	u32 lo = 0x0, hi = 0x0;
+
+	rc = virtio_pci_read(edev->priv, offset, &lo, 4);
+	if (!rc) {
+		rc = virtio_pci_read(edev->priv, offset + 4, &hi, 4);
+	}
+	if (!rc) {
+		*dst = ((u64)hi << 32) | lo;
+	}
+
+	return rc;
+}
+
 static int virtio_pci_bar_write8(struct vmm_emudev *edev,
 				 physical_addr_t offset,
 				 u8 src)
@@ -267,6 +383,31 @@ static int virtio_pci_bar_write32(struct vmm_emudev *edev,
 	return virtio_pci_write(edev->priv, offset, 0x00000000, src, 4);
 }
 
+static int virtio_pci_bar_write64(struct vmm_emudev *edev,
+				  physical_addr_t offset,
+				  u64 src)
+{
+	int rc;
+	struct virtio_pci_dev *m = edev->priv;
+
+	/* MSI-X table entries can be written with one quadword store */
+	if (m->pdev) {
+		rc = pci_emu_msix_bar_write(m->pdev, m->barnum,
+					    offset, src, 8);
+		if (rc != VMM_ENOTAVAIL) {
+			return rc;
+		}
+	}
+
+	rc = virtio_pci_write(m, offset, 0x00000000, src & 0xFFFFFFFF, 4);
+	if (!rc) {
+		rc = virtio_pci_write(m, offset + 4, 0x00000000,
+				      src >> 32, 4);
+	}
+
+	return rc;
+}
+
 static int virtio_pci_bar_reset(struct vmm_emudev *edev)
 {
 	struct virtio_pci_dev *m = edev->priv;
@@ -274,6 +415,7 @@ static int virtio_pci_bar_reset(struct vmm_emudev *edev)
 	m->config.queue_sel = 0x0;
 	m->config.interrupt_state = 0x0;
 	m->config.status = 0x0;
+	virtio_pci_msix_reset(m);
 	vmm_devemu_emulate_irq(m->guest, m->irq, 0);
 
 	return vmm_virtio_reset(&m->dev);
@@ -285,6 +427,9 @@ static int virtio_pci_bar_remove(struct vmm_emudev *edev)
 
 	if (vdev) {
 		vmm_virtio_unregister_device(&vdev->dev);
+		if (vdev->pdev) {
+			pci_emu_msi_cleanup(vdev->pdev);
+		}
 		vmm_free(vdev);
 		edev->priv = NULL;
 	}
@@ -331,14 +476,43 @@ static int virtio_pci_bar_probe(struct vmm_guest *guest,
 		goto virtio_pci_probe_freestate_fail;
 	}
 
+	/*
+	 * MSI-X table has to be in memory space so emulate MSI-X
+	 * only for large enough memory BARs of PCI devices.
+	 */
+	vdev->pdev = vmm_guest_get_region_priv(edev->reg);
+	if (vdev->pdev && !(edev->reg->flags & VMM_REGION_IO) &&
+	    (VIRTIO_PCI_MSIX_BAR_SIZE <= edev->reg->phys_size)) {
+		rc = vmm_devtree_read_u32(edev->node, "barnum",
+					  &vdev->barnum);
+		if (rc) {
+			goto virtio_pci_probe_freestate_fail;
+		}
+
+		rc = pci_emu_msi_init(vdev->pdev, 0,
+				      VIRTIO_PCI_MSIX_VECTORS, vdev->barnum,
+				      VIRTIO_PCI_MSIX_TABLE_OFFSET,
+				      VIRTIO_PCI_MSIX_PBA_OFFSET);
+		if (rc) {
+			goto virtio_pci_probe_freestate_fail;
+		}
+	} else {
+		vdev->pdev = NULL;
+	}
+	virtio_pci_msix_reset(vdev);
+
 	if ((rc = vmm_virtio_register_device(&vdev->dev))) {
-		goto virtio_pci_probe_freestate_fail;
+		goto virtio_pci_probe_msicleanup_fail;
 	}
 
 	edev->priv = vdev;
 
 	goto virtio_pci_probe_done;
 
+virtio_pci_probe_msicleanup_fail:
+	if (vdev->pdev) {
+		pci_emu_msi_cleanup(vdev->pdev);
+	}
 virtio_pci_probe_freestate_fail:
 	vmm_free(vdev);
 virtio_pci_probe_done:
@@ -380,6 +554,8 @@ static struct vmm_emulator virtio_bar_emulator = {
 	.write16 = virtio_pci_bar_write16,
 	.read32 = virtio_pci_bar_read32,
 	.write32 = virtio_pci_bar_write32,
+	.read64 = virtio_pci_bar_read64,
+	.write64 = virtio_pci_bar_write64,
 	.reset = virtio_pci_bar_reset,
 	.remove = virtio_pci_bar_remove,
 };
@@ -79,6 +79,8 @@ struct scsi_info {
 	unsigned long	capacity;
 	unsigned long	blksz;
 	bool		readonly;
+	bool		unmap;
+	unsigned long	max_unmap_blocks;
 };
 
 struct scsi_transport {
@@ -217,6 +219,17 @@ extern const unsigned char scsi_direction[256/8];
 #define SCSI_WRT_VERIFY	0x2E		/* Write and Verify (O) */
 #define SCSI_WRITE_LONG	0x3F		/* Write Long (O) */
 #define SCSI_WRITE_SAME	0x41		/* Write Same (O) */
+#define SCSI_UNMAP	0x42		/* Unmap (O) */
+#define SCSI_READ16	0x88		/* Read 16-byte (O) */
+#define SCSI_WRITE16	0x8A		/* Write 16-byte (O) */
+#define SCSI_VERIFY16	0x8F		/* Verify 16-byte (O) */
+#define SCSI_SYNC_CACHE16 0x91		/* Synchronize Cache 16-byte (O) */
+#define SCSI_REPORT_LUNS 0xA0		/* Report LUNs (MANDATORY) */
+
+/*
+ *  Service actions of SCSI_RD_CAPAC16 (Service Action In 16-byte)
+ */
+#define SCSI_SAI_RD_CAPAC16	0x10	/* Read Capacity 16-byte */
 
 /*
  * functions exported by SCSI library
@@ -242,6 +255,13 @@ int scsi_write10(struct scsi_request *srb,
 		 unsigned long start, unsigned short blocks,
 		 struct scsi_transport *tr, void *priv);
 
+int scsi_sync_cache10(struct scsi_request *srb,
+		      struct scsi_transport *tr, void *priv);
+
+int scsi_unmap(struct scsi_request *srb,
+	       u64 start, u32 blocks,
+	       struct scsi_transport *tr, void *priv);
+
 int scsi_reset(struct scsi_transport *tr, void *priv);
 
 int scsi_get_info(struct scsi_info *info, unsigned int lun,
@@ -31,7 +31,7 @@
 #define VFS_IPRIORITY		(VMM_BLOCKDEV_CLASS_IPRIORITY+1)
 #define VFS_MAX_PATH		(256)
 #define	VFS_MAX_NAME		(64)
-#define VFS_MAX_FD		(32)
+#define VFS_MAX_FD		(32)	/* initial size of file table */
 
 /** file type bits */
 #define	S_IFDIR			(1<<0)
@@ -176,11 +176,13 @@ enum vnode_type {
 enum vnode_flag {
 	VNONE,				/* default vnode flag */
 	VROOT,	   			/* root of its filesystem */
+	VSTALE,				/* not to be cached when unused */
 };
 
 /** vnode structure */
 struct vnode {
 	struct dlist v_link;		/* link for hash list */
+	struct dlist v_lru;		/* link for unused vnode cache */
 	struct mount *v_mount;		/* mount point pointer */
 	atomic_t v_refcnt;		/* reference count */
 	char v_path[VFS_MAX_PATH];	/* pointer to path in fs */
@@ -286,6 +288,29 @@ size_t vfs_read(int fd, void *buf, size_t len);
  */
 size_t vfs_write(int fd, void *buf, size_t len);
 
+/** I/O vector for vfs_readv() */
+struct vfs_iovec {
+	void *iov_base;
+	size_t iov_len;
+};
+
+/** Read a file at given offset without using or updating
+ *  the current position of file
+ *  Note: Must be called from Orphan (or Thread) context.
+ */
+size_t vfs_pread(int fd, void *buf, size_t len, loff_t off);
+
+/** Write a file at given offset without using or updating
+ *  the current position of file
+ *  Note: Must be called from Orphan (or Thread) context.
+ */
+size_t vfs_pwrite(int fd, void *buf, size_t len, loff_t off);
+
+/** Read a file at given offset into multiple buffers
+ *  Note: Must be called from Orphan (or Thread) context.
+ */
+size_t vfs_readv(int fd, const struct vfs_iovec *iov, int iovcnt, loff_t off);
+
 /** Set current position of a file 
  *  Note: Must be called from Orphan (or Thread) context.
  */
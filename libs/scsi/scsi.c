@@ -57,7 +57,7 @@
  */
 const unsigned char scsi_direction[256/8] = {
 	0x28, 0x81, 0x14, 0x14, 0x20, 0x01, 0x90, 0x77,
-	0x0C, 0x20, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+	0x08, 0x20, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01,
 	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
 };
@@ -265,6 +265,82 @@ int scsi_write10(struct scsi_request *srb,
 }
 VMM_EXPORT_SYMBOL(scsi_write10);
 
+int scsi_sync_cache10(struct scsi_request *srb,
+		      struct scsi_transport *tr, void *priv)
+{
+	int rc;
+	unsigned char *data;
+	unsigned long datalen;
+
+	if (!srb || !tr || !tr->transport) {
+		return VMM_EINVALID;
+	}
+
+	/* Zero LBA and zero blocks means entire medium */
+	data = srb->data;
+	datalen = srb->datalen;
+	memset(&srb->cmd, 0, sizeof(srb->cmd));
+	srb->cmd[0] = SCSI_SYNC_CACHE;
+	srb->cmd[1] = srb->lun << 5;
+	srb->data = NULL;
+	srb->datalen = 0;
+	srb->cmdlen = 12;
+	rc = tr->transport(srb, tr, priv);
+	srb->data = data;
+	srb->datalen = datalen;
+	DPRINTF("%s: returns %d\n", __func__, rc);
+
+	return rc;
+}
+VMM_EXPORT_SYMBOL(scsi_sync_cache10);
+
+int scsi_unmap(struct scsi_request *srb,
+	       u64 start, u32 blocks,
+	       struct scsi_transport *tr, void *priv)
+{
+	int rc;
+	unsigned char *data;
+	unsigned long datalen;
+	unsigned char __cacheline_aligned param[24];
+
+	if (!srb || !tr || !tr->transport) {
+		return VMM_EINVALID;
+	}
+
+	/* Parameter list with one block descriptor */
+	memset(param, 0, sizeof(param));
+	param[1] = sizeof(param) - 2;
+	param[3] = sizeof(param) - 8;
+	param[8] = ((unsigned char)(start >> 56)) & 0xff;
+	param[9] = ((unsigned char)(start >> 48)) & 0xff;
+	param[10] = ((unsigned char)(start >> 40)) & 0xff;
+	param[11] = ((unsigned char)(start >> 32)) & 0xff;
+	param[12] = ((unsigned char)(start >> 24)) & 0xff;
+	param[13] = ((unsigned char)(start >> 16)) & 0xff;
+	param[14] = ((unsigned char)(start >> 8)) & 0xff;
+	param[15] = ((unsigned char)(start)) & 0xff;
+	param[16] = ((unsigned char)(blocks >> 24)) & 0xff;
+	param[17] = ((unsigned char)(blocks >> 16)) & 0xff;
+	param[18] = ((unsigned char)(blocks >> 8)) & 0xff;
+	param[19] = ((unsigned char)(blocks)) & 0xff;
+
+	data = srb->data;
+	datalen = srb->datalen;
+	memset(&srb->cmd, 0, sizeof(srb->cmd));
+	srb->cmd[0] = SCSI_UNMAP;
+	srb->cmd[8] = sizeof(param);
+	srb->data = param;
+	srb->datalen = sizeof(param);
+	srb->cmdlen = 12;
+	DPRINTF("%s: start %"PRIx64" blocks %x\n", __func__, start, blocks);
+	rc = tr->transport(srb, tr, priv);
+	srb->data = data;
+	srb->datalen = datalen;
+
+	return rc;
+}
+VMM_EXPORT_SYMBOL(scsi_unmap);
+
 int scsi_reset(struct scsi_transport *tr, void *priv)
 {
 	if (!tr || !tr->reset) {
@@ -275,11 +351,67 @@ int scsi_reset(struct scsi_transport *tr, void *priv)
 }
 VMM_EXPORT_SYMBOL(scsi_reset);
 
+static int scsi_inquiry_vpd(struct scsi_request *srb, unsigned char page,
+			    struct scsi_transport *tr, void *priv)
+{
+	int rc;
+	unsigned long datalen;
+
+	if (!srb || !srb->data || (srb->datalen < 64)) {
+		return VMM_EINVALID;
+	}
+
+	datalen = srb->datalen;
+	memset(&srb->cmd, 0, sizeof(srb->cmd));
+	srb->cmd[0] = SCSI_INQUIRY;
+	srb->cmd[1] = (srb->lun << 5) | 0x1;
+	srb->cmd[2] = page;
+	srb->cmd[4] = 64;
+	srb->datalen = 64;
+	srb->cmdlen = 12;
+	rc = tr->transport(srb, tr, priv);
+	srb->datalen = datalen;
+	if (rc) {
+		return rc;
+	}
+
+	return (srb->data[1] == page) ? VMM_OK : VMM_ENOTAVAIL;
+}
+
+static void scsi_get_unmap_info(struct scsi_info *info,
+				struct scsi_transport *tr, void *priv)
+{
+	u32 max_blocks;
+	unsigned char __cacheline_aligned buf[64];
+	struct scsi_request srb;
+
+	/* Logical block provisioning VPD page tells about UNMAP */
+	INIT_SCSI_REQUEST(&srb, info->lun, buf, sizeof(buf));
+	if (scsi_inquiry_vpd(&srb, 0xB2, tr, priv) ||
+	    !(buf[5] & 0x80)) {
+		return;
+	}
+	info->unmap = TRUE;
+	info->max_unmap_blocks = 0xFFFFFFFF;
+
+	/* Block limits VPD page tells about maximum UNMAP blocks */
+	INIT_SCSI_REQUEST(&srb, info->lun, buf, sizeof(buf));
+	if (scsi_inquiry_vpd(&srb, 0xB0, tr, priv) || (buf[3] < 0x3C)) {
+		return;
+	}
+	max_blocks = ((u32)buf[20] << 24) | ((u32)buf[21] << 16) |
+		     ((u32)buf[22] << 8) | (u32)buf[23];
+	if (max_blocks) {
+		info->max_unmap_blocks = max_blocks;
+	}
+}
+
 int scsi_get_info(struct scsi_info *info, unsigned int lun,
 		  struct scsi_transport *tr, void *priv)
 {
 	int rc;
 	u32 *cap;
+	unsigned char version;
 	unsigned char __cacheline_aligned buf[64];
 	struct scsi_request srb;
 
@@ -299,6 +431,7 @@ int scsi_get_info(struct scsi_info *info, unsigned int lun,
 	info->perph_qualifier = (buf[0] & 0xE0) >> 5;
 	info->perph_type = buf[0] & 0x1F;
 	info->removable = (buf[1] & 0x80) ? TRUE : FALSE;
+	version = buf[2];
 
 	memcpy(&info->vendor[0], (const void *)&buf[8], 8);
 	memcpy(&info->product[0], (const void *)&buf[16], 16);
@@ -337,6 +470,11 @@ int scsi_get_info(struct scsi_info *info, unsigned int lun,
 		break;
 	};
 
+	/* VPD pages are only probed for SPC-3 (or later) devices */
+	if (!info->readonly && (version >= 0x05)) {
+		scsi_get_unmap_info(info, tr, priv);
+	}
+
 	if (tr->info_fixup) {
 		tr->info_fixup(info, tr, priv);
 	}
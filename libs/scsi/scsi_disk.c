@@ -152,14 +152,74 @@ static int scsi_disk_rq_write(struct vmm_blockrq *brq,
 	return VMM_OK;
 }
 
+static int scsi_disk_rq_discard(struct vmm_blockrq *brq,
+				struct vmm_request *r, void *priv)
+{
+	int rc;
+	u64 lba;
+	u32 bcnt, blks;
+	struct scsi_request srb;
+	struct scsi_disk *disk = priv;
+
+	if (!disk->info.unmap) {
+		return VMM_EOPNOTSUPP;
+	}
+
+	bcnt = r->bcnt;
+	lba = r->lba;
+
+	while (bcnt) {
+		blks = (disk->info.max_unmap_blocks < bcnt) ?
+					disk->info.max_unmap_blocks : bcnt;
+
+		INIT_SCSI_REQUEST(&srb, disk->info.lun, NULL, 0);
+		rc = scsi_unmap(&srb, lba, blks, disk->tr, disk->tr_priv);
+		if (rc) {
+			return rc;
+		}
+
+		lba += blks;
+		bcnt -= blks;
+	}
+
+	return VMM_OK;
+}
+
+static int scsi_disk_rq_sync(struct vmm_blockrq *brq,
+			     struct vmm_request *r, void *priv)
+{
+	int rc;
+	struct scsi_request srb;
+	struct scsi_disk *disk = priv;
+
+	INIT_SCSI_REQUEST(&srb, disk->info.lun, NULL, 0);
+	rc = scsi_sync_cache10(&srb, disk->tr, disk->tr_priv);
+	if (rc == VMM_OK) {
+		return VMM_OK;
+	}
+
+	/* Devices without write cache may not support SYNC CACHE */
+	rc = scsi_request_sense(&srb, disk->tr, disk->tr_priv);
+	if (rc) {
+		return rc;
+	}
+	if ((srb.sense_buf[2] & 0x0f) == SENSE_ILLEGAL_REQUEST) {
+		return VMM_OK;
+	}
+
+	return VMM_EIO;
+}
+
 static void scsi_disk_rq_flush(struct vmm_blockrq *brq, void *priv)
 {
-	/* Nothing to do here. */
+	scsi_disk_rq_sync(brq, NULL, priv);
 }
 
 static struct vmm_blockrq_ops scsi_rq_ops = {
 	.read = scsi_disk_rq_read,
 	.write = scsi_disk_rq_write,
+	.discard = scsi_disk_rq_discard,
+	.sync = scsi_disk_rq_sync,
 	.flush = scsi_disk_rq_flush
 };
 
@@ -214,6 +274,9 @@ struct scsi_disk *scsi_create_disk(const char *name,
 	disk->bdev->dev.parent = dev;
 	disk->bdev->flags = (disk->info.readonly) ?
 				VMM_BLOCKDEV_RDONLY : VMM_BLOCKDEV_RW;
+	if (disk->info.unmap) {
+		disk->bdev->flags |= VMM_BLOCKDEV_DISCARD;
+	}
 	disk->bdev->start_lba = 0;
 	disk->bdev->num_blocks = disk->info.capacity;
 	disk->bdev->block_size = disk->info.blksz;
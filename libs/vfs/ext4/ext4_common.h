@@ -91,13 +91,23 @@ struct ext2_sblock {
 	u32 hash_seed[4];
 	u8 def_hash_version;
 	u8 jnl_backup_type;
-	u16 reserved_word_pad;
+	u16 desc_size;
 	u32 default_mount_opts;
 	u32 first_meta_bg;
 	u32 mkfs_time;
 	u32 jnl_blocks[17];
+	u32 total_blocks_hi;
+	u32 reserved_blocks_hi;
+	u32 free_blocks_hi;
+	u16 min_extra_isize;
+	u16 want_extra_isize;
+	u32 flags;
 }__packed;
 
+/* Superblock flags */
+#define EXT2_FLAGS_SIGNED_HASH		0x0001	/* Signed dirhash in use */
+#define EXT2_FLAGS_UNSIGNED_HASH	0x0002	/* Unsigned dirhash in use */
+
 /* FS States */
 #define EXT2_VALID_FS			1	/* Unmounted cleanly */
 #define EXT2_ERROR_FS			2	/* Errors detected */
@@ -132,11 +142,16 @@ struct ext2_sblock {
 #define EXT3_FEAT_INCOMPAT_RECOVER	0x0004	 
 #define EXT3_FEAT_INCOMPAT_JOURNAL_DEV	0x0008	 
 #define EXT2_FEAT_INCOMPAT_META_BG	0x0010
+#define EXT4_FEAT_INCOMPAT_EXTENTS	0x0040	/* Files use extent trees */
+#define EXT4_FEAT_INCOMPAT_64BIT	0x0080	/* 64-bit block numbers */
+#define EXT4_FEAT_INCOMPAT_FLEX_BG	0x0200	/* Flexible block groups */
 
 /* Feature Read-Only Compatibility */
 #define EXT2_FEAT_RO_COMPAT_SPARS_SUPER	0x0001	/* Sparse Superblock */
 #define EXT2_FEAT_RO_COMPAT_LARGE_FILE	0x0002	/* Large file support, 64-bit file size */
 #define EXT2_FEAT_RO_COMPAT_BTREE_DIR	0x0004	/* Binary tree sorted directory files */
+#define EXT4_FEAT_RO_COMPAT_GDT_CSUM	0x0010	/* Group descriptor checksums */
+#define EXT4_FEAT_RO_COMPAT_METADATA_CSUM 0x0400	/* Metadata checksums */
 
 /* Compression Algo Bitmap */
 #define EXT2_LZV1_ALG			0	/* Binary value of 0x00000001 */
@@ -159,6 +174,13 @@ struct ext2_block_group {
 	u16 bg_checksum;	/* crc16(s_uuid+grouo_num+group_desc)*/
 }__packed;
 
+/* Minimum size of on-disk block group descriptor */
+#define EXT2_MIN_DESC_SIZE		32
+
+/* Block group flags */
+#define EXT4_BG_INODE_UNINIT		0x0001	/* Inode table/bitmap not in use */
+#define EXT4_BG_BLOCK_UNINIT		0x0002	/* Block bitmap not in use */
+
 /* The ext2 inode.  */
 struct ext2_inode {
 	u16 mode;
@@ -232,6 +254,7 @@ struct ext2_inode {
 #define EXT2_INDEX_FL			0x00001000	/* hash indexed directory */
 #define EXT2_IMAGIC_FL			0x00002000	/* AFS directory */
 #define EXT3_JOURNAL_DATA_FL		0x00004000	/* journal file data */
+#define EXT4_EXTENTS_FL			0x00080000	/* inode uses extents */
 #define EXT2_RESERVED_FL		0x80000000	/* reserved for ext2 library */
 
 /* The ext2 directory entry. */
@@ -242,6 +265,75 @@ struct ext2_dirent {
 	u8 filetype;
 }__packed;
 
+/* Directory entries are padded to 4 byte boundary */
+#define EXT2_DIRENT_LEN(namelen)	\
+	(((namelen) + sizeof(struct ext2_dirent) + 3) & ~3)
+
+/* Magic value used to identify an ext4 extent tree node.  */
+#define EXT4_EXT_MAGIC			0xF30A
+
+/* Extents longer than this are uninitialized (preallocated) */
+#define EXT4_EXT_INIT_MAX_LEN		32768
+
+/* Max tree depth allowed by ext4 */
+#define EXT4_EXT_MAX_DEPTH		5
+
+/* The ext4 extent tree node header.  */
+struct ext4_extent_header {
+	u16 magic;
+	u16 entries;	/* number of valid entries */
+	u16 max;	/* capacity of store in entries */
+	u16 depth;	/* has tree real underlying blocks? */
+	u32 generation;
+}__packed;
+
+/* The ext4 extent tree index entry.  */
+struct ext4_extent_idx {
+	u32 block;	/* index covers logical blocks from 'block' */
+	u32 leaf_lo;	/* pointer to the physical block of the next level */
+	u16 leaf_hi;
+	u16 unused;
+}__packed;
+
+/* The ext4 extent tree leaf entry.  */
+struct ext4_extent {
+	u32 block;	/* first logical block extent covers */
+	u16 len;	/* number of blocks covered by extent */
+	u16 start_hi;	/* high 16 bits of physical block */
+	u32 start_lo;	/* low 32 bits of physical block */
+}__packed;
+
+/* The htree root info (follows ".." entry of first directory block) */
+struct ext2_dx_root_info {
+	u32 reserved_zero;
+	u8 hash_version;
+	u8 info_length;	/* 8 */
+	u8 indirect_levels;
+	u8 unused_flags;
+}__packed;
+
+/* The htree index entry (count & limit overlay first entry) */
+struct ext2_dx_entry {
+	u32 hash;
+	u32 block;
+}__packed;
+
+struct ext2_dx_countlimit {
+	u16 limit;
+	u16 count;
+}__packed;
+
+/* Max htree depth without largedir feature */
+#define EXT2_HTREE_LEVEL		3
+
+/* Directory hash versions */
+#define EXT2_HASH_LEGACY		0
+#define EXT2_HASH_HALF_MD4		1
+#define EXT2_HASH_TEA			2
+#define EXT2_HASH_LEGACY_UNSIGNED	3	/* Internal use only */
+#define EXT2_HASH_HALF_MD4_UNSIGNED	4	/* Internal use only */
+#define EXT2_HASH_TEA_UNSIGNED		5	/* Internal use only */
+
 /* Directory entry file types */
 #define EXT2_FT_UNKNOWN			0	/* Unknown File Type */
 #define EXT2_FT_REG_FILE		1	/* Regular File */
@@ -360,8 +360,7 @@ int ext4fs_control_sync(struct ext4fs_control *ctrl)
 	/* Unlock sblock */
 	vmm_mutex_unlock(&ctrl->sblock_lock);
 
-	desc_per_blk = udiv32(ctrl->block_size, 
-					sizeof(struct ext2_block_group));
+	desc_per_blk = udiv32(ctrl->block_size, ctrl->desc_size);
 	for (g = 0; g < ctrl->group_count; g++) {
 		/* Lock group */
 		vmm_mutex_lock(&ctrl->groups[g].grp_lock);
@@ -374,8 +373,7 @@ int ext4fs_control_sync(struct ext4fs_control *ctrl)
 
 		/* Write group descriptor to block device */
 		blkno = ctrl->group_table_blkno + udiv32(g, desc_per_blk);
-		blkoff = umod32(g, desc_per_blk) * 
-					sizeof(struct ext2_block_group);
+		blkoff = umod32(g, desc_per_blk) * ctrl->desc_size;
 		rc = ext4fs_devwrite(ctrl, blkno, blkoff, 
 				    sizeof(struct ext2_block_group), 
 				    (char *)&ctrl->groups[g].grp);
@@ -411,8 +409,8 @@ int ext4fs_control_sync(struct ext4fs_control *ctrl)
 		vmm_mutex_unlock(&ctrl->groups[g].grp_lock);
 	}
 
-	/* Flush cached data in device request queue */
-	rc = vmm_blockdev_flush_cache(ctrl->bdev);
+	/* Flush cached data and make it durable on block device */
+	rc = vmm_blockdev_flush(ctrl->bdev);
 	if (rc) {
 		return rc;
 	}
@@ -450,10 +448,31 @@ int ext4fs_control_init(struct ext4fs_control *ctrl,
 		goto fail;
 	}
 
-	/* Directory indexing not supported so throw warning */
-	if (__le32(ctrl->sblock.feature_compatibility) & 
-					EXT2_FEAT_COMPAT_DIR_INDEX) {
-		vmm_lwarning("ext4", "directory indexing is not available\n");
+	/* New files are extent mapped only if filesystem supports it */
+	ctrl->extents = (__le32(ctrl->sblock.feature_incompat) &
+				EXT4_FEAT_INCOMPAT_EXTENTS) ? TRUE : FALSE;
+
+	/* Group descriptor checksums are not maintained so
+	 * such filesystems are only available as read-only.
+	 */
+	ctrl->rdonly = (__le32(ctrl->sblock.feature_ro_compat) &
+			(EXT4_FEAT_RO_COMPAT_GDT_CSUM |
+			 EXT4_FEAT_RO_COMPAT_METADATA_CSUM)) ? TRUE : FALSE;
+	if (ctrl->rdonly) {
+		vmm_lwarning("ext4", "metadata checksums are not supported "
+			     "so mounting read-only\n");
+	}
+
+	/* Setup directory indexing (htree) parameters */
+	ctrl->dir_index = (__le32(ctrl->sblock.feature_compatibility) &
+				EXT2_FEAT_COMPAT_DIR_INDEX) ? TRUE : FALSE;
+	for (g = 0; g < 4; g++) {
+		ctrl->hash_seed[g] = __le32(ctrl->sblock.hash_seed[g]);
+	}
+	if (__le32(ctrl->sblock.flags) & EXT2_FLAGS_UNSIGNED_HASH) {
+		ctrl->hash_unsigned = EXT2_HASH_LEGACY_UNSIGNED;
+	} else {
+		ctrl->hash_unsigned = 0;
 	}
 
 	/* Pre-compute frequently required values */
@@ -478,22 +497,30 @@ int ext4fs_control_init(struct ext4fs_control *ctrl,
 		ctrl->group_count++;
 	}
 	ctrl->group_table_blkno = __le32(ctrl->sblock.first_data_block) + 1;
+	if (__le32(ctrl->sblock.feature_incompat) & EXT4_FEAT_INCOMPAT_64BIT) {
+		ctrl->desc_size = __le16(ctrl->sblock.desc_size);
+	} else {
+		ctrl->desc_size = EXT2_MIN_DESC_SIZE;
+	}
+	if ((ctrl->desc_size < EXT2_MIN_DESC_SIZE) ||
+	    (ctrl->block_size < ctrl->desc_size)) {
+		rc = VMM_EINVALID;
+		goto fail;
+	}
 	ctrl->groups = vmm_zalloc(ctrl->group_count * 
 						sizeof(struct ext4fs_group));
 	if (!ctrl->groups) {
 		rc = VMM_ENOMEM;
 		goto fail;
 	}
-	desc_per_blk = udiv32(ctrl->block_size, 
-					sizeof(struct ext2_block_group));
+	desc_per_blk = udiv32(ctrl->block_size, ctrl->desc_size);
 	for (g = 0; g < ctrl->group_count; g++) {
 		/* Init group lock */
 		INIT_MUTEX(&ctrl->groups[g].grp_lock);
 
 		/* Load descriptor */
 		blkno = ctrl->group_table_blkno + udiv32(g, desc_per_blk);
-		blkoff = umod32(g, desc_per_blk) * 
-					sizeof(struct ext2_block_group);
+		blkoff = umod32(g, desc_per_blk) * ctrl->desc_size;
 		rc = ext4fs_devread(ctrl, blkno, blkoff, 
 				    sizeof(struct ext2_block_group), 
 				    (char *)&ctrl->groups[g].grp);
@@ -72,8 +72,20 @@ struct ext4fs_control {
 	u32 inode_size;
 	u32 inodes_per_block;
 
+	/* flag to show whether new files use extent trees */
+	bool extents;
+
+	/* flag to show whether metadata can't be updated safely */
+	bool rdonly;
+
+	/* directory indexing (htree) parameters */
+	bool dir_index;
+	u32 hash_seed[4];
+	u8 hash_unsigned;
+
 	u32 group_count;
 	u32 group_table_blkno;
+	u32 desc_size;
 	struct ext4fs_group *groups;
 };
 
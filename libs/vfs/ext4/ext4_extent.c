@@ -0,0 +1,663 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file ext4_extent.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief source file for Ext4 extent tree functions
+ *
+ * The extent tree of an inode is loaded once into a sorted in-memory
+ * array of extents. Block lookups are served from this array without
+ * touching any metadata block and updates only modify the array. The
+ * on-disk tree is rebuilt from the array at sync time reusing the tree
+ * blocks it had earlier.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <libs/stringlib.h>
+#include <libs/mathlib.h>
+#include <libs/vfs.h>
+
+#include "ext4_control.h"
+#include "ext4_extent.h"
+
+#define EXT4_EXT_ROOT_MAX		((sizeof(((struct ext2_inode *)0)->b) - \
+					  sizeof(struct ext4_extent_header)) / \
+					 sizeof(struct ext4_extent))
+#define EXT4_EXT_ALLOC_MIN		16
+
+static inline struct ext4_extent_header *ext4fs_extent_root(
+						struct ext4fs_node *node)
+{
+	return (struct ext4_extent_header *)&node->inode.b;
+}
+
+static inline u32 ext4fs_extent_blk_max(struct ext4fs_control *ctrl)
+{
+	return (ctrl->block_size - sizeof(struct ext4_extent_header)) /
+		sizeof(struct ext4_extent);
+}
+
+static inline u32 ext4fs_extent_max_len(bool uninit)
+{
+	return (uninit) ? (EXT4_EXT_INIT_MAX_LEN - 1) : EXT4_EXT_INIT_MAX_LEN;
+}
+
+void ext4fs_extent_init_root(struct ext2_inode *inode, u32 pblk, u32 blkcnt)
+{
+	struct ext4_extent_header *eh = (struct ext4_extent_header *)&inode->b;
+	struct ext4_extent *ex = (struct ext4_extent *)(eh + 1);
+
+	memset(&inode->b, 0, sizeof(inode->b));
+	eh->magic = __le16(EXT4_EXT_MAGIC);
+	eh->entries = 0;
+	eh->max = __le16(EXT4_EXT_ROOT_MAX);
+	eh->depth = 0;
+	if (pblk && blkcnt) {
+		eh->entries = __le16(1);
+		ex->block = 0;
+		ex->len = __le16(blkcnt);
+		ex->start_hi = 0;
+		ex->start_lo = __le32(pblk);
+	}
+	inode->flags = __le32(__le32(inode->flags) | EXT4_EXTENTS_FL);
+}
+
+static int ext4fs_extent_grow(struct ext4fs_node *node, u32 more)
+{
+	u32 alloc;
+	struct ext4fs_extent *ext;
+
+	if ((node->ext_count + more) <= node->ext_alloc) {
+		return VMM_OK;
+	}
+
+	alloc = (node->ext_alloc) ? node->ext_alloc : EXT4_EXT_ALLOC_MIN;
+	while (alloc < (node->ext_count + more)) {
+		alloc *= 2;
+	}
+	ext = vmm_malloc(alloc * sizeof(*ext));
+	if (!ext) {
+		return VMM_ENOMEM;
+	}
+	if (node->ext) {
+		memcpy(ext, node->ext, node->ext_count * sizeof(*ext));
+		vmm_free(node->ext);
+	}
+	node->ext = ext;
+	node->ext_alloc = alloc;
+
+	return VMM_OK;
+}
+
+static int ext4fs_extent_insert(struct ext4fs_node *node, u32 pos,
+				u32 lblk, u32 pblk, u32 len, bool uninit)
+{
+	int rc;
+
+	rc = ext4fs_extent_grow(node, 1);
+	if (rc) {
+		return rc;
+	}
+
+	if (pos < node->ext_count) {
+		memmove(&node->ext[pos + 1], &node->ext[pos],
+			(node->ext_count - pos) * sizeof(*node->ext));
+	}
+	node->ext[pos].lblk = lblk;
+	node->ext[pos].pblk = pblk;
+	node->ext[pos].len = len;
+	node->ext[pos].uninit = uninit;
+	node->ext_count++;
+
+	return VMM_OK;
+}
+
+static void ext4fs_extent_remove(struct ext4fs_node *node, u32 pos)
+{
+	node->ext_count--;
+	if (pos < node->ext_count) {
+		memmove(&node->ext[pos], &node->ext[pos + 1],
+			(node->ext_count - pos) * sizeof(*node->ext));
+	}
+}
+
+/* Merge extent at given position with the next one if possible */
+static void ext4fs_extent_merge(struct ext4fs_node *node, u32 pos)
+{
+	struct ext4fs_extent *e, *n;
+
+	if ((pos + 1) >= node->ext_count) {
+		return;
+	}
+
+	e = &node->ext[pos];
+	n = &node->ext[pos + 1];
+	if ((e->uninit != n->uninit) ||
+	    ((e->lblk + e->len) != n->lblk) ||
+	    ((e->pblk + e->len) != n->pblk) ||
+	    (ext4fs_extent_max_len(e->uninit) < (e->len + n->len))) {
+		return;
+	}
+
+	e->len += n->len;
+	ext4fs_extent_remove(node, pos + 1);
+}
+
+static int ext4fs_extent_add_tblk(struct ext4fs_node *node, u32 blkno)
+{
+	u32 *tblk, alloc;
+
+	if (node->ext_tblk_count == node->ext_tblk_alloc) {
+		alloc = (node->ext_tblk_alloc) ?
+			(node->ext_tblk_alloc * 2) : EXT4_EXT_ALLOC_MIN;
+		tblk = vmm_malloc(alloc * sizeof(*tblk));
+		if (!tblk) {
+			return VMM_ENOMEM;
+		}
+		if (node->ext_tblk) {
+			memcpy(tblk, node->ext_tblk,
+			       node->ext_tblk_count * sizeof(*tblk));
+			vmm_free(node->ext_tblk);
+		}
+		node->ext_tblk = tblk;
+		node->ext_tblk_alloc = alloc;
+	}
+
+	node->ext_tblk[node->ext_tblk_count++] = blkno;
+
+	return VMM_OK;
+}
+
+static int ext4fs_extent_load_node(struct ext4fs_node *node,
+				   struct ext4_extent_header *eh,
+				   u32 max, int depth)
+{
+	int rc = VMM_OK;
+	u32 i, blkno, len;
+	u8 *buf = NULL;
+	bool uninit;
+	struct ext4fs_extent *last;
+	struct ext4_extent *ex;
+	struct ext4_extent_idx *ix;
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	if ((__le16(eh->magic) != EXT4_EXT_MAGIC) ||
+	    (max < __le16(eh->entries)) ||
+	    (__le16(eh->depth) != depth)) {
+		return VMM_EINVALID;
+	}
+
+	if (!depth) {
+		ex = (struct ext4_extent *)(eh + 1);
+		for (i = 0; i < __le16(eh->entries); i++) {
+			if (__le16(ex[i].start_hi)) {
+				return VMM_ENOTSUPP;
+			}
+			len = __le16(ex[i].len);
+			uninit = (len > EXT4_EXT_INIT_MAX_LEN) ? TRUE : FALSE;
+			if (uninit) {
+				len -= EXT4_EXT_INIT_MAX_LEN;
+			}
+			if (!len) {
+				continue;
+			}
+			if (node->ext_count) {
+				last = &node->ext[node->ext_count - 1];
+				if (__le32(ex[i].block) < (last->lblk + last->len)) {
+					return VMM_EINVALID;
+				}
+			}
+			rc = ext4fs_extent_insert(node, node->ext_count,
+						  __le32(ex[i].block),
+						  __le32(ex[i].start_lo),
+						  len, uninit);
+			if (rc) {
+				return rc;
+			}
+		}
+		return VMM_OK;
+	}
+
+	buf = vmm_malloc(ctrl->block_size);
+	if (!buf) {
+		return VMM_ENOMEM;
+	}
+
+	ix = (struct ext4_extent_idx *)(eh + 1);
+	for (i = 0; i < __le16(eh->entries); i++) {
+		if (__le16(ix[i].leaf_hi)) {
+			rc = VMM_ENOTSUPP;
+			break;
+		}
+		blkno = __le32(ix[i].leaf_lo);
+		rc = ext4fs_extent_add_tblk(node, blkno);
+		if (rc) {
+			break;
+		}
+		rc = ext4fs_devread(ctrl, blkno, 0, ctrl->block_size,
+				    (char *)buf);
+		if (rc) {
+			break;
+		}
+		rc = ext4fs_extent_load_node(node,
+				(struct ext4_extent_header *)buf,
+				ext4fs_extent_blk_max(ctrl), depth - 1);
+		if (rc) {
+			break;
+		}
+	}
+
+	vmm_free(buf);
+
+	return rc;
+}
+
+static int ext4fs_extent_load(struct ext4fs_node *node)
+{
+	int rc;
+	struct ext4_extent_header *eh = ext4fs_extent_root(node);
+
+	if (node->ext_loaded) {
+		return VMM_OK;
+	}
+
+	if (EXT4_EXT_MAX_DEPTH < __le16(eh->depth)) {
+		return VMM_EINVALID;
+	}
+
+	node->ext_count = 0;
+	node->ext_tblk_count = 0;
+	node->ext_hint = 0;
+	rc = ext4fs_extent_load_node(node, eh, EXT4_EXT_ROOT_MAX,
+				     __le16(eh->depth));
+	if (rc) {
+		node->ext_count = 0;
+		node->ext_tblk_count = 0;
+		return rc;
+	}
+
+	node->ext_loaded = TRUE;
+	node->ext_dirty = FALSE;
+
+	return VMM_OK;
+}
+
+/* Find last extent starting at or before given logical block.
+ * Returns -1 if there is no such extent.
+ */
+static int ext4fs_extent_find(struct ext4fs_node *node, u32 lblk)
+{
+	int lo, hi, mid;
+	struct ext4fs_extent *e;
+
+	if (!node->ext_count || (lblk < node->ext[0].lblk)) {
+		return -1;
+	}
+
+	/* Sequential access mostly hits same or next extent */
+	if (node->ext_hint < node->ext_count) {
+		e = &node->ext[node->ext_hint];
+		if ((e->lblk <= lblk) &&
+		    (((node->ext_hint + 1) == node->ext_count) ||
+		     (lblk < node->ext[node->ext_hint + 1].lblk))) {
+			return node->ext_hint;
+		}
+	}
+
+	lo = 0;
+	hi = node->ext_count - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (node->ext[mid].lblk <= lblk) {
+			lo = mid;
+		} else {
+			hi = mid - 1;
+		}
+	}
+	node->ext_hint = lo;
+
+	return lo;
+}
+
+int ext4fs_extent_lookup(struct ext4fs_node *node, u32 lblk,
+			 u32 *pblk, u32 *blkcnt, bool *uninit)
+{
+	int rc, i;
+	struct ext4fs_extent *e;
+
+	rc = ext4fs_extent_load(node);
+	if (rc) {
+		return rc;
+	}
+
+	i = ext4fs_extent_find(node, lblk);
+	if (i >= 0) {
+		e = &node->ext[i];
+		if (lblk < (e->lblk + e->len)) {
+			*pblk = e->pblk + (lblk - e->lblk);
+			*blkcnt = e->len - (lblk - e->lblk);
+			*uninit = e->uninit;
+			return VMM_OK;
+		}
+	}
+
+	/* Hole extends till next extent or end of file */
+	*pblk = 0;
+	*uninit = FALSE;
+	if ((i + 1) < (int)node->ext_count) {
+		*blkcnt = node->ext[i + 1].lblk - lblk;
+	} else {
+		*blkcnt = 0xFFFFFFFF - lblk;
+	}
+
+	return VMM_OK;
+}
+
+int ext4fs_extent_map(struct ext4fs_node *node, u32 lblk, u32 pblk)
+{
+	int rc, i;
+	u32 pos, off, cnt;
+	struct ext4fs_extent e;
+
+	rc = ext4fs_extent_load(node);
+	if (rc) {
+		return rc;
+	}
+
+	/* Splitting an extent needs upto two more entries */
+	rc = ext4fs_extent_grow(node, 2);
+	if (rc) {
+		return rc;
+	}
+
+	i = ext4fs_extent_find(node, lblk);
+	if ((i >= 0) && (lblk < (node->ext[i].lblk + node->ext[i].len))) {
+		e = node->ext[i];
+		off = lblk - e.lblk;
+		if (pblk && !e.uninit && ((e.pblk + off) == pblk)) {
+			return VMM_OK;
+		}
+
+		/* Split extent around given logical block */
+		ext4fs_extent_remove(node, i);
+		pos = i;
+		cnt = 0;
+		if (off) {
+			rc = ext4fs_extent_insert(node, pos + cnt, e.lblk,
+						  e.pblk, off, e.uninit);
+			if (rc) {
+				return rc;
+			}
+			cnt++;
+		}
+		if (pblk) {
+			rc = ext4fs_extent_insert(node, pos + cnt, lblk,
+						  pblk, 1, FALSE);
+			if (rc) {
+				return rc;
+			}
+			cnt++;
+		}
+		if ((off + 1) < e.len) {
+			rc = ext4fs_extent_insert(node, pos + cnt, lblk + 1,
+						  e.pblk + off + 1,
+						  e.len - off - 1, e.uninit);
+			if (rc) {
+				return rc;
+			}
+			cnt++;
+		}
+	} else {
+		if (!pblk) {
+			return VMM_OK;
+		}
+		pos = i + 1;
+		rc = ext4fs_extent_insert(node, pos, lblk, pblk, 1, FALSE);
+		if (rc) {
+			return rc;
+		}
+		cnt = 1;
+	}
+
+	/* Merge with neighbours (from right to left) */
+	for (off = pos + cnt; off > pos; off--) {
+		ext4fs_extent_merge(node, off - 1);
+	}
+	if (pos) {
+		ext4fs_extent_merge(node, pos - 1);
+	}
+
+	node->ext_hint = 0;
+	node->ext_dirty = TRUE;
+
+	return VMM_OK;
+}
+
+int ext4fs_extent_truncate(struct ext4fs_node *node, u32 lblk)
+{
+	int rc;
+	u32 b, first;
+	struct ext4fs_extent *e;
+
+	rc = ext4fs_extent_load(node);
+	if (rc) {
+		return rc;
+	}
+
+	while (node->ext_count) {
+		e = &node->ext[node->ext_count - 1];
+		if ((e->lblk + e->len) <= lblk) {
+			break;
+		}
+
+		first = (e->lblk < lblk) ? (lblk - e->lblk) : 0;
+		for (b = first; b < e->len; b++) {
+			rc = ext4fs_node_free_block(node, e->pblk + b);
+			if (rc) {
+				return rc;
+			}
+		}
+
+		node->ext_dirty = TRUE;
+		if (first) {
+			e->len = first;
+			break;
+		}
+		node->ext_count--;
+	}
+
+	node->ext_hint = 0;
+
+	return VMM_OK;
+}
+
+static void ext4fs_extent_fill(struct ext4fs_node *node,
+			       struct ext4_extent_idx *idx, bool leaf,
+			       u32 start, u32 count, void *entries)
+{
+	u32 i;
+	struct ext4fs_extent *e;
+	struct ext4_extent *ex = entries;
+	struct ext4_extent_idx *ix = entries;
+
+	for (i = 0; i < count; i++) {
+		if (leaf) {
+			e = &node->ext[start + i];
+			ex[i].block = __le32(e->lblk);
+			ex[i].len = __le16((e->uninit) ?
+				(e->len + EXT4_EXT_INIT_MAX_LEN) : e->len);
+			ex[i].start_hi = 0;
+			ex[i].start_lo = __le32(e->pblk);
+		} else {
+			ix[i] = idx[start + i];
+		}
+	}
+}
+
+static u32 ext4fs_extent_first_lblk(struct ext4fs_node *node,
+				    struct ext4_extent_idx *idx,
+				    bool leaf, u32 start)
+{
+	return (leaf) ? node->ext[start].lblk : __le32(idx[start].block);
+}
+
+int ext4fs_extent_sync(struct ext4fs_node *node)
+{
+	int rc = VMM_OK;
+	u8 *buf = NULL;
+	u32 i, t, items, nblk, need, blkno, per_blk;
+	u16 depth;
+	struct ext4_extent_header *eh;
+	struct ext4_extent_idx *idx = NULL, *nidx = NULL, *tmp;
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	if (!node->ext_loaded || !node->ext_dirty) {
+		return VMM_OK;
+	}
+
+	/* Count tree blocks required for current extents */
+	per_blk = ext4fs_extent_blk_max(ctrl);
+	need = 0;
+	depth = 0;
+	items = node->ext_count;
+	while (items > EXT4_EXT_ROOT_MAX) {
+		items = udiv32(items + per_blk - 1, per_blk);
+		need += items;
+		depth++;
+	}
+	if (EXT4_EXT_MAX_DEPTH < depth) {
+		return VMM_ENOSPC;
+	}
+
+	/* Reuse tree blocks loaded earlier and allocate/free the rest */
+	while (node->ext_tblk_count < need) {
+		rc = ext4fs_node_alloc_block(node, &blkno);
+		if (rc) {
+			return rc;
+		}
+		rc = ext4fs_extent_add_tblk(node, blkno);
+		if (rc) {
+			ext4fs_node_free_block(node, blkno);
+			return rc;
+		}
+	}
+	while (need < node->ext_tblk_count) {
+		rc = ext4fs_node_free_block(node,
+				node->ext_tblk[node->ext_tblk_count - 1]);
+		if (rc) {
+			return rc;
+		}
+		node->ext_tblk_count--;
+	}
+
+	if (depth) {
+		nblk = udiv32(node->ext_count + per_blk - 1, per_blk);
+		buf = vmm_zalloc(ctrl->block_size);
+		idx = vmm_malloc(nblk * sizeof(*idx));
+		nidx = vmm_malloc(nblk * sizeof(*idx));
+		if (!buf || !idx || !nidx) {
+			rc = VMM_ENOMEM;
+			goto done;
+		}
+	}
+
+	/* Write non-root levels bottom-up */
+	t = 0;
+	depth = 0;
+	items = node->ext_count;
+	while (items > EXT4_EXT_ROOT_MAX) {
+		nblk = udiv32(items + per_blk - 1, per_blk);
+		for (i = 0; i < nblk; i++) {
+			memset(buf, 0, ctrl->block_size);
+			eh = (struct ext4_extent_header *)buf;
+			eh->magic = __le16(EXT4_EXT_MAGIC);
+			eh->max = __le16(per_blk);
+			eh->depth = __le16(depth);
+			eh->entries = __le16(((items - i * per_blk) < per_blk) ?
+					     (items - i * per_blk) : per_blk);
+			ext4fs_extent_fill(node, idx, (depth == 0),
+					   i * per_blk, __le16(eh->entries),
+					   eh + 1);
+
+			nidx[i].block = __le32(ext4fs_extent_first_lblk(node,
+						idx, (depth == 0), i * per_blk));
+			nidx[i].leaf_lo = __le32(node->ext_tblk[t]);
+			nidx[i].leaf_hi = 0;
+			nidx[i].unused = 0;
+
+			rc = ext4fs_devwrite(ctrl, node->ext_tblk[t], 0,
+					     ctrl->block_size, (char *)buf);
+			if (rc) {
+				goto done;
+			}
+			t++;
+		}
+
+		tmp = idx;
+		idx = nidx;
+		nidx = tmp;
+		items = nblk;
+		depth++;
+	}
+
+	/* Write root level in inode */
+	eh = ext4fs_extent_root(node);
+	memset(&node->inode.b, 0, sizeof(node->inode.b));
+	eh->magic = __le16(EXT4_EXT_MAGIC);
+	eh->max = __le16(EXT4_EXT_ROOT_MAX);
+	eh->depth = __le16(depth);
+	eh->entries = __le16(items);
+	ext4fs_extent_fill(node, idx, (depth == 0), 0, items, eh + 1);
+
+	node->inode_dirty = TRUE;
+	node->ext_dirty = FALSE;
+
+done:
+	if (nidx) {
+		vmm_free(nidx);
+	}
+	if (idx) {
+		vmm_free(idx);
+	}
+	if (buf) {
+		vmm_free(buf);
+	}
+
+	return rc;
+}
+
+void ext4fs_extent_free(struct ext4fs_node *node)
+{
+	if (node->ext) {
+		vmm_free(node->ext);
+		node->ext = NULL;
+	}
+	if (node->ext_tblk) {
+		vmm_free(node->ext_tblk);
+		node->ext_tblk = NULL;
+	}
+
+	node->ext_loaded = FALSE;
+	node->ext_dirty = FALSE;
+	node->ext_count = 0;
+	node->ext_alloc = 0;
+	node->ext_hint = 0;
+	node->ext_tblk_count = 0;
+	node->ext_tblk_alloc = 0;
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file ext4_extent.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief header file for Ext4 extent tree functions
+ */
+#ifndef _EXT4_EXTENT_H__
+#define _EXT4_EXTENT_H__
+
+#include <vmm_types.h>
+
+#include "ext4_control.h"
+#include "ext4_node.h"
+
+static inline bool ext4fs_node_has_extents(struct ext4fs_node *node)
+{
+	return (__le32(node->inode.flags) & EXT4_EXTENTS_FL) ? TRUE : FALSE;
+}
+
+void ext4fs_extent_init_root(struct ext2_inode *inode, u32 pblk, u32 blkcnt);
+
+int ext4fs_extent_lookup(struct ext4fs_node *node, u32 lblk,
+			 u32 *pblk, u32 *blkcnt, bool *uninit);
+
+int ext4fs_extent_map(struct ext4fs_node *node, u32 lblk, u32 pblk);
+
+int ext4fs_extent_truncate(struct ext4fs_node *node, u32 lblk);
+
+int ext4fs_extent_sync(struct ext4fs_node *node);
+
+void ext4fs_extent_free(struct ext4fs_node *node);
+
+#endif
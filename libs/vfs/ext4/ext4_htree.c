@@ -0,0 +1,465 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file ext4_htree.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief source file for Ext4 hashed directory (htree) functions
+ *
+ * Indexed directories keep a small B-tree keyed on name hash in
+ * blocks which look like empty directory blocks to older readers.
+ * The lookup hashes the name, walks the index down to one leaf block
+ * and scans only that block (plus following blocks on hash collision)
+ * instead of the whole directory.
+ *
+ * The directory hash functions are adapted from Linux fs/ext4/hash.c
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <libs/bitops.h>
+#include <libs/stringlib.h>
+#include <libs/vfs.h>
+
+#include "ext4_control.h"
+#include "ext4_htree.h"
+
+#define EXT2_HTREE_EOF			0x7FFFFFFF
+#define EXT2_DX_BLOCK_MASK		0x0FFFFFFF
+
+#define TEA_DELTA			0x9E3779B9
+
+static void ext4fs_tea_transform(u32 buf[4], const u32 in[4])
+{
+	u32 sum = 0;
+	u32 b0 = buf[0], b1 = buf[1];
+	u32 a = in[0], b = in[1], c = in[2], d = in[3];
+	int n = 16;
+
+	do {
+		sum += TEA_DELTA;
+		b0 += ((b1 << 4) + a) ^ (b1 + sum) ^ ((b1 >> 5) + b);
+		b1 += ((b0 << 4) + c) ^ (b0 + sum) ^ ((b0 >> 5) + d);
+	} while (--n);
+
+	buf[0] += b0;
+	buf[1] += b1;
+}
+
+/* F, G and H are basic MD4 functions: selection, majority, parity */
+#define MD4_F(x, y, z)			((z) ^ ((x) & ((y) ^ (z))))
+#define MD4_G(x, y, z)			(((x) & (y)) + (((x) ^ (y)) & (z)))
+#define MD4_H(x, y, z)			((x) ^ (y) ^ (z))
+
+#define MD4_ROUND(f, a, b, c, d, x, s)	\
+	(a += f(b, c, d) + (x), a = rol32(a, s))
+#define MD4_K1				0
+#define MD4_K2				013240474631UL
+#define MD4_K3				015666365641UL
+
+static void ext4fs_half_md4_transform(u32 buf[4], const u32 in[8])
+{
+	u32 a = buf[0], b = buf[1], c = buf[2], d = buf[3];
+
+	/* Round 1 */
+	MD4_ROUND(MD4_F, a, b, c, d, in[0] + MD4_K1,  3);
+	MD4_ROUND(MD4_F, d, a, b, c, in[1] + MD4_K1,  7);
+	MD4_ROUND(MD4_F, c, d, a, b, in[2] + MD4_K1, 11);
+	MD4_ROUND(MD4_F, b, c, d, a, in[3] + MD4_K1, 19);
+	MD4_ROUND(MD4_F, a, b, c, d, in[4] + MD4_K1,  3);
+	MD4_ROUND(MD4_F, d, a, b, c, in[5] + MD4_K1,  7);
+	MD4_ROUND(MD4_F, c, d, a, b, in[6] + MD4_K1, 11);
+	MD4_ROUND(MD4_F, b, c, d, a, in[7] + MD4_K1, 19);
+
+	/* Round 2 */
+	MD4_ROUND(MD4_G, a, b, c, d, in[1] + MD4_K2,  3);
+	MD4_ROUND(MD4_G, d, a, b, c, in[3] + MD4_K2,  5);
+	MD4_ROUND(MD4_G, c, d, a, b, in[5] + MD4_K2,  9);
+	MD4_ROUND(MD4_G, b, c, d, a, in[7] + MD4_K2, 13);
+	MD4_ROUND(MD4_G, a, b, c, d, in[0] + MD4_K2,  3);
+	MD4_ROUND(MD4_G, d, a, b, c, in[2] + MD4_K2,  5);
+	MD4_ROUND(MD4_G, c, d, a, b, in[4] + MD4_K2,  9);
+	MD4_ROUND(MD4_G, b, c, d, a, in[6] + MD4_K2, 13);
+
+	/* Round 3 */
+	MD4_ROUND(MD4_H, a, b, c, d, in[3] + MD4_K3,  3);
+	MD4_ROUND(MD4_H, d, a, b, c, in[7] + MD4_K3,  9);
+	MD4_ROUND(MD4_H, c, d, a, b, in[2] + MD4_K3, 11);
+	MD4_ROUND(MD4_H, b, c, d, a, in[6] + MD4_K3, 15);
+	MD4_ROUND(MD4_H, a, b, c, d, in[1] + MD4_K3,  3);
+	MD4_ROUND(MD4_H, d, a, b, c, in[5] + MD4_K3,  9);
+	MD4_ROUND(MD4_H, c, d, a, b, in[0] + MD4_K3, 11);
+	MD4_ROUND(MD4_H, b, c, d, a, in[4] + MD4_K3, 15);
+
+	buf[0] += a;
+	buf[1] += b;
+	buf[2] += c;
+	buf[3] += d;
+}
+
+/* The old legacy hash */
+static u32 ext4fs_dx_hack_hash(const char *name, u32 len, bool unsign)
+{
+	int c;
+	u32 hash, hash0 = 0x12a3fe2d, hash1 = 0x37abe8f9;
+
+	while (len--) {
+		c = (unsign) ? (int)(unsigned char)*name : (int)(signed char)*name;
+		name++;
+		hash = hash1 + (hash0 ^ (c * 7152373));
+		if (hash & 0x80000000) {
+			hash -= 0x7fffffff;
+		}
+		hash1 = hash0;
+		hash0 = hash;
+	}
+
+	return hash0 << 1;
+}
+
+static void ext4fs_str2hashbuf(const char *msg, u32 len,
+			       u32 *buf, int num, bool unsign)
+{
+	int c;
+	u32 i, pad, val;
+
+	pad = len | (len << 8);
+	pad |= pad << 16;
+
+	val = pad;
+	if (len > (u32)(num * 4)) {
+		len = num * 4;
+	}
+	for (i = 0; i < len; i++) {
+		c = (unsign) ? (int)(unsigned char)msg[i] :
+			       (int)(signed char)msg[i];
+		val = c + (val << 8);
+		if ((i % 4) == 3) {
+			*buf++ = val;
+			val = pad;
+			num--;
+		}
+	}
+	if (--num >= 0) {
+		*buf++ = val;
+	}
+	while (--num >= 0) {
+		*buf++ = pad;
+	}
+}
+
+u32 ext4fs_htree_hash(struct ext4fs_control *ctrl, u8 hash_version,
+		      const char *name, u32 len)
+{
+	int i;
+	bool unsign = FALSE;
+	u32 hash, in[8], buf[4];
+
+	/* Initialize the default seed for the hash checksum functions */
+	buf[0] = 0x67452301;
+	buf[1] = 0xefcdab89;
+	buf[2] = 0x98badcfe;
+	buf[3] = 0x10325476;
+
+	/* If the seed is all zero's, use the default seed */
+	for (i = 0; i < 4; i++) {
+		if (ctrl->hash_seed[i]) {
+			break;
+		}
+	}
+	if (i < 4) {
+		memcpy(buf, ctrl->hash_seed, sizeof(buf));
+	}
+
+	switch (hash_version) {
+	case EXT2_HASH_LEGACY_UNSIGNED:
+		unsign = TRUE;
+		/* fall through */
+	case EXT2_HASH_LEGACY:
+		hash = ext4fs_dx_hack_hash(name, len, unsign);
+		break;
+	case EXT2_HASH_HALF_MD4_UNSIGNED:
+		unsign = TRUE;
+		/* fall through */
+	case EXT2_HASH_HALF_MD4:
+		while (len) {
+			ext4fs_str2hashbuf(name, len, in, 8, unsign);
+			ext4fs_half_md4_transform(buf, in);
+			if (len <= 32) {
+				break;
+			}
+			len -= 32;
+			name += 32;
+		}
+		hash = buf[1];
+		break;
+	case EXT2_HASH_TEA_UNSIGNED:
+		unsign = TRUE;
+		/* fall through */
+	case EXT2_HASH_TEA:
+		while (len) {
+			ext4fs_str2hashbuf(name, len, in, 4, unsign);
+			ext4fs_tea_transform(buf, in);
+			if (len <= 16) {
+				break;
+			}
+			len -= 16;
+			name += 16;
+		}
+		hash = buf[0];
+		break;
+	default:
+		return 0;
+	};
+
+	hash = hash & ~1;
+	if (hash == (EXT2_HTREE_EOF << 1)) {
+		hash = (EXT2_HTREE_EOF - 1) << 1;
+	}
+
+	return hash;
+}
+
+/* One level of index walk */
+struct ext4fs_dx_frame {
+	u8 *buf;
+	struct ext2_dx_entry *entries;
+	u32 count;
+	u32 at;
+};
+
+static inline struct ext2_dx_countlimit *ext4fs_dx_countlimit(
+					struct ext2_dx_entry *entries)
+{
+	return (struct ext2_dx_countlimit *)entries;
+}
+
+static int ext4fs_dx_read_blk(struct ext4fs_node *dnode, u32 blk, u8 *buf)
+{
+	u32 rlen, bsize = dnode->ctrl->block_size;
+
+	rlen = ext4fs_node_read(dnode, (u64)blk * bsize, bsize, (char *)buf);
+
+	return (rlen == bsize) ? VMM_OK : VMM_EIO;
+}
+
+/* Setup frame entries and select entry for given hash */
+static int ext4fs_dx_frame_probe(struct ext4fs_node *dnode,
+				 struct ext4fs_dx_frame *frame,
+				 u32 offset, u32 hash)
+{
+	u32 lo, hi, mid, limit, bsize = dnode->ctrl->block_size;
+	struct ext2_dx_countlimit *cl;
+
+	if ((bsize - sizeof(struct ext2_dx_entry)) < offset) {
+		return VMM_EINVALID;
+	}
+
+	frame->entries = (struct ext2_dx_entry *)(frame->buf + offset);
+	cl = ext4fs_dx_countlimit(frame->entries);
+	frame->count = __le16(cl->count);
+	limit = __le16(cl->limit);
+	if (!frame->count || (limit < frame->count) ||
+	    (((bsize - offset) / sizeof(struct ext2_dx_entry)) < limit)) {
+		return VMM_EINVALID;
+	}
+
+	/* First entry has implicit hash zero (it holds count & limit) */
+	lo = 1;
+	hi = frame->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (hash < __le32(frame->entries[mid].hash)) {
+			hi = mid;
+		} else {
+			lo = mid + 1;
+		}
+	}
+	frame->at = lo - 1;
+
+	return VMM_OK;
+}
+
+static inline u32 ext4fs_dx_frame_blk(struct ext4fs_dx_frame *frame)
+{
+	return __le32(frame->entries[frame->at].block) & EXT2_DX_BLOCK_MASK;
+}
+
+/* Scan a directory leaf block for given name */
+static int ext4fs_dx_scan_leaf(struct ext4fs_node *dnode, u8 *buf,
+			       const char *name, u32 namelen,
+			       struct ext2_dirent *dent)
+{
+	u32 off = 0, reclen, bsize = dnode->ctrl->block_size;
+	struct ext2_dirent *d;
+
+	while ((off + sizeof(struct ext2_dirent)) <= bsize) {
+		d = (struct ext2_dirent *)(buf + off);
+		reclen = __le16(d->direntlen);
+		if ((reclen < sizeof(struct ext2_dirent)) ||
+		    (bsize < (off + reclen)) ||
+		    (reclen < (sizeof(struct ext2_dirent) + d->namelen))) {
+			return VMM_EINVALID;
+		}
+
+		if (__le32(d->inode) && (d->namelen == namelen) &&
+		    !memcmp(buf + off + sizeof(struct ext2_dirent),
+			    name, namelen)) {
+			memcpy(dent, d, sizeof(*dent));
+			return VMM_OK;
+		}
+
+		off += reclen;
+	}
+
+	return VMM_ENOENT;
+}
+
+int ext4fs_htree_find_dirent(struct ext4fs_node *dnode,
+			     const char *name, struct ext2_dirent *dent)
+{
+	int rc;
+	u32 i, p, levels, hash, bhash, namelen;
+	u8 *leaf = NULL;
+	u8 hash_version;
+	struct ext2_dx_root_info *info;
+	struct ext4fs_dx_frame frames[EXT2_HTREE_LEVEL];
+	struct ext4fs_control *ctrl = dnode->ctrl;
+
+	if (!ctrl->dir_index ||
+	    !(__le32(dnode->inode.flags) & EXT2_INDEX_FL)) {
+		return VMM_ENOTSUPP;
+	}
+
+	namelen = strlen(name);
+	if (!namelen || (VFS_MAX_NAME <= namelen)) {
+		return VMM_ENOTSUPP;
+	}
+
+	memset(frames, 0, sizeof(frames));
+	for (i = 0; i < EXT2_HTREE_LEVEL; i++) {
+		frames[i].buf = vmm_malloc(ctrl->block_size);
+		if (!frames[i].buf) {
+			rc = VMM_ENOMEM;
+			goto done;
+		}
+	}
+	leaf = vmm_malloc(ctrl->block_size);
+	if (!leaf) {
+		rc = VMM_ENOMEM;
+		goto done;
+	}
+
+	/* Root lives in block zero after "." and ".." entries */
+	rc = ext4fs_dx_read_blk(dnode, 0, frames[0].buf);
+	if (rc) {
+		goto done;
+	}
+	info = (struct ext2_dx_root_info *)(frames[0].buf +
+					2 * (sizeof(struct ext2_dirent) + 4));
+	hash_version = info->hash_version;
+	levels = info->indirect_levels + 1;
+	if (info->reserved_zero || (levels > EXT2_HTREE_LEVEL) ||
+	    ((hash_version != EXT2_HASH_LEGACY) &&
+	     (hash_version != EXT2_HASH_HALF_MD4) &&
+	     (hash_version != EXT2_HASH_TEA))) {
+		rc = VMM_ENOTSUPP;
+		goto done;
+	}
+	hash_version += ctrl->hash_unsigned;
+	hash = ext4fs_htree_hash(ctrl, hash_version, name, namelen);
+
+	/* Walk down the index */
+	rc = ext4fs_dx_frame_probe(dnode, &frames[0],
+			(u8 *)info + info->info_length - frames[0].buf, hash);
+	for (p = 1; !rc && (p < levels); p++) {
+		rc = ext4fs_dx_read_blk(dnode,
+				ext4fs_dx_frame_blk(&frames[p - 1]),
+				frames[p].buf);
+		if (rc) {
+			break;
+		}
+		rc = ext4fs_dx_frame_probe(dnode, &frames[p],
+				sizeof(struct ext2_dirent), hash);
+	}
+	if (rc) {
+		rc = (rc == VMM_EINVALID) ? VMM_ENOTSUPP : rc;
+		goto done;
+	}
+
+	while (1) {
+		/* Scan leaf block selected by index */
+		rc = ext4fs_dx_read_blk(dnode,
+				ext4fs_dx_frame_blk(&frames[levels - 1]), leaf);
+		if (rc) {
+			break;
+		}
+		rc = ext4fs_dx_scan_leaf(dnode, leaf, name, namelen, dent);
+		if (rc != VMM_ENOENT) {
+			rc = (rc == VMM_EINVALID) ? VMM_ENOTSUPP : rc;
+			break;
+		}
+
+		/* Names with same hash may continue in next leaf block
+		 * in which case next index entry has collision bit set.
+		 */
+		p = levels;
+		while (p && ((frames[p - 1].at + 1) >= frames[p - 1].count)) {
+			p--;
+		}
+		if (!p) {
+			break;
+		}
+		p--;
+		bhash = __le32(frames[p].entries[frames[p].at + 1].hash);
+		if ((bhash & ~1) != hash) {
+			break;
+		}
+		frames[p].at++;
+		for (p = p + 1; p < levels; p++) {
+			rc = ext4fs_dx_read_blk(dnode,
+					ext4fs_dx_frame_blk(&frames[p - 1]),
+					frames[p].buf);
+			if (rc) {
+				break;
+			}
+			rc = ext4fs_dx_frame_probe(dnode, &frames[p],
+					sizeof(struct ext2_dirent), 0);
+			if (rc) {
+				break;
+			}
+			frames[p].at = 0;
+		}
+		if (rc) {
+			rc = (rc == VMM_EINVALID) ? VMM_ENOTSUPP : rc;
+			break;
+		}
+		rc = VMM_ENOENT;
+	}
+
+done:
+	if (leaf) {
+		vmm_free(leaf);
+	}
+	for (i = 0; i < EXT2_HTREE_LEVEL; i++) {
+		if (frames[i].buf) {
+			vmm_free(frames[i].buf);
+		}
+	}
+
+	return rc;
+}
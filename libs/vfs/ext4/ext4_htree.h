@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file ext4_htree.h
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief header file for Ext4 hashed directory (htree) functions
+ */
+#ifndef _EXT4_HTREE_H__
+#define _EXT4_HTREE_H__
+
+#include <vmm_types.h>
+
+#include "ext4_node.h"
+
+u32 ext4fs_htree_hash(struct ext4fs_control *ctrl, u8 hash_version,
+		      const char *name, u32 len);
+
+int ext4fs_htree_find_dirent(struct ext4fs_node *dnode,
+			     const char *name, struct ext2_dirent *dent);
+
+#endif
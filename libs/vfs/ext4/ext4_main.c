@@ -36,6 +36,7 @@
 
 #include "ext4_control.h"
 #include "ext4_node.h"
+#include "ext4_extent.h"
 
 #define MODULE_DESC			"Ext4 Filesystem Driver"
 #define MODULE_AUTHOR			"Anup Patel"
@@ -134,6 +135,12 @@ int ext4fs_mount(struct mount *m, const char *dev, u32 flags)
 	/* Save control as mount point data */
 	m->m_data = ctrl;
 
+	/* Force read-only if metadata can't be updated safely */
+	if (ctrl->rdonly) {
+		m->m_flags &= ~MOUNT_RW;
+		m->m_flags |= MOUNT_RDONLY;
+	}
+
 	return VMM_OK;
 
 fail:
@@ -395,6 +402,10 @@ static int ext4fs_create(struct vnode *dv, const char *name, u32 mode)
 	inode.atime = __le32(ext4fs_current_timestamp());
 	inode.ctime = __le32(ext4fs_current_timestamp());
 
+	if (dnode->ctrl->extents) {
+		ext4fs_extent_init_root(&inode, 0, 0);
+	}
+
 	rc = ext4fs_control_write_inode(dnode->ctrl, inode_no, &inode);
 	if (rc) {
 		ext4fs_control_free_inode(dnode->ctrl, inode_no);
@@ -558,7 +569,11 @@ static int ext4fs_mkdir(struct vnode *dv, const char *name, u32 mode)
 		goto failed2;
 	}
 
-	inode.b.blocks.dir_blocks[0] = __le32(blkno);
+	if (ctrl->extents) {
+		ext4fs_extent_init_root(&inode, blkno, 1);
+	} else {
+		inode.b.blocks.dir_blocks[0] = __le32(blkno);
+	}
 	inode.size = __le32(ctrl->block_size);
 	inode.blockcnt = __le32(ctrl->block_size >> EXT2_SECTOR_BITS);
 
@@ -29,6 +29,8 @@
 
 #include "ext4_control.h"
 #include "ext4_node.h"
+#include "ext4_extent.h"
+#include "ext4_htree.h"
 
 u64 ext4fs_node_get_size(struct ext4fs_node *node)
 {
@@ -47,10 +49,96 @@ void ext4fs_node_set_size(struct ext4fs_node *node, u64 size)
 	if (__le32(node->ctrl->sblock.revision_level) != 0) {
 		node->inode.dir_acl = __le32((u32)(size >> 32));
 	}
-	node->inode.blockcnt = __le32((u32)(size >> EXT2_SECTOR_BITS));
 	node->inode_dirty = TRUE;
 }
 
+int ext4fs_node_alloc_block(struct ext4fs_node *node, u32 *blkno)
+{
+	int rc;
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	rc = ext4fs_control_alloc_block(ctrl, node->inode_no, blkno);
+	if (rc) {
+		return rc;
+	}
+
+	/* Inode block count is in 512 byte units */
+	node->inode.blockcnt = __le32(__le32(node->inode.blockcnt) +
+				(ctrl->block_size >> EXT2_SECTOR_BITS));
+	node->inode_dirty = TRUE;
+
+	return VMM_OK;
+}
+
+int ext4fs_node_free_block(struct ext4fs_node *node, u32 blkno)
+{
+	int rc;
+	u32 blkcnt = __le32(node->inode.blockcnt);
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	rc = ext4fs_control_free_block(ctrl, blkno);
+	if (rc) {
+		return rc;
+	}
+
+	/* Inode block count is in 512 byte units */
+	blkcnt -= (ctrl->block_size >> EXT2_SECTOR_BITS);
+	node->inode.blockcnt = __le32(blkcnt);
+	node->inode_dirty = TRUE;
+
+	return VMM_OK;
+}
+
+/* Write back cached block if it is dirty and within given blocks */
+static int ext4fs_node_flush_cached(struct ext4fs_node *node,
+				    u32 blkno, u32 blkcnt)
+{
+	int rc;
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	if (!node->cached_block || !node->cached_dirty ||
+	    (node->cached_blkno < blkno) ||
+	    ((blkno + blkcnt) <= node->cached_blkno)) {
+		return VMM_OK;
+	}
+
+	rc = ext4fs_devwrite(ctrl, node->cached_blkno, 0,
+			     ctrl->block_size, (char *)node->cached_block);
+	if (rc) {
+		return rc;
+	}
+	node->cached_dirty = FALSE;
+
+	return VMM_OK;
+}
+
+/* Make a newly allocated block as cached block filled with zeros */
+static int ext4fs_node_zero_blk(struct ext4fs_node *node, u32 blkno)
+{
+	int rc;
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	if (!node->cached_block) {
+		node->cached_block = vmm_zalloc(ctrl->block_size);
+		if (!node->cached_block) {
+			return VMM_ENOMEM;
+		}
+	}
+
+	if (node->cached_blkno != blkno) {
+		rc = ext4fs_node_flush_cached(node, node->cached_blkno, 1);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	memset(node->cached_block, 0, ctrl->block_size);
+	node->cached_blkno = blkno;
+	node->cached_dirty = TRUE;
+
+	return VMM_OK;
+}
+
 int ext4fs_node_read_blk(struct ext4fs_node *node,
 			 u32 blkno, u32 blkoff, u32 blklen, char *buf)
 {
@@ -141,8 +229,8 @@ int ext4fs_node_write_blk(struct ext4fs_node *node,
 			if (rc) {
 				return rc;
 			}
-			node->cached_blkno = blkno;
 		}
+		node->cached_blkno = blkno;
 	}
 
 	memcpy(&node->cached_block[blkoff], buf, blklen);
@@ -156,6 +244,11 @@ int ext4fs_node_sync(struct ext4fs_node *node)
 	int rc;
 	struct ext4fs_control *ctrl = node->ctrl;
 
+	rc = ext4fs_extent_sync(node);
+	if (rc) {
+		return rc;
+	}
+
 	if (node->inode_dirty) {
 		rc = ext4fs_control_write_inode(ctrl, 
 					node->inode_no, &node->inode);
@@ -207,17 +300,33 @@ int ext4fs_node_sync(struct ext4fs_node *node)
 int ext4fs_node_read_blkno(struct ext4fs_node *node, u32 blkpos, u32 *blkno)
 {
 	int rc;
-	u32 dindir2_blkno;
+	bool uninit;
+	u32 blkcnt, dindir2_blkno;
 	struct ext2_inode *inode = &node->inode;
 	struct ext4fs_control *ctrl = node->ctrl;
 
-	if (blkpos < ctrl->dir_blklast) {
+	if (ext4fs_node_has_extents(node)) {
+		/* Extents.  */
+		rc = ext4fs_extent_lookup(node, blkpos, blkno, &blkcnt, &uninit);
+		if (rc) {
+			return rc;
+		}
+		/* Uninitialized extents read as zeros */
+		if (uninit) {
+			*blkno = 0;
+		}
+	} else if (blkpos < ctrl->dir_blklast) {
 		/* Direct blocks.  */
 		*blkno = __le32(inode->b.blocks.dir_blocks[blkpos]);
 	} else if (blkpos < ctrl->indir_blklast) {
 		/* Indirect.  */
 		u32 indir_blkpos = blkpos - ctrl->dir_blklast;
 
+		if (!node->indir_blkno) {
+			*blkno = 0;
+			return VMM_OK;
+		}
+
 		if (!node->indir_block) {
 			node->indir_block = vmm_malloc(ctrl->block_size);
 			if (!node->indir_block) {
@@ -237,6 +346,11 @@ int ext4fs_node_read_blkno(struct ext4fs_node *node, u32 blkpos, u32 *blkno)
 		u32 dindir1_blkpos = udiv32(t, ctrl->block_size / 4);
 		u32 dindir2_blkpos = t - dindir1_blkpos * (ctrl->block_size / 4);
 
+		if (!node->dindir1_blkno) {
+			*blkno = 0;
+			return VMM_OK;
+		}
+
 		if (!node->dindir1_block) {
 			node->dindir1_block = vmm_malloc(ctrl->block_size);
 			if (!node->dindir1_block) {
@@ -250,6 +364,10 @@ int ext4fs_node_read_blkno(struct ext4fs_node *node, u32 blkpos, u32 *blkno)
 		}
 
 		dindir2_blkno = __le32(node->dindir1_block[dindir1_blkpos]);
+		if (!dindir2_blkno) {
+			*blkno = 0;
+			return VMM_OK;
+		}
 
 		if (!node->dindir2_block) {
 			node->dindir2_block = vmm_malloc(ctrl->block_size);
@@ -285,6 +403,29 @@ int ext4fs_node_read_blkno(struct ext4fs_node *node, u32 blkpos, u32 *blkno)
 	return VMM_OK;
 }
 
+/* Allocate a zero filled indirect or double-indirect block */
+static int ext4fs_node_alloc_mapblk(struct ext4fs_node *node,
+				    u32 **block, u32 *blkno)
+{
+	int rc;
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	if (!(*block)) {
+		*block = vmm_malloc(ctrl->block_size);
+		if (!(*block)) {
+			return VMM_ENOMEM;
+		}
+	}
+
+	rc = ext4fs_node_alloc_block(node, blkno);
+	if (rc) {
+		return rc;
+	}
+	memset(*block, 0, ctrl->block_size);
+
+	return VMM_OK;
+}
+
 int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno)
 {
 	int rc;
@@ -292,7 +433,10 @@ int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno)
 	struct ext2_inode *inode = &node->inode;
 	struct ext4fs_control *ctrl = node->ctrl;
 
-	if (blkpos < ctrl->dir_blklast) {
+	if (ext4fs_node_has_extents(node)) {
+		/* Extents.  */
+		return ext4fs_extent_map(node, blkpos, blkno);
+	} else if (blkpos < ctrl->dir_blklast) {
 		/* Direct blocks.  */
 		inode->b.blocks.dir_blocks[blkpos] = __le32(blkno);
 		node->inode_dirty = TRUE;
@@ -300,6 +444,20 @@ int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno)
 		/* Indirect.  */
 		u32 indir_blkpos = blkpos - ctrl->dir_blklast;
 
+		if (!node->indir_blkno) {
+			if (!blkno) {
+				return VMM_OK;
+			}
+			rc = ext4fs_node_alloc_mapblk(node, &node->indir_block,
+						      &node->indir_blkno);
+			if (rc) {
+				return rc;
+			}
+			inode->b.blocks.indir_block = __le32(node->indir_blkno);
+			node->inode_dirty = TRUE;
+			node->indir_dirty = TRUE;
+		}
+
 		if (!node->indir_block) {
 			node->indir_block = vmm_malloc(ctrl->block_size);
 			if (!node->indir_block) {
@@ -320,6 +478,21 @@ int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno)
 		u32 dindir1_blkpos = udiv32(t, ctrl->block_size / 4);
 		u32 dindir2_blkpos = t - dindir1_blkpos * (ctrl->block_size / 4);
 
+		if (!node->dindir1_blkno) {
+			if (!blkno) {
+				return VMM_OK;
+			}
+			rc = ext4fs_node_alloc_mapblk(node, &node->dindir1_block,
+						      &node->dindir1_blkno);
+			if (rc) {
+				return rc;
+			}
+			inode->b.blocks.double_indir_block =
+						__le32(node->dindir1_blkno);
+			node->inode_dirty = TRUE;
+			node->dindir1_dirty = TRUE;
+		}
+
 		if (!node->dindir1_block) {
 			node->dindir1_block = vmm_malloc(ctrl->block_size);
 			if (!node->dindir1_block) {
@@ -341,7 +514,7 @@ int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno)
 			}
 			node->dindir2_blkno = 0;
 		}
-		if (dindir2_blkno != node->dindir2_blkno) {
+		if (!dindir2_blkno || (dindir2_blkno != node->dindir2_blkno)) {
 			if (node->dindir2_dirty) {
 				rc = ext4fs_devwrite(ctrl, node->dindir2_blkno,
 						  0, ctrl->block_size, 
@@ -351,9 +524,10 @@ int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno)
 				}
 				node->dindir2_dirty = FALSE;
 			}
-			if (!dindir2_blkno) {
-				rc = ext4fs_control_alloc_block(ctrl, 
-					node->inode_no, &dindir2_blkno);
+			if (!dindir2_blkno && !blkno) {
+				return VMM_OK;
+			} else if (!dindir2_blkno) {
+				rc = ext4fs_node_alloc_block(node, &dindir2_blkno);
 				if (rc) {
 					return rc;
 				}
@@ -382,15 +556,56 @@ int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno)
 	return VMM_OK;
 }
 
+int ext4fs_node_read_blkrun(struct ext4fs_node *node, u32 blkpos,
+			    u32 blkmax, u32 *blkno, u32 *blkcnt)
+{
+	int rc;
+	bool uninit;
+	u32 b, next;
+
+	if (!blkmax) {
+		return VMM_EINVALID;
+	}
+
+	if (ext4fs_node_has_extents(node)) {
+		rc = ext4fs_extent_lookup(node, blkpos, blkno, blkcnt, &uninit);
+		if (rc) {
+			return rc;
+		}
+		/* Uninitialized extents read as zeros */
+		if (uninit) {
+			*blkno = 0;
+		}
+		if (blkmax < *blkcnt) {
+			*blkcnt = blkmax;
+		}
+		return VMM_OK;
+	}
+
+	rc = ext4fs_node_read_blkno(node, blkpos, blkno);
+	if (rc) {
+		return rc;
+	}
+
+	for (b = 1; b < blkmax; b++) {
+		rc = ext4fs_node_read_blkno(node, blkpos + b, &next);
+		if (rc || (next != ((*blkno) ? (*blkno + b) : 0))) {
+			break;
+		}
+	}
+	*blkcnt = b;
+
+	return VMM_OK;
+}
+
 /* Note: Node position has to be 64-bit */
 u32 ext4fs_node_read(struct ext4fs_node *node, u64 pos, u32 len, char *buf)
 {
 	int rc;
 	u64 filesize = ext4fs_node_get_size(node);
-	u32 i, rlen, blkno, blkoff, blklen;
-	u32 last_blkpos, last_blklen;
-	u32 first_blkpos, first_blkoff, first_blklen;
+	u32 rlen, blkpos, blkno, blkoff, blklen, blkcnt;
 	struct ext4fs_control *ctrl = node->ctrl;
+	u32 blkshift = ctrl->log2_block_size + EXT2_SECTOR_BITS;
 
 	if (filesize <= pos) {
 		return 0;
@@ -400,48 +615,60 @@ u32 ext4fs_node_read(struct ext4fs_node *node, u64 pos, u32 len, char *buf)
 	}
 
 	/* Note: div result < 32-bit */
-	first_blkpos = udiv64(pos, ctrl->block_size); 
-	first_blkoff = pos - (first_blkpos * ctrl->block_size);
-	first_blklen = ctrl->block_size - first_blkoff;
-	if (len < first_blklen) {
-		first_blklen = len;
-	}
-
-	/* Note: div result < 32-bit */
-	last_blkpos = udiv64((len + pos), ctrl->block_size); 
-	last_blklen = (len + pos) - (last_blkpos * ctrl->block_size);
+	blkpos = udiv64(pos, ctrl->block_size);
+	blkoff = pos - ((u64)blkpos * ctrl->block_size);
 
 	rlen = len;
-	i = first_blkpos;
 	while (rlen) {
-		rc = ext4fs_node_read_blkno(node, i, &blkno);
-		if (rc) {
-			goto done;
-		}
+		if (!blkoff && (ctrl->block_size <= rlen)) {
+			/* Whole blocks are read directly in
+			 * physically contiguous runs.
+			 */
+			rc = ext4fs_node_read_blkrun(node, blkpos,
+					rlen >> blkshift, &blkno, &blkcnt);
+			if (rc) {
+				goto done;
+			}
+			blklen = blkcnt << blkshift;
 
-		if (i == first_blkpos) {
-			/* First block.  */
-			blkoff = first_blkoff;
-			blklen = first_blklen;
-		} else if (i == last_blkpos) {
-			/* Last block.  */
-			blkoff = 0;
-			blklen = last_blklen;
+			if (!blkno) {
+				memset(buf, 0, blklen);
+			} else {
+				rc = ext4fs_node_flush_cached(node,
+							blkno, blkcnt);
+				if (rc) {
+					goto done;
+				}
+				rc = ext4fs_devread(ctrl, blkno, 0,
+						    blklen, buf);
+				if (rc) {
+					goto done;
+				}
+			}
 		} else {
-			/* Middle block. */
-			blkoff = 0;
-			blklen = ctrl->block_size;
-		}
+			/* Partial block is read via cached block */
+			blkcnt = 1;
+			blklen = ctrl->block_size - blkoff;
+			if (rlen < blklen) {
+				blklen = rlen;
+			}
 
-		/* Read cached block */
-		rc = ext4fs_node_read_blk(node, blkno, blkoff, blklen, buf);
-		if (rc) {
-			goto done;
+			rc = ext4fs_node_read_blkno(node, blkpos, &blkno);
+			if (rc) {
+				goto done;
+			}
+
+			rc = ext4fs_node_read_blk(node, blkno,
+						  blkoff, blklen, buf);
+			if (rc) {
+				goto done;
+			}
 		}
 
 		buf += blklen;
 		rlen -= blklen;
-		i++;
+		blkpos += blkcnt;
+		blkoff = 0;
 	}
 
 done:
@@ -484,8 +711,8 @@ static char *ext4fs_node_read_symlink(struct ext4fs_node *node)
 u32 ext4fs_node_write(struct ext4fs_node *node, u64 pos, u32 len, char *buf)
 {
 	int rc;
-	bool update_nodesize = FALSE, alloc_newblock = FALSE;
-	u32 wlen, blkpos, blkno, blkoff, blklen;
+	bool update_nodesize = FALSE, alloc_newblock = FALSE, uninit;
+	u32 wlen, blkpos, blkno, blkoff, blklen, blkcnt;
 	u64 wpos, filesize = ext4fs_node_get_size(node);
 	struct ext4fs_control *ctrl = node->ctrl;
 
@@ -500,46 +727,72 @@ u32 ext4fs_node_write(struct ext4fs_node *node, u64 pos, u32 len, char *buf)
 		blklen = ctrl->block_size - blkoff;
 		blklen = (wlen < blklen) ? wlen : blklen;
 
-		rc = ext4fs_node_read_blkno(node, blkpos, &blkno);
+		if (ext4fs_node_has_extents(node)) {
+			rc = ext4fs_extent_lookup(node, blkpos,
+						  &blkno, &blkcnt, &uninit);
+		} else {
+			uninit = FALSE;
+			rc = ext4fs_node_read_blkno(node, blkpos, &blkno);
+		}
 		if (rc) {
 			goto done;
 		}
 
 		if (!blkno) {
-			rc = ext4fs_control_alloc_block(ctrl, 
-						node->inode_no, &blkno);
+			rc = ext4fs_node_alloc_block(node, &blkno);
 			if (rc) {
 				goto done;
 			}
 
 			rc = ext4fs_node_write_blkno(node, blkpos, blkno);
 			if (rc) {
-				return rc;
+				ext4fs_node_free_block(node, blkno);
+				goto done;
 			}
 
 			alloc_newblock = TRUE;			
+		} else if (uninit) {
+			/* Mark preallocated block as initialized */
+			rc = ext4fs_node_write_blkno(node, blkpos, blkno);
+			if (rc) {
+				goto done;
+			}
+
+			alloc_newblock = FALSE;
 		} else {
 			alloc_newblock = FALSE;
 		}
 
+		/* Partially written new block must not expose
+		 * stale on-disk contents.
+		 */
+		if ((alloc_newblock || uninit) &&
+		    (blklen != ctrl->block_size)) {
+			rc = ext4fs_node_zero_blk(node, blkno);
+			if (rc) {
+				if (alloc_newblock) {
+					ext4fs_node_free_block(node, blkno);
+					ext4fs_node_write_blkno(node, blkpos, 0);
+				}
+				goto done;
+			}
+		}
+
 		rc = ext4fs_node_write_blk(node, blkno, blkoff, blklen, buf);
 		if (rc) {
 			if (alloc_newblock) {
-				ext4fs_control_free_block(ctrl, blkno);
+				ext4fs_node_free_block(node, blkno);
 				ext4fs_node_write_blkno(node, blkpos, 0);
 			}
 			goto done;
 		}
 
-		if (wpos >= filesize) {
-			update_nodesize = TRUE;
-		}
-
 		wpos += blklen;
 		buf += blklen;
 		wlen -= blklen;
-		if (update_nodesize) {
-			filesize += blklen;
+		if (filesize < wpos) {
+			filesize = wpos;
+			update_nodesize = TRUE;
 		}
 	}
 
@@ -557,6 +810,81 @@ done:
 	return len - wlen;
 }
 
+/* Free indirect and double-indirect blocks not required
+ * by blocks before given block position.
+ */
+static int ext4fs_node_free_mapblks(struct ext4fs_node *node, u32 blkpos)
+{
+	int rc;
+	u32 i, first, dindir2_blkno, per_blk;
+	struct ext2_inode *inode = &node->inode;
+	struct ext4fs_control *ctrl = node->ctrl;
+
+	per_blk = ctrl->block_size / 4;
+
+	if (node->dindir1_blkno) {
+		if (!node->dindir1_block) {
+			node->dindir1_block = vmm_malloc(ctrl->block_size);
+			if (!node->dindir1_block) {
+				return VMM_ENOMEM;
+			}
+			rc = ext4fs_devread(ctrl, node->dindir1_blkno, 0,
+				ctrl->block_size, (char *)node->dindir1_block);
+			if (rc) {
+				return rc;
+			}
+		}
+
+		first = 0;
+		if (ctrl->indir_blklast < blkpos) {
+			first = udiv32(blkpos - ctrl->indir_blklast +
+				       per_blk - 1, per_blk);
+		}
+
+		for (i = first; i < per_blk; i++) {
+			dindir2_blkno = __le32(node->dindir1_block[i]);
+			if (!dindir2_blkno) {
+				continue;
+			}
+			if (dindir2_blkno == node->dindir2_blkno) {
+				node->dindir2_blkno = 0;
+				node->dindir2_dirty = FALSE;
+			}
+			rc = ext4fs_node_free_block(node, dindir2_blkno);
+			if (rc) {
+				return rc;
+			}
+			node->dindir1_block[i] = 0;
+			node->dindir1_dirty = TRUE;
+		}
+
+		if (!first) {
+			rc = ext4fs_node_free_block(node,
+						       node->dindir1_blkno);
+			if (rc) {
+				return rc;
+			}
+			node->dindir1_blkno = 0;
+			node->dindir1_dirty = FALSE;
+			inode->b.blocks.double_indir_block = 0;
+			node->inode_dirty = TRUE;
+		}
+	}
+
+	if (node->indir_blkno && (blkpos <= ctrl->dir_blklast)) {
+		rc = ext4fs_node_free_block(node, node->indir_blkno);
+		if (rc) {
+			return rc;
+		}
+		node->indir_blkno = 0;
+		node->indir_dirty = FALSE;
+		inode->b.blocks.indir_block = 0;
+		node->inode_dirty = TRUE;
+	}
+
+	return VMM_OK;
+}
+
 int ext4fs_node_truncate(struct ext4fs_node *node, u64 pos) 
 {
 	int rc;
@@ -588,28 +916,50 @@ int ext4fs_node_truncate(struct ext4fs_node *node, u64 pos)
 		blkpos = first_blkpos;
 	}
 
-	/* Free node blocks */
-	while (blkpos < blkcnt) {
-		rc = ext4fs_node_read_blkno(node, blkpos, &blkno);
+	/* Write back cached block before its block gets freed */
+	rc = ext4fs_node_flush_cached(node, node->cached_blkno, 1);
+	if (rc) {
+		return rc;
+	}
+	node->cached_blkno = 0;
+
+	if (ext4fs_node_has_extents(node)) {
+		/* Free extents and shrink extent tree */
+		rc = ext4fs_extent_truncate(node, blkpos);
 		if (rc) {
 			return rc;
 		}
+	} else {
+		/* Free node blocks */
+		while (blkpos < blkcnt) {
+			rc = ext4fs_node_read_blkno(node, blkpos, &blkno);
+			if (rc) {
+				return rc;
+			}
 
-		rc = ext4fs_control_free_block(ctrl, blkno);
-		if (rc) {
-			return rc;
+			if (blkno) {
+				rc = ext4fs_node_free_block(node, blkno);
+				if (rc) {
+					return rc;
+				}
+
+				rc = ext4fs_node_write_blkno(node, blkpos, 0);
+				if (rc) {
+					return rc;
+				}
+			}
+
+			blkpos++;
 		}
 
-		rc = ext4fs_node_write_blkno(node, blkpos, 0);
+		/* Free indirect & double indirect blocks */
+		rc = ext4fs_node_free_mapblks(node,
+				(first_blkoff) ? (first_blkpos + 1) : first_blkpos);
 		if (rc) {
 			return rc;
 		}
-
-		blkpos++;
 	}
 
-	/* FIXME: Free indirect & double indirect blocks */
-
 	if (pos != filesize) {
 		/* Update node mtime */
 		node->inode.mtime = __le32(ext4fs_current_timestamp());
@@ -651,6 +1001,13 @@ int ext4fs_node_load(struct ext4fs_control *ctrl,
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	/* Extent cache is loaded on first access */
+	ext4fs_extent_free(node);
+	if (ext4fs_node_has_extents(node)) {
+		node->indir_blkno = 0;
+		node->dindir1_blkno = 0;
+	}
+
 	return VMM_OK;
 }
 
@@ -677,6 +1034,10 @@ int ext4fs_node_init(struct ext4fs_node *node)
 	node->dindir2_blkno = 0;
 	node->dindir2_dirty = FALSE;
 
+	node->ext = NULL;
+	node->ext_tblk = NULL;
+	ext4fs_extent_free(node);
+
 	node->lookup_victim = 0;
 	for (idx = 0; idx < EXT4_NODE_LOOKUP_SIZE; idx++) {
 		node->lookup_name[idx][0] = '\0';
@@ -703,6 +1064,8 @@ int ext4fs_node_exit(struct ext4fs_node *node)
 		vmm_free(node->dindir2_block);
 	}
 
+	ext4fs_extent_free(node);
+
 	return VMM_OK;
 }
 
@@ -792,11 +1155,18 @@ int ext4fs_node_read_dirent(struct ext4fs_node *dnode,
 	d->d_reclen = 0;
 
 	do {
+		if (filesize < (sizeof(struct ext2_dirent) + fileoff)) {
+			return VMM_ENOENT;
+		}
+
 		readlen = ext4fs_node_read(dnode, fileoff, 
 				sizeof(struct ext2_dirent), (char *)&dent);
 		if (readlen != sizeof(struct ext2_dirent)) {
 			return VMM_EIO;
 		}
+		if (!__le16(dent.direntlen)) {
+			return VMM_EIO;
+		}
 
 		if (dent.namelen > (VFS_MAX_NAME - 1)) {
 			dent.namelen = (VFS_MAX_NAME - 1);
@@ -812,7 +1182,11 @@ int ext4fs_node_read_dirent(struct ext4fs_node *dnode,
 		d->d_reclen += __le16(dent.direntlen);
 		fileoff += __le16(dent.direntlen);
 
-		if ((strcmp(d->d_name, ".") == 0) ||
+		/* Skip unused entries (such as htree index blocks),
+		 * "." and ".."
+		 */
+		if (!__le32(dent.inode) ||
+		    (strcmp(d->d_name, ".") == 0) ||
 		    (strcmp(d->d_name, "..") == 0)) {
 			continue;
 		} else {
@@ -858,6 +1232,7 @@ int ext4fs_node_read_dirent(struct ext4fs_node *dnode,
 int ext4fs_node_find_dirent(struct ext4fs_node *dnode, 
 			    const char *name, struct ext2_dirent *dent)
 {
+	int rc;
 	bool found;
 	u32 rlen;
 	char filename[VFS_MAX_NAME];
@@ -868,6 +1243,15 @@ int ext4fs_node_find_dirent(struct ext4fs_node *dnode,
 		return VMM_OK;
 	}
 
+	/* Try to find using hash index of directory */
+	rc = ext4fs_htree_find_dirent(dnode, name, dent);
+	if (rc != VMM_ENOTSUPP) {
+		if (!rc) {
+			ext4fs_node_add_lookup_dirent(dnode, name, dent);
+		}
+		return rc;
+	}
+
 	/* Find desired directoy entry such that we ignore
 	 * "." and ".." in search process
 	 */
@@ -889,9 +1273,13 @@ int ext4fs_node_find_dirent(struct ext4fs_node *dnode,
 		if (rlen != dent->namelen) {
 			return VMM_EIO;
 		}
+		if (!__le16(dent->direntlen)) {
+			return VMM_EIO;
+		}
 		filename[dent->namelen] = '\0';
 
-		if ((strcmp(filename, ".") != 0) &&
+		if (__le32(dent->inode) &&
+		    (strcmp(filename, ".") != 0) &&
 		    (strcmp(filename, "..") != 0)) {
 			if (strcmp(filename, name) == 0) {
 				found = TRUE;
@@ -928,8 +1316,18 @@ int ext4fs_node_add_dirent(struct ext4fs_node *dnode,
 		return VMM_EINVALID;
 	}
 
+	/* New entries are not inserted in hash index so convert
+	 * indexed directory into linear directory. The index blocks
+	 * look like empty directory blocks to linear lookups.
+	 */
+	if (__le32(dnode->inode.flags) & EXT2_INDEX_FL) {
+		dnode->inode.flags =
+			__le32(__le32(dnode->inode.flags) & ~EXT2_INDEX_FL);
+		dnode->inode_dirty = TRUE;
+	}
+
 	/* Compute size of directory entry required */
-	direntlen = sizeof(struct ext2_dirent) + strlen(name);
+	direntlen = EXT2_DIRENT_LEN(strlen(name));
 
 	/* Find directory entry to split */
 	off = 0;
@@ -941,8 +1339,12 @@ int ext4fs_node_add_dirent(struct ext4fs_node *dnode,
 			return VMM_EIO;
 		}
 
-		if (direntlen < (__le16(dent.direntlen) - 
-				dent.namelen - sizeof(struct ext2_dirent))) {
+		if (!__le16(dent.direntlen)) {
+			return VMM_EIO;
+		}
+
+		if ((EXT2_DIRENT_LEN(dent.namelen) + direntlen) <=
+						__le16(dent.direntlen)) {
 			found = TRUE;
 			break;
 		}
@@ -979,9 +1381,9 @@ int ext4fs_node_add_dirent(struct ext4fs_node *dnode,
 		/* Split existing directory entry to make space for 
 		 * new directory entry
 		 */
-		direntlen = (__le16(dent.direntlen) - 
-				dent.namelen - sizeof(struct ext2_dirent));
-		dent.direntlen = __le16(__le16(dent.direntlen) - direntlen);
+		direntlen = __le16(dent.direntlen) -
+				EXT2_DIRENT_LEN(dent.namelen);
+		dent.direntlen = __le16(EXT2_DIRENT_LEN(dent.namelen));
 
 		wlen = ext4fs_node_write(dnode, off, 
 				 sizeof(struct ext2_dirent), (char *)&dent);
@@ -29,6 +29,14 @@
 
 #define EXT4_NODE_LOOKUP_SIZE		4
 
+/* In-memory copy of an ext4 extent */
+struct ext4fs_extent {
+	u32 lblk;
+	u32 pblk;
+	u32 len;
+	bool uninit;
+};
+
 /* Information for accessing a ext4fs file/directory. */
 struct ext4fs_node {
 	/* Parent ext4fs control */
@@ -67,6 +75,21 @@ struct ext4fs_node {
 	u32 dindir2_blkno;
 	bool dindir2_dirty;
 
+	/* Extent cache (only for extent mapped inodes)
+	 * Holds all leaf extents sorted by logical block and
+	 * the blocks used by extent tree nodes. Allocated on
+	 * demand. Must be freed in vput()
+	 */
+	bool ext_loaded;
+	bool ext_dirty;
+	struct ext4fs_extent *ext;
+	u32 ext_count;
+	u32 ext_alloc;
+	u32 ext_hint;
+	u32 *ext_tblk;
+	u32 ext_tblk_count;
+	u32 ext_tblk_alloc;
+
 	/* Child directory entry lookup table */
 	u32 lookup_victim;
 	char lookup_name[EXT4_NODE_LOOKUP_SIZE][VFS_MAX_NAME];
@@ -77,6 +100,10 @@ u64 ext4fs_node_get_size(struct ext4fs_node *node);
 
 void ext4fs_node_set_size(struct ext4fs_node *node, u64 size);
 
+int ext4fs_node_alloc_block(struct ext4fs_node *node, u32 *blkno);
+
+int ext4fs_node_free_block(struct ext4fs_node *node, u32 blkno);
+
 int ext4fs_node_read_blk(struct ext4fs_node *node,
 			 u32 blkno, u32 blkoff, u32 blklen, char *buf);
 
@@ -89,6 +116,9 @@ int ext4fs_node_read_blkno(struct ext4fs_node *node, u32 blkpos, u32 *blkno);
 
 int ext4fs_node_write_blkno(struct ext4fs_node *node, u32 blkpos, u32 blkno);
 
+int ext4fs_node_read_blkrun(struct ext4fs_node *node, u32 blkpos,
+			    u32 blkmax, u32 *blkno, u32 *blkcnt);
+
 u32 ext4fs_node_read(struct ext4fs_node *node, u64 pos, u32 len, char *buf);
 
 u32 ext4fs_node_write(struct ext4fs_node *node, u64 pos, u32 len, char *buf);
@@ -25,6 +25,8 @@ libs-objs-$(CONFIG_VFS_EXT4)+= vfs/ext4/ext4fs.o
 
 ext4fs-y += ext4_control.o
 ext4fs-y += ext4_node.o
+ext4fs-y += ext4_extent.o
+ext4fs-y += ext4_htree.o
 ext4fs-y += ext4_main.o
 
 %/ext4fs.o: $(foreach obj,$(ext4fs-y),%/$(obj))
@@ -27,6 +27,7 @@
 #include <vmm_modules.h>
 #include <libs/stringlib.h>
 #include <libs/mathlib.h>
+#include <libs/bitmap.h>
 
 #include "fat_control.h"
 
@@ -219,22 +220,6 @@ static u32 __fatfs_control_first_valid_cluster(struct fatfs_control *ctrl)
 	return 0x0;
 }
 
-static u32 __fatfs_control_last_valid_cluster(struct fatfs_control *ctrl)
-{
-	switch (ctrl->type) {
-	case FAT_TYPE_12:
-		return FAT12_RESERVED2_CLUSTER - 1;
-		break;
-	case FAT_TYPE_16:
-		return FAT16_RESERVED2_CLUSTER - 1;
-		break;
-	case FAT_TYPE_32:
-		return FAT32_RESERVED2_CLUSTER - 1;
-		break;
-	};
-	return 0x0;
-}
-
 static bool __fatfs_control_valid_cluster(struct fatfs_control *ctrl, u32 cl)
 {
 	switch (ctrl->type) {
@@ -380,6 +365,15 @@ static int __fatfs_control_set_next_cluster(struct fatfs_control *ctrl,
 		return VMM_EIO;
 	}
 
+	/* Keep free cluster bitmap in-sync with FAT */
+	if (ctrl->free_map && (clust < ctrl->free_map_bits)) {
+		if (next) {
+			bitmap_setbit(ctrl->free_map, clust);
+		} else {
+			bitmap_clearbit(ctrl->free_map, clust);
+		}
+	}
+
 	return VMM_OK;
 }
 
@@ -413,68 +407,158 @@ static int __fatfs_control_set_last_cluster(struct fatfs_control *ctrl,
 	return rc;
 }
 
-static int __fatfs_control_nth_cluster(struct fatfs_control *ctrl, 
-					u32 clust, u32 pos, u32 *next)
+static int __fatfs_control_build_free_map(struct fatfs_control *ctrl)
 {
 	int rc;
-	u32 i;
+	u8 *buf;
+	u64 fat_base, rlen;
+	u32 i, clust, off, fat_len, fat_bytes;
+	u32 entry, chunk, chunk_off, chunk_len;
 
-	if (next) {
-		*next = clust;
-	}
-
-	if (!__fatfs_control_valid_cluster(ctrl, clust)) {
-		return VMM_EINVALID;
+	if (ctrl->free_map) {
+		return VMM_OK;
 	}
 
-	for (i = 0; i < pos; i++) {
-		rc = __fatfs_control_get_next_cluster(ctrl, clust, &clust);
+	/* Flush FAT sector cache so that FAT on device is up-to-date */
+	for (i = 0; i < FAT_TABLE_CACHE_SIZE; i++) {
+		rc = __fatfs_control_flush_fat_cache(ctrl, i);
 		if (rc) {
 			return rc;
 		}
+	}
 
-		if (next) {
-			*next = clust;
+	ctrl->free_map_bits = ctrl->data_clusters + 2;
+	ctrl->free_map = vmm_zalloc(bitmap_estimate_size(ctrl->free_map_bits));
+	if (!ctrl->free_map) {
+		return VMM_ENOMEM;
+	}
+
+	/* Chunk size is multiple of 3 sectors so that FAT12 entries
+	 * never cross chunk boundary.
+	 */
+	chunk = FAT_FREE_MAP_CHUNK_SECTORS * ctrl->bytes_per_sector;
+	buf = vmm_malloc(chunk);
+	if (!buf) {
+		vmm_free(ctrl->free_map);
+		ctrl->free_map = NULL;
+		return VMM_ENOMEM;
+	}
+
+	/* Scan FAT in large chunks instead of one sector at a time */
+	rc = VMM_OK;
+	chunk_off = 0;
+	chunk_len = 0;
+	fat_base = (u64)ctrl->first_fat_sector * ctrl->bytes_per_sector;
+	fat_bytes = ctrl->sectors_per_fat * ctrl->bytes_per_sector;
+	fat_len = (ctrl->type == FAT_TYPE_32) ? 4 : 2;
+	for (clust = 0; clust < ctrl->free_map_bits; clust++) {
+		switch (ctrl->type) {
+		case FAT_TYPE_12:
+			off = clust * 12 / 8;
+			break;
+		case FAT_TYPE_16:
+			off = clust * 2;
+			break;
+		default:
+			off = clust * 4;
+			break;
+		};
+
+		if ((off + fat_len) > fat_bytes) {
+			/* Clusters not covered by FAT are never free */
+			bitmap_set(ctrl->free_map, clust,
+				   ctrl->free_map_bits - clust);
+			break;
 		}
 
-		if (!__fatfs_control_valid_cluster(ctrl, clust)) {
-			return VMM_EINVALID;
+		if ((off < chunk_off) || ((chunk_off + chunk_len) <= off)) {
+			chunk_off = off - umod32(off, chunk);
+			chunk_len = fat_bytes - chunk_off;
+			chunk_len = (chunk < chunk_len) ? chunk : chunk_len;
+			rlen = vmm_blockdev_read(ctrl->bdev, buf,
+						 fat_base + chunk_off, chunk_len);
+			if (rlen != chunk_len) {
+				rc = VMM_EIO;
+				break;
+			}
+		}
+
+		i = off - chunk_off;
+		if (fat_len == 2) {
+			entry = ((u32)buf[i + 1] << 8) | ((u32)buf[i]);
+		} else {
+			entry = ((u32)buf[i + 3] << 24) |
+				((u32)buf[i + 2] << 16) |
+				((u32)buf[i + 1] << 8) |
+				((u32)buf[i]);
+			entry &= 0x0FFFFFFF;
+		}
+		if (ctrl->type == FAT_TYPE_12) {
+			entry = (clust % 2) ? (entry >> 4) : (entry & 0xFFF);
+		}
+
+		if (entry || !__fatfs_control_valid_cluster(ctrl, clust)) {
+			bitmap_setbit(ctrl->free_map, clust);
 		}
 	}
 
-	return VMM_OK;
+	vmm_free(buf);
+
+	if (rc) {
+		vmm_free(ctrl->free_map);
+		ctrl->free_map = NULL;
+	}
+
+	return rc;
 }
 
-static int __fatfs_control_alloc_first_cluster(struct fatfs_control *ctrl, 
-						u32 *newclust)
+static int __fatfs_control_find_free_cluster(struct fatfs_control *ctrl,
+					     u32 hint, u32 *clust)
 {
 	int rc;
-	bool found;
-	u32 current, next, first, last;
+	u32 first, found;
+
+	rc = __fatfs_control_build_free_map(ctrl);
+	if (rc) {
+		return rc;
+	}
 
-	found = FALSE;
 	first = __fatfs_control_first_valid_cluster(ctrl);
-	last = __fatfs_control_last_valid_cluster(ctrl);
-	for (current = first; current <= last; current++) {
-		rc = __fatfs_control_get_next_cluster(ctrl, current, &next);
-		if (rc) {
-			return rc;
-		}
+	if ((hint < first) || (ctrl->free_map_bits <= hint)) {
+		hint = first;
+	}
 
-		if (next == 0x0) {
-			found = TRUE;
-			break;
+	found = find_next_zero_bit(ctrl->free_map,
+				   ctrl->free_map_bits, hint);
+	if (found >= ctrl->free_map_bits) {
+		found = find_next_zero_bit(ctrl->free_map, hint, first);
+		if (found >= hint) {
+			return VMM_ENOTAVAIL;
 		}
 	}
 
-	if (!found) {
-		return VMM_ENOTAVAIL;
+	*clust = found;
+
+	return VMM_OK;
+}
+
+static int __fatfs_control_alloc_first_cluster(struct fatfs_control *ctrl, 
+						u32 *newclust)
+{
+	int rc;
+	u32 current;
+
+	rc = __fatfs_control_find_free_cluster(ctrl, ctrl->free_hint,
+						&current);
+	if (rc) {
+		return rc;
 	}
 
 	rc = __fatfs_control_set_last_cluster(ctrl, current);
 	if (rc) {
 		return rc;
 	}
+	ctrl->free_hint = current + 1;
 
 	if (newclust) {
 		*newclust = current;
@@ -487,8 +571,7 @@ static int __fatfs_control_append_free_cluster(struct fatfs_control *ctrl,
 					       u32 clust, u32 *newclust)
 {
 	int rc;
-	bool found;
-	u32 current, next, first, last;
+	u32 current, next;
 
 	if (!__fatfs_control_valid_cluster(ctrl, clust)) {
 		return VMM_EINVALID;
@@ -508,33 +591,12 @@ static int __fatfs_control_append_free_cluster(struct fatfs_control *ctrl,
 		}
 	}
 
-	found = FALSE;
-	first = __fatfs_control_first_valid_cluster(ctrl);
-	last = __fatfs_control_last_valid_cluster(ctrl);
-	current = clust + 1;
-	while (1) {
-		if (clust == current) {
-			break;
-		}
-
-		rc = __fatfs_control_get_next_cluster(ctrl, current, &next);
-		if (rc) {
-			return rc;
-		}
-
-		if (next == 0x0) {
-			found = TRUE;
-			break;
-		}
-
-		current++;
-		if (current > last) {
-			current = first;
-		}
-	}
-
-	if (!found) {
-		return VMM_ENOTAVAIL;
+	/* Prefer cluster right after last cluster so that
+	 * cluster chain stays physically contiguous.
+	 */
+	rc = __fatfs_control_find_free_cluster(ctrl, clust + 1, &current);
+	if (rc) {
+		return rc;
 	}
 
 	rc = __fatfs_control_set_last_cluster(ctrl, current);
@@ -546,9 +608,10 @@ static int __fatfs_control_append_free_cluster(struct fatfs_control *ctrl,
 	if (rc) {
 		return rc;
 	}
+	ctrl->free_hint = current + 1;
 
 	if (newclust) {
-		*newclust = clust;
+		*newclust = current;
 	}
 
 	return VMM_OK;
@@ -623,13 +686,13 @@ bool fatfs_control_valid_cluster(struct fatfs_control *ctrl, u32 clust)
 	return __fatfs_control_valid_cluster(ctrl, clust);
 }
 
-int fatfs_control_nth_cluster(struct fatfs_control *ctrl, 
-				u32 clust, u32 pos, u32 *next)
+int fatfs_control_next_cluster(struct fatfs_control *ctrl, 
+			       u32 clust, u32 *next)
 {
 	int rc;
 
 	vmm_mutex_lock(&ctrl->fat_cache_lock);
-	rc = __fatfs_control_nth_cluster(ctrl, clust, pos, next);
+	rc = __fatfs_control_get_next_cluster(ctrl, clust, next);
 	vmm_mutex_unlock(&ctrl->fat_cache_lock);
 
 	return rc;
@@ -697,8 +760,8 @@ int fatfs_control_sync(struct fatfs_control *ctrl)
 	}
 	vmm_mutex_unlock(&ctrl->fat_cache_lock);
 
-	/* Flush cached data in device request queue */
-	rc = vmm_blockdev_flush_cache(ctrl->bdev);
+	/* Flush cached data and make it durable on block device */
+	rc = vmm_blockdev_flush(ctrl->bdev);
 	if (rc) {
 		return rc;
 	}
@@ -816,6 +879,9 @@ int fatfs_control_init(struct fatfs_control *ctrl, struct vmm_blockdev *bdev)
 	}
 	ctrl->fat_cache_buf = 
 		vmm_zalloc(FAT_TABLE_CACHE_SIZE * ctrl->bytes_per_sector);
+	ctrl->free_map = NULL;
+	ctrl->free_map_bits = 0;
+	ctrl->free_hint = 0;
 	if (!ctrl->fat_cache_buf) {
 		return VMM_ENOMEM;
 	}
@@ -834,6 +900,10 @@ int fatfs_control_init(struct fatfs_control *ctrl, struct vmm_blockdev *bdev)
 
 int fatfs_control_exit(struct fatfs_control *ctrl)
 {
+	if (ctrl->free_map) {
+		vmm_free(ctrl->free_map);
+		ctrl->free_map = NULL;
+	}
 	vmm_free(ctrl->fat_cache_buf);
 
 	return VMM_OK;
@@ -33,6 +33,7 @@
 #define __le16(x)			vmm_le16_to_cpu(x)
 
 #define FAT_TABLE_CACHE_SIZE		32
+#define FAT_FREE_MAP_CHUNK_SECTORS	48
 
 /* Information about a "mounted" FAT filesystem. */
 struct fatfs_control {
@@ -71,6 +72,14 @@ struct fatfs_control {
 	bool fat_cache_dirty[FAT_TABLE_CACHE_SIZE];
 	u32 fat_cache_num[FAT_TABLE_CACHE_SIZE];
 	u8 *fat_cache_buf;
+
+	/* Free cluster bitmap (set bit means cluster in use).
+	 * Built on first cluster allocation and protected by
+	 * fat_cache_lock.
+	 */
+	unsigned long *free_map;
+	u32 free_map_bits;
+	u32 free_hint;
 };
 
 u32 fatfs_pack_timestamp(u32 year, u32 mon, u32 day, 
@@ -81,8 +90,8 @@ void fatfs_current_timestamp(u32 *year, u32 *mon, u32 *day,
 
 bool fatfs_control_valid_cluster(struct fatfs_control *ctrl, u32 clust);
 
-int fatfs_control_nth_cluster(struct fatfs_control *ctrl, 
-			      u32 clust, u32 pos, u32 *next);
+int fatfs_control_next_cluster(struct fatfs_control *ctrl, 
+			       u32 clust, u32 *next);
 
 int fatfs_control_set_last_cluster(struct fatfs_control *ctrl, u32 clust);
 
@@ -165,6 +165,175 @@ static int fatfs_node_sync_parent_dent(struct fatfs_node *node)
 	return VMM_OK;
 }
 
+static void fatfs_node_runs_reset(struct fatfs_node *node)
+{
+	node->runs_first = node->first_cluster;
+	node->runs_mapped = 0;
+	node->runs_end = FALSE;
+	node->runs_hint = 0;
+	node->runs_count = 0;
+}
+
+static int fatfs_node_runs_append(struct fatfs_node *node, u32 pclust)
+{
+	u32 nalloc;
+	struct fatfs_node_run *run, *nruns;
+
+	if (node->runs_count) {
+		run = &node->runs[node->runs_count - 1];
+		if ((run->pclust + run->count) == pclust) {
+			run->count++;
+			node->runs_mapped++;
+			return VMM_OK;
+		}
+	}
+
+	if (node->runs_count == node->runs_alloc) {
+		nalloc = (node->runs_alloc) ?
+			  (node->runs_alloc * 2) : FAT_NODE_RUNS_GROW;
+		nruns = vmm_malloc(nalloc * sizeof(*nruns));
+		if (!nruns) {
+			return VMM_ENOMEM;
+		}
+		if (node->runs) {
+			memcpy(nruns, node->runs,
+			       node->runs_count * sizeof(*nruns));
+			vmm_free(node->runs);
+		}
+		node->runs = nruns;
+		node->runs_alloc = nalloc;
+	}
+
+	run = &node->runs[node->runs_count];
+	run->lclust = node->runs_mapped;
+	run->pclust = pclust;
+	run->count = 1;
+	node->runs_count++;
+	node->runs_mapped++;
+
+	return VMM_OK;
+}
+
+static void fatfs_node_runs_trim(struct fatfs_node *node, u32 lclust)
+{
+	struct fatfs_node_run *run;
+
+	if (node->runs_mapped <= lclust) {
+		return;
+	}
+
+	while (node->runs_count) {
+		run = &node->runs[node->runs_count - 1];
+		if (run->lclust < lclust) {
+			run->count = lclust - run->lclust;
+			break;
+		}
+		node->runs_count--;
+	}
+
+	node->runs_mapped = lclust;
+	node->runs_end = TRUE;
+	node->runs_hint = 0;
+}
+
+/* Walk cluster chain until logical cluster lclust is mapped or
+ * end of cluster chain is reached. The walk resumes from the last
+ * mapped cluster so each FAT entry of a file is read only once.
+ */
+static int fatfs_node_runs_extend(struct fatfs_node *node, u32 lclust)
+{
+	int rc;
+	u32 next;
+	struct fatfs_node_run *run;
+	struct fatfs_control *ctrl = node->ctrl;
+
+	if (node->runs_first != node->first_cluster) {
+		fatfs_node_runs_reset(node);
+	}
+
+	if (!node->runs_mapped && !node->runs_end) {
+		if (!fatfs_control_valid_cluster(ctrl, node->first_cluster)) {
+			node->runs_end = TRUE;
+			return VMM_OK;
+		}
+		rc = fatfs_node_runs_append(node, node->first_cluster);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	while ((node->runs_mapped <= lclust) && !node->runs_end) {
+		run = &node->runs[node->runs_count - 1];
+		rc = fatfs_control_next_cluster(ctrl,
+				run->pclust + run->count - 1, &next);
+		if (rc) {
+			return rc;
+		}
+
+		if (!fatfs_control_valid_cluster(ctrl, next)) {
+			node->runs_end = TRUE;
+			break;
+		}
+
+		/* Cluster chain longer than data area means a loop */
+		if (ctrl->data_clusters <= node->runs_mapped) {
+			return VMM_EIO;
+		}
+
+		rc = fatfs_node_runs_append(node, next);
+		if (rc) {
+			return rc;
+		}
+	}
+
+	return VMM_OK;
+}
+
+/* Map logical cluster lclust to physical cluster. Optionally, also
+ * return count of physically contiguous clusters starting from it
+ * considering upto want clusters of cluster chain.
+ */
+static int fatfs_node_map_cluster(struct fatfs_node *node, u32 lclust,
+				  u32 want, u32 *pclust, u32 *count)
+{
+	int rc;
+	u32 lo, hi, mid;
+	struct fatfs_node_run *run;
+
+	rc = fatfs_node_runs_extend(node, lclust + ((want) ? want - 1 : 0));
+	if (rc) {
+		return rc;
+	}
+
+	if (node->runs_mapped <= lclust) {
+		return VMM_ENOENT;
+	}
+
+	run = &node->runs[node->runs_hint];
+	if ((lclust < run->lclust) || ((run->lclust + run->count) <= lclust)) {
+		lo = 0;
+		hi = node->runs_count - 1;
+		while (lo < hi) {
+			mid = lo + (hi - lo + 1) / 2;
+			if (node->runs[mid].lclust <= lclust) {
+				lo = mid;
+			} else {
+				hi = mid - 1;
+			}
+		}
+		node->runs_hint = lo;
+		run = &node->runs[lo];
+	}
+
+	*pclust = run->pclust + (lclust - run->lclust);
+	if (count) {
+		*count = run->count - (lclust - run->lclust);
+		*count = (want && (want < *count)) ? want : *count;
+	}
+
+	return VMM_OK;
+}
+
 u32 fatfs_node_get_size(struct fatfs_node *node)
 {
 	if (!node) {
@@ -178,7 +347,7 @@ u32 fatfs_node_read(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 {
 	int rc;
 	u64 rlen, roff;
-	u32 r, cl_pos, cl_off, cl_num, cl_len;
+	u32 r, cl_pos, cl_off, cl_num, cl_cnt, cl_len;
 	struct fatfs_control *ctrl = node->ctrl;
 
 	if (!node->parent && ctrl->type != FAT_TYPE_32) {
@@ -205,35 +374,50 @@ u32 fatfs_node_read(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 	}
 
 	r = 0;
+	cl_pos = udiv32(pos, ctrl->bytes_per_cluster);
+	cl_off = pos - cl_pos * ctrl->bytes_per_cluster;
 	while (r < len) {
-		/* Get the next cluster */
-		if (r == 0) {
-			cl_pos = udiv32(pos, ctrl->bytes_per_cluster); 
-			cl_off = pos - cl_pos * ctrl->bytes_per_cluster;
-			rc = fatfs_control_nth_cluster(ctrl, 
-							node->first_cluster,
-							cl_pos, &cl_num);
-			if (rc) {
-				return 0;
+		/* Get the next cluster and contiguous cluster count */
+		cl_cnt = udiv32(cl_off + (len - r) +
+				ctrl->bytes_per_cluster - 1,
+				ctrl->bytes_per_cluster);
+		rc = fatfs_node_map_cluster(node, cl_pos, cl_cnt,
+					    &cl_num, &cl_cnt);
+		if (rc) {
+			break;
+		}
+
+		/* Read whole contiguous clusters directly */
+		if (!cl_off && (ctrl->bytes_per_cluster <= (len - r))) {
+			cl_cnt = min(cl_cnt,
+				     udiv32(len - r, ctrl->bytes_per_cluster));
+			cl_len = cl_cnt * ctrl->bytes_per_cluster;
+
+			if (fatfs_node_sync_cached_cluster(node)) {
+				break;
 			}
-			cl_len = ctrl->bytes_per_cluster - cl_off;
-			cl_len = (cl_len < len) ? cl_len : len;
-		} else {
-			cl_pos++;
-			cl_off = 0;
-			rc = fatfs_control_nth_cluster(ctrl, 
-							cl_num, 1, &cl_num);
-			if (rc) {
-				return r;
+
+			roff = (u64)ctrl->first_data_sector * 
+						ctrl->bytes_per_sector;
+			roff += (u64)(cl_num - 2) * ctrl->bytes_per_cluster;
+			rlen = vmm_blockdev_read(ctrl->bdev, buf, roff, cl_len);
+			if (rlen != cl_len) {
+				break;
 			}
-			cl_len = (ctrl->bytes_per_cluster < (len - r)) ? 
-					ctrl->bytes_per_cluster : (len - r);
+
+			r += cl_len;
+			buf += cl_len;
+			cl_pos += cl_cnt;
+			continue;
 		}
 
+		cl_len = ctrl->bytes_per_cluster - cl_off;
+		cl_len = (cl_len < (len - r)) ? cl_len : (len - r);
+
 		/* Make sure cached cluster is updated */
 		if (node->cached_clust != cl_num) {
 			if (fatfs_node_sync_cached_cluster(node)) {
-				return 0;
+				break;
 			}
 
 			node->cached_clust = cl_num;
@@ -245,7 +429,8 @@ u32 fatfs_node_read(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 						node->cached_data, 
 						roff, ctrl->bytes_per_cluster);
 			if (rlen != ctrl->bytes_per_cluster) {
-				return r;
+				node->cached_clust = 0;
+				break;
 			}
 		}
 
@@ -255,6 +440,8 @@ u32 fatfs_node_read(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 		/* Update iteration */
 		r += cl_len;
 		buf += cl_len;
+		cl_pos++;
+		cl_off = 0;
 	}
 
 	return r;
@@ -265,7 +452,7 @@ u32 fatfs_node_write(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 	int rc;
 	u64 woff, wlen;
 	u32 w, wstartcl, wendcl;
-	u32 cl_off, cl_num, cl_len;
+	u32 cl_pos, cl_off, cl_num, cl_cnt, cl_len;
 	u32 year, mon, day, hour, min, sec;
 	struct fatfs_control *ctrl = node->ctrl;
 
@@ -276,12 +463,18 @@ u32 fatfs_node_write(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 		}
 		if ((pos + len) > wlen) {
 			wlen = wlen - pos;
+		} else {
+			wlen = len;
 		}
 		woff = (u64)ctrl->first_root_sector * ctrl->bytes_per_sector;
 		woff += pos;
 		return vmm_blockdev_write(ctrl->bdev, (u8 *)buf, woff, wlen);
 	}
 
+	if (!len) {
+		return 0;
+	}
+
 	wstartcl = udiv32(pos, ctrl->bytes_per_cluster);
 	wendcl = udiv32(pos + len - 1, ctrl->bytes_per_cluster);
 
@@ -294,13 +487,11 @@ u32 fatfs_node_write(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 	}
 
 	/* Sync and zero-out cached cluster buffer */
-	if (fatfs_control_valid_cluster(ctrl, node->cached_clust)) {
-		if (fatfs_node_sync_cached_cluster(node)) {
-			return 0;
-		}
-		node->cached_clust = 0;
-		memset(node->cached_data, 0, ctrl->bytes_per_cluster);
+	if (fatfs_node_sync_cached_cluster(node)) {
+		return 0;
 	}
+	node->cached_clust = 0;
+	memset(node->cached_data, 0, ctrl->bytes_per_cluster);
 
 	/* If first cluster is zero then allocate first cluster */
 	if (node->first_cluster == 0) {
@@ -318,26 +509,31 @@ u32 fatfs_node_write(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 	}
 
 	/* Make room for new data by appending free clusters */
-	cl_num = node->first_cluster;
-	for (w = 0; w <= (wendcl - wstartcl); w++) {
-		if (w == 0) {
-			rc = fatfs_control_nth_cluster(ctrl, cl_num,
-							wstartcl, &cl_num);
-			if (!rc) {
-				continue;
-			}
-		} else {
-			rc = fatfs_control_nth_cluster(ctrl, cl_num, 1, &cl_num);
-			if (!rc) {
-				continue;
-			}
-		}
-
-		/* Add new cluster */
+	rc = fatfs_node_runs_extend(node, wendcl);
+	if (rc) {
+		return 0;
+	}
+	while (node->runs_count && (node->runs_mapped <= wendcl)) {
+		/* Add new cluster after last cluster */
+		cl_pos = node->runs_mapped;
+		cl_num = node->runs[node->runs_count - 1].pclust + 
+			 node->runs[node->runs_count - 1].count - 1;
 		rc = fatfs_control_append_free_cluster(ctrl, cl_num, &cl_num);
 		if (rc) {
 			break;
 		}
+		rc = fatfs_node_runs_append(node, cl_num);
+		if (rc) {
+			fatfs_node_runs_reset(node);
+			break;
+		}
+
+		/* No need to zero-out cluster fully covered by new data */
+		woff = (u64)cl_pos * ctrl->bytes_per_cluster;
+		if ((pos <= woff) &&
+		    ((woff + ctrl->bytes_per_cluster) <= ((u64)pos + len))) {
+			continue;
+		}
 
 		/* Write zeros to new cluster */
 		woff = (u64)ctrl->first_data_sector * ctrl->bytes_per_sector;
@@ -350,20 +546,22 @@ u32 fatfs_node_write(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 		}
 	}
 
-	/* Write data to required location */
+	/* Write data to required location one contiguous run at a time */
 	w = 0;
-	rc = fatfs_control_nth_cluster(ctrl, node->first_cluster, 
-					wstartcl, &cl_num);
-	if (rc) {
-		goto done;
-	}
+	cl_pos = wstartcl;
+	cl_off = pos - wstartcl * ctrl->bytes_per_cluster;
 	while (w < len) {
-		/* Current cluster info */
-		cl_off = umod64(pos + w, ctrl->bytes_per_cluster);
-		cl_len = ctrl->bytes_per_cluster - cl_off;
-		cl_len = (len < cl_len) ? len : cl_len;
+		rc = fatfs_node_map_cluster(node, cl_pos, wendcl - cl_pos + 1,
+					    &cl_num, &cl_cnt);
+		if (rc) {
+			break;
+		}
 
-		/* Write next cluster */
+		/* Current run info */
+		cl_len = cl_cnt * ctrl->bytes_per_cluster - cl_off;
+		cl_len = ((len - w) < cl_len) ? (len - w) : cl_len;
+
+		/* Write current run */
 		woff = (u64)ctrl->first_data_sector * ctrl->bytes_per_sector;
 		woff += (u64)(cl_num - 2) * ctrl->bytes_per_cluster;
 		woff += cl_off;
@@ -375,15 +573,10 @@ u32 fatfs_node_write(struct fatfs_node *node, u32 pos, u32 len, u8 *buf)
 		/* Update iteration */
 		w += cl_len;
 		buf += cl_len;
-
-		/* Go to next cluster */
-		rc = fatfs_control_nth_cluster(ctrl, cl_num, 1, &cl_num);
-		if (rc) {
-			break;
-		}
+		cl_pos += cl_cnt;
+		cl_off = 0;
 	}
 
-done:
 	/* Update node size */
 	if (!(node->parent_dent.file_attributes & FAT_DIRENT_SUBDIR)) {
 		if (__le32(node->parent_dent.file_size) < (pos + w)) {
@@ -424,15 +617,25 @@ int fatfs_node_truncate(struct fatfs_node *node, u32 pos)
 	if (cl_off) {
 		cl_pos += 1;
 	}
-	rc = fatfs_control_nth_cluster(ctrl, node->first_cluster, 
-					cl_pos, &cl_num);
+	rc = fatfs_node_map_cluster(node, cl_pos, 1, &cl_num, NULL);
+	if (rc == VMM_ENOENT) {
+		/* No clusters after last cluster */
+		goto skip_clusters;
+	} else if (rc) {
+		return rc;
+	}
+
+	/* Drop cached cluster because it may be freed */
+	rc = fatfs_node_sync_cached_cluster(node);
 	if (rc) {
 		return rc;
 	}
+	node->cached_clust = 0;
 
 	/* Remove all clusters after last cluster */
 	rc = fatfs_control_truncate_clusters(ctrl, cl_num);
 	if (rc) {
+		fatfs_node_runs_reset(node);
 		return rc;
 	}
 
@@ -441,18 +644,23 @@ int fatfs_node_truncate(struct fatfs_node *node, u32 pos)
 	 */
 	if (cl_pos == 0) {
 		node->first_cluster = 0;
+		node->parent_dent.first_cluster_hi = 0;
+		node->parent_dent.first_cluster_lo = 0;
+		fatfs_node_runs_reset(node);
 	} else {
-		rc = fatfs_control_nth_cluster(ctrl, node->first_cluster, 
-						cl_pos - 1, &cl_num);
+		rc = fatfs_node_map_cluster(node, cl_pos - 1, 1,
+					    &cl_num, NULL);
 		if (rc) {
 			return rc;
 		}
+		fatfs_node_runs_trim(node, cl_pos);
 		rc = fatfs_control_set_last_cluster(ctrl, cl_num);
 		if (rc) {
 			return rc;
 		}
 	}
 
+skip_clusters:
 	/* Update node size */
 	if (!(node->parent_dent.file_attributes & FAT_DIRENT_SUBDIR)) {
 		if (pos < __le32(node->parent_dent.file_size)) {
@@ -508,6 +716,10 @@ int fatfs_node_init(struct fatfs_control *ctrl, struct fatfs_node *node)
 	node->cached_data = NULL;
 	node->cached_dirty = FALSE;
 
+	node->runs_alloc = 0;
+	node->runs = NULL;
+	fatfs_node_runs_reset(node);
+
 	node->lookup_victim = 0;
 	for (idx = 0; idx < FAT_NODE_LOOKUP_SIZE; idx++) {
 		node->lookup_name[idx][0] = '\0';
@@ -527,6 +739,13 @@ int fatfs_node_exit(struct fatfs_node *node)
 		node->cached_dirty = FALSE;
 	}
 
+	if (node->runs) {
+		vmm_free(node->runs);
+		node->runs = NULL;
+		node->runs_alloc = 0;
+		fatfs_node_runs_reset(node);
+	}
+
 	return VMM_OK;
 }
 
@@ -617,27 +836,27 @@ int fatfs_node_read_dirent(struct fatfs_node *dnode,
 
 		if (!strlen(lname)) {
 			i = 8;
-			while (i && (dent.dos_file_name[i-1] == ' ')) {
-				dent.dos_file_name[i-1] = '\0';
+			while (i && (check[i-1] == ' ')) {
+				check[i-1] = '\0';
 				i--;
 			}
 			i = 3;
-			while (i && (dent.dos_extension[i-1] == ' ')) {
-				dent.dos_extension[i-1] = '\0';
+			while (i && (check[7 + i] == ' ')) {
+				check[7 + i] = '\0';
 				i--;
 			}
 
-			for(i = 0; i < 8 && dent.dos_file_name[i]; i++) {
-				lname[i] = tolower(dent.dos_file_name[i]);
+			for(i = 0; i < 8 && check[i]; i++) {
+				lname[i] = tolower(check[i]);
 			}
 			lname[8] = '\0';
 
-			if (dent.dos_extension[0] != '\0') {
+			if (check[8] != '\0') {
 				len = strlen(lname);
 				lname[len] = '.';
-				lname[len+1] = tolower(dent.dos_extension[0]);
-				lname[len+2] = tolower(dent.dos_extension[1]);
-				lname[len+3] = tolower(dent.dos_extension[2]);
+				lname[len+1] = tolower(check[8]);
+				lname[len+2] = tolower(check[9]);
+				lname[len+3] = tolower(check[10]);
 				lname[len+4] = '\0';
 			}
 
@@ -750,27 +969,27 @@ int fatfs_node_find_dirent(struct fatfs_node *dnode,
 			lfn_off = off - sizeof(struct fat_dirent);
 			lfn_len = 0;
 			i = 8;
-			while (i && (dent->dos_file_name[i-1] == ' ')) {
-				dent->dos_file_name[i-1] = '\0';
+			while (i && (check[i-1] == ' ')) {
+				check[i-1] = '\0';
 				i--;
 			}
 			i = 3;
-			while (i && (dent->dos_extension[i-1] == ' ')) {
-				dent->dos_extension[i-1] = '\0';
+			while (i && (check[7 + i] == ' ')) {
+				check[7 + i] = '\0';
 				i--;
 			}
 
-			for(i = 0; i < 8 && dent->dos_file_name[i]; i++) {
-				lname[i] = tolower(dent->dos_file_name[i]);
+			for(i = 0; i < 8 && check[i]; i++) {
+				lname[i] = tolower(check[i]);
 			}
 			lname[8] = '\0';
 
-			if (dent->dos_extension[0] != '\0') {
+			if (check[8] != '\0') {
 				len = strlen(lname);
 				lname[len+0] = '.';
-				lname[len+1] = tolower(dent->dos_extension[0]);
-				lname[len+2] = tolower(dent->dos_extension[1]);
-				lname[len+3] = tolower(dent->dos_extension[2]);
+				lname[len+1] = tolower(check[8]);
+				lname[len+2] = tolower(check[9]);
+				lname[len+3] = tolower(check[10]);
 				lname[len+4] = '\0';
 			}
 			lcsum = dcsum;
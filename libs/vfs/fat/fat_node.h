@@ -28,6 +28,14 @@
 #include "fat_common.h"
 
 #define FAT_NODE_LOOKUP_SIZE		4
+#define FAT_NODE_RUNS_GROW		16
+
+/* Run of physically contiguous clusters of a FAT file/directory. */
+struct fatfs_node_run {
+	u32 lclust;
+	u32 pclust;
+	u32 count;
+};
 
 /* Information for accessing a FAT file/directory. */
 struct fatfs_node {
@@ -49,6 +57,15 @@ struct fatfs_node {
 	u32 cached_clust;
 	bool cached_dirty;
 
+	/* Cached cluster runs (lazily built from cluster chain) */
+	u32 runs_first;
+	u32 runs_mapped;
+	bool runs_end;
+	u32 runs_hint;
+	u32 runs_count;
+	u32 runs_alloc;
+	struct fatfs_node_run *runs;
+
 	/* Child directory entry lookup table */
 	u32 lookup_victim;
 	char lookup_name[FAT_NODE_LOOKUP_SIZE][VFS_MAX_NAME];
@@ -26,6 +26,7 @@
 #include <vmm_stdio.h>
 #include <vmm_scheduler.h>
 #include <vmm_modules.h>
+#include <vmm_rcu.h>
 #include <arch_atomic.h>
 #include <libs/stringlib.h>
 #include <libs/bitmap.h>
@@ -46,9 +47,28 @@ struct file {
 	struct vnode *f_vnode;		/* vnode */
 };
 
+/** file table (replaced as a whole when it grows) */
+struct vfs_fdtable {
+	u32 count;
+	struct file *fd[];
+};
+
 /* size of vnode hash table, must power 2 */
 #define VFS_VNODE_HASH_SIZE		(32)
 
+/* max number of unused vnodes kept in vnode cache */
+#define VFS_VNODE_CACHE_SIZE		(32)
+
+/* number of negative lookup entries */
+#define VFS_NEGDENT_COUNT		(32)
+
+/** negative lookup entry (path known to be absent) */
+struct vfs_negdent {
+	struct dlist head;
+	struct mount *m;
+	char path[VFS_MAX_PATH];
+};
+
 struct vfs_ctrl {
 	struct vmm_mutex fs_list_lock;
 	struct dlist fs_list;
@@ -56,9 +76,16 @@ struct vfs_ctrl {
 	struct dlist mnt_list;
 	struct vmm_mutex vnode_list_lock[VFS_VNODE_HASH_SIZE];
 	struct list_head vnode_list[VFS_VNODE_HASH_SIZE];
-	struct vmm_mutex fd_bmap_lock;
+	struct vmm_mutex vnode_cache_lock;
+	struct dlist vnode_cache;
+	u32 vnode_cache_count;
+	struct vmm_mutex negdent_lock;
+	struct dlist negdent_list;
+	u32 negdent_gen;
+	struct vfs_negdent negdent[VFS_NEGDENT_COUNT];
+	struct vmm_mutex fd_table_lock;
 	unsigned long *fd_bmap;
-	struct file fd[VFS_MAX_FD];
+	struct vfs_fdtable *fdt;
 	struct vmm_notifier_block bdev_client;
 };
 
@@ -70,8 +97,10 @@ static int count_match(const char *path, char *mount_root)
 	int len = 0;
 
 	while (*path && *mount_root) {
-		if ((*path++) != (*mount_root++))
+		if (*path != *mount_root)
 			break;
+		path++;
+		mount_root++;
 		len++;
 	}
 
@@ -127,46 +156,206 @@ static int vfs_findroot(const char *path, struct mount **mp, char **root)
 	return VMM_OK;
 }
 
+static struct vfs_fdtable *vfs_fdtable_alloc(u32 count)
+{
+	struct vfs_fdtable *t;
+
+	t = vmm_zalloc(sizeof(*t) + count * sizeof(t->fd[0]));
+	if (t) {
+		t->count = count;
+	}
+
+	return t;
+}
+
+/** Double the size of file table.
+ *  Note: Must be called with file table locked.
+ *  Note: Lock-less readers may still use the old table so it is
+ *  freed only after an RCU grace period.
+ */
+static int vfs_fd_grow(void)
+{
+	struct vfs_fdtable *old = vfsc.fdt, *t;
+	unsigned long *bmap;
+
+	bmap = vmm_zalloc(bitmap_estimate_size(old->count * 2));
+	if (!bmap) {
+		return VMM_ENOMEM;
+	}
+
+	t = vfs_fdtable_alloc(old->count * 2);
+	if (!t) {
+		vmm_free(bmap);
+		return VMM_ENOMEM;
+	}
+
+	/* File pointers remain same so only copy the table */
+	bitmap_copy(bmap, vfsc.fd_bmap, old->count);
+	memcpy(t->fd, old->fd, old->count * sizeof(t->fd[0]));
+
+	vmm_free(vfsc.fd_bmap);
+	vfsc.fd_bmap = bmap;
+	vmm_rcu_assign_pointer(vfsc.fdt, t);
+
+	vmm_rcu_synchronize();
+	vmm_free(old);
+
+	return VMM_OK;
+}
+
 static int vfs_fd_alloc(void)
 {
-	int i, ret = -1;
+	int ret = -1;
+	u32 i;
+	struct file *f;
 
-	vmm_mutex_lock(&vfsc.fd_bmap_lock);
+	vmm_mutex_lock(&vfsc.fd_table_lock);
 
-	for (i = 0; i < VFS_MAX_FD; i++) {
-		if (!bitmap_isset(vfsc.fd_bmap, i)) {
-			bitmap_setbit(vfsc.fd_bmap, i);
-			ret = i;
-			break;
+	i = find_first_zero_bit(vfsc.fd_bmap, vfsc.fdt->count);
+	if ((i >= vfsc.fdt->count) && vfs_fd_grow()) {
+		goto done;
+	}
+
+	/* Files are allocated on first use and never freed
+	 * hence lock-less readers can keep using file pointers.
+	 */
+	if (!vfsc.fdt->fd[i]) {
+		f = vmm_zalloc(sizeof(struct file));
+		if (!f) {
+			goto done;
 		}
+		INIT_MUTEX(&f->f_lock);
+		arch_smp_wmb();
+		vfsc.fdt->fd[i] = f;
 	}
 
-	vmm_mutex_unlock(&vfsc.fd_bmap_lock);
+	bitmap_setbit(vfsc.fd_bmap, i);
+	ret = i;
+
+done:
+	vmm_mutex_unlock(&vfsc.fd_table_lock);
 
 	return ret;
 }
 
 static void vfs_fd_free(int fd)
 {
-	if (-1 < fd && fd < VFS_MAX_FD) {
-		vmm_mutex_lock(&vfsc.fd_bmap_lock);
-
-		if (bitmap_isset(vfsc.fd_bmap, fd)) {
-			vmm_mutex_lock(&vfsc.fd[fd].f_lock);
-			vfsc.fd[fd].f_flags = 0;
-			vfsc.fd[fd].f_offset = 0;
-			vfsc.fd[fd].f_vnode = NULL;
-			vmm_mutex_unlock(&vfsc.fd[fd].f_lock);
-			bitmap_clearbit(vfsc.fd_bmap, fd);
-		}
+	struct file *f;
 
-		vmm_mutex_unlock(&vfsc.fd_bmap_lock);
+	if (fd < 0) {
+		return;
 	}
+
+	vmm_mutex_lock(&vfsc.fd_table_lock);
+
+	if ((fd < vfsc.fdt->count) && bitmap_isset(vfsc.fd_bmap, fd)) {
+		f = vfsc.fdt->fd[fd];
+		vmm_mutex_lock(&f->f_lock);
+		f->f_flags = 0;
+		f->f_offset = 0;
+		f->f_vnode = NULL;
+		vmm_mutex_unlock(&f->f_lock);
+		bitmap_clearbit(vfsc.fd_bmap, fd);
+	}
+
+	vmm_mutex_unlock(&vfsc.fd_table_lock);
 }
 
+/** Map file descriptor to file without taking file table lock
+ *  Note: Caller has to check f_vnode with f_lock held because
+ *  the file descriptor can be closed concurrently.
+ */
 static struct file *vfs_fd_to_file(int fd)
 {
-	return (-1 < fd && fd < VFS_MAX_FD) ? &vfsc.fd[fd] : NULL;
+	struct file *f = NULL;
+	struct vfs_fdtable *t;
+
+	if (fd < 0) {
+		return NULL;
+	}
+
+	vmm_rcu_read_lock();
+	t = vmm_rcu_dereference(vfsc.fdt);
+	if (fd < t->count) {
+		f = vmm_rcu_dereference(t->fd[fd]);
+	}
+	vmm_rcu_read_unlock();
+
+	return f;
+}
+
+/** Check whether given path is a known absent path of mount point */
+static bool vfs_negdent_find(struct mount *m, const char *path)
+{
+	bool found = FALSE;
+	struct vfs_negdent *n;
+
+	vmm_mutex_lock(&vfsc.negdent_lock);
+
+	list_for_each_entry(n, &vfsc.negdent_list, head) {
+		if ((n->m == m) && !strncmp(n->path, path, VFS_MAX_PATH)) {
+			list_move_tail(&n->head, &vfsc.negdent_list);
+			found = TRUE;
+			break;
+		}
+	}
+
+	vmm_mutex_unlock(&vfsc.negdent_lock);
+
+	return found;
+}
+
+/** Remember an absent path of mount point by recycling the least
+ *  recently used entry. Nothing is remembered if negative entries
+ *  were invalidated after the failed lookup started (i.e. gen changed).
+ */
+static void vfs_negdent_add(struct mount *m, const char *path, u32 gen)
+{
+	struct vfs_negdent *n;
+
+	vmm_mutex_lock(&vfsc.negdent_lock);
+
+	if (gen == vfsc.negdent_gen) {
+		n = list_first_entry(&vfsc.negdent_list,
+				     struct vfs_negdent, head);
+		n->m = m;
+		strlcpy(n->path, path, sizeof(n->path));
+		list_move_tail(&n->head, &vfsc.negdent_list);
+	}
+
+	vmm_mutex_unlock(&vfsc.negdent_lock);
+}
+
+static u32 vfs_negdent_gen(void)
+{
+	u32 gen;
+
+	vmm_mutex_lock(&vfsc.negdent_lock);
+	gen = vfsc.negdent_gen;
+	vmm_mutex_unlock(&vfsc.negdent_lock);
+
+	return gen;
+}
+
+/** Forget all absent paths of mount point
+ *  Note: Must be called whenever new names appear under mount point.
+ */
+static void vfs_negdent_invalidate(struct mount *m)
+{
+	struct vfs_negdent *n, *nn;
+
+	vmm_mutex_lock(&vfsc.negdent_lock);
+
+	vfsc.negdent_gen++;
+	list_for_each_entry_safe(n, nn, &vfsc.negdent_list, head) {
+		if (n->m == m) {
+			n->m = NULL;
+			n->path[0] = '\0';
+			list_move(&n->head, &vfsc.negdent_list);
+		}
+	}
+
+	vmm_mutex_unlock(&vfsc.negdent_lock);
 }
 
 /** Compute hash value from mount point and path name. */
@@ -183,6 +372,10 @@ static u32 vfs_vnode_hash(struct mount *m, const char *path)
 	return (val ^ (u32)(unsigned long)m) & (VFS_VNODE_HASH_SIZE - 1);
 }
 
+/** Allocate new vnode and add it to hash list
+ *  Note: New vnode is returned locked so that concurrent lookups
+ *  of same path wait till filesystem lookup() is done.
+ */
 static struct vnode *vfs_vnode_vget(struct mount *m, const char *path)
 {
 	int err;
@@ -197,6 +390,7 @@ static struct vnode *vfs_vnode_vget(struct mount *m, const char *path)
 	}
 
 	INIT_LIST_HEAD(&v->v_link);
+	INIT_LIST_HEAD(&v->v_lru);
 	INIT_MUTEX(&v->v_lock);
 	v->v_mount = m;
 	arch_atomic_write(&v->v_refcnt, 1);
@@ -217,6 +411,8 @@ static struct vnode *vfs_vnode_vget(struct mount *m, const char *path)
 
 	arch_atomic_add(&m->m_refcnt, 1);
 
+	vmm_mutex_lock(&v->v_lock);
+
 	vmm_mutex_lock(&vfsc.vnode_list_lock[hash]);
 	list_add(&v->v_link, &vfsc.vnode_list[hash]);
 	vmm_mutex_unlock(&vfsc.vnode_list_lock[hash]);
@@ -242,44 +438,160 @@ static struct vnode *vfs_vnode_lookup(struct mount *m, const char *path)
 		}
 	}
 
+	if (found) {
+		/* unused vnode is revived from vnode cache */
+		if (!arch_atomic_read(&v->v_refcnt)) {
+			vmm_mutex_lock(&vfsc.vnode_cache_lock);
+			list_del_init(&v->v_lru);
+			vfsc.vnode_cache_count--;
+			vmm_mutex_unlock(&vfsc.vnode_cache_lock);
+		}
+		arch_atomic_add(&v->v_refcnt, 1);
+	}
+
 	vmm_mutex_unlock(&vfsc.vnode_list_lock[hash]);
 
+	return (found) ? v : NULL;
+}
+
+static void vfs_vnode_vref(struct vnode *v)
+{
+	arch_atomic_add(&v->v_refcnt, 1);
+}
+
+/** Free vnode which is already removed from hash list */
+static void vfs_vnode_free(struct vnode *v)
+{
+	struct mount *m = v->v_mount;
+
+	/* deallocate fs specific data from this vnode */
+	vmm_mutex_lock(&m->m_lock);
+	m->m_fs->vput(m, v);
+	vmm_mutex_unlock(&m->m_lock);
+
+	arch_atomic_sub(&m->m_refcnt, 1);
+
+	vmm_free(v);
+}
+
+/** Free least recently used vnode of given mount point (or any mount
+ *  point if m == NULL) from vnode cache if vnode cache has more than
+ *  limit vnodes. Returns FALSE if there is nothing to free.
+ *
+ *  Unused vnodes enter vnode cache after their children so children
+ *  are always freed before their parent.
+ */
+static bool vfs_vnode_cache_evict(struct mount *m, u32 limit)
+{
+	u32 hash;
+	bool found;
+	struct vnode *v, *tv;
+
+	vmm_mutex_lock(&vfsc.vnode_cache_lock);
+
+	found = FALSE;
+	if (vfsc.vnode_cache_count > limit) {
+		list_for_each_entry(v, &vfsc.vnode_cache, v_lru) {
+			if (!m || (v->v_mount == m)) {
+				found = TRUE;
+				break;
+			}
+		}
+	}
 	if (!found) {
-		return NULL;
+		vmm_mutex_unlock(&vfsc.vnode_cache_lock);
+		return FALSE;
 	}
+	hash = vfs_vnode_hash(v->v_mount, v->v_path);
 
-	arch_atomic_add(&v->v_refcnt, 1);
+	vmm_mutex_unlock(&vfsc.vnode_cache_lock);
 
-	return v;
+	/* hash list lock is taken before vnode cache lock so
+	 * check whether vnode is still in vnode cache after
+	 * taking both locks.
+	 */
+	vmm_mutex_lock(&vfsc.vnode_list_lock[hash]);
+	vmm_mutex_lock(&vfsc.vnode_cache_lock);
+
+	found = FALSE;
+	list_for_each_entry(tv, &vfsc.vnode_cache, v_lru) {
+		if ((tv == v) &&
+		    (vfs_vnode_hash(v->v_mount, v->v_path) == hash)) {
+			found = TRUE;
+			break;
+		}
+	}
+	if (found) {
+		list_del_init(&v->v_lru);
+		vfsc.vnode_cache_count--;
+		list_del(&v->v_link);
+	}
+
+	vmm_mutex_unlock(&vfsc.vnode_cache_lock);
+
+	if (found) {
+		vfs_vnode_free(v);
+	}
+
+	vmm_mutex_unlock(&vfsc.vnode_list_lock[hash]);
+
+	return TRUE;
 }
 
-static void vfs_vnode_vref(struct vnode *v)
+/** Free all unused vnodes of a mount point from vnode cache */
+static void vfs_vnode_cache_purge(struct mount *m)
 {
-	arch_atomic_add(&v->v_refcnt, 1);
+	while (vfs_vnode_cache_evict(m, 0)) ;
 }
 
 static void vfs_vnode_vput(struct vnode *v)
 {
 	u32 hash;
+	bool cached = FALSE;
+
+	hash = vfs_vnode_hash(v->v_mount, v->v_path);
+
+	/* reference count drops to zero with hash list locked
+	 * so that vfs_vnode_lookup() can safely revive it.
+	 */
+	vmm_mutex_lock(&vfsc.vnode_list_lock[hash]);
 
 	if (arch_atomic_sub_return(&v->v_refcnt, 1)) {
+		vmm_mutex_unlock(&vfsc.vnode_list_lock[hash]);
 		return;
 	}
 
-	hash = vfs_vnode_hash(v->v_mount, v->v_path);
+	if (v->v_flags == VNONE) {
+		/* keep unused vnode in vnode cache */
+		vmm_mutex_lock(&vfsc.vnode_cache_lock);
+		list_add_tail(&v->v_lru, &vfsc.vnode_cache);
+		vfsc.vnode_cache_count++;
+		vmm_mutex_unlock(&vfsc.vnode_cache_lock);
+		cached = TRUE;
+	} else {
+		/* stale vnode may already be removed from hash list */
+		list_del_init(&v->v_link);
+		vfs_vnode_free(v);
+	}
 
-	vmm_mutex_lock(&vfsc.vnode_list_lock[hash]);
-	list_del(&v->v_link);
 	vmm_mutex_unlock(&vfsc.vnode_list_lock[hash]);
 
-	/* deallocate fs specific data from this vnode */
-	vmm_mutex_lock(&v->v_mount->m_lock);
-	v->v_mount->m_fs->vput(v->v_mount, v);
-	vmm_mutex_unlock(&v->v_mount->m_lock);
+	if (cached) {
+		vfs_vnode_cache_evict(NULL, VFS_VNODE_CACHE_SIZE);
+	}
+}
 
-	arch_atomic_sub(&v->v_mount->m_refcnt, 1);
+/** Remove vnode from hash list so that later lookups of its path
+ *  reach the filesystem again. The vnode itself lives on till its
+ *  last reference is dropped by vfs_vnode_vput().
+ */
+static void vfs_vnode_unhash(struct vnode *v)
+{
+	u32 hash = vfs_vnode_hash(v->v_mount, v->v_path);
 
-	vmm_free(v);
+	vmm_mutex_lock(&vfsc.vnode_list_lock[hash]);
+	list_del_init(&v->v_link);
+	vmm_mutex_unlock(&vfsc.vnode_list_lock[hash]);
 }
 
 /** Get stat from vnode pointer. */
@@ -421,6 +733,7 @@ static int vfs_vnode_acquire(const char *path, struct vnode **vp)
 	struct mount *m;
 	struct vnode *dv, *v;
 	int err, i, j;
+	u32 gen;
 
 	/* convert a full path name to its mount point and
 	 * the local node in the file system.
@@ -461,26 +774,54 @@ static int vfs_vnode_acquire(const char *path, struct vnode **vp)
 
 		/* get a vnode for the target. */
 		v = vfs_vnode_lookup(m, node);
-		if (v == NULL) {
+		if (v != NULL) {
+			/* wait for filesystem lookup() of new vnode */
+			vmm_mutex_lock(&v->v_lock);
+			vmm_mutex_unlock(&v->v_lock);
+			if (v->v_flags == VSTALE) {
+				/* not found */
+				vfs_vnode_release(v);
+				return VMM_ENOENT;
+			}
+		} else {
+			/* target already known to be absent */
+			if (vfs_negdent_find(m, node)) {
+				vfs_vnode_release(dv);
+				return VMM_ENOENT;
+			}
+
+			gen = vfs_negdent_gen();
+
 			v = vfs_vnode_vget(m, node);
 			if (v == NULL) {
-				vfs_vnode_vput(dv);
+				vfs_vnode_release(dv);
 				return VMM_ENOMEM;
 			}
 
 			/* find a vnode in this directory. */
-			vmm_mutex_lock(&v->v_lock);
 			vmm_mutex_lock(&dv->v_lock);
 			err = dv->v_mount->m_fs->lookup(dv, &node[j], v);
 			vmm_mutex_unlock(&dv->v_lock);
+			if (err) {
+				v->v_flags = VSTALE;
+			}
 			vmm_mutex_unlock(&v->v_lock);
-			if (err || (*p == '/' && v->v_type != VDIR)) {
+			if (err) {
 				/* not found */
+				if (err == VMM_ENOENT) {
+					vfs_negdent_add(m, node, gen);
+				}
 				vfs_vnode_release(v);
 				return err;
 			}
 		}
 
+		if (*p == '/' && v->v_type != VDIR) {
+			/* not a directory */
+			vfs_vnode_release(v);
+			return VMM_ENOENT;
+		}
+
 		dv = v;
 	}
 
@@ -499,7 +840,9 @@ static int vfs_vnode_acquire(const char *path, struct vnode **vp)
 static void vfs_force_unmount(struct mount *m)
 {
 	int i;
-	bool found;
+	u32 hash;
+	bool found, unhashed;
+	struct file *f;
 	struct vnode *v;
 	struct mount *tm;
 
@@ -528,19 +871,36 @@ static void vfs_force_unmount(struct mount *m)
 	list_del(&m->m_link);
 
 	/* Flush all file descriptors using vnode from this mount point */
-	vmm_mutex_lock(&vfsc.fd_bmap_lock);
-	for (i = 0; i < VFS_MAX_FD; i++) {
+	vmm_mutex_lock(&vfsc.fd_table_lock);
+	for (i = 0; i < vfsc.fdt->count; i++) {
+		f = vfsc.fdt->fd[i];
 		if (bitmap_isset(vfsc.fd_bmap, i) &&
-		    (vfsc.fd[i].f_vnode->v_mount == m)) {
-			vmm_mutex_lock(&vfsc.fd[i].f_lock);
-			vfsc.fd[i].f_flags = 0;
-			vfsc.fd[i].f_offset = 0;
-			vfsc.fd[i].f_vnode = NULL;
-			vmm_mutex_unlock(&vfsc.fd[i].f_lock);
+		    f->f_vnode && (f->f_vnode->v_mount == m)) {
+			vmm_mutex_lock(&f->f_lock);
+			v = f->f_vnode;
+			f->f_flags = 0;
+			f->f_offset = 0;
+			f->f_vnode = NULL;
+			vmm_mutex_unlock(&f->f_lock);
 			bitmap_clear(vfsc.fd_bmap, i, 1);
+
+			/* Vnodes removed from hash list are not flushed
+			 * below so drop reference of file descriptor.
+			 */
+			hash = vfs_vnode_hash(v->v_mount, v->v_path);
+			vmm_mutex_lock(&vfsc.vnode_list_lock[hash]);
+			unhashed = list_empty(&v->v_link);
+			vmm_mutex_unlock(&vfsc.vnode_list_lock[hash]);
+			if (unhashed &&
+			    !arch_atomic_sub_return(&v->v_refcnt, 1)) {
+				vfs_vnode_free(v);
+			}
 		}
 	}
-	vmm_mutex_unlock(&vfsc.fd_bmap_lock);
+	vmm_mutex_unlock(&vfsc.fd_table_lock);
+
+	/* Flush all absent paths of this mount point */
+	vfs_negdent_invalidate(m);
 
 	/* Flush all vnodes from this mount point */
 	for (i = 0; i < VFS_VNODE_HASH_SIZE; i++) {
@@ -558,8 +918,14 @@ static void vfs_force_unmount(struct mount *m)
 				break;
 			}
 
-			/* Remove vnode from hash list */
+			/* Remove vnode from hash list and vnode cache */
 			list_del(&v->v_link);
+			vmm_mutex_lock(&vfsc.vnode_cache_lock);
+			if (!list_empty(&v->v_lru)) {
+				list_del_init(&v->v_lru);
+				vfsc.vnode_cache_count--;
+			}
+			vmm_mutex_unlock(&vfsc.vnode_cache_lock);
 
 			/* Deallocate fs specific data from this vnode */
 			vmm_mutex_lock(&v->v_mount->m_lock);
@@ -709,6 +1075,7 @@ int vfs_mount(const char *dir, const char *fsname, const char *dev, u32 flags)
 	v->v_flags = VROOT;
 	v->v_mode = S_IFDIR | S_IRWXU | S_IRWXG | S_IRWXO;
 	m->m_root = v;
+	vmm_mutex_unlock(&v->v_lock);
 
 	/* call a file system specific routine. */
 	vmm_mutex_lock(&m->m_lock);
@@ -778,6 +1145,9 @@ int vfs_unmount(const char *path)
 		return VMM_EINVALID;
 	}
 
+	/* unused vnodes in vnode cache don't make it busy */
+	vfs_vnode_cache_purge(m);
+
 	/* mount point reference count should be 1 
 	 * otherwise it is busy.
 	 */
@@ -791,6 +1161,9 @@ int vfs_unmount(const char *path)
 
 	vmm_mutex_unlock(&vfsc.mnt_list_lock);
 
+	/* forget absent paths of this mount point */
+	vfs_negdent_invalidate(m);
+
 	/* call filesytem msync & filesystem unmount */
 	vmm_mutex_lock(&m->m_lock);
 	err = m->m_fs->msync(m);
@@ -945,6 +1318,7 @@ int vfs_open(const char *path, u32 flags, u32 mode)
 			vmm_mutex_lock(&dv->v_lock);
 			err = dv->v_mount->m_fs->create(dv, filename, mode);
 			vmm_mutex_unlock(&dv->v_lock);
+			vfs_negdent_invalidate(dv->v_mount);
 			vfs_vnode_release(dv);
 			if (err) {
 				return err;
@@ -1145,6 +1519,108 @@ size_t vfs_write(int fd, void *buf, size_t len)
 }
 VMM_EXPORT_SYMBOL(vfs_write);
 
+/** Lock file and get its regular file vnode if file
+ *  was opened with given access mode.
+ */
+static struct vnode *vfs_file_lock_vnode(struct file *f, u32 access)
+{
+	struct vnode *v;
+
+	vmm_mutex_lock(&f->f_lock);
+
+	v = f->f_vnode;
+	if (!v || (v->v_type != VREG) || !(f->f_flags & access)) {
+		vmm_mutex_unlock(&f->f_lock);
+		return NULL;
+	}
+
+	return v;
+}
+
+size_t vfs_pread(int fd, void *buf, size_t len, loff_t off)
+{
+	struct vfs_iovec iov = { .iov_base = buf, .iov_len = len };
+
+	return vfs_readv(fd, &iov, 1, off);
+}
+VMM_EXPORT_SYMBOL(vfs_pread);
+
+size_t vfs_pwrite(int fd, void *buf, size_t len, loff_t off)
+{
+	size_t ret;
+	struct vnode *v;
+	struct file *f;
+
+	BUG_ON(!vmm_scheduler_orphan_context());
+
+	if (!buf || !len || (off < 0)) {
+		return 0;
+	}
+
+	f = vfs_fd_to_file(fd);
+	if (!f) {
+		return 0;
+	}
+
+	v = vfs_file_lock_vnode(f, O_WRONLY);
+	if (!v) {
+		return 0;
+	}
+
+	vmm_mutex_lock(&v->v_lock);
+	ret = v->v_mount->m_fs->write(v, off, buf, len);
+	vmm_mutex_unlock(&v->v_lock);
+
+	vmm_mutex_unlock(&f->f_lock);
+
+	return ret;
+}
+VMM_EXPORT_SYMBOL(vfs_pwrite);
+
+size_t vfs_readv(int fd, const struct vfs_iovec *iov, int iovcnt, loff_t off)
+{
+	int i;
+	size_t rd, ret = 0;
+	struct vnode *v;
+	struct file *f;
+
+	BUG_ON(!vmm_scheduler_orphan_context());
+
+	if (!iov || (iovcnt < 1) || (off < 0)) {
+		return 0;
+	}
+
+	f = vfs_fd_to_file(fd);
+	if (!f) {
+		return 0;
+	}
+
+	v = vfs_file_lock_vnode(f, O_RDONLY);
+	if (!v) {
+		return 0;
+	}
+
+	/* whole vector is read under one vnode lock */
+	vmm_mutex_lock(&v->v_lock);
+	for (i = 0; i < iovcnt; i++) {
+		if (!iov[i].iov_base || !iov[i].iov_len) {
+			continue;
+		}
+		rd = v->v_mount->m_fs->read(v, off + ret,
+					    iov[i].iov_base, iov[i].iov_len);
+		ret += rd;
+		if (rd < iov[i].iov_len) {
+			break;
+		}
+	}
+	vmm_mutex_unlock(&v->v_lock);
+
+	vmm_mutex_unlock(&f->f_lock);
+
+	return ret;
+}
+VMM_EXPORT_SYMBOL(vfs_readv);
+
 loff_t vfs_lseek(int fd, loff_t off, int whence)
 {
 	loff_t ret;
@@ -1512,6 +1988,8 @@ int vfs_mkdir(const char *path, u32 mode)
 fail:
 	vmm_mutex_unlock(&dv->v_lock);
 
+	vfs_negdent_invalidate(dv->v_mount);
+
 	vfs_vnode_release(dv);
 
 	return err;
@@ -1606,6 +2084,9 @@ fail:
 	vmm_mutex_unlock(&v->v_lock);
 	vmm_mutex_unlock(&dv->v_lock);
 
+	/* removed directory must not be cached */
+	v->v_flags = VSTALE;
+	vfs_vnode_unhash(v);
 	vfs_vnode_release(v);
 	vfs_vnode_release(dv);
 
@@ -1710,6 +2191,14 @@ fail4:
 
 	vmm_mutex_unlock(&v1->v_lock);
 
+	/* source and its cached children have stale paths */
+	if (v1->v_flags != VROOT) {
+		v1->v_flags = VSTALE;
+		vfs_vnode_unhash(v1);
+	}
+	vfs_vnode_cache_purge(sv->v_mount);
+	vfs_negdent_invalidate(sv->v_mount);
+
 fail3:
 	vfs_vnode_release(dv);
 fail2:
@@ -1785,6 +2274,9 @@ fail2:
 fail1:
 	vmm_mutex_unlock(&v->v_lock);
 
+	/* removed file must not be cached nor found by path */
+	v->v_flags = VSTALE;
+	vfs_vnode_unhash(v);
 	vfs_vnode_release(dv);
 	vfs_vnode_release(v);
 
@@ -2053,15 +2545,27 @@ static int __init vfs_init(void)
 		INIT_LIST_HEAD(&vfsc.vnode_list[i]);
 	};
 
-	INIT_MUTEX(&vfsc.fd_bmap_lock);
+	INIT_MUTEX(&vfsc.vnode_cache_lock);
+	INIT_LIST_HEAD(&vfsc.vnode_cache);
+	vfsc.vnode_cache_count = 0;
+
+	INIT_MUTEX(&vfsc.negdent_lock);
+	INIT_LIST_HEAD(&vfsc.negdent_list);
+	for (i = 0; i < VFS_NEGDENT_COUNT; i++) {
+		INIT_LIST_HEAD(&vfsc.negdent[i].head);
+		list_add_tail(&vfsc.negdent[i].head, &vfsc.negdent_list);
+	}
+
+	INIT_MUTEX(&vfsc.fd_table_lock);
 	vfsc.fd_bmap = vmm_zalloc(bitmap_estimate_size(VFS_MAX_FD));
 	if (!vfsc.fd_bmap) {
 		return VMM_ENOMEM;
 	}
 	bitmap_zero(vfsc.fd_bmap, VFS_MAX_FD);
-	memset(&vfsc.fd, 0, sizeof(vfsc.fd));
-	for (i = 0; i < VFS_MAX_FD; i++) {
-		INIT_MUTEX(&vfsc.fd[i].f_lock);
+	vfsc.fdt = vfs_fdtable_alloc(VFS_MAX_FD);
+	if (!vfsc.fdt) {
+		vmm_free(vfsc.fd_bmap);
+		return VMM_ENOMEM;
 	}
 
 	vfsc.bdev_client.notifier_call = &vfs_blockdev_notification;
@@ -2073,7 +2577,16 @@ static int __init vfs_init(void)
 
 static void __exit vfs_exit(void)
 {
+	u32 i;
+
 	vmm_blockdev_unregister_client(&vfsc.bdev_client);
+
+	for (i = 0; i < vfsc.fdt->count; i++) {
+		if (vfsc.fdt->fd[i]) {
+			vmm_free(vfsc.fdt->fd[i]);
+		}
+	}
+	vmm_free(vfsc.fdt);
 	vmm_free(vfsc.fd_bmap);
 }
 
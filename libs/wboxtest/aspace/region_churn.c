@@ -0,0 +1,358 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file region_churn.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief region_churn test implementation
+ *
+ * This test creates a scratch guest from first guest node under /guests
+ * and one reader thread pinned on each online host CPU. The readers
+ * keep looking up guest regions using vmm_guest_find_region() and read
+ * guest memory using vmm_guest_memory_read() while the test thread keeps
+ * adding and deleting RAM regions using vmm_guest_add_region() and
+ * vmm_guest_del_region(). Readers check that every region they find
+ * is one of the churned regions covering the looked up address.
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_rcu.h>
+#include <vmm_completion.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_devtree.h>
+#include <vmm_manager.h>
+#include <vmm_host_aspace.h>
+#include <vmm_guest_aspace.h>
+#include <vmm_modules.h>
+#include <libs/stringlib.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"region_churn test"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define	MODULE_INIT			region_churn_init
+#define	MODULE_EXIT			region_churn_exit
+
+#define CHURN_GUEST_NAME		"wbt_aspace"
+
+/* Number of region slots and size of each region */
+#define NUM_SLOTS			4
+#define SLOT_SIZE			0x10000
+
+/* Number of region add/del operations */
+#define NUM_UPDATES			256
+
+/* Candidate guest physical addresses for region slots */
+#define HOLE_STEP			0x10000000
+#define HOLE_LAST			0xE0000000
+
+/* Global data */
+static struct vmm_thread *workers[CONFIG_CPU_COUNT];
+static struct vmm_completion work_done[CONFIG_CPU_COUNT];
+static u64 read_count[CONFIG_CPU_COUNT];
+static u64 found_count[CONFIG_CPU_COUNT];
+static u32 error_count[CONFIG_CPU_COUNT];
+static volatile bool stop_readers;
+static struct vmm_guest *churn_guest;
+static physical_addr_t churn_base;
+
+static int region_churn_reader_thread_main(void *data)
+{
+	u32 val, slot = 0, thread_id = (u32)(unsigned long)data;
+	physical_addr_t gphys;
+	struct vmm_region *reg;
+
+	while (!stop_readers) {
+		gphys = churn_base + slot * SLOT_SIZE + (SLOT_SIZE / 2);
+
+		vmm_rcu_read_lock();
+
+		reg = vmm_guest_find_region(churn_guest, gphys,
+					    VMM_REGION_MEMORY, FALSE);
+		if (reg) {
+			if ((VMM_REGION_GPHYS_START(reg) !=
+					(churn_base + slot * SLOT_SIZE)) ||
+			    (reg->phys_size != SLOT_SIZE) ||
+			    !(reg->flags & VMM_REGION_ISDYNAMIC)) {
+				error_count[thread_id]++;
+			}
+			found_count[thread_id]++;
+		}
+
+		vmm_rcu_read_unlock();
+
+		/* Goes through region lookup on its own */
+		vmm_guest_memory_read(churn_guest, gphys,
+				      &val, sizeof(val), TRUE);
+
+		read_count[thread_id]++;
+		slot = (slot + 1) % NUM_SLOTS;
+	}
+
+	vmm_completion_complete(&work_done[thread_id]);
+
+	return 0;
+}
+
+static void region_churn_destroy_workers(int nworkers)
+{
+	int w;
+
+	for (w = 0; w < nworkers; w++) {
+		if (workers[w]) {
+			vmm_threads_destroy(workers[w]);
+			workers[w] = NULL;
+		}
+	}
+}
+
+static int region_churn_create_workers(int nworkers)
+{
+	int w;
+	u32 cpu;
+	char wname[VMM_FIELD_NAME_SIZE];
+	u8 current_priority = vmm_scheduler_current_priority();
+
+	w = 0;
+	for_each_online_cpu(cpu) {
+		if (w >= nworkers) {
+			break;
+		}
+
+		vmm_snprintf(wname, VMM_FIELD_NAME_SIZE,
+			     "region_churn_worker%d", w);
+		workers[w] = vmm_threads_create(wname,
+					region_churn_reader_thread_main,
+					(void *)(unsigned long)w,
+					current_priority,
+					VMM_THREAD_DEF_TIME_SLICE);
+		if (workers[w] == NULL) {
+			region_churn_destroy_workers(w);
+			return VMM_EFAIL;
+		}
+		vmm_threads_set_affinity(workers[w], vmm_cpumask_of(cpu));
+		w++;
+	}
+
+	return VMM_OK;
+}
+
+/* Copy first guest node under /guests as scratch guest node */
+static struct vmm_devtree_node *region_churn_node(void)
+{
+	int rc;
+	struct vmm_devtree_node *pnode, *tnode, *node = NULL;
+
+	pnode = vmm_devtree_getnode(VMM_DEVTREE_PATH_SEPARATOR_STRING
+				    VMM_DEVTREE_GUESTINFO_NODE_NAME);
+	if (!pnode) {
+		return NULL;
+	}
+
+	tnode = vmm_devtree_next_child(pnode, NULL);
+	if (tnode) {
+		rc = vmm_devtree_copynode(pnode, CHURN_GUEST_NAME, tnode);
+		vmm_devtree_dref_node(tnode);
+		if (rc == VMM_OK) {
+			node = vmm_devtree_getchild(pnode, CHURN_GUEST_NAME);
+		}
+	}
+
+	vmm_devtree_dref_node(pnode);
+
+	return node;
+}
+
+/* Find guest physical range not used by any region of guest */
+static int region_churn_find_hole(struct vmm_guest *guest,
+				  physical_addr_t *base)
+{
+	physical_addr_t gphys, end;
+
+	for (*base = HOLE_STEP; *base <= HOLE_LAST; *base += HOLE_STEP) {
+		end = *base + NUM_SLOTS * SLOT_SIZE;
+		for (gphys = *base; gphys < end; gphys += VMM_PAGE_SIZE) {
+			if (vmm_guest_find_region(guest, gphys,
+						  VMM_REGION_MEMORY, FALSE)) {
+				break;
+			}
+		}
+		if (gphys == end) {
+			return VMM_OK;
+		}
+	}
+
+	return VMM_ENOTAVAIL;
+}
+
+static int region_churn_update(struct vmm_guest *guest, u32 slot,
+			       bool *present)
+{
+	int rc;
+	char name[VMM_FIELD_NAME_SIZE];
+	physical_addr_t gphys = churn_base + slot * SLOT_SIZE;
+	struct vmm_region *reg;
+
+	if (present[slot]) {
+		/* Only this thread adds or deletes regions */
+		reg = vmm_guest_find_region(guest, gphys,
+					    VMM_REGION_MEMORY, FALSE);
+		if (!reg) {
+			return VMM_ENOENT;
+		}
+		rc = vmm_guest_del_region(guest, reg, TRUE);
+	} else {
+		vmm_snprintf(name, sizeof(name), "wbt_churn%d", slot);
+		rc = vmm_guest_add_region(guest, guest->aspace.node, name,
+				VMM_DEVTREE_DEVICE_TYPE_VAL_ALLOCED_RAM,
+				VMM_DEVTREE_MANIFEST_TYPE_VAL_REAL,
+				VMM_DEVTREE_ADDRESS_TYPE_VAL_MEMORY,
+				NULL, 0, gphys, 0, SLOT_SIZE,
+				VMM_PAGE_SHIFT, 0, NULL);
+	}
+	if (!rc) {
+		present[slot] = !present[slot];
+	}
+
+	return rc;
+}
+
+static int region_churn_run(struct wboxtest *test, struct vmm_chardev *cdev,
+			    u32 test_hcpu)
+{
+	int w, rc, ret = VMM_OK, nworkers = vmm_num_online_cpus();
+	u32 i, updates, errors = 0;
+	u64 reads = 0, found = 0;
+	bool present[NUM_SLOTS];
+	struct vmm_devtree_node *node;
+
+	node = region_churn_node();
+	if (!node) {
+		vmm_cprintf(cdev, "region_churn: skipped (no guest node)\n");
+		return VMM_OK;
+	}
+
+	churn_guest = vmm_manager_guest_create(node);
+	if (!churn_guest) {
+		vmm_cprintf(cdev, "region_churn: skipped "
+			    "(cannot create guest)\n");
+		goto done_delnode;
+	}
+
+	ret = region_churn_find_hole(churn_guest, &churn_base);
+	if (ret) {
+		vmm_cprintf(cdev, "error: no free guest physical range\n");
+		goto done_destroy;
+	}
+
+	/* Initialise global data */
+	memset(workers, 0, sizeof(workers));
+	memset(read_count, 0, sizeof(read_count));
+	memset(found_count, 0, sizeof(found_count));
+	memset(error_count, 0, sizeof(error_count));
+	memset(present, 0, sizeof(present));
+	stop_readers = FALSE;
+
+	/* Start readers */
+	ret = region_churn_create_workers(nworkers);
+	if (ret) {
+		goto done_destroy;
+	}
+	for (w = 0; w < nworkers; w++) {
+		INIT_COMPLETION(&work_done[w]);
+		vmm_threads_start(workers[w]);
+	}
+
+	/* Keep adding and deleting regions while readers are running */
+	for (i = 0; i < NUM_UPDATES; i++) {
+		ret = region_churn_update(churn_guest,
+					  (i * 3) % NUM_SLOTS, present);
+		if (ret) {
+			vmm_cprintf(cdev, "error: update %d failed (%d)\n",
+				    i, ret);
+			break;
+		}
+	}
+	updates = i;
+
+	/* Stop readers */
+	stop_readers = TRUE;
+	for (w = 0; w < nworkers; w++) {
+		vmm_completion_wait(&work_done[w]);
+		reads += read_count[w];
+		found += found_count[w];
+		errors += error_count[w];
+	}
+	region_churn_destroy_workers(nworkers);
+
+	/* Delete remaining regions */
+	for (i = 0; i < NUM_SLOTS; i++) {
+		if (present[i]) {
+			rc = region_churn_update(churn_guest, i, present);
+			if (rc && !ret) {
+				ret = rc;
+			}
+		}
+	}
+
+	vmm_cprintf(cdev, "readers %d lookups %"PRIu64" found %"PRIu64" "
+		    "updates %d\n", nworkers, reads, found, updates);
+
+	if (errors) {
+		vmm_cprintf(cdev, "error: readers found %d wrong regions\n",
+			    errors);
+		ret = VMM_EFAIL;
+	}
+
+done_destroy:
+	if (vmm_manager_guest_destroy(churn_guest)) {
+		vmm_cprintf(cdev, "error: failed to destroy %s\n",
+			    CHURN_GUEST_NAME);
+		ret = VMM_EFAIL;
+	}
+	churn_guest = NULL;
+done_delnode:
+	vmm_devtree_delnode(node);
+	vmm_devtree_dref_node(node);
+
+	return ret;
+}
+
+static struct wboxtest region_churn = {
+	.name = "region_churn",
+	.run = region_churn_run,
+};
+
+static int __init region_churn_init(void)
+{
+	return wboxtest_register("aspace", &region_churn);
+}
+
+static void __exit region_churn_exit(void)
+{
+	wboxtest_unregister(&region_churn);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -0,0 +1,369 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file fbd_qcow2.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief fbd_qcow2 test implementation
+ *
+ * This test formats a RAM backed block device with an empty FAT16
+ * filesystem, mounts it read-write and creates an empty qcow2 image
+ * on it. The image is exposed as file backed block device and written
+ * such that writes allocate clusters partially (head, tail and across
+ * cluster boundary) as well as completely. The whole virtual disk is
+ * read back and verified where unwritten parts must read as zeros.
+ * The image is then closed, opened again and verified once more.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_host_aspace.h>
+#include <vmm_host_ram.h>
+#include <vmm_host_io.h>
+#include <vmm_stdio.h>
+#include <vmm_modules.h>
+#include <drv/rbd.h>
+#include <drv/fbd.h>
+#include <libs/stringlib.h>
+#include <libs/vfs.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"fbd_qcow2 test"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			fbd_qcow2_init
+#define MODULE_EXIT			fbd_qcow2_exit
+
+/* Geometry of generated FAT16 filesystem (8MB with 1KB clusters) */
+#define FAT_SECTOR_SIZE			512
+#define FAT_TOTAL_SECTORS		16384
+#define FAT_SECTORS_PER_CLUSTER		2
+#define FAT_RESERVED_SECTORS		1
+#define FAT_NUM_FATS			2
+#define FAT_ROOT_ENTRIES		512
+#define FAT_SECTORS_PER_FAT		32
+
+/* Virtual size of qcow2 image */
+#define DISK_SIZE			(4 * 1024 * 1024)
+
+/* Default qcow2 cluster size */
+#define CLUSTER_SIZE			(64 * 1024)
+
+/* Size of read-back buffer */
+#define CHUNK_SIZE			CLUSTER_SIZE
+
+/* Base mount path used when root filesystem is already mounted */
+#define BASE_DIR			"/wbt_fbd"
+
+struct fbd_qcow2_range {
+	u32 off;
+	u32 len;
+	u32 seed;
+};
+
+/* Written ranges (must not overlap) */
+static const struct fbd_qcow2_range ranges[] = {
+	/* Head of first cluster */
+	{ .off = 0, .len = 4096, .seed = 1 },
+	/* Middle of another cluster */
+	{ .off = 3 * CLUSTER_SIZE + 8192, .len = 512, .seed = 2 },
+	/* Across cluster boundary */
+	{ .off = 6 * CLUSTER_SIZE - 1024, .len = 2048, .seed = 3 },
+	/* Complete cluster */
+	{ .off = 9 * CLUSTER_SIZE, .len = CLUSTER_SIZE, .seed = 4 },
+	/* Tail of last cluster */
+	{ .off = DISK_SIZE - 1536, .len = 1536, .seed = 5 },
+};
+
+static u8 *buf;
+static char base[VFS_MAX_PATH];
+
+static u8 fbd_qcow2_byte(u32 seed, u32 pos)
+{
+	return (u8)(pos * 13 + seed * 101 + (pos >> 9) + 1);
+}
+
+static u8 fbd_qcow2_expected(u32 pos)
+{
+	u32 i;
+
+	for (i = 0; i < array_size(ranges); i++) {
+		if ((ranges[i].off <= pos) &&
+		    (pos < (ranges[i].off + ranges[i].len))) {
+			return fbd_qcow2_byte(ranges[i].seed, pos);
+		}
+	}
+
+	return 0;
+}
+
+static void fbd_qcow2_put16(u8 *p, u16 val)
+{
+	val = vmm_cpu_to_le16(val);
+	memcpy(p, &val, sizeof(val));
+}
+
+/* Generate boot sector and empty FAT tables of FAT16 filesystem */
+static struct rbd *fbd_qcow2_fat_create(const char *name)
+{
+	u32 i;
+	u8 *sec;
+	struct rbd *d;
+	physical_addr_t pa;
+	physical_size_t sz = FAT_TOTAL_SECTORS * FAT_SECTOR_SIZE;
+
+	sec = vmm_zalloc(FAT_SECTOR_SIZE);
+	if (!sec) {
+		return NULL;
+	}
+
+	if (!vmm_host_ram_alloc(&pa, sz, VMM_PAGE_SHIFT)) {
+		vmm_free(sec);
+		return NULL;
+	}
+	vmm_host_memory_set(pa, 0, sz, TRUE);
+
+	sec[0] = 0xEB;
+	sec[1] = 0x3C;
+	sec[2] = 0x90;
+	memcpy(&sec[3], "XVISOR  ", 8);
+	fbd_qcow2_put16(&sec[11], FAT_SECTOR_SIZE);
+	sec[13] = FAT_SECTORS_PER_CLUSTER;
+	fbd_qcow2_put16(&sec[14], FAT_RESERVED_SECTORS);
+	sec[16] = FAT_NUM_FATS;
+	fbd_qcow2_put16(&sec[17], FAT_ROOT_ENTRIES);
+	fbd_qcow2_put16(&sec[19], FAT_TOTAL_SECTORS);
+	sec[21] = 0xF8;
+	fbd_qcow2_put16(&sec[22], FAT_SECTORS_PER_FAT);
+	fbd_qcow2_put16(&sec[24], 32);
+	fbd_qcow2_put16(&sec[26], 64);
+	sec[36] = 0x80;
+	sec[38] = 0x29;
+	memcpy(&sec[43], "WBT_FBD    ", 11);
+	memcpy(&sec[54], "FAT16   ", 8);
+	sec[510] = 0x55;
+	sec[511] = 0xAA;
+	vmm_host_memory_write(pa, sec, FAT_SECTOR_SIZE, TRUE);
+
+	/* First two FAT entries are reserved */
+	memset(sec, 0, FAT_SECTOR_SIZE);
+	sec[0] = 0xF8;
+	sec[1] = 0xFF;
+	sec[2] = 0xFF;
+	sec[3] = 0xFF;
+	for (i = 0; i < FAT_NUM_FATS; i++) {
+		vmm_host_memory_write(pa + (FAT_RESERVED_SECTORS +
+				      i * FAT_SECTORS_PER_FAT) * FAT_SECTOR_SIZE,
+				      sec, FAT_SECTOR_SIZE, TRUE);
+	}
+
+	vmm_free(sec);
+
+	/* RAM is already allocated so ignore overlap and
+	 * let rbd_destroy() free it.
+	 */
+	d = rbd_create(name, pa, sz, TRUE);
+	if (!d) {
+		vmm_host_ram_free(pa, sz);
+	}
+
+	return d;
+}
+
+static int fbd_qcow2_write(struct fbd *d)
+{
+	u32 i, j;
+
+	for (i = 0; i < array_size(ranges); i++) {
+		for (j = 0; j < ranges[i].len; j++) {
+			buf[j] = fbd_qcow2_byte(ranges[i].seed,
+						ranges[i].off + j);
+		}
+		if (vmm_blockdev_write(d->bdev, buf, ranges[i].off,
+				       ranges[i].len) != ranges[i].len) {
+			return VMM_EIO;
+		}
+	}
+
+	return VMM_OK;
+}
+
+static int fbd_qcow2_verify(struct vmm_chardev *cdev, struct fbd *d)
+{
+	u32 off, i;
+
+	if (d->size != DISK_SIZE) {
+		vmm_cprintf(cdev, "error: disk size 0x%"PRIx64"\n", d->size);
+		return VMM_EFAIL;
+	}
+
+	for (off = 0; off < DISK_SIZE; off += CHUNK_SIZE) {
+		if (vmm_blockdev_read(d->bdev, buf, off,
+				      CHUNK_SIZE) != CHUNK_SIZE) {
+			vmm_cprintf(cdev, "error: read at 0x%x failed\n", off);
+			return VMM_EIO;
+		}
+		for (i = 0; i < CHUNK_SIZE; i++) {
+			if (buf[i] != fbd_qcow2_expected(off + i)) {
+				vmm_cprintf(cdev, "error: mismatch at 0x%x\n",
+					    off + i);
+				return VMM_EFAIL;
+			}
+		}
+	}
+
+	return VMM_OK;
+}
+
+static bool fbd_qcow2_root_mounted(void)
+{
+	u32 i;
+	struct mount *m;
+
+	for (i = 0; i < vfs_mount_count(); i++) {
+		m = vfs_mount_get(i);
+		if (m && !strcmp(m->m_path, "/")) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static int fbd_qcow2_run(struct wboxtest *test, struct vmm_chardev *cdev,
+			 u32 test_hcpu)
+{
+	int rc, ret = VMM_OK;
+	bool base_created = FALSE;
+	char mpath[VFS_MAX_PATH], path[VFS_MAX_PATH];
+	struct rbd *r;
+	struct fbd *d;
+
+	buf = vmm_malloc(CHUNK_SIZE);
+	if (!buf) {
+		return VMM_ENOMEM;
+	}
+
+	/* Create RAM backed block device with empty FAT16 filesystem */
+	r = fbd_qcow2_fat_create("wbt_fbd_fat");
+	if (!r) {
+		vmm_cprintf(cdev, "error: failed to create RBD instance\n");
+		ret = VMM_ENOMEM;
+		goto done_free;
+	}
+
+	/* Mount it on root (or a new directory) */
+	if (fbd_qcow2_root_mounted()) {
+		strlcpy(base, BASE_DIR, sizeof(base));
+		base_created = (vfs_mkdir(base, S_IRWXU) == VMM_OK);
+		strlcpy(mpath, base, sizeof(mpath));
+	} else {
+		base[0] = '\0';
+		strlcpy(mpath, "/", sizeof(mpath));
+	}
+	rc = vfs_mount(mpath, "fat", "wbt_fbd_fat", MOUNT_RW);
+	if (rc) {
+		vmm_cprintf(cdev, "fbd_qcow2: skipped (cannot mount %s)\n",
+			    mpath);
+		goto done_rmdir;
+	}
+
+	/* Create qcow2 image and write to it */
+	vmm_snprintf(path, sizeof(path), "%s/disk.qcow2", base);
+	rc = fbd_qcow2_create(path, DISK_SIZE, NULL);
+	if (rc) {
+		vmm_cprintf(cdev, "error: failed to create %s (%d)\n",
+			    path, rc);
+		ret = rc;
+		goto done_unmount;
+	}
+
+	d = fbd_create("wbt_fbd0", path, 0, 0);
+	if (!d) {
+		vmm_cprintf(cdev, "error: failed to open %s\n", path);
+		ret = VMM_EFAIL;
+		goto done_unlink;
+	}
+	ret = fbd_qcow2_write(d);
+	if (ret) {
+		vmm_cprintf(cdev, "error: failed to write %s\n", path);
+	} else {
+		ret = fbd_qcow2_verify(cdev, d);
+	}
+	fbd_destroy(d);
+	if (ret) {
+		goto done_unlink;
+	}
+
+	/* Allocated clusters must be found after opening again */
+	d = fbd_create("wbt_fbd0", path, 0, 0);
+	if (!d) {
+		vmm_cprintf(cdev, "error: failed to reopen %s\n", path);
+		ret = VMM_EFAIL;
+		goto done_unlink;
+	}
+	ret = fbd_qcow2_verify(cdev, d);
+	fbd_destroy(d);
+
+done_unlink:
+	rc = vfs_unlink(path);
+	if (rc) {
+		vmm_cprintf(cdev, "error: failed to remove %s (%d)\n",
+			    path, rc);
+		ret = rc;
+	}
+done_unmount:
+	rc = vfs_unmount(mpath);
+	if (rc) {
+		vmm_cprintf(cdev, "error: failed to unmount %s (%d)\n",
+			    mpath, rc);
+		ret = rc;
+	}
+done_rmdir:
+	if (base_created) {
+		vfs_rmdir(base);
+	}
+	rbd_destroy(r);
+done_free:
+	vmm_free(buf);
+	buf = NULL;
+
+	return ret;
+}
+
+static struct wboxtest fbd_qcow2 = {
+	.name = "fbd_qcow2",
+	.run = fbd_qcow2_run,
+};
+
+static int __init fbd_qcow2_init(void)
+{
+	return wboxtest_register("block", &fbd_qcow2);
+}
+
+static void __exit fbd_qcow2_exit(void)
+{
+	wboxtest_unregister(&fbd_qcow2);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
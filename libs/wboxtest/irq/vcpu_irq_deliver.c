@@ -0,0 +1,229 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file vcpu_irq_deliver.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief vcpu_irq_deliver test implementation
+ *
+ * This test measures assert-to-deliver cost of guest interrupts for
+ * increasing interrupt counts. It creates a scratch guest from first
+ * guest node under /guests and keeps its first VCPU paused. Guest
+ * interrupts are asserted through the interrupt controller emulators
+ * of the scratch guest (which in-turn use vmm_vcpu_irq_assert()) and
+ * delivered to the paused VCPU using vmm_vcpu_irq_process() before
+ * being deasserted again.
+ */
+
+#include <vmm_error.h>
+#include <vmm_stdio.h>
+#include <vmm_smp.h>
+#include <vmm_cpumask.h>
+#include <vmm_timer.h>
+#include <vmm_devtree.h>
+#include <vmm_devemu.h>
+#include <vmm_manager.h>
+#include <vmm_scheduler.h>
+#include <vmm_vcpu_irq.h>
+#include <vmm_modules.h>
+#include <libs/mathlib.h>
+#include <libs/stringlib.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"vcpu_irq_deliver test"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define	MODULE_INIT			vcpu_irq_deliver_init
+#define	MODULE_EXIT			vcpu_irq_deliver_exit
+
+#define VIRQ_GUEST_NAME			"wbt_irq"
+#define VIRQ_MIN_NIRQ			32
+#define VIRQ_ROUNDS			100
+
+/* Copy first guest node under /guests as scratch guest node */
+static struct vmm_devtree_node *vcpu_irq_deliver_node(void)
+{
+	int rc;
+	struct vmm_devtree_node *pnode, *tnode, *node = NULL;
+
+	pnode = vmm_devtree_getnode(VMM_DEVTREE_PATH_SEPARATOR_STRING
+				    VMM_DEVTREE_GUESTINFO_NODE_NAME);
+	if (!pnode) {
+		return NULL;
+	}
+
+	tnode = vmm_devtree_next_child(pnode, NULL);
+	if (tnode) {
+		rc = vmm_devtree_copynode(pnode, VIRQ_GUEST_NAME, tnode);
+		vmm_devtree_dref_node(tnode);
+		if (rc == VMM_OK) {
+			node = vmm_devtree_getchild(pnode, VIRQ_GUEST_NAME);
+		}
+	}
+
+	vmm_devtree_dref_node(pnode);
+
+	return node;
+}
+
+/* Bring VCPU out of reset without letting it run */
+static int vcpu_irq_deliver_pause(struct vmm_vcpu *vcpu, u32 test_hcpu)
+{
+	int rc;
+
+	rc = vmm_manager_vcpu_set_affinity(vcpu, vmm_cpumask_of(test_hcpu));
+	if (rc) {
+		return rc;
+	}
+
+	/* VCPU can only run on test_hcpu where we don't allow
+	 * preemption until it is paused.
+	 */
+	vmm_scheduler_preempt_disable();
+	if (vmm_smp_processor_id() == test_hcpu) {
+		rc = vmm_manager_vcpu_kick(vcpu);
+		if (!rc) {
+			rc = vmm_manager_vcpu_pause(vcpu);
+		}
+	} else {
+		rc = VMM_EFAIL;
+	}
+	vmm_scheduler_preempt_enable();
+
+	if (!rc && (vmm_manager_vcpu_get_state(vcpu) !=
+					VMM_VCPU_STATE_PAUSED)) {
+		rc = VMM_EFAIL;
+	}
+
+	return rc;
+}
+
+static void vcpu_irq_deliver_measure(struct vmm_guest *guest,
+				     struct vmm_vcpu *vcpu, u32 num_irq,
+				     u64 *ns, u64 *delivered)
+{
+	u32 r, i;
+	u64 tstamp, count;
+
+	count = arch_atomic64_read(&vcpu->irqs.execute_count);
+	tstamp = vmm_timer_timestamp();
+	for (r = 0; r < VIRQ_ROUNDS; r++) {
+		for (i = 0; i < num_irq; i++) {
+			vmm_devemu_emulate_irq(guest, i, 1);
+		}
+		vmm_vcpu_irq_process(vcpu, &vcpu->regs);
+		for (i = 0; i < num_irq; i++) {
+			vmm_devemu_emulate_irq(guest, i, 0);
+		}
+	}
+	tstamp = vmm_timer_timestamp() - tstamp;
+
+	*ns = udiv64(tstamp, (u64)VIRQ_ROUNDS * num_irq);
+	*delivered = arch_atomic64_read(&vcpu->irqs.execute_count) - count;
+}
+
+static int vcpu_irq_deliver_run(struct wboxtest *test,
+				struct vmm_chardev *cdev,
+				u32 test_hcpu)
+{
+	int rc;
+	u32 num_irq, max_irq;
+	u64 ns, delivered;
+	struct vmm_devtree_node *node;
+	struct vmm_guest *guest;
+	struct vmm_vcpu *vcpu;
+
+	node = vcpu_irq_deliver_node();
+	if (!node) {
+		vmm_cprintf(cdev, "vcpu_irq_deliver: skipped "
+			    "(no guest node)\n");
+		return VMM_OK;
+	}
+
+	guest = vmm_manager_guest_create(node);
+	if (!guest) {
+		vmm_cprintf(cdev, "vcpu_irq_deliver: skipped "
+			    "(cannot create guest)\n");
+		rc = VMM_OK;
+		goto done_delnode;
+	}
+
+	vcpu = vmm_manager_guest_vcpu(guest, 0);
+	if (!vcpu) {
+		vmm_cprintf(cdev, "error: guest has no VCPU\n");
+		rc = VMM_EFAIL;
+		goto done_destroy;
+	}
+
+	rc = vcpu_irq_deliver_pause(vcpu, test_hcpu);
+	if (rc) {
+		vmm_cprintf(cdev, "error: failed to pause %s (%d)\n",
+			    vcpu->name, rc);
+		goto done_destroy;
+	}
+
+	max_irq = vmm_devemu_count_irqs(guest);
+	if (max_irq < VIRQ_MIN_NIRQ) {
+		vmm_cprintf(cdev, "vcpu_irq_deliver: skipped "
+			    "(%d guest IRQs)\n", max_irq);
+		goto done_destroy;
+	}
+
+	vmm_cprintf(cdev, "%-8s %-20s %s\n",
+		    "IRQs", "Assert-Deliver (ns)", "Delivered");
+	for (num_irq = VIRQ_MIN_NIRQ; num_irq <= max_irq; num_irq *= 2) {
+		vcpu_irq_deliver_measure(guest, vcpu, num_irq,
+					 &ns, &delivered);
+		vmm_cprintf(cdev, "%-8d %-20"PRIu64" %"PRIu64"\n",
+			    num_irq, ns, delivered);
+	}
+
+done_destroy:
+	if (vmm_manager_guest_destroy(guest)) {
+		vmm_cprintf(cdev, "error: failed to destroy %s\n",
+			    VIRQ_GUEST_NAME);
+		rc = VMM_EFAIL;
+	}
+done_delnode:
+	vmm_devtree_delnode(node);
+	vmm_devtree_dref_node(node);
+
+	return rc;
+}
+
+static struct wboxtest vcpu_irq_deliver = {
+	.name = "vcpu_irq_deliver",
+	.run = vcpu_irq_deliver_run,
+};
+
+static int __init vcpu_irq_deliver_init(void)
+{
+	return wboxtest_register("irq", &vcpu_irq_deliver);
+}
+
+static void __exit vcpu_irq_deliver_exit(void)
+{
+	wboxtest_unregister(&vcpu_irq_deliver);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
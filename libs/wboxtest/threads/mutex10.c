@@ -0,0 +1,342 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file mutex10.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief mutex10 test implementation
+ *
+ * This test checks adaptive spinning and priority inheritance of mutex.
+ *
+ * First, two worker threads pinned on different host CPUs repeatedly
+ * hand-off a mutex (and a semaphore used as sleeping lock) between
+ * them and the average acquire latency of both is reported.
+ *
+ * Second, classic priority inversion is created on the test host CPU
+ * where a low priority thread holds the mutex, a medium priority thread
+ * hogs the host CPU, and a high priority thread blocks on the mutex.
+ * The high priority thread must get the mutex before the medium priority
+ * thread is done hogging the host CPU.
+ */
+
+#include <vmm_error.h>
+#include <vmm_delay.h>
+#include <vmm_mutex.h>
+#include <vmm_semaphore.h>
+#include <vmm_completion.h>
+#include <vmm_stdio.h>
+#include <vmm_timer.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_modules.h>
+#include <libs/mathlib.h>
+#include <libs/stringlib.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"mutex10 test"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			mutex10_init
+#define MODULE_EXIT			mutex10_exit
+
+/* Number of hand-off threads */
+#define NUM_THREADS			2
+
+/* Number of lock acquires per hand-off thread */
+#define NUM_LOOPS			2000
+
+/* Time for which hand-off threads hold the lock */
+#define HANDOFF_HOLD_NSECS		2000ULL
+
+/* Time for which low priority thread holds the mutex */
+#define LOW_HOLD_MSECS			10
+
+/* Time for which medium priority thread hogs the host CPU */
+#define MEDIUM_HOG_MSECS		100
+
+/* Delay after which high priority thread blocks on mutex */
+#define HIGH_DELAY_MSECS		2
+
+/* Global data */
+static struct vmm_thread *workers[NUM_THREADS];
+static struct vmm_thread *low, *medium, *high;
+static DEFINE_MUTEX(mutex1);
+static DEFINE_SEMAPHORE(sem1, 1, 1);
+static struct vmm_completion work_done;
+static struct vmm_completion low_locked;
+static volatile bool use_sem;
+static u64 handoff_nsecs[NUM_THREADS];
+static u64 high_wait_nsecs;
+
+static void mutex10_busy(u64 nsecs)
+{
+	u64 tstamp = vmm_timer_timestamp();
+
+	while ((vmm_timer_timestamp() - tstamp) < nsecs) ;
+}
+
+static int mutex10_handoff_thread_main(void *data)
+{
+	int i, thread_id = (int)(unsigned long)data;
+	u64 tstamp, total = 0;
+
+	for (i = 0; i < NUM_LOOPS; i++) {
+		tstamp = vmm_timer_timestamp();
+		if (use_sem) {
+			vmm_semaphore_down(&sem1);
+		} else {
+			vmm_mutex_lock(&mutex1);
+		}
+		total += vmm_timer_timestamp() - tstamp;
+
+		mutex10_busy(HANDOFF_HOLD_NSECS);
+
+		if (use_sem) {
+			vmm_semaphore_up(&sem1);
+		} else {
+			vmm_mutex_unlock(&mutex1);
+		}
+	}
+
+	handoff_nsecs[thread_id] = udiv64(total, NUM_LOOPS);
+
+	/* Signal work done completion */
+	vmm_completion_complete(&work_done);
+
+	return 0;
+}
+
+static int mutex10_low_thread_main(void *data)
+{
+	vmm_mutex_lock(&mutex1);
+	vmm_completion_complete(&low_locked);
+
+	/* Hold mutex till wall-clock time elapses */
+	mutex10_busy(LOW_HOLD_MSECS * 1000000ULL);
+
+	vmm_mutex_unlock(&mutex1);
+
+	vmm_completion_complete(&work_done);
+
+	return 0;
+}
+
+static int mutex10_medium_thread_main(void *data)
+{
+	mutex10_busy(MEDIUM_HOG_MSECS * 1000000ULL);
+
+	vmm_completion_complete(&work_done);
+
+	return 0;
+}
+
+static int mutex10_high_thread_main(void *data)
+{
+	u64 tstamp;
+
+	vmm_msleep(HIGH_DELAY_MSECS);
+
+	tstamp = vmm_timer_timestamp();
+	vmm_mutex_lock(&mutex1);
+	high_wait_nsecs = vmm_timer_timestamp() - tstamp;
+	vmm_mutex_unlock(&mutex1);
+
+	vmm_completion_complete(&work_done);
+
+	return 0;
+}
+
+static int mutex10_handoff_test(struct vmm_chardev *cdev, u32 test_hcpu)
+{
+	int i, w, done_count;
+	u32 cpu, other_hcpu = test_hcpu;
+	char wname[VMM_FIELD_NAME_SIZE];
+	u8 current_priority = vmm_scheduler_current_priority();
+	u64 avg[2];
+
+	/* Find another online host CPU */
+	for_each_online_cpu(cpu) {
+		if (cpu != test_hcpu) {
+			other_hcpu = cpu;
+			break;
+		}
+	}
+	if (other_hcpu == test_hcpu) {
+		vmm_cprintf(cdev, "handoff: skipped (single host CPU)\n");
+		return VMM_OK;
+	}
+
+	for (i = 0; i < 2; i++) {
+		use_sem = (i) ? TRUE : FALSE;
+		INIT_COMPLETION(&work_done);
+
+		/* Create and start hand-off threads */
+		for (w = 0; w < NUM_THREADS; w++) {
+			vmm_snprintf(wname, VMM_FIELD_NAME_SIZE,
+				     "mutex10_handoff%d", w);
+			workers[w] = vmm_threads_create(wname,
+					mutex10_handoff_thread_main,
+					(void *)(unsigned long)w,
+					current_priority,
+					VMM_THREAD_DEF_TIME_SLICE);
+			if (!workers[w]) {
+				goto fail;
+			}
+			vmm_threads_set_affinity(workers[w],
+				vmm_cpumask_of((w) ? other_hcpu : test_hcpu));
+		}
+		for (w = 0; w < NUM_THREADS; w++) {
+			vmm_threads_start(workers[w]);
+		}
+
+		/* Wait for hand-off threads to complete */
+		for (done_count = 0; done_count < NUM_THREADS; done_count++) {
+			vmm_completion_wait(&work_done);
+		}
+
+		avg[i] = 0;
+		for (w = 0; w < NUM_THREADS; w++) {
+			avg[i] += handoff_nsecs[w];
+			vmm_threads_destroy(workers[w]);
+			workers[w] = NULL;
+		}
+		avg[i] = udiv64(avg[i], NUM_THREADS);
+	}
+
+	vmm_cprintf(cdev, "handoff: mutex %"PRIu64" ns "
+		    "semaphore %"PRIu64" ns\n", avg[0], avg[1]);
+
+	return VMM_OK;
+
+fail:
+	for (w = 0; w < NUM_THREADS; w++) {
+		if (workers[w]) {
+			vmm_threads_destroy(workers[w]);
+			workers[w] = NULL;
+		}
+	}
+	return VMM_EFAIL;
+}
+
+static int mutex10_inversion_test(struct vmm_chardev *cdev, u32 test_hcpu)
+{
+	int done_count, ret = VMM_OK;
+	const struct vmm_cpumask *cpu_mask = vmm_cpumask_of(test_hcpu);
+
+	INIT_COMPLETION(&work_done);
+	INIT_COMPLETION(&low_locked);
+	high_wait_nsecs = 0;
+
+	/* Create low, medium, and high priority threads */
+	low = vmm_threads_create("mutex10_low", mutex10_low_thread_main,
+				 NULL, VMM_THREAD_DEF_PRIORITY - 1,
+				 VMM_THREAD_DEF_TIME_SLICE);
+	medium = vmm_threads_create("mutex10_medium",
+				    mutex10_medium_thread_main,
+				    NULL, VMM_THREAD_DEF_PRIORITY + 1,
+				    VMM_THREAD_DEF_TIME_SLICE);
+	high = vmm_threads_create("mutex10_high", mutex10_high_thread_main,
+				  NULL, VMM_THREAD_DEF_PRIORITY + 2,
+				  VMM_THREAD_DEF_TIME_SLICE);
+	if (!low || !medium || !high) {
+		ret = VMM_EFAIL;
+		goto done;
+	}
+	vmm_threads_set_affinity(low, cpu_mask);
+	vmm_threads_set_affinity(medium, cpu_mask);
+	vmm_threads_set_affinity(high, cpu_mask);
+
+	/* Low priority thread takes the mutex first */
+	vmm_threads_start(low);
+	vmm_completion_wait(&low_locked);
+
+	/* High priority thread blocks on mutex while medium hogs */
+	vmm_threads_start(high);
+	vmm_threads_start(medium);
+
+	/* Wait for threads to complete */
+	for (done_count = 0; done_count < 3; done_count++) {
+		vmm_completion_wait(&work_done);
+	}
+
+	vmm_cprintf(cdev, "inversion: high priority waited %"PRIu64" ns "
+		    "(medium priority hog %d ms)\n",
+		    high_wait_nsecs, MEDIUM_HOG_MSECS);
+
+#ifdef CONFIG_MUTEX_PRIO_INHERIT
+	if (high_wait_nsecs >= (MEDIUM_HOG_MSECS * 1000000ULL)) {
+		vmm_cprintf(cdev, "error: unbounded priority inversion\n");
+		ret = VMM_EFAIL;
+	}
+#endif
+
+done:
+	if (high) {
+		vmm_threads_destroy(high);
+		high = NULL;
+	}
+	if (medium) {
+		vmm_threads_destroy(medium);
+		medium = NULL;
+	}
+	if (low) {
+		vmm_threads_destroy(low);
+		low = NULL;
+	}
+
+	return ret;
+}
+
+static int mutex10_run(struct wboxtest *test, struct vmm_chardev *cdev,
+		       u32 test_hcpu)
+{
+	int ret;
+
+	/* Initialise global data */
+	memset(workers, 0, sizeof(workers));
+	low = medium = high = NULL;
+
+	ret = mutex10_handoff_test(cdev, test_hcpu);
+	if (ret) {
+		return ret;
+	}
+
+	return mutex10_inversion_test(cdev, test_hcpu);
+}
+
+static struct wboxtest mutex10 = {
+	.name = "mutex10",
+	.run = mutex10_run,
+};
+
+static int __init mutex10_init(void)
+{
+	return wboxtest_register("threads", &mutex10);
+}
+
+static void __exit mutex10_exit(void)
+{
+	wboxtest_unregister(&mutex10);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
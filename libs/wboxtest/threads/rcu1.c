@@ -0,0 +1,276 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file rcu1.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief rcu1 test implementation
+ *
+ * This test creates one reader thread pinned on each online host CPU
+ * and all readers repeatedly dereference a shared object under RCU
+ * read lock while the test thread keeps replacing the shared object.
+ * Replaced objects are poisoned and freed either after synchronous
+ * grace period or from RCU callback. Readers check that they never
+ * see a poisoned object and test also checks that all RCU callbacks
+ * were invoked.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_timer.h>
+#include <vmm_rcu.h>
+#include <vmm_completion.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_modules.h>
+#include <libs/mathlib.h>
+#include <libs/stringlib.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"rcu1 test"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			rcu1_init
+#define MODULE_EXIT			rcu1_exit
+
+/* Number of shared object updates */
+#define NUM_UPDATES			128
+
+/* Busy loop iterations inside read-side critical section */
+#define HOLD_LOOPS			64
+
+#define OBJ_MAGIC			0x52435531
+#define OBJ_POISON			0xdeadbeef
+
+struct rcu1_obj {
+	u32 magic;
+	u32 gen;
+	struct vmm_rcu_head rcu;
+};
+
+/* Global data */
+static struct vmm_thread *workers[CONFIG_CPU_COUNT];
+static struct vmm_completion work_done[CONFIG_CPU_COUNT];
+static u64 read_count[CONFIG_CPU_COUNT];
+static u32 error_count[CONFIG_CPU_COUNT];
+static volatile bool stop_readers;
+static volatile u32 callback_count;
+static struct rcu1_obj *shared_obj;
+
+static int rcu1_reader_thread_main(void *data)
+{
+	int j, thread_id = (int)(unsigned long)data;
+	struct rcu1_obj *obj;
+
+	while (!stop_readers) {
+		vmm_rcu_read_lock();
+
+		obj = vmm_rcu_dereference(shared_obj);
+		if (obj->magic != OBJ_MAGIC) {
+			error_count[thread_id]++;
+		}
+		for (j = 0; j < HOLD_LOOPS; j++) {
+			barrier();
+		}
+		if (obj->magic != OBJ_MAGIC) {
+			error_count[thread_id]++;
+		}
+
+		vmm_rcu_read_unlock();
+
+		read_count[thread_id]++;
+	}
+
+	vmm_completion_complete(&work_done[thread_id]);
+
+	return 0;
+}
+
+static void rcu1_obj_free(struct rcu1_obj *obj)
+{
+	obj->magic = OBJ_POISON;
+	vmm_free(obj);
+}
+
+static void rcu1_obj_free_rcu(struct vmm_rcu_head *rhead)
+{
+	rcu1_obj_free(container_of(rhead, struct rcu1_obj, rcu));
+	callback_count++;
+}
+
+static struct rcu1_obj *rcu1_obj_alloc(u32 gen)
+{
+	struct rcu1_obj *obj = vmm_zalloc(sizeof(*obj));
+
+	if (obj) {
+		obj->magic = OBJ_MAGIC;
+		obj->gen = gen;
+		INIT_RCU_HEAD(&obj->rcu);
+	}
+
+	return obj;
+}
+
+static void rcu1_destroy_workers(int nworkers)
+{
+	int w;
+
+	for (w = 0; w < nworkers; w++) {
+		if (workers[w]) {
+			vmm_threads_destroy(workers[w]);
+			workers[w] = NULL;
+		}
+	}
+}
+
+static int rcu1_create_workers(int nworkers)
+{
+	int w;
+	u32 cpu;
+	char wname[VMM_FIELD_NAME_SIZE];
+	u8 current_priority = vmm_scheduler_current_priority();
+
+	w = 0;
+	for_each_online_cpu(cpu) {
+		if (w >= nworkers) {
+			break;
+		}
+
+		vmm_snprintf(wname, VMM_FIELD_NAME_SIZE,
+			     "rcu1_worker%d", w);
+		workers[w] = vmm_threads_create(wname,
+					rcu1_reader_thread_main,
+					(void *)(unsigned long)w,
+					current_priority,
+					VMM_THREAD_DEF_TIME_SLICE);
+		if (workers[w] == NULL) {
+			rcu1_destroy_workers(w);
+			return VMM_EFAIL;
+		}
+		vmm_threads_set_affinity(workers[w], vmm_cpumask_of(cpu));
+		w++;
+	}
+
+	return VMM_OK;
+}
+
+static int rcu1_run(struct wboxtest *test, struct vmm_chardev *cdev,
+		    u32 test_hcpu)
+{
+	int w, ret = VMM_OK, nworkers = vmm_num_online_cpus();
+	u32 i, errors = 0, ncalls = 0;
+	u64 reads = 0, tstamp, sync_ns = 0;
+	struct rcu1_obj *obj, *old;
+
+	/* Initialise global data */
+	memset(workers, 0, sizeof(workers));
+	memset(read_count, 0, sizeof(read_count));
+	memset(error_count, 0, sizeof(error_count));
+	stop_readers = FALSE;
+	callback_count = 0;
+	shared_obj = rcu1_obj_alloc(0);
+	if (!shared_obj) {
+		return VMM_ENOMEM;
+	}
+
+	/* Start readers */
+	ret = rcu1_create_workers(nworkers);
+	if (ret) {
+		goto free_obj;
+	}
+	for (w = 0; w < nworkers; w++) {
+		INIT_COMPLETION(&work_done[w]);
+		vmm_threads_start(workers[w]);
+	}
+
+	/* Keep replacing shared object while readers are running */
+	for (i = 1; i <= NUM_UPDATES; i++) {
+		obj = rcu1_obj_alloc(i);
+		if (!obj) {
+			ret = VMM_ENOMEM;
+			break;
+		}
+
+		old = shared_obj;
+		vmm_rcu_assign_pointer(shared_obj, obj);
+
+		if (i & 0x1) {
+			tstamp = vmm_timer_timestamp();
+			vmm_rcu_synchronize();
+			sync_ns += vmm_timer_timestamp() - tstamp;
+			rcu1_obj_free(old);
+		} else {
+			vmm_rcu_call(&old->rcu, rcu1_obj_free_rcu);
+			ncalls++;
+		}
+	}
+
+	/* Stop readers and wait for pending callbacks */
+	stop_readers = TRUE;
+	for (w = 0; w < nworkers; w++) {
+		vmm_completion_wait(&work_done[w]);
+		reads += read_count[w];
+		errors += error_count[w];
+	}
+	rcu1_destroy_workers(nworkers);
+	vmm_rcu_barrier();
+
+	vmm_cprintf(cdev, "readers %d reads %"PRIu64" updates %d "
+		    "avg synchronize %"PRIu64" ns\n", nworkers, reads,
+		    i - 1, udiv64(sync_ns, (NUM_UPDATES + 1) / 2));
+
+	if (errors) {
+		vmm_cprintf(cdev, "error: readers saw %d freed objects\n",
+			    errors);
+		ret = VMM_EFAIL;
+	}
+	if (callback_count != ncalls) {
+		vmm_cprintf(cdev, "error: %d of %d RCU callbacks invoked\n",
+			    callback_count, ncalls);
+		ret = VMM_EFAIL;
+	}
+
+free_obj:
+	rcu1_obj_free(shared_obj);
+	shared_obj = NULL;
+
+	return ret;
+}
+
+static struct wboxtest rcu1 = {
+	.name = "rcu1",
+	.run = rcu1_run,
+};
+
+static int __init rcu1_init(void)
+{
+	return wboxtest_register("threads", &rcu1);
+}
+
+static void __exit rcu1_exit(void)
+{
+	wboxtest_unregister(&rcu1);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
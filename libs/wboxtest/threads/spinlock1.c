@@ -0,0 +1,254 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file spinlock1.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief spinlock1 test implementation
+ *
+ * This test creates one worker thread pinned on each online host CPU
+ * and all workers repeatedly acquire the same spinlock (and then the
+ * same rwlock for writing) to increment a shared counter. It checks
+ * the final value of the shared counter and reports lock acquire
+ * latency percentiles under contention.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_stdio.h>
+#include <vmm_timer.h>
+#include <vmm_spinlocks.h>
+#include <vmm_completion.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_modules.h>
+#include <libs/libsort.h>
+#include <libs/mathlib.h>
+#include <libs/stringlib.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"spinlock1 test"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			spinlock1_init
+#define MODULE_EXIT			spinlock1_exit
+
+/* Number of lock acquires per worker */
+#define NUM_ITERS			4096
+
+/* Busy loop iterations inside critical section */
+#define HOLD_LOOPS			32
+
+/* Global data */
+static struct vmm_thread *workers[CONFIG_CPU_COUNT];
+static struct vmm_completion work_done[CONFIG_CPU_COUNT];
+static u64 *samples;
+static volatile bool use_rwlock;
+static volatile u64 shared_counter;
+static DEFINE_SPINLOCK(shared_lock);
+static DEFINE_RWLOCK(shared_rwlock);
+
+static int spinlock1_worker_thread_main(void *data)
+{
+	int i, j, thread_id = (int)(unsigned long)data;
+	u64 tstamp, *lat = &samples[thread_id * NUM_ITERS];
+	irq_flags_t flags;
+
+	for (i = 0; i < NUM_ITERS; i++) {
+		tstamp = vmm_timer_timestamp();
+		if (use_rwlock) {
+			vmm_write_lock_irqsave_lite(&shared_rwlock, flags);
+		} else {
+			vmm_spin_lock_irqsave_lite(&shared_lock, flags);
+		}
+		lat[i] = vmm_timer_timestamp() - tstamp;
+
+		shared_counter++;
+		for (j = 0; j < HOLD_LOOPS; j++) {
+			barrier();
+		}
+
+		if (use_rwlock) {
+			vmm_write_unlock_irqrestore_lite(&shared_rwlock, flags);
+		} else {
+			vmm_spin_unlock_irqrestore_lite(&shared_lock, flags);
+		}
+	}
+
+	vmm_completion_complete(&work_done[thread_id]);
+
+	return 0;
+}
+
+static int spinlock1_cmp(const void *a, const void *b)
+{
+	u64 x = *(const u64 *)a, y = *(const u64 *)b;
+
+	if (x < y) {
+		return -1;
+	}
+
+	return (x > y) ? 1 : 0;
+}
+
+static int spinlock1_do_test(struct vmm_chardev *cdev,
+			     const char *name, int nworkers)
+{
+	int w;
+	u64 num = (u64)nworkers * NUM_ITERS;
+
+	/* Reset shared counter */
+	shared_counter = 0;
+
+	/* Start workers and wait for them to finish */
+	for (w = 0; w < nworkers; w++) {
+		INIT_COMPLETION(&work_done[w]);
+		vmm_threads_start(workers[w]);
+	}
+	for (w = 0; w < nworkers; w++) {
+		vmm_completion_wait(&work_done[w]);
+	}
+
+	/* Check shared counter */
+	if (shared_counter != num) {
+		vmm_cprintf(cdev, "error: %s shared counter %"PRIu64
+			    " expected %"PRIu64"\n", name,
+			    (u64)shared_counter, num);
+		return VMM_EFAIL;
+	}
+
+	/* Report acquire latency percentiles */
+	simple_sort(samples, num, sizeof(u64), spinlock1_cmp, NULL);
+	vmm_cprintf(cdev, "%-10s %-8d %-12"PRIu64" %-12"PRIu64
+		    " %-12"PRIu64" %-12"PRIu64"\n", name, nworkers,
+		    samples[udiv64(num * 50, 100)],
+		    samples[udiv64(num * 90, 100)],
+		    samples[udiv64(num * 99, 100)],
+		    samples[num - 1]);
+
+	return VMM_OK;
+}
+
+static void spinlock1_destroy_workers(int nworkers)
+{
+	int w;
+
+	for (w = 0; w < nworkers; w++) {
+		if (workers[w]) {
+			vmm_threads_destroy(workers[w]);
+			workers[w] = NULL;
+		}
+	}
+}
+
+static int spinlock1_create_workers(int nworkers)
+{
+	int w;
+	u32 cpu;
+	char wname[VMM_FIELD_NAME_SIZE];
+	u8 current_priority = vmm_scheduler_current_priority();
+
+	w = 0;
+	for_each_online_cpu(cpu) {
+		if (w >= nworkers) {
+			break;
+		}
+
+		vmm_snprintf(wname, VMM_FIELD_NAME_SIZE,
+			     "spinlock1_worker%d", w);
+		workers[w] = vmm_threads_create(wname,
+					spinlock1_worker_thread_main,
+					(void *)(unsigned long)w,
+					current_priority,
+					VMM_THREAD_DEF_TIME_SLICE);
+		if (workers[w] == NULL) {
+			spinlock1_destroy_workers(w);
+			return VMM_EFAIL;
+		}
+		vmm_threads_set_affinity(workers[w], vmm_cpumask_of(cpu));
+		w++;
+	}
+
+	return VMM_OK;
+}
+
+static int spinlock1_run(struct wboxtest *test, struct vmm_chardev *cdev,
+			 u32 test_hcpu)
+{
+	int ret, nworkers = vmm_num_online_cpus();
+
+	/* Initialise global data */
+	memset(workers, 0, sizeof(workers));
+	samples = vmm_malloc((u64)nworkers * NUM_ITERS * sizeof(u64));
+	if (!samples) {
+		return VMM_ENOMEM;
+	}
+
+	vmm_cprintf(cdev, "%-10s %-8s %-12s %-12s %-12s %-12s\n",
+		    "Lock", "Workers", "p50 (ns)", "p90 (ns)",
+		    "p99 (ns)", "Max (ns)");
+
+	/* Spinlock contention */
+	use_rwlock = FALSE;
+	ret = spinlock1_create_workers(nworkers);
+	if (ret) {
+		goto free_samples;
+	}
+	ret = spinlock1_do_test(cdev, "spinlock", nworkers);
+	spinlock1_destroy_workers(nworkers);
+	if (ret) {
+		goto free_samples;
+	}
+
+	/* Rwlock writer contention */
+	use_rwlock = TRUE;
+	ret = spinlock1_create_workers(nworkers);
+	if (ret) {
+		goto free_samples;
+	}
+	ret = spinlock1_do_test(cdev, "rwlock", nworkers);
+	spinlock1_destroy_workers(nworkers);
+
+free_samples:
+	vmm_free(samples);
+	samples = NULL;
+
+	return ret;
+}
+
+static struct wboxtest spinlock1 = {
+	.name = "spinlock1",
+	.run = spinlock1_run,
+};
+
+static int __init spinlock1_init(void)
+{
+	return wboxtest_register("threads", &spinlock1);
+}
+
+static void __exit spinlock1_exit(void)
+{
+	wboxtest_unregister(&spinlock1);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
@@ -0,0 +1,447 @@
+/**
+ * Copyright (c) 2026 Anup Patel.
+ * All rights reserved.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+ *
+ * @file parallel_read.c
+ * @author Anup Patel (anup@brainfault.org)
+ * @brief parallel_read test implementation
+ *
+ * This test creates two RAM backed block devices holding generated CPIO
+ * images and mounts them such that second image covers a directory of
+ * the first image. Multiple threads then open many files of both mount
+ * points at the same time (more than initial size of VFS file table)
+ * and read them using vfs_read(), vfs_pread(), and vfs_readv() while
+ * also looking up absent files. The contents of all files are verified
+ * and both mount points must be unmountable once threads are done.
+ */
+
+#include <vmm_error.h>
+#include <vmm_heap.h>
+#include <vmm_host_aspace.h>
+#include <vmm_host_ram.h>
+#include <vmm_completion.h>
+#include <vmm_stdio.h>
+#include <vmm_scheduler.h>
+#include <vmm_threads.h>
+#include <vmm_modules.h>
+#include <drv/rbd.h>
+#include <libs/stringlib.h>
+#include <libs/vfs.h>
+#include <libs/wboxtest.h>
+
+#define MODULE_DESC			"parallel_read test"
+#define MODULE_AUTHOR			"Anup Patel"
+#define MODULE_LICENSE			"GPL"
+#define MODULE_IPRIORITY		(WBOXTEST_IPRIORITY+1)
+#define MODULE_INIT			parallel_read_init
+#define MODULE_EXIT			parallel_read_exit
+
+/* Number of reader threads */
+#define NUM_THREADS			4
+
+/* Number of iterations per reader thread */
+#define NUM_LOOPS			8
+
+/* Number of files in each CPIO image */
+#define NUM_FILES			24
+
+/* Number of files kept open at a time by each reader thread */
+#define NUM_OPEN			12
+
+/* Size of read buffer of each reader thread */
+#define READ_CHUNK			1024
+
+/* Base mount path used when root filesystem is already mounted */
+#define BASE_DIR			"/wbt_vfs"
+
+/* Global data */
+static struct vmm_thread *workers[NUM_THREADS];
+static struct vmm_completion work_done;
+static u8 rbufs[NUM_THREADS][READ_CHUNK];
+static int failures[NUM_THREADS];
+static char base[VFS_MAX_PATH];
+
+static u32 parallel_read_file_size(u32 file)
+{
+	return 3000 + file * 517;
+}
+
+static u8 parallel_read_file_byte(u32 seed, u32 pos)
+{
+	return (u8)(pos * 31 + seed * 7 + (pos >> 8));
+}
+
+/* Seed of file in first image is file number and
+ * seed of file in second image is file number + NUM_FILES
+ */
+static void parallel_read_file_path(char *path, u32 seed)
+{
+	if (seed < NUM_FILES) {
+		vmm_snprintf(path, VFS_MAX_PATH, "%s/d0/f%02d", base, seed);
+	} else {
+		vmm_snprintf(path, VFS_MAX_PATH, "%s/d1/f%02d",
+			     base, seed - NUM_FILES);
+	}
+}
+
+static u32 parallel_read_cpio_add(u8 *img, u32 off, u32 ino,
+				  const char *name, u32 mode,
+				  u32 size, u32 seed)
+{
+	u32 i, namesize = strlen(name) + 1;
+	char hdr[112];
+
+	if (img) {
+		vmm_snprintf(hdr, sizeof(hdr), "070701"
+			"%08x%08x%08x%08x%08x%08x%08x"
+			"%08x%08x%08x%08x%08x%08x",
+			ino, mode, 0, 0, 1, 0, size,
+			0, 0, 0, 0, namesize, 0);
+		memcpy(&img[off], hdr, 110);
+		memcpy(&img[off + 110], name, namesize);
+	}
+	off = (off + 110 + namesize + 3) & ~0x3;
+
+	if (img) {
+		for (i = 0; i < size; i++) {
+			img[off + i] = parallel_read_file_byte(seed, i);
+		}
+	}
+	off = (off + size + 3) & ~0x3;
+
+	return off;
+}
+
+/* Generate CPIO image (or only compute its size if img == NULL).
+ * First image has directories d0 (with files) and d1 (to be covered)
+ * whereas second image has files in its root directory.
+ */
+static u32 parallel_read_cpio_gen(u8 *img, bool second)
+{
+	u32 f, off = 0, ino = 1;
+	char name[VFS_MAX_NAME];
+
+	if (!second) {
+		off = parallel_read_cpio_add(img, off, ino++, "d0",
+					     0040755, 0, 0);
+		off = parallel_read_cpio_add(img, off, ino++, "d1",
+					     0040755, 0, 0);
+	}
+
+	for (f = 0; f < NUM_FILES; f++) {
+		vmm_snprintf(name, sizeof(name),
+			     (second) ? "f%02d" : "d0/f%02d", f);
+		off = parallel_read_cpio_add(img, off, ino++, name, 0100644,
+					parallel_read_file_size(f),
+					(second) ? f + NUM_FILES : f);
+	}
+
+	return parallel_read_cpio_add(img, off, 0, "TRAILER!!!", 0, 0, 0);
+}
+
+static struct rbd *parallel_read_rbd_create(const char *name, bool second)
+{
+	u8 *img;
+	u32 len;
+	struct rbd *d;
+	physical_addr_t pa;
+	physical_size_t sz;
+
+	len = parallel_read_cpio_gen(NULL, second);
+	sz = VMM_ROUNDUP2_PAGE_SIZE(len);
+
+	img = vmm_zalloc(sz);
+	if (!img) {
+		return NULL;
+	}
+	parallel_read_cpio_gen(img, second);
+
+	if (!vmm_host_ram_alloc(&pa, sz, VMM_PAGE_SHIFT)) {
+		vmm_free(img);
+		return NULL;
+	}
+	vmm_host_memory_write(pa, img, sz, TRUE);
+	vmm_free(img);
+
+	/* RAM is already allocated so ignore overlap and
+	 * let rbd_destroy() free it.
+	 */
+	d = rbd_create(name, pa, sz, TRUE);
+	if (!d) {
+		vmm_host_ram_free(pa, sz);
+	}
+
+	return d;
+}
+
+static int parallel_read_verify(int fd, u32 seed, u8 *buf)
+{
+	u32 i, pos, len, size = parallel_read_file_size(seed % NUM_FILES);
+	struct vfs_iovec iov[2];
+	size_t rd;
+
+	/* Sequential read of whole file */
+	pos = 0;
+	while (pos < size) {
+		rd = vfs_read(fd, buf, READ_CHUNK);
+		if (!rd) {
+			return VMM_EIO;
+		}
+		for (i = 0; i < rd; i++) {
+			if (buf[i] != parallel_read_file_byte(seed, pos + i)) {
+				return VMM_EFAIL;
+			}
+		}
+		pos += rd;
+	}
+	if ((pos != size) || vfs_read(fd, buf, READ_CHUNK)) {
+		return VMM_EFAIL;
+	}
+
+	/* Positional reads must not depend on file position */
+	for (pos = seed % 97; pos < size; pos += size / 3) {
+		len = min((u32)READ_CHUNK, size - pos);
+		if (vfs_pread(fd, buf, READ_CHUNK, pos) != len) {
+			return VMM_EIO;
+		}
+		for (i = 0; i < len; i++) {
+			if (buf[i] != parallel_read_file_byte(seed, pos + i)) {
+				return VMM_EFAIL;
+			}
+		}
+	}
+
+	/* Vectored read across two buffers */
+	pos = size / 2;
+	iov[0].iov_base = buf;
+	iov[0].iov_len = 100;
+	iov[1].iov_base = buf + 100;
+	iov[1].iov_len = READ_CHUNK - 100;
+	len = min((u32)READ_CHUNK, size - pos);
+	if (vfs_readv(fd, iov, 2, pos) != len) {
+		return VMM_EIO;
+	}
+	for (i = 0; i < len; i++) {
+		if (buf[i] != parallel_read_file_byte(seed, pos + i)) {
+			return VMM_EFAIL;
+		}
+	}
+
+	return VMM_OK;
+}
+
+static int parallel_read_thread_main(void *data)
+{
+	int i, l, fd, fds[NUM_OPEN];
+	u32 seeds[NUM_OPEN];
+	int thread_id = (int)(unsigned long)data;
+	u8 *buf = rbufs[thread_id];
+	char path[VFS_MAX_PATH];
+
+	for (l = 0; l < NUM_LOOPS; l++) {
+		/* Open many files (overlapping with other threads) */
+		for (i = 0; i < NUM_OPEN; i++) {
+			seeds[i] = (thread_id * 7 + l * 5 + i) % (2 * NUM_FILES);
+			parallel_read_file_path(path, seeds[i]);
+			fds[i] = vfs_open(path, O_RDONLY, 0);
+			if (fds[i] < 0) {
+				failures[thread_id]++;
+			}
+		}
+
+		/* Absent files must not be found */
+		vmm_snprintf(path, sizeof(path), "%s/d%d/absent%d",
+			     base, l & 1, thread_id);
+		fd = vfs_open(path, O_RDONLY, 0);
+		if (fd >= 0) {
+			failures[thread_id]++;
+			vfs_close(fd);
+		}
+
+		/* Read and close all files */
+		for (i = 0; i < NUM_OPEN; i++) {
+			if (fds[i] < 0) {
+				continue;
+			}
+			if (parallel_read_verify(fds[i], seeds[i], buf)) {
+				failures[thread_id]++;
+			}
+			if (vfs_close(fds[i])) {
+				failures[thread_id]++;
+			}
+		}
+	}
+
+	/* Signal work done completion */
+	vmm_completion_complete(&work_done);
+
+	return 0;
+}
+
+static bool parallel_read_root_mounted(void)
+{
+	u32 i;
+	struct mount *m;
+
+	for (i = 0; i < vfs_mount_count(); i++) {
+		m = vfs_mount_get(i);
+		if (m && !strcmp(m->m_path, "/")) {
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static int parallel_read_run(struct wboxtest *test, struct vmm_chardev *cdev,
+			     u32 test_hcpu)
+{
+	int rc, w, done_count, ret = VMM_OK;
+	bool base_created = FALSE;
+	char mpath0[VFS_MAX_PATH], mpath1[VFS_MAX_PATH];
+	u8 current_priority = vmm_scheduler_current_priority();
+	char wname[VMM_FIELD_NAME_SIZE];
+	struct rbd *d0, *d1;
+
+	/* Initialise global data */
+	memset(workers, 0, sizeof(workers));
+	memset(failures, 0, sizeof(failures));
+	INIT_COMPLETION(&work_done);
+
+	/* Create RAM backed block devices */
+	d0 = parallel_read_rbd_create("wbt_vfs0", FALSE);
+	d1 = parallel_read_rbd_create("wbt_vfs1", TRUE);
+	if (!d0 || !d1) {
+		vmm_cprintf(cdev, "error: failed to create RBD instances\n");
+		ret = VMM_ENOMEM;
+		goto done_destroy;
+	}
+
+	/* Mount first image on root (or a new directory) */
+	if (parallel_read_root_mounted()) {
+		strlcpy(base, BASE_DIR, sizeof(base));
+		base_created = (vfs_mkdir(base, S_IRWXU) == VMM_OK);
+		strlcpy(mpath0, base, sizeof(mpath0));
+	} else {
+		base[0] = '\0';
+		strlcpy(mpath0, "/", sizeof(mpath0));
+	}
+	rc = vfs_mount(mpath0, "cpio", "wbt_vfs0", MOUNT_RDONLY);
+	if (rc) {
+		vmm_cprintf(cdev, "parallel_read: skipped (cannot mount %s)\n",
+			    mpath0);
+		goto done_rmdir;
+	}
+
+	/* Mount second image on directory of first image */
+	vmm_snprintf(mpath1, sizeof(mpath1), "%s/d1", base);
+	rc = vfs_mount(mpath1, "cpio", "wbt_vfs1", MOUNT_RDONLY);
+	if (rc) {
+		vmm_cprintf(cdev, "error: failed to mount %s\n", mpath1);
+		ret = rc;
+		goto done_unmount0;
+	}
+
+	/* Create and start reader threads */
+	for (w = 0; w < NUM_THREADS; w++) {
+		vmm_snprintf(wname, VMM_FIELD_NAME_SIZE,
+			     "parallel_read%d", w);
+		workers[w] = vmm_threads_create(wname,
+					parallel_read_thread_main,
+					(void *)(unsigned long)w,
+					current_priority,
+					VMM_THREAD_DEF_TIME_SLICE);
+		if (!workers[w]) {
+			ret = VMM_EFAIL;
+			goto done_destroy_threads;
+		}
+	}
+	for (w = 0; w < NUM_THREADS; w++) {
+		vmm_threads_start(workers[w]);
+	}
+
+	/* Wait for reader threads to complete */
+	for (done_count = 0; done_count < NUM_THREADS; done_count++) {
+		vmm_completion_wait(&work_done);
+	}
+
+	for (w = 0; w < NUM_THREADS; w++) {
+		if (failures[w]) {
+			vmm_cprintf(cdev, "error: reader%d had %d failures\n",
+				    w, failures[w]);
+			ret = VMM_EFAIL;
+		}
+	}
+
+done_destroy_threads:
+	for (w = 0; w < NUM_THREADS; w++) {
+		if (workers[w]) {
+			vmm_threads_destroy(workers[w]);
+			workers[w] = NULL;
+		}
+	}
+
+	/* Nothing is open so both mount points must be unmountable */
+	rc = vfs_unmount(mpath1);
+	if (rc) {
+		vmm_cprintf(cdev, "error: failed to unmount %s (%d)\n",
+			    mpath1, rc);
+		ret = rc;
+	}
+done_unmount0:
+	rc = vfs_unmount(mpath0);
+	if (rc) {
+		vmm_cprintf(cdev, "error: failed to unmount %s (%d)\n",
+			    mpath0, rc);
+		ret = rc;
+	}
+done_rmdir:
+	if (base_created) {
+		vfs_rmdir(base);
+	}
+done_destroy:
+	if (d1) {
+		rbd_destroy(d1);
+	}
+	if (d0) {
+		rbd_destroy(d0);
+	}
+
+	return ret;
+}
+
+static struct wboxtest parallel_read = {
+	.name = "parallel_read",
+	.run = parallel_read_run,
+};
+
+static int __init parallel_read_init(void)
+{
+	return wboxtest_register("vfs", &parallel_read);
+}
+
+static void __exit parallel_read_exit(void)
+{
+	wboxtest_unregister(&parallel_read);
+}
+
+VMM_DECLARE_MODULE(MODULE_DESC,
+			MODULE_AUTHOR,
+			MODULE_LICENSE,
+			MODULE_IPRIORITY,
+			MODULE_INIT,
+			MODULE_EXIT);
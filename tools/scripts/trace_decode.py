@@ -0,0 +1,175 @@
+#! /usr/bin/env python3
+#/**
+# Copyright (c) 2026 Anup Patel.
+# All rights reserved.
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+#
+# @file trace_decode.py
+# @author Anup Patel (anup@brainfault.org)
+# @brief Decode binary trace file saved by "trace dump <vfs_path>" command
+# */
+
+import bisect
+import struct
+import sys
+from optparse import OptionParser
+
+# Must match struct vmm_trace_file_header, struct vmm_trace_file_chunk
+# and struct vmm_trace_record in core/include/vmm_trace.h
+TRACE_MAGIC = b"XVTRACE"
+TRACE_VERSION = 1
+HEADER_FMT = "<8sIIII"
+CHUNK_FMT = "<IIQ"
+RECORD_FMT = "<QIHHQQ"
+
+EVENTS = [
+	"sched_switch",
+	"vcpu_irq_assert",
+	"vcpu_irq_deassert",
+	"devemu_read",
+	"devemu_write",
+	"virtio_kick",
+	"virtio_notify",
+	"timer_expiry",
+	"ipi_send",
+	"ipi_recv",
+	"hirq_entry",
+	"hirq_exit",
+]
+
+class SymbolTable:
+	def __init__(self, path):
+		self.addrs = []
+		self.names = []
+		if not path:
+			return
+		syms = []
+		with open(path, "r") as f:
+			for line in f:
+				fields = line.split()
+				if len(fields) < 3 or fields[1] not in "tTwW":
+					continue
+				syms.append((int(fields[0], 16), fields[2]))
+		syms.sort()
+		self.addrs = [s[0] for s in syms]
+		self.names = [s[1] for s in syms]
+
+	def lookup(self, addr):
+		i = bisect.bisect_right(self.addrs, addr) - 1
+		if i < 0:
+			return "0x%x" % addr
+		off = addr - self.addrs[i]
+		if off:
+			return "%s+0x%x" % (self.names[i], off)
+		return self.names[i]
+
+def format_args(syms, ev, a0, a1, a2):
+	if ev == 0:
+		prev = "none" if a1 == 0xffffffffffffffff else "%d" % a1
+		return "prev=%s next=%d tslice=%dns" % (prev, a0, a2)
+	if ev in (1, 2):
+		s = "vcpu=%d irq=%d" % (a0, a1)
+		if ev == 1:
+			s += " reason=0x%x" % a2
+		return s
+	if ev in (3, 4):
+		space = "io" if a0 & 0x100 else "mmio"
+		return "%s addr=0x%x len=%d data=0x%x" % \
+			(space, a1, a0 & 0xff, a2)
+	if ev in (5, 6):
+		return "guest=%d vq=%d type=%d" % (a0, a1, a2)
+	if ev == 7:
+		return "handler=%s late=%dns" % (syms.lookup(a1), a2)
+	if ev in (8, 9):
+		peer = "dst" if ev == 8 else "src"
+		kind = "sync" if a2 else "async"
+		return "%s=%d func=%s %s" % (peer, a0, syms.lookup(a1), kind)
+	if ev in (10, 11):
+		return "hirq=%d" % a1
+	return "arg0=0x%x arg1=0x%x arg2=0x%x" % (a0, a1, a2)
+
+def read_exact(f, size):
+	buf = f.read(size)
+	if len(buf) != size:
+		raise EOFError("truncated trace file")
+	return buf
+
+def main():
+	usage = "Usage: %prog [options] <trace_file>"
+	parser = OptionParser(usage=usage)
+	parser.add_option("-m", "--map", dest="map",
+			  help="System.map or nm output for symbol lookup",
+			  metavar="FILE")
+	parser.add_option("-c", "--cpu", dest="cpu", type="int", default=-1,
+			  help="Only show records of given host CPU")
+	parser.add_option("-e", "--event", dest="events", action="append",
+			  default=[], help="Only show given event (repeatable)")
+	parser.add_option("-r", "--relative", action="store_true",
+			  dest="relative", default=False,
+			  help="Show timestamps relative to first record")
+	(options, args) = parser.parse_args()
+
+	if len(args) != 1:
+		parser.print_help()
+		sys.exit(1)
+
+	for e in options.events:
+		if e not in EVENTS:
+			sys.stderr.write("Unknown event %s\n" % e)
+			sys.exit(1)
+
+	syms = SymbolTable(options.map)
+	recs = []
+
+	with open(args[0], "rb") as f:
+		magic, version, rec_size, cpu_count, mask = \
+			struct.unpack(HEADER_FMT,
+				      read_exact(f, struct.calcsize(HEADER_FMT)))
+		if magic.rstrip(b"\0") != TRACE_MAGIC:
+			sys.stderr.write("Invalid trace file magic\n")
+			sys.exit(1)
+		if version != TRACE_VERSION or \
+		   rec_size != struct.calcsize(RECORD_FMT):
+			sys.stderr.write("Unsupported trace file version %d "
+					 "(record size %d)\n" % (version, rec_size))
+			sys.exit(1)
+
+		print("# event mask 0x%08x, %d CPUs" % (mask, cpu_count))
+		for i in range(cpu_count):
+			cpu, nr, lost = struct.unpack(CHUNK_FMT,
+				read_exact(f, struct.calcsize(CHUNK_FMT)))
+			print("# CPU%d: %d records, %d lost" % (cpu, nr, lost))
+			for j in range(nr):
+				ts, seq, ev, a0, a1, a2 = \
+					struct.unpack(RECORD_FMT,
+						      read_exact(f, rec_size))
+				recs.append((ts, cpu, seq, ev, a0, a1, a2))
+
+	recs.sort()
+	base = recs[0][0] if (recs and options.relative) else 0
+	for ts, cpu, seq, ev, a0, a1, a2 in recs:
+		if options.cpu >= 0 and cpu != options.cpu:
+			continue
+		name = EVENTS[ev] if ev < len(EVENTS) else "event%d" % ev
+		if options.events and name not in options.events:
+			continue
+		ts -= base
+		print("[%6d.%09d] CPU%-3d %-18s %s" %
+		      (ts // 1000000000, ts % 1000000000, cpu, name,
+		       format_args(syms, ev, a0, a1, a2)))
+
+if __name__ == "__main__":
+	main()